@@ -0,0 +1,191 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiomixer.h"
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIOMIXER_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define AUDIOMIXER_NEON
+#include <arm_neon.h>
+#endif
+
+QAtomicInt AudioMixer::bufferMemory;
+
+AudioMixer::AudioMixer()
+    : nextBuffer{0}, buffersQueued{0}, playing{false}, underruns{0}, volume{256},
+      framesize{(av_DefaultSettings.audio_frame_duration * TOXAV_MIXER_SAMPLE_RATE) / 1000}
+{
+    alGenSources(1, &source);
+    alSourcei(source, AL_LOOPING, AL_FALSE);
+    alGenBuffers(TOXAV_AUDIO_BUFFERS, buffers);
+    mixed.resize(2*framesize);
+    scaled.resize(2*framesize);
+    // Every buffer holds a mixed frame once playout went round them all
+    bufferMemory.fetchAndAddRelaxed(TOXAV_AUDIO_BUFFERS * mixed.size() * 2);
+}
+
+AudioMixer::~AudioMixer()
+{
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, 0); // Unqueues everything
+    alDeleteSources(1, &source);
+    alDeleteBuffers(TOXAV_AUDIO_BUFFERS, buffers);
+    bufferMemory.fetchAndAddRelaxed(-TOXAV_AUDIO_BUFFERS * mixed.size() * 2);
+    qDebug() << QString("Core: audio mixer had %1 underruns").arg(underruns);
+}
+
+void AudioMixer::removeCall(ToxCall* call)
+{
+    streams.remove(call);
+}
+
+void AudioMixer::setVolume(int Volume)
+{
+    volume = std::max(Volume, 0);
+}
+
+void AudioMixer::addSaturate(int16_t* dst, const int16_t* src, int count)
+{
+    int x = 0;
+#if defined(AUDIOMIXER_SSE2)
+    for (; x+8 <= count; x+=8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_adds_epi16(a, b));
+    }
+#elif defined(AUDIOMIXER_NEON)
+    for (; x+8 <= count; x+=8)
+        vst1q_s16(dst + x, vqaddq_s16(vld1q_s16(dst + x), vld1q_s16(src + x)));
+#endif
+    for (; x<count; x++)
+        dst[x] = std::min(std::max(dst[x] + src[x], -32768), 32767);
+}
+
+void AudioMixer::resample(Stream& stream, const int16_t* data, int samples, int channels, int sampleRate)
+{
+    // Linear, interpolating from the last sample of the previous frame into this one
+    double step = (double)sampleRate / TOXAV_MIXER_SAMPLE_RATE;
+    for (; stream.phase < samples - 1; stream.phase += step)
+    {
+        int i = std::floor(stream.phase);
+        double f = stream.phase - i;
+        for (int c=0; c<2; c++)
+        {
+            int channel = channels == 1 ? 0 : c;
+            int a = i < 0 ? stream.last[c] : data[i*channels + channel];
+            int b = data[(i+1)*channels + channel];
+            stream.pending.append(a + std::lround((b - a) * f));
+        }
+    }
+    stream.phase -= samples;
+    stream.last[0] = data[(samples-1)*channels];
+    stream.last[1] = data[(samples-1)*channels + (channels == 1 ? 0 : 1)];
+}
+
+bool AudioMixer::fill(ToxCall* call, Stream& stream)
+{
+    int samples, channels, sampleRate, waited;
+    while (stream.pending.size() < 2*framesize)
+    {
+        if (!call->jitter.pop(popped, samples, channels, sampleRate, &waited))
+            return false;
+        if (waited >= 0)
+            call->audioStats.record(AudioStats::Jitter, waited * 1000LL);
+        if (channels < 1 || channels > 2 || samples <= 0)
+            continue;
+        // Heard after what the source has queued and what we haven't mixed yet
+        if (LatencyProbe::isEnabled())
+            call->probe.process(popped.constData(), samples, channels, sampleRate,
+                                (buffersQueued * framesize + stream.pending.size() / 2) * 1000000LL / TOXAV_MIXER_SAMPLE_RATE);
+        resample(stream, popped.constData(), samples, channels, sampleRate);
+    }
+    return true;
+}
+
+int AudioMixer::reclaimBuffers()
+{
+    ALint processed = 0;
+    alGetSourcei(source, AL_BUFFERS_PROCESSED, &processed);
+    if (processed)
+    {
+        // They come back in the order we queued them, so they're the next ones in the ring
+        ALuint bufids[TOXAV_AUDIO_BUFFERS];
+        alSourceUnqueueBuffers(source, processed, bufids);
+        buffersQueued -= processed;
+    }
+    return buffersQueued;
+}
+
+void AudioMixer::playout(const QVector<ToxCall*>& calls)
+{
+    while (reclaimBuffers() < TOXAV_AUDIO_PLAYOUT_FRAMES)
+    {
+        // What this frame waits for once queued, the rest of the playing buffer and those after it
+        ALint offset = 0;
+        if (buffersQueued)
+            alGetSourcei(source, AL_SAMPLE_OFFSET, &offset);
+        qint64 ahead = std::max<qint64>(buffersQueued*framesize - offset, 0) * 1000000 / TOXAV_MIXER_SAMPLE_RATE;
+
+        bool any = false;
+        std::fill(mixed.begin(), mixed.end(), 0);
+        for (ToxCall* call : calls)
+        {
+            Stream& stream = streams[call];
+            // A call that's buffering pads with silence, the others keep playing
+            if (!fill(call, stream) && stream.pending.isEmpty())
+                continue;
+            int count = std::min(stream.pending.size(), 2*framesize);
+            int gain = call->volume.loadAcquire() * volume / 256;
+            if (gain == 256)
+            {
+                addSaturate(mixed.data(), stream.pending.constData(), count);
+            }
+            else
+            {
+                for (int i=0; i<count; i++)
+                    scaled[i] = std::min(std::max(stream.pending.at(i) * gain / 256, -32768), 32767);
+                addSaturate(mixed.data(), scaled.constData(), count);
+            }
+            stream.pending.remove(0, count);
+            call->audioStats.record(AudioStats::Playout, ahead);
+            any = true;
+        }
+        if (!any)
+            return;
+
+        ALuint bufid = buffers[nextBuffer];
+        nextBuffer = (nextBuffer + 1) % TOXAV_AUDIO_BUFFERS;
+        alBufferData(bufid, AL_FORMAT_STEREO16, mixed.constData(), mixed.size() * 2, TOXAV_MIXER_SAMPLE_RATE);
+        alSourceQueueBuffers(source, 1, &bufid);
+        buffersQueued++;
+    }
+
+    ALint state;
+    alGetSourcei(source, AL_SOURCE_STATE, &state);
+    if (state != AL_PLAYING && buffersQueued)
+    {
+        if (playing)
+            underruns++;
+        playing = true;
+        alSourcePlay(source);
+    }
+}
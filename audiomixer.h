@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOMIXER_H
+#define AUDIOMIXER_H
+
+#include <cstdint>
+#include <QVector>
+#include <QHash>
+#include <QAtomicInt>
+#include "coreav.h"
+
+/// Mixes the received audio of every call into one OpenAL source, so the driver resamples and
+/// mixes a single stream however many calls we're in. Each call's jitter buffer output is resampled
+/// to TOXAV_MIXER_SAMPLE_RATE stereo, scaled by its volume and summed with saturating adds.
+/// Everything here runs on the audio thread, which creates and destroys it.
+class AudioMixer
+{
+public:
+    AudioMixer();
+    ~AudioMixer();
+
+    void removeCall(ToxCall* call); ///< Forgets what we have left of the call's audio
+    /// Queues mixed frames until TOXAV_AUDIO_PLAYOUT_FRAMES are waiting on the source
+    void playout(const QVector<ToxCall*>& calls);
+    void setVolume(int volume); ///< In 1/256, applied after the calls' own volume. Where ducking would go
+
+    quint32 getUnderruns() const {return underruns;} ///< The source ran dry
+    static int getBufferMemory() {return bufferMemory.load();} ///< Of the mixers' AL buffers, from any thread
+    static void addSaturate(int16_t* dst, const int16_t* src, int count); ///< Vectorized where the CPU allows it
+
+private:
+    /// A call's audio resampled to our rate, waiting to be mixed
+    struct Stream
+    {
+        Stream() : phase{0} {last[0] = last[1] = 0;}
+        QVector<int16_t> pending; ///< Interleaved stereo
+        double phase; ///< Where the next output sample is in the next input frame, -1 is last
+        int16_t last[2];
+    };
+    bool fill(ToxCall* call, Stream& stream); ///< Pulls from the jitter buffer until we have a frame, false if it's dry
+    static void resample(Stream& stream, const int16_t* data, int samples, int channels, int sampleRate);
+    int reclaimBuffers(); ///< Returns how many buffers are still queued
+
+private:
+    ALuint source;
+    ALuint buffers[TOXAV_AUDIO_BUFFERS]; ///< Reused in this order
+    int nextBuffer, buffersQueued;
+    bool playing;
+    quint32 underruns;
+    int volume;
+    int framesize; ///< Stereo samples per mixed frame
+    QHash<ToxCall*, Stream> streams;
+    QVector<int16_t> mixed, scaled, popped;
+    static QAtomicInt bufferMemory;
+};
+
+#endif // AUDIOMIXER_H
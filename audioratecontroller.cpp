@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audioratecontroller.h"
+#include "jitterbuffer.h"
+#include "audiostats.h"
+#include "coredefines.h"
+#include <QDebug>
+#include <algorithm>
+
+AudioRateController::AudioRateController()
+    : level{0}, lastLost{0}, lastSendFailures{0}, goodWindows{0}
+{
+    levels.append({64000, 20});
+}
+
+void AudioRateController::reset(int bitrate, int frameDuration)
+{
+    // Opus is still fine for speech at 16kbps, and takes frames of up to 60ms
+    levels.clear();
+    const int above[] = {TOXAV_AUDIO_RATE_MAX_BITRATE, 96000};
+    for (int step : above)
+        if (step > bitrate && step <= TOXAV_AUDIO_RATE_MAX_BITRATE)
+            levels.append({step, frameDuration});
+    level = levels.size();
+    levels.append({bitrate, frameDuration});
+    const Level ladder[] = {{48000, 20}, {32000, 40}, {24000, 40}, {16000, 60}};
+    for (const Level& step : ladder)
+        if (step.bitrate < bitrate)
+            levels.append({step.bitrate, std::max(step.frameDuration, frameDuration)});
+
+    goodWindows = 0;
+    lastLost = lastSendFailures = 0;
+    window.start();
+}
+
+bool AudioRateController::evaluate(const JitterBuffer& jitter, const AudioStats& stats, int peerFrameDuration)
+{
+    qint64 elapsed = window.restart();
+    quint32 lostFrames = jitter.getLost(), sendFailures = stats.getSendFailures();
+    quint32 lost = lostFrames - lastLost, failed = sendFailures - lastSendFailures;
+    lastLost = lostFrames;
+    lastSendFailures = sendFailures;
+
+    // What should have gone each way during the window, in frames
+    qint64 expected = elapsed / std::max(peerFrameDuration, 1), sent = elapsed / levels[level].frameDuration;
+    if (expected <= 0 || sent <= 0)
+        return false;
+    int loss = lost * 100 / expected, failures = failed * 100 / sent, jitterMs = jitter.getJitter();
+    bool congested = loss > TOXAV_AUDIO_RATE_MAX_LOSS || failures > TOXAV_AUDIO_RATE_MAX_LOSS
+                     || jitterMs > TOXAV_AUDIO_RATE_MAX_JITTER;
+    bool clean = !failed && loss * 4 <= TOXAV_AUDIO_RATE_MAX_LOSS && jitterMs * 2 < TOXAV_AUDIO_RATE_MAX_JITTER;
+
+    int oldLevel = level;
+    if (congested)
+    {
+        goodWindows = 0;
+        level = std::min(level+1, levels.size()-1);
+    }
+    else if (clean && ++goodWindows >= TOXAV_AUDIO_RATE_RECOVERY)
+    {
+        goodWindows = 0;
+        level = std::max(level-1, 0);
+    }
+    else if (!clean)
+    {
+        goodWindows = 0;
+    }
+
+    if (level != oldLevel)
+        qDebug() << QString("AudioRateController: %1% lost, %2% failed to send, %3ms jitter, now at %4bps in %5ms frames")
+                    .arg(loss).arg(failures).arg(jitterMs).arg(levels[level].bitrate).arg(levels[level].frameDuration);
+    return level != oldLevel;
+}
+
+int AudioRateController::getBitrate() const
+{
+    return levels[level].bitrate;
+}
+
+int AudioRateController::getFrameDuration() const
+{
+    return levels[level].frameDuration;
+}
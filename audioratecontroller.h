@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIORATECONTROLLER_H
+#define AUDIORATECONTROLLER_H
+
+#include <QElapsedTimer>
+#include <QVector>
+
+class JitterBuffer;
+class AudioStats;
+
+/// Adapts a call's audio bitrate and frame duration to how well the link carries it.
+/// Every TOXAV_AUDIO_RATE_WINDOW it looks at the frames the jitter buffer found lost, how much
+/// the arrivals jittered and how often toxav_send_audio failed. A bad link steps down a ladder
+/// of lower bitrates and longer frames, fewer and smaller packets being what it copes with best.
+/// After TOXAV_AUDIO_RATE_RECOVERY clean windows in a row it steps back up, past the call's
+/// default settings up to TOXAV_AUDIO_RATE_MAX_BITRATE. Only the Core thread uses it.
+class AudioRateController
+{
+public:
+    AudioRateController();
+
+    void reset(int bitrate, int frameDuration); ///< Starts over at the call's settings, a clean link climbs above them
+    /// Call every TOXAV_AUDIO_RATE_WINDOW with the call's stats, true if the settings should change
+    bool evaluate(const JitterBuffer& jitter, const AudioStats& stats, int peerFrameDuration);
+    int getBitrate() const; ///< In bits per second
+    int getFrameDuration() const; ///< In ms
+
+private:
+    struct Level
+    {
+        int bitrate;
+        int frameDuration;
+    };
+
+    QVector<Level> levels; ///< Best quality first
+    int level;
+    QElapsedTimer window; ///< Since we last evaluated
+    quint32 lastLost, lastSendFailures; ///< The counters are per call, we look at their deltas
+    int goodWindows; ///< In a row
+};
+
+#endif // AUDIORATECONTROLLER_H
@@ -0,0 +1,155 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiostats.h"
+#include "jitterbuffer.h"
+#include <QMutexLocker>
+#include <QFile>
+#include <QTextStream>
+#include <QDateTime>
+#include <QDebug>
+#include <cstring>
+#include <algorithm>
+
+const int AudioStats::bucketLimits[AudioStats::bucketCount-1] = {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000};
+QString AudioStats::dumpFile;
+
+static const char* stageNames[AudioStats::StageCount] = {"capture", "encode", "arrival gap", "jitter buffer", "playout"};
+
+AudioStats::AudioStats()
+{
+    reset();
+}
+
+void AudioStats::reset()
+{
+    QMutexLocker locker(&mutex);
+    memset(histograms, 0, sizeof(histograms));
+    arrivalClock.invalidate();
+    encodeErrors = sendErrors = 0;
+}
+
+void AudioStats::record(Stage stage, qint64 usecs)
+{
+    int ms = usecs / 1000;
+    int bucket = 0;
+    while (bucket < bucketCount-1 && ms >= bucketLimits[bucket])
+        bucket++;
+
+    QMutexLocker locker(&mutex);
+    Histogram& h = histograms[stage];
+    h.buckets[bucket]++;
+    h.count++;
+    h.sum += usecs;
+    h.max = std::max(h.max, usecs);
+}
+
+void AudioStats::received()
+{
+    qint64 gap = -1;
+    {
+        QMutexLocker locker(&mutex);
+        if (arrivalClock.isValid())
+            gap = arrivalClock.nsecsElapsed() / 1000;
+        arrivalClock.start();
+    }
+    if (gap >= 0)
+        record(Arrival, gap);
+}
+
+void AudioStats::encodeFailed()
+{
+    QMutexLocker locker(&mutex);
+    encodeErrors++;
+}
+
+void AudioStats::sendFailed()
+{
+    QMutexLocker locker(&mutex);
+    sendErrors++;
+}
+
+quint32 AudioStats::getSendFailures() const
+{
+    QMutexLocker locker(&mutex);
+    return sendErrors;
+}
+
+int AudioStats::Histogram::percentile(double p) const
+{
+    quint32 seen = 0;
+    for (int i=0; i<bucketCount-1; i++)
+        if ((seen += buckets[i]) >= p * count)
+            return bucketLimits[i];
+    return max / 1000;
+}
+
+QString AudioStats::Histogram::summary() const
+{
+    if (!count)
+        return QString("-");
+    return QString("avg %1ms, p50 <%2ms, p95 <%3ms, max %4ms").arg(sum / count / 1000.0, 0, 'f', 1)
+            .arg(percentile(0.5)).arg(percentile(0.95)).arg(max / 1000.0, 0, 'f', 1);
+}
+
+QString AudioStats::report(const JitterBuffer& jitter, bool detailed) const
+{
+    QString text;
+    QTextStream out(&text);
+    {
+        QMutexLocker locker(&mutex);
+        for (int i=0; i<StageCount; i++)
+        {
+            out << stageNames[i] << ": " << histograms[i].summary() << "\n";
+            if (!detailed || !histograms[i].count)
+                continue;
+            for (int b=0; b<bucketCount; b++)
+            {
+                if (b < bucketCount-1)
+                    out << "    <" << bucketLimits[b] << "ms: ";
+                else
+                    out << "    more: ";
+                out << histograms[i].buckets[b] << "\n";
+            }
+        }
+        out << "encode errors: " << encodeErrors << ", send errors: " << sendErrors << "\n";
+    }
+    out << "jitter " << jitter.getJitter() << "ms, playout delay " << jitter.getTargetDelay()
+        << "ms, " << jitter.getConcealed() << " concealed, " << jitter.getDropped() << " dropped, "
+        << jitter.getUnderruns() << " underruns";
+    return text;
+}
+
+void AudioStats::setDumpFile(const QString& path)
+{
+    dumpFile = path;
+}
+
+void AudioStats::dump(int callId, const JitterBuffer& jitter) const
+{
+    if (dumpFile.isEmpty())
+        return;
+
+    QFile file(dumpFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text))
+    {
+        qWarning() << "AudioStats: Can't open" << dumpFile;
+        return;
+    }
+    QTextStream out(&file);
+    out << "Call " << callId << " ended " << QDateTime::currentDateTime().toString(Qt::ISODate) << "\n"
+        << report(jitter, true) << "\n\n";
+}
@@ -0,0 +1,74 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOSTATS_H
+#define AUDIOSTATS_H
+
+#include <QMutex>
+#include <QElapsedTimer>
+#include <QString>
+
+class JitterBuffer;
+
+/// Where the time goes in a call's audio, as histograms of each stage of the pipeline.
+/// Written from the audio and toxav threads, read from any.
+class AudioStats
+{
+public:
+    enum Stage
+    {
+        Capture, ///< From alcCaptureSamples to toxav_send_audio, what we buffered before a frame was complete
+        Encode, ///< toxav_prepare_audio_frame
+        Arrival, ///< Time between two received frames, from playCallAudio
+        Jitter, ///< In the jitter buffer
+        Playout, ///< From the mixer to the AL source playing it
+        StageCount
+    };
+
+    AudioStats();
+    void reset(); ///< For a new call
+    void record(Stage stage, qint64 usecs);
+    void received(); ///< Records the Arrival gap
+    void encodeFailed();
+    void sendFailed();
+    quint32 getSendFailures() const; ///< Since the call started
+
+    /// A few lines per stage, with every histogram bucket if detailed
+    QString report(const JitterBuffer& jitter, bool detailed = false) const;
+    static void setDumpFile(const QString& path); ///< Where every call appends its report when it ends
+    void dump(int callId, const JitterBuffer& jitter) const;
+
+private:
+    static const int bucketCount = 12;
+    static const int bucketLimits[bucketCount-1]; ///< Upper bounds in ms, the last bucket has no bound
+    struct Histogram
+    {
+        quint32 buckets[bucketCount];
+        quint32 count;
+        qint64 sum, max;
+        QString summary() const;
+        int percentile(double p) const; ///< Upper bound of the bucket, in ms
+    };
+
+private:
+    mutable QMutex mutex;
+    Histogram histograms[StageCount];
+    QElapsedTimer arrivalClock;
+    quint32 encodeErrors, sendErrors;
+    static QString dumpFile;
+};
+
+#endif // AUDIOSTATS_H
@@ -0,0 +1,295 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "audiothread.h"
+#include "audiomixer.h"
+#include "settings.h"
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+QAtomicInt AudioThread::micLevel;
+QAtomicInt AudioThread::micVoice;
+
+AudioThread::AudioThread(ALCdevice* InDev)
+    : inDev{InDev}, stopping{0}, mixer{nullptr}, volume{256}, probeSamples{-1}
+{
+}
+
+AudioThread::~AudioThread()
+{
+    stopping.storeRelease(1);
+    wait();
+}
+
+bool AudioThread::sameEncoding(const ToxAvCSettings& a, const ToxAvCSettings& b)
+{
+    return a.audio_bitrate == b.audio_bitrate && a.audio_frame_duration == b.audio_frame_duration
+            && a.audio_sample_rate == b.audio_sample_rate && a.audio_channels == b.audio_channels;
+}
+
+void AudioThread::addCall(ToxCall* call)
+{
+    QMutexLocker locker(&callsMutex);
+    if (calls.contains(call))
+        return;
+    bool first = calls.isEmpty();
+    calls.append(call);
+    addEncoding(call, captured.size());
+
+    if (!first)
+        return;
+    captured.clear();
+    for (Encoding& encoding : encodings)
+        encoding.offset = 0;
+    probeSamples = -1;
+    if (LatencyProbe::isEnabled())
+        qDebug() << "AudioThread: Sending the latency probe instead of the microphone";
+    else if (inDev)
+        alcCaptureStart(inDev);
+    else
+        qWarning() << "AudioThread: No capture device, not sending audio";
+    statsClock.start();
+    stopping.storeRelease(0);
+    start(QThread::TimeCriticalPriority);
+}
+
+void AudioThread::addEncoding(ToxCall* call, int offset)
+{
+    // The device is opened with the default settings, we can't send anything else from it
+    const ToxAvCSettings& settings = call->codecSettings;
+    int framesize = (settings.audio_frame_duration * settings.audio_sample_rate) / 1000;
+    if (framesize <= 0 || settings.audio_sample_rate != av_DefaultSettings.audio_sample_rate
+            || settings.audio_channels != 1)
+    {
+        qWarning() << "AudioThread: Can't capture for the codec settings of call" << call->callId << ", not sending audio";
+    }
+    else
+    {
+        auto it = std::find_if(encodings.begin(), encodings.end(),
+                               [&](const Encoding& e){return sameEncoding(e.settings, settings);});
+        if (it == encodings.end())
+        {
+            Encoding encoding;
+            encoding.settings = settings;
+            encoding.framesize = framesize;
+            encoding.offset = offset;
+            encoding.vad.reset(Settings::getInstance().getVoiceDetection());
+            encodings.append(encoding);
+            it = encodings.end() - 1;
+            encoded.resize(std::max(encoded.size(), framesize*2));
+        }
+        it->calls.append(call);
+    }
+}
+
+void AudioThread::removeCall(ToxCall* call)
+{
+    {
+        QMutexLocker locker(&callsMutex);
+        if (!calls.removeOne(call))
+            return;
+        if (mixer)
+            mixer->removeCall(call);
+        for (int i=encodings.size()-1; i>=0; i--)
+            if (encodings[i].calls.removeOne(call) && encodings[i].calls.isEmpty())
+                encodings.remove(i);
+        if (!calls.isEmpty())
+            return;
+        stopping.storeRelease(1);
+    }
+
+    // Ending one call used to stop the microphone for all of them, now only the last one does
+    wait();
+    if (inDev && !LatencyProbe::isEnabled())
+        alcCaptureStop(inDev);
+}
+
+void AudioThread::updateCall(ToxCall* call)
+{
+    QMutexLocker locker(&callsMutex);
+    if (!calls.contains(call))
+        return;
+    // A new encoding starts where the old one was, so nothing is said twice or skipped
+    int offset = captured.size();
+    for (int i=encodings.size()-1; i>=0; i--)
+    {
+        if (!encodings[i].calls.removeOne(call))
+            continue;
+        offset = encodings[i].offset;
+        if (encodings[i].calls.isEmpty())
+            encodings.remove(i);
+    }
+    addEncoding(call, offset);
+}
+
+void AudioThread::setVolume(int Volume)
+{
+    volume.storeRelease(Volume);
+}
+
+int AudioThread::getMicLevel(bool* voice)
+{
+    if (voice)
+        *voice = micVoice.loadAcquire();
+    return micLevel.loadAcquire();
+}
+
+void AudioThread::run()
+{
+    {
+        QMutexLocker locker(&callsMutex);
+        mixer = new AudioMixer;
+    }
+
+    while (!stopping.loadAcquire())
+    {
+        QMutexLocker locker(&callsMutex);
+        capture();
+        mixer->setVolume(volume.loadAcquire());
+        mixer->playout(calls);
+        reportStats();
+        int sleep = nextWakeup();
+        locker.unlock();
+
+        usleep(sleep);
+    }
+
+    QMutexLocker locker(&callsMutex);
+    delete mixer;
+    mixer = nullptr;
+}
+
+void AudioThread::capture()
+{
+    ALint samples = 0;
+    if (LatencyProbe::isEnabled())
+    {
+        // The probe's clicks instead of the microphone, as much of them as the clock says we'd have captured
+        const int sampleRate = av_DefaultSettings.audio_sample_rate;
+        qint64 now = LatencyProbe::now();
+        if (probeSamples < 0)
+            probeSamples = now * sampleRate / 1000000;
+        samples = now * sampleRate / 1000000 - probeSamples;
+        if (samples > 0)
+        {
+            int old = captured.size();
+            captured.resize(old + samples);
+            LatencyProbe::generate(captured.data() + old, samples, sampleRate, probeSamples * 1000000 / sampleRate);
+            probeSamples += samples;
+        }
+    }
+    else if (inDev)
+    {
+        alcGetIntegerv(inDev, ALC_CAPTURE_SAMPLES, sizeof(samples), &samples);
+        if (samples > 0)
+        {
+            int old = captured.size();
+            captured.resize(old + samples);
+            alcCaptureSamples(inDev, captured.data() + old, samples);
+        }
+    }
+
+    // Everything that's complete goes out now, a late wakeup doesn't turn into latency
+    for (Encoding& encoding : encodings)
+    {
+        for (; captured.size() - encoding.offset >= encoding.framesize; encoding.offset += encoding.framesize)
+        {
+            const int16_t* frame = captured.constData() + encoding.offset;
+            // How long ago the frame was complete, by what we captured after it
+            qint64 waited = (captured.size() - encoding.offset - encoding.framesize) * 1000000LL
+                            / encoding.settings.audio_sample_rate;
+            // Silence is skipped for everyone, before the encoder gets to spend anything on it
+            bool send = encoding.vad.process(frame, encoding.framesize, encoding.settings.audio_sample_rate);
+            // The meter shows what the calls hear, so nothing while they're all muted
+            bool muted = std::all_of(encoding.calls.constBegin(), encoding.calls.constEnd(),
+                                     [](ToxCall* call){return call->muteMic.loadAcquire() != 0;});
+            micLevel.storeRelease(muted ? 0 : encoding.vad.getLevel());
+            micVoice.storeRelease(!muted && encoding.vad.isVoice());
+            if (!send)
+                continue;
+            // The first unmuted call encodes, the others get the same packet
+            int size = -1;
+            qint64 encodeTime = 0;
+            for (ToxCall* call : encoding.calls)
+            {
+                // Muted calls still advance, so unmuting doesn't send what was said meanwhile
+                if (call->muteMic.loadAcquire())
+                    continue;
+                if (size < 0)
+                {
+                    QElapsedTimer timer;
+                    timer.start();
+                    size = toxav_prepare_audio_frame(call->toxav, call->callId, encoded.data(), encoded.size(),
+                                                     frame, encoding.framesize);
+                    encodeTime = timer.nsecsElapsed() / 1000;
+                    if (size < 0)
+                    {
+                        qDebug() << "Core: toxav_prepare_audio_frame error";
+                        call->audioStats.encodeFailed();
+                        break;
+                    }
+                }
+                call->audioStats.record(AudioStats::Encode, encodeTime);
+                if (toxav_send_audio(call->toxav, call->callId, encoded.data(), size) < 0)
+                {
+                    qDebug() << "Core: toxav_send_audio error";
+                    call->audioStats.sendFailed();
+                    continue;
+                }
+                call->audioStats.record(AudioStats::Capture, waited);
+            }
+        }
+    }
+
+    // Forget what every encoding has sent
+    int done = captured.size();
+    for (const Encoding& encoding : encodings)
+        done = std::min(done, encoding.offset);
+    if (done > 0)
+    {
+        captured.remove(0, done);
+        for (Encoding& encoding : encodings)
+            encoding.offset -= done;
+    }
+}
+
+int AudioThread::nextWakeup() const
+{
+    const int sampleRate = av_DefaultSettings.audio_sample_rate;
+    // Without anything to send the playout still needs a frame's worth of pacing
+    int missing = (av_DefaultSettings.audio_frame_duration * sampleRate) / 1000;
+    for (const Encoding& encoding : encodings)
+        missing = std::min(missing, encoding.framesize - (captured.size() - encoding.offset));
+    return std::max<qint64>(missing * 1000000LL / sampleRate, 1000);
+}
+
+void AudioThread::reportStats()
+{
+    if (statsClock.elapsed() < TOX_LATENCY_REPORT_INTERVAL)
+        return;
+    statsClock.restart();
+
+    for (const ToxCall* call : calls)
+    {
+        const JitterBuffer& jitter = call->jitter;
+        qDebug() << QString("Core: call %1 jitter %2ms, playout delay %3ms, buffered %4ms, latency %5ms, "
+                            "%6 concealed, %7 dropped, %8 underruns")
+                    .arg(call->callId).arg(jitter.getJitter()).arg(jitter.getTargetDelay()).arg(jitter.getDepth())
+                    .arg(jitter.getLatency()).arg(jitter.getConcealed()).arg(jitter.getDropped()).arg(jitter.getUnderruns());
+    }
+    qDebug() << QString("Core: audio mixer %1 underruns").arg(mixer->getUnderruns());
+}
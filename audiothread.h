@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef AUDIOTHREAD_H
+#define AUDIOTHREAD_H
+
+#include <QThread>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QVector>
+#include <QElapsedTimer>
+#include "coreav.h"
+#include "voicedetector.h"
+
+class AudioMixer;
+
+/// Captures, encodes and sends the audio of every call, and mixes what their jitter buffers release.
+/// The microphone is read once: each frame is encoded once per distinct codec setting and the same
+/// packet goes to every unmuted call using it. It runs at real-time priority so a busy Core thread
+/// can't delay it, sends every complete frame each time it wakes up, and sleeps until the next
+/// frame should be complete rather than polling. ToxAv locks its calls, it's safe to send from here.
+/// Only this thread touches the output source, through the mixer. It's shared by every Core in the
+/// process, each call is sent with its own Core's toxav. Frames a VoiceDetector finds silent aren't
+/// even encoded. With the LatencyProbe enabled, its clicks are sent instead of the microphone.
+class AudioThread : public QThread
+{
+public:
+    explicit AudioThread(ALCdevice* InDev);
+    ~AudioThread();
+    void addCall(ToxCall* call); ///< The first call starts capturing
+    void removeCall(ToxCall* call); ///< Returns once we're done with the call, the last one stops capturing
+    void updateCall(ToxCall* call); ///< Sends with the call's new codecSettings from the next frame on
+    void setVolume(int volume); ///< Of everything we play, in 1/256
+    static int getMicLevel(bool* voice = nullptr); ///< Of the last captured frame, 0 to 100, and whether it was sent as speech
+
+protected:
+    void run();
+
+private:
+    /// The calls that can share encoded frames, and how far they've got in the captured samples
+    struct Encoding
+    {
+        ToxAvCSettings settings;
+        int framesize;
+        int offset;
+        VoiceDetector vad; ///< On the frames of this size
+        QVector<ToxCall*> calls;
+    };
+    static bool sameEncoding(const ToxAvCSettings& a, const ToxAvCSettings& b);
+    void addEncoding(ToxCall* call, int offset); ///< Where the call's codecSettings are sent, a new one starts at offset
+    void capture(); ///< Reads what the device has and sends every complete frame to every call
+    void reportStats(); ///< Logs the jitter buffers every TOX_LATENCY_REPORT_INTERVAL
+    int nextWakeup() const; ///< Microseconds until the next frame should be complete
+
+private:
+    ALCdevice* inDev;
+    QMutex callsMutex; ///< Held for a whole iteration, removeCall waits for it
+    QVector<ToxCall*> calls;
+    QVector<Encoding> encodings;
+    QAtomicInt stopping;
+    QVector<int16_t> captured; ///< Samples not sent to every encoding yet
+    QVector<uint8_t> encoded;
+    AudioMixer* mixer; ///< Lives while the thread runs
+    QAtomicInt volume;
+    QElapsedTimer statsClock;
+    qint64 probeSamples; ///< Generated by the LatencyProbe since the clock started, -1 until the first capture
+    static QAtomicInt micLevel, micVoice; ///< Read by the GUI
+};
+
+#endif // AUDIOTHREAD_H
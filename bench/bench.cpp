@@ -0,0 +1,126 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "bench.h"
+#include "widget/videoconvert.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSysInfo>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+QString Bench::filter;
+
+void Bench::setFilter(const QString& Filter)
+{
+    filter = Filter;
+}
+
+bool Bench::enabled(const QString& name)
+{
+    return filter.isEmpty() || name.contains(filter);
+}
+
+static void printLine(const QJsonObject& object)
+{
+    QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "%s\n", line.constData());
+    fflush(stdout);
+}
+
+void Bench::printEnvironment(const QString& tag)
+{
+    QJsonObject environment;
+    environment["environment"] = true;
+    environment["date"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    environment["qt"] = qVersion();
+    environment["threads"] = QThread::idealThreadCount();
+    environment["videoconvert"] = VideoConvert::implementation();
+    if (!tag.isEmpty())
+        environment["tag"] = tag;
+    printLine(environment);
+}
+
+void Bench::run(const QString& name, const char* unit, double units, const std::function<void()>& body)
+{
+    if (!enabled(name))
+        return;
+
+    // Warms up the caches and finds how many iterations make a round
+    int iterations = 1;
+    body();
+    for (;;)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i=0; i<iterations; i++)
+            body();
+        if (timer.elapsed() >= BENCH_ROUND_TIME || iterations >= 1<<24)
+            break;
+        iterations *= 2;
+    }
+
+    QVector<qint64> roundNs;
+    for (int round=0; round<BENCH_ROUNDS; round++)
+    {
+        QElapsedTimer timer;
+        timer.start();
+        for (int i=0; i<iterations; i++)
+            body();
+        roundNs << timer.nsecsElapsed();
+    }
+    report(name, unit, units, iterations, roundNs);
+}
+
+void Bench::once(const QString& name, const char* unit, double units, const std::function<void()>& body)
+{
+    if (!enabled(name))
+        return;
+
+    QElapsedTimer timer;
+    timer.start();
+    body();
+    report(name, unit, units, 1, QVector<qint64>{timer.nsecsElapsed()});
+}
+
+void Bench::fail(const QString& name, const QString& error)
+{
+    QJsonObject result;
+    result["name"] = name;
+    result["error"] = error;
+    printLine(result);
+}
+
+void Bench::report(const QString& name, const char* unit, double units, int iterations, QVector<qint64> roundNs)
+{
+    std::sort(roundNs.begin(), roundNs.end());
+    double best = double(roundNs.first()) / iterations;
+    double median = double(roundNs[roundNs.size() / 2]) / iterations;
+
+    QJsonObject result;
+    result["name"] = name;
+    result["unit"] = unit;
+    result["units"] = units;
+    result["iterations"] = iterations;
+    result["best_ns"] = best;
+    result["median_ns"] = median;
+    result["per_second"] = best > 0 ? units * 1e9 / best : 0;
+    printLine(result);
+}
@@ -0,0 +1,61 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <QString>
+#include <QVector>
+#include <functional>
+
+#define BENCH_ROUNDS 5
+#define BENCH_ROUND_TIME 100 // ms, the iterations of a round double until it takes that long
+
+/// Times the hot paths and prints one JSON object per line on stdout, so results can be diffed and tracked.
+/// Each result has the name, the unit of work, the iterations per round, the best and median nanoseconds
+/// per iteration and how many units that makes per second.
+class Bench
+{
+public:
+    static void setFilter(const QString& filter); ///< Only the benchmarks whose name contains it run
+    static bool enabled(const QString& name);
+    static void printEnvironment(const QString& tag); ///< The first line, what the numbers were measured on, and the run's label
+
+    /// For micro benchmarks, repeated until a round takes BENCH_ROUND_TIME. One call of body processes units of unit
+    static void run(const QString& name, const char* unit, double units, const std::function<void()>& body);
+    /// For macro benchmarks too slow to repeat, body runs once
+    static void once(const QString& name, const char* unit, double units, const std::function<void()>& body);
+    static void fail(const QString& name, const QString& error); ///< Reported instead of a result
+
+private:
+    static void report(const QString& name, const char* unit, double units, int iterations, QVector<qint64> roundNs);
+
+private:
+    static QString filter;
+};
+
+/// The benchmarks themselves, each runs the ones of its area that pass the filter
+class Benchmarks
+{
+public:
+    static void videoConvert(); ///< What Camera does to every capture and NetCamView to every frame it shows
+    static void formatting(); ///< MessageAction::getMessage and SmileyPack::smileyfied
+    static void chatArea(); ///< ChatAreaWidget filling up with 10k and 100k rows, one by one and as a backlog
+    static void friendList(); ///< FriendList lookups among 5k friends
+    static void fileTransfer(); ///< The sendFileChunks loop between two toxes on the loopback
+};
+
+#endif // BENCH_H
@@ -0,0 +1,346 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "bench.h"
+#include "filereadahead.h"
+#include "friend.h"
+#include "friendlist.h"
+#include "smileypack.h"
+#include "widget/chatareawidget.h"
+#include "widget/tool/chataction.h"
+#include "widget/videoconvert.h"
+#include <tox/tox.h>
+#include <QApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTemporaryFile>
+#include <QThread>
+#include <QTimer>
+#include <algorithm>
+#include <vector>
+
+#define BENCH_FRIENDS 5000
+#define BENCH_FILE_SIZE 64*1024*1024
+#define BENCH_CONNECT_TIMEOUT 60*1000
+#define BENCH_TRANSFER_TIMEOUT 5*60*1000
+#define BENCH_TOX_FIRST_PORT 33445 // toxcore's default port range
+#define BENCH_TOX_LAST_PORT 33545
+
+namespace
+{
+QStringList chatCorpus()
+{
+    return {
+        "hi", "hey, how are you? :)", "lol", "ok", "brb 5 min",
+        "did you see https://github.com/tux3/qTox/pull/123 yet?",
+        "> I think the build is broken\nyes, since the merge :(",
+        "check www.example.com/some/long/path?with=query&and=params#fragment",
+        "<script>alert(\"no\")</script> & other things that need escaping",
+        "So I tried compiling it with the new toolchain and it failed at link time, "
+        "something about missing symbols in libsodium. Had to rebuild it from source :/ :D ;)",
+    };
+}
+
+/// A gradient with some noise, so nothing is trivially compressible or constant
+std::vector<uint8_t> makeImage(int width, int height, int bytesPerPixel)
+{
+    std::vector<uint8_t> image(width * height * bytesPerPixel);
+    uint32_t seed = 12345;
+    for (size_t i=0; i<image.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        image[i] = uint8_t((i / bytesPerPixel) % width + (seed >> 28));
+    }
+    return image;
+}
+}
+
+void Benchmarks::videoConvert()
+{
+    const QSize sizes[] = {{640, 480}, {1280, 720}};
+    for (const QSize& size : sizes)
+    {
+        int w = size.width(), h = size.height();
+        QString suffix = QString(".%1x%2").arg(w).arg(h);
+        std::vector<uint8_t> bgr = makeImage(w, h, 3), yuyv = makeImage(w, h, 2), rgb = makeImage(w, h, 4);
+        std::vector<uint8_t> y(w*h), u((w+1)/2 * ((h+1)/2)), v(u.size());
+        int cw = (w+1)/2;
+
+        Bench::run("video.bgrToI420" + suffix, "frame", 1, [&]{
+            VideoConvert::bgrToI420(bgr.data(), w*3, w, h, y.data(), w, u.data(), cw, v.data(), cw);
+        });
+        Bench::run("video.yuyvToI420" + suffix, "frame", 1, [&]{
+            VideoConvert::yuyvToI420(yuyv.data(), w*2, w, h, y.data(), w, u.data(), cw, v.data(), cw);
+        });
+        Bench::run("video.rgb32ToI420" + suffix, "frame", 1, [&]{
+            VideoConvert::rgb32ToI420(rgb.data(), w*4, w, h, y.data(), w, u.data(), cw, v.data(), cw);
+        });
+        // NetCamView shows frames at their size or shrunk to its widget
+        Bench::run("video.i420ToRgb32" + suffix, "frame", 1, [&]{
+            VideoConvert::i420ToRgb32(y.data(), w, u.data(), cw, v.data(), cw, w, h, rgb.data(), w*4, w, h);
+        });
+        Bench::run("video.i420ToRgb32.half" + suffix, "frame", 1, [&]{
+            VideoConvert::i420ToRgb32(y.data(), w, u.data(), cw, v.data(), cw, w, h, rgb.data(), w*4, w/2, h/2);
+        });
+    }
+}
+
+void Benchmarks::formatting()
+{
+    if (!Bench::enabled("format"))
+        return;
+
+    // The pack loads on the thread pool, the numbers only mean something with its emoticons
+    SmileyPack& pack = SmileyPack::getInstance();
+    if (pack.getEmoticons().isEmpty())
+    {
+        QEventLoop loop;
+        QObject::connect(&pack, &SmileyPack::packChanged, &loop, &QEventLoop::quit);
+        QTimer::singleShot(5000, &loop, SLOT(quit()));
+        loop.exec();
+    }
+    if (pack.getEmoticons().isEmpty())
+        Bench::fail("format.smileyfied", "no smiley pack");
+
+    QStringList chat = chatCorpus();
+    double chars = 0;
+    for (const QString& message : chat)
+        chars += message.size();
+    QString paste;
+    for (int i=0; i<2000; i++)
+        paste += QString("[%1] DEBUG core.cpp:%2 > bootstrap node 144.76.60.215:33445 http://tox.im %3 :)\n")
+                    .arg(i).arg(100 + i % 300).arg(QString(i % 40, 'x'));
+
+    Bench::run("format.getMessage.chat", "char", chars, [&]{
+        for (const QString& message : chat)
+            MessageAction("author", message, "12:00", false).getMessage();
+    });
+    Bench::run("format.getMessage.paste", "char", paste.size(), [&]{
+        MessageAction("author", paste, "12:00", false).getMessage();
+    });
+    Bench::run("format.smileyfied.chat", "char", chars, [&]{
+        for (const QString& message : chat)
+            pack.smileyfied(message);
+    });
+    Bench::run("format.smileyfied.paste", "char", paste.size(), [&]{
+        pack.smileyfied(paste);
+    });
+}
+
+void Benchmarks::chatArea()
+{
+    QStringList chat = chatCorpus();
+    for (int rows : {10000, 100000})
+    {
+        for (bool backlog : {false, true})
+        {
+            QString name = QString("chatarea.%1.%2").arg(backlog ? "insertMessages" : "insertMessage").arg(rows);
+            if (!Bench::enabled(name))
+                continue;
+
+            ChatAreaWidget area;
+            area.resize(600, 800);
+            area.show();
+            QList<ChatAction*> actions;
+            for (int i=0; i<rows; i++)
+                actions << new MessageAction(i % 3 ? "friend" : "me", chat[i % chat.size()], "12:00", i % 3 == 0);
+            QApplication::processEvents();
+
+            // Until the layout caught up, what the user waits for
+            Bench::once(name, "row", rows, [&]{
+                if (backlog)
+                {
+                    area.insertMessages(actions);
+                }
+                else
+                {
+                    for (ChatAction* action : actions)
+                        area.insertMessage(action);
+                }
+                QApplication::processEvents();
+            });
+        }
+    }
+}
+
+void Benchmarks::friendList()
+{
+    if (!Bench::enabled("friendlist"))
+        return;
+
+    for (int i=0; i<BENCH_FRIENDS; i++)
+        FriendList::addFriend(i, QString(64, QChar('A' + i % 26)));
+
+    // Every friend, in an order a cache can't guess
+    std::vector<int> ids(BENCH_FRIENDS);
+    for (int i=0; i<BENCH_FRIENDS; i++)
+        ids[i] = int((i * 2654435761u) % BENCH_FRIENDS);
+    volatile int found = 0;
+    Bench::run("friendlist.findFriend.5k", "lookup", BENCH_FRIENDS, [&]{
+        for (int id : ids)
+            found += FriendList::findFriend(id) != nullptr;
+    });
+    Bench::run("friendlist.findFriend.missing.5k", "lookup", BENCH_FRIENDS, [&]{
+        for (int id : ids)
+            found += FriendList::findFriend(id + BENCH_FRIENDS) != nullptr;
+    });
+
+    for (Friend* f : FriendList::friendList)
+        delete f;
+    FriendList::clear();
+}
+
+namespace
+{
+/// Both ends of the loopback transfer, the toxes' callbacks get it as their userdata
+struct LoopbackTransfer
+{
+    bool accepted;
+    long long received;
+};
+
+void onLoopbackFileRequest(Tox* tox, int32_t friendId, uint8_t fileNum, uint64_t, const uint8_t*, uint16_t, void*)
+{
+    tox_file_send_control(tox, friendId, 1, fileNum, TOX_FILECONTROL_ACCEPT, nullptr, 0);
+}
+
+void onLoopbackFileData(Tox*, int32_t, uint8_t, const uint8_t*, uint16_t length, void* transfer)
+{
+    static_cast<LoopbackTransfer*>(transfer)->received += length;
+}
+
+void onLoopbackFileControl(Tox*, int32_t, uint8_t receiveSend, uint8_t, uint8_t control, const uint8_t*, uint16_t, void* transfer)
+{
+    if (receiveSend == 1 && control == TOX_FILECONTROL_ACCEPT)
+        static_cast<LoopbackTransfer*>(transfer)->accepted = true;
+}
+
+void pump(Tox* a, Tox* b)
+{
+    tox_do(a);
+    tox_do(b);
+}
+}
+
+void Benchmarks::fileTransfer()
+{
+    QString name = "file.sendFileChunks.loopback";
+    if (!Bench::enabled(name))
+        return;
+
+    Tox_Options options;
+    options.ipv6enabled = 0;
+    options.udp_disabled = 0;
+    options.proxy_enabled = false;
+    options.proxy_address[0] = 0;
+    options.proxy_port = 0;
+    Tox* sender = tox_new(&options);
+    Tox* receiver = tox_new(&options);
+    if (!sender || !receiver)
+    {
+        Bench::fail(name, "tox_new failed");
+        if (sender)
+            tox_kill(sender);
+        if (receiver)
+            tox_kill(receiver);
+        return;
+    }
+
+    // The toxes took the first free ports of toxcore's range, each tries all of them to find the other
+    uint8_t senderAddress[TOX_FRIEND_ADDRESS_SIZE], receiverAddress[TOX_FRIEND_ADDRESS_SIZE];
+    tox_get_address(sender, senderAddress);
+    tox_get_address(receiver, receiverAddress);
+    for (uint16_t port = BENCH_TOX_FIRST_PORT; port <= BENCH_TOX_LAST_PORT; port++)
+    {
+        tox_bootstrap_from_address(sender, "127.0.0.1", port, receiverAddress);
+        tox_bootstrap_from_address(receiver, "127.0.0.1", port, senderAddress);
+    }
+    int friendId = tox_add_friend_norequest(sender, receiverAddress);
+    int senderId = tox_add_friend_norequest(receiver, senderAddress);
+
+    QElapsedTimer connecting;
+    connecting.start();
+    while (tox_get_friend_connection_status(sender, friendId) != 1
+           || tox_get_friend_connection_status(receiver, senderId) != 1)
+    {
+        if (connecting.elapsed() > BENCH_CONNECT_TIMEOUT)
+        {
+            Bench::fail(name, "the toxes didn't connect");
+            tox_kill(sender);
+            tox_kill(receiver);
+            return;
+        }
+        pump(sender, receiver);
+        QThread::msleep(std::min(tox_do_interval(sender), tox_do_interval(receiver)));
+    }
+
+    QTemporaryFile file;
+    file.open();
+    std::vector<uint8_t> block = makeImage(1024, 1024, 1);
+    for (int written = 0; written < BENCH_FILE_SIZE; written += block.size())
+        file.write(reinterpret_cast<const char*>(block.data()), block.size());
+    file.flush();
+
+    LoopbackTransfer transfer{false, 0};
+    tox_callback_file_send_request(receiver, onLoopbackFileRequest, &transfer);
+    tox_callback_file_data(receiver, onLoopbackFileData, &transfer);
+    tox_callback_file_control(sender, onLoopbackFileControl, &transfer);
+
+    QByteArray fileName = "bench.bin";
+    int fileNum = tox_new_file_sender(sender, friendId, BENCH_FILE_SIZE, (const uint8_t*)fileName.data(), fileName.size());
+    while (!transfer.accepted && connecting.elapsed() < 2*BENCH_CONNECT_TIMEOUT)
+        pump(sender, receiver);
+    if (fileNum < 0 || !transfer.accepted)
+    {
+        Bench::fail(name, "the transfer wasn't accepted");
+        tox_kill(sender);
+        tox_kill(receiver);
+        return;
+    }
+
+    // Core::sendFileChunks without the bookkeeping: read-ahead chunks into toxcore until its window is full
+    Bench::once(name, "byte", BENCH_FILE_SIZE, [&]{
+        long long chunkSize = tox_file_data_size(sender, friendId);
+        FileReadAhead readAhead(file.fileName(), 0, BENCH_FILE_SIZE, chunkSize);
+        QElapsedTimer sending;
+        sending.start();
+        long long sent = 0;
+        bool finishSent = false;
+        while (transfer.received < BENCH_FILE_SIZE && sending.elapsed() < BENCH_TRANSFER_TIMEOUT)
+        {
+            while (sent < BENCH_FILE_SIZE)
+            {
+                int size = 0;
+                const uint8_t* data = readAhead.peek(size);
+                if (!data || tox_file_send_data(sender, friendId, fileNum, data, size) == -1)
+                    break;
+                readAhead.pop();
+                sent += size;
+            }
+            if (sent == BENCH_FILE_SIZE && !finishSent)
+            {
+                tox_file_send_control(sender, friendId, 0, fileNum, TOX_FILECONTROL_FINISHED, nullptr, 0);
+                finishSent = true;
+            }
+            pump(sender, receiver);
+        }
+    });
+    if (transfer.received < BENCH_FILE_SIZE)
+        Bench::fail(name, QString("only %1 bytes arrived, the result above is meaningless").arg(transfer.received));
+
+    tox_kill(sender);
+    tox_kill(receiver);
+}
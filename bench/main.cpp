@@ -0,0 +1,52 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "bench.h"
+#include "settings.h"
+#include <QApplication>
+#include <QStringList>
+
+// qtox-bench [--tag <label>] [filter]
+// Runs the benchmarks whose name contains filter, or all of them, and prints one JSON result per line
+int main(int argc, char *argv[])
+{
+    // Nothing is looked at, and the numbers shouldn't depend on the desktop they ran on
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty())
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication a(argc, argv);
+    a.setApplicationName("qTox");
+    a.setOrganizationName("Tox");
+
+    QStringList args = a.arguments().mid(1);
+    QString tag;
+    int tagArg = args.indexOf("--tag");
+    if (tagArg >= 0 && tagArg+1 < args.size())
+    {
+        tag = args[tagArg+1];
+        args.erase(args.begin() + tagArg, args.begin() + tagArg + 2);
+    }
+    Bench::setFilter(args.value(0));
+
+    Settings::getInstance();
+    Bench::printEnvironment(tag);
+    Benchmarks::videoConvert();
+    Benchmarks::formatting();
+    Benchmarks::friendList();
+    Benchmarks::chatArea();
+    Benchmarks::fileTransfer();
+    return 0;
+}
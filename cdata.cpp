@@ -20,15 +20,36 @@
 
 // CData
 
+static_assert(TOX_FRIEND_ADDRESS_SIZE <= 38 && TOX_CLIENT_ID_SIZE <= 38, "CData::MAX_SIZE is too small");
+
+namespace
+{
+const char hexDigits[] = "0123456789ABCDEF";
+
+/// The value of each Latin-1 character as a hex digit, -1 if it isn't one
+struct HexTable
+{
+    HexTable()
+    {
+        for (int i=0; i<256; i++)
+            values[i] = -1;
+        for (int i=0; i<10; i++)
+            values['0'+i] = i;
+        for (int i=0; i<6; i++)
+            values['a'+i] = values['A'+i] = 10+i;
+    }
+    signed char values[256];
+};
+const HexTable hexTable;
+}
+
 CData::CData(const QString &data, uint16_t byteSize)
 {
-    cData = new uint8_t[byteSize+1];
-    cDataSize = fromString(data, cData);
+    cDataSize = fromHex(data.constData(), data.length(), cData, byteSize);
 }
 
 CData::~CData()
 {
-    delete[] cData;
 }
 
 uint8_t* CData::data()
@@ -43,14 +64,38 @@ uint16_t CData::size()
 
 QString CData::toString(const uint8_t *cData, const uint16_t cDataSize)
 {
-    return QString(QByteArray(reinterpret_cast<const char*>(cData), cDataSize).toHex()).toUpper();
+    QString hex(cDataSize * 2, Qt::Uninitialized);
+    toHex(cData, cDataSize, hex.data());
+    return hex;
+}
+
+void CData::toHex(const uint8_t* data, int size, QChar* out)
+{
+    for (int i=0; i<size; i++)
+    {
+        *out++ = QLatin1Char(hexDigits[data[i] >> 4]);
+        *out++ = QLatin1Char(hexDigits[data[i] & 0xf]);
+    }
 }
 
-uint16_t CData::fromString(const QString& data, uint8_t* cData)
+int CData::fromHex(const QChar* hex, int length, uint8_t* out, int maxSize)
 {
-    QByteArray arr = QByteArray::fromHex(data.toLower().toLatin1());
-    memcpy(cData, reinterpret_cast<uint8_t*>(arr.data()), arr.size());
-    return arr.size();
+    int size = 0, high = -1;
+    for (int i=0; i<length && size<maxSize; i++)
+    {
+        ushort c = hex[i].unicode();
+        int value = c < 256 ? hexTable.values[c] : -1;
+        if (value < 0)
+            continue;
+        if (high < 0)
+        {
+            high = value;
+            continue;
+        }
+        out[size++] = (high << 4) | value;
+        high = -1;
+    }
+    return size;
 }
 
 
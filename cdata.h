@@ -20,12 +20,18 @@
 #include <cstdint>
 
 class QString;
+class QChar;
+
+/// Binary data from its hex form, in an inline buffer. The hex is converted with tables, without temporaries
 class CData
 {
 public:
     uint8_t* data();
     uint16_t size();
 
+    static void toHex(const uint8_t* data, int size, QChar* out); ///< Uppercase, writes 2*size QChars
+    static int fromHex(const QChar* hex, int length, uint8_t* out, int maxSize); ///< Skips non hex digits like QByteArray::fromHex, returns the size
+
 protected:
     explicit CData(const QString& data, uint16_t byteSize);
     virtual ~CData();
@@ -33,10 +39,10 @@ protected:
     static QString toString(const uint8_t* cData, const uint16_t cDataSize);
 
 private:
-    uint8_t* cData;
-    uint16_t cDataSize;
+    static const int MAX_SIZE = 38; ///< TOX_FRIEND_ADDRESS_SIZE, the largest we hold
 
-    static uint16_t fromString(const QString& userId, uint8_t* cData);
+    uint8_t cData[MAX_SIZE];
+    uint16_t cDataSize;
 };
 
 class CUserId : public CData
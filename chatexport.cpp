@@ -0,0 +1,180 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "chatexport.h"
+#include "history.h"
+#include "widget/tool/messageformatter.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMap>
+#include <QDebug>
+
+class ChatExport::Task : public QRunnable
+{
+public:
+    explicit Task(ChatExport* Owner) : owner{Owner} {}
+
+    void run()
+    {
+        QString error;
+        bool ok = exportAll(error);
+        if (!ok)
+            QFile::remove(owner->path);
+        QMetaObject::invokeMethod(owner, "onFinished", Qt::QueuedConnection, Q_ARG(bool, ok), Q_ARG(QString, error));
+    }
+
+private:
+    bool exportAll(QString& error)
+    {
+        History& history = History::getInstance();
+        history.sync();
+
+        // Progress is how far we are in the segments
+        QMap<int, qint64> sizes = history.getSegmentSizes(owner->chat), before;
+        qint64 total = 0;
+        for (auto it = sizes.begin(); it != sizes.end(); ++it)
+        {
+            before.insert(it.key(), total);
+            total += it.value();
+        }
+
+        QFile file(owner->path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        {
+            error = file.errorString();
+            return false;
+        }
+        QTextStream out(&file);
+        out.setCodec("UTF-8");
+        begin(out);
+
+        bool first = true;
+        int lastPercent = -1;
+        history.read(owner->chat, QDateTime(), [&](const History::Message& message)
+        {
+            if (owner->cancelled.load())
+                return false;
+            write(out, message, first);
+            first = false;
+
+            int percent = total ? (before.value(message.segment) + message.offset) * 100 / total : 100;
+            if (percent != lastPercent)
+            {
+                lastPercent = percent;
+                QMetaObject::invokeMethod(owner, "onProgress", Qt::QueuedConnection, Q_ARG(int, percent));
+            }
+            return out.status() == QTextStream::Ok;
+        });
+        if (owner->cancelled.load())
+            return false;
+
+        end(out);
+        out.flush();
+        if (out.status() != QTextStream::Ok || !file.flush())
+        {
+            error = file.errorString();
+            return false;
+        }
+        return true;
+    }
+
+    void begin(QTextStream& out)
+    {
+        if (owner->format == Html)
+            out << "<!DOCTYPE html>\n<html><head><meta charset=\"utf-8\"><title>" << MessageFormatter::escape(owner->title)
+                << "</title></head>\n<body><table>\n";
+        else if (owner->format == Json)
+            out << "[\n";
+    }
+
+    void write(QTextStream& out, const History::Message& message, bool first)
+    {
+        QString time = message.time.toString("yyyy-MM-dd hh:mm:ss");
+        if (owner->format == Html)
+        {
+            out << "<tr><td>" << time << "</td><td><b>" << MessageFormatter::escape(message.author) << "</b></td><td>"
+                << MessageFormatter::escape(message.message).replace('\n', "<br>") << "</td></tr>\n";
+        }
+        else if (owner->format == Json)
+        {
+            QJsonObject object;
+            object["time"] = message.time.toString(Qt::ISODate);
+            object["author"] = message.author;
+            object["message"] = message.message;
+            if (!first)
+                out << ",\n";
+            out << QString::fromUtf8(QJsonDocument(object).toJson(QJsonDocument::Compact));
+        }
+        else
+        {
+            out << "[" << time << "] " << message.author << ": " << message.message << "\n";
+        }
+    }
+
+    void end(QTextStream& out)
+    {
+        if (owner->format == Html)
+            out << "</table></body></html>\n";
+        else if (owner->format == Json)
+            out << "\n]\n";
+    }
+
+private:
+    ChatExport* owner;
+};
+
+ChatExport::ChatExport(const QString& chat, const QString& title, const QString& path, Format format)
+    : chat{chat}, title{title}, path{path}, format{format}, cancelled{0}
+{
+}
+
+ChatExport::Format ChatExport::formatFor(const QString& path)
+{
+    QString suffix = QFileInfo(path).suffix().toLower();
+    if (suffix == "html" || suffix == "htm")
+        return Html;
+    if (suffix == "json")
+        return Json;
+    return PlainText;
+}
+
+void ChatExport::start()
+{
+    QThreadPool::globalInstance()->start(new Task(this));
+}
+
+void ChatExport::cancel()
+{
+    cancelled.store(1);
+}
+
+void ChatExport::onProgress(int percent)
+{
+    emit progress(percent);
+}
+
+void ChatExport::onFinished(bool ok, QString error)
+{
+    if (!ok && !error.isEmpty())
+        qWarning() << "ChatExport: Can't export to" << path << ":" << error;
+    emit finished(ok, error);
+    deleteLater();
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CHATEXPORT_H
+#define CHATEXPORT_H
+
+#include <QObject>
+#include <QString>
+#include <QAtomicInt>
+
+/// Writes a chat's history to a file on a worker thread, streaming it from the history store
+/// one message at a time. Deletes itself once finished has been emitted, cancel() instead of deleting it.
+class ChatExport : public QObject
+{
+    Q_OBJECT
+public:
+    enum Format {PlainText, Html, Json};
+
+    ChatExport(const QString& chat, const QString& title, const QString& path, Format format);
+    void start();
+    static Format formatFor(const QString& path); ///< By the extension, plain text if we don't know it
+
+public slots:
+    void cancel(); ///< The partial file is removed
+
+signals:
+    void progress(int percent);
+    void finished(bool ok, QString error); ///< Not ok and no error when cancelled
+
+private slots:
+    void onProgress(int percent);
+    void onFinished(bool ok, QString error);
+
+private:
+    class Task;
+    QString chat, title, path;
+    Format format;
+    QAtomicInt cancelled;
+};
+
+#endif // CHATEXPORT_H
@@ -18,56 +18,125 @@
 #include "cdata.h"
 #include "cstring.h"
 #include "settings.h"
-#include "widget/widget.h"
+#include "filereadahead.h"
+#include "filewritebehind.h"
+#include "profilesaver.h"
+#include "startuptrace.h"
+#include "audiothread.h"
+#include "soundbank.h"
+#include "widget/videoconverter.h"
 
 #include <tox/tox.h>
 
+#include <algorithm>
 #include <ctime>
-#include <functional>
+#include <limits>
 
 #include <QDebug>
 #include <QDir>
 #include <QFile>
-#include <QSaveFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <QStandardPaths>
 #include <QThread>
 #include <QTimer>
 #include <QCoreApplication>
 #include <QDateTime>
+#include <QSet>
+#include <QVector>
 
 const QString Core::CONFIG_FILE_NAME = "data";
-QList<ToxFile> Core::fileSendQueue;
-QList<ToxFile> Core::fileRecvQueue;
-
-Core::Core(Camera* cam, QThread *coreThread) :
-    tox(nullptr), camera(cam)
+Core* Core::instance{nullptr};
+
+Core::Core(Camera* cam, QThread *coreThread, const QString& ProfileDir) :
+    tox(nullptr), profiler(this), camera(cam), bootstrapAttempts{0}, bootstrapIndex{0}, bootstrapOffset{0},
+    bootstrapRoundTime{0}, windowMinimized{false}, isConnected{false},
+    nextDeadline{0}, lastIteration{0}, lastLatencyReport{0},
+    loopCount{0}, loopPeriodSum{0}, loopPeriodMax{0}, loopLatenessSum{0},
+    uploadTokens{0}, uploadRefillTime{0}, fileRotation{0}, fileSendsStalled{false}, nextBatchId{0},
+    nextMessageId{1}, profileDir{ProfileDir},
+    checkpoints{ProfileDir.isEmpty() ? Settings::getSettingsDirPath() : ProfileDir, this}, audioOpened{false}
 {
+    if (!instance)
+        instance = this;
     videobuf = new uint8_t[videobufsize];
-    videoBusyness=0;
 
     toxTimer = new QTimer(this);
     toxTimer->setSingleShot(true);
-    //saveTimer = new QTimer(this);
-    //saveTimer->start(TOX_SAVE_INTERVAL);
+    fileTimer = new QTimer(this);
+    fileTimer->setSingleShot(true);
+    saveTimer = new QTimer(this);
+    saveTimer->setSingleShot(true);
+    saveTimer->setInterval(TOX_SAVE_DELAY);
     bootstrapTimer = new QTimer(this);
     bootstrapTimer->start(TOX_BOOTSTRAP_INTERVAL);
+    presenceTimer = new QTimer(this);
+    presenceTimer->setSingleShot(true);
+    presenceTimer->setInterval(TOX_PRESENCE_COALESCE_INTERVAL);
     connect(toxTimer, &QTimer::timeout, this, &Core::process);
-    //connect(saveTimer, &QTimer::timeout, this, &Core::saveConfiguration); //Disable save timer in favor of saving on events
-    //connect(fileTimer, &QTimer::timeout, this, &Core::fileHeartbeat);
+    connect(saveTimer, &QTimer::timeout, this, &Core::onSaveTimer);
+    connect(fileTimer, &QTimer::timeout, this, &Core::fileHeartbeat);
     connect(bootstrapTimer, &QTimer::timeout, this, &Core::onBootstrapTimer);
-    connect(&Settings::getInstance(), &Settings::dhtServerListChanged, this, &Core::bootstrapDht);
+    connect(presenceTimer, &QTimer::timeout, this, &Core::flushPresence);
+    impairmentTimer = new QTimer(this);
+    impairmentTimer->setInterval(TOXAV_IMPAIRMENT_TICK);
+    connect(impairmentTimer, &QTimer::timeout, this, &Core::deliverImpaired);
+    connect(&Settings::getInstance(), &Settings::dhtServerListChanged, this, &Core::onDhtServerListChanged);
+    connect(this, &Core::knownDhtNodesChanged, &Settings::getInstance(), &Settings::setKnownDhtNodes);
     connect(this, SIGNAL(fileTransferFinished(ToxFile)), this, SLOT(onFileTransferFinished(ToxFile)));
 
     for (int i=0; i<TOXAV_MAX_CALLS;i++)
     {
-        calls[i].sendAudioTimer = new QTimer();
         calls[i].sendVideoTimer = new QTimer();
-        calls[i].sendAudioTimer->moveToThread(coreThread);
         calls[i].sendVideoTimer->moveToThread(coreThread);
         connect(calls[i].sendVideoTimer, &QTimer::timeout, [this,i](){sendCallVideo(i);});
+        calls[i].audioRateTimer = new QTimer();
+        calls[i].audioRateTimer->moveToThread(coreThread);
+        calls[i].audioRateTimer->setInterval(TOXAV_AUDIO_RATE_WINDOW);
+        connect(calls[i].audioRateTimer, &QTimer::timeout, [this,i](){adaptCallAudio(i);});
+        calls[i].generation = calls[i].videoJobGeneration = 0;
+        calls[i].videoConverter = new VideoConverter();
+        calls[i].videoConverter->moveToThread(coreThread);
+        connect(calls[i].videoConverter, &VideoConverter::frameReady,
+                [this,i](const VideoFrame& frame, qint64 cost){sendCallVideoFrame(i, frame, cost);});
+    }
+}
+
+Core::~Core()
+{
+    if (instance == this)
+        instance = nullptr;
+
+    // The audio thread sends our calls with our toxav, it must be done with them before it's gone
+    for (int i=0; i<TOXAV_MAX_CALLS; i++)
+    {
+        QMutexLocker locker(&audioMutex);
+        if (audioThread)
+            audioThread->removeCall(&calls[i]);
     }
 
-    // OpenAL init
+    if (tox) {
+        saveConfiguration();
+        ProfileSaver::getInstance().flush();
+        toxav_kill(toxav);
+        tox_kill(tox);
+    }
+
+    delete[] videobuf;
+
+    closeAudioDevices();
+}
+
+void Core::openAudioDevices()
+{
+    QMutexLocker locker(&audioMutex);
+    audioOpened = true;
+    if (audioUsers++)
+        return;
+
+    StartupTrace::Phase phase("OpenAL");
     alOutDev = alcOpenDevice(nullptr);
     if (!alOutDev)
     {
@@ -80,9 +149,10 @@ Core::Core(Camera* cam, QThread *coreThread) :
         {
             qWarning() << "Core: Cannot create output audio context";
             alcCloseDevice(alOutDev);
+            alOutDev = nullptr;
         }
         else
-            alGenSources(1, &alMainSource);
+            soundBank = new SoundBank;
     }
     alInDev = alcCaptureOpenDevice(NULL,av_DefaultSettings.audio_sample_rate, AL_FORMAT_MONO16,
                                    (av_DefaultSettings.audio_frame_duration * av_DefaultSettings.audio_sample_rate * 4) / 1000);
@@ -90,38 +160,67 @@ Core::Core(Camera* cam, QThread *coreThread) :
         qWarning() << "Core: Cannot open input audio device";
 }
 
-Core::~Core()
+void Core::closeAudioDevices()
 {
-    if (tox) {
-        saveConfiguration();
-        toxav_kill(toxav);
-        tox_kill(tox);
-    }
-
-    if (videobuf)
-    {
-        delete[] videobuf;
-        videobuf=nullptr;
-    }
+    QMutexLocker locker(&audioMutex);
+    if (!audioOpened || --audioUsers)
+        return;
 
+    // It plays on the context
+    delete audioThread;
+    audioThread = nullptr;
+    delete soundBank;
+    soundBank = nullptr;
     if (alContext)
     {
         alcMakeContextCurrent(nullptr);
         alcDestroyContext(alContext);
+        alContext = nullptr;
     }
     if (alOutDev)
         alcCloseDevice(alOutDev);
     if (alInDev)
         alcCaptureCloseDevice(alInDev);
+    alOutDev = alInDev = nullptr;
+}
+
+CoreEventQueue& Core::getEventQueue()
+{
+    return events;
 }
 
 Core* Core::getInstance()
 {
-    return Widget::getInstance()->getCore();
+    return instance;
+}
+
+QString Core::getProfileDir() const
+{
+    return profileDir.isEmpty() ? Settings::getSettingsDirPath() : profileDir;
+}
+
+void Core::registerMetaTypes()
+{
+    qRegisterMetaType<Status>("Status");
+    qRegisterMetaType<vpx_image>("vpx_image");
+    qRegisterMetaType<VideoFrame>("VideoFrame");
+    qRegisterMetaType<uint8_t>("uint8_t");
+    qRegisterMetaType<int32_t>("int32_t");
+    qRegisterMetaType<int64_t>("int64_t");
+    qRegisterMetaType<ToxFile>("ToxFile");
+    qRegisterMetaType<ToxFile::FileDirection>("ToxFile::FileDirection");
+    qRegisterMetaType<QList<FriendInfo>>("QList<FriendInfo>");
+    qRegisterMetaType<QList<FriendPresence>>("QList<FriendPresence>");
+    qRegisterMetaType<QList<GroupMessage>>("QList<GroupMessage>");
+    qRegisterMetaType<QList<KnownDhtNode>>("QList<KnownDhtNode>");
+    qRegisterMetaType<FileCheckpoint>("FileCheckpoint");
 }
 
 void Core::start()
 {
+    // Opening the audio devices can take a while, on our thread it overlaps with the GUI's construction
+    openAudioDevices();
+
     // IPv6 needed for LAN discovery, but can crash some weird routers. On by default, can be disabled in options.
     bool enableIPv6 = Settings::getInstance().getEnableIPv6();
     if (enableIPv6)
@@ -136,6 +235,7 @@ void Core::start()
     toxOptions.proxy_address[0] = 0;
     toxOptions.proxy_port = 0;
 
+    StartupTrace::begin("tox_new");
     tox = tox_new(&toxOptions);
     if (tox == nullptr)
     {
@@ -167,10 +267,16 @@ void Core::start()
         emit failedToStart();
         return;
     }
+    StartupTrace::end("tox_new");
 
     qsrand(time(nullptr));
+    StartupTrace::begin("Profile load");
+    knownDhtNodes = Settings::getInstance().getKnownDhtNodes();
+    if (int listSize = Settings::getInstance().getDhtServerList().size())
+        bootstrapOffset = qrand() % listSize;
 
     loadConfiguration();
+    StartupTrace::end("Profile load");
 
     tox_callback_friend_request(tox, onFriendRequest, this);
     tox_callback_friend_message(tox, onFriendMessage, this);
@@ -180,6 +286,7 @@ void Core::start()
     tox_callback_status_message(tox, onStatusMessageChanged, this);
     tox_callback_user_status(tox, onUserStatusChanged, this);
     tox_callback_connection_status(tox, onConnectionStatusChanged, this);
+    tox_callback_read_receipt(tox, onReadReceipt, this);
     tox_callback_group_invite(tox, onGroupInvite, this);
     tox_callback_group_message(tox, onGroupMessage, this);
     tox_callback_group_namelist_change(tox, onGroupNamelistChange, this);
@@ -207,9 +314,12 @@ void Core::start()
 
     emit friendAddressGenerated(CFriendAddress::toString(friendAddress));
 
-    bootstrapDht();
-
-    toxTimer->start(tox_do_interval(tox));
+    loopClock.start();
+    {
+        StartupTrace::Phase phase("First bootstrap");
+        bootstrapDht();
+    }
+    scheduleProcess();
 }
 
 void Core::onBootstrapTimer()
@@ -220,33 +330,56 @@ void Core::onBootstrapTimer()
         bootstrapDht();
 }
 
+void Core::onDhtServerListChanged()
+{
+    if (!tox)
+        return;
+    // The retries' slowdown and position were for the old list
+    bootstrapAttempts = 0;
+    bootstrapDht();
+}
+
 void Core::onFriendRequest(Tox*/* tox*/, const uint8_t* cUserId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FriendRequest);
     emit static_cast<Core*>(core)->friendRequestReceived(CUserId::toString(cUserId), CString::toString(cMessage, cMessageSize));
 }
 
 void Core::onFriendMessage(Tox*/* tox*/, int friendId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendMessageReceived(friendId, CString::toString(cMessage, cMessageSize));
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FriendMessage);
+    CoreEvent event;
+    event.type = CoreEvent::FriendMessage;
+    event.friendId = friendId;
+    event.text = CString::toString(cMessage, cMessageSize);
+    static_cast<Core*>(core)->events.push(std::move(event));
 }
 
 void Core::onFriendNameChange(Tox*/* tox*/, int friendId, const uint8_t* cName, uint16_t cNameSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendUsernameChanged(friendId, CString::toString(cName, cNameSize));
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::NameChange);
+    FriendPresence& presence = static_cast<Core*>(core)->pendingPresenceFor(friendId);
+    presence.hasName = true;
+    presence.name = CString::toString(cName, cNameSize);
 }
 
 void Core::onFriendTypingChange(Tox*/* tox*/, int friendId, uint8_t isTyping, void *core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::TypingChange);
     emit static_cast<Core*>(core)->friendTypingChanged(friendId, isTyping ? true : false);
 }
 
 void Core::onStatusMessageChanged(Tox*/* tox*/, int friendId, const uint8_t* cMessage, uint16_t cMessageSize, void* core)
 {
-    emit static_cast<Core*>(core)->friendStatusMessageChanged(friendId, CString::toString(cMessage, cMessageSize));
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::StatusMessage);
+    FriendPresence& presence = static_cast<Core*>(core)->pendingPresenceFor(friendId);
+    presence.hasStatusMessage = true;
+    presence.statusMessage = CString::toString(cMessage, cMessageSize);
 }
 
 void Core::onUserStatusChanged(Tox*/* tox*/, int friendId, uint8_t userstatus, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::UserStatus);
     Status status;
     switch (userstatus) {
         case TOX_USERSTATUS_NONE:
@@ -262,77 +395,143 @@ void Core::onUserStatusChanged(Tox*/* tox*/, int friendId, uint8_t userstatus, v
             status = Status::Online;
             break;
     }
-    emit static_cast<Core*>(core)->friendStatusChanged(friendId, status);
+    FriendPresence& presence = static_cast<Core*>(core)->pendingPresenceFor(friendId);
+    presence.hasStatus = true;
+    presence.status = status;
 }
 
 void Core::onConnectionStatusChanged(Tox*/* tox*/, int friendId, uint8_t status, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::ConnectionStatus);
     Status friendStatus = status ? Status::Online : Status::Offline;
-    emit static_cast<Core*>(core)->friendStatusChanged(friendId, friendStatus);
+    FriendPresence& presence = static_cast<Core*>(core)->pendingPresenceFor(friendId);
+    presence.hasStatus = true;
+    presence.status = friendStatus;
     if (friendStatus == Status::Offline) {
         static_cast<Core*>(core)->checkLastOnline(friendId);
+        static_cast<Core*>(core)->breakFileTransfers(friendId);
+        static_cast<Core*>(core)->requeueMessages(friendId);
+    } else {
+        static_cast<Core*>(core)->resumeFileSends(friendId);
     }
 }
 
+void Core::onReadReceipt(Tox*/* tox*/, int32_t friendId, uint32_t receipt, void* core)
+{
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::ReadReceipt);
+    Core* c = static_cast<Core*>(core);
+    auto it = c->outboxes.find(friendId);
+    if (it == c->outboxes.end())
+        return;
+
+    FriendOutbox& outbox = *it;
+    for (int i=0; i<outbox.inFlight.size(); i++)
+    {
+        if (outbox.inFlight[i].receipt != receipt)
+            continue;
+
+        int messageId = outbox.inFlight.takeAt(i).messageId;
+        bool pending = false;
+        for (const OutgoingMessage& piece : outbox.inFlight)
+            pending |= piece.messageId == messageId;
+        if (!outbox.queued.isEmpty() && outbox.queued.first().messageId == messageId)
+            pending = true;
+
+        if (outbox.queued.isEmpty() && outbox.inFlight.isEmpty())
+            c->outboxes.erase(it);
+        if (!pending)
+            emit c->messageDelivered(friendId, messageId);
+        return;
+    }
+}
+
+FriendPresence& Core::pendingPresenceFor(int friendId)
+{
+    if (pendingPresence.isEmpty())
+        presenceTimer->start();
+
+    FriendPresence& presence = pendingPresence[friendId];
+    presence.friendId = friendId;
+    return presence;
+}
+
+void Core::flushPresence()
+{
+    if (pendingPresence.isEmpty())
+        return;
+
+    // A friend who flapped during the window only shows up once, in its last state
+    QList<FriendPresence> updates = pendingPresence.values();
+    pendingPresence.clear();
+    emit friendPresenceChanged(updates);
+}
+
 void Core::onAction(Tox*/* tox*/, int friendId, const uint8_t *cMessage, uint16_t cMessageSize, void *core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FriendAction);
     emit static_cast<Core*>(core)->actionReceived(friendId, CString::toString(cMessage, cMessageSize));
 }
 
 void Core::onGroupInvite(Tox*, int friendnumber, const uint8_t *group_public_key, void *core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::GroupInvite);
     qDebug() << QString("Core: Group invite by %1").arg(friendnumber);
     emit static_cast<Core*>(core)->groupInviteReceived(friendnumber, group_public_key);
 }
 
 void Core::onGroupMessage(Tox*, int groupnumber, int friendgroupnumber, const uint8_t * message, uint16_t length, void *core)
 {
-    emit static_cast<Core*>(core)->groupMessageReceived(groupnumber, friendgroupnumber, CString::toString(message, length));
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::GroupMessage);
+    Core* c = static_cast<Core*>(core);
+    GroupMessage msg;
+    msg.peerId = friendgroupnumber;
+    msg.author = c->getGroupPeerName(groupnumber, friendgroupnumber);
+    msg.message = CString::toString(message, length);
+    c->pendingGroupMessages[groupnumber].append(msg);
 }
 
 void Core::onGroupNamelistChange(Tox*, int groupnumber, int peernumber, uint8_t change, void *core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::GroupNamelist);
     qDebug() << QString("Core: Group namelist change %1:%2 %3").arg(groupnumber).arg(peernumber).arg(change);
-    emit static_cast<Core*>(core)->groupNamelistChanged(groupnumber, peernumber, change);
+    Core* c = static_cast<Core*>(core);
+    c->dirtyGroupPeers.insert(groupnumber);
+
+    // Fetched here on our thread, the GUI doesn't have to call into toxcore
+    QString name;
+    if (change != TOX_CHAT_CHANGE_PEER_DEL)
+        name = c->getGroupPeerName(groupnumber, peernumber);
+    emit c->groupNamelistChanged(groupnumber, peernumber, change, name);
 }
 
 void Core::onFileSendRequestCallback(Tox*, int32_t friendnumber, uint8_t filenumber, uint64_t filesize,
                                           const uint8_t *filename, uint16_t filename_length, void *core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FileSendRequest);
     qDebug() << QString("Core: Received file request %1 with friend %2").arg(filenumber).arg(friendnumber);
 
-    ToxFile file{filenumber, friendnumber,
+    ToxFile* file = new ToxFile{filenumber, friendnumber,
                 CString::toString(filename,filename_length).toUtf8(), "", ToxFile::RECEIVING};
-    file.filesize = filesize;
-    fileRecvQueue.append(file);
-    emit static_cast<Core*>(core)->fileReceiveRequested(fileRecvQueue.last());
+    file->filesize = filesize;
+    static_cast<Core*>(core)->addFileToQueue(file);
+
+    // A file we have part of resumes before anyone sees the request, which then comes already accepted.
+    // Hashing the partial file reads it, onFileResumeRequestMade goes on once that's done
+    FileCheckpoint checkpoint;
+    QString friendKey = static_cast<Core*>(core)->getFriendKey(friendnumber);
+    if (static_cast<Core*>(core)->checkpoints.find(friendKey, ToxFile::RECEIVING, file->fileName, file->filesize, checkpoint))
+    {
+        static_cast<Core*>(core)->checkpoints.makeResumeRequestAsync(checkpoint, "onFileResumeRequestMade",
+                                            fileTransferKey(file->friendId, file->fileNum, file->direction));
+        return;
+    }
+    emit static_cast<Core*>(core)->fileReceiveRequested(*file);
 }
 void Core::onFileControlCallback(Tox* tox, int32_t friendnumber, uint8_t receive_send, uint8_t filenumber,
-                                      uint8_t control_type, const uint8_t*, uint16_t, void *core)
+                                      uint8_t control_type, const uint8_t* data, uint16_t length, void *core)
 {
-    ToxFile* file{nullptr};
-    if (receive_send == 1)
-    {
-        for (ToxFile& f : fileSendQueue)
-        {
-            if (f.fileNum == filenumber && f.friendId == friendnumber)
-            {
-                file = &f;
-                break;
-            }
-        }
-    }
-    else
-    {
-        for (ToxFile& f : fileRecvQueue)
-        {
-            if (f.fileNum == filenumber && f.friendId == friendnumber)
-            {
-                file = &f;
-                break;
-            }
-        }
-    }
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FileControl);
+    ToxFile* file = static_cast<Core*>(core)->findFile(friendnumber, filenumber, receive_send == 1 ? ToxFile::SENDING : ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::onFileControlCallback: No such file in queue");
@@ -340,58 +539,59 @@ void Core::onFileControlCallback(Tox* tox, int32_t friendnumber, uint8_t receive
     }
     if      (receive_send == 1 && control_type == TOX_FILECONTROL_ACCEPT)
     {
-        file->status = ToxFile::TRANSMITTING;
-        emit static_cast<Core*>(core)->fileTransferAccepted(*file);
-        qDebug() << "Core: File control callback, file accepted";
-        file->sendTimer = new QTimer(static_cast<Core*>(core));
-        connect(file->sendTimer, &QTimer::timeout, std::bind(sendAllFileData,static_cast<Core*>(core), file));
-        file->sendTimer->setSingleShot(true);
-        file->sendTimer->start(TOX_FILE_INTERVAL);
+        if (file->status == ToxFile::STOPPED && length)
+        {
+            // The friend has part of this file from an earlier attempt, onFileResumeChecked goes on
+            // once we hashed our side of it
+            QByteArray request((const char*)data, length);
+            static_cast<Core*>(core)->checkpoints.checkResumeRequestAsync(request, file->filePath, file->filesize,
+                            "onFileResumeChecked", fileTransferKey(file->friendId, file->fileNum, file->direction));
+            return;
+        }
+        static_cast<Core*>(core)->acceptFileSend(file);
     }
     else if (receive_send == 1 && control_type == TOX_FILECONTROL_KILL)
     {
         qDebug() << QString("Core::onFileControlCallback: Transfer of file %1 cancelled by friend %2")
                     .arg(file->fileNum).arg(file->friendId);
         file->status = ToxFile::STOPPED;
-        emit static_cast<Core*>(core)->fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
-        // Wait for sendAllFileData to return before deleting the ToxFile, we MUST ensure this or we'll use after free
-        if (file->sendTimer)
-        {
-            QThread::msleep(1);
-            qApp->processEvents();
-            if (file->sendTimer)
-            {
-                delete file->sendTimer;
-                file->sendTimer = nullptr;
-            }
-        }
-        removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
+        static_cast<Core*>(core)->notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+        static_cast<Core*>(core)->removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
     }
     else if (receive_send == 1 && control_type == TOX_FILECONTROL_FINISHED)
     {
         qDebug() << QString("Core::onFileControlCallback: Transfer of file %1 to friend %2 is complete")
                     .arg(file->fileNum).arg(file->friendId);
         file->status = ToxFile::STOPPED;
-        emit static_cast<Core*>(core)->fileTransferFinished(*file);
-        removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
+        // The friend confirms with the digest of what it wrote
+        if (length && !file->digest.isEmpty())
+            file->digestMismatch = QByteArray((const char*)data, length) != file->digest;
+        if (file->digestMismatch)
+            qWarning() << QString("Core::onFileControlCallback: File %1 arrived corrupted at friend %2")
+                          .arg(file->fileNum).arg(file->friendId);
+        static_cast<Core*>(core)->notifyFileFinished(*file);
+        static_cast<Core*>(core)->removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
     }
     else if (receive_send == 0 && control_type == TOX_FILECONTROL_KILL)
     {
         qDebug() << QString("Core::onFileControlCallback: Transfer of file %1 cancelled by friend %2")
                     .arg(file->fileNum).arg(file->friendId);
         file->status = ToxFile::STOPPED;
-        emit static_cast<Core*>(core)->fileTransferCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
-        removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
+        static_cast<Core*>(core)->notifyFileCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
+        static_cast<Core*>(core)->removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
     }
     else if (receive_send == 0 && control_type == TOX_FILECONTROL_FINISHED)
     {
         qDebug() << QString("Core::onFileControlCallback: Reception of file %1 from %2 finished")
                     .arg(file->fileNum).arg(file->friendId);
         file->status = ToxFile::STOPPED;
-        emit static_cast<Core*>(core)->fileTransferFinished(*file);
-        // confirm receive is complete
-        tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_FINISHED, nullptr, 0);
-        removeFileFromQueue((bool)receive_send, file->friendId, file->fileNum);
+        file->peerDigest = QByteArray((const char*)data, length);
+        quint64 key = fileTransferKey(file->friendId, file->fileNum, file->direction);
+        // The rest is written out on the I/O thread, we confirm once it's on disk
+        if (file->writeBehind)
+            file->writeBehind->closeAsync(static_cast<Core*>(core), "onFileWriteClosed", key);
+        else
+            static_cast<Core*>(core)->onFileWriteClosed(key);
     }
     else if (receive_send == 0 && control_type == TOX_FILECONTROL_ACCEPT)
     {
@@ -408,28 +608,46 @@ void Core::onFileControlCallback(Tox* tox, int32_t friendnumber, uint8_t receive
     }
 }
 
-void Core::onFileDataCallback(Tox*, int32_t friendnumber, uint8_t filenumber, const uint8_t *data, uint16_t length, void *core)
+void Core::onFileDataCallback(Tox* tox, int32_t friendnumber, uint8_t filenumber, const uint8_t *data, uint16_t length, void *core)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileRecvQueue)
-    {
-        if (f.fileNum == filenumber && f.friendId == friendnumber)
-        {
-            file = &f;
-            break;
-        }
-    }
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::FileData);
+    ToxFile* file = static_cast<Core*>(core)->findFile(friendnumber, filenumber, ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::onFileDataCallback: No such file in queue");
         return;
     }
 
-    file->file->write((char*)data,length);
+    if (!file->writeBehind)
+    {
+        qWarning("Core::onFileDataCallback: Got data for a file we didn't accept");
+        return;
+    }
+
+    QElapsedTimer busy;
+    busy.start();
+    file->stats.wakeups++;
+    file->writeBehind->write(data, length);
+    if (file->writeBehind->hasError())
+    {
+        qWarning() << QString("Core::onFileDataCallback: Error writing file: %1").arg(file->writeBehind->errorString());
+        file->status = ToxFile::STOPPED;
+        static_cast<Core*>(core)->notifyFileCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
+        tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
+        static_cast<Core*>(core)->removeFileFromQueue(false, file->friendId, file->fileNum);
+        return;
+    }
     file->bytesSent += length;
+    // The disk is behind, the sender waits until resumeFileRecvs sees it caught up
+    if (file->stats.diskStallTime < 0 && file->writeBehind->isBackedUp())
+    {
+        file->stats.diskStallTime = static_cast<Core*>(core)->loopClock.elapsed();
+        tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_PAUSE, nullptr, 0);
+    }
     //qDebug() << QString("Core::onFileDataCallback: received %1/%2 bytes").arg(file->bytesSent).arg(file->filesize);
-    emit static_cast<Core*>(core)->fileTransferInfo(file->friendId, file->fileNum,
-                                            file->filesize, file->bytesSent, ToxFile::RECEIVING);
+    static_cast<Core*>(core)->reportFileProgress(file);
+    static_cast<Core*>(core)->saveFileCheckpoint(file);
+    file->stats.coreTimeUs += busy.nsecsElapsed() / 1000;
 }
 
 void Core::acceptFriendRequest(const QString& userId)
@@ -438,7 +656,7 @@ void Core::acceptFriendRequest(const QString& userId)
     if (friendId == -1) {
         emit failedToAddFriend(userId);
     } else {
-        saveConfiguration();
+        scheduleSave();
         emit friendAdded(friendId, userId);
     }
 }
@@ -453,37 +671,112 @@ void Core::requestFriendship(const QString& friendAddress, const QString& messag
     if (friendId < 0) {
         emit failedToAddFriend(userId);
     } else {
-        // Update our friendAddresses
-        bool found=false;
-        QList<QString>& friendAddresses = Settings::getInstance().friendAddresses;
-        for (QString& addr : friendAddresses)
+        Settings::getInstance().updateFriendAddress(friendAddress);
+        emit friendAdded(friendId, userId);
+    }
+    scheduleSave();
+}
+
+void Core::sendMessage(int friendId, const QString& message)
+{
+    int messageId = queueMessage(friendId, message, false);
+    emit messageSentResult(friendId, message, messageId);
+}
+
+void Core::sendAction(int friendId, const QString &action)
+{
+    int messageId = queueMessage(friendId, action, true);
+    emit actionSentResult(friendId, action, messageId);
+}
+
+int Core::queueMessage(int friendId, const QString& message, bool isAction)
+{
+    if (!tox_friend_exists(tox, friendId) || message.isEmpty())
+        return 0;
+
+    // Not a CString, a pasted log can be well over what its inline buffer and size hold
+    int messageId = nextMessageId++;
+    FriendOutbox& outbox = outboxes[friendId];
+    for (const QByteArray& piece : splitMessage(message.toUtf8()))
+        outbox.queued.append(OutgoingMessage{messageId, isAction, piece, 0});
+
+    wakeUp();
+    return messageId;
+}
+
+QList<QByteArray> Core::splitMessage(const QByteArray& utf8)
+{
+    QList<QByteArray> pieces;
+    int pos = 0;
+    while (utf8.size() - pos > TOX_MAX_MESSAGE_LENGTH)
+    {
+        int end = pos + TOX_MAX_MESSAGE_LENGTH;
+        // Back off the continuation bytes so we never cut a character in two
+        while (end > pos && (static_cast<uint8_t>(utf8[end]) & 0xC0) == 0x80)
+            end--;
+
+        // Rather at a line or word break, if there's one in the last quarter of the piece
+        for (int i = end; i > pos + TOX_MAX_MESSAGE_LENGTH*3/4; i--)
         {
-            if (addr.toUpper().contains(friendAddress))
+            if (utf8[i-1] == '\n' || utf8[i-1] == ' ')
             {
-                addr = friendAddress;
-                found = true;
+                end = i;
+                break;
             }
         }
-        if (!found)
-            friendAddresses.append(friendAddress);
-        emit friendAdded(friendId, userId);
+
+        pieces.append(utf8.mid(pos, end - pos));
+        pos = end;
     }
-    saveConfiguration();
+    pieces.append(utf8.mid(pos));
+    return pieces;
 }
 
-void Core::sendMessage(int friendId, const QString& message)
+void Core::sendQueuedMessages()
 {
-    CString cMessage(message);
+    for (auto it = outboxes.begin(); it != outboxes.end();)
+    {
+        int friendId = it.key();
+        FriendOutbox& outbox = *it;
+        if (tox_get_friend_connection_status(tox, friendId) != 1)
+        {
+            ++it;
+            continue;
+        }
 
-    int messageId = tox_send_message(tox, friendId, cMessage.data(), cMessage.size());
-    emit messageSentResult(friendId, message, messageId);
+        int sent = 0;
+        while (!outbox.queued.isEmpty() && sent < TOX_MESSAGE_QUANTUM
+               && outbox.inFlight.size() < TOX_MESSAGE_IN_FLIGHT)
+        {
+            OutgoingMessage& piece = outbox.queued.first();
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(piece.text.constData());
+            piece.receipt = piece.isAction ? tox_send_action(tox, friendId, data, piece.text.size())
+                                           : tox_send_message(tox, friendId, data, piece.text.size());
+            // Toxcore's send queue is full, it'll take more after the next tox_do
+            if (!piece.receipt)
+                break;
+
+            outbox.inFlight.append(outbox.queued.takeFirst());
+            sent++;
+        }
+
+        if (outbox.queued.isEmpty() && outbox.inFlight.isEmpty())
+            it = outboxes.erase(it);
+        else
+            ++it;
+    }
 }
 
-void Core::sendAction(int friendId, const QString &action)
+void Core::requeueMessages(int friendId)
 {
-    CString cMessage(action);
-    int ret = tox_send_action(tox, friendId, cMessage.data(), cMessage.size());
-    emit actionSentResult(friendId, action, ret);
+    auto it = outboxes.find(friendId);
+    if (it == outboxes.end() || it->inFlight.isEmpty())
+        return;
+
+    // The friend may have read some of them and lost the receipts, better twice than never
+    it->queued = it->inFlight + it->queued;
+    it->inFlight.clear();
+    qDebug() << "Core: Will send" << it->queued.size() << "message pieces again to friend" << friendId;
 }
 
 void Core::sendTyping(int friendId, bool typing)
@@ -491,6 +784,8 @@ void Core::sendTyping(int friendId, bool typing)
     int ret = tox_set_user_is_typing(tox, friendId, typing);
     if (ret == -1)
         emit failedToSetTyping(typing);
+    else
+        wakeUp();
 }
 
 void Core::sendGroupMessage(int groupId, const QString& message)
@@ -498,41 +793,326 @@ void Core::sendGroupMessage(int groupId, const QString& message)
     CString cMessage(message);
 
     tox_group_message_send(tox, groupId, cMessage.data(), cMessage.size());
+    wakeUp();
 }
 
 void Core::sendFile(int32_t friendId, QString Filename, QString FilePath, long long filesize)
 {
-    QByteArray fileName = Filename.toUtf8();
+    offerFile(friendId, Filename.toUtf8(), FilePath, filesize, -1);
+}
+
+ToxFile* Core::offerFile(int friendId, const QByteArray& fileName, const QString& filePath, long long filesize, int batchId)
+{
     int fileNum = tox_new_file_sender(tox, friendId, filesize, (uint8_t*)fileName.data(), fileName.size());
     if (fileNum == -1)
     {
-        qWarning() << "Core::sendFile: Can't create the Tox file sender";
+        qWarning() << "Core::offerFile: Can't create the Tox file sender";
+        return nullptr;
+    }
+    qDebug() << QString("Core::offerFile: Created file sender %1 with friend %2").arg(fileNum).arg(friendId);
+
+    ToxFile* file = new ToxFile{fileNum, friendId, fileName, filePath, ToxFile::SENDING};
+    file->filesize = filesize;
+    file->batchId = batchId;
+    if (!file->open(false))
+    {
+        qWarning() << QString("Core::offerFile: Can't open file, error: %1").arg(file->file->errorString());
+    }
+    addFileToQueue(file);
+
+    // The checkpoint is saved by onFileFingerprinted, the source is hashed off our thread
+    checkpoints.fingerprintAsync(filePath, filesize, "onFileFingerprinted",
+                                 fileTransferKey(friendId, fileNum, ToxFile::SENDING));
+
+    emit fileSendStarted(*file);
+    wakeUp();
+    return file;
+}
+
+void Core::sendFiles(int32_t friendId, QString batchName, QString baseDir, QStringList filePaths)
+{
+    ToxFileBatch* batch = new ToxFileBatch{nextBatchId++, friendId, {}, 0, 0, 0, 0, 0, 0, false};
+    QDir base(baseDir);
+    for (const QString& path : filePaths)
+    {
+        QFileInfo info(path);
+        if (!info.isFile() || !info.isReadable())
+        {
+            qWarning() << "Core::sendFiles: Skipping unreadable file" << path;
+            continue;
+        }
+        QString name = baseDir.isEmpty() ? info.fileName() : base.relativeFilePath(path);
+        batch->pending.append({name, path, info.size()});
+        batch->totalBytes += info.size();
+    }
+    if (batch->pending.isEmpty())
+    {
+        qWarning() << "Core::sendFiles: Nothing to send";
+        delete batch;
         return;
     }
-    qDebug() << QString("Core::sendFile: Created file sender %1 with friend %2").arg(fileNum).arg(friendId);
 
-    ToxFile file{fileNum, friendId, fileName, FilePath, ToxFile::SENDING};
-    file.filesize = filesize;
-    if (!file.open(false))
+    fileBatches.insert(batch->id, batch);
+    emit fileBatchStarted(friendId, batch->id, batchName, batch->pending.size(), batch->totalBytes);
+    advanceFileBatch(batch->id);
+}
+
+void Core::cancelFileBatch(int friendId, int batchId)
+{
+    ToxFileBatch* batch = fileBatches.value(batchId, nullptr);
+    if (!batch || batch->friendId != friendId)
     {
-        qWarning() << QString("Core::sendFile: Can't open file, error: %1").arg(file.file->errorString());
+        qWarning("Core::cancelFileBatch: No such batch");
+        return;
     }
-    fileSendQueue.append(file);
+    batch->filesFailed += batch->pending.size();
+    batch->pending.clear();
 
-    emit fileSendStarted(fileSendQueue.last());
+    QList<ToxFile*> files;
+    for (ToxFile* file : fileTransfers)
+        if (file->batchId == batchId)
+            files.append(file);
+    if (files.isEmpty())
+    {
+        advanceFileBatch(batchId);
+        return;
+    }
+    // The batch finishes once the last of those is removed
+    for (ToxFile* file : files)
+        cancelFileSend(file->friendId, file->fileNum);
 }
 
-void Core::pauseResumeFileSend(int friendId, int fileNum)
+void Core::advanceFileBatch(int batchId)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileSendQueue)
+    ToxFileBatch* batch = fileBatches.value(batchId, nullptr);
+    if (!batch || batch->advancing)
+        return;
+
+    batch->advancing = true;
+    while (batch->inFlight < TOX_FILE_BATCH_IN_FLIGHT && !batch->pending.isEmpty())
     {
-        if (f.fileNum == fileNum && f.friendId == friendId)
+        ToxFileBatch::Entry entry = batch->pending.first();
+        if (!offerFile(batch->friendId, entry.name.toUtf8(), entry.path, entry.filesize, batchId))
         {
-            file = &f;
-            break;
+            // Toxcore may be out of file numbers, retry when one of ours is done
+            if (batch->inFlight)
+                break;
+            batch->pending.removeFirst();
+            batch->filesFailed++;
+            continue;
         }
+        batch->pending.removeFirst();
+        batch->inFlight++;
     }
+    batch->advancing = false;
+
+    if (batch->inFlight || !batch->pending.isEmpty())
+        return;
+    qDebug() << QString("Core::advanceFileBatch: Batch %1 to friend %2 is done, %3 files failed")
+                .arg(batchId).arg(batch->friendId).arg(batch->filesFailed);
+    reportFileBatchProgress(batch, true);
+    notifyFileBatchFinished(batch->friendId, batchId, batch->filesFailed);
+    fileBatches.remove(batchId);
+    delete batch;
+}
+
+void Core::fileBatchFileDone(int batchId, bool success)
+{
+    ToxFileBatch* batch = fileBatches.value(batchId, nullptr);
+    if (!batch)
+        return;
+    batch->inFlight--;
+    if (success)
+        batch->filesDone++;
+    else
+        batch->filesFailed++;
+    advanceFileBatch(batchId);
+}
+
+void Core::reportFileBatchProgress(ToxFileBatch* batch, bool force)
+{
+    qint64 now = loopClock.elapsed();
+    if (!force && now - batch->progressTime < TOX_FILE_PROGRESS_INTERVAL)
+        return;
+    batch->progressTime = now;
+
+    long long bytesSent = batch->doneBytes;
+    for (const ToxFile* file : fileTransfers)
+        if (file->batchId == batch->id)
+            bytesSent += file->bytesSent;
+    CoreEvent event;
+    event.type = CoreEvent::FileBatchInfo;
+    event.friendId = batch->friendId;
+    event.id = batch->id;
+    event.total = batch->filesDone;
+    event.done = bytesSent;
+    events.push(std::move(event));
+}
+
+bool Core::resumeFileRecv(ToxFile* file, const FileCheckpoint& checkpoint, const QByteArray& request)
+{
+    if (request.isEmpty())
+    {
+        qDebug() << "Core::resumeFileRecv: The partial file is gone or too short, asking the user again";
+        checkpoints.remove(checkpoint.friendKey, ToxFile::RECEIVING, checkpoint.fileName, checkpoint.filesize);
+        return false;
+    }
+
+    file->setFilePath(checkpoint.filePath);
+    file->writeBehind = new FileWriteBehind(checkpoint.filePath, file->filesize, checkpoint.offset);
+    if (!file->writeBehind->isOpen())
+    {
+        qWarning() << "Core::resumeFileRecv: Unable to open file";
+        delete file->writeBehind;
+        file->writeBehind = nullptr;
+        return false;
+    }
+    qDebug() << QString("Core::resumeFileRecv: Resuming file %1 from friend %2 at %3")
+                .arg(file->fileNum).arg(file->friendId).arg(checkpoint.offset);
+    file->bytesSent = checkpoint.offset;
+    file->status = ToxFile::TRANSMITTING;
+    tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_ACCEPT,
+                          (const uint8_t*)request.constData(), request.size());
+    wakeUp();
+    return true;
+}
+
+void Core::saveFileCheckpoint(ToxFile* file, bool force)
+{
+    qint64 now = loopClock.elapsed();
+    if (!file->writeBehind || (!force && now - file->checkpointTime < TOX_FILE_CHECKPOINT_INTERVAL))
+        return;
+    file->checkpointTime = now;
+
+    FileCheckpoint checkpoint{getFriendKey(file->friendId), ToxFile::RECEIVING, file->fileName, file->filePath,
+                              file->filesize, file->writeBehind->written(), QByteArray()};
+    checkpoints.save(checkpoint);
+}
+
+void Core::breakFileTransfers(int friendId)
+{
+    // What's already in flight will resume alone, the rest of the batch is lost
+    for (ToxFileBatch* batch : fileBatches)
+    {
+        if (batch->friendId != friendId)
+            continue;
+        batch->filesFailed += batch->pending.size();
+        batch->pending.clear();
+    }
+
+    QList<ToxFile*> broken;
+    for (ToxFile* file : fileTransfers)
+        if (file->friendId == friendId)
+            broken.append(file);
+
+    for (ToxFile* file : broken)
+    {
+        // Finishing, the data is all there and onFileWriteClosed completes it
+        if (file->writeBehind && file->writeBehind->isClosing())
+            continue;
+        // Keep the checkpoints so we can continue once the friend is back. What's written is a safe
+        // point to resume from, the rest still goes to disk but we don't wait for it
+        if (file->writeBehind)
+        {
+            saveFileCheckpoint(file, true);
+            file->writeBehind->closeAsync();
+        }
+        qDebug() << QString("Core::breakFileTransfers: Friend %1 went offline during transfer of file %2")
+                    .arg(friendId).arg(file->fileNum);
+        file->status = ToxFile::STOPPED;
+        notifyFileCancelled(file->friendId, file->fileNum, file->direction);
+        removeFileFromQueue(file->direction == ToxFile::SENDING, file->friendId, file->fileNum, true);
+    }
+}
+
+void Core::resumeFileSends(int friendId)
+{
+    // Each is offered by onFileSendChecked once its source is hashed
+    for (const FileCheckpoint& checkpoint : checkpoints.findAll(getFriendKey(friendId), ToxFile::SENDING))
+        checkpoints.checkFingerprintAsync(checkpoint, "onFileSendChecked", friendId);
+}
+
+void Core::acceptFileSend(ToxFile* file)
+{
+    file->status = ToxFile::TRANSMITTING;
+    emit fileTransferAccepted(*file);
+    qDebug() << "Core: File control callback, file accepted";
+    startFileSends();
+}
+
+void Core::onFileFingerprinted(quint64 key, QByteArray fingerprint)
+{
+    // Done or cancelled meanwhile, there's nothing to resume
+    ToxFile* file = fileTransfers.value(key, nullptr);
+    if (!file)
+        return;
+    FileCheckpoint checkpoint{getFriendKey(file->friendId), ToxFile::SENDING, file->fileName, file->filePath,
+                              file->filesize, 0, fingerprint};
+    checkpoints.save(checkpoint);
+}
+
+void Core::onFileSendChecked(quint64 friendId, FileCheckpoint checkpoint, bool unchanged)
+{
+    if (!unchanged)
+    {
+        qDebug() << "Core::onFileSendChecked: File changed since the transfer broke, dropping it" << checkpoint.filePath;
+        checkpoints.remove(checkpoint.friendKey, ToxFile::SENDING, checkpoint.fileName, checkpoint.filesize);
+        return;
+    }
+    // The friend may have been removed meanwhile
+    if (getFriendKey(friendId) != checkpoint.friendKey)
+        return;
+    sendFile(friendId, QString::fromUtf8(checkpoint.fileName), checkpoint.filePath, checkpoint.filesize);
+}
+
+void Core::onFileResumeChecked(quint64 key, qint64 offset)
+{
+    // Cancelled meanwhile, or accepted without resuming
+    ToxFile* file = fileTransfers.value(key, nullptr);
+    if (!file || file->status != ToxFile::STOPPED)
+        return;
+    if (offset < 0)
+    {
+        qWarning() << QString("Core::onFileResumeChecked: Can't resume file %1 with friend %2, starting over")
+                      .arg(file->fileNum).arg(file->friendId);
+        QString fileName = QString::fromUtf8(file->fileName), filePath = file->filePath;
+        int friendId = file->friendId;
+        long long filesize = file->filesize;
+        notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+        tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
+        removeFileFromQueue(true, file->friendId, file->fileNum);
+        sendFile(friendId, fileName, filePath, filesize);
+        return;
+    }
+    qDebug() << QString("Core::onFileResumeChecked: Resuming file %1 with friend %2 at %3")
+                .arg(file->fileNum).arg(file->friendId).arg(offset);
+    file->bytesSent = offset;
+    acceptFileSend(file);
+}
+
+void Core::onFileResumeRequestMade(quint64 key, FileCheckpoint checkpoint, QByteArray request)
+{
+    // The friend cancelled it meanwhile
+    ToxFile* file = fileTransfers.value(key, nullptr);
+    if (!file)
+        return;
+    bool resumed = resumeFileRecv(file, checkpoint, request);
+    emit fileReceiveRequested(*file);
+    if (resumed)
+        reportFileProgress(file, true);
+}
+
+QString Core::getFriendKey(int friendId) const
+{
+    uint8_t rawid[TOX_CLIENT_ID_SIZE];
+    if (tox_get_client_id(tox, friendId, rawid) != 0)
+        return QString();
+    return CUserId::toString(rawid);
+}
+
+void Core::pauseResumeFileSend(int friendId, int fileNum)
+{
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::SENDING);
     if (!file)
     {
         qWarning("Core::pauseResumeFileSend: No such file in queue");
@@ -549,6 +1129,7 @@ void Core::pauseResumeFileSend(int friendId, int fileNum)
         file->status = ToxFile::TRANSMITTING;
         emit fileTransferAccepted(*file);
         tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_ACCEPT, nullptr, 0);
+        startFileSends();
     }
     else
         qWarning() << "Core::pauseResumeFileSend: File is stopped";
@@ -556,15 +1137,7 @@ void Core::pauseResumeFileSend(int friendId, int fileNum)
 
 void Core::pauseResumeFileRecv(int friendId, int fileNum)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileRecvQueue)
-    {
-        if (f.fileNum == fileNum && f.friendId == friendId)
-        {
-            file = &f;
-            break;
-        }
-    }
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::cancelFileRecv: No such file in queue");
@@ -588,96 +1161,72 @@ void Core::pauseResumeFileRecv(int friendId, int fileNum)
 
 void Core::cancelFileSend(int friendId, int fileNum)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileSendQueue)
-    {
-        if (f.fileNum == fileNum && f.friendId == friendId)
-        {
-            file = &f;
-            break;
-        }
-    }
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::SENDING);
     if (!file)
     {
         qWarning("Core::cancelFileSend: No such file in queue");
         return;
     }
     file->status = ToxFile::STOPPED;
-    emit fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+    notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
     tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
-    while (file->sendTimer) QThread::msleep(1); // Wait until sendAllFileData returns before deleting
     removeFileFromQueue(true, friendId, fileNum);
 }
 
 void Core::cancelFileRecv(int friendId, int fileNum)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileRecvQueue)
-    {
-        if (f.fileNum == fileNum && f.friendId == friendId)
-        {
-            file = &f;
-            break;
-        }
-    }
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::cancelFileRecv: No such file in queue");
         return;
     }
     file->status = ToxFile::STOPPED;
-    emit fileTransferCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
+    notifyFileCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
     tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
-    removeFileFromQueue(true, friendId, fileNum);
+    removeFileFromQueue(false, friendId, fileNum);
 }
 
 void Core::rejectFileRecvRequest(int friendId, int fileNum)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileRecvQueue)
-    {
-        if (f.fileNum == fileNum && f.friendId == friendId)
-        {
-            file = &f;
-            break;
-        }
-    }
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::rejectFileRecvRequest: No such file in queue");
         return;
     }
     file->status = ToxFile::STOPPED;
-    emit fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+    notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
     tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
     removeFileFromQueue(false, friendId, fileNum);
 }
 
 void Core::acceptFileRecvRequest(int friendId, int fileNum, QString path)
 {
-    ToxFile* file{nullptr};
-    for (ToxFile& f : fileRecvQueue)
-    {
-        if (f.fileNum == fileNum && f.friendId == friendId)
-        {
-            file = &f;
-            break;
-        }
-    }
+    ToxFile* file = findFile(friendId, fileNum, ToxFile::RECEIVING);
     if (!file)
     {
         qWarning("Core::acceptFileRecvRequest: No such file in queue");
         return;
     }
+    if (file->writeBehind)
+    {
+        qDebug() << "Core::acceptFileRecvRequest: The file was already accepted or resumed";
+        return;
+    }
     file->setFilePath(path);
-    if (!file->open(true))
+    file->writeBehind = new FileWriteBehind(path, file->filesize, 0, Settings::getInstance().getHashTransfers());
+    if (!file->writeBehind->isOpen())
     {
         qWarning() << "Core::acceptFileRecvRequest: Unable to open file";
+        delete file->writeBehind;
+        file->writeBehind = nullptr;
         return;
     }
     file->status = ToxFile::TRANSMITTING;
     emit fileTransferAccepted(*file);
     tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_ACCEPT, nullptr, 0);
+    wakeUp();
 }
 
 void Core::removeFriend(int friendId)
@@ -685,7 +1234,8 @@ void Core::removeFriend(int friendId)
     if (tox_del_friend(tox, friendId) == -1) {
         emit failedToRemoveFriend(friendId);
     } else {
-        saveConfiguration();
+        outboxes.remove(friendId);
+        scheduleSave();
         emit friendRemoved(friendId);
     }
 }
@@ -693,6 +1243,8 @@ void Core::removeFriend(int friendId)
 void Core::removeGroup(int groupId)
 {
     tox_del_groupchat(tox, groupId);
+    QMutexLocker lock(&groupPeersMutex);
+    groupPeers.remove(groupId);
 }
 
 QString Core::getUsername()
@@ -713,7 +1265,7 @@ void Core::setUsername(const QString& username)
     if (tox_set_name(tox, cUsername.data(), cUsername.size()) == -1) {
         emit failedToSetUsername(username);
     } else {
-        saveConfiguration();
+        scheduleSave();
         emit usernameSet(username);
     }
 }
@@ -743,7 +1295,7 @@ void Core::setStatusMessage(const QString& message)
     if (tox_set_status_message(tox, cMessage.data(), cMessage.size()) == -1) {
         emit failedToSetStatusMessage(message);
     } else {
-        saveConfiguration();
+        scheduleSave();
         emit statusMessageSet(message);
     }
 }
@@ -767,7 +1319,7 @@ void Core::setStatus(Status status)
     }
 
     if (tox_set_user_status(tox, userstatus) == 0) {
-        saveConfiguration();
+        scheduleSave();
         emit statusSet(status);
     } else {
         emit failedToSetStatus(status);
@@ -784,70 +1336,233 @@ void Core::onFileTransferFinished(ToxFile file)
 
 void Core::bootstrapDht()
 {
-    const Settings& s = Settings::getInstance();
-    QList<Settings::DhtServer> dhtServerList = s.getDhtServerList();
-
-    int listSize = dhtServerList.size();
-    static int j = qrand() % listSize, n=0;
+    QList<KnownDhtNode> candidates = bootstrapCandidates();
+    if (candidates.isEmpty())
+    {
+        qWarning() << "Core::bootstrapDht: No bootstrap node to connect to";
+        return;
+    }
 
-    // We couldn't connect after trying 6 different nodes, let's try something else
-    if (n>3)
+    // The first attempt goes wide, the next ones go through the rest of the list a few nodes at a time
+    int count = TOX_BOOTSTRAP_RETRY_NODES;
+    if (bootstrapAttempts == 0)
+    {
+        qDebug() << "Core: Connecting to the DHT ...";
+        count = TOX_BOOTSTRAP_PARALLEL;
+        bootstrapIndex = 0;
+        bootstrapTimer->setInterval(TOX_BOOTSTRAP_INTERVAL);
+    }
+    else if (bootstrapAttempts > 3)
     {
         qDebug() << "Core: We're having trouble connecting to the DHT, slowing down";
-        bootstrapTimer->setInterval(TOX_BOOTSTRAP_INTERVAL*(n-1));
+        bootstrapTimer->setInterval(TOX_BOOTSTRAP_INTERVAL*std::min(bootstrapAttempts-2, 6));
     }
-    else
-        qDebug() << "Core: Connecting to the DHT ...";
+    bootstrapAttempts++;
 
-    int i=0;
-    while (i < (2 - (n>3)))
+    bootstrapRound.clear();
+    bootstrapRoundTime = loopClock.elapsed();
+    count = std::min(count, candidates.size());
+    for (int i=0; i<count; i++)
     {
-        const Settings::DhtServer& dhtServer = dhtServerList[j % listSize];
-        if (tox_bootstrap_from_address(tox, dhtServer.address.toLatin1().data(),
-            dhtServer.port, CUserId(dhtServer.userId).data()) == 1)
-            qDebug() << QString("Core: Bootstraping from ")+dhtServer.name+QString(", addr ")+dhtServer.address.toLatin1().data()
-                        +QString(", port ")+QString().setNum(dhtServer.port);
+        const KnownDhtNode& node = candidates[bootstrapIndex++ % candidates.size()];
+        if (tox_bootstrap_from_address(tox, node.address.toLatin1().data(),
+            node.port, CUserId(node.userId).data()) == 1)
+        {
+            qDebug() << QString("Core: Bootstraping from ")+node.name+QString(", addr ")+node.address.toLatin1().data()
+                        +QString(", port ")+QString().setNum(node.port);
+            bootstrapRound << node;
+        }
         else
-            qDebug() << "Core: Error bootstraping from "+dhtServer.name;
+            qDebug() << "Core: Error bootstraping from "+node.name;
+    }
+}
 
-        tox_do(tox);
-        j++;
-        i++;
-        n++;
+QList<KnownDhtNode> Core::bootstrapCandidates() const
+{
+    QList<KnownDhtNode> candidates;
+    QSet<QString> keys;
+    QDateTime oldest = QDateTime::currentDateTime().addDays(-TOX_BOOTSTRAP_CACHE_MAX_AGE);
+    for (const KnownDhtNode& node : knownDhtNodes)
+    {
+        if (node.lastConnected < oldest)
+            continue;
+        candidates << node;
+        keys.insert(node.userId);
     }
+
+    QList<Settings::DhtServer> servers = Settings::getInstance().getDhtServerList();
+    for (int i=0; i<servers.size(); i++)
+    {
+        const Settings::DhtServer& server = servers[(bootstrapOffset + i) % servers.size()];
+        if (keys.contains(server.userId))
+            continue;
+        KnownDhtNode node;
+        node.name = server.name;
+        node.userId = server.userId;
+        node.address = server.address;
+        node.port = server.port;
+        node.connectTime = -1;
+        candidates << node;
+    }
+    return candidates;
+}
+
+void Core::rememberBootstrapNodes()
+{
+    if (bootstrapRound.isEmpty())
+        return;
+
+    int connectTime = loopClock.elapsed() - bootstrapRoundTime;
+    QDateTime now = QDateTime::currentDateTime();
+    for (KnownDhtNode node : bootstrapRound)
+    {
+        node.connectTime = connectTime;
+        node.lastConnected = now;
+        for (int i=0; i<knownDhtNodes.size(); i++)
+        {
+            if (knownDhtNodes[i].userId != node.userId)
+                continue;
+            // Averaged, so one slow start doesn't bury a node that's usually fast
+            if (knownDhtNodes[i].connectTime >= 0)
+                node.connectTime = (node.connectTime + knownDhtNodes[i].connectTime) / 2;
+            knownDhtNodes.removeAt(i);
+            break;
+        }
+        knownDhtNodes << node;
+    }
+    bootstrapRound.clear();
+
+    std::stable_sort(knownDhtNodes.begin(), knownDhtNodes.end(), [](const KnownDhtNode& a, const KnownDhtNode& b)
+    {
+        return a.connectTime < b.connectTime;
+    });
+    while (knownDhtNodes.size() > TOX_BOOTSTRAP_CACHE_SIZE)
+        knownDhtNodes.removeLast();
+    emit knownDhtNodesChanged(knownDhtNodes);
 }
 
 void Core::process()
 {
-    tox_do(tox);
+    qint64 now = loopClock.elapsed();
+    if (lastIteration)
+        recordLoopLatency(now - lastIteration, std::max<qint64>(now - nextDeadline, 0));
+    lastIteration = now;
+
+    {
+        CoreProfiler::Scope scope(profiler, CoreProfiler::ToxDo);
+        tox_do(tox);
+    }
+    profiler.record(CoreProfiler::EventQueueDepth, events.depth());
+    if (!dirtyGroupPeers.isEmpty())
+        refreshGroupPeers();
+    if (!pendingGroupMessages.isEmpty())
+        flushGroupMessages();
+    if (!outboxes.isEmpty())
+        sendQueuedMessages();
+    if (events.hasOverflow())
+        events.flushOverflow();
+    if (fileSendsStalled)
+    {
+        fileSendsStalled = false;
+        startFileSends();
+    }
+    resumeFileRecvs();
 #ifdef DEBUG
     //we want to see the debug messages immediately
     fflush(stdout);
 #endif
     checkConnection();
-    //int toxInterval = tox_do_interval(tox);
-    //qDebug() << QString("Tox interval %1").arg(toxInterval);
-    toxTimer->start(50);
+    scheduleProcess();
 }
 
-void Core::checkConnection()
+void Core::scheduleProcess()
+{
+    int interval = tox_do_interval(tox);
+
+    // Nobody is looking and nothing is in flight, no need to wake up that often
+    if (windowMinimized && !hasActiveWork())
+        interval = std::max(interval, TOX_IDLE_INTERVAL);
+
+    nextDeadline = loopClock.elapsed() + interval;
+    toxTimer->start(interval);
+}
+
+void Core::wakeUp()
+{
+    if (!tox || !toxTimer->isActive() || toxTimer->remainingTime() == 0)
+        return;
+
+    nextDeadline = loopClock.elapsed();
+    toxTimer->start(0);
+}
+
+bool Core::hasActiveWork() const
 {
-    static bool isConnected = false;
+    for (int i=0; i<TOXAV_MAX_CALLS; i++)
+        if (calls[i].active)
+            return true;
+    for (const ToxFile* f : fileTransfers)
+        if (f->status == ToxFile::TRANSMITTING)
+            return true;
+    for (auto it = outboxes.begin(); it != outboxes.end(); ++it)
+        if (!it->queued.isEmpty() && tox_get_friend_connection_status(tox, it.key()) == 1)
+            return true;
+    return false;
+}
+
+void Core::recordLoopLatency(qint64 period, qint64 lateness)
+{
+    profiler.record(CoreProfiler::LoopPeriod, period * 1000);
+    profiler.record(CoreProfiler::TimerLateness, lateness * 1000);
+    loopCount++;
+    loopPeriodSum += period;
+    loopPeriodMax = std::max(loopPeriodMax, period);
+    loopLatenessSum += lateness;
+
+    qint64 now = loopClock.elapsed();
+    if (now - lastLatencyReport < TOX_LATENCY_REPORT_INTERVAL)
+        return;
+
+    qDebug() << QString("Core: loop period avg %1ms max %2ms, timer lateness avg %3ms over %4 iterations")
+                .arg((double)loopPeriodSum/loopCount, 0, 'f', 1).arg(loopPeriodMax)
+                .arg((double)loopLatenessSum/loopCount, 0, 'f', 1).arg(loopCount);
+    if (Settings::getInstance().getLogCoreStats())
+    {
+        qDebug("%s", qPrintable(profiler.report()));
+        profiler.reset();
+    }
+    lastLatencyReport = now;
+    loopCount = loopPeriodSum = loopPeriodMax = loopLatenessSum = 0;
+}
 
+void Core::setWindowMinimized(bool minimized)
+{
+    windowMinimized = minimized;
+    if (!minimized)
+        wakeUp();
+}
+
+void Core::checkConnection()
+{
     if (tox_isconnected(tox) && !isConnected) {
         qDebug() << "Core: Connected to DHT";
         emit connected();
         isConnected = true;
+        rememberBootstrapNodes();
+        bootstrapAttempts = 0;
     } else if (!tox_isconnected(tox) && isConnected) {
         qDebug() << "Core: Disconnected to DHT";
         emit disconnected();
         isConnected = false;
+        // Likely a network change, start over wide instead of where the retries left off
+        bootstrapAttempts = 0;
+        bootstrapDht();
     }
 }
 
 void Core::loadConfiguration()
 {
-    QString path = QDir(Settings::getSettingsDirPath()).filePath(CONFIG_FILE_NAME);
+    QString path = QDir(getProfileDir()).filePath(CONFIG_FILE_NAME);
 
     QFile configurationFile(path);
 
@@ -889,7 +1604,7 @@ void Core::saveConfiguration()
         return;
     }
 
-    QString path = Settings::getSettingsDirPath();
+    QString path = getProfileDir();
 
     QDir directory(path);
 
@@ -899,62 +1614,80 @@ void Core::saveConfiguration()
     }
 
     path = directory.filePath(CONFIG_FILE_NAME);
-    QSaveFile configurationFile(path);
-    if (!configurationFile.open(QIODevice::WriteOnly)) {
-        qCritical() << "File " << path << " cannot be opened";
-        return;
-    }
-
-        qDebug() << "Core: Saving";
+    qDebug() << "Core: Saving";
 
     uint32_t fileSize = tox_size(tox);
     if (fileSize > 0 && fileSize <= INT32_MAX) {
-        uint8_t *data = new uint8_t[fileSize];
-        tox_save(tox, data);
-        configurationFile.write(reinterpret_cast<char *>(data), fileSize);
-        configurationFile.commit();
-        delete[] data;
+        QByteArray data(fileSize, Qt::Uninitialized);
+        tox_save(tox, reinterpret_cast<uint8_t*>(data.data()));
+        ProfileSaver::getInstance().write(path, data);
     }
+}
 
-    Settings::getInstance().save();
+void Core::scheduleSave()
+{
+    // Not restarted by later changes, so a steady stream of them still gets saved
+    if (!saveTimer->isActive())
+        saveTimer->start();
+}
+
+void Core::onSaveTimer()
+{
+    {
+        CoreProfiler::Scope scope(profiler, CoreProfiler::SaveSnapshot);
+        saveConfiguration();
+    }
+    // Friend addresses are kept in the settings, they're saved on the GUI thread with the rest
+    QMetaObject::invokeMethod(&Settings::getInstance(), "requestSave", Qt::QueuedConnection);
 }
 
 void Core::loadFriends()
 {
+    StartupTrace::Phase phase("Friend list");
     const uint32_t friendCount = tox_count_friendlist(tox);
-    if (friendCount > 0) {
-        // assuming there are not that many friends to fill up the whole stack
-        int32_t *ids = new int32_t[friendCount];
-        tox_get_friendlist(tox, ids, friendCount);
-        uint8_t clientId[TOX_CLIENT_ID_SIZE];
-        for (int32_t i = 0; i < static_cast<int32_t>(friendCount); ++i) {
-            if (tox_get_client_id(tox, ids[i], clientId) == 0) {
-                emit friendAdded(ids[i], CUserId::toString(clientId));
-
-                const int nameSize = tox_get_name_size(tox, ids[i]);
-                if (nameSize > 0) {
-                    uint8_t *name = new uint8_t[nameSize];
-                    if (tox_get_name(tox, ids[i], name) == nameSize) {
-                        emit friendUsernameLoaded(ids[i], CString::toString(name, nameSize));
-                    }
-                    delete[] name;
-                }
-
-                const int statusMessageSize = tox_get_status_message_size(tox, ids[i]);
-                if (statusMessageSize > 0) {
-                    uint8_t *statusMessage = new uint8_t[statusMessageSize];
-                    if (tox_get_status_message(tox, ids[i], statusMessage, statusMessageSize) == statusMessageSize) {
-                        emit friendStatusMessageLoaded(ids[i], CString::toString(statusMessage, statusMessageSize));
-                    }
-                    delete[] statusMessage;
-                }
-
-                checkLastOnline(ids[i]);
-            }
+    if (friendCount == 0)
+        return;
+
+    QVector<int32_t> ids(friendCount);
+    tox_get_friendlist(tox, ids.data(), friendCount);
+    QList<FriendInfo> friends;
+    friends.reserve(friendCount);
+    QByteArray buffer;
+    uint8_t clientId[TOX_CLIENT_ID_SIZE];
+    for (int32_t id : ids)
+    {
+        if (tox_get_client_id(tox, id, clientId) != 0)
+            continue;
+
+        FriendInfo info;
+        info.friendId = id;
+        info.userId = CUserId::toString(clientId);
 
+        const int nameSize = tox_get_name_size(tox, id);
+        if (nameSize > 0)
+        {
+            buffer.resize(nameSize);
+            if (tox_get_name(tox, id, (uint8_t*)buffer.data()) == nameSize)
+                info.name = CString::toString((uint8_t*)buffer.data(), nameSize);
+        }
+
+        const int statusMessageSize = tox_get_status_message_size(tox, id);
+        if (statusMessageSize > 0)
+        {
+            buffer.resize(statusMessageSize);
+            if (tox_get_status_message(tox, id, (uint8_t*)buffer.data(), statusMessageSize) == statusMessageSize)
+                info.statusMessage = CString::toString((uint8_t*)buffer.data(), statusMessageSize);
         }
-        delete[] ids;
+
+        const uint64_t lastOnline = tox_get_last_online(tox, id);
+        if (lastOnline > 0)
+            info.lastSeen = QDateTime::fromTime_t(lastOnline);
+
+        friends.append(info);
     }
+
+    // One queued event for the whole list, the GUI fills its model in a single pass
+    emit friendListLoaded(friends);
 }
 
 void Core::checkLastOnline(int friendId) {
@@ -983,26 +1716,50 @@ QString Core::getGroupPeerName(int groupId, int peerId) const
     return name;
 }
 
-QList<QString> Core::getGroupPeerNames(int groupId) const
+GroupPeers Core::getGroupPeers(int groupId) const
 {
-    QList<QString> names;
-    int nPeers = getGroupNumberPeers(groupId);
-    if (nPeers == -1)
-    {
-        qWarning() << "Core::getGroupPeerNames: Unable to get number of peers";
-        return names;
-    }
-    uint8_t namesArray[nPeers][TOX_MAX_NAME_LENGTH];
-    uint16_t* lengths = new uint16_t[nPeers];
-    int result = tox_group_get_names(tox, groupId, namesArray, lengths, nPeers);
-    if (result != nPeers)
+    QMutexLocker lock(&groupPeersMutex);
+    GroupPeers peers = groupPeers.value(groupId);
+    return peers ? peers : GroupPeers(new GroupPeerSnapshot);
+}
+
+void Core::refreshGroupPeers()
+{
+    uint8_t name[TOX_MAX_NAME_LENGTH];
+    for (int groupId : dirtyGroupPeers)
     {
-        qWarning() << "Core::getGroupPeerNames: Unexpected result";
-        return names;
+        int count = std::max(tox_group_number_peers(tox, groupId), 0);
+        int previousSize = 0;
+        {
+            QMutexLocker lock(&groupPeersMutex);
+            if (GroupPeers previous = groupPeers.value(groupId))
+                previousSize = previous->arena.size();
+        }
+
+        // Sized from the last snapshot, so a busy room doesn't regrow the arena name by name
+        GroupPeerSnapshot* snapshot = new GroupPeerSnapshot;
+        snapshot->peers.resize(count);
+        snapshot->arena.reserve(std::max(previousSize, count * (GROUPCHAT_PEER_KEY_SIZE + 16)));
+        snapshot->arena.fill(0, count * GROUPCHAT_PEER_KEY_SIZE);
+        for (int i=0; i<count; i++)
+        {
+            tox_group_peer_pubkey(tox, groupId, i, (uint8_t*)snapshot->arena.data() + i * GROUPCHAT_PEER_KEY_SIZE);
+            int length = std::max(tox_group_peername(tox, groupId, i, name), 0);
+            snapshot->peers[i] = {snapshot->arena.size(), length};
+            snapshot->arena.append((const char*)name, length);
+        }
+
+        QMutexLocker lock(&groupPeersMutex);
+        groupPeers[groupId] = GroupPeers(snapshot);
     }
-    for (int i=0; i<nPeers; i++)
-       names.push_back(CString::toString(namesArray[i], lengths[i]));
-    return names;
+    dirtyGroupPeers.clear();
+}
+
+void Core::flushGroupMessages()
+{
+    for (auto it = pendingGroupMessages.constBegin(); it != pendingGroupMessages.constEnd(); ++it)
+        emit groupMessagesReceived(it.key(), it.value());
+    pendingGroupMessages.clear();
 }
 
 int Core::joinGroupchat(int32_t friendnumber, const uint8_t* friend_group_public_key) const
@@ -1016,122 +1773,373 @@ void Core::quitGroupChat(int groupId) const
     tox_del_groupchat(tox, groupId);
 }
 
-void Core::removeFileFromQueue(bool sendQueue, int friendId, int fileId)
+quint64 Core::fileTransferKey(int friendId, int fileNum, ToxFile::FileDirection direction)
 {
-    bool found = false;
-    if (sendQueue)
-    {
-        for (int i=0; i<fileSendQueue.size();)
-        {
-            if (fileSendQueue[i].friendId == friendId && fileSendQueue[i].fileNum == fileId)
-            {
-                found = true;
-                fileSendQueue[i].file->close();
-                delete fileSendQueue[i].file;
-                fileSendQueue.removeAt(i);
-                continue;
-            }
-            i++;
-        }
-    }
-    else
+    return (quint64(quint32(friendId)) << 32) | (quint64(direction) << 16) | quint16(fileNum);
+}
+
+ToxFile* Core::findFile(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    return fileTransfers.value(fileTransferKey(friendId, fileNum, direction), nullptr);
+}
+
+void Core::addFileToQueue(ToxFile* file)
+{
+    quint64 key = fileTransferKey(file->friendId, file->fileNum, file->direction);
+    if (fileTransfers.contains(key))
     {
-        for (int i=0; i<fileRecvQueue.size();)
-        {
-            if (fileRecvQueue[i].friendId == friendId && fileRecvQueue[i].fileNum == fileId)
-            {
-                found = true;
-                fileRecvQueue[i].file->close();
-                delete fileRecvQueue[i].file;
-                fileRecvQueue.removeAt(i);
-                continue;
-            }
-            i++;
-        }
+        // Toxcore reuses file numbers, so a stale entry means we missed the end of the last transfer
+        qWarning() << "Core::addFileToQueue: Replacing a stale transfer with the same file number";
+        removeFileFromQueue(file->direction == ToxFile::SENDING, file->friendId, file->fileNum, true);
     }
-    if (!found)
-        qWarning() << "Core::removeFileFromQueue: No such file in queue";
+    file->stats.rateBytes = file->bytesSent;
+    file->stats.rateTime = loopClock.elapsed();
+    fileTransfers.insert(key, file);
 }
 
-void Core::sendAllFileData(Core *core, ToxFile* file)
+void Core::removeFileFromQueue(bool sendQueue, int friendId, int fileId, bool keepCheckpoint)
 {
-    if (file->status == ToxFile::PAUSED)
+    ToxFile* file = fileTransfers.take(fileTransferKey(friendId, fileId, sendQueue ? ToxFile::SENDING : ToxFile::RECEIVING));
+    if (!file)
     {
-        file->sendTimer->start(5+TOX_FILE_INTERVAL);
+        qWarning() << "Core::removeFileFromQueue: No such file in queue";
         return;
     }
-    else if (file->status == ToxFile::STOPPED)
+    if (!keepCheckpoint)
+        checkpoints.remove(getFriendKey(friendId), file->direction, file->fileName, file->filesize);
+    int batchId = file->batchId;
+    bool complete = file->bytesSent == file->filesize;
+    // Cancelled or failed, what we have of it is no use without the checkpoint
+    if (file->writeBehind && !keepCheckpoint && (!complete || file->writeBehind->hasError()))
+        file->writeBehind->discard();
+    if (ToxFileBatch* batch = fileBatches.value(batchId, nullptr))
+        if (complete)
+            batch->doneBytes += file->filesize;
+    file->file->close();
+    delete file->file;
+    delete file->readAhead;
+    delete file->writeBehind;
+    delete file;
+
+    if (batchId >= 0)
+        fileBatchFileDone(batchId, complete);
+}
+
+void Core::resumeFileRecvs()
+{
+    for (ToxFile* file : fileTransfers)
     {
-        qWarning("Core::sendAllFileData: File is stopped");
-        file->sendTimer->disconnect();
-        delete file->sendTimer;
-        file->sendTimer = nullptr;
-        return;
+        if (file->direction != ToxFile::RECEIVING || file->stats.diskStallTime < 0
+                || file->writeBehind->isBackedUp())
+            continue;
+        file->stats.diskWaitMs += loopClock.elapsed() - file->stats.diskStallTime;
+        file->stats.diskStallTime = -1;
+        // Paused by the user meanwhile, their resume accepts it
+        if (file->status == ToxFile::TRANSMITTING)
+            tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_ACCEPT, nullptr, 0);
     }
-    emit core->fileTransferInfo(file->friendId, file->fileNum, file->filesize, file->bytesSent, ToxFile::SENDING);
-    qApp->processEvents();
-    long long chunkSize = tox_file_data_size(core->tox, file->friendId);
-    if (chunkSize == -1)
+}
+
+void Core::onFileWriteClosed(quint64 key)
+{
+    // Cancelled or dropped while the last blocks were written
+    ToxFile* file = fileTransfers.value(key, nullptr);
+    if (!file)
+        return;
+
+    if (file->writeBehind && file->writeBehind->hasError())
     {
-        qWarning("Core::fileHeartbeat: Error getting preffered chunk size, aborting file send");
-        file->status = ToxFile::STOPPED;
-        emit core->fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
-        tox_file_send_control(core->tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
-        removeFileFromQueue(true, file->friendId, file->fileNum);
+        qWarning() << QString("Core::onFileWriteClosed: Error writing file: %1").arg(file->writeBehind->errorString());
+        notifyFileCancelled(file->friendId, file->fileNum, ToxFile::RECEIVING);
+        tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
+        removeFileFromQueue(false, file->friendId, file->fileNum);
         return;
     }
-    //qDebug() << "chunkSize: " << chunkSize;
-    chunkSize = std::min(chunkSize, file->filesize);
-    uint8_t* data = new uint8_t[chunkSize];
-    file->file->seek(file->bytesSent);
-    int readSize = file->file->read((char*)data, chunkSize);
-    if (readSize == -1)
-    {
-        qWarning() << QString("Core::sendAllFileData: Error reading from file: %1").arg(file->file->errorString());
-        delete[] data;
-        file->status = ToxFile::STOPPED;
-        emit core->fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
-        tox_file_send_control(core->tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
-        removeFileFromQueue(true, file->friendId, file->fileNum);
+    if (file->writeBehind)
+        file->digest = file->writeBehind->digest();
+    if (!file->peerDigest.isEmpty() && !file->digest.isEmpty())
+        file->digestMismatch = file->peerDigest != file->digest;
+    if (file->digestMismatch)
+        qWarning() << QString("Core::onFileWriteClosed: File %1 from friend %2 is corrupted, the digests don't match")
+                      .arg(file->fileNum).arg(file->friendId);
+    reportFileProgress(file, true);
+    notifyFileFinished(*file);
+    // confirm receive is complete
+    tox_file_send_control(tox, file->friendId, 1, file->fileNum, TOX_FILECONTROL_FINISHED,
+                          (const uint8_t*)file->digest.constData(), file->digest.size());
+    removeFileFromQueue(false, file->friendId, file->fileNum);
+}
+
+void Core::startFileSends()
+{
+    if (!fileTimer->isActive() || fileTimer->remainingTime() > 0)
+        fileTimer->start(0);
+}
+
+void Core::fileHeartbeat()
+{
+    CoreProfiler::Scope scope(profiler, CoreProfiler::FileHeartbeat);
+    QVector<ToxFile*> sends;
+    for (ToxFile* file : fileTransfers)
+        if (file->direction == ToxFile::SENDING && file->status == ToxFile::TRANSMITTING)
+            sends.append(file);
+    if (sends.isEmpty())
         return;
+
+    bool inCall = false;
+    for (int i=0; i<TOXAV_MAX_CALLS; i++)
+        if (calls[i].active)
+            inCall = true;
+
+    // Token bucket for the upload limit, we may overdraw by a chunk and pay it back later
+    long long limit = Settings::getInstance().getUploadLimit() * 1024LL;
+    // A capped link of the harness can't take more than its bandwidth either
+    if (long long cap = impairment.getProfile().bandwidth * 1000LL / 8)
+        limit = limit ? std::min(limit, cap) : cap;
+    qint64 now = loopClock.elapsed();
+    if (limit)
+        uploadTokens = std::min(uploadTokens + limit * (now - uploadRefillTime) / 1000, limit / TOX_FILE_UPLOAD_BURST);
+    uploadRefillTime = now;
+    long long budget = limit ? uploadTokens : std::numeric_limits<long long>::max();
+
+    // Round-robin, every transfer gets the same quantum of chunks per round until toxcore
+    // stops taking data. During a call we only do one small round so the A/V packets go first
+    int quantum = inCall ? TOX_FILE_CALL_QUANTUM : TOX_FILE_QUANTUM;
+    int start = fileRotation++ % (quint32)sends.size();
+    QSet<int> blockedFriends;
+    long long totalSent = 0;
+    bool progress = true;
+    for (int round=0; progress && totalSent < budget && (!inCall || round == 0); round++)
+    {
+        progress = false;
+        for (int i=0; i<sends.size() && totalSent < budget; i++)
+        {
+            ToxFile*& file = sends[(start + i) % sends.size()];
+            if (!file || blockedFriends.contains(file->friendId))
+                continue;
+
+            bool windowFull = false;
+            long long sent = sendFileChunks(file, quantum, budget - totalSent, windowFull);
+            if (sent < 0)
+            {
+                file = nullptr; // Aborted and removed
+                continue;
+            }
+            totalSent += sent;
+            if (file->status != ToxFile::TRANSMITTING)
+                file = nullptr; // Everything was sent
+            else if (windowFull)
+                blockedFriends.insert(file->friendId);
+            else if (sent)
+                progress = true;
+        }
     }
-    else if (readSize == 0)
+    if (limit)
+        uploadTokens -= totalSent;
+    if (totalSent)
+        wakeUp();
+
+    if (std::none_of(sends.begin(), sends.end(), [](ToxFile* file){return file != nullptr;}))
+        return;
+    // Toxcore's windows are full or the disk is behind, polling wouldn't help. The next tox_do
+    // frees the windows, it starts us again
+    fileSendsStalled = !totalSent && !(limit && uploadTokens <= 0);
+    if (fileSendsStalled)
+        return;
+    if (limit && uploadTokens <= 0)
+        fileTimer->start(1 + (-uploadTokens * 1000) / limit);
+    else if (inCall)
+        fileTimer->start(TOX_FILE_CALL_INTERVAL);
+    else
+        fileTimer->start(1+TOX_FILE_INTERVAL);
+}
+
+long long Core::sendFileChunks(ToxFile* file, int maxChunks, long long maxBytes, bool& windowFull)
+{
+    QElapsedTimer busy;
+    busy.start();
+    file->stats.wakeups++;
+
+    long long chunkSize = tox_file_data_size(tox, file->friendId);
+    if (chunkSize == -1)
     {
-        qWarning() << QString("Core::sendAllFileData: Nothing to read from file: %1").arg(file->file->errorString());
-        delete[] data;
+        qWarning("Core::sendFileChunks: Error getting preffered chunk size, aborting file send");
         file->status = ToxFile::STOPPED;
-        emit core->fileTransferCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
-        tox_file_send_control(core->tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
+        notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+        tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
         removeFileFromQueue(true, file->friendId, file->fileNum);
-        return;
+        return -1;
     }
-    if (tox_file_send_data(core->tox, file->friendId, file->fileNum, data, readSize) == -1)
+    if (!file->readAhead)
+        file->readAhead = new FileReadAhead(file->filePath, file->bytesSent, file->filesize, chunkSize,
+                                            Settings::getInstance().getHashTransfers());
+
+    // The reads happen on the read-ahead worker, we only hand ready chunks to toxcore
+    long long sent = 0;
+    for (int i=0; i<maxChunks && sent < maxBytes && file->bytesSent < file->filesize; i++)
     {
-        //qWarning("Core::fileHeartbeat: Error sending data chunk");
-        //core->process();
-        delete[] data;
-        //QThread::msleep(1);
-        file->sendTimer->start(1+TOX_FILE_INTERVAL);
-        return;
+        int readSize = 0;
+        const uint8_t* data = file->readAhead->peek(readSize);
+        if (!data)
+        {
+            if (!file->readAhead->hasError())
+            {
+                if (file->stats.diskStallTime < 0)
+                    file->stats.diskStallTime = loopClock.elapsed();
+                break; // Not read yet, try again on the next heartbeat
+            }
+            qWarning() << QString("Core::sendFileChunks: Error reading from file: %1").arg(file->readAhead->errorString());
+            file->status = ToxFile::STOPPED;
+            notifyFileCancelled(file->friendId, file->fileNum, ToxFile::SENDING);
+            tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_KILL, nullptr, 0);
+            removeFileFromQueue(true, file->friendId, file->fileNum);
+            return -1;
+        }
+        if (file->stats.diskStallTime >= 0)
+        {
+            file->stats.diskWaitMs += loopClock.elapsed() - file->stats.diskStallTime;
+            file->stats.diskStallTime = -1;
+        }
+        if (tox_file_send_data(tox, file->friendId, file->fileNum, data, readSize) == -1)
+        {
+            file->stats.sendFailures++;
+            windowFull = true; // The chunk stays queued until the next tox_do
+            break;
+        }
+        file->readAhead->pop();
+        file->bytesSent += readSize;
+        sent += readSize;
     }
-    delete[] data;
-    file->bytesSent += readSize;
-    //qDebug() << QString("Core::fileHeartbeat: sent %1/%2 bytes").arg(file->bytesSent).arg(file->fileData.size());
+    //qDebug() << QString("Core::sendFileChunks: sent %1/%2 bytes").arg(file->bytesSent).arg(file->filesize);
 
     if (file->bytesSent < file->filesize)
     {
-        file->sendTimer->start(TOX_FILE_INTERVAL);
+        if (sent)
+            reportFileProgress(file);
+        file->stats.coreTimeUs += busy.nsecsElapsed() / 1000;
+        return sent;
+    }
+
+    //qDebug("Core: File transfer finished");
+    reportFileProgress(file, true);
+    file->digest = file->readAhead->digest();
+    delete file->readAhead;
+    file->readAhead = nullptr;
+    file->status = ToxFile::STOPPED; // Waiting for the friend to confirm with FILECONTROL_FINISHED
+    tox_file_send_control(tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_FINISHED,
+                          (const uint8_t*)file->digest.constData(), file->digest.size());
+    //emit core->fileTransferFinished(*file);
+    file->stats.coreTimeUs += busy.nsecsElapsed() / 1000;
+    return sent;
+}
+
+void Core::reportFileProgress(ToxFile* file, bool force)
+{
+    if (file->batchId >= 0)
+    {
+        // Nobody shows the files of a batch one by one
+        if (ToxFileBatch* batch = fileBatches.value(file->batchId, nullptr))
+            reportFileBatchProgress(batch, force);
         return;
     }
-    else
+
+    qint64 now = loopClock.elapsed();
+    if (!force && now - file->progressTime < TOX_FILE_PROGRESS_INTERVAL)
+        return;
+    file->progressTime = now;
+    CoreEvent event;
+    event.type = CoreEvent::FileTransferInfo;
+    event.direction = file->direction;
+    event.friendId = file->friendId;
+    event.id = file->fileNum;
+    event.total = file->filesize;
+    event.done = file->bytesSent;
+    events.push(std::move(event));
+}
+
+void Core::notifyFileFinished(const ToxFile& file)
+{
+    CoreEvent event;
+    event.type = CoreEvent::FileTransferFinished;
+    event.friendId = file.friendId;
+    event.id = file.fileNum;
+    event.file = file;
+    events.push(std::move(event));
+    emit fileTransferFinished(file);
+}
+
+void Core::notifyFileCancelled(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    CoreEvent event;
+    event.type = CoreEvent::FileTransferCancelled;
+    event.direction = direction;
+    event.friendId = friendId;
+    event.id = fileNum;
+    events.push(std::move(event));
+    emit fileTransferCancelled(friendId, fileNum, direction);
+}
+
+void Core::notifyFileBatchFinished(int friendId, int batchId, int filesFailed)
+{
+    CoreEvent event;
+    event.type = CoreEvent::FileBatchFinished;
+    event.friendId = friendId;
+    event.id = batchId;
+    event.total = filesFailed;
+    events.push(std::move(event));
+    emit fileBatchFinished(friendId, batchId, filesFailed);
+}
+
+void Core::requestLoopStats()
+{
+    emit loopStats(QJsonDocument(profiler.snapshot()).toJson(QJsonDocument::Compact));
+}
+
+void Core::resetLoopStats()
+{
+    profiler.reset();
+}
+
+void Core::requestFileTransferStats()
+{
+    static const char* statusNames[] = {"stopped", "paused", "transmitting"};
+
+    qint64 now = loopClock.elapsed();
+    QJsonArray transfers;
+    for (ToxFile* file : fileTransfers)
     {
-        //qDebug("Core: File transfer finished");
-        file->sendTimer->disconnect();
-        delete file->sendTimer;
-        file->sendTimer = nullptr;
-        tox_file_send_control(core->tox, file->friendId, 0, file->fileNum, TOX_FILECONTROL_FINISHED, nullptr, 0);
-        //emit core->fileTransferFinished(*file);
-    }
+        ToxFileStats& stats = file->stats;
+        if (now > stats.rateTime)
+        {
+            stats.bytesPerSec = (file->bytesSent - stats.rateBytes) * 1000 / (now - stats.rateTime);
+            stats.rateBytes = file->bytesSent;
+            stats.rateTime = now;
+        }
+        long long diskWaitMs = stats.diskWaitMs;
+        if (stats.diskStallTime >= 0)
+            diskWaitMs += now - stats.diskStallTime;
+
+        QJsonObject entry;
+        entry["friendId"] = file->friendId;
+        entry["fileNum"] = file->fileNum;
+        entry["direction"] = file->direction == ToxFile::SENDING ? "sending" : "receiving";
+        entry["fileName"] = QString::fromUtf8(file->fileName);
+        entry["status"] = statusNames[file->status];
+        entry["bytesSent"] = (double)file->bytesSent;
+        entry["filesize"] = (double)file->filesize;
+        entry["bytesPerSec"] = (double)stats.bytesPerSec;
+        entry["sendFailures"] = stats.sendFailures;
+        entry["wakeups"] = stats.wakeups;
+        entry["diskWaitMs"] = (double)diskWaitMs;
+        entry["coreTimeUs"] = (double)stats.coreTimeUs;
+        transfers.append(entry);
+    }
+
+    QJsonObject root;
+    root["time"] = (double)now;
+    root["uploadLimit"] = Settings::getInstance().getUploadLimit();
+    root["transfers"] = transfers;
+    emit fileTransferStats(QJsonDocument(root).toJson());
 }
 
 void Core::groupInviteFriend(int friendId, int groupId)
@@ -1149,13 +2157,8 @@ QString Core::getFriendAddress(int friendNumber) const
     // If we don't know the full address of the client, return just the id, otherwise get the full address
     uint8_t rawid[TOX_CLIENT_ID_SIZE];
     tox_get_client_id(tox, friendNumber, rawid);
-    QByteArray data((char*)rawid,TOX_CLIENT_ID_SIZE);
-    QString id = data.toHex().toUpper();
-
-    QList<QString>& friendAddresses = Settings::getInstance().friendAddresses;
-    for (QString addr : friendAddresses)
-        if (addr.toUpper().contains(id))
-            return addr;
+    QString id = CUserId::toString(rawid);
 
-    return id;
+    QString address = Settings::getInstance().getFriendAddress(id);
+    return address.isEmpty() ? id : address;
 }
@@ -19,40 +19,61 @@
 
 #include <cstdint>
 #include <QObject>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QMutex>
+#include <QStringList>
 
 #include "corestructs.h"
 #include "coreav.h"
 #include "coredefines.h"
+#include "videoframe.h"
+#include "coreeventqueue.h"
+#include "coreprofiler.h"
+#include "netimpairment.h"
+#include "filecheckpoints.h"
 
 template <typename T> class QList;
 class Camera;
+class AudioThread;
+class SoundBank;
 class QTimer;
 class QString;
+struct FileCheckpoint;
 
+/// One tox profile, run on its own thread. A process can host several, each with its own profile
+/// directory. What they share is the camera, the OpenAL devices with the audio thread and sound bank,
+/// and the process-wide Settings.
 class Core : public QObject
 {
     Q_OBJECT
 public:
-    explicit Core(Camera* cam, QThread* coreThread);
-    static Core* getInstance(); ///< Returns the global widget's Core instance
+    /// The profile is read from and saved to profileDir, the settings dir if it's empty
+    explicit Core(Camera* cam, QThread* coreThread, const QString& profileDir = QString());
+    static Core* getInstance(); ///< Returns the first running Core, the one the window shows
+    static void registerMetaTypes(); ///< Before connecting to Core across threads
     ~Core();
 
     int getGroupNumberPeers(int groupId) const;
     QString getGroupPeerName(int groupId, int peerId) const;
-    QList<QString> getGroupPeerNames(int groupId) const;
+    GroupPeers getGroupPeers(int groupId) const; ///< Any thread, a snapshot as of the last tox_do, never null
     QString getFriendAddress(int friendNumber) const;
     int joinGroupchat(int32_t friendnumber, const uint8_t* friend_group_public_key) const;
     void quitGroupChat(int groupId) const;
     void dispatchVideoFrame(vpx_image img) const;
 
-    void saveConfiguration();
+    void saveConfiguration(); ///< Snapshots the profile now, ProfileSaver writes it
+    CoreEventQueue& getEventQueue();
     
     QString getUsername();
     QString getStatusMessage();
     ToxID getSelfId();
 
-    void increaseVideoBusyness();
-    void decreaseVideoBusyness();
+    QString getProfileDir() const;
+    void videoFrameDisplayed(int callId); ///< Call once a videoFrameReceived was handled, from any thread
+    QString getCallStatsReport(int callId); ///< The call's audio latency stats, empty if it's not active
+    static int getMicLevel(bool* voice = nullptr); ///< Of the microphone during calls, 0 to 100, from any thread. Voice is false while silence isn't sent
 
 public slots:
     void start();
@@ -77,12 +98,17 @@ public slots:
     void sendTyping(int friendId, bool typing);
 
     void sendFile(int32_t friendId, QString Filename, QString FilePath, long long filesize);
+    void sendFiles(int32_t friendId, QString batchName, QString baseDir, QStringList filePaths);
+    void cancelFileBatch(int friendId, int batchId);
     void cancelFileSend(int friendId, int fileNum);
     void cancelFileRecv(int friendId, int fileNum);
     void rejectFileRecvRequest(int friendId, int fileNum);
     void acceptFileRecvRequest(int friendId, int fileNum, QString path);
     void pauseResumeFileSend(int friendId, int fileNum);
     void pauseResumeFileRecv(int friendId, int fileNum);
+    void requestFileTransferStats(); ///< Replies with fileTransferStats
+    void requestLoopStats(); ///< Replies with loopStats
+    void resetLoopStats();
 
     void answerCall(int callId);
     void hangupCall(int callId);
@@ -90,25 +116,28 @@ public slots:
     void cancelCall(int callId, int friendId);
 
     void micMuteToggle(int callId);
+    void screenShareToggle(int callId); ///< Switches the call's video between the camera and the screen
+
+    void setWindowMinimized(bool minimized);
+    void setNetImpairment(const QString& spec); ///< See NetImpairment::Profile::parse, an empty spec is a good network again
 
 signals:
     void connected();
     void disconnected();
 
     void friendRequestReceived(const QString& userId, const QString& message);
-    void friendMessageReceived(int friendId, const QString& message);
 
     void friendAdded(int friendId, const QString& userId);
+    void friendListLoaded(const QList<FriendInfo>& friends); ///< Once, instead of a friendAdded per friend
 
-    void friendStatusChanged(int friendId, Status status);
-    void friendStatusMessageChanged(int friendId, const QString& message);
-    void friendUsernameChanged(int friendId, const QString& username);
+    void friendPresenceChanged(const QList<FriendPresence>& updates); ///< Status, name and status message changes, merged per friend
     void friendTypingChanged(int friendId, bool isTyping);
 
     void friendStatusMessageLoaded(int friendId, const QString& message);
     void friendUsernameLoaded(int friendId, const QString& username);
 
     void friendAddressGenerated(const QString& friendAddress);
+    void knownDhtNodesChanged(const QList<KnownDhtNode>& nodes);
 
     void friendRemoved(int friendId);
 
@@ -116,15 +145,16 @@ signals:
 
     void emptyGroupCreated(int groupnumber);
     void groupInviteReceived(int friendnumber, const uint8_t *group_public_key);
-    void groupMessageReceived(int groupnumber, int friendgroupnumber, const QString& message);
-    void groupNamelistChanged(int groupnumber, int peernumber, uint8_t change);
+    void groupMessagesReceived(int groupnumber, const QList<GroupMessage>& messages); ///< Everything a room got in one tox_do
+    void groupNamelistChanged(int groupnumber, int peernumber, uint8_t change, const QString& name); ///< Name empty on removal
 
     void usernameSet(const QString& username);
     void statusMessageSet(const QString& message);
     void statusSet(Status status);
 
-    void messageSentResult(int friendId, const QString& message, int messageId);
+    void messageSentResult(int friendId, const QString& message, int messageId); ///< Queued, messageId 0 if the friend doesn't exist
     void actionSentResult(int friendId, const QString& action, int success);
+    void messageDelivered(int friendId, int messageId); ///< Every piece of the message or action got its read receipt
 
     void failedToAddFriend(const QString& userId);
     void failedToRemoveFriend(int friendId);
@@ -145,8 +175,11 @@ signals:
     void fileUploadFinished(const QString& path);
     void fileDownloadFinished(const QString& path);
     void fileTransferPaused(int FriendId, int FileNum, ToxFile::FileDirection direction);
-    void fileTransferInfo(int FriendId, int FileNum, int64_t Filesize, int64_t BytesSent, ToxFile::FileDirection direction);
     void fileTransferRemotePausedUnpaused(ToxFile file, bool paused);
+    void fileBatchStarted(int FriendId, int BatchId, QString name, int fileCount, long long totalBytes);
+    void fileBatchFinished(int FriendId, int BatchId, int filesFailed);
+    void fileTransferStats(const QByteArray& json); ///< A JSON snapshot of every transfer's ToxFileStats
+    void loopStats(const QByteArray& json); ///< A JSON snapshot of the CoreProfiler
 
     void avInvite(int friendId, int callIndex, bool video);
     void avStart(int friendId, int callIndex, bool video);
@@ -159,7 +192,7 @@ signals:
     void avPeerTimeout(int friendId, int callIndex);
     void avMediaChange(int friendId, int callIndex, bool videoEnabled);
 
-    void videoFrameReceived(vpx_image* frame);
+    void videoFrameReceived(int friendId, int callId, const VideoFrame& frame); ///< Ack with videoFrameDisplayed
 
 private:
     static void onFriendRequest(Tox* tox, const uint8_t* cUserId, const uint8_t* cMessage, uint16_t cMessageSize, void* core);
@@ -170,6 +203,7 @@ private:
     static void onUserStatusChanged(Tox* tox, int friendId, uint8_t userstatus, void* core);
     static void onConnectionStatusChanged(Tox* tox, int friendId, uint8_t status, void* core);
     static void onAction(Tox* tox, int friendId, const uint8_t* cMessage, uint16_t cMessageSize, void* core);
+    static void onReadReceipt(Tox* tox, int32_t friendId, uint32_t receipt, void* core);
     static void onGroupInvite(Tox *tox, int friendnumber, const uint8_t *group_public_key, void *userdata);
     static void onGroupMessage(Tox *tox, int groupnumber, int friendgroupnumber, const uint8_t * message, uint16_t length, void *userdata);
     static void onGroupNamelistChange(Tox *tox, int groupnumber, int peernumber, uint8_t change, void *userdata);
@@ -191,47 +225,130 @@ private:
     static void onAvPeerTimeout(void* toxav, int32_t call_index, void* core);
     static void onAvMediaChange(void *toxav, int32_t call_index, void* core);
 
-    static void prepareCall(int friendId, int callId, ToxAv *toxav, bool videoEnabled);
-    static void cleanupCall(int callId);
+    void prepareCall(int friendId, int callId, bool videoEnabled);
+    void cleanupCall(int callId);
+    void prewarmCamera(); ///< Opens the camera while a video call rings, so the video starts as soon as it's answered
     static void playCallAudio(ToxAv *toxav, int32_t callId, int16_t *data, int samples, void *user_data); // Callback
-    static void sendCallAudio(int callId, ToxAv* toxav);
-    static void playAudioBuffer(int callId, int16_t *data, int samples, unsigned channels, int sampleRate);
     static void playCallVideo(ToxAv* toxav, int32_t callId, vpx_image_t* img, void *user_data);
-    void sendCallVideo(int callId);
+    void sendCallVideo(int callId); ///< Asks the call's VideoConverter for the next frame
+    void sendCallVideoFrame(int callId, const VideoFrame& frame, qint64 cost); ///< Encodes and sends what it made of it
+    void adaptCallAudio(int callId); ///< Applies what the call's AudioRateController makes of the last window
+    void receiveCallAudio(int callId, const int16_t* data, int samples, int channels, int sampleRate); ///< Past the impairment
+    void receiveCallVideo(int callId, const vpx_image& img); ///< Past the impairment, copied unless it's dropped
+    void deliverImpaired(); ///< What the impairment lets arrive by now
 
     void checkConnection();
     void onBootstrapTimer();
+    void onDhtServerListChanged(); ///< Bootstraps wide again from the new list
+    void openAudioDevices(); ///< The first Core opens them, the others share them
+    void closeAudioDevices(); ///< The last Core closes them
+    QList<KnownDhtNode> bootstrapCandidates() const; ///< The known nodes, then the configured ones
+    void rememberBootstrapNodes(); ///< Ranks the nodes of the round that got us connected
+
+    void scheduleProcess(); ///< Re-arms the tox timer from tox_do_interval
+    void wakeUp(); ///< Runs process() as soon as possible, call it when we queued local work
+    bool hasActiveWork() const;
+    void recordLoopLatency(qint64 period, qint64 lateness);
 
     void loadConfiguration();
     void loadFriends();
 
-    static void sendAllFileData(Core* core, ToxFile* file);
-    static void removeFileFromQueue(bool sendQueue, int friendId, int fileId);
-
+    long long sendFileChunks(ToxFile* file, int maxChunks, long long maxBytes, bool& windowFull);
+    void startFileSends(); ///< Runs the transfer scheduler as soon as possible
+    void resumeFileRecvs(); ///< Lets the senders we paused for the disk go on once it caught up
+    static quint64 fileTransferKey(int friendId, int fileNum, ToxFile::FileDirection direction);
+    ToxFile* findFile(int friendId, int fileNum, ToxFile::FileDirection direction);
+    ToxFile* offerFile(int friendId, const QByteArray& fileName, const QString& filePath, long long filesize, int batchId);
+    void advanceFileBatch(int batchId); ///< Offers the next files while we're under TOX_FILE_BATCH_IN_FLIGHT
+    void fileBatchFileDone(int batchId, bool success);
+    void reportFileBatchProgress(ToxFileBatch* batch, bool force=false);
+    bool resumeFileRecv(ToxFile* file, const FileCheckpoint& checkpoint, const QByteArray& request); ///< Accepts the file from the checkpoint, false if we can't
+    void acceptFileSend(ToxFile* file); ///< The friend accepted, starts sending
+    void saveFileCheckpoint(ToxFile* file, bool force=false); ///< At most every TOX_FILE_CHECKPOINT_INTERVAL unless forced
+    void breakFileTransfers(int friendId); ///< Drops the friend's transfers but keeps their checkpoints
+    void resumeFileSends(int friendId); ///< Offers the files again that we were sending when the friend left
+    QString getFriendKey(int friendId) const;
+    void addFileToQueue(ToxFile* file);
+    void removeFileFromQueue(bool sendQueue, int friendId, int fileId, bool keepCheckpoint=false);
+    void reportFileProgress(ToxFile* file, bool force=false); ///< Emits fileTransferInfo at most every TOX_FILE_PROGRESS_INTERVAL
+    void notifyFileFinished(const ToxFile& file); ///< In the ring behind the progress, and as fileTransferFinished
+    void notifyFileCancelled(int friendId, int fileNum, ToxFile::FileDirection direction); ///< Same for fileTransferCancelled
+    void notifyFileBatchFinished(int friendId, int batchId, int filesFailed); ///< Same for fileBatchFinished
+
+    int queueMessage(int friendId, const QString& message, bool isAction); ///< Returns our message id, 0 on failure
+    void sendQueuedMessages(); ///< Hands toxcore what it will take of every online friend's outbox
+    void requeueMessages(int friendId); ///< The friend left, what they didn't receipt goes again when they're back
+    static QList<QByteArray> splitMessage(const QByteArray& utf8);
     void checkLastOnline(int friendId);
+    FriendPresence& pendingPresenceFor(int friendId); ///< Starts the coalescing window with the first update
+    void refreshGroupPeers(); ///< Rebuilds the snapshots of the groups whose namelist changed, once per tox_do
+    void flushGroupMessages(); ///< One groupMessagesReceived per room that got messages during tox_do
+    void scheduleSave(); ///< Saves within TOX_SAVE_DELAY, every change until then goes in the same save
 
 private slots:
      void onFileTransferFinished(ToxFile file);
+     void fileHeartbeat(); ///< Shares the upload between the active transfers
+     void flushPresence(); ///< Sends the merged presence updates to the GUI
+     void onSaveTimer();
+     void onFileWriteClosed(quint64 key); ///< Finishes a reception once its write-behind closed the file
+     void onFileFingerprinted(quint64 key, QByteArray fingerprint); ///< Saves the checkpoint of a file we offered
+     void onFileSendChecked(quint64 friendId, FileCheckpoint checkpoint, bool unchanged); ///< Offers a broken send again
+     void onFileResumeChecked(quint64 key, qint64 offset); ///< Accepts a send, from the offset if the friend's part matches ours
+     void onFileResumeRequestMade(quint64 key, FileCheckpoint checkpoint, QByteArray request); ///< Resumes a reception, or asks the user
 
 private:
     Tox* tox;
     ToxAv* toxav;
-    QTimer *toxTimer, *fileTimer, *bootstrapTimer; //, *saveTimer;
+    QTimer *toxTimer, *fileTimer, *bootstrapTimer, *presenceTimer, *saveTimer;
+    QTimer *impairmentTimer; ///< Every TOXAV_IMPAIRMENT_TICK while the impairment is enabled
+    NetImpairment impairment; ///< Between toxav's callbacks and our calls, off unless the harness sets it
+    QHash<int, FriendPresence> pendingPresence; ///< By friend, until presenceTimer fires
+    CoreEventQueue events; ///< Friend messages and transfers' progress and ends, see EventDispatcher::drainCoreEvents
+    CoreProfiler profiler; ///< Times the callbacks, the loop and counts our signals
+    QHash<int, GroupPeers> groupPeers; ///< By group, under groupPeersMutex
+    QSet<int> dirtyGroupPeers;
+    QHash<int, QList<GroupMessage>> pendingGroupMessages; ///< By group, filled by the callbacks of one tox_do
+    mutable QMutex groupPeersMutex;
     Camera* camera;
     QList<DhtServer> dhtServerList;
     int dhtServerId;
-    static QList<ToxFile> fileSendQueue, fileRecvQueue;
-    static ToxCall calls[];
-
+    QList<KnownDhtNode> knownDhtNodes; ///< Fastest first, Settings gets a copy through knownDhtNodesChanged
+    QList<KnownDhtNode> bootstrapRound; ///< The nodes of our last bootstrap, credited if we connect before the next
+    int bootstrapAttempts; ///< Since we were last connected
+    int bootstrapIndex, bootstrapOffset;
+    qint64 bootstrapRoundTime;
+    bool windowMinimized;
+    bool isConnected; ///< To the DHT, as of the last checkConnection
+
+    QElapsedTimer loopClock;
+    qint64 nextDeadline, lastIteration, lastLatencyReport;
+    qint64 loopCount, loopPeriodSum, loopPeriodMax, loopLatenessSum;
+    long long uploadTokens; ///< Bytes we may still send under the upload limit, can go negative
+    qint64 uploadRefillTime;
+    quint32 fileRotation; ///< Which transfer goes first in the next round-robin, wraps around
+    bool fileSendsStalled; ///< Nothing could be sent, process retries after tox_do instead of the timer
+    QHash<int, ToxFileBatch*> fileBatches;
+    int nextBatchId;
+    QHash<int, FriendOutbox> outboxes; ///< By friend, dropped once empty
+    int nextMessageId;
+    QString profileDir;
+    FileCheckpoints checkpoints; ///< In the profile's dir, each profile resumes its own transfers
+    QHash<quint64, ToxFile*> fileTransfers; ///< Owns the transfers, the addresses stay valid until removeFileFromQueue
+    ToxCall calls[TOXAV_MAX_CALLS];
+    uint8_t* videobuf;
+    bool audioOpened; ///< We count in audioUsers
+
+    static Core* instance;
     static const QString CONFIG_FILE_NAME;
     static const int videobufsize;
-    static uint8_t* videobuf;
-    static int videoBusyness; // Used to know when to drop frames
 
+    static QMutex audioMutex; ///< Guards what the Cores share below
+    static int audioUsers;
+    static AudioThread* audioThread; ///< Shared by every call of every Core, created with the first one
     static ALCdevice* alOutDev, *alInDev;
     static ALCcontext* alContext;
 public:
-    static ALuint alMainSource;
+    static SoundBank* soundBank; ///< Null without an output device
 };
 
 #endif // CORE_HPP
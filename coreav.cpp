@@ -16,71 +16,101 @@
 
 #include "core.h"
 #include "widget/camera.h"
+#include "widget/screencapture.h"
+#include "settings.h"
+#include "audiothread.h"
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QTimer>
+#include <algorithm>
 
-ToxCall Core::calls[TOXAV_MAX_CALLS];
 const int Core::videobufsize{TOXAV_MAX_VIDEO_WIDTH * TOXAV_MAX_VIDEO_HEIGHT * 4};
-uint8_t* Core::videobuf;
-int Core::videoBusyness;
 
 ALCdevice* Core::alOutDev, *Core::alInDev;
 ALCcontext* Core::alContext;
-ALuint Core::alMainSource;
+SoundBank* Core::soundBank{nullptr};
+AudioThread* Core::audioThread{nullptr};
+int Core::audioUsers{0};
+QMutex Core::audioMutex;
 
-void Core::prepareCall(int friendId, int callId, ToxAv* toxav, bool videoEnabled)
+void Core::prepareCall(int friendId, int callId, bool videoEnabled)
 {
     qDebug() << QString("Core: preparing call %1").arg(callId);
     calls[callId].callId = callId;
     calls[callId].friendId = friendId;
-    calls[callId].muteMic = false;
+    calls[callId].toxav = toxav;
+    calls[callId].generation++;
+    calls[callId].muteMic.storeRelease(0);
+    calls[callId].videoFramesQueued.storeRelease(0);
+    calls[callId].videoFramesReceived.storeRelease(0);
+    calls[callId].videoFramesDropped.storeRelease(0);
+    calls[callId].probe.reset();
     // the following three lines are also now redundant from startCall, but are
     // necessary there for outbound and here for inbound
     calls[callId].codecSettings = av_DefaultSettings;
     calls[callId].codecSettings.max_video_width = TOXAV_MAX_VIDEO_WIDTH;
     calls[callId].codecSettings.max_video_height = TOXAV_MAX_VIDEO_HEIGHT;
     calls[callId].videoEnabled = videoEnabled;
+    calls[callId].videoSource = Camera::getInstance();
     toxav_prepare_transmission(toxav, callId, av_jbufdc, av_VADd, videoEnabled);
 
     // Audio
-    alGenSources(1, &calls[callId].alSource);
-    alcCaptureStart(alInDev);
+    if (toxav_get_peer_csettings(toxav, callId, 0, &calls[callId].peerSettings) != ErrorNone)
+    {
+        qWarning() << "Core::prepareCall: error getting peer settings, assuming the defaults";
+        calls[callId].peerSettings = av_DefaultSettings;
+    }
+    calls[callId].volume.storeRelease(256);
+    calls[callId].jitter.reset();
+    calls[callId].audioStats.reset();
+    calls[callId].audioRate.reset(calls[callId].codecSettings.audio_bitrate, calls[callId].codecSettings.audio_frame_duration);
+    calls[callId].audioRateTimer->start();
 
     // Go
     calls[callId].active = true;
-    calls[callId].sendAudioTimer->setInterval(5);
-    calls[callId].sendAudioTimer->setSingleShot(true);
-    connect(calls[callId].sendAudioTimer, &QTimer::timeout, [=](){sendCallAudio(callId,toxav);});
-    calls[callId].sendAudioTimer->start();
-    calls[callId].sendVideoTimer->setInterval(50);
+    {
+        QMutexLocker locker(&audioMutex);
+        if (!audioThread)
+            audioThread = new AudioThread(alInDev);
+        audioThread->addCall(&calls[callId]);
+    }
+    calls[callId].videoRate.reset();
+    calls[callId].sendVideoTimer->setInterval(calls[callId].videoRate.getInterval());
     calls[callId].sendVideoTimer->setSingleShot(true);
     if (calls[callId].videoEnabled)
     {
         calls[callId].sendVideoTimer->start();
-        Camera::getInstance()->suscribe();
+        calls[callId].videoSource->suscribe();
     }
 }
 
 void Core::onAvMediaChange(void* toxav, int32_t callId, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvMediaChange);
+    ToxCall& call = static_cast<Core*>(core)->calls[callId];
     ToxAvCSettings settings;
-    toxav_get_peer_csettings((ToxAv*)toxav, callId, 0, &settings);
+    if (toxav_get_peer_csettings((ToxAv*)toxav, callId, 0, &settings) != ErrorNone)
+        return;
+    call.peerSettings = settings;
     int friendId = toxav_get_peer_id((ToxAv*)toxav, callId, 0);
 
     qWarning() << "Core: Received media change from friend "<<friendId;
 
+    // The peer's audio adaptation changes its settings too, that doesn't start or stop our video
+    if ((settings.call_type == TypeVideo) == call.videoEnabled)
+        return;
     if (settings.call_type == TypeAudio)
     {
-        calls[callId].videoEnabled = false;
-        calls[callId].sendVideoTimer->stop();
-        Camera::getInstance()->unsuscribe();
+        call.videoEnabled = false;
+        call.sendVideoTimer->stop();
+        call.videoSource->unsuscribe();
         emit ((Core*)core)->avMediaChange(friendId, callId, false);
     }
     else
     {
-        Camera::getInstance()->suscribe();
-        calls[callId].videoEnabled = true;
-        calls[callId].sendVideoTimer->start();
+        call.videoSource->suscribe();
+        call.videoEnabled = true;
+        call.sendVideoTimer->start();
         emit ((Core*)core)->avMediaChange(friendId, callId, true);
     }
 }
@@ -115,6 +145,7 @@ void Core::answerCall(int callId)
     }
 
     delete transSettings;
+    wakeUp();
 }
 
 void Core::hangupCall(int callId)
@@ -122,6 +153,7 @@ void Core::hangupCall(int callId)
     qDebug() << QString("Core: hanging up call %1").arg(callId);
     calls[callId].active = false;
     toxav_hangup(toxav, callId);
+    wakeUp();
 }
 
 void Core::startCall(int friendId, bool video)
@@ -144,6 +176,7 @@ void Core::startCall(int friendId, bool video)
         toxav_call(toxav, &callId, friendId, &cSettings, TOXAV_RINGING_TIME);
         calls[callId].videoEnabled=false;
     }
+    wakeUp();
 }
 
 void Core::cancelCall(int callId, int friendId)
@@ -151,133 +184,254 @@ void Core::cancelCall(int callId, int friendId)
     qDebug() << QString("Core: Cancelling call with %1").arg(friendId);
     calls[callId].active = false;
     toxav_cancel(toxav, callId, friendId, 0);
+    wakeUp();
 }
 
 void Core::cleanupCall(int callId)
 {
     qDebug() << QString("Core: cleaning up call %1").arg(callId);
+    bool wasActive = calls[callId].active;
     calls[callId].active = false;
-    disconnect(calls[callId].sendAudioTimer,0,0,0);
-    calls[callId].sendAudioTimer->stop();
+    {
+        QMutexLocker locker(&audioMutex);
+        if (audioThread)
+            audioThread->removeCall(&calls[callId]);
+    }
+    if (wasActive)
+        calls[callId].audioStats.dump(callId, calls[callId].jitter);
     calls[callId].sendVideoTimer->stop();
+    calls[callId].audioRateTimer->stop();
     if (calls[callId].videoEnabled)
-        Camera::getInstance()->unsuscribe();
-    alcCaptureStop(alInDev);
+        calls[callId].videoSource->unsuscribe();
+    impairment.dropCall(callId);
 }
 
-void Core::playCallAudio(ToxAv* toxav, int32_t callId, int16_t *data, int samples, void *user_data)
+void Core::playCallAudio(ToxAv*, int32_t callId, int16_t *data, int samples, void *user_data)
 {
-    Q_UNUSED(user_data);
-
-    if (!calls[callId].active)
+    Core* core = static_cast<Core*>(user_data);
+    CoreProfiler::Scope scope(core->profiler, CoreProfiler::AvAudio);
+    ToxCall& call = core->calls[callId];
+    if (!call.active)
         return;
 
-    ToxAvCSettings dest;
-    if(toxav_get_peer_csettings(toxav, callId, 0, &dest) == 0)
-        playAudioBuffer(callId, data, samples, dest.audio_channels, dest.audio_sample_rate);
+    const ToxAvCSettings& peer = call.peerSettings;
+    if (core->impairment.isEnabled() && samples > 0 && peer.audio_sample_rate > 0)
+    {
+        // Held for later, toxav reuses data
+        NetImpairment::Packet packet{callId, QVector<int16_t>(samples * peer.audio_channels), samples,
+                                     peer.audio_channels, peer.audio_sample_rate, VideoFrame()};
+        std::copy(data, data + packet.audio.size(), packet.audio.begin());
+        int bytes = (long long)peer.audio_bitrate * samples / peer.audio_sample_rate / 8;
+        if (core->impairment.push(packet, bytes))
+            return;
+    }
+    core->receiveCallAudio(callId, data, samples, peer.audio_channels, peer.audio_sample_rate);
+}
+
+void Core::receiveCallAudio(int callId, const int16_t* data, int samples, int channels, int sampleRate)
+{
+    // The audio thread mixes it in when the jitter buffer lets it go
+    ToxCall& call = calls[callId];
+    call.audioStats.received();
+    call.jitter.push(data, samples, channels, sampleRate);
+}
+
+int Core::getMicLevel(bool* voice)
+{
+    return AudioThread::getMicLevel(voice);
+}
+
+QString Core::getCallStatsReport(int callId)
+{
+    if (callId < 0 || callId >= TOXAV_MAX_CALLS || !calls[callId].active)
+        return QString();
+    const ToxCall& call = calls[callId];
+    const ToxAvCSettings& settings = call.codecSettings;
+    QString report = call.audioStats.report(call.jitter)
+            + QString("\nsending %1kbps in %2ms frames").arg(settings.audio_bitrate / 1000).arg(settings.audio_frame_duration);
+    if (call.videoEnabled)
+        report += QString("\nvideo %1 frames received, %2 dropped while the last one was being shown")
+                .arg(call.videoFramesReceived.loadAcquire()).arg(call.videoFramesDropped.loadAcquire());
+    QString latency = call.probe.report();
+    if (!latency.isEmpty())
+        report += "\n" + latency;
+    if (impairment.isEnabled())
+        report += "\n" + impairment.report();
+    return report;
 }
 
-void Core::sendCallAudio(int callId, ToxAv* toxav)
+void Core::playCallVideo(ToxAv*, int32_t callId, vpx_image_t* img, void *user_data)
 {
-    if (!calls[callId].active)
+    Core* core = static_cast<Core*>(user_data);
+    CoreProfiler::Scope scope(core->profiler, CoreProfiler::AvVideo);
+    ToxCall& call = core->calls[callId];
+    if (!call.active || !call.videoEnabled)
         return;
 
-    if (calls[callId].muteMic)
+    call.videoFramesReceived.ref();
+    if (core->impairment.isEnabled())
     {
-        calls[callId].sendAudioTimer->start();
-        return;
+        // Held for later, so it's copied whether its view will take it or not
+        NetImpairment::Packet packet{callId, QVector<int16_t>(), 0, 0, 0, VideoFrame::copy(*img)};
+        int bytes = call.peerSettings.video_bitrate * 1000 / 8 / TOXAV_VIDEO_MAX_FPS; // kbps
+        if (!packet.video.isNull() && core->impairment.push(packet, bytes))
+        {
+            vpx_img_free(img);
+            return;
+        }
     }
+    core->receiveCallVideo(callId, *img);
+    vpx_img_free(img);
+}
 
-    int framesize = (calls[callId].codecSettings.audio_frame_duration * calls[callId].codecSettings.audio_sample_rate) / 1000;
-    uint8_t buf[framesize*2], dest[framesize*2];
-
-    bool frame = false;
-    ALint samples;
-    alcGetIntegerv(alInDev, ALC_CAPTURE_SAMPLES, sizeof(samples), &samples);
-    if(samples >= framesize)
+void Core::receiveCallVideo(int callId, const vpx_image& img)
+{
+    // One frame in flight per call, if its view didn't show the last one yet this one is dropped
+    ToxCall& call = calls[callId];
+    if (!call.videoFramesQueued.testAndSetOrdered(0, 1))
+    {
+        call.videoFramesDropped.ref();
+        qWarning() << "Core: playCallVideo: Busy, dropping current frame";
+    }
+    else
     {
-        alcCaptureSamples(alInDev, buf, framesize);
-        frame = 1;
+        emit videoFrameReceived(call.friendId, callId, VideoFrame::copy(img)); // The decoder reuses img
     }
+}
 
-    if(frame)
+void Core::deliverImpaired()
+{
+    for (const NetImpairment::Packet& packet : impairment.takeDue())
     {
-        int r;
-        if((r = toxav_prepare_audio_frame(toxav, callId, dest, framesize*2, (int16_t*)buf, framesize)) < 0)
+        const ToxCall& call = calls[packet.callId];
+        if (!call.active)
+            continue;
+        if (!packet.video.isNull())
         {
-            qDebug() << "Core: toxav_prepare_audio_frame error";
-            calls[callId].sendAudioTimer->start();
-            return;
+            if (call.videoEnabled)
+                receiveCallVideo(packet.callId, *packet.video.image());
+        }
+        else
+        {
+            receiveCallAudio(packet.callId, packet.audio.constData(), packet.samples, packet.channels, packet.sampleRate);
         }
-
-        if((r = toxav_send_audio(toxav, callId, dest, r)) < 0)
-            qDebug() << "Core: toxav_send_audio error";
     }
-    calls[callId].sendAudioTimer->start();
 }
 
-void Core::playCallVideo(ToxAv*, int32_t callId, vpx_image_t* img, void *user_data)
+void Core::setNetImpairment(const QString& spec)
 {
-    Q_UNUSED(user_data);
+    bool ok;
+    NetImpairment::Profile profile = NetImpairment::Profile::parse(spec, &ok);
+    if (!ok)
+        qWarning() << "Core::setNetImpairment: Bad impairment" << spec << ", the network is left unimpaired";
+    impairment.setProfile(profile);
+    if (impairment.isEnabled())
+    {
+        qDebug() << "Core: Impairing the network with" << profile.toString();
+        impairmentTimer->start();
+    }
+    else
+    {
+        impairmentTimer->stop();
+    }
+}
 
+void Core::sendCallVideo(int callId)
+{
     if (!calls[callId].active || !calls[callId].videoEnabled)
         return;
 
-    if (videoBusyness >= 1)
-        qWarning() << "Core: playCallVideo: Busy, dropping current frame";
-    else
-        emit Core::getInstance()->videoFrameReceived(img);
-    vpx_img_free(img);
+    // Still converting the last one, its frame restarts the timer
+    if (calls[callId].videoConverter->isBusy())
+        return;
+    calls[callId].videoJobGeneration = calls[callId].generation;
+    calls[callId].videoConverter->fromSource(calls[callId].videoSource, calls[callId].videoRate.getMaxSize());
 }
 
-void Core::sendCallVideo(int callId)
+void Core::sendCallVideoFrame(int callId, const VideoFrame& frame, qint64 cost)
 {
+    // The call ended or stopped sending video while the frame was converted
     if (!calls[callId].active || !calls[callId].videoEnabled)
         return;
+    // It was for the call that had the slot before, this one's first frame was held back by it
+    if (calls[callId].videoJobGeneration != calls[callId].generation)
+    {
+        sendCallVideo(callId);
+        return;
+    }
 
-    vpx_image frame = camera->getLastVPXImage();
-    if (frame.w && frame.h)
+    VideoRateController& rate = calls[callId].videoRate;
+    QElapsedTimer encodeCost;
+    encodeCost.start();
+    if (!frame.isNull())
     {
         int result;
-        if((result = toxav_prepare_video_frame(toxav, callId, videobuf, videobufsize, &frame)) < 0)
-        {
+        if((result = toxav_prepare_video_frame(toxav, callId, videobuf, videobufsize, frame.image())) < 0)
             qDebug() << QString("Core: toxav_prepare_video_frame: error %1").arg(result);
-            vpx_img_free(&frame);
-            calls[callId].sendVideoTimer->start();
-            return;
-        }
-
-        if((result = toxav_send_video(toxav, callId, (uint8_t*)videobuf, result)) < 0)
+        else if((result = toxav_send_video(toxav, callId, (uint8_t*)videobuf, result)) < 0)
             qDebug() << QString("Core: toxav_send_video error: %1").arg(result);
-
-        vpx_img_free(&frame);
+        cost += encodeCost.elapsed();
+        rate.frameSent(cost, result < 0);
     }
     else
     {
         qDebug("Core::sendCallVideo: Invalid frame (bad camera ?)");
     }
 
-    calls[callId].sendVideoTimer->start();
+    // The interval is from frame to frame, whatever this one took
+    calls[callId].sendVideoTimer->start(std::max<qint64>(rate.getInterval() - cost, 1));
 }
 
-
-void Core::increaseVideoBusyness()
+void Core::adaptCallAudio(int callId)
 {
-    videoBusyness++;
+    ToxCall& call = calls[callId];
+    if (!call.active)
+        return;
+    // The peer adapts its frames too, the loss is counted in its frames
+    ToxAvCSettings peerSettings;
+    if (toxav_get_peer_csettings(toxav, callId, 0, &peerSettings) == ErrorNone)
+        call.peerSettings = peerSettings;
+    if (!call.audioRate.evaluate(call.jitter, call.audioStats, call.peerSettings.audio_frame_duration))
+        return;
+
+    call.codecSettings.audio_bitrate = call.audioRate.getBitrate();
+    call.codecSettings.audio_frame_duration = call.audioRate.getFrameDuration();
+    // The peer's decoder takes any frame duration, it only has to know about the bitrate
+    if (toxav_change_settings(toxav, callId, &call.codecSettings) != ErrorNone)
+        qWarning() << "Core::adaptCallAudio: toxav_change_settings failed for call" << callId;
+    QMutexLocker locker(&audioMutex);
+    if (audioThread)
+        audioThread->updateCall(&call);
 }
 
-void Core::decreaseVideoBusyness()
+void Core::videoFrameDisplayed(int callId)
 {
-  videoBusyness--;
+    calls[callId].videoFramesQueued.storeRelease(0);
 }
 
 void Core::micMuteToggle(int callId)
 {
-    calls[callId].muteMic = !calls[callId].muteMic;
+    calls[callId].muteMic.storeRelease(!calls[callId].muteMic.loadAcquire());
+}
+
+void Core::screenShareToggle(int callId)
+{
+    VideoSource* camera = Camera::getInstance();
+    VideoSource* next = calls[callId].videoSource == camera ? (VideoSource*)ScreenCapture::getInstance() : camera;
+    if (calls[callId].active && calls[callId].videoEnabled)
+    {
+        next->suscribe();
+        calls[callId].videoSource->unsuscribe();
+    }
+    calls[callId].videoSource = next;
+    // The screen has nothing in common with the camera's sizes, start from the top again
+    calls[callId].videoRate.reset();
 }
 
 void Core::onAvCancel(void* _toxav, int32_t callId, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvCancel);
+    ToxCall& call = static_cast<Core*>(core)->calls[callId];
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, callId, 0);
@@ -288,18 +442,20 @@ void Core::onAvCancel(void* _toxav, int32_t callId, void* core)
     }
     qDebug() << QString("Core: AV cancel from %1").arg(friendId);
 
-    calls[callId].active = false;
+    call.active = false;
 
     emit static_cast<Core*>(core)->avCancel(friendId, callId);
 }
 
-void Core::onAvReject(void*, int32_t, void*)
+void Core::onAvReject(void*, int32_t, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvReject);
     qDebug() << "Core: AV reject";
 }
 
 void Core::onAvEnd(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvEnd);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -310,13 +466,23 @@ void Core::onAvEnd(void* _toxav, int32_t call_index, void* core)
     }
     qDebug() << QString("Core: AV end from %1").arg(friendId);
 
-    cleanupCall(call_index);
+    static_cast<Core*>(core)->cleanupCall(call_index);
 
     emit static_cast<Core*>(core)->avEnd(friendId, call_index);
 }
 
+void Core::prewarmCamera()
+{
+    // The call is either answered within the ringing time or not at all, after that
+    // the usual release delay applies. Nothing here waits for the device to open
+    if (camera)
+        camera->prewarm((TOXAV_RINGING_TIME + Settings::getInstance().getCamReleaseDelay()) * 1000);
+}
+
 void Core::onAvRinging(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvRinging);
+    ToxCall& call = static_cast<Core*>(core)->calls[call_index];
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -326,9 +492,10 @@ void Core::onAvRinging(void* _toxav, int32_t call_index, void* core)
         return;
     }
 
-    if (calls[call_index].videoEnabled)
+    if (call.videoEnabled)
     {
         qDebug() << QString("Core: AV ringing with %1 with video").arg(friendId);
+        static_cast<Core*>(core)->prewarmCamera();
         emit static_cast<Core*>(core)->avRinging(friendId, call_index, true);
     }
     else
@@ -340,6 +507,7 @@ void Core::onAvRinging(void* _toxav, int32_t call_index, void* core)
 
 void Core::onAvStarting(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvStarting);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -361,13 +529,13 @@ void Core::onAvStarting(void* _toxav, int32_t call_index, void* core)
     if (transSettings->call_type == TypeVideo)
     {
         qDebug() << QString("Core: AV starting from %1 with video").arg(friendId);
-        prepareCall(friendId, call_index, toxav, true);
+        static_cast<Core*>(core)->prepareCall(friendId, call_index, true);
         emit static_cast<Core*>(core)->avStarting(friendId, call_index, true);
     }
     else
     {
         qDebug() << QString("Core: AV starting from %1 without video").arg(friendId);
-        prepareCall(friendId, call_index, toxav, false);
+        static_cast<Core*>(core)->prepareCall(friendId, call_index, false);
         emit static_cast<Core*>(core)->avStarting(friendId, call_index, false);
     }
 
@@ -376,6 +544,7 @@ void Core::onAvStarting(void* _toxav, int32_t call_index, void* core)
 
 void Core::onAvEnding(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvEnding);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -386,13 +555,14 @@ void Core::onAvEnding(void* _toxav, int32_t call_index, void* core)
     }
     qDebug() << QString("Core: AV ending from %1").arg(friendId);
 
-    cleanupCall(call_index);
+    static_cast<Core*>(core)->cleanupCall(call_index);
 
     emit static_cast<Core*>(core)->avEnding(friendId, call_index);
 }
 
 void Core::onAvRequestTimeout(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvRequestTimeout);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -403,13 +573,14 @@ void Core::onAvRequestTimeout(void* _toxav, int32_t call_index, void* core)
     }
     qDebug() << QString("Core: AV request timeout with %1").arg(friendId);
 
-    cleanupCall(call_index);
+    static_cast<Core*>(core)->cleanupCall(call_index);
 
     emit static_cast<Core*>(core)->avRequestTimeout(friendId, call_index);
 }
 
 void Core::onAvPeerTimeout(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvPeerTimeout);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -420,7 +591,7 @@ void Core::onAvPeerTimeout(void* _toxav, int32_t call_index, void* core)
     }
     qDebug() << QString("Core: AV peer timeout with %1").arg(friendId);
 
-    cleanupCall(call_index);
+    static_cast<Core*>(core)->cleanupCall(call_index);
 
     emit static_cast<Core*>(core)->avPeerTimeout(friendId, call_index);
 }
@@ -428,6 +599,7 @@ void Core::onAvPeerTimeout(void* _toxav, int32_t call_index, void* core)
 
 void Core::onAvInvite(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvInvite);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -449,6 +621,7 @@ void Core::onAvInvite(void* _toxav, int32_t call_index, void* core)
     if (transSettings->call_type == TypeVideo)
     {
         qDebug() << QString("Core: AV invite from %1 with video").arg(friendId);
+        static_cast<Core*>(core)->prewarmCamera();
         emit static_cast<Core*>(core)->avInvite(friendId, call_index, true);
     }
     else
@@ -462,6 +635,7 @@ void Core::onAvInvite(void* _toxav, int32_t call_index, void* core)
 
 void Core::onAvStart(void* _toxav, int32_t call_index, void* core)
 {
+    CoreProfiler::Scope scope(static_cast<Core*>(core)->profiler, CoreProfiler::AvStart);
     ToxAv* toxav = static_cast<ToxAv*>(_toxav);
 
     int friendId = toxav_get_peer_id(toxav, call_index, 0);
@@ -483,60 +657,15 @@ void Core::onAvStart(void* _toxav, int32_t call_index, void* core)
     if (transSettings->call_type == TypeVideo)
     {
         qDebug() << QString("Core: AV start from %1 with video").arg(friendId);
-        prepareCall(friendId, call_index, toxav, true);
+        static_cast<Core*>(core)->prepareCall(friendId, call_index, true);
         emit static_cast<Core*>(core)->avStart(friendId, call_index, true);
     }
     else
     {
         qDebug() << QString("Core: AV start from %1 without video").arg(friendId);
-        prepareCall(friendId, call_index, toxav, false);
+        static_cast<Core*>(core)->prepareCall(friendId, call_index, false);
         emit static_cast<Core*>(core)->avStart(friendId, call_index, false);
     }
 
     delete transSettings;
 }
-
-// This function's logic was shamelessly stolen from uTox
-void Core::playAudioBuffer(int callId, int16_t *data, int samples, unsigned channels, int sampleRate)
-{
-    if(!channels || channels > 2)
-    {
-        qWarning() << "Core::playAudioBuffer: trying to play on "<<channels<<" channels! Giving up.";
-        return;
-    }
-
-    ALuint bufid;
-    ALint processed, queued;
-    alGetSourcei(calls[callId].alSource, AL_BUFFERS_PROCESSED, &processed);
-    alGetSourcei(calls[callId].alSource, AL_BUFFERS_QUEUED, &queued);
-    alSourcei(calls[callId].alSource, AL_LOOPING, AL_FALSE);
-
-    if(processed)
-    {
-        ALuint bufids[processed];
-        alSourceUnqueueBuffers(calls[callId].alSource, processed, bufids);
-        alDeleteBuffers(processed - 1, bufids + 1);
-        bufid = bufids[0];
-    }
-    else if(queued < 16)
-    {
-        alGenBuffers(1, &bufid);
-    }
-    else
-    {
-        qDebug() << "Core: Dropped audio frame";
-        return;
-    }
-
-    alBufferData(bufid, (channels == 1) ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16, data,
-                    samples * 2 * channels, sampleRate);
-    alSourceQueueBuffers(calls[callId].alSource, 1, &bufid);
-
-    ALint state;
-    alGetSourcei(calls[callId].alSource, AL_SOURCE_STATE, &state);
-    if(state != AL_PLAYING)
-    {
-        alSourcePlay(calls[callId].alSource);
-        qDebug() << "Core: Starting audio source of call " << callId;
-    }
-}
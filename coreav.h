@@ -2,6 +2,13 @@
 #define COREAV_H
 
 #include <tox/toxav.h>
+#include <QAtomicInt>
+#include "videoratecontroller.h"
+#include "audioratecontroller.h"
+#include "jitterbuffer.h"
+#include "audiostats.h"
+#include "latencyprobe.h"
+#include "coredefines.h"
 
 #if defined(__APPLE__) && defined(__MACH__)
  #include <OpenAL/al.h>
@@ -12,18 +19,33 @@
 #endif
 
 class QTimer;
+class VideoConverter;
 
 struct ToxCall
 {
 public:
     ToxAvCSettings codecSettings;
-    QTimer *sendAudioTimer, *sendVideoTimer;
+    QTimer *sendVideoTimer;
+    QTimer *audioRateTimer; ///< Every TOXAV_AUDIO_RATE_WINDOW while the call is active
+    VideoConverter* videoConverter; ///< Scales the outgoing frames off the Core thread
     int callId;
     int friendId;
+    ToxAv* toxav; ///< Of the Core the call belongs to, the audio thread sends with it
     bool videoEnabled;
     bool active;
-    bool muteMic;
-    ALuint alSource;
+    quint32 generation; ///< Bumped for each call that takes the slot
+    quint32 videoJobGeneration; ///< Of the call the frame being converted was for
+    QAtomicInt muteMic; ///< Read by the audio thread
+    ToxAvCSettings peerSettings; ///< Updated on media changes, so we don't ask toxav for every packet
+    QAtomicInt volume; ///< In 1/256, read by the audio mixer
+    JitterBuffer jitter; ///< Between toxav's audio callback and the audio thread
+    AudioStats audioStats;
+    VideoRateController videoRate;
+    AudioRateController audioRate; ///< Drives codecSettings' audio bitrate and frame duration
+    VideoSource* videoSource; ///< The camera, or the screen while we share it
+    QAtomicInt videoFramesQueued; ///< To the GUI and not shown yet, at most 1
+    QAtomicInt videoFramesReceived, videoFramesDropped; ///< Dropped because the GUI hadn't shown the last one yet
+    LatencyProbe probe; ///< Hears the clicks of a LatencyProbe sender, read by the audio thread
 };
 
 #endif // COREAV_H
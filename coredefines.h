@@ -3,13 +3,76 @@
 
 #define TOXAV_MAX_CALLS 16
 #define GROUPCHAT_MAX_SIZE 32
+#define GROUPCHAT_PEER_KEY_SIZE 32
 #define TOX_SAVE_INTERVAL 30*1000
+#define TOX_SAVE_DELAY 2*1000
+#define SETTINGS_SAVE_DELAY 2*1000
 #define TOX_FILE_INTERVAL 0
+#define TOX_FILE_READAHEAD_CHUNKS 32
+#define TOX_FILE_MAP_THRESHOLD 16*1024*1024
+#define TOX_FILE_HASH_STEP 1024*1024
+#define TOX_FILE_PAGE_SIZE 4096 // Mapped files are faulted in a byte per page ahead of the sender
+#define TOX_FILE_WRITE_BLOCK 256*1024
+#define TOX_FILE_WRITE_QUEUE_BLOCKS 16
+#define TOX_FILE_PROGRESS_INTERVAL 100
+#define TOX_FILE_QUANTUM 8
+#define TOX_FILE_CALL_QUANTUM 2
+#define TOX_FILE_CALL_INTERVAL 10
+#define TOX_FILE_UPLOAD_BURST 4
+#define TOX_FILE_CHECKPOINT_INTERVAL 5*1000
+#define TOX_FILE_CHECKPOINT_BLOCK 64*1024
+#define TOX_FILE_BATCH_IN_FLIGHT 8
 #define TOX_BOOTSTRAP_INTERVAL 5*1000
+#define TOX_BOOTSTRAP_PARALLEL 8
+#define TOX_BOOTSTRAP_RETRY_NODES 2
+#define TOX_BOOTSTRAP_CACHE_SIZE 16
+#define TOX_BOOTSTRAP_CACHE_MAX_AGE 7 // Days
+#define TOX_MESSAGE_IN_FLIGHT 32 // Unreceipted pieces per friend
+#define TOX_MESSAGE_QUANTUM 8 // Pieces per friend per tox_do
+#define TOX_IDLE_INTERVAL 250
+#define TOX_LATENCY_REPORT_INTERVAL 60*1000
+#define TOX_CALL_STATS_INTERVAL 1000
+#define TOX_SOUND_COALESCE_INTERVAL 1000
+#define TOX_PRESENCE_COALESCE_INTERVAL 100
+#define CORE_EVENT_QUEUE_SIZE 1024
+#define CORE_EVENT_DRAIN_INTERVAL 16
 #define TOXAV_RINGING_TIME 15
+#define TOXAV_AUDIO_BUFFERS 16
+#define TOXAV_AUDIO_PLAYOUT_FRAMES 2
+#define TOXAV_MIXER_SAMPLE_RATE 48000
+#define TOXAV_JITTER_MIN_DELAY 40
+#define TOXAV_JITTER_MAX_DELAY 400
+#define TOXAV_JITTER_MAX_FRAMES 64
+#define TOXAV_JITTER_CONCEAL_FRAMES 3
+#define TOXAV_JITTER_MAX_GAP 200 // ms, a longer gap between frames is unsent silence. Below TOXAV_VAD_COMFORT_INTERVAL
+#define TOXAV_AUDIO_RATE_WINDOW 5*1000
+#define TOXAV_AUDIO_RATE_RECOVERY 4
+#define TOXAV_AUDIO_RATE_MAX_LOSS 5 // Percent of the frames lost or failing to send
+#define TOXAV_AUDIO_RATE_MAX_JITTER 60
+#define TOXAV_AUDIO_RATE_MAX_BITRATE 128000 // What a clean link climbs to, above the call's defaults
+#define TOXAV_VAD_MIN_ENERGY 64 // Mean square of the halved samples, about -60dBFS
+#define TOXAV_VAD_THRESHOLD 4 // Times the noise floor's energy
+#define TOXAV_VAD_FRICATIVE_RATE 0.3 // Zero crossings per sample
+#define TOXAV_VAD_HANGOVER 300
+#define TOXAV_VAD_COMFORT_INTERVAL 400
+#define TOXAV_IMPAIRMENT_TICK 5
+#define TOXAV_IMPAIRMENT_MAX_QUEUE 1000 // ms a frame may wait for a capped link
+#define TOXAV_IMPAIRMENT_REORDER_DELAY 20 // ms past the jitter, for a frame to be overtaken
+#define TOXAV_PROBE_INTERVAL 2000 // Also the longest latency the probe can measure
+#define TOXAV_PROBE_CLICK 20
+#define TOXAV_PROBE_AMPLITUDE 16000
+#define TOX_MIC_LEVEL_INTERVAL 50
 
 // TODO: Put that in the settings
 #define TOXAV_MAX_VIDEO_WIDTH 1600
 #define TOXAV_MAX_VIDEO_HEIGHT 1200
+#define TOXAV_VIDEO_FRAME_POOL 8
+#define TOXAV_VIDEO_MAX_FPS 20
+#define TOXAV_VIDEO_MIN_FPS 10
+#define TOXAV_VIDEO_RATE_WINDOW 2*1000
+#define TOXAV_VIDEO_RATE_RECOVERY 3
+#define TOXAV_SCREEN_CAPTURE_INTERVAL 100
+#define TOXAV_SCREEN_CAPTURE_TILE 64
+#define CAMERA_RELEASE_DELAY 10
 
 #endif // COREDEFINES_H
@@ -0,0 +1,79 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "coreeventqueue.h"
+#include <QObject>
+#include <QMetaObject>
+
+CoreEventQueue::CoreEventQueue()
+    : head{0}, tail{0}, wakePending{0}, receiver{nullptr}, slot{nullptr}
+{
+}
+
+void CoreEventQueue::setReceiver(QObject* Receiver, const char* Slot)
+{
+    receiver = Receiver;
+    slot = Slot;
+}
+
+void CoreEventQueue::push(CoreEvent&& event)
+{
+    // Nothing jumps ahead of what's already waiting
+    if (!overflow.isEmpty())
+        flushOverflow();
+    if (!overflow.isEmpty() || !tryPush(event))
+        overflow.append(std::move(event));
+    wake();
+}
+
+void CoreEventQueue::flushOverflow()
+{
+    while (!overflow.isEmpty() && tryPush(overflow.first()))
+        overflow.removeFirst();
+    wake();
+}
+
+int CoreEventQueue::depth() const
+{
+    int queued = tail.loadAcquire() - head.loadAcquire();
+    if (queued < 0)
+        queued += CAPACITY;
+    return queued + overflow.size();
+}
+
+bool CoreEventQueue::hasOverflow() const
+{
+    return !overflow.isEmpty();
+}
+
+bool CoreEventQueue::tryPush(CoreEvent& event)
+{
+    int t = tail.loadAcquire();
+    int next = (t + 1) % CAPACITY;
+    if (next == head.loadAcquire())
+        return false;
+    ring[t] = std::move(event);
+    tail.storeRelease(next);
+    return true;
+}
+
+void CoreEventQueue::wake()
+{
+    if (!receiver || head.loadAcquire() == tail.loadAcquire())
+        return;
+    if (wakePending.testAndSetOrdered(0, 1))
+        QMetaObject::invokeMethod(receiver, slot, Qt::QueuedConnection);
+}
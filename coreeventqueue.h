@@ -0,0 +1,99 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef COREEVENTQUEUE_H
+#define COREEVENTQUEUE_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+#include "corestructs.h"
+#include "coredefines.h"
+
+class QObject;
+
+/// One of Core's high rate events, stored by value in the ring
+struct CoreEvent
+{
+    enum Type : quint8
+    {
+        FriendMessage,
+        FileTransferInfo,
+        FileBatchInfo,
+        FileTransferFinished,
+        FileTransferCancelled,
+        FileBatchFinished
+    };
+
+    Type type;
+    ToxFile::FileDirection direction; ///< FileTransferInfo and FileTransferCancelled
+    int friendId;
+    int id; ///< The file number or the batch id
+    qint64 total, done; ///< Filesize and bytes sent, or files done and bytes sent for a batch, or files failed
+    QString text; ///< The message, moved in and out of the ring without copying the characters
+    ToxFile file; ///< FileTransferFinished, behind the file's last progress in the ring
+};
+
+/// Carries Core's high rate events to the GUI thread without a queued signal each.
+/// A single producer, single consumer ring: Core pushes without locking or allocating,
+/// the receiver is woken with one queued call per batch and drains it all at once.
+/// Events that don't fit while the GUI is behind wait on Core's side, in order.
+class CoreEventQueue
+{
+public:
+    CoreEventQueue();
+    void setReceiver(QObject* receiver, const char* slot); ///< Before Core's thread starts, slot is called when there's something to drain
+
+    void push(CoreEvent&& event); ///< Core thread only
+    void flushOverflow(); ///< Core thread only, retries what didn't fit
+    bool hasOverflow() const;
+    int depth() const; ///< Core thread only, what the receiver hasn't drained yet, with the overflow
+
+    template <typename Handler>
+    void drain(Handler handler); ///< Receiver's thread only, handler gets each CoreEvent&&. Later pushes wake us again
+
+private:
+    bool tryPush(CoreEvent& event);
+    void wake();
+
+private:
+    static const int CAPACITY = CORE_EVENT_QUEUE_SIZE;
+    CoreEvent ring[CAPACITY];
+    QAtomicInt head; ///< Next slot to read, written by the consumer
+    QAtomicInt tail; ///< Next slot to write, written by the producer
+    QAtomicInt wakePending; ///< Set by the producer when it wakes the consumer, cleared by the consumer before draining
+    QList<CoreEvent> overflow; ///< Producer only
+    QObject* receiver;
+    const char* slot;
+};
+
+template <typename Handler>
+void CoreEventQueue::drain(Handler handler)
+{
+    // Full barrier, the tail must not be read before the producer can see the wake is needed again
+    wakePending.fetchAndStoreOrdered(0);
+    int h = head.loadAcquire();
+    int t = tail.loadAcquire();
+    while (h != t)
+    {
+        CoreEvent event = std::move(ring[h]);
+        h = (h + 1) % CAPACITY;
+        head.storeRelease(h);
+        handler(std::move(event));
+    }
+}
+
+#endif // COREEVENTQUEUE_H
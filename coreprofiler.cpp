@@ -0,0 +1,161 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "coreprofiler.h"
+#include <QJsonArray>
+#include <QMetaMethod>
+#include <QStringList>
+#include <algorithm>
+#include <limits>
+
+namespace
+{
+const char* probeNames[CoreProfiler::ProbeCount] = {
+    "tox_do", "loop period", "timer lateness", "event queue depth", "file heartbeat", "save snapshot",
+    "friend request", "friend message", "friend action", "name change", "typing change", "status message", "user status",
+    "connection status", "read receipt", "group invite", "group message", "group namelist",
+    "file send request", "file control", "file data",
+    "av invite", "av start", "av cancel", "av reject", "av end", "av ringing", "av starting", "av ending",
+    "av media change", "av request timeout", "av peer timeout", "av audio", "av video",
+};
+}
+
+CoreProfiler::CoreProfiler(QObject* core)
+    : meta{core->metaObject()}, signalCount{0}
+{
+    int first = meta->methodOffset(), last = meta->methodCount();
+    signalEmits.reset(new QAtomicInt[last - first]);
+    signalMethods.reset(new int[last - first]);
+
+    // Like QSignalSpy, each signal is connected to a method index past QObject's that only qt_metacall knows
+    int slotBase = QObject::staticMetaObject.methodCount();
+    for (int i = first; i < last; i++)
+    {
+        if (meta->method(i).methodType() != QMetaMethod::Signal)
+            continue;
+        signalMethods[signalCount] = i;
+        QMetaObject::connect(core, i, this, slotBase + signalCount, Qt::DirectConnection, nullptr);
+        signalCount++;
+    }
+}
+
+int CoreProfiler::qt_metacall(QMetaObject::Call call, int id, void** args)
+{
+    id = QObject::qt_metacall(call, id, args);
+    if (id < 0)
+        return id;
+    if (call == QMetaObject::InvokeMetaMethod && id < signalCount)
+        signalEmits[id].fetchAndAddRelaxed(1);
+    return -1;
+}
+
+void CoreProfiler::record(Probe probe, qint64 value)
+{
+    int bucket = 0;
+    while (bucket < CORE_PROFILER_BUCKETS-1 && value >= (qint64(1) << bucket))
+        bucket++;
+
+    Histogram& histogram = histograms[probe];
+    histogram.buckets[bucket].fetchAndAddRelaxed(1);
+    histogram.count.fetchAndAddRelaxed(1);
+    int clamped = int(std::min<qint64>(value, std::numeric_limits<int>::max()));
+    int max = histogram.max.loadAcquire();
+    while (clamped > max && !histogram.max.testAndSetRelaxed(max, clamped))
+        max = histogram.max.loadAcquire();
+}
+
+void CoreProfiler::reset()
+{
+    for (Histogram& histogram : histograms)
+    {
+        for (QAtomicInt& bucket : histogram.buckets)
+            bucket.storeRelease(0);
+        histogram.count.storeRelease(0);
+        histogram.max.storeRelease(0);
+    }
+    for (int i=0; i<signalCount; i++)
+        signalEmits[i].storeRelease(0);
+}
+
+qint64 CoreProfiler::percentile(const int* buckets, int count, double fraction)
+{
+    int target = std::max(1, int(count * fraction + 0.5)), seen = 0;
+    for (int i=0; i<CORE_PROFILER_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= target)
+            return i ? qint64(1) << i : 0;
+    }
+    return qint64(1) << CORE_PROFILER_BUCKETS;
+}
+
+QJsonObject CoreProfiler::snapshot() const
+{
+    QJsonArray probes;
+    for (int probe=0; probe<ProbeCount; probe++)
+    {
+        const Histogram& histogram = histograms[probe];
+        int count = histogram.count.loadAcquire();
+        if (!count)
+            continue;
+
+        int buckets[CORE_PROFILER_BUCKETS];
+        QJsonArray bucketArray;
+        for (int i=0; i<CORE_PROFILER_BUCKETS; i++)
+            bucketArray << (buckets[i] = histogram.buckets[i].loadAcquire());
+
+        QJsonObject entry;
+        entry["name"] = probeNames[probe];
+        entry["unit"] = probe == EventQueueDepth ? "events" : "us";
+        entry["count"] = count;
+        entry["p50"] = (double)percentile(buckets, count, 0.5);
+        entry["p99"] = (double)percentile(buckets, count, 0.99);
+        entry["max"] = histogram.max.loadAcquire();
+        entry["buckets"] = bucketArray;
+        probes << entry;
+    }
+
+    QJsonObject signalObject;
+    for (int i=0; i<signalCount; i++)
+        if (int emits = signalEmits[i].loadAcquire())
+            signalObject[QString::fromLatin1(meta->method(signalMethods[i]).name())] = emits;
+
+    QJsonObject result;
+    result["probes"] = probes;
+    result["signals"] = signalObject;
+    return result;
+}
+
+QString CoreProfiler::report() const
+{
+    QJsonObject stats = snapshot();
+    QStringList lines;
+    for (const QJsonValue& value : stats["probes"].toArray())
+    {
+        QJsonObject probe = value.toObject();
+        lines << QString("Core: %1: %2 samples, p50 <%3 p99 <%4 max %5 %6").arg(probe["name"].toString())
+                 .arg(probe["count"].toInt()).arg(probe["p50"].toDouble()).arg(probe["p99"].toDouble())
+                 .arg(probe["max"].toInt()).arg(probe["unit"].toString());
+    }
+
+    QJsonObject signalObject = stats["signals"].toObject();
+    QStringList emits;
+    for (auto it = signalObject.begin(); it != signalObject.end(); ++it)
+        emits << QString("%1 %2").arg(it.key()).arg(it.value().toInt());
+    if (!emits.isEmpty())
+        lines << "Core: signals emitted: " + emits.join(", ");
+    return lines.join('\n');
+}
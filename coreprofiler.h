@@ -0,0 +1,85 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef COREPROFILER_H
+#define COREPROFILER_H
+
+#include <QObject>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QScopedArrayPointer>
+#include <QJsonObject>
+
+#define CORE_PROFILER_BUCKETS 24 // Powers of two, the last one holds everything above 4s of microseconds
+
+/// Where the Core thread spends its time. Each probe is a histogram of microseconds,
+/// for every tox and toxav callback and the phases of the loop, or of events for the queue to the GUI.
+/// Every signal of the Core is counted as it's emitted, the same way QSignalSpy listens.
+/// Recording is a few relaxed atomic increments and may happen on any thread.
+class CoreProfiler : public QObject
+{
+public:
+    enum Probe
+    {
+        ToxDo, LoopPeriod, TimerLateness, EventQueueDepth, FileHeartbeat, SaveSnapshot,
+        FriendRequest, FriendMessage, FriendAction, NameChange, TypingChange, StatusMessage, UserStatus,
+        ConnectionStatus, ReadReceipt, GroupInvite, GroupMessage, GroupNamelist,
+        FileSendRequest, FileControl, FileData,
+        AvInvite, AvStart, AvCancel, AvReject, AvEnd, AvRinging, AvStarting, AvEnding,
+        AvMediaChange, AvRequestTimeout, AvPeerTimeout, AvAudio, AvVideo,
+        ProbeCount
+    };
+
+    /// Records the microseconds until it goes out of scope
+    class Scope
+    {
+    public:
+        Scope(CoreProfiler& Profiler, Probe Which) : profiler(Profiler), probe{Which} {timer.start();}
+        ~Scope() {profiler.record(probe, timer.nsecsElapsed() / 1000);}
+
+    private:
+        CoreProfiler& profiler;
+        Probe probe;
+        QElapsedTimer timer;
+    };
+
+    explicit CoreProfiler(QObject* core); ///< Counts core's signals from then on
+    void record(Probe probe, qint64 value);
+    void reset();
+    QJsonObject snapshot() const; ///< The probes that recorded something and the signals that were emitted
+    QString report() const; ///< The snapshot as lines for the log
+
+    int qt_metacall(QMetaObject::Call call, int id, void** args) override; ///< Where the signals land
+
+private:
+    struct Histogram
+    {
+        QAtomicInt buckets[CORE_PROFILER_BUCKETS];
+        QAtomicInt count;
+        QAtomicInt max;
+    };
+
+    static qint64 percentile(const int* buckets, int count, double fraction); ///< Upper bound of the bucket it falls in
+
+private:
+    const QMetaObject* meta;
+    int signalCount;
+    Histogram histograms[ProbeCount];
+    QScopedArrayPointer<QAtomicInt> signalEmits; ///< By signal, in the order of meta's methods
+    QScopedArrayPointer<int> signalMethods; ///< Method index of each counted signal
+};
+
+#endif // COREPROFILER_H
@@ -1,9 +1,42 @@
 #include "corestructs.h"
+#include "coredefines.h"
 #include <QFile>
 
+int GroupPeerSnapshot::size() const
+{
+    return peers.size();
+}
+
+QString GroupPeerSnapshot::name(int peerId) const
+{
+    if (peerId < 0 || peerId >= peers.size())
+        return QString();
+    const Peer& peer = peers[peerId];
+    return QString::fromUtf8(arena.constData() + peer.nameOffset, peer.nameLength);
+}
+
+QByteArray GroupPeerSnapshot::publicKey(int peerId) const
+{
+    if (peerId < 0 || peerId >= peers.size())
+        return QByteArray();
+    return arena.mid(peerId * GROUPCHAT_PEER_KEY_SIZE, GROUPCHAT_PEER_KEY_SIZE);
+}
+
+FriendPresence::FriendPresence()
+    : friendId{-1}, hasStatus{false}, hasName{false}, hasStatusMessage{false}, status{Status::Offline}
+{
+}
+
+ToxFileStats::ToxFileStats()
+    : bytesPerSec{0}, sendFailures{0}, wakeups{0}, diskWaitMs{0}, coreTimeUs{0},
+    rateBytes{0}, rateTime{0}, diskStallTime{-1}
+{
+}
+
 ToxFile::ToxFile(int FileNum, int FriendId, QByteArray FileName, QString FilePath, FileDirection Direction)
     : fileNum(FileNum), friendId(FriendId), fileName{FileName}, filePath{FilePath}, file{new QFile(filePath)},
-    bytesSent{0}, filesize{0}, status{STOPPED}, direction{Direction}, sendTimer{nullptr}
+    bytesSent{0}, filesize{0}, status{STOPPED}, direction{Direction}, readAhead{nullptr},
+    writeBehind{nullptr}, progressTime{0}, checkpointTime{0}, batchId{-1}, digestMismatch{false}
 {
 }
 
@@ -4,9 +4,16 @@
 // Some headers use Core structs but don't need to include all of core.h
 // They should include this file directly instead to reduce compilation times
 
+#include <cstdint>
 #include <QString>
+#include <QList>
+#include <QDateTime>
+#include <QVector>
+#include <QByteArray>
+#include <QSharedPointer>
 class QFile;
-class QTimer;
+class FileReadAhead;
+class FileWriteBehind;
 
 enum class Status : int {Online = 0, Away, Busy, Offline};
 
@@ -36,6 +43,61 @@ struct ToxID
 
 };
 
+/// A friend as the profile loads, the whole list is sent to the GUI at once
+struct FriendInfo
+{
+    int friendId;
+    QString userId, name, statusMessage;
+    QDateTime lastSeen; ///< Invalid if never seen online
+};
+
+/// The last known status, name and status message of a friend, merged over a burst of updates
+struct FriendPresence
+{
+    FriendPresence();
+
+    int friendId;
+    bool hasStatus, hasName, hasStatusMessage; ///< Which of the fields changed
+    Status status;
+    QString name, statusMessage;
+};
+
+/// A group message as it came in, the author is resolved then since the peer number may be reused after a leave
+struct GroupMessage
+{
+    int peerId;
+    QString author, message;
+};
+
+/// Every peer of a group at one point, read-only once built. The keys and names
+/// are packed in one arena, so a snapshot is two allocations whatever the group's size.
+class GroupPeerSnapshot
+{
+public:
+    int size() const;
+    QString name(int peerId) const; ///< Empty if unknown
+    QByteArray publicKey(int peerId) const;
+
+private:
+    friend class Core;
+    struct Peer
+    {
+        int nameOffset, nameLength;
+    };
+    QVector<Peer> peers;
+    QByteArray arena; ///< GROUPCHAT_PEER_KEY_SIZE bytes of key per peer, then the names
+};
+typedef QSharedPointer<const GroupPeerSnapshot> GroupPeers;
+
+/// A bootstrap node that got us connected, the cache of them is kept fastest first
+struct KnownDhtNode
+{
+    QString name, userId, address;
+    quint16 port;
+    int connectTime; ///< Msecs from bootstrapping with it to being connected
+    QDateTime lastConnected;
+};
+
 struct DhtServer
 {
     QString name;
@@ -44,6 +106,20 @@ struct DhtServer
     int port;
 };
 
+/// Live counters of a transfer, to tell network, disk and scheduling stalls apart
+struct ToxFileStats
+{
+    ToxFileStats();
+
+    long long bytesPerSec; ///< Over the interval between the last two snapshots
+    int sendFailures; ///< tox_file_send_data calls toxcore refused because its window was full
+    int wakeups; ///< Scheduler visits for sends, data callbacks for receives
+    long long diskWaitMs; ///< Time the read-ahead wasn't ready or the write-behind queue was full
+    long long coreTimeUs; ///< Time Core's thread spent on this transfer
+    long long rateBytes, rateTime; ///< bytesSent and loop clock at the last snapshot
+    long long diskStallTime; ///< When the read-ahead ran dry or we paused the sender for the write-behind, or -1
+};
+
 struct ToxFile
 {
     enum FileStatus
@@ -74,7 +150,52 @@ struct ToxFile
     long long filesize;
     FileStatus status;
     FileDirection direction;
-    QTimer* sendTimer;
+    FileReadAhead* readAhead; ///< Prefetches outgoing chunks, created when the friend accepts
+    FileWriteBehind* writeBehind; ///< Writes incoming chunks, created when we accept
+    long long progressTime; ///< When fileTransferInfo was last emitted, on Core's loop clock
+    long long checkpointTime; ///< When the receive checkpoint was last saved, on Core's loop clock
+    int batchId; ///< The ToxFileBatch this file is part of, or -1
+    QByteArray digest; ///< SHA-256 of the data, empty if it wasn't hashed
+    QByteArray peerDigest; ///< The friend's digest of a received file, kept until it's closed
+    bool digestMismatch; ///< The friend's digest differs from ours
+    ToxFileStats stats;
+};
+
+/// Many files sent to a friend as one job, a few of them in flight at a time
+struct ToxFileBatch
+{
+    struct Entry
+    {
+        QString name; ///< Relative to the batch's base directory
+        QString path;
+        long long filesize;
+    };
+
+    int id;
+    int friendId;
+    QList<Entry> pending; ///< Not offered yet
+    int inFlight;
+    int filesDone, filesFailed;
+    long long totalBytes;
+    long long doneBytes; ///< Of the files that are done
+    long long progressTime;
+    bool advancing; ///< Guards advanceFileBatch against reentrance
+};
+
+/// One toxcore-sized piece of a message we send, a long message is several of them
+struct OutgoingMessage
+{
+    int messageId; ///< Ours, shared by every piece of the message
+    bool isAction;
+    QByteArray text; ///< UTF-8, at most TOX_MAX_MESSAGE_LENGTH bytes and never cut inside a character
+    uint32_t receipt; ///< Toxcore's, once sent
+};
+
+/// What we still have to send a friend, in order
+struct FriendOutbox
+{
+    QList<OutgoingMessage> queued; ///< Not accepted by toxcore yet
+    QList<OutgoingMessage> inFlight; ///< Waiting for their read receipt, sent again if the friend goes offline first
 };
 
 #endif // CORESTRUCTS_H
@@ -19,13 +19,17 @@
 
 CString::CString(const QString& string)
 {
-    cString = new uint8_t[string.length() * MAX_SIZE_OF_UTF8_ENCODED_CHARACTER]();
-    cStringSize = fromString(string, cString);
+    if (string.length() <= INLINE_LENGTH)
+        cString = inlineBuffer;
+    else
+        cString = new uint8_t[string.length() * MAX_SIZE_OF_UTF8_ENCODED_CHARACTER];
+    cStringSize = encode(string.constData(), string.length(), cString);
 }
 
 CString::~CString()
 {
-    delete[] cString;
+    if (cString != inlineBuffer)
+        delete[] cString;
 }
 
 uint8_t* CString::data()
@@ -43,9 +47,39 @@ QString CString::toString(const uint8_t* cString, uint16_t cStringSize)
     return QString::fromUtf8(reinterpret_cast<const char*>(cString), cStringSize);
 }
 
-uint16_t CString::fromString(const QString& string, uint8_t* cString)
+int CString::encode(const QChar* string, int length, uint8_t* out)
 {
-    QByteArray byteArray = QByteArray(string.toUtf8());
-    memcpy(cString, reinterpret_cast<uint8_t*>(byteArray.data()), byteArray.size());
-    return byteArray.size();
+    uint8_t* start = out;
+    const ushort* c = reinterpret_cast<const ushort*>(string);
+    const ushort* end = c + length;
+    while (c != end)
+    {
+        uint u = *c++;
+        if (u < 0x80)
+        {
+            *out++ = u;
+            continue;
+        }
+        if (u < 0x800)
+        {
+            *out++ = 0xc0 | (u >> 6);
+            *out++ = 0x80 | (u & 0x3f);
+            continue;
+        }
+        if (QChar::isHighSurrogate(u) && c != end && QChar::isLowSurrogate(*c))
+        {
+            u = QChar::surrogateToUcs4(u, *c++);
+            *out++ = 0xf0 | (u >> 18);
+            *out++ = 0x80 | ((u >> 12) & 0x3f);
+            *out++ = 0x80 | ((u >> 6) & 0x3f);
+            *out++ = 0x80 | (u & 0x3f);
+            continue;
+        }
+        if (QChar::isSurrogate(u))
+            u = QChar::ReplacementCharacter; // Unpaired, like QString::toUtf8 does
+        *out++ = 0xe0 | (u >> 12);
+        *out++ = 0x80 | ((u >> 6) & 0x3f);
+        *out++ = 0x80 | (u & 0x3f);
+    }
+    return out - start;
 }
@@ -18,26 +18,35 @@
 #define CSTRING_H
 
 #include <cstdint>
+#include <tox/tox.h>
 
 class QString;
 
+class QChar;
+
+/// The UTF-8 of a string, encoded straight from its UTF-16. Strings no longer than the longest
+/// message toxcore accepts use the inline buffer and don't allocate, whatever their script
 class CString
 {
 public:
     explicit CString(const QString& string);
     ~CString();
+    CString(const CString&) = delete;
+    CString& operator=(const CString&) = delete;
 
     uint8_t* data();
     uint16_t size();
 
     static QString toString(const uint8_t* cMessage, const uint16_t cMessageSize);
+    static int encode(const QChar* string, int length, uint8_t* out); ///< Needs MAX_SIZE_OF_UTF8_ENCODED_CHARACTER bytes per QChar, returns the size
 
 private:
-    const static int MAX_SIZE_OF_UTF8_ENCODED_CHARACTER = 4;
+    const static int MAX_SIZE_OF_UTF8_ENCODED_CHARACTER = 3; ///< Per UTF-16 unit, a surrogate pair takes 4 bytes for 2 units
+    const static int INLINE_LENGTH = TOX_MAX_MESSAGE_LENGTH; ///< In UTF-16 units
+    const static int INLINE_SIZE = INLINE_LENGTH * MAX_SIZE_OF_UTF8_ENCODED_CHARACTER;
 
     uint8_t* cString;
     uint16_t cStringSize;
-
-    static uint16_t fromString(const QString& message, uint8_t* cMessage);
+    uint8_t inlineBuffer[INLINE_SIZE];
 };
 #endif // CSTRING_H
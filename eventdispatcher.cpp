@@ -0,0 +1,286 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "eventdispatcher.h"
+#include "core.h"
+#include "friendlist.h"
+#include "friend.h"
+#include "filetransferinstance.h"
+#include "widget/form/chatform.h"
+#include "widget/widget.h"
+#include <QTimer>
+
+EventDispatcher::EventDispatcher()
+    : coreEvents{nullptr}
+{
+    drainTimer = new QTimer(this);
+    drainTimer->setSingleShot(true);
+    drainTimer->setInterval(CORE_EVENT_DRAIN_INTERVAL);
+    connect(drainTimer, &QTimer::timeout, this, &EventDispatcher::drainCoreEvents);
+}
+
+EventDispatcher& EventDispatcher::getInstance()
+{
+    static EventDispatcher dispatcher;
+    return dispatcher;
+}
+
+void EventDispatcher::connectCore(Core* core)
+{
+    coreEvents = &core->getEventQueue();
+    coreEvents->setReceiver(this, "onCoreEventsReady");
+    connect(core, &Core::fileSendStarted, this, &EventDispatcher::onFileSendStarted);
+    connect(core, &Core::fileReceiveRequested, this, &EventDispatcher::onFileReceiveRequested);
+    connect(core, &Core::fileBatchStarted, this, &EventDispatcher::onFileBatchStarted);
+    connect(core, &Core::fileTransferAccepted, this, &EventDispatcher::onFileTransferAccepted);
+    connect(core, &Core::fileTransferPaused, this, &EventDispatcher::onFileTransferPaused);
+    connect(core, &Core::fileTransferRemotePausedUnpaused, this, &EventDispatcher::onFileTransferRemotePausedUnpaused);
+    connect(core, &Core::avInvite, this, &EventDispatcher::onAvInvite);
+    connect(core, &Core::avStart, this, &EventDispatcher::onAvStart);
+    connect(core, &Core::avCancel, this, &EventDispatcher::onAvCancel);
+    connect(core, &Core::avEnd, this, &EventDispatcher::onAvEnd);
+    connect(core, &Core::avRinging, this, &EventDispatcher::onAvRinging);
+    connect(core, &Core::avStarting, this, &EventDispatcher::onAvStarting);
+    connect(core, &Core::avEnding, this, &EventDispatcher::onAvEnding);
+    connect(core, &Core::avRequestTimeout, this, &EventDispatcher::onAvRequestTimeout);
+    connect(core, &Core::avPeerTimeout, this, &EventDispatcher::onAvPeerTimeout);
+    connect(core, &Core::avMediaChange, this, &EventDispatcher::onAvMediaChange);
+}
+
+quint64 EventDispatcher::transferKey(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    return (quint64(quint32(friendId)) << 32) | (quint64(quint32(fileNum)) << 1) | (direction == ToxFile::RECEIVING);
+}
+
+quint64 EventDispatcher::batchKey(int friendId, int batchId)
+{
+    return (quint64(quint32(friendId)) << 32) | quint32(batchId);
+}
+
+void EventDispatcher::addChatForm(int friendId, ChatForm* form)
+{
+    forms.insert(friendId, form);
+}
+
+void EventDispatcher::removeChatForm(int friendId)
+{
+    forms.remove(friendId);
+}
+
+void EventDispatcher::addTransfer(FileTransferInstance* transfer, int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    transfers.insert(transferKey(friendId, fileNum, direction), transfer);
+}
+
+void EventDispatcher::removeTransfer(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    transfers.remove(transferKey(friendId, fileNum, direction));
+}
+
+void EventDispatcher::addBatch(FileTransferInstance* transfer, int friendId, int batchId)
+{
+    batches.insert(batchKey(friendId, batchId), transfer);
+}
+
+void EventDispatcher::removeBatch(int friendId, int batchId)
+{
+    batches.remove(batchKey(friendId, batchId));
+}
+
+ChatForm* EventDispatcher::formFor(int friendId, bool create)
+{
+    ChatForm* form = forms.value(friendId, nullptr);
+    if (form || !create)
+        return form;
+
+    Friend* f = FriendList::findFriend(friendId);
+    return f ? f->getChatForm() : nullptr;
+}
+
+FileTransferInstance* EventDispatcher::transferFor(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    return transfers.value(transferKey(friendId, fileNum, direction));
+}
+
+FileTransferInstance* EventDispatcher::batchFor(int friendId, int batchId)
+{
+    return batches.value(batchKey(friendId, batchId));
+}
+
+void EventDispatcher::onCoreEventsReady()
+{
+    // However often Core wakes us, we drain at most once per frame
+    if (!drainTimer->isActive())
+        drainTimer->start();
+}
+
+void EventDispatcher::drainCoreEvents()
+{
+    if (!coreEvents)
+        return;
+
+    coreEvents->drain([this](CoreEvent&& event)
+    {
+        switch (event.type)
+        {
+        case CoreEvent::FriendMessage:
+            if (Widget* widget = Widget::getInstance())
+                widget->onFriendMessageReceived(event.friendId, event.text);
+            break;
+        case CoreEvent::FileTransferInfo:
+            onFileTransferInfo(event.friendId, event.id, event.total, event.done, event.direction);
+            break;
+        case CoreEvent::FileBatchInfo:
+            onFileBatchInfo(event.friendId, event.id, event.total, event.done);
+            break;
+        case CoreEvent::FileTransferFinished:
+            onFileTransferFinished(event.file);
+            break;
+        case CoreEvent::FileTransferCancelled:
+            onFileTransferCancelled(event.friendId, event.id, event.direction);
+            break;
+        case CoreEvent::FileBatchFinished:
+            onFileBatchFinished(event.friendId, event.id, event.total);
+            break;
+        }
+    });
+}
+
+void EventDispatcher::onFileSendStarted(ToxFile file)
+{
+    if (ChatForm* form = formFor(file.friendId, true))
+        form->startFileSend(file);
+}
+
+void EventDispatcher::onFileReceiveRequested(ToxFile file)
+{
+    if (ChatForm* form = formFor(file.friendId, true))
+        form->onFileRecvRequest(file);
+}
+
+void EventDispatcher::onFileBatchStarted(int friendId, int batchId, QString name, int fileCount, long long totalBytes)
+{
+    if (ChatForm* form = formFor(friendId, true))
+        form->startFileBatch(friendId, batchId, name, fileCount, totalBytes);
+}
+
+void EventDispatcher::onFileTransferAccepted(ToxFile file)
+{
+    if (FileTransferInstance* transfer = transferFor(file.friendId, file.fileNum, file.direction))
+        transfer->onFileTransferAccepted(file);
+}
+
+void EventDispatcher::onFileTransferCancelled(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    if (FileTransferInstance* transfer = transferFor(friendId, fileNum, direction))
+        transfer->onFileTransferCancelled(friendId, fileNum, direction);
+}
+
+void EventDispatcher::onFileTransferFinished(ToxFile file)
+{
+    if (FileTransferInstance* transfer = transferFor(file.friendId, file.fileNum, file.direction))
+        transfer->onFileTransferFinished(file);
+}
+
+void EventDispatcher::onFileTransferPaused(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    if (FileTransferInstance* transfer = transferFor(friendId, fileNum, direction))
+        transfer->onFileTransferPaused(friendId, fileNum, direction);
+}
+
+void EventDispatcher::onFileTransferInfo(int friendId, int fileNum, int64_t filesize, int64_t bytesSent, ToxFile::FileDirection direction)
+{
+    if (FileTransferInstance* transfer = transferFor(friendId, fileNum, direction))
+        transfer->onFileTransferInfo(friendId, fileNum, filesize, bytesSent, direction);
+}
+
+void EventDispatcher::onFileTransferRemotePausedUnpaused(ToxFile file, bool paused)
+{
+    if (FileTransferInstance* transfer = transferFor(file.friendId, file.fileNum, file.direction))
+        transfer->onFileTransferRemotePausedUnpaused(file, paused);
+}
+
+void EventDispatcher::onFileBatchInfo(int friendId, int batchId, int filesDone, long long bytesSent)
+{
+    if (FileTransferInstance* transfer = batchFor(friendId, batchId))
+        transfer->onFileBatchInfo(friendId, batchId, filesDone, bytesSent);
+}
+
+void EventDispatcher::onFileBatchFinished(int friendId, int batchId, int filesFailed)
+{
+    if (FileTransferInstance* transfer = batchFor(friendId, batchId))
+        transfer->onFileBatchFinished(friendId, batchId, filesFailed);
+}
+
+void EventDispatcher::onAvInvite(int friendId, int callIndex, bool video)
+{
+    if (ChatForm* form = formFor(friendId, true))
+        form->onAvInvite(friendId, callIndex, video);
+}
+
+void EventDispatcher::onAvStart(int friendId, int callIndex, bool video)
+{
+    if (ChatForm* form = formFor(friendId, true))
+        form->onAvStart(friendId, callIndex, video);
+}
+
+void EventDispatcher::onAvCancel(int friendId, int callIndex)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvCancel(friendId, callIndex);
+}
+
+void EventDispatcher::onAvEnd(int friendId, int callIndex)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvEnd(friendId, callIndex);
+}
+
+void EventDispatcher::onAvRinging(int friendId, int callIndex, bool video)
+{
+    if (ChatForm* form = formFor(friendId, true))
+        form->onAvRinging(friendId, callIndex, video);
+}
+
+void EventDispatcher::onAvStarting(int friendId, int callIndex, bool video)
+{
+    if (ChatForm* form = formFor(friendId, true))
+        form->onAvStarting(friendId, callIndex, video);
+}
+
+void EventDispatcher::onAvEnding(int friendId, int callIndex)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvEnding(friendId, callIndex);
+}
+
+void EventDispatcher::onAvRequestTimeout(int friendId, int callIndex)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvRequestTimeout(friendId, callIndex);
+}
+
+void EventDispatcher::onAvPeerTimeout(int friendId, int callIndex)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvPeerTimeout(friendId, callIndex);
+}
+
+void EventDispatcher::onAvMediaChange(int friendId, int callIndex, bool video)
+{
+    if (ChatForm* form = formFor(friendId, false))
+        form->onAvMediaChange(friendId, callIndex, video);
+}
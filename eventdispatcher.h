@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef EVENTDISPATCHER_H
+#define EVENTDISPATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include "corestructs.h"
+
+class Core;
+class CoreEventQueue;
+class QTimer;
+class ChatForm;
+class FileTransferInstance;
+
+/// Receives each Core event once, on the GUI thread, and hands it to the one chat form or
+/// transfer it's about, looked up by friend, file or batch. Receivers register themselves.
+class EventDispatcher : public QObject
+{
+    Q_OBJECT
+public:
+    static EventDispatcher& getInstance();
+    void connectCore(Core* core);
+
+    void addChatForm(int friendId, ChatForm* form);
+    void removeChatForm(int friendId);
+    void addTransfer(FileTransferInstance* transfer, int friendId, int fileNum, ToxFile::FileDirection direction);
+    void removeTransfer(int friendId, int fileNum, ToxFile::FileDirection direction);
+    void addBatch(FileTransferInstance* transfer, int friendId, int batchId);
+    void removeBatch(int friendId, int batchId);
+
+private slots:
+    void onCoreEventsReady(); ///< Called by the queue, waits for the next frame to drain it
+    void drainCoreEvents();
+    void onFileSendStarted(ToxFile file);
+    void onFileReceiveRequested(ToxFile file);
+    void onFileBatchStarted(int friendId, int batchId, QString name, int fileCount, long long totalBytes);
+    void onFileTransferAccepted(ToxFile file);
+    void onFileTransferCancelled(int friendId, int fileNum, ToxFile::FileDirection direction);
+    void onFileTransferFinished(ToxFile file);
+    void onFileTransferPaused(int friendId, int fileNum, ToxFile::FileDirection direction);
+    void onFileTransferInfo(int friendId, int fileNum, int64_t filesize, int64_t bytesSent, ToxFile::FileDirection direction);
+    void onFileTransferRemotePausedUnpaused(ToxFile file, bool paused);
+    void onFileBatchInfo(int friendId, int batchId, int filesDone, long long bytesSent);
+    void onFileBatchFinished(int friendId, int batchId, int filesFailed);
+    void onAvInvite(int friendId, int callIndex, bool video);
+    void onAvStart(int friendId, int callIndex, bool video);
+    void onAvCancel(int friendId, int callIndex);
+    void onAvEnd(int friendId, int callIndex);
+    void onAvRinging(int friendId, int callIndex, bool video);
+    void onAvStarting(int friendId, int callIndex, bool video);
+    void onAvEnding(int friendId, int callIndex);
+    void onAvRequestTimeout(int friendId, int callIndex);
+    void onAvPeerTimeout(int friendId, int callIndex);
+    void onAvMediaChange(int friendId, int callIndex, bool video);
+
+private:
+    EventDispatcher();
+    ChatForm* formFor(int friendId, bool create); ///< Only events that start something create the form
+    FileTransferInstance* transferFor(int friendId, int fileNum, ToxFile::FileDirection direction);
+    FileTransferInstance* batchFor(int friendId, int batchId);
+    static quint64 transferKey(int friendId, int fileNum, ToxFile::FileDirection direction);
+    static quint64 batchKey(int friendId, int batchId);
+
+private:
+    CoreEventQueue* coreEvents;
+    QTimer* drainTimer;
+    QHash<int, ChatForm*> forms;
+    QHash<quint64, QPointer<FileTransferInstance>> transfers, batches;
+};
+
+#endif // EVENTDISPATCHER_H
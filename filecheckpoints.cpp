@@ -0,0 +1,262 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "filecheckpoints.h"
+#include "coredefines.h"
+#include "filereadahead.h"
+#include <algorithm>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QtEndian>
+
+struct FileCheckpoints::Link
+{
+    QMutex mutex;
+    QObject* receiver; ///< Under mutex, cleared by our destructor
+};
+
+class FileCheckpoints::Task : public QRunnable
+{
+public:
+    enum Kind {Fingerprint, CheckFingerprint, MakeResumeRequest, CheckResumeRequest};
+
+    Task(const QSharedPointer<Link>& SharedLink, Kind Type, const char* Member, quint64 Tag)
+        : link{SharedLink}, type{Type}, member{Member}, tag{Tag}, filesize{0} {}
+
+    void run()
+    {
+        QByteArray result;
+        qint64 offset = -1;
+        switch (type)
+        {
+        case Fingerprint:
+            result = fingerprint(path, filesize);
+            break;
+        case CheckFingerprint:
+            result = fingerprint(checkpoint.filePath, checkpoint.filesize);
+            break;
+        case MakeResumeRequest:
+            result = makeResumeRequest(checkpoint.filePath, checkpoint.offset);
+            break;
+        case CheckResumeRequest:
+            offset = checkResumeRequest(request, path, filesize);
+            break;
+        }
+
+        // Posted under the mutex, so the receiver can't be destroyed meanwhile
+        QMutexLocker locker(&link->mutex);
+        if (!link->receiver)
+            return;
+        if (type == Fingerprint)
+            QMetaObject::invokeMethod(link->receiver, member.constData(), Qt::QueuedConnection,
+                                      Q_ARG(quint64, tag), Q_ARG(QByteArray, result));
+        else if (type == CheckFingerprint)
+            QMetaObject::invokeMethod(link->receiver, member.constData(), Qt::QueuedConnection, Q_ARG(quint64, tag),
+                                      Q_ARG(FileCheckpoint, checkpoint), Q_ARG(bool, result == checkpoint.fingerprint));
+        else if (type == MakeResumeRequest)
+            QMetaObject::invokeMethod(link->receiver, member.constData(), Qt::QueuedConnection, Q_ARG(quint64, tag),
+                                      Q_ARG(FileCheckpoint, checkpoint), Q_ARG(QByteArray, result));
+        else
+            QMetaObject::invokeMethod(link->receiver, member.constData(), Qt::QueuedConnection,
+                                      Q_ARG(quint64, tag), Q_ARG(qint64, offset));
+    }
+
+    QSharedPointer<Link> link;
+    Kind type;
+    QByteArray member;
+    quint64 tag;
+    QString path;
+    qint64 filesize;
+    QByteArray request;
+    FileCheckpoint checkpoint;
+};
+
+FileCheckpoints::FileCheckpoints(const QString& profileDir, QObject* receiver)
+    : store{QDir(profileDir).filePath("transfers.ini"), QSettings::IniFormat}, link{new Link}
+{
+    link->receiver = receiver;
+}
+
+FileCheckpoints::~FileCheckpoints()
+{
+    QMutexLocker locker(&link->mutex);
+    link->receiver = nullptr;
+}
+
+bool FileCheckpoints::find(const QString& friendKey, ToxFile::FileDirection direction,
+                           const QByteArray& fileName, qint64 filesize, FileCheckpoint& checkpoint)
+{
+    QMutexLocker locker(&storeMutex);
+    QSettings& s = store;
+    s.beginGroup(key(friendKey, direction, fileName, filesize));
+    bool found = s.contains("filePath");
+    if (found)
+    {
+        checkpoint.friendKey = friendKey;
+        checkpoint.direction = direction;
+        checkpoint.fileName = fileName;
+        checkpoint.filePath = s.value("filePath").toString();
+        checkpoint.filesize = filesize;
+        checkpoint.offset = s.value("offset", 0).toLongLong();
+        checkpoint.fingerprint = s.value("fingerprint").toByteArray();
+    }
+    s.endGroup();
+    return found;
+}
+
+QList<FileCheckpoint> FileCheckpoints::findAll(const QString& friendKey, ToxFile::FileDirection direction)
+{
+    QList<FileCheckpoint> checkpoints;
+    QMutexLocker locker(&storeMutex);
+    QSettings& s = store;
+    for (const QString& group : s.childGroups())
+    {
+        s.beginGroup(group);
+        if (s.value("friendKey").toString() == friendKey && s.value("direction").toInt() == direction)
+        {
+            FileCheckpoint checkpoint;
+            checkpoint.friendKey = friendKey;
+            checkpoint.direction = direction;
+            checkpoint.fileName = s.value("fileName").toByteArray();
+            checkpoint.filePath = s.value("filePath").toString();
+            checkpoint.filesize = s.value("filesize").toLongLong();
+            checkpoint.offset = s.value("offset", 0).toLongLong();
+            checkpoint.fingerprint = s.value("fingerprint").toByteArray();
+            checkpoints.append(checkpoint);
+        }
+        s.endGroup();
+    }
+    return checkpoints;
+}
+
+void FileCheckpoints::save(const FileCheckpoint& checkpoint)
+{
+    QMutexLocker locker(&storeMutex);
+    QSettings& s = store;
+    s.beginGroup(key(checkpoint.friendKey, checkpoint.direction, checkpoint.fileName, checkpoint.filesize));
+        s.setValue("friendKey", checkpoint.friendKey);
+        s.setValue("direction", (int)checkpoint.direction);
+        s.setValue("fileName", checkpoint.fileName);
+        s.setValue("filePath", checkpoint.filePath);
+        s.setValue("filesize", checkpoint.filesize);
+        s.setValue("offset", checkpoint.offset);
+        s.setValue("fingerprint", checkpoint.fingerprint);
+    s.endGroup();
+}
+
+void FileCheckpoints::remove(const QString& friendKey, ToxFile::FileDirection direction,
+                             const QByteArray& fileName, qint64 filesize)
+{
+    QMutexLocker locker(&storeMutex);
+    store.remove(key(friendKey, direction, fileName, filesize));
+}
+
+void FileCheckpoints::fingerprintAsync(const QString& path, qint64 filesize, const char* member, quint64 tag)
+{
+    Task* task = new Task(link, Task::Fingerprint, member, tag);
+    task->path = path;
+    task->filesize = filesize;
+    readAheadPool()->start(task);
+}
+
+void FileCheckpoints::checkFingerprintAsync(const FileCheckpoint& checkpoint, const char* member, quint64 tag)
+{
+    Task* task = new Task(link, Task::CheckFingerprint, member, tag);
+    task->checkpoint = checkpoint;
+    readAheadPool()->start(task);
+}
+
+void FileCheckpoints::makeResumeRequestAsync(const FileCheckpoint& checkpoint, const char* member, quint64 tag)
+{
+    Task* task = new Task(link, Task::MakeResumeRequest, member, tag);
+    task->checkpoint = checkpoint;
+    readAheadPool()->start(task);
+}
+
+void FileCheckpoints::checkResumeRequestAsync(const QByteArray& request, const QString& path, qint64 filesize,
+                                              const char* member, quint64 tag)
+{
+    Task* task = new Task(link, Task::CheckResumeRequest, member, tag);
+    task->request = request;
+    task->path = path;
+    task->filesize = filesize;
+    readAheadPool()->start(task);
+}
+
+QByteArray FileCheckpoints::fingerprint(const QString& path, qint64 filesize)
+{
+    return hashBlock(path, std::min<qint64>(TOX_FILE_CHECKPOINT_BLOCK, filesize)) + hashBlock(path, filesize);
+}
+
+QByteArray FileCheckpoints::makeResumeRequest(const QString& path, qint64 offset)
+{
+    if (offset < TOX_FILE_CHECKPOINT_BLOCK)
+        return QByteArray();
+
+    QByteArray head = hashBlock(path, TOX_FILE_CHECKPOINT_BLOCK);
+    QByteArray tail = hashBlock(path, offset);
+    if (head.isEmpty() || tail.isEmpty())
+        return QByteArray();
+
+    QByteArray request(sizeof(quint64), 0);
+    qToBigEndian<quint64>(offset, reinterpret_cast<uchar*>(request.data()));
+    return request + head + tail;
+}
+
+qint64 FileCheckpoints::checkResumeRequest(const QByteArray& request, const QString& path, qint64 filesize)
+{
+    const int hashSize = 20; // SHA-1
+    if (request.size() != (int)sizeof(quint64) + 2*hashSize)
+        return -1;
+
+    qint64 offset = qFromBigEndian<quint64>(reinterpret_cast<const uchar*>(request.constData()));
+    if (offset < TOX_FILE_CHECKPOINT_BLOCK || offset > filesize)
+        return -1;
+    if (hashBlock(path, TOX_FILE_CHECKPOINT_BLOCK) != request.mid(sizeof(quint64), hashSize)
+            || hashBlock(path, offset) != request.mid(sizeof(quint64) + hashSize))
+        return -1;
+    return offset;
+}
+
+QString FileCheckpoints::key(const QString& friendKey, ToxFile::FileDirection direction,
+                             const QByteArray& fileName, qint64 filesize)
+{
+    // File names can hold anything, so we don't use them in the group name directly
+    QByteArray id = friendKey.toUtf8() + '/' + QByteArray::number(direction) + '/'
+                    + fileName + '/' + QByteArray::number(filesize);
+    return QCryptographicHash::hash(id, QCryptographicHash::Sha1).toHex();
+}
+
+QByteArray FileCheckpoints::hashBlock(const QString& path, qint64 end)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < end)
+        return QByteArray();
+
+    qint64 start = std::max<qint64>(end - TOX_FILE_CHECKPOINT_BLOCK, 0);
+    if (!file.seek(start))
+        return QByteArray();
+    QByteArray block = file.read(end - start);
+    if (block.size() != end - start)
+        return QByteArray();
+    return QCryptographicHash::hash(block, QCryptographicHash::Sha1);
+}
@@ -0,0 +1,91 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILECHECKPOINTS_H
+#define FILECHECKPOINTS_H
+
+#include "corestructs.h"
+#include <QByteArray>
+#include <QList>
+#include <QMetaType>
+#include <QMutex>
+#include <QSettings>
+#include <QSharedPointer>
+#include <QString>
+
+class QObject;
+
+/// Where an interrupted transfer stopped, so it can continue after a reconnect or a restart
+struct FileCheckpoint
+{
+    QString friendKey; ///< Public key of the friend, friend numbers don't survive a restart
+    ToxFile::FileDirection direction;
+    QByteArray fileName;
+    QString filePath;
+    qint64 filesize;
+    qint64 offset; ///< Bytes safely on disk, only meaningful on the receiving side
+    QByteArray fingerprint; ///< Hashes of the first and last block of the source, sending side only
+};
+Q_DECLARE_METATYPE(FileCheckpoint)
+
+/// Persists the checkpoints of one profile to transfers.ini in the profile's dir.
+/// To resume, the receiver sends a resume request with its FILECONTROL_ACCEPT. The request
+/// holds the offset and the hashes of the first block and of the block before the offset.
+/// The sender only skips ahead if its own file hashes the same.
+/// Hashing reads the files, so it's done on the read-ahead pool. The *Async calls post the result
+/// to the receiver's member, tagged as asked, and never after we're destroyed.
+class FileCheckpoints
+{
+public:
+    FileCheckpoints(const QString& profileDir, QObject* receiver);
+    ~FileCheckpoints();
+
+    bool find(const QString& friendKey, ToxFile::FileDirection direction,
+              const QByteArray& fileName, qint64 filesize, FileCheckpoint& checkpoint);
+    QList<FileCheckpoint> findAll(const QString& friendKey, ToxFile::FileDirection direction);
+    void save(const FileCheckpoint& checkpoint);
+    void remove(const QString& friendKey, ToxFile::FileDirection direction,
+                const QByteArray& fileName, qint64 filesize);
+
+    /// member(quint64 tag, QByteArray fingerprint)
+    void fingerprintAsync(const QString& path, qint64 filesize, const char* member, quint64 tag);
+    /// member(quint64 tag, FileCheckpoint checkpoint, bool unchanged), whether the source still has its fingerprint
+    void checkFingerprintAsync(const FileCheckpoint& checkpoint, const char* member, quint64 tag);
+    /// member(quint64 tag, FileCheckpoint checkpoint, QByteArray request), the request is empty if we can't resume
+    void makeResumeRequestAsync(const FileCheckpoint& checkpoint, const char* member, quint64 tag);
+    /// member(quint64 tag, qint64 offset), the offset to resume from, or -1
+    void checkResumeRequestAsync(const QByteArray& request, const QString& path, qint64 filesize,
+                                 const char* member, quint64 tag);
+
+private:
+    struct Link;
+    class Task;
+
+    static QByteArray fingerprint(const QString& path, qint64 filesize);
+    static QByteArray makeResumeRequest(const QString& path, qint64 offset); ///< Empty if we can't resume
+    static qint64 checkResumeRequest(const QByteArray& request, const QString& path, qint64 filesize); ///< The offset to resume from, or -1
+    static QString key(const QString& friendKey, ToxFile::FileDirection direction,
+                       const QByteArray& fileName, qint64 filesize);
+    static QByteArray hashBlock(const QString& path, qint64 end); ///< Hash of the block ending at end
+
+private:
+    QSettings store; ///< Under storeMutex
+    QMutex storeMutex;
+    QSharedPointer<Link> link; ///< Shared with the tasks, which outlive us
+};
+
+#endif // FILECHECKPOINTS_H
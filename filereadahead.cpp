@@ -0,0 +1,298 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "filereadahead.h"
+#include "coredefines.h"
+#include <algorithm>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+struct FileReadAhead::State
+{
+    QMutex mutex;
+    QWaitCondition idle; ///< Woken when the worker stops, digest waits for it
+    QFile file; ///< Only touched by the worker once the read-ahead started, owns the mapping
+    const uchar* mapped;
+    QQueue<QByteArray> ready;
+    QList<QByteArray> spare; ///< Consumed chunks, recycled so we don't allocate per chunk
+    qint64 readPos; ///< Mapped, how far the worker has faulted in and hashed, the sender doesn't go past it
+    qint64 sentPos; ///< Mapped, where the sender is
+    qint64 filesize;
+    int chunkSize;
+    bool busy;
+    bool cancelled;
+    bool error;
+    QString errorString;
+    bool hashing;
+    bool hashed; ///< Every byte went through hash
+    QCryptographicHash hash{QCryptographicHash::Sha256}; ///< Only touched by the worker until hashed
+    QByteArray digest;
+
+    bool isAhead() const ///< Under mutex
+    {
+        if (mapped)
+            return readPos - sentPos >= (qint64)TOX_FILE_READAHEAD_CHUNKS * chunkSize;
+        return ready.size() >= TOX_FILE_READAHEAD_CHUNKS;
+    }
+    void stop() ///< Under mutex, by the worker
+    {
+        busy = false;
+        idle.wakeAll();
+    }
+};
+
+QThreadPool* readAheadPool()
+{
+    static QThreadPool* pool = []
+    {
+        QThreadPool* pool = new QThreadPool;
+        pool->setMaxThreadCount(2);
+        return pool;
+    }();
+    return pool;
+}
+
+class FileReadAhead::Task : public QRunnable
+{
+public:
+    explicit Task(const QSharedPointer<State>& SharedState) : d{SharedState} {}
+
+    void run()
+    {
+        if (d->mapped)
+        {
+            walkMapped();
+            return;
+        }
+
+        forever
+        {
+            QByteArray chunk;
+            {
+                QMutexLocker locker(&d->mutex);
+                if (d->cancelled || d->readPos >= d->filesize || d->isAhead())
+                {
+                    d->stop();
+                    return;
+                }
+                if (!d->spare.isEmpty())
+                    chunk = d->spare.takeLast();
+            }
+
+            qint64 wanted = std::min<qint64>(d->chunkSize, d->filesize - d->readPos);
+            chunk.resize(wanted);
+            qint64 readSize = d->file.read(chunk.data(), wanted);
+
+            QMutexLocker locker(&d->mutex);
+            if (readSize <= 0)
+            {
+                d->error = true;
+                d->errorString = readSize ? d->file.errorString() : QString("Unexpected end of file");
+                d->stop();
+                return;
+            }
+            chunk.resize(readSize);
+            if (d->hashing)
+            {
+                locker.unlock();
+                d->hash.addData(chunk);
+                locker.relock();
+            }
+            d->readPos += readSize;
+            d->hashed = d->hashing && d->readPos >= d->filesize;
+            d->ready.enqueue(chunk);
+        }
+    }
+
+private:
+    /// Mapped files are sent in place. We fault them in and hash them ahead of the sender, which waits
+    /// for us, so the Core thread doesn't wait on the disk and the digest is there when the last chunk is
+    void walkMapped()
+    {
+        forever
+        {
+            qint64 pos;
+            {
+                QMutexLocker locker(&d->mutex);
+                if (d->cancelled || d->readPos >= d->filesize || d->isAhead())
+                {
+                    d->stop();
+                    return;
+                }
+                pos = d->readPos;
+            }
+            int size = std::min<qint64>(TOX_FILE_HASH_STEP, d->filesize - pos);
+            if (d->hashing)
+            {
+                d->hash.addData(reinterpret_cast<const char*>(d->mapped + pos), size);
+            }
+            else
+            {
+                const volatile uchar* page = d->mapped + pos;
+                for (int i=0; i<size; i+=TOX_FILE_PAGE_SIZE)
+                    (void)page[i];
+            }
+
+            QMutexLocker locker(&d->mutex);
+            d->readPos += size;
+            d->hashed = d->hashing && d->readPos >= d->filesize;
+        }
+    }
+
+private:
+    QSharedPointer<State> d;
+};
+
+FileReadAhead::FileReadAhead(const QString& path, qint64 offset, qint64 filesize, int chunkSize, bool hash)
+    : d{new State}, mapped{nullptr}, mappedPos{offset}
+{
+    d->mapped = nullptr;
+    d->hashing = hash && !offset;
+    d->hashed = d->hashing && !filesize;
+    d->readPos = offset;
+    d->sentPos = offset;
+    d->filesize = filesize;
+    d->chunkSize = chunkSize;
+    d->busy = false;
+    d->cancelled = false;
+    d->error = false;
+
+    d->file.setFileName(path);
+    if (!d->file.open(QIODevice::ReadOnly))
+    {
+        d->error = true;
+        d->errorString = d->file.errorString();
+        return;
+    }
+
+    if (filesize >= TOX_FILE_MAP_THRESHOLD)
+        mapped = d->file.map(0, filesize);
+    if (mapped)
+    {
+        d->mapped = mapped;
+        refill();
+        return;
+    }
+
+    if (offset && !d->file.seek(offset))
+    {
+        d->error = true;
+        d->errorString = d->file.errorString();
+        return;
+    }
+    refill();
+}
+
+FileReadAhead::~FileReadAhead()
+{
+    // The mapping goes away with the file, once the worker let go of the state
+    QMutexLocker locker(&d->mutex);
+    d->cancelled = true;
+}
+
+const uint8_t* FileReadAhead::peek(int& size)
+{
+    if (mapped)
+    {
+        qint64 end;
+        {
+            QMutexLocker locker(&d->mutex);
+            end = d->readPos;
+        }
+        int chunk = std::min<qint64>(d->chunkSize, d->filesize - mappedPos);
+        if (mappedPos >= d->filesize || mappedPos + chunk > end)
+        {
+            refill();
+            return nullptr;
+        }
+        size = chunk;
+        return mapped + mappedPos;
+    }
+
+    const uint8_t* data = nullptr;
+    {
+        QMutexLocker locker(&d->mutex);
+        if (!d->ready.isEmpty())
+        {
+            // The worker never touches a queued chunk again, so the pointer stays valid until pop
+            const QByteArray& chunk = d->ready.head();
+            size = chunk.size();
+            data = reinterpret_cast<const uint8_t*>(chunk.constData());
+        }
+    }
+    refill();
+    return data;
+}
+
+void FileReadAhead::pop()
+{
+    if (mapped)
+    {
+        mappedPos = std::min<qint64>(mappedPos + d->chunkSize, d->filesize);
+        {
+            QMutexLocker locker(&d->mutex);
+            d->sentPos = mappedPos;
+        }
+        refill();
+        return;
+    }
+
+    {
+        QMutexLocker locker(&d->mutex);
+        if (d->ready.isEmpty())
+            return;
+        d->spare.append(d->ready.dequeue());
+    }
+    refill();
+}
+
+bool FileReadAhead::hasError() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->error;
+}
+
+QByteArray FileReadAhead::digest() const
+{
+    QMutexLocker locker(&d->mutex);
+    while (d->hashing && d->busy && !d->hashed)
+        d->idle.wait(&d->mutex);
+    if (d->hashed && d->digest.isEmpty())
+        d->digest = d->hash.result();
+    return d->digest;
+}
+
+QString FileReadAhead::errorString() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->errorString;
+}
+
+void FileReadAhead::refill()
+{
+    QMutexLocker locker(&d->mutex);
+    if (d->busy || d->cancelled || d->error || d->readPos >= d->filesize || d->isAhead())
+        return;
+    d->busy = true;
+    readAheadPool()->start(new Task(d));
+}
@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILEREADAHEAD_H
+#define FILEREADAHEAD_H
+
+#include <QString>
+#include <QSharedPointer>
+#include <cstdint>
+
+class QThreadPool;
+
+/// Prefetches the chunks of an outgoing file so the Core thread never blocks on disk.
+/// Large local files are mapped and served in place, everything else is read
+/// on a worker thread into a bounded queue of TOX_FILE_READAHEAD_CHUNKS chunks.
+/// A mapped file is walked by the worker ahead of what we serve, so its page faults happen there.
+/// With hash set the worker also computes the file's SHA-256 as it reads or walks.
+/// peek/pop must only be called from the thread that owns the transfer.
+class FileReadAhead
+{
+public:
+    FileReadAhead(const QString& path, qint64 offset, qint64 filesize, int chunkSize, bool hash=false);
+    ~FileReadAhead();
+
+    const uint8_t* peek(int& size); ///< Next ready chunk, or nullptr if it isn't read yet or on error
+    void pop(); ///< Consumes the chunk returned by the last peek
+    bool hasError() const;
+    QByteArray digest() const; ///< SHA-256 of the file once it's all read, waits for the worker. Empty if we don't hash or resumed
+    QString errorString() const;
+    bool isMapped() const {return mapped != nullptr;}
+
+private:
+    void refill();
+
+private:
+    struct State;
+    class Task;
+    QSharedPointer<State> d;
+    uchar* mapped;
+    qint64 mappedPos;
+};
+
+QThreadPool* readAheadPool(); ///< Reads the outgoing files, the checkpoint hashing shares it
+
+#endif // FILEREADAHEAD_H
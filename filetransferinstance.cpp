@@ -16,21 +16,44 @@
 
 #include "filetransferinstance.h"
 #include "core.h"
+#include "eventdispatcher.h"
+#include "thumbnailer.h"
+#include "style.h"
+#include "widget/imageviewer.h"
 #include <math.h>
+#include <QDir>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
-#include <QBuffer>
+#include <QPainter>
+#include <QFontMetricsF>
 #include <QDebug>
+#include <algorithm>
+
+// Pixels between the edges of an item and its miniature and text
+#define FILE_TRANSFER_PADDING 6
+// ms after the last file of a received folder, its next file is asked for again
+#define FILE_TRANSFER_FOLDER_TIMEOUT 60*1000
 
 uint FileTransferInstance::Idconter = 0;
+qint64 FileTransferInstance::previewMemory = 0;
+QHash<QString, FileTransferInstance::FolderDestination> FileTransferInstance::folderDestinations;
+QSet<FileTransferInstance*> FileTransferInstance::pendingFolderFiles;
+
+static qint64 pixmapBytes(const QPixmap& pixmap)
+{
+    return (qint64)pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+}
 
 FileTransferInstance::FileTransferInstance(ToxFile File)
-    : lastUpdate{QDateTime::currentDateTime()}, lastBytesSent{0},
-      fileNum{File.fileNum}, friendId{File.friendId}, direction{File.direction}
+    : lastUpdate{QDateTime::currentDateTime()}, lastBytesSent{File.bytesSent},
+      fileNum{File.fileNum}, friendId{File.friendId}, batchId{-1}, fileCount{1}, filesDone{0},
+      totalBytes{File.filesize}, direction{File.direction}
 {
     id = Idconter++;
-    state = tsPending;
+    state = File.status == ToxFile::TRANSMITTING ? tsProcessing : tsPending; // A resumed file isn't asked for
     remotePaused = false;
+    digestMismatch = false;
 
     filename = File.fileName;
     size = getHumanReadableSize(File.filesize);
@@ -38,14 +61,91 @@ FileTransferInstance::FileTransferInstance(ToxFile File)
     eta = "00:00";
     if (File.direction == ToxFile::SENDING)
     {
-        QImage preview;
-        File.file->seek(0);
-        if (preview.loadFromData(File.file->readAll()))
-        {
-            pic = preview.scaledToHeight(50);
-        }
-        File.file->seek(0);
+        filePath = File.filePath;
+        Thumbnailer::getInstance().request(File.filePath, QByteArray(), this, "onThumbnailReady");
     }
+    else
+    {
+        // The files of a folder come one by one, the user is asked where the folder goes only once
+        relativePath = QString::fromUtf8(File.fileName);
+        folder = folderOf(relativePath);
+    }
+
+    EventDispatcher::getInstance().addTransfer(this, friendId, fileNum, direction);
+
+    if (folder.isEmpty() || state != tsPending)
+        return;
+    auto it = folderDestinations.find(folderKey());
+    if (it != folderDestinations.end() && QDateTime::currentMSecsSinceEpoch() - it->lastUse < FILE_TRANSFER_FOLDER_TIMEOUT)
+        acceptInto(it->dir);
+    else
+        pendingFolderFiles.insert(this);
+}
+
+FileTransferInstance::FileTransferInstance(int FriendId, int BatchId, QString Name, int FileCount, long long TotalBytes)
+    : lastUpdate{QDateTime::currentDateTime()}, lastBytesSent{0},
+      fileNum{-1}, friendId{FriendId}, batchId{BatchId}, fileCount{FileCount}, filesDone{0},
+      totalBytes{TotalBytes}, direction{ToxFile::SENDING}
+{
+    id = Idconter++;
+    state = tsPending;
+    remotePaused = false;
+    digestMismatch = false;
+
+    filename = tr("%1 (0/%2 files)","Name of a batch of files being sent").arg(Name).arg(fileCount);
+    batchName = Name;
+    size = getHumanReadableSize(TotalBytes);
+    speed = "0B/s";
+    eta = "00:00";
+
+    EventDispatcher::getInstance().addBatch(this, friendId, batchId);
+}
+
+FileTransferInstance::~FileTransferInstance()
+{
+    previewMemory -= pixmapBytes(pic);
+    pendingFolderFiles.remove(this);
+}
+
+QString FileTransferInstance::folderOf(const QString& name)
+{
+    // Nothing may land outside the folder the user picks
+    if (QDir::isAbsolutePath(name) || name.contains('\\') || name.contains(':'))
+        return QString();
+    QStringList parts = name.split('/');
+    if (parts.size() < 2)
+        return QString();
+    for (const QString& part : parts)
+        if (part.isEmpty() || part == "." || part == "..")
+            return QString();
+    return parts.first();
+}
+
+QString FileTransferInstance::folderKey() const
+{
+    return QString::number(friendId) + '/' + folder;
+}
+
+void FileTransferInstance::acceptInto(const QString& dir)
+{
+    pendingFolderFiles.remove(this);
+    folderDestinations[folderKey()] = FolderDestination{dir, QDateTime::currentMSecsSinceEpoch()};
+    savePath = QDir(dir).filePath(relativePath);
+    QDir().mkpath(QFileInfo(savePath).absolutePath());
+
+    QMetaObject::invokeMethod(Core::getInstance(), "acceptFileRecvRequest", Qt::QueuedConnection,
+                              Q_ARG(int, friendId), Q_ARG(int, fileNum), Q_ARG(QString, savePath));
+    state = tsProcessing;
+
+    emit stateUpdated();
+}
+
+void FileTransferInstance::onThumbnailReady(const QImage& thumbnail)
+{
+    previewMemory -= pixmapBytes(pic);
+    pic = QPixmap::fromImage(thumbnail);
+    previewMemory += pixmapBytes(pic);
+    emit stateUpdated();
 }
 
 QString FileTransferInstance::getHumanReadableSize(unsigned long long size)
@@ -63,9 +163,42 @@ void FileTransferInstance::onFileTransferInfo(int FriendId, int FileNum, int64_t
             return;
 
 //    state = tsProcessing;
+    updateSpeed(Filesize, BytesSent);
+}
+
+void FileTransferInstance::onFileBatchInfo(int FriendId, int BatchId, int FilesDone, long long BytesSent)
+{
+    if (BatchId != batchId || FriendId != friendId)
+            return;
+
+    if (state == tsPending)
+        state = tsProcessing;
+    if (FilesDone != filesDone)
+    {
+        filesDone = FilesDone;
+        filename = tr("%1 (%2/%3 files)","Name of a batch of files being sent").arg(batchName).arg(filesDone).arg(fileCount);
+    }
+    updateSpeed(totalBytes, BytesSent);
+}
+
+void FileTransferInstance::onFileBatchFinished(int FriendId, int BatchId, int FilesFailed)
+{
+    if (BatchId != batchId || FriendId != friendId)
+            return;
+    EventDispatcher::getInstance().removeBatch(friendId, batchId);
+    if (state == tsCanceled)
+        return;
+
+    state = FilesFailed ? tsCanceled : tsFinished;
+
+    emit stateUpdated();
+}
+
+void FileTransferInstance::updateSpeed(int64_t Filesize, int64_t BytesSent)
+{
     QDateTime newtime = QDateTime::currentDateTime();
-    int timediff = lastUpdate.secsTo(newtime);
-    if (timediff <= 0)
+    qint64 timediff = lastUpdate.msecsTo(newtime);
+    if (timediff < 1000)
         return;
     qint64 diff = BytesSent - lastBytesSent;
     if (diff < 0)
@@ -73,7 +206,7 @@ void FileTransferInstance::onFileTransferInfo(int FriendId, int FileNum, int64_t
         qWarning() << "FileTransferInstance::onFileTransferInfo: Negative transfer speed !";
         diff = 0;
     }
-    long rawspeed = diff / timediff;
+    long rawspeed = diff * 1000 / timediff;
     speed = getHumanReadableSize(rawspeed)+"/s";
     size = getHumanReadableSize(Filesize);
     if (!rawspeed)
@@ -84,14 +217,15 @@ void FileTransferInstance::onFileTransferInfo(int FriendId, int FileNum, int64_t
     eta = etaTime.toString("mm:ss");
     lastUpdate = newtime;
     lastBytesSent = BytesSent;
-    emit stateUpdated();
+    emit progressUpdated();
 }
 
 void FileTransferInstance::onFileTransferCancelled(int FriendId, int FileNum, ToxFile::FileDirection Direction)
 {
     if (FileNum != fileNum || FriendId != friendId || Direction != direction)
             return;
-    disconnect(Core::getInstance(),0,this,0);
+    EventDispatcher::getInstance().removeTransfer(friendId, fileNum, direction);
+    pendingFolderFiles.remove(this);
     state = tsCanceled;
 
     emit stateUpdated();
@@ -101,23 +235,18 @@ void FileTransferInstance::onFileTransferFinished(ToxFile File)
 {
     if (File.fileNum != fileNum || File.friendId != friendId || File.direction != direction)
             return;
-    disconnect(Core::getInstance(),0,this,0);
+    EventDispatcher::getInstance().removeTransfer(friendId, fileNum, direction);
 
-    if (File.direction == ToxFile::RECEIVING)
+    digest = File.digest.toHex();
+    digestMismatch = File.digestMismatch;
+
+    if (File.direction == ToxFile::RECEIVING && !digestMismatch)
     {
-        QImage preview;
-        QFile previewFile(File.filePath);
-        if (previewFile.open(QIODevice::ReadOnly) && previewFile.size() <= 1024*1024*25) // Don't preview big (>25MiB) images
-        {
-            if (preview.loadFromData(previewFile.readAll()))
-            {
-                pic = preview.scaledToHeight(50);
-            }
-            previewFile.close();
-        }
+        filePath = File.filePath;
+        Thumbnailer::getInstance().request(File.filePath, File.digest, this, "onThumbnailReady");
     }
 
-    state = tsFinished;
+    state = digestMismatch ? tsCanceled : tsFinished;
 
     emit stateUpdated();
 }
@@ -155,14 +284,21 @@ void FileTransferInstance::onFileTransferPaused(int FriendId, int FileNum, ToxFi
 
 void FileTransferInstance::cancelTransfer()
 {
-    Core::getInstance()->cancelFileSend(friendId, fileNum);
+    // Queued, Core only touches its transfers from its own thread
+    if (batchId >= 0)
+        QMetaObject::invokeMethod(Core::getInstance(), "cancelFileBatch", Qt::QueuedConnection,
+                                  Q_ARG(int, friendId), Q_ARG(int, batchId));
+    else
+        QMetaObject::invokeMethod(Core::getInstance(), "cancelFileSend", Qt::QueuedConnection,
+                                  Q_ARG(int, friendId), Q_ARG(int, fileNum));
     state = tsCanceled;
     emit stateUpdated();
 }
 
 void FileTransferInstance::rejectRecvRequest()
 {
-    Core::getInstance()->rejectFileRecvRequest(friendId, fileNum);
+    QMetaObject::invokeMethod(Core::getInstance(), "rejectFileRecvRequest", Qt::QueuedConnection,
+                              Q_ARG(int, friendId), Q_ARG(int, fileNum));
     onFileTransferCancelled(friendId, fileNum, direction);
     state = tsCanceled;
     emit stateUpdated();
@@ -185,6 +321,26 @@ bool isFileWritable(QString& path)
 
 void FileTransferInstance::acceptRecvRequest()
 {
+    if (!folder.isEmpty())
+    {
+        QString dir = QFileDialog::getExistingDirectory(0, tr("Save the folder %1 in","Title of the dialog choosing where a received folder goes").arg(folder),
+                                                        QDir::currentPath());
+        if (dir.isEmpty())
+            return;
+        if (!QFileInfo(dir).isWritable())
+        {
+            QMessageBox::warning(0, tr("Location not writable","Title of permissions popup"), tr("You do not have permission to write that location. Choose another, or cancel the save dialog.", "text of permissions popup"));
+            return;
+        }
+        // The folder's other files that are waiting go there too
+        QString key = folderKey();
+        for (FileTransferInstance* transfer : pendingFolderFiles.toList())
+            if (transfer->folderKey() == key && transfer->state == tsPending)
+                transfer->acceptInto(dir);
+        acceptInto(dir);
+        return;
+    }
+
     QString path;
     while (true)
     {
@@ -205,7 +361,8 @@ void FileTransferInstance::acceptRecvRequest()
 
     savePath = path;
 
-    Core::getInstance()->acceptFileRecvRequest(friendId, fileNum, path);
+    QMetaObject::invokeMethod(Core::getInstance(), "acceptFileRecvRequest", Qt::QueuedConnection,
+                              Q_ARG(int, friendId), Q_ARG(int, fileNum), Q_ARG(QString, path));
     state = tsProcessing;
 
     emit stateUpdated();
@@ -219,7 +376,8 @@ void FileTransferInstance::pauseResumeRecv()
     if (remotePaused)
         return;
 
-    Core::getInstance()->pauseResumeFileRecv(friendId, fileNum);
+    QMetaObject::invokeMethod(Core::getInstance(), "pauseResumeFileRecv", Qt::QueuedConnection,
+                              Q_ARG(int, friendId), Q_ARG(int, fileNum));
 //    if (state == tsProcessing)
 //        state = tsPaused;
 //    else state = tsProcessing;
@@ -235,7 +393,8 @@ void FileTransferInstance::pauseResumeSend()
     if (remotePaused)
         return;
 
-    Core::getInstance()->pauseResumeFileSend(friendId, fileNum);
+    QMetaObject::invokeMethod(Core::getInstance(), "pauseResumeFileSend", Qt::QueuedConnection,
+                              Q_ARG(int, friendId), Q_ARG(int, fileNum));
 //    if (state == tsProcessing)
 //        state = tsPaused;
 //    else state = tsProcessing;
@@ -243,66 +402,27 @@ void FileTransferInstance::pauseResumeSend()
     emit stateUpdated();
 }
 
-QString FileTransferInstance::QImage2base64(const QImage &img)
-{
-    QByteArray ba;
-    QBuffer buffer(&ba);
-    buffer.open(QIODevice::WriteOnly);
-    img.save(&buffer, "PNG"); // writes image into ba in PNG format
-    return ba.toBase64();
-}
-
-QString FileTransferInstance::getHtmlImage()
+void FileTransferInstance::pressButton(int button)
 {
-    qDebug() << "QString FileTransferInstance::getHtmlImage() " << state;
-
-    QString res;
-    if (state == tsPending || state == tsProcessing || state == tsPaused)
-    {
-        QImage leftBtnImg(":/ui/fileTransferInstance/stopFileButton.png");
-        QImage rightBtnImg;
-        if (state == tsProcessing)
-            rightBtnImg = QImage(":/ui/fileTransferInstance/pauseFileButton.png");
-        else if (state == tsPaused)
-            rightBtnImg = QImage(":/ui/fileTransferInstance/resumeFileButton.png");
-        else
-        {
-            if (direction == ToxFile::SENDING)
-                rightBtnImg = QImage(":/ui/fileTransferInstance/pauseGreyFileButton.png");
-            else
-                rightBtnImg = QImage(":/ui/fileTransferInstance/acceptFileButton.png");
-        }
-
-        if (remotePaused)
-            rightBtnImg = QImage(":/ui/fileTransferInstance/pauseGreyFileButton.png");
-
-        res = draw2ButtonsForm("silver", leftBtnImg, rightBtnImg);
-    } else if (state == tsCanceled)
+    // The miniature only exists once we know the file is a picture
+    if (button == PreviewButton && state == tsFinished && !filePath.isEmpty())
     {
-        res = drawButtonlessForm("red");
-    } else if (state == tsFinished)
-    {
-        res = drawButtonlessForm("green");
+        ImageViewer::view(filePath);
+        return;
     }
-
-    return res;
-}
-
-void FileTransferInstance::pressFromHtml(QString code)
-{
     if (state == tsFinished || state == tsCanceled)
         return;
 
     if (direction == ToxFile::SENDING)
     {
-        if (code == "btnA")
+        if (button == CancelButton)
             cancelTransfer();
-        else if (code == "btnB")
+        else if (button == ActionButton && batchId < 0)
             pauseResumeSend();
     } else {
-        if (code == "btnA")
+        if (button == CancelButton)
             rejectRecvRequest();
-        else if (code == "btnB")
+        else if (button == ActionButton)
         {
             if (state == tsPending)
                 acceptRecvRequest();
@@ -312,69 +432,142 @@ void FileTransferInstance::pressFromHtml(QString code)
     }
 }
 
-QString FileTransferInstance::drawButtonlessForm(const QString &type)
+QString FileTransferInstance::getText()
 {
-    QString imgAStr;
-    QString imgBStr;
+    return getLines().join("\n");
+}
 
-    if (type == "red")
+QStringList FileTransferInstance::getLines()
+{
+    QStringList lines;
+    lines << filename;
+    if (isActive())
     {
-        imgAStr = "<img src=\"data:placeholder/png;base64," + QImage2base64(QImage(":/ui/fileTransferInstance/emptyLRedFileButton.png")) + "\">";
-        imgBStr = "<img src=\"data:placeholder/png;base64," + QImage2base64(QImage(":/ui/fileTransferInstance/emptyRRedFileButton.png")) + "\">";
-    } else {
-        imgAStr = "<img src=\"data:placeholder/png;base64," + QImage2base64(QImage(":/ui/fileTransferInstance/emptyLGreenFileButton.png")) + "\">";
-        imgBStr = "<img src=\"data:placeholder/png;base64," + QImage2base64(QImage(":/ui/fileTransferInstance/emptyRGreenFileButton.png")) + "\">";
+        lines << getHumanReadableSize(lastBytesSent) + " / " + size + " (" + speed + " ETA: " + eta + ")";
+    }
+    else
+    {
+        lines << size;
+        if (digestMismatch)
+            lines << tr("Corrupted, the checksums don't match","Shown on a transfer whose SHA-256 differs at both ends");
+        else if (!digest.isEmpty())
+            lines << "SHA-256: " + digest;
     }
+    return lines;
+}
+
+bool FileTransferInstance::isActive()
+{
+    return state == tsPending || state == tsProcessing || state == tsPaused;
+}
 
-    QString content = "<p>" + filename + "</p><p>" + size + "</p>";
+void FileTransferInstance::getButtons(QString& buttonA, QString& buttonB)
+{
+    if (isActive())
+    {
+        buttonA = "stopFileButton";
+        if (state == tsProcessing)
+            buttonB = "pauseFileButton";
+        else if (state == tsPaused)
+            buttonB = "resumeFileButton";
+        else if (direction == ToxFile::SENDING)
+            buttonB = "pauseGreyFileButton";
+        else
+            buttonB = "acceptFileButton";
 
-    return wrapIntoForm(content, type, imgAStr, imgBStr);
+        if (remotePaused || batchId >= 0) // Batches can't be paused
+            buttonB = "pauseGreyFileButton";
+    }
+    else if (state == tsCanceled)
+    {
+        buttonA = "emptyLRedFileButton";
+        buttonB = "emptyRRedFileButton";
+    }
+    else
+    {
+        buttonA = "emptyLGreenFileButton";
+        buttonB = "emptyRGreenFileButton";
+    }
 }
 
-QString FileTransferInstance::insertMiniature(const QString &type)
+QPixmap FileTransferInstance::getButton(const QString& name)
 {
-    if (pic == QImage())
-        return QString();
+    return Style::getPixmap(":/ui/fileTransferInstance/" + name + ".png");
+}
 
-    QString widgetId = QString::number(getId());
+static QFont itemFont(const QFont& font)
+{
+    QFont small(font);
+    small.setPixelSize(10);
+    return small;
+}
 
-    QString res;
-    res  = "<td><div class=" + type + ">\n";
-    res += "<img src=\"data:mini." + widgetId + "/png;base64," + QImage2base64(pic) + "\">";
-    res += "</div></td>\n";
-    return res;
+qreal FileTransferInstance::getHeight(const QFont& font)
+{
+    QFontMetricsF metrics(itemFont(font));
+    qreal text = getLines().size() * metrics.lineSpacing() + 2*FILE_TRANSFER_PADDING;
+    qreal buttons = 2 * getButton("stopFileButton").height();
+    qreal miniature = pic.height() + 2*FILE_TRANSFER_PADDING;
+    return std::max(std::max(text, buttons), miniature);
 }
 
-QString FileTransferInstance::draw2ButtonsForm(const QString &type, const QImage &imgA, const QImage &imgB)
+void FileTransferInstance::draw(QPainter* painter, const QRectF& rect, const QFont& font)
 {
-    QString widgetId = QString::number(getId());
-    QString imgAstr = "<img src=\"data:ftrans." + widgetId + ".btnA/png;base64," + QImage2base64(imgA) + "\">";
-    QString imgBstr = "<img src=\"data:ftrans." + widgetId + ".btnB/png;base64," + QImage2base64(imgB) + "\">";
+    QString buttonA, buttonB;
+    getButtons(buttonA, buttonB);
+    QPixmap pixmapA = getButton(buttonA), pixmapB = getButton(buttonB);
+
+    QColor background(0xd1, 0xd1, 0xd1), text(Qt::black);
+    if (state == tsCanceled)
+        background = QColor(200, 78, 78), text = Qt::white;
+    else if (state == tsFinished)
+        background = QColor(0x6b, 0xc2, 0x60), text = Qt::white;
+
+    QRectF box(rect.left(), rect.top(), rect.width() - pixmapA.width(), rect.height());
+    painter->save();
+    painter->fillRect(box, background);
+
+    qreal left = box.left() + FILE_TRANSFER_PADDING;
+    if (!pic.isNull())
+    {
+        painter->drawPixmap(QPointF(left, box.top() + (box.height() - pic.height()) / 2), pic);
+        left += pic.width() + FILE_TRANSFER_PADDING;
+    }
 
-    QString content;
-    content += "<p>" + filename + "</p>";
-    content += "<p>" + getHumanReadableSize(lastBytesSent) + " / " + size + "&nbsp;(" + speed + " ETA: " + eta + ")</p>\n";
+    QFont small = itemFont(font);
+    QFontMetricsF metrics(small);
+    painter->setFont(small);
+    painter->setPen(text);
+    qreal y = box.top() + FILE_TRANSFER_PADDING + metrics.ascent();
+    for (const QString& line : getLines())
+    {
+        painter->drawText(QPointF(left, y), metrics.elidedText(line, Qt::ElideMiddle, box.right() - FILE_TRANSFER_PADDING - left));
+        y += metrics.lineSpacing();
+    }
 
-    return wrapIntoForm(content, type, imgAstr, imgBstr);
+    QPointF buttons(box.right(), rect.top() + (rect.height() - pixmapA.height() - pixmapB.height()) / 2);
+    painter->drawPixmap(buttons, pixmapA);
+    painter->drawPixmap(buttons + QPointF(0, pixmapA.height()), pixmapB);
+    painter->restore();
 }
 
-QString FileTransferInstance::wrapIntoForm(const QString& content, const QString &type, const QString &imgAstr, const QString &imgBstr)
+FileTransferInstance::Button FileTransferInstance::buttonAt(const QPointF& pos, const QRectF& rect)
 {
-    QString res;
-
-    res =  "<table widht=100% cellspacing=\"0\">\n";
-    res += "<tr valign=middle>\n";
-    res += insertMiniature(type);
-    res += "<td width=100%>\n";
-    res += "<div class=" + type + ">";
-    res += content;
-    res += "</div>\n";
-    res += "</td>\n";
-    res += "<td>\n";
-    res += "<div class=button>" + imgAstr + "<br>" + imgBstr+ "</div>\n";
-    res += "</td>\n";
-    res += "</tr>\n";
-    res += "</table>\n";
+    if (!isActive())
+    {
+        // Where draw puts the miniature
+        QRectF miniature(QPointF(rect.left() + FILE_TRANSFER_PADDING, rect.top() + (rect.height() - pic.height()) / 2), pic.size());
+        if (state == tsFinished && !pic.isNull() && !filePath.isEmpty() && miniature.contains(pos))
+            return PreviewButton;
+        return NoButton;
+    }
 
-    return res;
+    QPixmap pixmap = getButton("stopFileButton");
+    QRectF buttonA(rect.right() - pixmap.width(), rect.top() + rect.height() / 2 - pixmap.height(),
+                   pixmap.width(), pixmap.height());
+    if (buttonA.contains(pos))
+        return CancelButton;
+    if (buttonA.translated(0, pixmap.height()).contains(pos) && !remotePaused && batchId < 0)
+        return ActionButton;
+    return NoButton;
 }
@@ -18,23 +18,37 @@
 
 #include <QObject>
 #include <QDateTime>
-#include <QImage>
+#include <QPixmap>
+#include <QStringList>
+#include <QRectF>
+#include <QHash>
+#include <QSet>
 
 #include "corestructs.h"
 
 struct ToxFile;
+class QPainter;
+class QFont;
 
 class FileTransferInstance : public QObject
 {
     Q_OBJECT
 public:
     enum TransfState {tsPending, tsProcessing, tsPaused, tsFinished, tsCanceled};
+    enum Button {NoButton = -1, CancelButton, ActionButton, PreviewButton}; ///< From the top, the second one accepts, pauses or resumes. The miniature opens the picture once it's complete
 
 public:
     explicit FileTransferInstance(ToxFile File);
-    QString getHtmlImage();
+    FileTransferInstance(int FriendId, int BatchId, QString Name, int FileCount, long long TotalBytes); ///< Aggregate of a ToxFileBatch
+    ~FileTransferInstance();
+    QString getText(); ///< What the item shows, as plain text
+    qreal getHeight(const QFont& font); ///< Of the painted item, only changes with the state
+    void draw(QPainter* painter, const QRectF& rect, const QFont& font);
+    Button buttonAt(const QPointF& pos, const QRectF& rect);
     uint getId(){return id;}
     TransfState getState() {return state;}
+    static qint64 getPreviewMemory() {return previewMemory;} ///< Of every item's pic, GUI thread only
+    static QString getHumanReadableSize(unsigned long long size);
 
 public slots:
     void onFileTransferInfo(int FriendId, int FileNum, int64_t Filesize, int64_t BytesSent, ToxFile::FileDirection Direction);
@@ -43,10 +57,14 @@ public slots:
     void onFileTransferAccepted(ToxFile File);
     void onFileTransferPaused(int FriendId, int FileNum, ToxFile::FileDirection Direction);
     void onFileTransferRemotePausedUnpaused(ToxFile File, bool paused);
-    void pressFromHtml(QString);
+    void onFileBatchInfo(int FriendId, int BatchId, int FilesDone, long long BytesSent);
+    void onFileBatchFinished(int FriendId, int BatchId, int FilesFailed);
+    void pressButton(int button);
+    void onThumbnailReady(const QImage& thumbnail);
 
 signals:
-    void stateUpdated();
+    void stateUpdated(); ///< The item may need a new height
+    void progressUpdated(); ///< Only the numbers changed, a repaint is enough
 
 private slots:
     void cancelTransfer();
@@ -56,26 +74,43 @@ private slots:
     void pauseResumeSend();
 
 private:
-    QString getHumanReadableSize(unsigned long long size);
-    QString QImage2base64(const QImage &img);
-    QString drawButtonlessForm(const QString &type);
-    QString draw2ButtonsForm(const QString &type, const QImage &imgA, const QImage &imgB);
-    QString insertMiniature(const QString &type);
-    QString wrapIntoForm(const QString &content, const QString &type, const QString &imgAstr, const QString &imgBstr);
+    void updateSpeed(int64_t Filesize, int64_t BytesSent);
+    QStringList getLines();
+    bool isActive();
+    void getButtons(QString& buttonA, QString& buttonB);
+    static QPixmap getButton(const QString& name); ///< Decoded once and shared by every item
+    static QString folderOf(const QString& name); ///< Top folder of a safe relative path, empty for a plain name
+    QString folderKey() const;
+    void acceptInto(const QString& dir); ///< Saves at our path relative to dir, making the subfolders
 
 private:
     static uint Idconter;
+    static qint64 previewMemory;
+    struct FolderDestination
+    {
+        QString dir;
+        qint64 lastUse; ///< ms since the epoch, the folder's latest request
+    };
+    static QHash<QString, FolderDestination> folderDestinations; ///< By folderKey, where the user saves a folder
+    static QSet<FileTransferInstance*> pendingFolderFiles; ///< Asked for, waiting for their folder's answer
     uint id;
 
     TransfState state;
     bool remotePaused;
-    QImage pic;
-    QString filename, size, speed, eta;
+    QPixmap pic; ///< Converted once, when Thumbnailer has the preview
+    QString filename, batchName, size, speed, eta;
+    QString digest;
+    bool digestMismatch;
     QDateTime lastUpdate;
     long long lastBytesSent;
     int fileNum;
     int friendId;
+    int batchId;
+    int fileCount, filesDone;
+    long long totalBytes;
     QString savePath;
+    QString filePath; ///< Of the complete file, what the miniature opens
+    QString relativePath, folder; ///< Of a received file the friend sent as part of a folder
     ToxFile::FileDirection direction;
     QString stopFileButtonStylesheet, pauseFileButtonStylesheet, acceptFileButtonStylesheet;
 };
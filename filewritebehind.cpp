@@ -0,0 +1,276 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#include "filewritebehind.h"
+#include "coredefines.h"
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMetaObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QQueue>
+#include <QRunnable>
+#include <QThreadPool>
+
+struct FileWriteBehind::State
+{
+    QMutex mutex;
+    QFile file; ///< Only touched by the I/O thread once opened
+    QQueue<QByteArray> blocks;
+    QList<QByteArray> spare; ///< Written blocks, recycled so we don't allocate per block
+    qint64 filesize;
+    qint64 offset; ///< Where the first block goes
+    qint64 written;
+    bool preallocated;
+    bool busy;
+    bool cancelled;
+    bool discarded; ///< The file is removed once the I/O thread is done with it
+    bool closing; ///< The file is closed once the I/O thread wrote what's queued
+    QObject* closeReceiver; ///< Told when it's closed, cleared by our destructor
+    QByteArray closeMember;
+    quint64 closeTag;
+    bool error;
+    QString errorString;
+    bool hashing;
+    QCryptographicHash hash{QCryptographicHash::Sha256}; ///< Only touched by the I/O thread while busy
+
+    void stop() ///< Under mutex, by the I/O thread
+    {
+        busy = false;
+        if (discarded)
+            file.remove();
+        else if (closing)
+            finishClose();
+    }
+    void finishClose() ///< Under mutex, once the I/O thread is idle
+    {
+        file.close();
+        if (closeReceiver)
+            QMetaObject::invokeMethod(closeReceiver, closeMember.constData(), Qt::QueuedConnection, Q_ARG(quint64, closeTag));
+        closeReceiver = nullptr;
+    }
+};
+
+namespace
+{
+/// A single thread so the writes of every transfer are serialized and stay sequential
+QThreadPool* writeBehindPool()
+{
+    static QThreadPool* pool = []
+    {
+        QThreadPool* pool = new QThreadPool;
+        pool->setMaxThreadCount(1);
+        return pool;
+    }();
+    return pool;
+}
+}
+
+class FileWriteBehind::Task : public QRunnable
+{
+public:
+    explicit Task(const QSharedPointer<State>& SharedState) : d{SharedState} {}
+
+    void run()
+    {
+        if (!d->preallocated)
+        {
+            d->preallocated = true;
+            if (!d->file.resize(d->filesize) || (d->offset && !d->file.seek(d->offset)))
+            {
+                fail(d->file.errorString());
+                return;
+            }
+        }
+
+        forever
+        {
+            QByteArray block;
+            {
+                QMutexLocker locker(&d->mutex);
+                if (d->cancelled || d->blocks.isEmpty())
+                {
+                    d->stop();
+                    return;
+                }
+                block = d->blocks.head();
+            }
+
+            if (d->file.write(block) != block.size())
+            {
+                fail(d->file.errorString());
+                return;
+            }
+            if (d->hashing)
+                d->hash.addData(block);
+
+            QMutexLocker locker(&d->mutex);
+            d->blocks.dequeue();
+            d->written += block.size();
+            block.resize(0); // Keeps the capacity reserved by write
+            d->spare.append(block);
+        }
+    }
+
+private:
+    void fail(const QString& error)
+    {
+        QMutexLocker locker(&d->mutex);
+        d->error = true;
+        d->errorString = error;
+        d->blocks.clear();
+        d->stop();
+    }
+
+private:
+    QSharedPointer<State> d;
+};
+
+FileWriteBehind::FileWriteBehind(const QString& path, qint64 filesize, qint64 offset, bool hash)
+    : d{new State}, opened{false}
+{
+    d->hashing = hash && !offset;
+    d->filesize = filesize;
+    d->offset = offset;
+    d->written = offset;
+    d->preallocated = false;
+    d->busy = false;
+    d->cancelled = false;
+    d->discarded = false;
+    d->closing = false;
+    d->closeReceiver = nullptr;
+    d->closeTag = 0;
+    d->error = false;
+
+    d->file.setFileName(path);
+    opened = d->file.open(offset ? QIODevice::ReadWrite : QIODevice::WriteOnly);
+    if (!opened)
+    {
+        d->error = true;
+        d->errorString = d->file.errorString();
+        return;
+    }
+
+    // Preallocate on the I/O thread right away, growing a large file may take a while
+    d->busy = true;
+    writeBehindPool()->start(new Task(d));
+}
+
+FileWriteBehind::~FileWriteBehind()
+{
+    // The receiver is only posted to under the mutex, so it won't hear from us once this is cleared
+    QMutexLocker locker(&d->mutex);
+    d->closeReceiver = nullptr;
+    if (d->closing)
+        return;
+    d->cancelled = true;
+    d->blocks.clear();
+}
+
+void FileWriteBehind::write(const uint8_t* data, int length)
+{
+    if (pending.isEmpty())
+        pending.reserve(TOX_FILE_WRITE_BLOCK);
+    pending.append(reinterpret_cast<const char*>(data), length);
+    if (pending.size() >= TOX_FILE_WRITE_BLOCK)
+        flush();
+}
+
+void FileWriteBehind::closeAsync(QObject* receiver, const char* member, quint64 tag)
+{
+    flush();
+
+    QMutexLocker locker(&d->mutex);
+    if (d->closing)
+        return;
+    d->closing = true;
+    d->closeReceiver = receiver;
+    d->closeMember = member;
+    d->closeTag = tag;
+    // Otherwise the I/O thread closes it when it runs out of blocks
+    if (!d->busy)
+        d->finishClose();
+}
+
+void FileWriteBehind::discard()
+{
+    pending.clear();
+    QMutexLocker locker(&d->mutex);
+    d->cancelled = true;
+    d->discarded = true;
+    d->blocks.clear();
+    if (!d->busy && opened)
+        d->file.remove();
+}
+
+bool FileWriteBehind::isClosing() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->closing;
+}
+
+bool FileWriteBehind::isBackedUp() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->blocks.size() >= TOX_FILE_WRITE_QUEUE_BLOCKS;
+}
+
+qint64 FileWriteBehind::written() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->written;
+}
+
+QByteArray FileWriteBehind::digest() const
+{
+    QMutexLocker locker(&d->mutex);
+    if (!d->hashing || d->busy || d->error || d->written != d->filesize)
+        return QByteArray();
+    return d->hash.result();
+}
+
+bool FileWriteBehind::hasError() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->error;
+}
+
+QString FileWriteBehind::errorString() const
+{
+    QMutexLocker locker(&d->mutex);
+    return d->errorString;
+}
+
+void FileWriteBehind::flush()
+{
+    if (pending.isEmpty())
+        return;
+
+    QMutexLocker locker(&d->mutex);
+    if (d->error)
+    {
+        pending.clear();
+        return;
+    }
+    d->blocks.enqueue(pending);
+    pending = d->spare.isEmpty() ? QByteArray() : d->spare.takeLast();
+    if (!d->busy)
+    {
+        d->busy = true;
+        writeBehindPool()->start(new Task(d));
+    }
+}
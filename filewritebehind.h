@@ -0,0 +1,63 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+
+#ifndef FILEWRITEBEHIND_H
+#define FILEWRITEBEHIND_H
+
+#include <QString>
+#include <QSharedPointer>
+#include <cstdint>
+
+class QObject;
+
+/// Coalesces the small chunks of an incoming file into TOX_FILE_WRITE_BLOCK sized writes
+/// done on a dedicated I/O thread. The target is preallocated to its full size first.
+/// Write never waits, once TOX_FILE_WRITE_QUEUE_BLOCKS are pending we're backed up and the caller
+/// pauses the sender until we aren't, so a slow disk can't make us buffer the whole file in memory.
+/// With hash set the I/O thread also computes the SHA-256 of the blocks as it writes them.
+/// Nothing here waits for the I/O thread, closing is done by it too.
+class FileWriteBehind
+{
+public:
+    FileWriteBehind(const QString& path, qint64 filesize, qint64 offset = 0, bool hash = false); ///< Keeps the first offset bytes of path when resuming
+    ~FileWriteBehind(); ///< Discards what wasn't written yet unless we're closing, the receiver isn't called then
+
+    bool isOpen() const {return opened;}
+    bool isClosing() const; ///< closeAsync was called
+    void write(const uint8_t* data, int length);
+    /// Writes out everything and closes the file on the I/O thread, then calls the receiver's member(quint64 tag)
+    /// on its thread, if there's a receiver. Check hasError and digest then
+    void closeAsync(QObject* receiver = nullptr, const char* member = nullptr, quint64 tag = 0);
+    void discard(); ///< Drops what wasn't written and removes the file once the I/O thread lets go of it
+    bool isBackedUp() const; ///< The I/O thread is TOX_FILE_WRITE_QUEUE_BLOCKS behind
+    qint64 written() const; ///< How much of the file is on disk, including the resumed part
+    QByteArray digest() const; ///< SHA-256 of what we wrote once closed, empty if we don't hash or resumed
+    bool hasError() const;
+    QString errorString() const;
+
+private:
+    void flush();
+
+private:
+    struct State;
+    class Task;
+    QSharedPointer<State> d;
+    QByteArray pending;
+    bool opened;
+};
+
+#endif // FILEWRITEBEHIND_H
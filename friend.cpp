@@ -16,14 +16,15 @@
 
 #include "friend.h"
 #include "friendlist.h"
-#include "widget/friendwidget.h"
 #include "widget/form/chatform.h"
+#include <QDebug>
+#include <algorithm>
 
 Friend::Friend(int FriendId, QString UserId)
-    : friendId(FriendId), userId(UserId)
+    : friendId(FriendId), userId(UserId), name(UserId)
 {
-    widget = new FriendWidget(friendId, userId);
-    chatForm = new ChatForm(this);
+    chatForm = nullptr;
+    chatFormUsed = 0;
     hasNewEvents = 0;
     friendStatus = Status::Offline;
 }
@@ -31,24 +32,69 @@ Friend::Friend(int FriendId, QString UserId)
 Friend::~Friend()
 {
     delete chatForm;
-    delete widget;
 }
 
 void Friend::setName(QString name)
 {
-    widget->name.setText(name);
-    widget->name.setToolTip(name); // for overlength names
-    chatForm->setName(name);
+    this->name = name;
+    if (chatForm)
+        chatForm->setName(name);
 }
 
 void Friend::setStatusMessage(QString message)
 {
-    widget->statusMessage.setText(message);
-    widget->statusMessage.setToolTip(message); // for overlength messsages
-    chatForm->setStatusMessage(message);
+    statusMessage = message;
+    if (chatForm)
+        chatForm->setStatusMessage(message);
 }
 
 QString Friend::getName()
 {
-    return widget->name.text();
+    return name;
+}
+
+ChatForm* Friend::getChatForm()
+{
+    chatFormUsed = QDateTime::currentMSecsSinceEpoch();
+    if (chatForm)
+        return chatForm;
+
+    releaseIdleChatForms();
+    chatForm = new ChatForm(this);
+    if (chatSince.isValid())
+        chatForm->restoreHistory(chatSince);
+    return chatForm;
+}
+
+bool Friend::releaseChatForm()
+{
+    if (!chatForm || !chatForm->isIdle())
+        return false;
+
+    chatSince = chatForm->getFirstMessageTime();
+    delete chatForm;
+    chatForm = nullptr;
+    return true;
+}
+
+void Friend::releaseIdleChatForms()
+{
+    QList<Friend*> cached;
+    for (Friend* f : FriendList::friendList)
+        if (f->chatForm)
+            cached << f;
+    if (cached.size() < MAX_CACHED_CHAT_FORMS)
+        return;
+
+    std::sort(cached.begin(), cached.end(), [](Friend* a, Friend* b){return a->chatFormUsed < b->chatFormUsed;});
+    int excess = cached.size() - MAX_CACHED_CHAT_FORMS + 1;
+    for (Friend* f : cached)
+    {
+        if (excess == 0)
+            break;
+        if (f->releaseChatForm())
+            excess--;
+    }
+    if (excess)
+        qDebug() << "Friend::releaseIdleChatForms: Keeping" << excess << "busy chat forms over the limit";
 }
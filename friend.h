@@ -18,9 +18,12 @@
 #define FRIEND_H
 
 #include <QString>
+#include <QDateTime>
 #include "corestructs.h"
 
-struct FriendWidget;
+// Chat forms kept alive at once before the least recently used idle ones are released
+#define MAX_CACHED_CHAT_FORMS 16
+
 class ChatForm;
 
 struct Friend
@@ -31,12 +34,20 @@ public:
     void setName(QString name);
     void setStatusMessage(QString message);
     QString getName();
+    ChatForm* getChatForm(); ///< Creates it the first time, or again after it was released
+    bool releaseChatForm(); ///< Frees the form if nothing would be lost, false if it's busy
+
+private:
+    static void releaseIdleChatForms(); ///< Keeps at most MAX_CACHED_CHAT_FORMS alive
 
 public:
-    FriendWidget* widget;
     int friendId;
     QString userId;
-    ChatForm* chatForm;
+    QString name, statusMessage;
+    QDateTime lastSeen;
+    ChatForm* chatForm; ///< Null until the chat is used, see getChatForm
+    qint64 chatFormUsed; ///< Last getChatForm, for picking which forms to release
+    QDateTime chatSince; ///< What a released form had shown, restored from the history
     int hasNewEvents;
     Status friendStatus;
 };
@@ -20,33 +20,32 @@
 #include <QDebug>
 
 QList<Friend*> FriendList::friendList;
+QHash<int, Friend*> FriendList::friendIndex;
 
 Friend* FriendList::addFriend(int friendId, const QString& userId)
 {
-    for (Friend* f : friendList)
-        if (f->friendId == friendId)
-            qWarning() << "FriendList::addFriend: friendId already taken";
+    if (friendIndex.contains(friendId))
+        qWarning() << "FriendList::addFriend: friendId already taken";
     Friend* newfriend = new Friend(friendId, userId);
     friendList.append(newfriend);
+    friendIndex.insert(friendId, newfriend);
     return newfriend;
 }
 
 Friend* FriendList::findFriend(int friendId)
 {
-    for (Friend* f : friendList)
-        if (f->friendId == friendId)
-            return f;
-    return nullptr;
+    return friendIndex.value(friendId, nullptr);
 }
 
 void FriendList::removeFriend(int friendId)
 {
-    for (int i=0; i<friendList.size(); i++)
-    {
-        if (friendList[i]->friendId == friendId)
-        {
-            friendList.removeAt(i);
-            return;
-        }
-    }
+    Friend* f = friendIndex.take(friendId);
+    if (f)
+        friendList.removeOne(f);
+}
+
+void FriendList::clear()
+{
+    friendList.clear();
+    friendIndex.clear();
 }
@@ -17,10 +17,13 @@
 #ifndef FRIENDLIST_H
 #define FRIENDLIST_H
 
-template <class T> class QList;
+#include <QList>
+#include <QHash>
+
 struct Friend;
 class QString;
 
+/// friendList keeps the order friends were added in, lookups go through a hash by friend number
 class FriendList
 {
 public:
@@ -28,9 +31,13 @@ public:
     static Friend* addFriend(int friendId, const QString& userId);
     static Friend* findFriend(int friendId);
     static void removeFriend(int friendId);
+    static void clear(); ///< Forgets every friend, doesn't delete them
 
 public:
     static QList<Friend*> friendList;
+
+private:
+    static QHash<int, Friend*> friendIndex;
 };
 
 #endif // FRIENDLIST_H
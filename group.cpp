@@ -15,23 +15,14 @@
 */
 
 #include "group.h"
-#include "widget/groupwidget.h"
+#include "grouppeermodel.h"
 #include "widget/form/groupchatform.h"
-#include "friendlist.h"
-#include "friend.h"
-#include "core.h"
-#include <QDebug>
-#include <QTimer>
 
 Group::Group(int GroupId, QString Name)
-    : groupId(GroupId), nPeers{0}, hasPeerInfo{false}, peerInfoTimer{new QTimer}
+    : groupId(GroupId), name(Name)
 {
-    widget = new GroupWidget(groupId, Name);
+    peers = new GroupPeerModel(this);
     chatForm = new GroupChatForm(this);
-    connect(peerInfoTimer, SIGNAL(timeout()), this, SLOT(queryPeerInfo()));
-    peerInfoTimer->setInterval(500);
-    peerInfoTimer->setSingleShot(false);
-    //peerInfoTimer.start();
 
     //in groupchats, we only notify on messages containing your name
     hasNewMessages = 0;
@@ -41,80 +32,21 @@ Group::Group(int GroupId, QString Name)
 Group::~Group()
 {
     delete chatForm;
-    delete widget;
-    delete peerInfoTimer;
-}
-
-void Group::queryPeerInfo()
-{
-    const Core* core = Core::getInstance();
-    int nPeersResult = core->getGroupNumberPeers(groupId);
-    if (nPeersResult == -1)
-    {
-        qDebug() << "Group::queryPeerInfo: Can't get number of peers";
-        return;
-    }
-    nPeers = nPeersResult;
-    widget->onUserListChanged();
-    chatForm->onUserListChanged();
-
-    if (nPeersResult == 0)
-        return;
-
-    bool namesOk = true;
-    QList<QString> names = core->getGroupPeerNames(groupId);
-    if (names.isEmpty())
-    {
-        qDebug() << "Group::queryPeerInfo: Can't get names of peers";
-        return;
-    }
-    for (int i=0; i<names.size(); i++)
-    {
-        QString name = names[i];
-        if (name.isEmpty())
-        {
-            name = "<Unknown>";
-            namesOk = false;
-        }
-        peers[i] = name;
-    }
-    nPeers = names.size();
-
-    widget->onUserListChanged();
-    chatForm->onUserListChanged();
-
-    if (namesOk)
-    {
-        qDebug() << "Group::queryPeerInfo: Successfully loaded names";
-        hasPeerInfo = true;
-        peerInfoTimer->stop();
-    }
 }
 
 void Group::addPeer(int peerId, QString name)
 {
-    if (peers.contains(peerId))
-        qWarning() << "Group::addPeer: peerId already used, overwriting anyway";
-    if (name.isEmpty())
-        peers[peerId] = "<Unknown>";
-    else
-        peers[peerId] = name;
-    nPeers++;
-    widget->onUserListChanged();
-    chatForm->onUserListChanged();
+    peers->addPeer(peerId, name.isEmpty() ? "<Unknown>" : name);
+    emit userListChanged(groupId);
 }
 
 void Group::removePeer(int peerId)
 {
-    peers.remove(peerId);
-    nPeers--;
-    widget->onUserListChanged();
-    chatForm->onUserListChanged();
+    peers->removePeer(peerId);
+    emit userListChanged(groupId);
 }
 
 void Group::updatePeer(int peerId, QString name)
 {
-    peers[peerId] = name;
-    widget->onUserListChanged();
-    chatForm->onUserListChanged();
+    peers->renamePeer(peerId, name);
 }
@@ -17,15 +17,11 @@
 #ifndef GROUP_H
 #define GROUP_H
 
-#include <QMap>
 #include <QObject>
 
-#define RETRY_PEER_INFO_INTERVAL 500
-
 struct Friend;
-class GroupWidget;
 class GroupChatForm;
-class QTimer;
+class GroupPeerModel;
 
 class Group : public QObject
 {
@@ -37,17 +33,14 @@ public:
     void removePeer(int peerId);
     void updatePeer(int peerId, QString newName);
 
-private slots:
-    void queryPeerInfo();
+signals:
+    void userListChanged(int groupId); ///< Peers joined or left, not for renames
 
 public:
     int groupId;
-    QMap<int,QString> peers;
-    int nPeers;
-    GroupWidget* widget;
+    QString name;
+    GroupPeerModel* peers;
     GroupChatForm* chatForm;
-    bool hasPeerInfo;
-    QTimer* peerInfoTimer;
     int hasNewMessages, userWasMentioned;
 };
 
@@ -16,32 +16,35 @@
 
 #include "grouplist.h"
 #include "group.h"
+#include <QDebug>
 
 QList<Group*> GroupList::groupList;
+QHash<int, Group*> GroupList::groupIndex;
 
 Group* GroupList::addGroup(int groupId, const QString& name)
 {
+    if (groupIndex.contains(groupId))
+        qWarning() << "GroupList::addGroup: groupId already taken";
     Group* newGroup = new Group(groupId, name);
     groupList.append(newGroup);
+    groupIndex.insert(groupId, newGroup);
     return newGroup;
 }
 
 Group* GroupList::findGroup(int groupId)
 {
-    for (Group* g : groupList)
-        if (g->groupId == groupId)
-            return g;
-    return nullptr;
+    return groupIndex.value(groupId, nullptr);
 }
 
 void GroupList::removeGroup(int groupId)
 {
-    for (int i=0; i<groupList.size(); i++)
-    {
-        if (groupList[i]->groupId == groupId)
-        {
-            groupList.removeAt(i);
-            return;
-        }
-    }
+    Group* g = groupIndex.take(groupId);
+    if (g)
+        groupList.removeOne(g);
+}
+
+void GroupList::clear()
+{
+    groupList.clear();
+    groupIndex.clear();
 }
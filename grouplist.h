@@ -17,11 +17,13 @@
 #ifndef GROUPLIST_H
 #define GROUPLIST_H
 
-template <typename T>
-class QList;
+#include <QList>
+#include <QHash>
+
 class Group;
 class QString;
 
+/// groupList keeps the order groups were added in, lookups go through a hash by group number
 class GroupList
 {
 public:
@@ -29,9 +31,13 @@ public:
     static Group* addGroup(int groupId, const QString& name);
     static Group* findGroup(int groupId);
     static void removeGroup(int groupId);
+    static void clear(); ///< Forgets every group, doesn't delete them
 
 public:
     static QList<Group*> groupList;
+
+private:
+    static QHash<int, Group*> groupIndex;
 };
 
 #endif // GROUPLIST_H
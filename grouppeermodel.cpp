@@ -0,0 +1,106 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "grouppeermodel.h"
+#include <QDebug>
+
+GroupPeerModel::GroupPeerModel(QObject *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+int GroupPeerModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return names.size();
+}
+
+QVariant GroupPeerModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= names.size())
+        return QVariant();
+    if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+        return names[index.row()];
+    return QVariant();
+}
+
+int GroupPeerModel::count() const
+{
+    return names.size();
+}
+
+bool GroupPeerModel::contains(int peerId) const
+{
+    return peerId >= 0 && peerId < names.size();
+}
+
+QString GroupPeerModel::getName(int peerId) const
+{
+    return contains(peerId) ? names[peerId] : QString();
+}
+
+void GroupPeerModel::addPeer(int peerId, const QString& name)
+{
+    if (contains(peerId))
+    {
+        qWarning() << "GroupPeerModel::addPeer: peerId already used, overwriting anyway";
+        renamePeer(peerId, name);
+        return;
+    }
+
+    // toxcore numbers peers densely, new ones come at the end
+    if (peerId != names.size())
+        qWarning() << "GroupPeerModel::addPeer: Unexpected peerId" << peerId << "with" << names.size() << "peers";
+    int row = names.size();
+    beginInsertRows(QModelIndex(), row, row);
+    names.append(name);
+    endInsertRows();
+}
+
+void GroupPeerModel::removePeer(int peerId)
+{
+    if (!contains(peerId))
+        return;
+
+    // toxcore moves its last peer into the freed number
+    int last = names.size() - 1;
+    if (peerId != last)
+    {
+        names[peerId] = names[last];
+        emit dataChanged(index(peerId), index(peerId));
+    }
+    beginRemoveRows(QModelIndex(), last, last);
+    names.removeLast();
+    endRemoveRows();
+}
+
+void GroupPeerModel::renamePeer(int peerId, const QString& name)
+{
+    if (!contains(peerId))
+        return;
+
+    names[peerId] = name;
+    emit dataChanged(index(peerId), index(peerId));
+}
+
+qint64 GroupPeerModel::getMemoryUsage() const
+{
+    qint64 bytes = names.capacity() * sizeof(QString);
+    for (const QString& name : names)
+        bytes += name.capacity() * sizeof(QChar);
+    return bytes;
+}
@@ -0,0 +1,47 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef GROUPPEERMODEL_H
+#define GROUPPEERMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QString>
+
+/// A group's peers, one row per peer number, changed one delta at a time by onGroupNamelistChange
+class GroupPeerModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit GroupPeerModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    int count() const;
+    bool contains(int peerId) const;
+    QString getName(int peerId) const; ///< Empty if there's no such peer
+    qint64 getMemoryUsage() const; ///< Rough bytes of the names
+
+    void addPeer(int peerId, const QString& name);
+    void removePeer(int peerId);
+    void renamePeer(int peerId, const QString& name);
+
+private:
+    QVector<QString> names; ///< By peer number
+};
+
+#endif // GROUPPEERMODEL_H
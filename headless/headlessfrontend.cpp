@@ -0,0 +1,395 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "headlessfrontend.h"
+#include "core.h"
+#include "coreeventqueue.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <algorithm>
+
+void ScriptReader::run()
+{
+    QTextStream in(input);
+    while (!in.atEnd())
+    {
+        QString line = in.readLine().trimmed();
+        if (!line.isEmpty() && !line.startsWith('#'))
+            emit lineRead(line);
+    }
+}
+
+HeadlessFrontend::HeadlessFrontend(Core* Target, const Options& Opts)
+    : core{Target}, coreEvents{&Target->getEventQueue()}, options(Opts), out{stdout},
+      scriptFinished{false}, waitCount{0},
+      messagesReceived{0}, messagesDelivered{0}, videoFrames{0}
+{
+    waitTimer = new QTimer(this);
+    waitTimer->setSingleShot(true);
+    connect(waitTimer, &QTimer::timeout, this, &HeadlessFrontend::onWaitTimeout);
+    clock.start();
+    sleepTimer = new QTimer(this);
+    sleepTimer->setSingleShot(true);
+    connect(sleepTimer, &QTimer::timeout, this, &HeadlessFrontend::runCommands);
+
+    // Before Core's thread starts, like EventDispatcher::connectCore
+    coreEvents->setReceiver(this, "onCoreEventsReady");
+    connect(core, &Core::connected, this, [this]{event("connected");});
+    connect(core, &Core::disconnected, this, [this]{event("disconnected");});
+    connect(core, &Core::failedToStart, this, [this]{event("failed-to-start"); emit quit(2);});
+    connect(core, &Core::friendAddressGenerated, this, &HeadlessFrontend::onFriendAddressGenerated);
+    connect(core, &Core::friendRequestReceived, this, &HeadlessFrontend::onFriendRequestReceived);
+    connect(core, &Core::friendAdded, this, &HeadlessFrontend::onFriendAdded);
+    connect(core, &Core::friendListLoaded, this, &HeadlessFrontend::onFriendListLoaded);
+    connect(core, &Core::friendPresenceChanged, this, &HeadlessFrontend::onFriendPresenceChanged);
+    connect(core, &Core::actionReceived, this, &HeadlessFrontend::onActionReceived);
+    connect(core, &Core::messageSentResult, this, &HeadlessFrontend::onMessageSentResult);
+    connect(core, &Core::messageDelivered, this, &HeadlessFrontend::onMessageDelivered);
+    connect(core, &Core::fileSendStarted, this, &HeadlessFrontend::onFileSendStarted);
+    connect(core, &Core::fileReceiveRequested, this, &HeadlessFrontend::onFileReceiveRequested);
+    connect(core, &Core::fileTransferFinished, this, &HeadlessFrontend::onFileTransferFinished);
+    connect(core, &Core::fileTransferCancelled, this, &HeadlessFrontend::onFileTransferCancelled);
+    connect(core, &Core::fileTransferStats, this, &HeadlessFrontend::onFileTransferStats);
+    connect(core, &Core::avInvite, this, &HeadlessFrontend::onAvInvite);
+    connect(core, &Core::avStart, this, &HeadlessFrontend::onAvStart);
+    connect(core, &Core::avEnd, this, &HeadlessFrontend::onAvEnd);
+    connect(core, &Core::avCancel, this, &HeadlessFrontend::onAvEnd);
+    connect(core, &Core::avPeerTimeout, this, &HeadlessFrontend::onAvEnd);
+    connect(core, &Core::videoFrameReceived, this, &HeadlessFrontend::onVideoFrameReceived);
+}
+
+void HeadlessFrontend::run(QIODevice* script)
+{
+    ScriptReader* reader = new ScriptReader(script);
+    reader->setObjectName("Script");
+    connect(reader, &ScriptReader::lineRead, this, &HeadlessFrontend::onLineRead);
+    connect(reader, &QThread::finished, this, &HeadlessFrontend::onScriptFinished);
+    connect(reader, &QThread::finished, reader, &QObject::deleteLater);
+    reader->start();
+}
+
+void HeadlessFrontend::onLineRead(const QString& line)
+{
+    commands << line;
+    runCommands();
+}
+
+void HeadlessFrontend::onScriptFinished()
+{
+    scriptFinished = true;
+    runCommands();
+}
+
+void HeadlessFrontend::runCommands()
+{
+    while (!commands.isEmpty() && waitingFor.isEmpty() && !sleepTimer->isActive())
+        runCommand(commands.takeFirst());
+
+    if (commands.isEmpty() && scriptFinished && waitingFor.isEmpty() && !sleepTimer->isActive())
+    {
+        event("counters", {"received=" + QString::number(messagesReceived),
+                           "delivered=" + QString::number(messagesDelivered),
+                           "frames=" + QString::number(videoFrames)});
+        scriptFinished = false; // Once
+        emit scriptDone();
+    }
+}
+
+bool HeadlessFrontend::runCommand(const QString& line)
+{
+    QString command = line.section(' ', 0, 0, QString::SectionSkipEmpty);
+    QString rest = line.section(' ', 1, -1, QString::SectionSkipEmpty);
+    QStringList args = rest.split(' ', QString::SkipEmptyParts);
+    int friendId = args.value(0).toInt();
+    QString text = rest.section(' ', 1, -1, QString::SectionSkipEmpty); // After the first argument
+
+    if (command == "id")
+    {
+        event("self", {selfAddress});
+    }
+    else if (command == "name" && !rest.isEmpty())
+    {
+        QMetaObject::invokeMethod(core, "setUsername", Qt::QueuedConnection, Q_ARG(QString, rest));
+    }
+    else if (command == "status" && args.size() == 1)
+    {
+        Status status = rest == "away" ? Status::Away : rest == "busy" ? Status::Busy : Status::Online;
+        QMetaObject::invokeMethod(core, "setStatus", Qt::QueuedConnection, Q_ARG(Status, status));
+    }
+    else if (command == "add" && !args.isEmpty())
+    {
+        QMetaObject::invokeMethod(core, "requestFriendship", Qt::QueuedConnection,
+                                  Q_ARG(QString, args[0]), Q_ARG(QString, text.isEmpty() ? QString("qtox-headless") : text));
+    }
+    else if (command == "accept" && args.size() == 1)
+    {
+        QMetaObject::invokeMethod(core, "acceptFriendRequest", Qt::QueuedConnection, Q_ARG(QString, args[0]));
+    }
+    else if (command == "remove" && args.size() == 1)
+    {
+        QMetaObject::invokeMethod(core, "removeFriend", Qt::QueuedConnection, Q_ARG(int, friendId));
+    }
+    else if ((command == "msg" || command == "action") && !text.isEmpty())
+    {
+        QMetaObject::invokeMethod(core, command == "msg" ? "sendMessage" : "sendAction", Qt::QueuedConnection,
+                                  Q_ARG(int, friendId), Q_ARG(QString, text));
+    }
+    else if (command == "bulk" && args.size() >= 3)
+    {
+        int count = args[1].toInt();
+        QString message = rest.section(' ', 2, -1, QString::SectionSkipEmpty);
+        for (int i=0; i<count; i++)
+            QMetaObject::invokeMethod(core, "sendMessage", Qt::QueuedConnection,
+                                      Q_ARG(int, friendId), Q_ARG(QString, message + " " + QString::number(i)));
+    }
+    else if (command == "file" && !text.isEmpty())
+    {
+        QFileInfo info(text);
+        if (!info.isFile())
+        {
+            event("error", {"no such file", text});
+            return true;
+        }
+        QMetaObject::invokeMethod(core, "sendFile", Qt::QueuedConnection, Q_ARG(int32_t, friendId),
+                                  Q_ARG(QString, info.fileName()), Q_ARG(QString, info.absoluteFilePath()),
+                                  Q_ARG(long long, info.size()));
+    }
+    else if (command == "call" && !args.isEmpty())
+    {
+        QMetaObject::invokeMethod(core, "startCall", Qt::QueuedConnection,
+                                  Q_ARG(int, friendId), Q_ARG(bool, args.value(1) == "video"));
+    }
+    else if ((command == "answer" || command == "hangup") && args.size() == 1)
+    {
+        QMetaObject::invokeMethod(core, command == "answer" ? "answerCall" : "hangupCall", Qt::QueuedConnection,
+                                  Q_ARG(int, args[0].toInt()));
+    }
+    else if (command == "stats")
+    {
+        QMetaObject::invokeMethod(core, "requestFileTransferStats", Qt::QueuedConnection);
+    }
+    else if (command == "callstats" && args.size() == 1)
+    {
+        QString report = core->getCallStatsReport(args[0].toInt());
+        if (report.isEmpty())
+            event("error", {"no such call", args[0]});
+        for (const QString& line : report.split('\n', QString::SkipEmptyParts))
+            event("call-stats", {args[0], escape(line)});
+    }
+    else if (command == "impair")
+    {
+        bool ok;
+        NetImpairment::Profile::parse(rest, &ok);
+        if (!ok)
+        {
+            event("error", {"bad impairment", escape(rest)});
+            return true;
+        }
+        QMetaObject::invokeMethod(core, "setNetImpairment", Qt::QueuedConnection, Q_ARG(QString, rest));
+    }
+    else if (command == "sleep" && args.size() == 1)
+    {
+        sleepTimer->start(args[0].toInt());
+        return false;
+    }
+    else if (command == "wait" && !args.isEmpty())
+    {
+        int count = std::max(args.value(1, "1").toInt(), 1);
+        if (seen.value(args[0]) >= count)
+        {
+            seen.clear();
+            return true;
+        }
+        waitingFor = args[0];
+        waitCount = count;
+        waitTimer->start(args.size() > 2 ? args[2].toInt() : HEADLESS_WAIT_TIMEOUT);
+        return false;
+    }
+    else if (command == "quit")
+    {
+        emit quit(args.value(0).toInt());
+        commands.clear();
+        return false;
+    }
+    else
+    {
+        event("error", {"bad command", escape(line)});
+    }
+    return true;
+}
+
+void HeadlessFrontend::onWaitTimeout()
+{
+    event("timeout", {waitingFor});
+    commands.clear();
+    emit quit(1);
+}
+
+void HeadlessFrontend::event(const QString& name, const QStringList& args)
+{
+    if (!options.name.isEmpty())
+        out << options.name << ' ';
+    out << name;
+    for (const QString& arg : args)
+        out << ' ' << arg;
+    out << endl;
+
+    int count = ++seen[name];
+    if (!waitingFor.isEmpty() && name == waitingFor && count >= waitCount)
+    {
+        waitingFor.clear();
+        seen.clear();
+        waitTimer->stop();
+        // Not from inside whatever printed the event
+        QMetaObject::invokeMethod(this, "runCommands", Qt::QueuedConnection);
+    }
+}
+
+QString HeadlessFrontend::escape(QString text)
+{
+    return text.replace('\\', "\\\\").replace('\n', "\\n").replace('\r', "\\r");
+}
+
+void HeadlessFrontend::onCoreEventsReady()
+{
+    // Nothing to render, drain right away
+    coreEvents->drain([this](CoreEvent&& coreEvent)
+    {
+        if (coreEvent.type != CoreEvent::FriendMessage)
+            return;
+        messagesReceived++;
+        event("message", {QString::number(coreEvent.friendId), escape(coreEvent.text)});
+    });
+}
+
+void HeadlessFrontend::onFriendAddressGenerated(const QString& address)
+{
+    selfAddress = address;
+    event("self", {address});
+}
+
+void HeadlessFrontend::onFriendRequestReceived(const QString& userId, const QString& message)
+{
+    event("friend-request", {userId, escape(message)});
+    if (options.acceptFriends)
+        QMetaObject::invokeMethod(core, "acceptFriendRequest", Qt::QueuedConnection, Q_ARG(QString, userId));
+}
+
+void HeadlessFrontend::onFriendAdded(int friendId, const QString& userId)
+{
+    event("friend-added", {QString::number(friendId), userId});
+}
+
+void HeadlessFrontend::onFriendListLoaded(const QList<FriendInfo>& friends)
+{
+    for (const FriendInfo& info : friends)
+        event("friend", {QString::number(info.friendId), info.userId, escape(info.name)});
+}
+
+void HeadlessFrontend::onFriendPresenceChanged(const QList<FriendPresence>& updates)
+{
+    static const char* names[] = {"online", "away", "busy", "offline"};
+    for (const FriendPresence& presence : updates)
+        if (presence.hasStatus)
+            event("presence", {QString::number(presence.friendId), names[static_cast<int>(presence.status)]});
+}
+
+void HeadlessFrontend::onActionReceived(int friendId, const QString& action)
+{
+    event("action", {QString::number(friendId), escape(action)});
+}
+
+void HeadlessFrontend::onMessageSentResult(int friendId, const QString&, int messageId)
+{
+    event(messageId ? "sent" : "send-failed", {QString::number(friendId), QString::number(messageId)});
+}
+
+void HeadlessFrontend::onMessageDelivered(int friendId, int messageId)
+{
+    messagesDelivered++;
+    event("delivered", {QString::number(friendId), QString::number(messageId)});
+}
+
+QString HeadlessFrontend::transferKey(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    return QString("%1-%2-%3").arg(friendId).arg(fileNum).arg(direction == ToxFile::SENDING ? "send" : "recv");
+}
+
+void HeadlessFrontend::onFileSendStarted(ToxFile file)
+{
+    transferStarts[transferKey(file.friendId, file.fileNum, file.direction)] = clock.elapsed();
+}
+
+void HeadlessFrontend::onFileReceiveRequested(ToxFile file)
+{
+    transferStarts[transferKey(file.friendId, file.fileNum, file.direction)] = clock.elapsed();
+    event("file-request", {QString::number(file.friendId), QString::number(file.fileNum),
+                           QString::number(file.filesize), escape(QString::fromUtf8(file.fileName))});
+    if (options.acceptFilesDir.isEmpty() || file.status == ToxFile::TRANSMITTING)
+        return;
+
+    // Numbered, a soak test sends the same file over and over
+    QString path = QDir(options.acceptFilesDir).filePath(QString("%1-%2-%3").arg(file.friendId).arg(file.fileNum)
+                                                         .arg(QFileInfo(QString::fromUtf8(file.fileName)).fileName()));
+    QMetaObject::invokeMethod(core, "acceptFileRecvRequest", Qt::QueuedConnection,
+                              Q_ARG(int, file.friendId), Q_ARG(int, file.fileNum), Q_ARG(QString, path));
+}
+
+void HeadlessFrontend::onFileTransferFinished(ToxFile file)
+{
+    qint64 elapsed = std::max<qint64>(clock.elapsed() - transferStarts.take(transferKey(file.friendId, file.fileNum, file.direction)), 1);
+    event("file-done", {QString::number(file.friendId), QString::number(file.fileNum),
+                        file.direction == ToxFile::SENDING ? "send" : "recv",
+                        file.digestMismatch ? "corrupted" : "ok",
+                        "kbps=" + QString::number(file.filesize * 8 / elapsed), "ms=" + QString::number(elapsed)});
+}
+
+void HeadlessFrontend::onFileTransferCancelled(int friendId, int fileNum, ToxFile::FileDirection direction)
+{
+    transferStarts.remove(transferKey(friendId, fileNum, direction));
+    event("file-cancelled", {QString::number(friendId), QString::number(fileNum),
+                             direction == ToxFile::SENDING ? "send" : "recv"});
+}
+
+void HeadlessFrontend::onFileTransferStats(const QByteArray& json)
+{
+    event("file-stats", {QString::fromUtf8(json).simplified()});
+}
+
+void HeadlessFrontend::onAvInvite(int friendId, int callId, bool video)
+{
+    event("call-invite", {QString::number(friendId), QString::number(callId), video ? "video" : "audio"});
+    if (options.answerCalls)
+        QMetaObject::invokeMethod(core, "answerCall", Qt::QueuedConnection, Q_ARG(int, callId));
+}
+
+void HeadlessFrontend::onAvStart(int friendId, int callId, bool video)
+{
+    event("call-start", {QString::number(friendId), QString::number(callId), video ? "video" : "audio"});
+}
+
+void HeadlessFrontend::onAvEnd(int friendId, int callId)
+{
+    event("call-end", {QString::number(friendId), QString::number(callId)});
+}
+
+void HeadlessFrontend::onVideoFrameReceived(int, int callId, const VideoFrame&)
+{
+    // Nothing shows it, but Core waits for the ack before it hands us the next one
+    videoFrames++;
+    core->videoFrameDisplayed(callId);
+}
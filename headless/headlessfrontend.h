@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef HEADLESSFRONTEND_H
+#define HEADLESSFRONTEND_H
+
+#include <QObject>
+#include <QHash>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QElapsedTimer>
+#include "corestructs.h"
+#include "videoframe.h"
+
+class Core;
+class CoreEventQueue;
+class QTimer;
+class QIODevice;
+
+#define HEADLESS_WAIT_TIMEOUT 60*1000
+
+/// Reads the script on its own thread, so a blocking stdin never holds up the event loop
+class ScriptReader : public QThread
+{
+    Q_OBJECT
+public:
+    explicit ScriptReader(QIODevice* Input) : input{Input} {}
+
+signals:
+    void lineRead(const QString& line);
+
+protected:
+    void run() override;
+
+private:
+    QIODevice* input;
+};
+
+/// Drives Core without a window, for soak tests and benchmarks.
+/// Commands come one per line from the script, what Core reports goes to stdout as one event per line
+/// with the event's name first. Commands run in order, sleep and wait hold up the ones after them:
+///   id | name <name> | status online|away|busy
+///   add <address> [message] | accept <userId> | remove <friend>
+///   msg <friend> <text> | action <friend> <text> | bulk <friend> <count> <text>
+///   file <friend> <path> | call <friend> [video] | answer <call> | hangup <call>
+///   stats | callstats <call> | impair [loss=% delay=ms jitter=ms reorder=% kbps=n seed=n] | sleep <ms>
+///   wait <event> [count] [timeout ms] | quit [code]
+/// A wait counts the events since the previous one ended, so an event that came first isn't missed.
+/// impair puts a NetImpairment between toxav and this profile's Core, without arguments the network is good again.
+/// With the same seeds and the same script a scenario impairs the same frames every run. callstats prints the
+/// call's jitter buffer, frame drops, impairment and, with --probe-audio, its mouth to ear latency.
+/// file-done reports the throughput of the transfer since it was offered.
+/// A wait that times out quits with code 1. The end of the script is scriptDone once its commands ran.
+/// When the process hosts several profiles, each has its own frontend and its events are prefixed by its name.
+class HeadlessFrontend : public QObject
+{
+    Q_OBJECT
+public:
+    struct Options
+    {
+        bool acceptFriends; ///< Accept every friend request
+        bool answerCalls; ///< Answer every call
+        QString acceptFilesDir; ///< Accept every file into it, unless empty
+        QString name; ///< Printed before each event, unless empty
+    };
+
+    HeadlessFrontend(Core* core, const Options& options);
+    void run(QIODevice* script);
+
+signals:
+    void scriptDone(); ///< Every command ran
+    void quit(int code); ///< A quit command, a wait that timed out or Core failing to start
+
+private slots:
+    void onLineRead(const QString& line);
+    void onScriptFinished();
+    void runCommands(); ///< Until one of them has to wait
+    void onWaitTimeout();
+
+    void onCoreEventsReady();
+    void onFriendAddressGenerated(const QString& address);
+    void onFriendRequestReceived(const QString& userId, const QString& message);
+    void onFriendAdded(int friendId, const QString& userId);
+    void onFriendListLoaded(const QList<FriendInfo>& friends);
+    void onFriendPresenceChanged(const QList<FriendPresence>& updates);
+    void onActionReceived(int friendId, const QString& action);
+    void onMessageSentResult(int friendId, const QString& message, int messageId);
+    void onMessageDelivered(int friendId, int messageId);
+    void onFileSendStarted(ToxFile file);
+    void onFileReceiveRequested(ToxFile file);
+    void onFileTransferFinished(ToxFile file);
+    void onFileTransferCancelled(int friendId, int fileNum, ToxFile::FileDirection direction);
+    void onFileTransferStats(const QByteArray& json);
+    void onAvInvite(int friendId, int callId, bool video);
+    void onAvStart(int friendId, int callId, bool video);
+    void onAvEnd(int friendId, int callId);
+    void onVideoFrameReceived(int friendId, int callId, const VideoFrame& frame);
+
+private:
+    bool runCommand(const QString& line); ///< False if the commands after it have to wait
+    void event(const QString& name, const QStringList& args = QStringList()); ///< Prints it and ends a wait for it
+    static QString escape(QString text); ///< One line per event, whatever the text
+    static QString transferKey(int friendId, int fileNum, ToxFile::FileDirection direction);
+
+private:
+    Core* core;
+    CoreEventQueue* coreEvents;
+    Options options;
+    QTextStream out;
+    QStringList commands; ///< Read but not run yet
+    bool scriptFinished;
+    QString waitingFor; ///< The event a wait command waits for, empty if we don't wait
+    int waitCount;
+    QHash<QString, int> seen; ///< Events since the last wait ended, by name
+    QString selfAddress;
+    QTimer *waitTimer, *sleepTimer;
+    long long messagesReceived, messagesDelivered, videoFrames;
+    QElapsedTimer clock;
+    QHash<QString, qint64> transferStarts; ///< By transferKey, when it was offered
+};
+
+#endif // HEADLESSFRONTEND_H
@@ -0,0 +1,153 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "headlessfrontend.h"
+#include "core.h"
+#include "settings.h"
+#include "widget/camera.h"
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QThread>
+#include <QDebug>
+
+// qtox-headless [--config <dir>] [--script <file>] [--profile <dir> [--script <file>]]...
+//               [--accept-friends] [--accept-files <dir>] [--answer-calls] [--probe-audio]
+// Runs Core without a window, see HeadlessFrontend for the commands it reads from the script or stdin.
+// Each --profile runs one more tox profile from its own directory on its own Core thread, with the
+// --script that follows it. Without any, the profile of the settings dir runs.
+// With --probe-audio every call sends the LatencyProbe's clicks instead of the microphone, so the
+// profiles of one process can measure their mouth to ear latency through each other.
+int main(int argc, char *argv[])
+{
+    // Several instances on one machine each need their own settings, before anything reads them
+    for (int i=1; i+1<argc; i++)
+        if (qstrcmp(argv[i], "--config") == 0)
+            qputenv("XDG_CONFIG_HOME", argv[i+1]);
+
+    QCoreApplication a(argc, argv);
+    a.setApplicationName("qTox");
+    a.setOrganizationName("Tox");
+    QStringList args = a.arguments();
+
+    HeadlessFrontend::Options options;
+    options.acceptFriends = args.contains("--accept-friends");
+    options.answerCalls = args.contains("--answer-calls");
+    int filesArg = args.indexOf("--accept-files");
+    if (filesArg >= 0 && filesArg+1 < args.size())
+        options.acceptFilesDir = args[filesArg+1];
+
+    struct Profile
+    {
+        QString dir; ///< Empty for the settings dir
+        QString script; ///< Empty for stdin
+        QFile* input;
+        QThread* thread;
+        Core* core;
+        HeadlessFrontend* frontend;
+    };
+    QList<Profile> profiles;
+    for (int i=1; i+1<args.size(); i++)
+    {
+        if (args[i] == "--profile")
+            profiles.append(Profile{args[++i], QString(), nullptr, nullptr, nullptr, nullptr});
+        else if (args[i] == "--script" && profiles.isEmpty())
+            profiles.append(Profile{QString(), args[++i], nullptr, nullptr, nullptr, nullptr});
+        else if (args[i] == "--script")
+            profiles.last().script = args[++i];
+    }
+    if (profiles.isEmpty())
+        profiles.append(Profile{QString(), QString(), nullptr, nullptr, nullptr, nullptr});
+
+    bool stdinTaken = false;
+    for (Profile& profile : profiles)
+    {
+        profile.input = new QFile;
+        if (!profile.script.isEmpty())
+        {
+            profile.input->setFileName(profile.script);
+            if (!profile.input->open(QIODevice::ReadOnly | QIODevice::Text))
+            {
+                qCritical() << "qtox-headless: Can't open the script" << profile.script;
+                return 2;
+            }
+        }
+        else if (stdinTaken)
+        {
+            qCritical() << "qtox-headless: Only one profile can read stdin, give the others a --script";
+            return 2;
+        }
+        else if (!profile.input->open(stdin, QIODevice::ReadOnly | QIODevice::Text))
+        {
+            qCritical() << "qtox-headless: Can't read stdin";
+            return 2;
+        }
+        else
+        {
+            stdinTaken = true;
+        }
+    }
+
+    Settings::getInstance();
+    Core::registerMetaTypes();
+    LatencyProbe::setEnabled(args.contains("--probe-audio"));
+
+    // Only opened if a video call subscribes to it, shared by every profile
+    Camera* camera = new Camera;
+    int running = profiles.size();
+    for (Profile& profile : profiles)
+    {
+        profile.thread = new QThread;
+        profile.thread->setObjectName("Core");
+        profile.core = new Core(camera, profile.thread, profile.dir);
+        profile.core->moveToThread(profile.thread);
+        QObject::connect(profile.thread, &QThread::started, profile.core, &Core::start);
+
+        if (profiles.size() > 1)
+            options.name = QDir(profile.dir).dirName();
+        profile.frontend = new HeadlessFrontend(profile.core, options);
+        // The process ends once every script ran, or at the first quit
+        QObject::connect(profile.frontend, &HeadlessFrontend::scriptDone, [&running]{if (!--running) QCoreApplication::exit(0);});
+        QObject::connect(profile.frontend, &HeadlessFrontend::quit, [](int code){QCoreApplication::exit(code);});
+    }
+    for (Profile& profile : profiles)
+    {
+        profile.thread->start();
+        profile.frontend->run(profile.input);
+    }
+
+    int errorcode = a.exec();
+
+    // Same order as Widget's destructor
+    for (Profile& profile : profiles)
+    {
+        profile.thread->exit();
+        profile.thread->wait(500);
+        if (!profile.thread->isFinished())
+            profile.thread->terminate();
+        delete profile.frontend;
+        delete profile.core; // Saves the profile and waits for it to be written
+    }
+    Settings::getInstance().save();
+    for (Profile& profile : profiles)
+    {
+        delete profile.thread;
+        delete profile.input;
+    }
+    delete camera;
+
+    return errorcode;
+}
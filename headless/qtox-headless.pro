@@ -0,0 +1,103 @@
+#    Copyright (C) 2014 by Project Tox <https://tox.im>
+#
+#    This file is part of qTox, a Qt-based graphical interface for Tox.
+#
+#    This program is libre software: you can redistribute it and/or modify
+#    it under the terms of the GNU General Public License as published by
+#    the Free Software Foundation, either version 3 of the License, or
+#    (at your option) any later version.
+#    This program is distributed in the hope that it will be useful,
+#    but WITHOUT ANY WARRANTY; without even the implied warranty of
+#    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+#
+#    See the COPYING file for more details.
+
+# Core without the window, for soak tests and benchmarks on machines without a display.
+# QtGui is only there for QImage and the screen capture, which finds no screen and sends nothing
+
+QT       += core gui network xml
+QT       -= widgets
+
+TARGET    = qtox-headless
+TEMPLATE  = app
+CONFIG   += c++11 console
+CONFIG   -= app_bundle
+
+ROOT = $$PWD/..
+INCLUDEPATH += $$ROOT $$ROOT/libs/include
+
+win32 {
+    LIBS += -L$$ROOT/libs/lib -lopencv_core249 -lopencv_highgui249 -lopencv_imgproc249 -lOpenAL32
+    LIBS += $$ROOT/libs/lib/libtoxav.a $$ROOT/libs/lib/libopus.a $$ROOT/libs/lib/libvpx.a $$ROOT/libs/lib/libtoxcore.a -lws2_32 $$ROOT/libs/lib/libsodium.a -lpthread -liphlpapi
+} else {
+    macx {
+        LIBS += -L$$ROOT/libs/lib/ -ltoxcore -ltoxav -lsodium -lvpx -framework OpenAL -lopencv_core -lopencv_highgui
+    } else {
+        LIBS += -L$$ROOT/libs/lib/ -ltoxcore -ltoxav -lsodium -lvpx -lopenal -lopencv_core -lopencv_highgui
+    }
+}
+
+HEADERS += headlessfrontend.h \
+    $$ROOT/core.h \
+    $$ROOT/coreav.h \
+    $$ROOT/coredefines.h \
+    $$ROOT/corestructs.h \
+    $$ROOT/coreeventqueue.h \
+    $$ROOT/coreprofiler.h \
+    $$ROOT/cdata.h \
+    $$ROOT/cstring.h \
+    $$ROOT/settings.h \
+    $$ROOT/smileypack.h \
+    $$ROOT/profilesaver.h \
+    $$ROOT/startuptrace.h \
+    $$ROOT/filereadahead.h \
+    $$ROOT/filewritebehind.h \
+    $$ROOT/filecheckpoints.h \
+    $$ROOT/videoframe.h \
+    $$ROOT/videosource.h \
+    $$ROOT/videoratecontroller.h \
+    $$ROOT/audioratecontroller.h \
+    $$ROOT/voicedetector.h \
+    $$ROOT/netimpairment.h \
+    $$ROOT/latencyprobe.h \
+    $$ROOT/audiothread.h \
+    $$ROOT/audiomixer.h \
+    $$ROOT/audiostats.h \
+    $$ROOT/jitterbuffer.h \
+    $$ROOT/soundbank.h \
+    $$ROOT/widget/camera.h \
+    $$ROOT/widget/screencapture.h \
+    $$ROOT/widget/videoconvert.h \
+    $$ROOT/widget/videoconverter.h
+
+SOURCES += main.cpp \
+    headlessfrontend.cpp \
+    $$ROOT/core.cpp \
+    $$ROOT/coreav.cpp \
+    $$ROOT/corestructs.cpp \
+    $$ROOT/coreeventqueue.cpp \
+    $$ROOT/coreprofiler.cpp \
+    $$ROOT/cdata.cpp \
+    $$ROOT/cstring.cpp \
+    $$ROOT/settings.cpp \
+    $$ROOT/smileypack.cpp \
+    $$ROOT/profilesaver.cpp \
+    $$ROOT/startuptrace.cpp \
+    $$ROOT/filereadahead.cpp \
+    $$ROOT/filewritebehind.cpp \
+    $$ROOT/filecheckpoints.cpp \
+    $$ROOT/videoframe.cpp \
+    $$ROOT/videoratecontroller.cpp \
+    $$ROOT/audioratecontroller.cpp \
+    $$ROOT/voicedetector.cpp \
+    $$ROOT/netimpairment.cpp \
+    $$ROOT/latencyprobe.cpp \
+    $$ROOT/audiothread.cpp \
+    $$ROOT/audiomixer.cpp \
+    $$ROOT/audiostats.cpp \
+    $$ROOT/jitterbuffer.cpp \
+    $$ROOT/soundbank.cpp \
+    $$ROOT/widget/camera.cpp \
+    $$ROOT/widget/screencapture.cpp \
+    $$ROOT/widget/videoconvert.cpp \
+    $$ROOT/widget/videoconverter.cpp
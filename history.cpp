@@ -0,0 +1,621 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "history.h"
+#include "historyindex.h"
+#include "settings.h"
+#include "corestructs.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QTimer>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QRegExp>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <sodium.h>
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Magic, version and flags at the start of every segment
+static const int segmentHeaderSize = 8;
+static const quint16 segmentVersion = 1;
+static const quint16 segmentEncrypted = 1;
+// Time, segment and offset of a record
+static const int indexEntrySize = 16;
+
+static bool syncFile(QFile& file)
+{
+    if (!file.flush())
+        return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+History& History::getInstance()
+{
+    static History* history = new History;
+    return *history;
+}
+
+History::History()
+{
+    qRegisterMetaType<History::Message>("History::Message");
+    qRegisterMetaType<History::Messages>("History::Messages");
+    qRegisterMetaType<History::Hits>("History::Hits");
+    sodium_init();
+    QDir().mkpath(QDir(Settings::getSettingsDirPath()).filePath("history"));
+    loadKey();
+
+    syncTimer = new QTimer(this);
+    syncTimer->setSingleShot(true);
+    syncTimer->setInterval(HISTORY_SYNC_INTERVAL);
+    connect(syncTimer, &QTimer::timeout, this, &History::syncFiles);
+
+    thread.setObjectName("qTox History");
+    moveToThread(&thread);
+    thread.start(QThread::LowPriority);
+}
+
+QString History::friendChat(const QString& userId)
+{
+    // The nospam can change, the key can't
+    return "friend-" + userId.left(TOX_ID_PUBLIC_KEY_LENGTH).toUpper();
+}
+
+QString History::groupChat(const QString& groupName)
+{
+    // Toxcore gives groups no id that outlives them, and the default name is just the group's number.
+    // Logging by it would put unrelated groups in the same log
+    if (groupName.isEmpty() || QRegExp("Groupchat #\\d+").exactMatch(groupName))
+        return QString();
+    return "group-" + QCryptographicHash::hash(groupName.toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+QString History::chatPath(const QString& chat) const
+{
+    return QDir(Settings::getSettingsDirPath()).filePath("history/" + chat);
+}
+
+QString History::segmentName(int number)
+{
+    // Padded, so that sorting the names sorts the segments
+    return QString("%1.seg").arg(number, 8, 10, QChar('0'));
+}
+
+int History::lastSegment(const QString& path)
+{
+    QStringList segments = QDir(path).entryList(QStringList() << "*.seg", QDir::Files, QDir::Name);
+    if (segments.isEmpty())
+        return -1;
+    return segments.last().section('.', 0, 0).toInt();
+}
+
+QStringList History::getChats() const
+{
+    return QDir(QDir(Settings::getSettingsDirPath()).filePath("history")).entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+}
+
+QMap<int, qint64> History::getSegmentSizes(const QString& chat) const
+{
+    QMap<int, qint64> sizes;
+    QDir dir(chatPath(chat));
+    for (const QFileInfo& info : dir.entryInfoList(QStringList() << "*.seg", QDir::Files, QDir::Name))
+        sizes.insert(info.fileName().section('.', 0, 0).toInt(), info.size());
+    return sizes;
+}
+
+void History::loadKey()
+{
+    QFile file(QDir(Settings::getSettingsDirPath()).filePath("history/key"));
+    if (file.open(QIODevice::ReadOnly))
+    {
+        key = file.readAll();
+        if (key.size() == crypto_secretbox_KEYBYTES)
+            return;
+        qWarning() << "History: The key file is damaged, encrypted logs can't be read";
+        key.clear();
+        return;
+    }
+
+    // Guarded like the profile next to it, before there's anything in it to read
+    QByteArray newKey(crypto_secretbox_KEYBYTES, 0);
+    randombytes_buf(newKey.data(), newKey.size());
+    if (!file.open(QIODevice::WriteOnly) || !file.setPermissions(QFile::ReadOwner | QFile::WriteOwner)
+            || file.write(newKey) != newKey.size() || !syncFile(file))
+    {
+        qWarning() << "History: Can't save a key, logs won't be encrypted";
+        if (file.isOpen())
+            file.remove();
+        return;
+    }
+    key = newKey;
+}
+
+QByteArray History::seal(const QByteArray& plain)
+{
+    QByteArray sealed(crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES + plain.size(), 0);
+    unsigned char* nonce = (unsigned char*)sealed.data();
+    randombytes_buf(nonce, crypto_secretbox_NONCEBYTES);
+    crypto_secretbox_easy(nonce + crypto_secretbox_NONCEBYTES, (const unsigned char*)plain.constData(), plain.size(),
+                          nonce, (const unsigned char*)key.constData());
+    return sealed;
+}
+
+bool History::unseal(const QByteArray& sealed, QByteArray& plain)
+{
+    int overhead = crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES;
+    if (key.isEmpty() || sealed.size() < overhead)
+        return false;
+    plain.resize(sealed.size() - overhead);
+    const unsigned char* nonce = (const unsigned char*)sealed.constData();
+    return crypto_secretbox_open_easy((unsigned char*)plain.data(), nonce + crypto_secretbox_NONCEBYTES,
+                                      sealed.size() - crypto_secretbox_NONCEBYTES, nonce,
+                                      (const unsigned char*)key.constData()) == 0;
+}
+
+void History::append(const QString& chat, const QString& author, const QString& message, const QDateTime& time)
+{
+    Settings& s = Settings::getInstance();
+    if (!s.getEnableLogging())
+        return;
+
+    Pending entry{chat, author, message, time, s.getEncryptLogs() && !key.isEmpty()};
+    QMutexLocker lock(&pendingMutex);
+    pending.append(entry);
+    if (pending.size() == 1)
+        QMetaObject::invokeMethod(this, "writePending", Qt::QueuedConnection);
+}
+
+History::Chat* History::openChat(const QString& chat, bool encrypted)
+{
+    Chat*& c = chats[chat];
+    if (c)
+        return c;
+
+    QString path = chatPath(chat);
+    QDir().mkpath(path);
+    c = new Chat;
+    c->index.setFileName(QDir(path).filePath("index"));
+    if (!c->index.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "History: Can't open the index of" << chat;
+        delete c;
+        chats.remove(chat);
+        return nullptr;
+    }
+    c->index.resize(c->index.size() / indexEntrySize * indexEntrySize);
+    c->index.seek(c->index.size());
+
+    int number = lastSegment(path);
+    if (number < 0 || !startSegment(c, number, encrypted))
+    {
+        if (!startSegment(c, number + 1, encrypted))
+        {
+            delete c;
+            chats.remove(chat);
+            return nullptr;
+        }
+    }
+    return c;
+}
+
+bool History::startSegment(Chat* c, int number, bool encrypted)
+{
+    if (c->segment.isOpen())
+    {
+        syncFile(c->segment);
+        c->segment.close();
+    }
+
+    c->segmentNumber = number;
+    c->segment.setFileName(QDir(QFileInfo(c->index).path()).filePath(segmentName(number)));
+    if (!c->segment.open(QIODevice::ReadWrite))
+    {
+        qWarning() << "History: Can't open" << c->segment.fileName();
+        return false;
+    }
+
+    if (c->segment.size() >= segmentHeaderSize)
+    {
+        // An existing segment, we keep appending to it if it suits us
+        QDataStream stream(&c->segment);
+        quint32 magic;
+        quint16 version, flags;
+        stream >> magic >> version >> flags;
+        c->encrypted = flags & segmentEncrypted;
+        if (magic != HISTORY_SEGMENT_MAGIC || version != segmentVersion
+                || c->encrypted != encrypted || c->segment.size() >= HISTORY_SEGMENT_SIZE)
+        {
+            c->segment.close();
+            return false;
+        }
+        recoverTail(c);
+        return true;
+    }
+
+    c->segment.resize(0);
+    QDataStream stream(&c->segment);
+    stream << (quint32)HISTORY_SEGMENT_MAGIC << segmentVersion << (quint16)(encrypted ? segmentEncrypted : 0);
+    c->encrypted = encrypted;
+    c->lastIndexed = -1;
+    return stream.status() == QDataStream::Ok;
+}
+
+void History::recoverTail(Chat* c)
+{
+    // The last index entry tells where to start, so this reads a stride at most
+    c->lastIndexed = -1;
+    qint64 entries = c->index.size() / indexEntrySize;
+    if (entries)
+    {
+        c->index.seek((entries - 1) * indexEntrySize);
+        QDataStream stream(&c->index);
+        qint64 time;
+        qint32 segment, offset;
+        stream >> time >> segment >> offset;
+        if (segment == c->segmentNumber)
+            c->lastIndexed = offset;
+    }
+
+    qint64 size = c->segment.size();
+    qint64 offset = c->lastIndexed >= 0 ? c->lastIndexed : segmentHeaderSize;
+    while (offset + 4 <= size)
+    {
+        c->segment.seek(offset);
+        uchar length[4];
+        if (c->segment.read((char*)length, 4) != 4)
+            break;
+        qint64 next = offset + 4 + qFromBigEndian<quint32>(length);
+        if (next > size)
+            break;
+        offset = next;
+    }
+    if (offset != size)
+    {
+        qWarning() << "History: Cutting" << size - offset << "bytes of a half written record from" << c->segment.fileName();
+        c->segment.resize(offset);
+    }
+    c->segment.seek(offset);
+    c->index.seek(c->index.size());
+}
+
+void History::writePending()
+{
+    QList<Pending> batch;
+    {
+        QMutexLocker lock(&pendingMutex);
+        batch.swap(pending);
+    }
+
+    for (const Pending& p : batch)
+    {
+        Chat* c = openChat(p.chat, p.encrypted);
+        if (!c)
+            continue;
+        HistoryIndex* index = indexFor(p.chat); // Before the write, in case it reads the whole log
+        if ((c->encrypted != p.encrypted || c->segment.pos() >= HISTORY_SEGMENT_SIZE)
+                && !startSegment(c, c->segmentNumber + 1, p.encrypted))
+            continue;
+
+        QByteArray payload;
+        qint64 time = p.time.toMSecsSinceEpoch();
+        {
+            QDataStream stream(&payload, QIODevice::WriteOnly);
+            stream << time << p.author << p.message;
+        }
+        if (c->encrypted)
+            payload = seal(payload);
+
+        QByteArray record(4, 0);
+        qToBigEndian<quint32>(payload.size(), (uchar*)record.data());
+        record += payload;
+        qint64 offset = c->segment.pos();
+        if (c->segment.write(record) != record.size())
+        {
+            qWarning() << "History: Can't write to" << c->segment.fileName();
+            continue;
+        }
+
+        if (c->lastIndexed < 0 || offset - c->lastIndexed >= HISTORY_INDEX_STRIDE)
+        {
+            QDataStream stream(&c->index);
+            stream << time << (qint32)c->segmentNumber << (qint32)offset;
+            c->lastIndexed = offset;
+        }
+        unsynced.insert(c);
+
+        index->add(p.message, c->segmentNumber, offset, c->encrypted);
+        unflushed.insert(index);
+    }
+
+    // One block of postings per batch
+    for (HistoryIndex* index : unflushed)
+        index->flush();
+    unflushed.clear();
+
+    if (!unsynced.isEmpty() && !syncTimer->isActive())
+        syncTimer->start();
+}
+
+void History::syncFiles()
+{
+    for (Chat* c : unsynced)
+        if (!syncFile(c->segment) || !syncFile(c->index))
+            qWarning() << "History: Can't sync" << c->segment.fileName();
+    unsynced.clear();
+}
+
+void History::sync()
+{
+    if (!thread.isRunning())
+        return;
+    if (QThread::currentThread() == &thread)
+    {
+        writePending();
+        syncFiles();
+        return;
+    }
+    QMetaObject::invokeMethod(this, "writePending", Qt::BlockingQueuedConnection);
+    QMetaObject::invokeMethod(this, "syncFiles", Qt::BlockingQueuedConnection);
+}
+
+void History::shutdown()
+{
+    if (!thread.isRunning())
+        return;
+    sync();
+    thread.quit();
+    thread.wait();
+}
+
+bool History::read(const QString& chat, const QDateTime& from, std::function<bool(const Message&)> visit)
+{
+    QDir dir(chatPath(chat));
+    if (!dir.exists())
+        return false;
+
+    // The sparse index gets us close to the first record we want
+    int firstSegment = 0;
+    qint64 firstOffset = 0;
+    qint64 fromTime = from.isValid() ? from.toMSecsSinceEpoch() : 0;
+    QFile indexFile(dir.filePath("index"));
+    if (from.isValid() && indexFile.open(QIODevice::ReadOnly))
+    {
+        QByteArray index = indexFile.readAll();
+        const uchar* entries = (const uchar*)index.constData();
+        int low = 0, high = index.size() / indexEntrySize;
+        while (low < high)
+        {
+            int mid = (low + high) / 2;
+            if (qFromBigEndian<qint64>(entries + mid*indexEntrySize) <= fromTime)
+                low = mid + 1;
+            else
+                high = mid;
+        }
+        if (low > 0)
+        {
+            const uchar* entry = entries + (low - 1) * indexEntrySize;
+            firstSegment = qFromBigEndian<qint32>(entry + 8);
+            firstOffset = qFromBigEndian<qint32>(entry + 12);
+        }
+    }
+    return readFrom(chat, firstSegment, firstOffset, fromTime, visit);
+}
+
+bool History::decodeRecord(const QByteArray& payload, Message& message)
+{
+    QDataStream stream(payload);
+    qint64 time;
+    stream >> time >> message.author >> message.message;
+    message.time = QDateTime::fromMSecsSinceEpoch(time);
+    return stream.status() == QDataStream::Ok;
+}
+
+bool History::readFrom(const QString& chat, int firstSegment, qint64 firstOffset, qint64 fromTime,
+                       std::function<bool(const Message&)> visit)
+{
+    QDir dir(chatPath(chat));
+    bool warned = false;
+    for (const QString& name : dir.entryList(QStringList() << "*.seg", QDir::Files, QDir::Name))
+    {
+        int number = name.section('.', 0, 0).toInt();
+        if (number < firstSegment)
+            continue;
+
+        QFile segment(dir.filePath(name));
+        if (!segment.open(QIODevice::ReadOnly))
+            continue;
+        QDataStream header(&segment);
+        quint32 magic;
+        quint16 version, flags;
+        header >> magic >> version >> flags;
+        if (magic != HISTORY_SEGMENT_MAGIC || version != segmentVersion)
+        {
+            qWarning() << "History: Skipping" << segment.fileName() << ", not a segment";
+            continue;
+        }
+        if (number == firstSegment && firstOffset > 0)
+            segment.seek(firstOffset);
+
+        forever
+        {
+            qint64 offset = segment.pos();
+            uchar length[4];
+            if (segment.read((char*)length, 4) != 4)
+                break;
+            quint32 size = qFromBigEndian<quint32>(length);
+            if (size > HISTORY_SEGMENT_SIZE)
+                break;
+            QByteArray payload = segment.read(size);
+            if ((quint32)payload.size() != size)
+                break; // Still being written
+
+            if (flags & segmentEncrypted)
+            {
+                QByteArray plain;
+                if (!unseal(payload, plain))
+                {
+                    if (!warned)
+                        qWarning() << "History: Can't decrypt records of" << chat;
+                    warned = true;
+                    continue;
+                }
+                payload = plain;
+            }
+
+            Message message;
+            if (!decodeRecord(payload, message) || message.time.toMSecsSinceEpoch() < fromTime)
+                continue;
+            message.segment = number;
+            message.offset = offset;
+            message.encrypted = flags & segmentEncrypted;
+            if (!visit(message))
+                return true;
+        }
+    }
+    return true;
+}
+
+bool History::readAt(const QString& chat, int segment, qint64 offset, Message& message)
+{
+    bool found = false;
+    readFrom(chat, segment, offset, 0, [&](const Message& m)
+    {
+        found = m.segment == segment && m.offset == offset;
+        message = m;
+        return false;
+    });
+    return found;
+}
+
+QList<QPair<int, qint64>> History::readIndex(const QString& chat)
+{
+    QList<QPair<int, qint64>> positions;
+    QFile file(QDir(chatPath(chat)).filePath("index"));
+    if (!file.open(QIODevice::ReadOnly))
+        return positions;
+    QByteArray index = file.readAll();
+    const uchar* entries = (const uchar*)index.constData();
+    for (int i=0; i < index.size() / indexEntrySize; i++)
+        positions.append(qMakePair((int)qFromBigEndian<qint32>(entries + i*indexEntrySize + 8),
+                                   (qint64)qFromBigEndian<qint32>(entries + i*indexEntrySize + 12)));
+    return positions;
+}
+
+QList<History::Message> History::readAround(const QString& chat, const Message& message, int before, int after)
+{
+    // Start a couple of index entries before the message, each is a stride of records
+    QPair<int, qint64> target(message.segment, message.offset), start(0, 0);
+    QList<QPair<int, qint64>> positions = readIndex(chat);
+    int entry = std::upper_bound(positions.begin(), positions.end(), target) - positions.begin() - 1;
+    int stride = 1;
+    QList<Message> context;
+    forever
+    {
+        start = entry - stride >= 0 ? positions[entry - stride] : qMakePair(0, (qint64)0);
+        context.clear();
+        int remaining = after;
+        bool passed = false;
+        readFrom(chat, start.first, start.second, 0, [&](const Message& m)
+        {
+            QPair<int, qint64> position(m.segment, m.offset);
+            if (!passed)
+            {
+                context.append(m);
+                if (context.size() > before + 1)
+                    context.removeFirst();
+                passed = position >= target;
+                return !passed || remaining > 0;
+            }
+            context.append(m);
+            return --remaining > 0;
+        });
+        // Go further back if the stride didn't have enough before the message
+        if (context.size() >= before + 1 || entry - stride < 0)
+            break;
+        stride *= 2;
+    }
+    return context;
+}
+
+HistoryIndex* History::indexFor(const QString& chat)
+{
+    HistoryIndex*& index = indexes[chat];
+    if (index)
+        return index;
+
+    index = new HistoryIndex(QDir(chatPath(chat)).filePath("terms"));
+    if (!index->exists())
+    {
+        // Logged before we kept an index
+        readFrom(chat, 0, 0, 0, [&](const Message& m)
+        {
+            index->add(m.message, m.segment, m.offset, m.encrypted);
+            return true;
+        });
+        index->flush();
+    }
+    return index;
+}
+
+void History::readContext(const QString& chat, const Message& message, int before, int after)
+{
+    QMetaObject::invokeMethod(this, "runReadContext", Qt::QueuedConnection, Q_ARG(QString, chat),
+                              Q_ARG(History::Message, message), Q_ARG(int, before), Q_ARG(int, after));
+}
+
+void History::runReadContext(QString chat, History::Message message, int before, int after)
+{
+    emit contextRead(chat, message, readAround(chat, message, before, after));
+}
+
+void History::search(const QString& query, const QString& chat)
+{
+    QMetaObject::invokeMethod(this, "runSearch", Qt::QueuedConnection, Q_ARG(QString, query), Q_ARG(QString, chat));
+}
+
+void History::runSearch(QString query, QString chat)
+{
+    // Anything still pending goes in the index first
+    writePending();
+
+    Hits hits;
+    QStringList searched = chat.isEmpty() ? getChats() : QStringList(chat);
+    for (const QString& c : searched)
+    {
+        if (!QDir(chatPath(c)).exists())
+            continue;
+        QVector<HistoryIndex::Posting> postings = indexFor(c)->find(query);
+        QList<Message>& found = hits[c];
+        for (int i = std::max(postings.size() - HISTORY_SEARCH_LIMIT, 0); i < postings.size(); i++)
+        {
+            Message message;
+            if (readAt(c, postings[i].segment, postings[i].offset, message))
+                found.append(message);
+        }
+        if (found.isEmpty())
+            hits.remove(c);
+    }
+    emit searchFinished(query, hits);
+}
@@ -0,0 +1,145 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <QObject>
+#include <QDateTime>
+#include <QStringList>
+#include <QMutex>
+#include <QThread>
+#include <QHash>
+#include <QSet>
+#include <QFile>
+#include <QMap>
+#include <QMetaType>
+#include <functional>
+
+// Segments are rolled over past this size, and when the encryption setting changes
+#define HISTORY_SEGMENT_SIZE 4*1024*1024
+// Bytes of records between two entries of the sparse time index
+#define HISTORY_INDEX_STRIDE 64*1024
+// How long appended records may wait before being synced to disk, in ms
+#define HISTORY_SYNC_INTERVAL 2*1000
+#define HISTORY_SEGMENT_MAGIC 0x5154484c
+// Newest hits of a search we return for each chat
+#define HISTORY_SEARCH_LIMIT 100
+
+class QTimer;
+class HistoryIndex;
+
+/// The chat logs. Each friend and group gets a directory of append-only segments, and a sparse index
+/// of the time of a record every HISTORY_INDEX_STRIDE bytes so reads can start anywhere without a scan.
+/// Appending only queues the message, a thread of ours writes it, and syncs the files in batches.
+/// With encryptLogs, each record of a new segment is sealed on its own, so nothing written is ever rewritten.
+/// The key is a random one kept unencrypted in history/key, readable only by the user like the profile next to
+/// it. That keeps the logs private where they're copied or backed up without it, not from whoever can read our files.
+/// Every chat also has a HistoryIndex of its words, updated by our thread with each batch it writes.
+class History : public QObject
+{
+    Q_OBJECT
+public:
+    struct Message
+    {
+        QDateTime time;
+        QString author, message;
+        int segment;
+        qint64 offset; ///< Where the record is, for readAround
+        bool encrypted; ///< Its segment is sealed, so are its words in the index
+    };
+    typedef QList<Message> Messages;
+    typedef QMap<QString, Messages> Hits; ///< By chat, oldest first
+
+    static History& getInstance();
+    static QString friendChat(const QString& userId); ///< The name of a chat's log
+    static QString groupChat(const QString& groupName); ///< Empty for a group with only its default name, which isn't logged
+
+    void append(const QString& chat, const QString& author, const QString& message, const QDateTime& time); ///< Any thread, never blocks on the disk
+    /// Reads the messages from the given time on, oldest first, until visit returns false. Any thread
+    bool read(const QString& chat, const QDateTime& from, std::function<bool(const Message&)> visit);
+    /// The messages around one we read or found, the message included. Any thread
+    QList<Message> readAround(const QString& chat, const Message& message, int before, int after);
+    /// readAround on our thread. Returns right away and emits contextRead
+    void readContext(const QString& chat, const Message& message, int before, int after);
+    /// Every word of the query must start a word of a message. Returns right away and emits searchFinished
+    void search(const QString& query, const QString& chat = QString()); ///< Every chat if empty
+    QStringList getChats() const;
+    QMap<int, qint64> getSegmentSizes(const QString& chat) const; ///< By segment number, empty without a log
+    void sync(); ///< Waits until everything appended is on disk
+    void shutdown(); ///< Syncs and stops our thread, at exit
+
+    bool canSeal() const {return !key.isEmpty();} ///< The key of the logs could be loaded
+    QByteArray seal(const QByteArray& plain); ///< With the key of the logs
+    bool unseal(const QByteArray& sealed, QByteArray& plain);
+
+signals:
+    void searchFinished(QString query, History::Hits hits);
+    void contextRead(QString chat, History::Message message, History::Messages context);
+
+private slots:
+    void writePending();
+    void syncFiles();
+    void runSearch(QString query, QString chat);
+    void runReadContext(QString chat, History::Message message, int before, int after);
+
+private:
+    History();
+    struct Pending
+    {
+        QString chat, author, message;
+        QDateTime time;
+        bool encrypted;
+    };
+    /// A log open for appending, only our thread touches it
+    struct Chat
+    {
+        QFile segment, index;
+        int segmentNumber;
+        bool encrypted;
+        qint64 lastIndexed; ///< Offset of the last record in the index, in this segment
+    };
+
+    QString chatPath(const QString& chat) const;
+    static QString segmentName(int number);
+    static int lastSegment(const QString& path); ///< -1 without any
+    Chat* openChat(const QString& chat, bool encrypted);
+    bool startSegment(Chat* c, int number, bool encrypted);
+    void recoverTail(Chat* c); ///< Cuts a record that was half written when we crashed
+    void loadKey();
+    HistoryIndex* indexFor(const QString& chat); ///< Indexes what was logged before, the first time
+    bool readFrom(const QString& chat, int segment, qint64 offset, qint64 fromTime, std::function<bool(const Message&)> visit);
+    bool readAt(const QString& chat, int segment, qint64 offset, Message& message);
+    static bool decodeRecord(const QByteArray& payload, Message& message);
+    QList<QPair<int, qint64>> readIndex(const QString& chat); ///< Segment and offset of every entry
+
+private:
+    QThread thread;
+    QMutex pendingMutex;
+    QList<Pending> pending;
+    QHash<QString, Chat*> chats;
+    QSet<Chat*> unsynced;
+    QHash<QString, HistoryIndex*> indexes;
+    QSet<HistoryIndex*> unflushed;
+    QTimer* syncTimer;
+    QByteArray key;
+};
+
+Q_DECLARE_METATYPE(History::Message)
+Q_DECLARE_METATYPE(History::Messages)
+Q_DECLARE_METATYPE(History::Hits)
+
+#endif // HISTORY_H
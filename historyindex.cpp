@@ -0,0 +1,170 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "historyindex.h"
+#include "history.h"
+#include <QFile>
+#include <QDataStream>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+
+HistoryIndex::HistoryIndex(const QString& path)
+    : path{path}, loaded{false}, sealPending{false}
+{
+}
+
+bool HistoryIndex::exists() const
+{
+    return QFile::exists(path);
+}
+
+QStringList HistoryIndex::words(const QString& text)
+{
+    QStringList words;
+    QString word;
+    for (QChar c : text)
+    {
+        if (c.isLetterOrNumber())
+        {
+            word += c.toLower();
+        }
+        else if (!word.isEmpty())
+        {
+            words << word;
+            word.clear();
+        }
+    }
+    if (!word.isEmpty())
+        words << word;
+    return words;
+}
+
+void HistoryIndex::add(const QString& text, qint32 segment, qint32 offset, bool sealed)
+{
+    Posting posting{segment, offset};
+    QStringList unique = words(text);
+    unique.removeDuplicates();
+    for (const QString& word : unique)
+    {
+        pending.append(qMakePair(word, posting));
+        if (loaded)
+            terms[word].append(posting);
+    }
+    sealPending |= sealed;
+}
+
+bool HistoryIndex::flush()
+{
+    if (pending.isEmpty())
+        return true;
+
+    QByteArray block;
+    {
+        QDataStream stream(&block, QIODevice::WriteOnly);
+        stream << (qint32)pending.size();
+        for (const QPair<QString, Posting>& entry : pending)
+            stream << entry.first << entry.second.segment << entry.second.offset;
+    }
+    if (sealPending)
+        block = History::getInstance().seal(block);
+
+    QByteArray header(5, 0);
+    qToBigEndian<quint32>(block.size(), (uchar*)header.data());
+    header[4] = sealPending;
+
+    QFile file(path);
+    if (!file.open(QIODevice::Append) || file.write(header + block) != header.size() + block.size())
+    {
+        qWarning() << "HistoryIndex: Can't write to" << path;
+        return false;
+    }
+    pending.clear();
+    sealPending = false;
+    return true;
+}
+
+void HistoryIndex::load()
+{
+    loaded = true;
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    forever
+    {
+        QByteArray header = file.read(5);
+        if (header.size() != 5)
+            break;
+        quint32 size = qFromBigEndian<quint32>((const uchar*)header.constData());
+        QByteArray block = file.read(size);
+        if ((quint32)block.size() != size)
+            break;
+        if (header[4] && !History::getInstance().unseal(QByteArray(block), block))
+        {
+            qWarning() << "HistoryIndex: Can't decrypt a block of" << path;
+            continue;
+        }
+
+        QDataStream stream(block);
+        qint32 count;
+        stream >> count;
+        for (int i=0; i<count && stream.status() == QDataStream::Ok; i++)
+        {
+            QString word;
+            Posting posting;
+            stream >> word >> posting.segment >> posting.offset;
+            terms[word].append(posting);
+        }
+    }
+
+    // What was added before we loaded is in the file already or still pending
+    for (const QPair<QString, Posting>& entry : pending)
+        terms[entry.first].append(entry.second);
+}
+
+QVector<HistoryIndex::Posting> HistoryIndex::find(const QString& query)
+{
+    if (!loaded)
+        load();
+
+    QVector<Posting> result;
+    bool first = true;
+    for (const QString& prefix : words(query))
+    {
+        // Every word starting with the prefix, merged
+        QVector<Posting> matches;
+        for (auto it = terms.lowerBound(prefix); it != terms.end() && it.key().startsWith(prefix); ++it)
+            matches += it.value();
+        std::sort(matches.begin(), matches.end());
+        matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+        if (first)
+        {
+            result = matches;
+            first = false;
+        }
+        else
+        {
+            QVector<Posting> both;
+            std::set_intersection(result.begin(), result.end(), matches.begin(), matches.end(), std::back_inserter(both));
+            result = both;
+        }
+        if (result.isEmpty())
+            break;
+    }
+    return result;
+}
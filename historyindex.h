@@ -0,0 +1,58 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef HISTORYINDEX_H
+#define HISTORYINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QMap>
+#include <QVector>
+#include <QPair>
+
+/// Inverted index of a chat's log, from every word of its messages to the records that contain it.
+/// New postings are appended to the terms file in one block per batch of the log, sealed when the log is.
+/// Only the history thread uses it.
+class HistoryIndex
+{
+public:
+    /// Where a record is in the log
+    struct Posting
+    {
+        qint32 segment, offset;
+        bool operator<(const Posting& other) const {return segment < other.segment || (segment == other.segment && offset < other.offset);}
+        bool operator==(const Posting& other) const {return segment == other.segment && offset == other.offset;}
+    };
+
+    explicit HistoryIndex(const QString& path); ///< Of the terms file, read on the first search
+    bool exists() const; ///< If not, the log written before we had an index needs to be added
+    void add(const QString& text, qint32 segment, qint32 offset, bool sealed); ///< Kept until flush
+    bool flush();
+    /// The records in which every word of the query starts a word, oldest first
+    QVector<Posting> find(const QString& query);
+    static QStringList words(const QString& text); ///< Lowercase, split on what isn't a letter or a digit
+
+private:
+    void load();
+
+private:
+    QString path;
+    bool loaded, sealPending;
+    QMap<QString, QVector<Posting>> terms; ///< Sorted, so a prefix is a range of keys
+    QVector<QPair<QString, Posting>> pending;
+};
+
+#endif // HISTORYINDEX_H
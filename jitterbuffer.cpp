@@ -0,0 +1,196 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "jitterbuffer.h"
+#include "coredefines.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+JitterBuffer::JitterBuffer()
+    : frames(TOXAV_JITTER_MAX_FRAMES)
+{
+    reset();
+}
+
+void JitterBuffer::reset()
+{
+    QMutexLocker locker(&mutex);
+    clock.start();
+    head = count = depth = 0;
+    buffering = true;
+    lastArrival = -1;
+    lastDuration = 0;
+    lastAfterGap = true;
+    jitter = 0;
+    targetDelay = TOXAV_JITTER_MIN_DELAY;
+    latency = 0;
+    last.samples = 0;
+    concealRun = 0;
+    concealed = lost = dropped = underruns = 0;
+}
+
+void JitterBuffer::dropFront()
+{
+    depth -= frames[head].duration;
+    head = (head + 1) % frames.size();
+    count--;
+    dropped++;
+}
+
+void JitterBuffer::push(const int16_t* data, int samples, int channels, int sampleRate)
+{
+    if (samples <= 0 || channels <= 0 || sampleRate <= 0)
+        return;
+
+    QMutexLocker locker(&mutex);
+    qint64 now = clock.elapsed();
+    int duration = std::max(samples * 1000 / sampleRate, 1);
+
+    // How much later or earlier than its predecessor's length this frame came.
+    // A longer gap is a peer's unsent silence. The frame that ends it is a comfort frame or the
+    // first of a new talk spurt, and neither that gap nor the one after it says anything about the link
+    bool afterGap = lastArrival < 0 || now - lastArrival > TOXAV_JITTER_MAX_GAP;
+    if (!afterGap && !lastAfterGap)
+    {
+        double deviation = std::abs((double)(now - lastArrival) - lastDuration);
+        jitter += (deviation - jitter) / 16;
+        targetDelay = std::min(std::max((int)(duration + 4*jitter), TOXAV_JITTER_MIN_DELAY), TOXAV_JITTER_MAX_DELAY);
+    }
+    lastArrival = now;
+    lastDuration = duration;
+    lastAfterGap = afterGap;
+
+    if (count == frames.size())
+        dropFront();
+
+    Frame& frame = frames[(head + count) % frames.size()];
+    frame.data.resize(samples * channels); // Keeps the capacity, so it stops allocating once warm
+    std::copy(data, data + samples * channels, frame.data.begin());
+    frame.samples = samples;
+    frame.channels = channels;
+    frame.sampleRate = sampleRate;
+    frame.arrival = now;
+    frame.duration = duration;
+    count++;
+    depth += duration;
+}
+
+bool JitterBuffer::pop(QVector<int16_t>& data, int& samples, int& channels, int& sampleRate, int* waited)
+{
+    QMutexLocker locker(&mutex);
+    if (buffering)
+    {
+        if (depth < targetDelay)
+            return false;
+        buffering = false;
+    }
+
+    if (!count)
+    {
+        // Fade out the last frame for a short gap, past that we start buffering again
+        if (concealRun >= TOXAV_JITTER_CONCEAL_FRAMES || !last.samples)
+        {
+            // Whatever comes next ends a silence, not a gap, so the concealment isn't counted as lost
+            buffering = true;
+            underruns++;
+            concealRun = 0;
+            return false;
+        }
+        concealRun++;
+        concealed++;
+        data.resize(last.data.size());
+        for (int i=0; i<data.size(); i++)
+            data[i] = last.data[i] / (1 << concealRun);
+        samples = last.samples;
+        channels = last.channels;
+        sampleRate = last.sampleRate;
+        if (waited)
+            *waited = -1;
+        return true;
+    }
+
+    // After a burst, catch up instead of staying behind for the rest of the call
+    while (count > 1 && depth > 2*targetDelay)
+        dropFront();
+
+    Frame& frame = frames[head];
+    latency = clock.elapsed() - frame.arrival;
+    if (waited)
+        *waited = latency;
+    std::swap(last, frame); // The ring gets last's buffer back, no allocation
+    head = (head + 1) % frames.size();
+    count--;
+    depth -= last.duration;
+    lost += concealRun; // The gap was short, those frames got lost on the way
+    concealRun = 0;
+
+    // Copied rather than shared, so neither side detaches and allocates later
+    data.resize(last.data.size());
+    std::copy(last.data.constBegin(), last.data.constEnd(), data.begin());
+    samples = last.samples;
+    channels = last.channels;
+    sampleRate = last.sampleRate;
+    return true;
+}
+
+int JitterBuffer::getDepth() const
+{
+    QMutexLocker locker(&mutex);
+    return depth;
+}
+
+int JitterBuffer::getTargetDelay() const
+{
+    QMutexLocker locker(&mutex);
+    return targetDelay;
+}
+
+int JitterBuffer::getJitter() const
+{
+    QMutexLocker locker(&mutex);
+    return std::lround(jitter);
+}
+
+int JitterBuffer::getLatency() const
+{
+    QMutexLocker locker(&mutex);
+    return latency;
+}
+
+quint32 JitterBuffer::getConcealed() const
+{
+    QMutexLocker locker(&mutex);
+    return concealed;
+}
+
+quint32 JitterBuffer::getLost() const
+{
+    QMutexLocker locker(&mutex);
+    return lost;
+}
+
+quint32 JitterBuffer::getDropped() const
+{
+    QMutexLocker locker(&mutex);
+    return dropped;
+}
+
+quint32 JitterBuffer::getUnderruns() const
+{
+    QMutexLocker locker(&mutex);
+    return underruns;
+}
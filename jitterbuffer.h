@@ -0,0 +1,78 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <cstdint>
+#include <QVector>
+#include <QMutex>
+#include <QElapsedTimer>
+
+/// Smooths the playout of a call's received audio. Frames are held until the buffer reaches
+/// a playout delay that follows the measured arrival jitter, between TOXAV_JITTER_MIN_DELAY and
+/// TOXAV_JITTER_MAX_DELAY. A few missing frames are concealed by fading out the last one, and
+/// when a burst leaves us more than twice the delay behind, the oldest frames are dropped so
+/// the lag doesn't add up over a long call. A peer that doesn't send its silence leaves gaps
+/// longer than that, they aren't counted as lost and don't feed the jitter.
+/// Toxav pushes, the audio thread pops.
+class JitterBuffer
+{
+public:
+    JitterBuffer();
+    void reset(); ///< Forget everything, for a new call
+
+    void push(const int16_t* data, int samples, int channels, int sampleRate);
+    /// The next frame to play, possibly concealed. False while we're buffering up to the delay
+    /// waited gets the milliseconds the frame spent here, or -1 if it's concealment
+    bool pop(QVector<int16_t>& data, int& samples, int& channels, int& sampleRate, int* waited = nullptr);
+
+    int getDepth() const; ///< Milliseconds of audio waiting
+    int getTargetDelay() const; ///< Milliseconds we buffer before playing
+    int getJitter() const; ///< Milliseconds, smoothed like RFC 3550's interarrival jitter
+    int getLatency() const; ///< Milliseconds the last frame played spent between toxav and us
+    quint32 getConcealed() const;
+    quint32 getLost() const; ///< Concealed frames of gaps that frames came back after, longer gaps are silence
+    quint32 getDropped() const; ///< Dropped to drain a burst or because we were full
+    quint32 getUnderruns() const;
+
+private:
+    struct Frame
+    {
+        QVector<int16_t> data;
+        int samples, channels, sampleRate;
+        qint64 arrival;
+        int duration; ///< ms
+    };
+    void dropFront();
+
+private:
+    mutable QMutex mutex;
+    QElapsedTimer clock;
+    QVector<Frame> frames; ///< Ring of TOXAV_JITTER_MAX_FRAMES, the buffers are reused
+    int head, count, depth;
+    bool buffering;
+    qint64 lastArrival;
+    int lastDuration;
+    bool lastAfterGap; ///< The last frame came after a gap of unsent silence, TOXAV_JITTER_MAX_GAP
+    double jitter;
+    int targetDelay, latency;
+    Frame last; ///< What we played last, repeated to conceal gaps
+    int concealRun;
+    quint32 concealed, lost, dropped, underruns;
+};
+
+#endif // JITTERBUFFER_H
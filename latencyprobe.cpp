@@ -0,0 +1,111 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "latencyprobe.h"
+#include "coredefines.h"
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+
+bool LatencyProbe::enabled{false};
+
+namespace
+{
+QElapsedTimer& sharedClock()
+{
+    static QElapsedTimer clock;
+    static QMutex mutex;
+    QMutexLocker locker(&mutex);
+    if (!clock.isValid())
+        clock.start();
+    return clock;
+}
+}
+
+LatencyProbe::LatencyProbe()
+{
+    reset();
+}
+
+void LatencyProbe::reset()
+{
+    QMutexLocker locker(&mutex);
+    lastClick = -1;
+    clicks = 0;
+    sum = max = 0;
+    min = -1;
+}
+
+void LatencyProbe::setEnabled(bool Enabled)
+{
+    enabled = Enabled;
+    sharedClock();
+}
+
+bool LatencyProbe::isEnabled()
+{
+    return enabled;
+}
+
+qint64 LatencyProbe::now()
+{
+    return sharedClock().nsecsElapsed() / 1000;
+}
+
+void LatencyProbe::generate(int16_t* data, int samples, int sampleRate, qint64 start)
+{
+    const qint64 interval = TOXAV_PROBE_INTERVAL * 1000LL, click = TOXAV_PROBE_CLICK * 1000LL;
+    for (int i=0; i<samples; i++)
+    {
+        qint64 t = start + i * 1000000LL / sampleRate;
+        // A square wave at 1kHz, Opus keeps its onset sharp
+        data[i] = t % interval < click ? (t / 500 % 2 ? TOXAV_PROBE_AMPLITUDE : -TOXAV_PROBE_AMPLITUDE) : 0;
+    }
+}
+
+void LatencyProbe::process(const int16_t* data, int samples, int channels, int sampleRate, qint64 queued)
+{
+    const qint64 interval = TOXAV_PROBE_INTERVAL * 1000LL;
+    for (int i=0; i<samples; i++)
+    {
+        if (std::abs(data[i*channels]) < TOXAV_PROBE_AMPLITUDE / 2)
+            continue;
+
+        // It was sent at the start of an interval, one that's older than any latency we can measure
+        qint64 heard = now() + queued + i * 1000000LL / sampleRate;
+        qint64 sent = heard / interval * interval;
+        QMutexLocker locker(&mutex);
+        if (sent == lastClick)
+            return;
+        lastClick = sent;
+        qint64 latency = heard - sent;
+        clicks++;
+        sum += latency;
+        min = min < 0 ? latency : std::min(min, latency);
+        max = std::max(max, latency);
+        return;
+    }
+}
+
+QString LatencyProbe::report() const
+{
+    QMutexLocker locker(&mutex);
+    if (!clicks)
+        return QString();
+    return QString("mouth to ear %1ms mean, %2ms min, %3ms max over %4 clicks")
+            .arg(sum / clicks / 1000).arg(min / 1000).arg(max / 1000).arg(clicks);
+}
@@ -0,0 +1,54 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef LATENCYPROBE_H
+#define LATENCYPROBE_H
+
+#include <cstdint>
+#include <QMutex>
+#include <QString>
+
+/// Measures mouth to ear latency between Cores of the same process, for the headless harness.
+/// Once enabled, the audio thread sends a synthetic microphone instead of the real one: silence with
+/// a loud click at the start of every TOXAV_PROBE_INTERVAL of a clock the whole process shares.
+/// The receiving end finds the clicks in what its jitter buffer releases, and since it knows when they
+/// were sent it only has to count what's still queued for the speaker to know when they'll be heard.
+/// One instance per call detects, generate is for the sender.
+class LatencyProbe
+{
+public:
+    LatencyProbe();
+    void reset(); ///< For a new call
+
+    static void setEnabled(bool enabled); ///< Call before the first call starts
+    static bool isEnabled();
+    static qint64 now(); ///< Microseconds of the shared clock
+    /// Fills samples of mono audio, the first one captured at the shared clock's time start
+    static void generate(int16_t* data, int samples, int sampleRate, qint64 start);
+
+    /// Looks for a click in a frame that will be heard in queued microseconds
+    void process(const int16_t* data, int samples, int channels, int sampleRate, qint64 queued);
+    QString report() const; ///< Empty until a click was heard
+
+private:
+    mutable QMutex mutex;
+    qint64 lastClick; ///< When the last click we counted was sent, -1 if none
+    quint32 clicks;
+    qint64 sum, min, max; ///< Microseconds
+    static bool enabled;
+};
+
+#endif // LATENCYPROBE_H
@@ -16,6 +16,12 @@
 
 #include "widget/widget.h"
 #include "settings.h"
+#include "widget/videoconvert.h"
+#include "audiostats.h"
+#include "widget/tool/messageformatter.h"
+#include "smileypack.h"
+#include "startuptrace.h"
+#include "style.h"
 #include <QApplication>
 #include <QFontDatabase>
 #include <QTranslator>
@@ -26,8 +32,28 @@ int main(int argc, char *argv[])
     QApplication a(argc, argv);
     a.setApplicationName("qTox");
     a.setOrganizationName("Tox");
+    StartupTrace::start(a.arguments().contains("--startup-trace"));
+
+    if (a.arguments().contains("--benchmark-video"))
+        return VideoConvert::benchmark();
+    if (a.arguments().contains("--benchmark-formatter"))
+        return MessageFormatter::benchmark();
+
+    // For QA runs, every call appends its audio stats there when it ends
+    int statsArg = a.arguments().indexOf("--call-stats");
+    if (statsArg >= 0 && statsArg+1 < a.arguments().size())
+        AudioStats::setDumpFile(a.arguments()[statsArg+1]);
+
+    StartupTrace::begin("Settings");
+    Settings::getInstance();
+    StartupTrace::end("Settings");
+
+    // Parsing the smiley pack, decoding its images and reading the stylesheets happen on the thread pool while we go on
+    SmileyPack::getInstance();
+    Style::preload();
 
     // Load translations
+    StartupTrace::begin("Translations");
     QTranslator translator;
     if (Settings::getInstance().getUseTranslations())
     {
@@ -38,12 +64,17 @@ int main(int argc, char *argv[])
             qDebug() << "Error loading translation "+locale;
         a.installTranslator(&translator);
     }
+    StartupTrace::end("Translations");
 
     // Install Unicode 6.1 supporting font
+    StartupTrace::begin("Fonts");
     QFontDatabase::addApplicationFont("://DejaVuSans.ttf");
+    StartupTrace::end("Fonts");
 
+    StartupTrace::begin("Main window");
     Widget* w = Widget::getInstance();
     w->show();
+    StartupTrace::end("Main window");
 
     int errorcode = a.exec();
 
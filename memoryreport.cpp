@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "memoryreport.h"
+#include "friend.h"
+#include "friendlist.h"
+#include "group.h"
+#include "grouplist.h"
+#include "grouppeermodel.h"
+#include "smileypack.h"
+#include "filetransferinstance.h"
+#include "videoframe.h"
+#include "audiomixer.h"
+#include "soundbank.h"
+#include "widget/imageviewer.h"
+#include "style.h"
+#include "widget/form/chatform.h"
+#include "widget/form/groupchatform.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QPixmapCache>
+#include <QDebug>
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+static QJsonObject subsystem(const QString& name, qint64 bytes, const QString& detail = QString())
+{
+    QJsonObject entry;
+    entry["name"] = name;
+    entry["bytes"] = (double)bytes;
+    entry["detail"] = detail;
+    return entry;
+}
+
+static qint64 stringBytes(const QString& str)
+{
+    return str.capacity() * sizeof(QChar);
+}
+
+QJsonObject MemoryReport::collect()
+{
+    QJsonArray subsystems;
+
+    qint64 chats = 0, friends = 0;
+    int forms = 0;
+    for (Friend* f : FriendList::friendList)
+    {
+        friends += sizeof(Friend) + stringBytes(f->userId) + stringBytes(f->name) + stringBytes(f->statusMessage);
+        if (f->chatForm)
+        {
+            chats += f->chatForm->getMemoryUsage();
+            forms++;
+        }
+    }
+    qint64 groups = 0;
+    for (Group* g : GroupList::groupList)
+    {
+        groups += sizeof(Group) + stringBytes(g->name) + g->peers->getMemoryUsage();
+        if (g->chatForm)
+        {
+            chats += g->chatForm->getMemoryUsage();
+            forms++;
+        }
+    }
+    subsystems << subsystem("chatDocuments", chats, QString("%1 chat forms").arg(forms));
+    subsystems << subsystem("smileys", SmileyPack::getInstance().getImageMemory());
+    subsystems << subsystem("previews", FileTransferInstance::getPreviewMemory());
+    subsystems << subsystem("imageViewers", ImageViewer::getTileMemory());
+    subsystems << subsystem("resourcePixmaps", Style::getPixmapMemory());
+    qint64 spareFrames;
+    qint64 frames = VideoFrame::getPoolMemory(&spareFrames);
+    subsystems << subsystem("videoFrames", frames, QString("%1 spare").arg(spareFrames));
+    subsystems << subsystem("openalBuffers", AudioMixer::getBufferMemory() + SoundBank::getBufferMemory());
+    subsystems << subsystem("friends", friends, QString("%1 friends").arg(FriendList::friendList.size()));
+    subsystems << subsystem("groups", groups, QString("%1 groups").arg(GroupList::groupList.size()));
+
+    QJsonObject report;
+    report["subsystems"] = subsystems;
+    report["resident"] = (double)residentMemory();
+    return report;
+}
+
+void MemoryReport::trim()
+{
+    int released = 0;
+    for (Friend* f : FriendList::friendList)
+    {
+        if (f->releaseChatForm())
+            released++;
+        else if (f->chatForm)
+            f->chatForm->trim();
+    }
+    for (Group* g : GroupList::groupList)
+        g->chatForm->trim();
+
+    QPixmapCache::clear();
+    Style::trimPixmaps();
+    VideoFrame::trimPool();
+#ifdef __GLIBC__
+    // What we freed is mostly small blocks, glibc keeps them for the next allocations otherwise
+    malloc_trim(0);
+#endif
+    qDebug() << "MemoryReport::trim: Released" << released << "idle chat forms";
+}
+
+qint64 MemoryReport::residentMemory()
+{
+#ifdef Q_OS_LINUX
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return 0;
+    QList<QByteArray> fields = statm.readAll().split(' ');
+    if (fields.size() < 2)
+        return 0;
+    return fields[1].toLongLong() * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
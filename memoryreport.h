@@ -0,0 +1,37 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <QJsonObject>
+
+/// Where our memory goes, by subsystem. The numbers are estimates of what each one holds on the heap,
+/// the resident size of the process is there to compare them with. GUI thread only.
+class MemoryReport
+{
+public:
+    /// {"subsystems": [{"name", "bytes", "detail"}], "resident": bytes}, resident is 0 where we can't read it
+    static QJsonObject collect();
+    /// Drops the caches we can rebuild and evicts scrollback: idle chat forms are released, the others
+    /// keep their last rows, and the spare video frames are freed
+    static void trim();
+
+private:
+    static qint64 residentMemory();
+};
+
+#endif // MEMORYREPORT_H
@@ -0,0 +1,171 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "netimpairment.h"
+#include "coredefines.h"
+#include <QMutexLocker>
+#include <QStringList>
+#include <algorithm>
+
+NetImpairment::Profile NetImpairment::Profile::parse(const QString& spec, bool* ok)
+{
+    Profile profile;
+    bool valid = true;
+    for (const QString& item : spec.split(' ', QString::SkipEmptyParts))
+    {
+        QString key = item.section('=', 0, 0);
+        QString value = item.section('=', 1);
+        bool number = false;
+        if (key == "loss")
+            profile.loss = value.toDouble(&number);
+        else if (key == "delay")
+            profile.delay = value.toInt(&number);
+        else if (key == "jitter")
+            profile.jitter = value.toInt(&number);
+        else if (key == "reorder")
+            profile.reorder = value.toDouble(&number);
+        else if (key == "kbps")
+            profile.bandwidth = value.toInt(&number);
+        else if (key == "seed")
+            profile.seed = value.toUInt(&number);
+        valid = valid && number;
+    }
+    valid = valid && profile.loss >= 0 && profile.loss <= 100 && profile.reorder >= 0 && profile.reorder <= 100
+            && profile.delay >= 0 && profile.jitter >= 0 && profile.bandwidth >= 0;
+    if (ok)
+        *ok = valid;
+    return valid ? profile : Profile();
+}
+
+QString NetImpairment::Profile::toString() const
+{
+    return QString("loss=%1 delay=%2 jitter=%3 reorder=%4 kbps=%5 seed=%6")
+            .arg(loss).arg(delay).arg(jitter).arg(reorder).arg(bandwidth).arg(seed);
+}
+
+bool NetImpairment::Profile::isNull() const
+{
+    return !loss && !delay && !jitter && !reorder && !bandwidth;
+}
+
+NetImpairment::NetImpairment()
+    : enabled{false}, linkFree{0}, pushed{0}, lost{0}, reordered{0}, tailDropped{0}, delaySum{0}
+{
+    clock.start();
+}
+
+void NetImpairment::setProfile(const Profile& Profile)
+{
+    QMutexLocker locker(&mutex);
+    profile = Profile;
+    enabled = !profile.isNull();
+    random.seed(profile.seed);
+    queue.clear();
+    linkFree = 0;
+    pushed = lost = reordered = tailDropped = 0;
+    delaySum = 0;
+}
+
+NetImpairment::Profile NetImpairment::getProfile() const
+{
+    QMutexLocker locker(&mutex);
+    return profile;
+}
+
+bool NetImpairment::isEnabled() const
+{
+    QMutexLocker locker(&mutex);
+    return enabled;
+}
+
+bool NetImpairment::push(const Packet& packet, int bytes)
+{
+    QMutexLocker locker(&mutex);
+    if (!enabled)
+        return false;
+
+    // Drawn for every frame whatever the profile, so changing one parameter doesn't reshuffle the others
+    std::uniform_real_distribution<double> percent(0, 100);
+    bool isLost = percent(random) < profile.loss;
+    bool isReordered = percent(random) < profile.reorder;
+    double jitter = std::uniform_real_distribution<double>(0, 1)(random) * profile.jitter;
+    pushed++;
+    if (isLost)
+    {
+        lost++;
+        return true;
+    }
+
+    // The link sends one frame after the other, a late frame waits for it to be free
+    qint64 sent = clock.elapsed();
+    if (profile.bandwidth)
+    {
+        qint64 start = std::max(sent, linkFree);
+        if (start - sent > TOXAV_IMPAIRMENT_MAX_QUEUE)
+        {
+            tailDropped++;
+            return true;
+        }
+        linkFree = start + std::max<qint64>(bytes * 8LL / profile.bandwidth, 1);
+        sent = linkFree;
+    }
+
+    qint64 delay = profile.delay + (qint64)jitter;
+    // Held back for more than the jitter, so the frames behind it get there first
+    if (isReordered)
+    {
+        delay += profile.jitter + TOXAV_IMPAIRMENT_REORDER_DELAY;
+        reordered++;
+    }
+    qint64 arrival = sent + delay;
+    delaySum += arrival - clock.elapsed();
+    queue.insert(arrival, packet);
+    return true;
+}
+
+QVector<NetImpairment::Packet> NetImpairment::takeDue()
+{
+    QMutexLocker locker(&mutex);
+    QVector<Packet> due;
+    qint64 now = clock.elapsed();
+    while (!queue.isEmpty() && queue.firstKey() <= now)
+    {
+        due.append(queue.first());
+        queue.erase(queue.begin());
+    }
+    return due;
+}
+
+void NetImpairment::dropCall(int callId)
+{
+    QMutexLocker locker(&mutex);
+    for (auto it = queue.begin(); it != queue.end();)
+    {
+        if (it->callId == callId)
+            it = queue.erase(it);
+        else
+            ++it;
+    }
+}
+
+QString NetImpairment::report() const
+{
+    QMutexLocker locker(&mutex);
+    quint32 delivered = pushed - lost - tailDropped;
+    return QString("impairment %1: %2 frames, %3 lost, %4 dropped by the link, %5 reordered, %6ms mean delay")
+            .arg(profile.toString()).arg(pushed).arg(lost).arg(tailDropped).arg(reordered)
+            .arg(delivered ? delaySum / delivered : 0);
+}
@@ -0,0 +1,87 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef NETIMPAIRMENT_H
+#define NETIMPAIRMENT_H
+
+#include <cstdint>
+#include <random>
+#include <QElapsedTimer>
+#include <QMultiMap>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include "videoframe.h"
+
+/// A bad network in front of one Core, for the headless harness. Toxcore owns its sockets, so it's the
+/// audio and video toxav hands us that go through it, before the jitter buffer and the views see them:
+/// each frame may be lost, is delayed by a base delay plus a uniform jitter, may be held back long enough to
+/// be overtaken, and queues behind the others on a link of the capped bandwidth, which drops what would wait
+/// longer than TOXAV_IMPAIRMENT_MAX_QUEUE. Core also caps its uploads to that bandwidth.
+/// Every decision comes from a generator seeded by the profile, so a scenario plays the same way every run.
+/// Toxav's threads push, Core's thread takes what's due.
+class NetImpairment
+{
+public:
+    struct Profile
+    {
+        Profile() : loss{0}, delay{0}, jitter{0}, reorder{0}, bandwidth{0}, seed{1} {}
+        double loss; ///< Percent of the frames
+        int delay, jitter; ///< ms
+        double reorder; ///< Percent of the frames held back past the next ones
+        int bandwidth; ///< kbps, 0 for no cap
+        quint32 seed;
+
+        /// From "loss=5 delay=80 jitter=20 reorder=1 kbps=256 seed=7", what isn't given stays at 0
+        static Profile parse(const QString& spec, bool* ok = nullptr);
+        QString toString() const;
+        bool isNull() const; ///< Nothing would be impaired
+    };
+
+    /// A received audio or video frame of a call
+    struct Packet
+    {
+        int callId;
+        QVector<int16_t> audio; ///< Empty for video
+        int samples, channels, sampleRate;
+        VideoFrame video;
+    };
+
+    NetImpairment();
+    void setProfile(const Profile& profile); ///< Restarts the generator and the counters, frames still queued are dropped
+    Profile getProfile() const;
+    bool isEnabled() const; ///< False once the profile is null, frames then go around us
+
+    /// Delivers the frame later or never, bytes is its estimated size on the wire. False if we're not enabled
+    bool push(const Packet& packet, int bytes);
+    QVector<Packet> takeDue(); ///< What has arrived by now, in arrival order
+    void dropCall(int callId); ///< Forgets the call's queued frames, when it ends
+
+    QString report() const; ///< One line of counters since the profile was set
+
+private:
+    mutable QMutex mutex;
+    QElapsedTimer clock;
+    Profile profile;
+    bool enabled;
+    std::mt19937 random;
+    QMultiMap<qint64, Packet> queue; ///< By arrival time in ms of our clock
+    qint64 linkFree; ///< When the capped link is done with what was pushed before
+    quint32 pushed, lost, reordered, tailDropped;
+    qint64 delaySum;
+};
+
+#endif // NETIMPAIRMENT_H
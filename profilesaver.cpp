@@ -0,0 +1,84 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "profilesaver.h"
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QDebug>
+
+class ProfileSaver::Task : public QRunnable
+{
+public:
+    explicit Task(ProfileSaver* Saver) : saver{Saver} {}
+    void run() {saver->writeAll();}
+
+private:
+    ProfileSaver* saver;
+};
+
+ProfileSaver::ProfileSaver()
+    : busy{false}
+{
+}
+
+ProfileSaver& ProfileSaver::getInstance()
+{
+    static ProfileSaver instance;
+    return instance;
+}
+
+void ProfileSaver::write(const QString& path, const QByteArray& data)
+{
+    QMutexLocker locker(&mutex);
+    pending.insert(path, data);
+    if (busy)
+        return;
+
+    busy = true;
+    QThreadPool::globalInstance()->start(new Task(this));
+}
+
+void ProfileSaver::flush()
+{
+    QMutexLocker locker(&mutex);
+    while (busy)
+        idle.wait(&mutex);
+}
+
+void ProfileSaver::writeAll()
+{
+    QMutexLocker locker(&mutex);
+    while (!pending.isEmpty())
+    {
+        auto it = pending.begin();
+        QString path = it.key();
+        QByteArray data = it.value();
+        pending.erase(it);
+        locker.unlock();
+
+        QSaveFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            qCritical() << "ProfileSaver: File " << path << " cannot be opened";
+        else if (file.write(data) != data.size() || !file.commit())
+            qCritical() << "ProfileSaver: Failed to write " << path << ":" << file.errorString();
+
+        locker.relock();
+    }
+    busy = false;
+    idle.wakeAll();
+}
@@ -0,0 +1,48 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef PROFILESAVER_H
+#define PROFILESAVER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QHash>
+#include <QMutex>
+#include <QWaitCondition>
+
+/// Writes the tox profile on an I/O thread, Core only has to take the snapshot.
+/// Only the newest snapshot of each path is kept while one is being written, so saves asked for
+/// close together end up as a single write of the latest state. Shared by every Core in the process.
+class ProfileSaver
+{
+public:
+    static ProfileSaver& getInstance();
+    void write(const QString& path, const QByteArray& data); ///< Returns at once, replaces a snapshot of the path not yet written
+    void flush(); ///< Blocks until the last snapshots are on disk
+
+private:
+    ProfileSaver();
+    class Task;
+    void writeAll(); ///< Runs on the I/O thread until no snapshot is left
+
+private:
+    QMutex mutex;
+    QWaitCondition idle;
+    QHash<QString, QByteArray> pending; ///< By path
+    bool busy;
+};
+
+#endif // PROFILESAVER_H
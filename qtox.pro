@@ -58,7 +58,7 @@ win32 {
             INSTALLS += target
             LIBS += -L$$PWD/libs/lib/ -Wl,-Bstatic -ltoxcore -ltoxav -lsodium -Wl,-Bdynamic -lopus -lvpx -lopenal -lopencv_core -lopencv_highgui
         } else {
-            LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -lvpx -lopenal -lopencv_core -lopencv_highgui
+            LIBS += -L$$PWD/libs/lib/ -ltoxcore -ltoxav -lsodium -lvpx -lopenal -lopencv_core -lopencv_highgui
         }
 
         contains(JENKINS, YES) {
@@ -84,8 +84,6 @@ HEADERS  += widget/form/addfriendform.h \
     widget/form/filesform.h \
     widget/tool/chattextedit.h \
     widget/tool/friendrequestdialog.h \
-    widget/friendwidget.h \
-    widget/groupwidget.h \
     widget/widget.h \
     friend.h \
     group.h \
@@ -97,21 +95,58 @@ HEADERS  += widget/form/addfriendform.h \
     cstring.h \
     widget/selfcamview.h \
     widget/camera.h \
+    widget/screencapture.h \
     widget/netcamview.h \
+    widget/videoconvert.h \
+    widget/videoconverter.h \
     smileypack.h \
+    thumbnailer.h \
     widget/emoticonswidget.h \
     style.h \
     widget/adjustingscrollarea.h \
     widget/croppinglabel.h \
     widget/friendlistwidget.h \
-    widget/genericchatroomwidget.h \
+    widget/contactlistmodel.h \
+    widget/transferlistmodel.h \
+    widget/contactlistdelegate.h \
     widget/form/genericchatform.h \
     widget/tool/chataction.h \
+    widget/tool/messageformatter.h \
+    widget/tool/mentionmatcher.h \
+    widget/tool/visibility.h \
     widget/chatareawidget.h \
     filetransferinstance.h \
+    filereadahead.h \
+    filewritebehind.h \
+    profilesaver.h \
+    coreeventqueue.h \
+    coreprofiler.h \
+    memoryreport.h \
+    widget/corestatsdialog.h \
+    widget/imageviewer.h \
+    filecheckpoints.h \
     corestructs.h \
     coredefines.h \
     coreav.h \
+    videoframe.h \
+    videosource.h \
+    audiothread.h \
+    audiomixer.h \
+    audiostats.h \
+    startuptrace.h \
+    soundbank.h \
+    history.h \
+    transferhistory.h \
+    historyindex.h \
+    eventdispatcher.h \
+    grouppeermodel.h \
+    chatexport.h \
+    jitterbuffer.h \
+    videoratecontroller.h \
+    audioratecontroller.h \
+    voicedetector.h \
+    netimpairment.h \
+    latencyprobe.h \
     widget/settingsdialog.h
 
 SOURCES += \
@@ -121,8 +156,6 @@ SOURCES += \
     widget/form/filesform.cpp \
     widget/tool/chattextedit.cpp \
     widget/tool/friendrequestdialog.cpp \
-    widget/friendwidget.cpp \
-    widget/groupwidget.cpp \
     widget/widget.cpp \
     core.cpp \
     friend.cpp \
@@ -135,18 +168,72 @@ SOURCES += \
     cstring.cpp \
     widget/selfcamview.cpp \
     widget/camera.cpp \
+    widget/screencapture.cpp \
     widget/netcamview.cpp \
+    widget/videoconvert.cpp \
+    widget/videoconverter.cpp \
     smileypack.cpp \
+    thumbnailer.cpp \
     widget/emoticonswidget.cpp \
     style.cpp \
     widget/adjustingscrollarea.cpp \
     widget/croppinglabel.cpp \
     widget/friendlistwidget.cpp \
+    widget/contactlistmodel.cpp \
+    widget/transferlistmodel.cpp \
+    widget/contactlistdelegate.cpp \
     coreav.cpp \
-    widget/genericchatroomwidget.cpp \
+    videoframe.cpp \
+    audiothread.cpp \
+    audiomixer.cpp \
+    audiostats.cpp \
+    startuptrace.cpp \
+    soundbank.cpp \
+    history.cpp \
+    transferhistory.cpp \
+    historyindex.cpp \
+    eventdispatcher.cpp \
+    grouppeermodel.cpp \
+    chatexport.cpp \
+    jitterbuffer.cpp \
+    videoratecontroller.cpp \
+    audioratecontroller.cpp \
+    voicedetector.cpp \
+    netimpairment.cpp \
+    latencyprobe.cpp \
     widget/form/genericchatform.cpp \
     widget/tool/chataction.cpp \
+    widget/tool/messageformatter.cpp \
+    widget/tool/mentionmatcher.cpp \
+    widget/tool/visibility.cpp \
     widget/chatareawidget.cpp \
     filetransferinstance.cpp \
+    filereadahead.cpp \
+    filewritebehind.cpp \
+    profilesaver.cpp \
+    coreeventqueue.cpp \
+    coreprofiler.cpp \
+    memoryreport.cpp \
+    widget/corestatsdialog.cpp \
+    widget/imageviewer.cpp \
+    filecheckpoints.cpp \
     corestructs.cpp \
     widget/settingsdialog.cpp
+
+# The OpenGL video surface needs QOpenGLWidget, older Qt versions draw video in software
+greaterThan(QT_MAJOR_VERSION, 4):greaterThan(QT_MINOR_VERSION, 3) {
+    DEFINES += QTOX_OPENGL_VIDEO
+    HEADERS += widget/videosurface.h
+    SOURCES += widget/videosurface.cpp
+}
+
+# qmake CONFIG+=bench builds qtox-bench instead, the benchmarks of the hot paths, in a build directory of its own
+bench {
+    TARGET = qtox-bench
+    CONFIG += console
+    SOURCES -= main.cpp
+    HEADERS += bench/bench.h
+    SOURCES += bench/main.cpp \
+        bench/bench.cpp \
+        bench/benchmarks.cpp
+}
@@ -16,21 +16,24 @@
 
 #include "settings.h"
 #include "smileypack.h"
+#include "coredefines.h"
 
 #include <QFont>
-#include <QApplication>
+#include <QGuiApplication>
 #include <QDir>
 #include <QFile>
 #include <QSettings>
 #include <QStandardPaths>
 #include <QDebug>
 #include <QList>
+#include <QTimer>
+#include <QMutexLocker>
 
 const QString Settings::FILENAME = "settings.ini";
 bool Settings::makeToxPortable{false};
 
 Settings::Settings() :
-    loaded(false), useCustomDhtList{false}
+    loaded(false), saveTimer{nullptr}, useCustomDhtList{false}
 {
     load();
 }
@@ -94,6 +97,20 @@ void Settings::load()
         }
         else
             useCustomDhtList=false;
+
+        int knownNodesSize = s.beginReadArray("knownNodes");
+        for (int i = 0; i < knownNodesSize; i ++) {
+            s.setArrayIndex(i);
+            KnownDhtNode node;
+            node.name = s.value("name").toString();
+            node.userId = s.value("userId").toString();
+            node.address = s.value("address").toString();
+            node.port = s.value("port").toInt();
+            node.connectTime = s.value("connectTime").toInt();
+            node.lastConnected = s.value("lastConnected").toDateTime();
+            knownDhtNodes << node;
+        }
+        s.endArray();
     s.endGroup();
 
     friendAddresses.clear();
@@ -101,7 +118,8 @@ void Settings::load()
         int size = s.beginReadArray("fullAddresses");
         for (int i = 0; i < size; i ++) {
             s.setArrayIndex(i);
-            friendAddresses.append(s.value("addr").toString());
+            QString address = s.value("addr").toString();
+            friendAddresses.insert(address.left(TOX_ID_PUBLIC_KEY_LENGTH).toUpper(), address);
         }
         s.endArray();
     s.endGroup();
@@ -110,6 +128,21 @@ void Settings::load()
         enableIPv6 = s.value("enableIPv6", true).toBool();
         useTranslations = s.value("useTranslations", true).toBool();
         makeToxPortable = s.value("makeToxPortable", false).toBool();
+        uploadLimit = s.value("uploadLimit", 0).toInt();
+        hashTransfers = s.value("hashTransfers", true).toBool();
+        logCoreStats = s.value("logCoreStats", false).toBool();
+    s.endGroup();
+
+    s.beginGroup("AV");
+        minVideoFps = s.value("minVideoFps", TOXAV_VIDEO_MIN_FPS).toInt();
+        maxVideoFps = s.value("maxVideoFps", TOXAV_VIDEO_MAX_FPS).toInt();
+        minVideoSize = s.value("minVideoSize", QSize(320, 240)).toSize();
+        useOpenGLVideo = s.value("useOpenGLVideo", true).toBool();
+        voiceDetection = s.value("voiceDetection", true).toBool();
+        camResolution = s.value("camResolution", QSize(640, 480)).toSize();
+        camFps = s.value("camFps", 0).toInt();
+        camFormat = s.value("camFormat", "").toString();
+        camReleaseDelay = s.value("camReleaseDelay", CAMERA_RELEASE_DELAY).toInt();
     s.endGroup();
 
     s.beginGroup("Widgets");
@@ -124,10 +157,12 @@ void Settings::load()
         smileyPack = s.value("smileyPack", QString()).toString();
         customEmojiFont = s.value("customEmojiFont", true).toBool();
         emojiFontFamily = s.value("emojiFontFamily", "DejaVu Sans").toString();
-        emojiFontPointSize = s.value("emojiFontPointSize", QApplication::font().pointSize()).toInt();
+        emojiFontPointSize = s.value("emojiFontPointSize", QGuiApplication::font().pointSize()).toInt();
         firstColumnHandlePos = s.value("firstColumnHandlePos", 50).toInt();
         secondColumnHandlePosFromRight = s.value("secondColumnHandlePosFromRight", 50).toInt();
         timestampFormat = s.value("timestampFormat", "hh:mm").toString();
+        scrollbackLimit = s.value("scrollbackLimit", 2000).toInt();
+        highlightWords = s.value("highlightWords").toStringList();
         minimizeOnClose = s.value("minimizeOnClose", false).toBool();
         useNativeStyle = s.value("nativeStyle", false).toBool();
         useNativeDecoration = s.value("nativeDecoration", true).toBool();
@@ -141,6 +176,8 @@ void Settings::load()
 
     s.beginGroup("Privacy");
         typingNotification = s.value("typingNotification", false).toBool();
+        enableLogging = s.value("enableLogging", false).toBool();
+        encryptLogs = s.value("encryptLogs", false).toBool();
     s.endGroup();
 
     // try to set a smiley pack if none is selected
@@ -176,9 +213,24 @@ void Settings::save()
     save(filePath);
 }
 
+void Settings::requestSave()
+{
+    if (!saveTimer)
+    {
+        saveTimer = new QTimer(this);
+        saveTimer->setSingleShot(true);
+        saveTimer->setInterval(SETTINGS_SAVE_DELAY);
+        connect(saveTimer, &QTimer::timeout, this, [this](){save();});
+    }
+    if (!saveTimer->isActive())
+        saveTimer->start();
+}
+
 void Settings::save(QString path)
 {
     qDebug() << "Settings: Saving in "<<path;
+    if (saveTimer)
+        saveTimer->stop();
 
     QSettings s(path, QSettings::IniFormat);
 
@@ -195,21 +247,51 @@ void Settings::save(QString path)
             s.setValue("port", dhtServerList[i].port);
         }
         s.endArray();
+        s.beginWriteArray("knownNodes", knownDhtNodes.size());
+        for (int i = 0; i < knownDhtNodes.size(); i ++) {
+            s.setArrayIndex(i);
+            s.setValue("name", knownDhtNodes[i].name);
+            s.setValue("userId", knownDhtNodes[i].userId);
+            s.setValue("address", knownDhtNodes[i].address);
+            s.setValue("port", knownDhtNodes[i].port);
+            s.setValue("connectTime", knownDhtNodes[i].connectTime);
+            s.setValue("lastConnected", knownDhtNodes[i].lastConnected);
+        }
+        s.endArray();
     s.endGroup();
 
     s.beginGroup("Friends");
+    {
+        QMutexLocker locker(&friendAddressesMutex);
         s.beginWriteArray("fullAddresses", friendAddresses.size());
-        for (int i = 0; i < friendAddresses.size(); i ++) {
-            s.setArrayIndex(i);
-            s.setValue("addr", friendAddresses[i]);
+        int i = 0;
+        for (const QString& address : friendAddresses) {
+            s.setArrayIndex(i++);
+            s.setValue("addr", address);
         }
         s.endArray();
+    }
     s.endGroup();
 
     s.beginGroup("General");
         s.setValue("enableIPv6", enableIPv6);
         s.setValue("useTranslations",useTranslations);
         s.setValue("makeToxPortable",makeToxPortable);
+        s.setValue("uploadLimit", uploadLimit);
+        s.setValue("hashTransfers", hashTransfers);
+        s.setValue("logCoreStats", logCoreStats);
+    s.endGroup();
+
+    s.beginGroup("AV");
+        s.setValue("minVideoFps", minVideoFps);
+        s.setValue("maxVideoFps", maxVideoFps);
+        s.setValue("minVideoSize", minVideoSize);
+        s.setValue("useOpenGLVideo", useOpenGLVideo);
+        s.setValue("voiceDetection", voiceDetection);
+        s.setValue("camResolution", camResolution);
+        s.setValue("camFps", camFps);
+        s.setValue("camFormat", camFormat);
+        s.setValue("camReleaseDelay", camReleaseDelay);
     s.endGroup();
 
     s.beginGroup("Widgets");
@@ -228,6 +310,8 @@ void Settings::save(QString path)
         s.setValue("firstColumnHandlePos", firstColumnHandlePos);
         s.setValue("secondColumnHandlePosFromRight", secondColumnHandlePosFromRight);
         s.setValue("timestampFormat", timestampFormat);
+        s.setValue("scrollbackLimit", scrollbackLimit);
+        s.setValue("highlightWords", highlightWords);
         s.setValue("minimizeOnClose", minimizeOnClose);
         s.setValue("nativeStyle", useNativeStyle);
         s.setValue("nativeDecoration", useNativeDecoration);
@@ -241,6 +325,8 @@ void Settings::save(QString path)
 
     s.beginGroup("Privacy");
         s.setValue("typingNotification", typingNotification);
+        s.setValue("enableLogging", enableLogging);
+        s.setValue("encryptLogs", encryptLogs);
     s.endGroup();
 }
 
@@ -268,6 +354,29 @@ void Settings::setDhtServerList(const QList<DhtServer>& newDhtServerList)
     emit dhtServerListChanged();
 }
 
+QString Settings::getFriendAddress(const QString& publicKey) const
+{
+    QMutexLocker locker(&friendAddressesMutex);
+    return friendAddresses.value(publicKey.toUpper());
+}
+
+void Settings::updateFriendAddress(const QString& address)
+{
+    QMutexLocker locker(&friendAddressesMutex);
+    friendAddresses.insert(address.left(TOX_ID_PUBLIC_KEY_LENGTH).toUpper(), address);
+}
+
+QList<KnownDhtNode> Settings::getKnownDhtNodes() const
+{
+    return knownDhtNodes;
+}
+
+void Settings::setKnownDhtNodes(const QList<KnownDhtNode>& nodes)
+{
+    knownDhtNodes = nodes;
+    requestSave();
+}
+
 bool Settings::getEnableIPv6() const
 {
     return enableIPv6;
@@ -278,6 +387,126 @@ void Settings::setEnableIPv6(bool newValue)
     enableIPv6 = newValue;
 }
 
+bool Settings::getHashTransfers() const
+{
+    return hashTransfers;
+}
+
+void Settings::setHashTransfers(bool newValue)
+{
+    hashTransfers = newValue;
+}
+
+bool Settings::getLogCoreStats() const
+{
+    return logCoreStats;
+}
+
+void Settings::setLogCoreStats(bool newValue)
+{
+    logCoreStats = newValue;
+}
+
+int Settings::getMinVideoFps() const
+{
+    return minVideoFps;
+}
+
+void Settings::setMinVideoFps(int newValue)
+{
+    minVideoFps = newValue;
+}
+
+int Settings::getMaxVideoFps() const
+{
+    return maxVideoFps;
+}
+
+void Settings::setMaxVideoFps(int newValue)
+{
+    maxVideoFps = newValue;
+}
+
+QSize Settings::getMinVideoSize() const
+{
+    return minVideoSize;
+}
+
+void Settings::setMinVideoSize(QSize newValue)
+{
+    minVideoSize = newValue;
+}
+
+bool Settings::getVoiceDetection() const
+{
+    return voiceDetection;
+}
+
+void Settings::setVoiceDetection(bool newValue)
+{
+    voiceDetection = newValue;
+}
+
+bool Settings::getUseOpenGLVideo() const
+{
+    return useOpenGLVideo;
+}
+
+void Settings::setUseOpenGLVideo(bool newValue)
+{
+    useOpenGLVideo = newValue;
+}
+
+QSize Settings::getCamResolution() const
+{
+    return camResolution;
+}
+
+void Settings::setCamResolution(QSize newValue)
+{
+    camResolution = newValue;
+}
+
+int Settings::getCamFps() const
+{
+    return camFps;
+}
+
+void Settings::setCamFps(int newValue)
+{
+    camFps = newValue;
+}
+
+QString Settings::getCamFormat() const
+{
+    return camFormat;
+}
+
+void Settings::setCamFormat(const QString& newValue)
+{
+    camFormat = newValue;
+}
+
+int Settings::getCamReleaseDelay() const
+{
+    return camReleaseDelay;
+}
+
+void Settings::setCamReleaseDelay(int newValue)
+{
+    camReleaseDelay = newValue;
+}
+
+int Settings::getUploadLimit() const
+{
+    return uploadLimit;
+}
+
+void Settings::setUploadLimit(int newValue)
+{
+    uploadLimit = newValue;
+}
+
 bool Settings::getMakeToxPortable() const
 {
     return makeToxPortable;
@@ -309,6 +538,7 @@ bool Settings::getEnableLogging() const
 void Settings::setEnableLogging(bool newValue)
 {
     enableLogging = newValue;
+    emit logStorageOptsChanged();
 }
 
 bool Settings::getEncryptLogs() const
@@ -319,6 +549,7 @@ bool Settings::getEncryptLogs() const
 void Settings::setEncryptLogs(bool newValue)
 {
     encryptLogs = newValue;
+    emit logStorageOptsChanged();
 }
 
 void Settings::setWidgetData(const QString& uniqueName, const QByteArray& data)
@@ -405,6 +636,27 @@ void Settings::setTimestampFormat(const QString &format)
     emit timestampFormatChanged();
 }
 
+int Settings::getScrollbackLimit() const
+{
+    return scrollbackLimit;
+}
+
+void Settings::setScrollbackLimit(int rows)
+{
+    scrollbackLimit = rows;
+}
+
+QStringList Settings::getHighlightWords() const
+{
+    return highlightWords;
+}
+
+void Settings::setHighlightWords(const QStringList& words)
+{
+    highlightWords = words;
+    emit highlightWordsChanged();
+}
+
 QString Settings::getEmojiFontFamily() const
 {
     return emojiFontFamily;
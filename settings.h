@@ -19,6 +19,12 @@
 
 #include <QHash>
 #include <QObject>
+#include <QSize>
+#include <QStringList>
+#include <QMutex>
+#include "corestructs.h"
+
+class QTimer;
 
 class Settings : public QObject
 {
@@ -42,6 +48,8 @@ public:
     const QList<DhtServer>& getDhtServerList() const;
     void setDhtServerList(const QList<DhtServer>& newDhtServerList);
 
+    QList<KnownDhtNode> getKnownDhtNodes() const; ///< Nodes that answered recently, tried first on startup
+
     bool getEnableIPv6() const;
     void setEnableIPv6(bool newValue);
 
@@ -57,6 +65,42 @@ public:
     bool getEncryptLogs() const;
     void setEncryptLogs(bool newValue);
 
+    int getUploadLimit() const; ///< In KiB/s, 0 means unlimited
+    void setUploadLimit(int newValue);
+
+    bool getHashTransfers() const;
+    void setHashTransfers(bool newValue);
+
+    bool getLogCoreStats() const; ///< Core logs its CoreProfiler report with the loop latency, read from the Core thread
+    void setLogCoreStats(bool newValue);
+
+    int getMinVideoFps() const; ///< What the call video rate controller may step down to
+    void setMinVideoFps(int newValue);
+
+    int getMaxVideoFps() const;
+    void setMaxVideoFps(int newValue);
+
+    QSize getMinVideoSize() const; ///< Smallest size the rate controller may scale call video down to
+    void setMinVideoSize(QSize newValue);
+
+    bool getVoiceDetection() const; ///< Don't send the silence between what's said in calls
+    void setVoiceDetection(bool newValue);
+
+    bool getUseOpenGLVideo() const; ///< Draw video with the OpenGL surface when the system has one
+    void setUseOpenGLVideo(bool newValue);
+
+    QSize getCamResolution() const; ///< What we ask the camera for, the device may pick the closest it has
+    void setCamResolution(QSize newValue);
+
+    int getCamFps() const; ///< 0 lets the device decide
+    void setCamFps(int newValue);
+
+    QString getCamFormat() const; ///< FOURCC to ask the camera for, empty lets the device decide
+    void setCamFormat(const QString& newValue);
+
+    int getCamReleaseDelay() const; ///< Seconds the camera stays open after its last user, 0 closes it right away
+    void setCamReleaseDelay(int newValue);
+
     // Assume all widgets have unique names
     // Don't use it to save every single thing you want to save, use it
     // for some general purpose widgets, such as MainWindows or Splitters,
@@ -104,6 +148,12 @@ public:
     const QString &getTimestampFormat() const;
     void setTimestampFormat(const QString &format);
 
+    int getScrollbackLimit() const; ///< Rows a chat keeps in memory, older ones go to disk. 0 keeps them all
+    void setScrollbackLimit(int rows);
+
+    QStringList getHighlightWords() const; ///< Alert in group chats like a mention of our name does
+    void setHighlightWords(const QStringList& words);
+
     bool isMinimizeOnCloseEnabled() const;
     void setMinimizeOnClose(bool newValue);
 
@@ -126,12 +176,18 @@ public:
     QByteArray getSplitterState() const;
     void setSplitterState(const QByteArray &value);
 
+    QString getFriendAddress(const QString& publicKey) const; ///< The full address we added a friend with, empty if we don't know it
+    void updateFriendAddress(const QString& address);
+
 public:
-    QList<QString> friendAddresses;
     void save();
     void save(QString path);
     void load();
 
+public slots:
+    void requestSave(); ///< Saves within SETTINGS_SAVE_DELAY, more requests until then are merged in one save
+    void setKnownDhtNodes(const QList<KnownDhtNode>& nodes); ///< Connected to Core, which keeps the list up to date
+
 private:
     Settings();
     Settings(Settings &settings) = delete;
@@ -140,14 +196,29 @@ private:
     static const QString FILENAME;
 
     bool loaded;
+    QTimer* saveTimer; ///< Created by the first requestSave, on the GUI thread
 
     bool useCustomDhtList;
     QList<DhtServer> dhtServerList;
+    QList<KnownDhtNode> knownDhtNodes;
+    QHash<QString, QString> friendAddresses; ///< By uppercase public key, written by Core and read by the GUI
+    mutable QMutex friendAddressesMutex;
     int dhtServerId;
     bool dontShowDhtDialog;
 
     bool enableIPv6;
     bool useTranslations;
+    int uploadLimit;
+    bool hashTransfers;
+    bool logCoreStats;
+    int minVideoFps, maxVideoFps;
+    QSize minVideoSize;
+    bool useOpenGLVideo;
+    bool voiceDetection;
+    QSize camResolution;
+    int camFps;
+    QString camFormat;
+    int camReleaseDelay;
     static bool makeToxPortable;
 
     bool enableLogging;
@@ -172,6 +243,8 @@ private:
     int firstColumnHandlePos;
     int secondColumnHandlePosFromRight;
     QString timestampFormat;
+    int scrollbackLimit;
+    QStringList highlightWords;
 
     // Privacy
     bool typingNotification;
@@ -183,6 +256,7 @@ signals:
     void smileyPackChanged();
     void emojiFontChanged();
     void timestampFormatChanged();
+    void highlightWordsChanged();
 };
 
 #endif // SETTINGS_HPP
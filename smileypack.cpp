@@ -16,20 +16,30 @@
 
 #include "smileypack.h"
 #include "settings.h"
+#include "startuptrace.h"
 
 #include <QFileInfo>
 #include <QFile>
-#include <QIcon>
-#include <QPixmap>
 #include <QDir>
 #include <QCoreApplication>
 #include <QDomDocument>
 #include <QDomElement>
-#include <QBuffer>
+#include <QUrl>
 #include <QStringBuilder>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMutexLocker>
+#include <QCryptographicHash>
+#include <QStandardPaths>
+#include <QDataStream>
+#include <QSaveFile>
+#include <QDateTime>
+#include <QDebug>
 
 SmileyPack::SmileyPack()
+    : generation{0}, loadedGeneration{-1}, loaded{false}
 {
+    pack.trieImages = QVector<int>{-1};
     load(Settings::getInstance().getSmileyPack());
     connect(&Settings::getInstance(), &Settings::smileyPackChanged, this, &SmileyPack::onSmileyPackChanged);
 }
@@ -82,14 +92,71 @@ bool SmileyPack::isValid(const QString &filename)
     return QFile(filename).exists();
 }
 
+/// Parses the pack and publishes it, then loads the images and publishes it again
+class SmileyPack::Loader : public QRunnable
+{
+public:
+    Loader(SmileyPack* Owner, const QString& Filename, int Generation)
+        : owner{Owner}, filename{Filename}, generation{Generation} {}
+
+    void run()
+    {
+        StartupTrace::Phase phase("Smiley pack");
+        Pack pack;
+        if (!parse(filename, pack))
+            qWarning() << "SmileyPack: Can't open" << filename;
+        buildTrie(pack);
+        publish(pack);
+
+        loadImages(filename, pack);
+        buildTrie(pack);
+        publish(pack);
+    }
+
+private:
+    void publish(const Pack& pack)
+    {
+        QMutexLocker locker(&owner->loadMutex);
+        if (generation != owner->generation)
+            return;
+        owner->loadedPack = pack;
+        owner->loadedGeneration = generation;
+        owner->loaded = true;
+        QMetaObject::invokeMethod(owner, "onLoaderProgress", Qt::QueuedConnection);
+    }
+
+private:
+    SmileyPack* owner;
+    QString filename;
+    int generation;
+};
+
 bool SmileyPack::load(const QString& filename)
 {
-    // discard old data
-    filenameTable.clear();
-    imgCache.clear();
-    emoticons.clear();
-    path.clear();
+    {
+        QMutexLocker locker(&loadMutex);
+        generation++;
+        loaded = false;
+        QThreadPool::globalInstance()->start(new Loader(this, filename, generation));
+    }
+    return QFile(filename).exists();
+}
 
+void SmileyPack::onLoaderProgress()
+{
+    {
+        QMutexLocker locker(&loadMutex);
+        if (!loaded || loadedGeneration != generation)
+            return;
+        pack = loadedPack;
+        loadedPack = Pack();
+        loaded = false;
+    }
+    emit packChanged();
+}
+
+bool SmileyPack::parse(const QString& filename, Pack& pack)
+{
     // open emoticons.xml
     QFile xmlFile(filename);
     if(!xmlFile.open(QIODevice::ReadOnly))
@@ -110,7 +177,7 @@ bool SmileyPack::load(const QString& filename)
      * </messaging-emoticon-map>
      */
 
-    path = QFileInfo(filename).absolutePath();
+    pack.path = QFileInfo(filename).absolutePath();
 
     QDomDocument doc;
     doc.setContent(xmlFile.readAll());
@@ -122,23 +189,97 @@ bool SmileyPack::load(const QString& filename)
         QDomElement stringElement = emoticonElements.at(i).firstChildElement("string");
 
         QStringList emoticonSet; // { ":)", ":-)" } etc.
+        if (!pack.imageIndex.contains(file)) // each file is loaded once, however many sets use it
+        {
+            pack.imageIndex.insert(file, pack.files.size());
+            pack.files << file;
+        }
 
         while (!stringElement.isNull())
         {
             QString emoticon = stringElement.text();
-            filenameTable.insert(emoticon, file);
+            pack.filenameTable.insert(emoticon, file);
             emoticonSet.push_back(emoticon);
-            cacheSmiley(file); // preload all smileys
 
             stringElement = stringElement.nextSibling().toElement();
         }
-        emoticons.push_back(emoticonSet);
+        pack.emoticons.push_back(emoticonSet);
+        pack.emoticonFiles.push_back(file);
     }
 
     // success!
     return true;
 }
 
+QString SmileyPack::cacheFile(const QString& filename)
+{
+    QByteArray key = QCryptographicHash::hash(QFileInfo(filename).absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("smileys/" + key.toHex() + ".cache");
+}
+
+void SmileyPack::loadImages(const QString& filename, Pack& pack)
+{
+    QSize size(16, 16); // TODO: adapt to text size
+    QDir dir(pack.path);
+    QVector<qint64> mtimes;
+    mtimes << QFileInfo(filename).lastModified().toMSecsSinceEpoch();
+    for (const QString& file : pack.files)
+        mtimes << QFileInfo(dir.filePath(file)).lastModified().toMSecsSinceEpoch();
+
+    // Valid while neither the cfg nor an image was modified
+    QFile cache(cacheFile(filename));
+    if (cache.open(QIODevice::ReadOnly))
+    {
+        QDataStream in(&cache);
+        quint32 magic;
+        QSize cachedSize;
+        QStringList cachedFiles;
+        QVector<qint64> cachedMtimes;
+        QVector<QImage> images;
+        in >> magic >> cachedSize >> cachedFiles >> cachedMtimes >> images;
+        if (in.status() == QDataStream::Ok && magic == SMILEYPACK_CACHE_MAGIC && cachedSize == size
+                && cachedFiles == pack.files && cachedMtimes == mtimes && images.size() == pack.files.size())
+        {
+            pack.images = images;
+            return;
+        }
+        cache.close();
+    }
+
+    pack.images.clear();
+    for (const QString& file : pack.files)
+    {
+        QImage img(dir.filePath(file));
+        if (!img.isNull())
+            img = img.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        pack.images << img;
+    }
+
+    QDir().mkpath(QFileInfo(cache.fileName()).absolutePath());
+    QSaveFile save(cache.fileName());
+    if (!save.open(QIODevice::WriteOnly))
+        return;
+    QDataStream out(&save);
+    out << (quint32)SMILEYPACK_CACHE_MAGIC << size << pack.files << mtimes << pack.images;
+    if (!save.commit())
+        qWarning() << "SmileyPack: Can't write the cache" << save.fileName();
+}
+
+void SmileyPack::buildTrie(Pack& pack)
+{
+    pack.trie.clear();
+    pack.trieImages = QVector<int>{-1};
+    for (int i = 0; i < pack.emoticons.size(); ++i)
+    {
+        int image = pack.imageIndex.value(pack.emoticonFiles[i]);
+        // Until the images are loaded, every emoticon gets a placeholder
+        if (!pack.images.isEmpty() && pack.images[image].isNull())
+            continue;
+        for (const QString& emoticon : pack.emoticons[i])
+            addToTrie(pack, emoticon, image);
+    }
+}
+
 QString SmileyPack::smileyfied(QString msg)
 {
     QRegExp exp("\\S+"); // matches words
@@ -149,7 +290,7 @@ QString SmileyPack::smileyfied(QString msg)
     while (index >= 0)
     {
         QString key = exp.cap();
-        if (filenameTable.contains(key))
+        if (pack.filenameTable.contains(key))
         {
             QString imgRichText = getAsRichText(key);
 
@@ -164,53 +305,94 @@ QString SmileyPack::smileyfied(QString msg)
 
 QList<QStringList> SmileyPack::getEmoticons() const
 {
-    return emoticons;
+    return pack.emoticons;
 }
 
-QString SmileyPack::getAsRichText(const QString &key)
+void SmileyPack::addToTrie(Pack& pack, const QString& emoticon, int image)
 {
-    return "<img src=\"data:image/png;base64," % QString(getCachedSmiley(key).toBase64()) % "\">";
+    int node = 0;
+    for (QChar c : emoticon)
+    {
+        quint64 key = (quint64)node << 16 | c.unicode();
+        auto it = pack.trie.find(key);
+        if (it == pack.trie.end())
+        {
+            it = pack.trie.insert(key, pack.trieImages.size());
+            pack.trieImages.append(-1);
+        }
+        node = *it;
+    }
+    if (node)
+        pack.trieImages[node] = image;
 }
 
-QIcon SmileyPack::getAsIcon(const QString &key)
+int SmileyPack::matchAt(const QChar* begin, const QChar* before, const QChar* end, int& image) const
 {
-    QPixmap pm;
-    pm.loadFromData(getCachedSmiley(key), "PNG");
+    if (begin != before && begin->isLetterOrNumber() && begin[-1].isLetterOrNumber())
+        return 0;
 
-    return QIcon(pm);
+    int node = 0, best = 0;
+    for (const QChar* c = begin; c != end; c++)
+    {
+        auto it = pack.trie.find((quint64)node << 16 | c->unicode());
+        if (it == pack.trie.end())
+            break;
+        node = *it;
+        if (pack.trieImages[node] >= 0 && (c+1 == end || !c->isLetterOrNumber() || !c[1].isLetterOrNumber()))
+        {
+            best = c + 1 - begin;
+            image = pack.trieImages[node];
+        }
+    }
+    return best;
 }
 
-void SmileyPack::cacheSmiley(const QString &name)
+QString SmileyPack::getImageRichText(int image)
 {
-    QSize size(16, 16); // TODO: adapt to text size
-    QString filename = QDir(path).filePath(name);
-    QImage img(filename);
-
-    if (!img.isNull())
-    {
-        QImage scaledImg = img.scaled(size, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    return "<img src=\"smiley:" % QString::number(image) % "\">";
+}
 
-        QByteArray scaledImgData;
-        QBuffer buffer(&scaledImgData);
-        scaledImg.save(&buffer, "PNG");
+QString SmileyPack::getAsRichText(const QString &key)
+{
+    int image = pack.imageIndex.value(pack.filenameTable.value(key), -1);
+    return image >= 0 ? getImageRichText(image) : QString();
+}
 
-        imgCache.insert(name, scaledImgData);
+QImage SmileyPack::getImage(const QUrl& url) const
+{
+    if (url.scheme() != "smiley")
+        return QImage();
+    bool ok;
+    int image = url.path().toInt(&ok);
+    if (!ok || image < 0 || image >= pack.files.size())
+        return QImage();
+    if (image >= pack.images.size())
+    {
+        static QImage placeholder;
+        if (placeholder.isNull())
+        {
+            placeholder = QImage(16, 16, QImage::Format_ARGB32_Premultiplied);
+            placeholder.fill(Qt::transparent);
+        }
+        return placeholder;
     }
+    return pack.images[image];
 }
 
-QByteArray SmileyPack::getCachedSmiley(const QString &key)
+QImage SmileyPack::getAsImage(const QString &key) const
 {
-    // valid key?
-    if (!filenameTable.contains(key))
-        return QByteArray();
-
-    // cache it if needed
-    QString file = filenameTable.value(key);
-    if (!imgCache.contains(file)) {
-        cacheSmiley(file);
-    }
+    int image = pack.imageIndex.value(pack.filenameTable.value(key), -1);
+    if (image < 0 || image >= pack.images.size())
+        return QImage();
+    return pack.images[image];
+}
 
-    return imgCache.value(file);
+qint64 SmileyPack::getImageMemory() const
+{
+    qint64 bytes = 0;
+    for (const QImage& image : pack.images)
+        bytes += image.byteCount();
+    return bytes;
 }
 
 void SmileyPack::onSmileyPackChanged()
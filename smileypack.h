@@ -21,13 +21,23 @@
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include <QVector>
+#include <QImage>
+#include <QMutex>
+
+class QUrl;
 
 #define SMILEYPACK_SEARCH_PATHS                                                                                             \
     {                                                                                                                       \
         "./smileys", "/usr/share/qtox/smileys", "/usr/share/emoticons", "~/.kde4/share/emoticons", "~/.kde/share/emoticons" \
     }
 
+// "QSM1", the start of our scaled image caches
+#define SMILEYPACK_CACHE_MAGIC 0x51534d31
+
 //maps emoticons to smileys
+//packs are parsed and their images scaled on a worker thread, with the scaled images cached on disk.
+//Until the images are ready, documents get a transparent placeholder of the same size
 class SmileyPack : public QObject
 {
     Q_OBJECT
@@ -36,27 +46,57 @@ public:
     static QList<QPair<QString, QString> > listSmileyPacks(const QStringList& paths = SMILEYPACK_SEARCH_PATHS);
     static bool isValid(const QString& filename);
 
-    bool load(const QString& filename);
+    bool load(const QString& filename); ///< Returns at once, packChanged tells when it's loaded
     QString smileyfied(QString msg);
+    /// Length of the longest emoticon at begin, 0 if there's none. Emoticons that start or end
+    /// with a letter or digit must not be glued to another one, so "xD" doesn't match in "boxDrive"
+    int matchAt(const QChar* begin, const QChar* before, const QChar* end, int& image) const;
     QList<QStringList> getEmoticons() const;
     QString getAsRichText(const QString& key);
-    QIcon getAsIcon(const QString& key);
+    static QString getImageRichText(int image); ///< References the image by a smiley: URL
+    QImage getImage(const QUrl& url) const; ///< For documents loading a smiley: URL
+    QImage getAsImage(const QString& key) const; ///< Null until the images are loaded
+    qint64 getImageMemory() const; ///< Of the loaded pack's scaled images
+
+signals:
+    void packChanged(); ///< The emoticons or their images changed, what was rendered with them is stale
 
 private slots:
     void onSmileyPackChanged();
+    void onLoaderProgress(); ///< Takes what the loader published
 
 private:
+    /// Everything we know about a pack, built by the loader and then swapped in on the GUI thread
+    struct Pack
+    {
+        QHash<QString, QString> filenameTable; // matches an emoticon to its corresponding smiley ie. ":)" -> "happy.png"
+        QHash<QString, int> imageIndex; // "happy.png" -> index in images
+        QStringList files; // by index
+        QVector<QImage> images; // (scaled) smileys, shared by every document showing them, empty while loading
+        QHash<quint64, int> trie; // (node << 16 | char) -> child node, the root is node 0
+        QVector<int> trieImages; // image matched by ending at a node, or -1
+        QList<QStringList> emoticons; // {{ ":)", ":-)" }, {":(", ...}, ... }
+        QStringList emoticonFiles; // the file of each set of emoticons
+        QString path; // directory containing the cfg and image files
+    };
+    class Loader;
+
     SmileyPack();
     SmileyPack(SmileyPack&) = delete;
     SmileyPack& operator=(const SmileyPack&) = delete;
 
-    void cacheSmiley(const QString& name);
-    QByteArray getCachedSmiley(const QString& key);
+    static bool parse(const QString& filename, Pack& pack);
+    static void loadImages(const QString& filename, Pack& pack); ///< From the disk cache if it's fresh
+    static void buildTrie(Pack& pack); ///< Leaves out the emoticons whose image didn't load
+    static void addToTrie(Pack& pack, const QString& emoticon, int image);
+    static QString cacheFile(const QString& filename);
 
-    QHash<QString, QString> filenameTable; // matches an emoticon to its corresponding smiley ie. ":)" -> "happy.png"
-    QHash<QString, QByteArray> imgCache; // (scaled) representation of a smiley ie. "happy.png" -> data
-    QList<QStringList> emoticons; // {{ ":)", ":-)" }, {":(", ...}, ... }
-    QString path; // directory containing the cfg and image files
+    Pack pack; ///< GUI thread only
+    QMutex loadMutex;
+    int generation; ///< Of the last load we started, results of older ones are dropped
+    int loadedGeneration;
+    bool loaded; ///< loadedPack is waiting for onLoaderProgress
+    Pack loadedPack;
 };
 
 #endif // SMILEYPACK_H
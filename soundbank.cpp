@@ -0,0 +1,83 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "soundbank.h"
+#include <QFile>
+#include <QDebug>
+
+/// Raw PCM in the resources
+static const struct
+{
+    const char* file;
+    ALenum format;
+    ALsizei sampleRate;
+} soundFiles[SoundBank::SoundCount] = {
+    {":audio/notification.pcm", AL_FORMAT_MONO16, 44100},
+};
+
+QAtomicInt SoundBank::bufferMemory;
+
+SoundBank::SoundBank()
+    : lastSound{SoundCount}, uploaded{0}
+{
+    alGenSources(1, &source);
+    alGenBuffers(SoundCount, buffers);
+    for (int i=0; i<SoundCount; i++)
+    {
+        QFile file(soundFiles[i].file);
+        if (!file.open(QIODevice::ReadOnly))
+        {
+            qWarning() << "SoundBank: Can't open" << soundFiles[i].file;
+            alDeleteBuffers(1, &buffers[i]);
+            buffers[i] = 0;
+            continue;
+        }
+        QByteArray data = file.readAll();
+        alBufferData(buffers[i], soundFiles[i].format, data.constData(), data.size(), soundFiles[i].sampleRate);
+        uploaded += data.size();
+    }
+    bufferMemory.fetchAndAddRelaxed(uploaded);
+}
+
+SoundBank::~SoundBank()
+{
+    alSourceStop(source);
+    alDeleteSources(1, &source);
+    for (ALuint buffer : buffers)
+        if (buffer)
+            alDeleteBuffers(1, &buffer);
+    bufferMemory.fetchAndAddRelaxed(-uploaded);
+}
+
+void SoundBank::play(Sound sound)
+{
+    if (sound < 0 || sound >= SoundCount || !buffers[sound])
+        return;
+
+    if (sound == lastSound && lastPlay.isValid())
+    {
+        ALint state;
+        alGetSourcei(source, AL_SOURCE_STATE, &state);
+        if (state == AL_PLAYING || lastPlay.elapsed() < TOX_SOUND_COALESCE_INTERVAL)
+            return;
+    }
+
+    alSourceStop(source);
+    alSourcei(source, AL_BUFFER, buffers[sound]);
+    alSourcePlay(source);
+    lastSound = sound;
+    lastPlay.start();
+}
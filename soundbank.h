@@ -0,0 +1,50 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef SOUNDBANK_H
+#define SOUNDBANK_H
+
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include "coreav.h"
+
+/// Our alert sounds, decoded and uploaded to AL buffers once when the output device opens.
+/// A sound played again while it's still playing, or within TOX_SOUND_COALESCE_INTERVAL of
+/// starting, is merged into that playback, so a burst of messages rings once.
+class SoundBank
+{
+public:
+    enum Sound
+    {
+        NewMessage,
+        SoundCount
+    };
+
+    SoundBank(); ///< Needs the output context to be current
+    ~SoundBank();
+    void play(Sound sound); ///< Main thread only
+    static int getBufferMemory() {return bufferMemory.load();} ///< Of the uploaded sounds, from any thread
+
+private:
+    ALuint source;
+    ALuint buffers[SoundCount]; ///< 0 if the sound failed to load
+    Sound lastSound;
+    QElapsedTimer lastPlay;
+    int uploaded; ///< Bytes, ours in bufferMemory
+    static QAtomicInt bufferMemory;
+};
+
+#endif // SOUNDBANK_H
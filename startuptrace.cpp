@@ -0,0 +1,97 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "startuptrace.h"
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QThread>
+#include <QTextStream>
+#include <cstdio>
+
+QMutex StartupTrace::mutex;
+QElapsedTimer StartupTrace::clock;
+QList<StartupTrace::Entry> StartupTrace::entries;
+bool StartupTrace::printing{false};
+bool StartupTrace::finished{false};
+
+static QString currentThreadName()
+{
+    QThread* thread = QThread::currentThread();
+    if (QCoreApplication::instance() && thread == QCoreApplication::instance()->thread())
+        return "GUI";
+    if (!thread->objectName().isEmpty())
+        return thread->objectName();
+    return QString("0x%1").arg(reinterpret_cast<quintptr>(thread), 0, 16);
+}
+
+void StartupTrace::start(bool print)
+{
+    QMutexLocker locker(&mutex);
+    printing = print;
+    clock.start();
+}
+
+void StartupTrace::begin(const char* phase)
+{
+    QMutexLocker locker(&mutex);
+    if (finished || !clock.isValid())
+        return;
+    entries.append({phase, currentThreadName(), clock.elapsed(), -1});
+}
+
+void StartupTrace::end(const char* phase)
+{
+    QMutexLocker locker(&mutex);
+    if (finished || !clock.isValid())
+        return;
+    QString thread = currentThreadName();
+    for (int i=entries.size()-1; i>=0; i--)
+    {
+        Entry& entry = entries[i];
+        if (qstrcmp(entry.phase, phase) == 0 && entry.end < 0 && entry.thread == thread)
+        {
+            entry.end = clock.elapsed();
+            return;
+        }
+    }
+}
+
+void StartupTrace::finish()
+{
+    QMutexLocker locker(&mutex);
+    if (finished || !clock.isValid())
+        return;
+    finished = true;
+    qint64 usable = clock.elapsed();
+    if (!printing)
+        return;
+
+    QTextStream out(stderr);
+    out << "Startup trace, in ms since main():\n";
+    out << "  start   time  thread    phase\n";
+    for (const Entry& entry : entries)
+    {
+        out << qSetFieldWidth(7) << right << entry.begin;
+        if (entry.end >= 0)
+            out << entry.end - entry.begin;
+        else
+            out << "...";
+        out << qSetFieldWidth(0) << "  " << qSetFieldWidth(8) << left << entry.thread
+            << qSetFieldWidth(0) << "  " << entry.phase << "\n";
+    }
+    out << "Usable after " << usable << " ms\n";
+    out.flush();
+}
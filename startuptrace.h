@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef STARTUPTRACE_H
+#define STARTUPTRACE_H
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QList>
+#include <QString>
+
+/// Wall time of the phases from main() to the first DHT connection, whichever thread runs them.
+/// Phases running in parallel overlap in the trace. Printed on stderr with --startup-trace
+class StartupTrace
+{
+public:
+    static void start(bool print); ///< From main(), every time is relative to that
+    static void begin(const char* phase);
+    static void end(const char* phase);
+    static void finish(); ///< When we're usable, prints the trace. Phases after that aren't recorded
+
+    /// Times its scope
+    class Phase
+    {
+    public:
+        explicit Phase(const char* Name) : name{Name} {begin(name);}
+        ~Phase() {end(name);}
+    private:
+        const char* name;
+    };
+
+private:
+    StartupTrace();
+    struct Entry
+    {
+        const char* phase;
+        QString thread;
+        qint64 begin, end; ///< end is -1 while running
+    };
+
+    static QMutex mutex;
+    static QElapsedTimer clock;
+    static QList<Entry> entries;
+    static bool printing, finished;
+};
+
+#endif // STARTUPTRACE_H
@@ -16,20 +16,126 @@
 
 #include "style.h"
 #include "settings.h"
+#include "startuptrace.h"
 
 #include <QFile>
 #include <QDebug>
+#include <QGuiApplication>
+#include <QHash>
+#include <QIcon>
+#include <QPixmap>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDirIterator>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace
+{
+QMutex cacheMutex;
+QHash<QString, QString> cache; ///< By filename, including the ones that failed to open
+QHash<QString, QPixmap> pixmaps; ///< By filename, size and device pixel ratio, GUI thread only
+QHash<QString, QIcon> icons; ///< By filename, each icon caches its own sizes
+}
 
 QString Style::get(const QString &filename)
 {
-    if (!Settings::getInstance().getUseNativeStyle())
+    if (Settings::getInstance().getUseNativeStyle())
+        return QString();
+
+    {
+        QMutexLocker locker(&cacheMutex);
+        auto it = cache.constFind(cacheKey(filename));
+        if (it != cache.constEnd())
+            return it.value();
+    }
+    return read(filename);
+}
+
+QString Style::read(const QString &filename)
+{
+    QString style;
+    QFile file(filename);
+    if (file.open(QFile::ReadOnly | QFile::Text))
+        style = file.readAll();
+    else
+        qWarning() << "Style " << filename << " not found";
+
+    QMutexLocker locker(&cacheMutex);
+    cache.insert(cacheKey(filename), style);
+    return style;
+}
+
+QString Style::cacheKey(const QString &filename)
+{
+    if (filename.startsWith(':') && !filename.startsWith(":/"))
+        return ":/" + filename.mid(1);
+    return filename;
+}
+
+QPixmap Style::getPixmap(const QString& filename, QSize size)
+{
+    qreal ratio = qApp->devicePixelRatio();
+    QString key = QString("%1@%2x%3@%4").arg(cacheKey(filename)).arg(size.width()).arg(size.height()).arg(ratio);
+    auto it = pixmaps.constFind(key);
+    if (it != pixmaps.constEnd())
+        return it.value();
+
+    QPixmap pixmap(filename);
+    if (pixmap.isNull())
+        qWarning() << "Style: Can't decode" << filename;
+    else if (size.isValid() && (pixmap.size() != size || ratio != 1))
+    {
+        pixmap = pixmap.scaled(size * ratio, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        pixmap.setDevicePixelRatio(ratio);
+    }
+    pixmaps.insert(key, pixmap);
+    return pixmap;
+}
+
+QIcon Style::getIcon(const QString& filename)
+{
+    QString key = cacheKey(filename);
+    auto it = icons.constFind(key);
+    if (it == icons.constEnd())
+        it = icons.insert(key, QIcon(filename));
+    return it.value();
+}
+
+qint64 Style::getPixmapMemory()
+{
+    qint64 bytes = 0;
+    for (const QPixmap& pixmap : pixmaps)
+        bytes += (qint64)pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+    return bytes;
+}
+
+void Style::trimPixmaps()
+{
+    // A pixmap that's only ours isn't shown anywhere right now
+    for (auto it = pixmaps.begin(); it != pixmaps.end();)
     {
-        QFile file(filename);
-        if (file.open(QFile::ReadOnly | QFile::Text))
-            return file.readAll();
+        if (it.value().isDetached())
+            it = pixmaps.erase(it);
         else
-            qWarning() << "Style " << filename << " not found";
+            ++it;
+    }
+}
+
+/// Fills the cache at startup, while the main window is being built
+class Style::Loader : public QRunnable
+{
+public:
+    void run()
+    {
+        StartupTrace::Phase phase("Stylesheets");
+        QDirIterator it(":/ui", QStringList("*.css"), QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            read(it.next());
     }
+};
 
-    return QString();
+void Style::preload()
+{
+    QThreadPool::globalInstance()->start(new Loader);
 }
@@ -17,14 +17,32 @@
 #ifndef STYLE_H
 #define STYLE_H
 
+#include <QSize>
+
 class QString;
+class QPixmap;
+class QIcon;
 
+/// Stylesheets are read once and kept, get is safe to call from any thread.
+/// The images of our resources are decoded once for the whole process too, every widget draws
+/// from the same pixmaps. Those are for the GUI thread only
 class Style
 {
 public:
-    static QString get(const QString& filename);
+    static QString get(const QString& filename); ///< Empty with the native style
+    static void preload(); ///< Reads every stylesheet of our resources on the thread pool
+
+    /// Scaled to size if it's valid, at the screen's device pixel ratio. Null if the file can't be decoded
+    static QPixmap getPixmap(const QString& filename, QSize size = QSize());
+    static QIcon getIcon(const QString& filename);
+    static qint64 getPixmapMemory(); ///< Of every cached pixmap
+    static void trimPixmaps(); ///< Forgets the pixmaps nobody else holds, they're decoded again when needed
+
 private:
     Style();
+    class Loader;
+    static QString read(const QString& filename);
+    static QString cacheKey(const QString& filename); ///< ":ui/a.css" and ":/ui/a.css" are the same resource
 };
 
 #endif // STYLE_H
@@ -0,0 +1,150 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "thumbnailer.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QRunnable>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <algorithm>
+
+namespace
+{
+/// Separate from the global pool so a burst of pictures doesn't hold up the smileys and stylesheets
+QThreadPool* thumbnailPool()
+{
+    static QThreadPool* pool = []
+    {
+        QThreadPool* pool = new QThreadPool;
+        pool->setMaxThreadCount(THUMBNAIL_THREADS);
+        return pool;
+    }();
+    return pool;
+}
+}
+
+/// Sniffs, reads, hashes and scales one file, then hands the miniature back on the GUI thread
+class Thumbnailer::Task : public QRunnable
+{
+public:
+    Task(Thumbnailer* Owner, const QString& Path, const QByteArray& Digest)
+        : owner{Owner}, path{Path}, digest{Digest} {}
+
+    void run()
+    {
+        QImage thumbnail = make();
+        QMetaObject::invokeMethod(owner, "onTaskDone", Qt::QueuedConnection,
+                                  Q_ARG(QString, path), Q_ARG(QImage, thumbnail));
+    }
+
+private:
+    QImage make()
+    {
+        if (!digest.isEmpty())
+        {
+            QImage cached(cacheFile(digest), "PNG");
+            if (!cached.isNull())
+                return cached;
+        }
+
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly) || file.size() > THUMBNAIL_MAX_FILE_SIZE)
+            return QImage();
+
+        // QImageReader only looks at the first bytes to decide, a 4GB ISO stops here
+        {
+            QImageReader sniffer(&file);
+            sniffer.setDecideFormatFromContent(true);
+            QSize size = sniffer.size();
+            if (!sniffer.canRead() || (size.isValid() && (qint64)size.width() * size.height() > THUMBNAIL_MAX_PIXELS))
+                return QImage();
+        }
+
+        file.seek(0);
+        QByteArray data = file.readAll();
+        if (digest.isEmpty())
+        {
+            digest = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+            QImage cached(cacheFile(digest), "PNG");
+            if (!cached.isNull())
+                return cached;
+        }
+
+        QBuffer buffer(&data);
+        QImageReader reader(&buffer);
+        reader.setDecideFormatFromContent(true);
+        // JPEG decodes straight to the smaller size when it's told the size beforehand
+        QSize size = reader.size();
+        if (size.isValid() && size.height() > THUMBNAIL_HEIGHT)
+            reader.setScaledSize(QSize(std::max(1, size.width() * THUMBNAIL_HEIGHT / size.height()), THUMBNAIL_HEIGHT));
+        QImage image = reader.read();
+        if (image.isNull())
+            return image;
+        if (image.height() != THUMBNAIL_HEIGHT)
+            image = image.scaledToHeight(THUMBNAIL_HEIGHT, Qt::SmoothTransformation);
+
+        QString cachePath = cacheFile(digest);
+        QDir().mkpath(QFileInfo(cachePath).absolutePath());
+        QSaveFile save(cachePath);
+        if (!save.open(QIODevice::WriteOnly) || !image.save(&save, "PNG") || !save.commit())
+            qWarning() << "Thumbnailer: Can't write the cache" << cachePath;
+        return image;
+    }
+
+private:
+    Thumbnailer* owner;
+    QString path;
+    QByteArray digest;
+};
+
+Thumbnailer& Thumbnailer::getInstance()
+{
+    static Thumbnailer instance;
+    return instance;
+}
+
+QString Thumbnailer::cacheFile(const QByteArray& digest)
+{
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("thumbnails/" + digest.toHex() + ".png");
+}
+
+void Thumbnailer::request(const QString& path, const QByteArray& digest, QObject* receiver, const char* member)
+{
+    auto& pending = waiters[path];
+    pending.append(qMakePair(QPointer<QObject>(receiver), QByteArray(member)));
+    // Already being made for someone else, they'll share it
+    if (pending.size() == 1)
+        thumbnailPool()->start(new Task(this, path, digest));
+}
+
+void Thumbnailer::onTaskDone(const QString& path, const QImage& thumbnail)
+{
+    auto pending = waiters.take(path);
+    if (thumbnail.isNull())
+        return;
+
+    for (const auto& waiter : pending)
+        if (waiter.first)
+            QMetaObject::invokeMethod(waiter.first, waiter.second.constData(), Q_ARG(QImage, thumbnail));
+}
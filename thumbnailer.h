@@ -0,0 +1,60 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QPointer>
+#include <QString>
+#include <QByteArray>
+
+class QImage;
+
+#define THUMBNAIL_HEIGHT 50
+#define THUMBNAIL_THREADS 2
+#define THUMBNAIL_MAX_FILE_SIZE 64*1024*1024 // Bigger images aren't worth decoding for a miniature
+#define THUMBNAIL_MAX_PIXELS 64*1024*1024
+
+/// Makes the miniatures of the files we transfer, on a worker pool and never for a file that isn't an image.
+/// Only the file's header is read to find that out. Miniatures are cached on disk by the SHA-256 of the file,
+/// so the same picture is only ever decoded once. Call from the GUI thread only.
+class Thumbnailer : public QObject
+{
+    Q_OBJECT
+public:
+    static Thumbnailer& getInstance();
+
+    /// Calls the receiver's member with the miniature as a QImage once it's ready, never if the file isn't an image.
+    /// Pass the digest if it's already known, a cached miniature is then found without reading the file
+    void request(const QString& path, const QByteArray& digest, QObject* receiver, const char* member);
+
+private slots:
+    void onTaskDone(const QString& path, const QImage& thumbnail);
+
+private:
+    Thumbnailer() = default;
+    static QString cacheFile(const QByteArray& digest);
+
+private:
+    class Task;
+    QHash<QString, QList<QPair<QPointer<QObject>, QByteArray>>> waiters; ///< By path, the receivers and their members
+};
+
+#endif // THUMBNAILER_H
@@ -0,0 +1,208 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "transferhistory.h"
+#include "history.h"
+#include "settings.h"
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QRunnable>
+#include <QThreadPool>
+
+namespace
+{
+/// One thread, so the records are written in the order they were appended
+QThreadPool* writerPool()
+{
+    static QThreadPool* pool = []
+    {
+        QThreadPool* pool = new QThreadPool;
+        pool->setMaxThreadCount(1);
+        return pool;
+    }();
+    return pool;
+}
+}
+
+/// Reads the whole index, handing it over in batches so the first screen fills before the last record is read
+class TransferHistory::Loader : public QRunnable
+{
+public:
+    explicit Loader(TransferHistory* Owner) : owner{Owner} {}
+
+    void run()
+    {
+        Entries batch;
+        QFile file(indexPath());
+        if (file.open(QIODevice::ReadOnly))
+        {
+            QDataStream in(&file);
+            qint64 good = 0;
+            while (!in.atEnd())
+            {
+                quint8 encrypted;
+                QByteArray payload, plain;
+                in >> encrypted >> payload;
+                // A record cut by a crash is cut off, nothing is appended before we're done
+                if (in.status() != QDataStream::Ok)
+                {
+                    qWarning() << "TransferHistory: Dropping a broken record at the end of" << file.fileName();
+                    file.close();
+                    QFile::resize(indexPath(), good);
+                    break;
+                }
+                good = file.pos();
+                Entry entry;
+                if ((encrypted && !History::getInstance().unseal(payload, plain)) || !decode(encrypted ? plain : payload, entry))
+                    continue;
+                batch.append(entry);
+                if (batch.size() == TRANSFER_HISTORY_LOAD_BATCH)
+                {
+                    deliver(batch, false);
+                    batch.clear();
+                }
+            }
+        }
+        deliver(batch, true);
+    }
+
+private:
+    void deliver(const Entries& batch, bool last)
+    {
+        QMetaObject::invokeMethod(owner, "onBatchLoaded", Qt::QueuedConnection,
+                                  Q_ARG(TransferHistory::Entries, batch), Q_ARG(bool, last));
+    }
+
+private:
+    TransferHistory* owner;
+};
+
+class TransferHistory::Writer : public QRunnable
+{
+public:
+    Writer(const QByteArray& Payload, bool Encrypted) : payload{Payload}, encrypted{Encrypted} {}
+
+    void run()
+    {
+        QFile file(indexPath());
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Append))
+        {
+            qWarning() << "TransferHistory: Can't open" << file.fileName();
+            return;
+        }
+        QByteArray record;
+        QDataStream out(&record, QIODevice::WriteOnly);
+        out << (quint8)encrypted << (encrypted ? History::getInstance().seal(payload) : payload);
+        if (file.write(record) != record.size())
+            qWarning() << "TransferHistory: Can't write to" << file.fileName();
+    }
+
+private:
+    QByteArray payload;
+    bool encrypted;
+};
+
+TransferHistory& TransferHistory::getInstance()
+{
+    static TransferHistory instance;
+    return instance;
+}
+
+TransferHistory::TransferHistory()
+    : loading{false}, loaded{false}
+{
+    qRegisterMetaType<TransferHistory::Entries>("TransferHistory::Entries");
+    History::getInstance(); // On our thread, before the loader needs its key
+}
+
+QString TransferHistory::indexPath()
+{
+    return QDir(Settings::getSettingsDirPath()).filePath("history/transfers");
+}
+
+QByteArray TransferHistory::encode(const Entry& entry)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out << entry.path << entry.peerId << entry.peerName << entry.size << entry.time << entry.digest << entry.sending;
+    return payload;
+}
+
+bool TransferHistory::decode(const QByteArray& payload, Entry& entry)
+{
+    QDataStream in(payload);
+    in >> entry.path >> entry.peerId >> entry.peerName >> entry.size >> entry.time >> entry.digest >> entry.sending;
+    entry.fileName = QFileInfo(entry.path).fileName();
+    return in.status() == QDataStream::Ok;
+}
+
+void TransferHistory::load()
+{
+    if (loading || loaded)
+        return;
+    loading = true;
+    QThreadPool::globalInstance()->start(new Loader(this));
+}
+
+void TransferHistory::append(const Entry& Entry)
+{
+    TransferHistory::Entry entry = Entry;
+    entry.fileName = QFileInfo(entry.path).fileName();
+
+    // Not written while the loader reads, it would find it and we'd list it twice
+    if (loading)
+    {
+        early.append(entry);
+        return;
+    }
+    write(entry);
+    entries.append(entry);
+    emit entriesAdded(entries.size()-1, 1);
+}
+
+void TransferHistory::shutdown()
+{
+    writerPool()->waitForDone();
+}
+
+void TransferHistory::write(const Entry& entry)
+{
+    Settings& s = Settings::getInstance();
+    if (s.getEnableLogging())
+        writerPool()->start(new Writer(encode(entry), s.getEncryptLogs() && History::getInstance().canSeal()));
+}
+
+void TransferHistory::onBatchLoaded(const TransferHistory::Entries& batch, bool last)
+{
+    int first = entries.size();
+    entries += batch;
+    if (last)
+    {
+        for (const Entry& entry : early)
+            write(entry);
+        entries += early;
+        early.clear();
+        loading = false;
+        loaded = true;
+    }
+    if (entries.size() > first)
+        emit entriesAdded(first, entries.size() - first);
+    if (last)
+        emit loadFinished();
+}
@@ -0,0 +1,82 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef TRANSFERHISTORY_H
+#define TRANSFERHISTORY_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QDateTime>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+
+// Records the loader hands to the GUI thread at once
+#define TRANSFER_HISTORY_LOAD_BATCH 4096
+
+/// Every file we sent or received, kept next to the chat logs in history/transfers.
+/// It's an append-only file of records, sealed with the key of the logs when encryptLogs is set.
+/// The whole index is read once on a worker, in batches, and kept in memory; appending only queues the record
+/// for a writer thread. Nothing is written while logging is disabled, the session's transfers are still listed.
+/// Call from the GUI thread only.
+class TransferHistory : public QObject
+{
+    Q_OBJECT
+public:
+    struct Entry
+    {
+        QString path, fileName;
+        QString peerId, peerName; ///< The friend's user id, and name when the transfer finished
+        qint64 size;
+        QDateTime time;
+        QByteArray digest; ///< SHA-256 of the data, empty if it wasn't hashed
+        bool sending;
+    };
+    typedef QVector<Entry> Entries;
+
+    static TransferHistory& getInstance();
+
+    void load(); ///< Starts reading the index the first time, entries come with entriesAdded
+    void append(const Entry& entry);
+    const Entries& getEntries() const {return entries;} ///< Oldest first
+    bool isLoaded() const {return loaded;}
+    static void shutdown(); ///< Waits for the queued records to be written, at exit, before History's
+
+signals:
+    void entriesAdded(int first, int count); ///< Indexes in getEntries, always at its end
+    void loadFinished();
+
+private slots:
+    void onBatchLoaded(const TransferHistory::Entries& batch, bool last);
+
+private:
+    TransferHistory();
+    static QString indexPath();
+    static void write(const Entry& entry); ///< Queues it for the writer
+    static QByteArray encode(const Entry& entry);
+    static bool decode(const QByteArray& payload, Entry& entry);
+
+private:
+    class Loader;
+    class Writer;
+    Entries entries;
+    Entries early; ///< Appended while we were loading, they go after what was on disk
+    bool loading, loaded;
+};
+
+Q_DECLARE_METATYPE(TransferHistory::Entries)
+
+#endif // TRANSFERHISTORY_H
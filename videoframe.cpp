@@ -0,0 +1,168 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoframe.h"
+#include "coredefines.h"
+#include <QAtomicInt>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#define VIDEO_FRAME_BUFFER_SIZE (TOXAV_MAX_VIDEO_WIDTH * TOXAV_MAX_VIDEO_HEIGHT * 3 / 2)
+
+struct VideoFrame::Buffer
+{
+    Buffer() : data{new uint8_t[VIDEO_FRAME_BUFFER_SIZE]} {count.ref();}
+    ~Buffer() {delete[] data; count.deref();}
+
+    QAtomicInt ref;
+    vpx_image img;
+    uint8_t* data;
+    static QAtomicInt count; ///< Alive, for the memory report
+};
+
+QAtomicInt VideoFrame::Buffer::count;
+
+/// The buffers nobody uses, we keep up to TOXAV_VIDEO_FRAME_POOL of them
+struct VideoFrame::Pool
+{
+    QMutex mutex;
+    QVector<Buffer*> spare;
+};
+
+VideoFrame::Pool& VideoFrame::pool()
+{
+    static Pool pool;
+    return pool;
+}
+
+qint64 VideoFrame::getPoolMemory(qint64* spare)
+{
+    if (spare)
+    {
+        Pool& spares = pool();
+        QMutexLocker locker(&spares.mutex);
+        *spare = (qint64)spares.spare.size() * VIDEO_FRAME_BUFFER_SIZE;
+    }
+    return (qint64)Buffer::count.load() * VIDEO_FRAME_BUFFER_SIZE;
+}
+
+void VideoFrame::trimPool()
+{
+    QVector<Buffer*> freed;
+    {
+        Pool& spares = pool();
+        QMutexLocker locker(&spares.mutex);
+        freed.swap(spares.spare);
+    }
+    qDeleteAll(freed);
+}
+
+VideoFrame::VideoFrame()
+    : d{nullptr}
+{
+}
+
+VideoFrame::VideoFrame(Buffer* buffer)
+    : d{buffer}
+{
+}
+
+VideoFrame::VideoFrame(const VideoFrame& other)
+    : d{other.d}
+{
+    if (d)
+        d->ref.ref();
+}
+
+VideoFrame& VideoFrame::operator=(const VideoFrame& other)
+{
+    VideoFrame copy(other);
+    std::swap(d, copy.d);
+    return *this;
+}
+
+VideoFrame::~VideoFrame()
+{
+    if (!d || d->ref.deref())
+        return;
+
+    Pool& spares = pool();
+    QMutexLocker locker(&spares.mutex);
+    if (spares.spare.size() < TOXAV_VIDEO_FRAME_POOL)
+    {
+        spares.spare.append(d);
+        return;
+    }
+    locker.unlock();
+    delete d;
+}
+
+VideoFrame VideoFrame::create(int width, int height)
+{
+    if (width <= 0 || height <= 0 || width > TOXAV_MAX_VIDEO_WIDTH || height > TOXAV_MAX_VIDEO_HEIGHT)
+    {
+        qWarning() << "VideoFrame::create: Unsupported frame size" << width << "x" << height;
+        return VideoFrame();
+    }
+
+    Buffer* buffer = nullptr;
+    Pool& spares = pool();
+    {
+        QMutexLocker locker(&spares.mutex);
+        if (!spares.spare.isEmpty())
+            buffer = spares.spare.takeLast();
+        else
+            spares.spare.reserve(TOXAV_VIDEO_FRAME_POOL);
+    }
+    if (!buffer)
+        buffer = new Buffer;
+
+    buffer->ref.store(1);
+    vpx_img_wrap(&buffer->img, VPX_IMG_FMT_I420, width, height, 1, buffer->data);
+    return VideoFrame(buffer);
+}
+
+VideoFrame VideoFrame::copy(const vpx_image& img)
+{
+    if (img.fmt != VPX_IMG_FMT_I420)
+    {
+        qWarning() << "VideoFrame::copy: Unsupported image format" << img.fmt;
+        return VideoFrame();
+    }
+
+    VideoFrame frame = create(img.d_w, img.d_h);
+    if (frame.isNull())
+        return frame;
+
+    vpx_image* dst = frame.image();
+    for (int plane = VPX_PLANE_Y; plane <= VPX_PLANE_V; plane++)
+    {
+        int w = plane == VPX_PLANE_Y ? img.d_w : (img.d_w+1)/2;
+        int h = plane == VPX_PLANE_Y ? img.d_h : (img.d_h+1)/2;
+        for (int line=0; line<h; line++)
+            memcpy(dst->planes[plane] + line*dst->stride[plane], img.planes[plane] + line*img.stride[plane], w);
+    }
+    return frame;
+}
+
+vpx_image* VideoFrame::image() const
+{
+    return d ? &d->img : nullptr;
+}
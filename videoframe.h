@@ -0,0 +1,56 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOFRAME_H
+#define VIDEOFRAME_H
+
+#include <QMetaType>
+#include "vpx/vpx_image.h"
+
+/// A refcounted I420 image. The buffers come from a pool and are sized for
+/// TOXAV_MAX_VIDEO_WIDTH x TOXAV_MAX_VIDEO_HEIGHT, so video doesn't touch the allocator once
+/// the pool is warm. Copies share the image, the last one gives the buffer back to the pool.
+/// Unlike a raw vpx_image* it's safe to pass through queued signals.
+class VideoFrame
+{
+public:
+    VideoFrame(); ///< A null frame
+    VideoFrame(const VideoFrame& other);
+    VideoFrame& operator=(const VideoFrame& other);
+    ~VideoFrame();
+
+    static VideoFrame create(int width, int height); ///< Null if it's bigger than the maximum video size
+    static VideoFrame copy(const vpx_image& img); ///< A pooled copy of an I420 image, null if we can't
+
+    static qint64 getPoolMemory(qint64* spare = nullptr); ///< Of every buffer, in use or not, and of the spare ones
+    static void trimPool(); ///< Frees the spare buffers, the pool warms up again with the next call
+
+    bool isNull() const {return !d;}
+    vpx_image* image() const; ///< Null for a null frame, the planes may be written while we're the only copy
+
+private:
+    struct Buffer;
+    struct Pool;
+    explicit VideoFrame(Buffer* buffer);
+    static Pool& pool();
+
+private:
+    Buffer* d;
+};
+
+Q_DECLARE_METATYPE(VideoFrame)
+
+#endif // VIDEOFRAME_H
@@ -0,0 +1,118 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoratecontroller.h"
+#include "coredefines.h"
+#include "settings.h"
+#include <QDebug>
+#include <algorithm>
+
+VideoRateController::VideoRateController()
+    : level{0}, frames{0}, failures{0}, cost{0}, goodWindows{0}
+{
+    levels.append({QSize(), 1000/TOXAV_VIDEO_MAX_FPS});
+}
+
+void VideoRateController::reset()
+{
+    Settings& s = Settings::getInstance();
+    int maxFps = std::max(s.getMaxVideoFps(), 1), minFps = std::min(std::max(s.getMinVideoFps(), 1), maxFps);
+    QSize minSize = s.getMinVideoSize();
+
+    QVector<QSize> sizes{QSize()};
+    for (QSize size : {QSize(640, 480), QSize(320, 240), QSize(160, 120)})
+        if (size.width() >= minSize.width() && size.height() >= minSize.height())
+            sizes.append(size);
+    QVector<int> rates{maxFps};
+    if ((maxFps+minFps)/2 != maxFps && (maxFps+minFps)/2 != minFps)
+        rates.append((maxFps+minFps)/2);
+    if (minFps != maxFps)
+        rates.append(minFps);
+
+    // A staircase, every step lowers either the frame rate or the size
+    levels.clear();
+    int size = 0, rate = 0;
+    levels.append({sizes[size], 1000/rates[rate]});
+    while (size < sizes.size()-1 || rate < rates.size()-1)
+    {
+        if (rate < rates.size()-1 && (rate <= size || size == sizes.size()-1))
+            rate++;
+        else
+            size++;
+        levels.append({sizes[size], 1000/rates[rate]});
+    }
+
+    level = 0;
+    goodWindows = 0;
+    frames = failures = 0;
+    cost = 0;
+    window.start();
+}
+
+void VideoRateController::frameSent(qint64 costMs, bool failed)
+{
+    frames++;
+    cost += costMs;
+    if (failed)
+        failures++;
+    if (!window.isValid())
+        window.start();
+    else if (window.elapsed() >= TOXAV_VIDEO_RATE_WINDOW)
+        evaluate();
+}
+
+int VideoRateController::getInterval() const
+{
+    return levels[level].interval;
+}
+
+QSize VideoRateController::getMaxSize() const
+{
+    return levels[level].maxSize;
+}
+
+void VideoRateController::evaluate()
+{
+    int interval = levels[level].interval;
+    qint64 avgCost = cost / frames;
+    bool congested = failures*10 > frames || avgCost*10 > interval*6;
+    bool idle = !failures && avgCost*10 < interval*3;
+
+    int oldLevel = level;
+    if (congested)
+    {
+        goodWindows = 0;
+        level = std::min(level+1, levels.size()-1);
+    }
+    else if (idle && ++goodWindows >= TOXAV_VIDEO_RATE_RECOVERY)
+    {
+        goodWindows = 0;
+        level = std::max(level-1, 0);
+    }
+    else if (!idle)
+    {
+        goodWindows = 0;
+    }
+
+    if (level != oldLevel)
+        qDebug() << QString("VideoRateController: %1 of %2 frames failed, %3ms per frame, now at %4x%5 every %6ms")
+                    .arg(failures).arg(frames).arg(avgCost)
+                    .arg(levels[level].maxSize.width()).arg(levels[level].maxSize.height()).arg(levels[level].interval);
+
+    frames = failures = 0;
+    cost = 0;
+    window.start();
+}
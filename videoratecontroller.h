@@ -0,0 +1,57 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEORATECONTROLLER_H
+#define VIDEORATECONTROLLER_H
+
+#include <QElapsedTimer>
+#include <QSize>
+#include <QVector>
+
+/// Adapts a call's video frame interval and size to how well the frames go out.
+/// It measures how long capturing, encoding and sending a frame takes and how often
+/// toxav_send_video fails, steps down a ladder of sizes and frame rates when the link
+/// or the CPU can't keep up, and back up once things stayed fine for a while.
+/// The bounds of the ladder come from the settings.
+class VideoRateController
+{
+public:
+    VideoRateController();
+
+    void reset(); ///< Starts over at the best quality, call for every new call
+    void frameSent(qint64 costMs, bool failed); ///< Call after every frame we tried to send
+    int getInterval() const; ///< How long to wait between frames, in ms
+    QSize getMaxSize() const; ///< What frames must be scaled down to fit in, invalid for no limit
+
+private:
+    void evaluate();
+
+private:
+    struct Level
+    {
+        QSize maxSize;
+        int interval;
+    };
+
+    QVector<Level> levels; ///< Best quality first
+    int level;
+    QElapsedTimer window; ///< Since we last evaluated
+    int frames, failures;
+    qint64 cost;
+    int goodWindows; ///< In a row, we only step up after TOXAV_VIDEO_RATE_RECOVERY of them
+};
+
+#endif // VIDEORATECONTROLLER_H
@@ -0,0 +1,35 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOSOURCE_H
+#define VIDEOSOURCE_H
+
+#include <QSize>
+#include "videoframe.h"
+
+/// Something a call can send video from, the camera or the screen.
+/// Core suscribes when a call starts sending from it and pulls frames at the rate controller's pace,
+/// so the getters are called from the Core thread and must not block on the source.
+class VideoSource
+{
+public:
+    virtual ~VideoSource() {}
+    virtual void suscribe() = 0; ///< Call this once before trying to get frames
+    virtual void unsuscribe() = 0; ///< Call this once when you don't need frames anymore
+    virtual VideoFrame getLastVideoFrame(QSize maxSize = QSize()) = 0; ///< The latest frame scaled down to fit maxSize, null if there is none yet
+};
+
+#endif // VIDEOSOURCE_H
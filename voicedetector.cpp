@@ -0,0 +1,145 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "voicedetector.h"
+#include "coredefines.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VOICEDETECTOR_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define VOICEDETECTOR_NEON
+#include <arm_neon.h>
+#endif
+
+VoiceDetector::VoiceDetector()
+{
+    reset(true);
+}
+
+void VoiceDetector::reset(bool Enabled)
+{
+    enabled = Enabled;
+    noiseFloor = -1; // Taken from the first frame, the microphone usually starts before anyone speaks
+    hangover = TOXAV_VAD_HANGOVER; // Don't start a call by cutting its first word
+    silence = 0;
+    level = 0;
+    voice = true;
+}
+
+void VoiceDetector::measure(const int16_t* frame, int samples, qint64& energy, int& crossings)
+{
+    // Halved so a pair of squares fits in an int32, the energy is only compared to itself anyway
+    energy = 0;
+    crossings = 0;
+    int x = 0;
+#if defined(VOICEDETECTOR_SSE2)
+    __m128i sum = _mm_setzero_si128(), signs = _mm_setzero_si128(), zero = _mm_setzero_si128();
+    for (; x+9 <= samples; x+=8)
+    {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + x));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(frame + x + 1));
+        __m128i half = _mm_srai_epi16(a, 1);
+        __m128i squares = _mm_madd_epi16(half, half);
+        sum = _mm_add_epi64(sum, _mm_add_epi64(_mm_unpacklo_epi32(squares, zero), _mm_unpackhi_epi32(squares, zero)));
+        // The sign bit of a^b is set where the signal crosses zero, srai makes that -1
+        signs = _mm_sub_epi16(signs, _mm_srai_epi16(_mm_xor_si128(a, b), 15));
+    }
+    qint64 sums[2];
+    int16_t counts[8];
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(counts), signs);
+    energy = sums[0] + sums[1];
+    for (int16_t count : counts)
+        crossings += count;
+#elif defined(VOICEDETECTOR_NEON)
+    int64x2_t sum = vdupq_n_s64(0);
+    int16x8_t signs = vdupq_n_s16(0);
+    for (; x+9 <= samples; x+=8)
+    {
+        int16x8_t a = vld1q_s16(frame + x), b = vld1q_s16(frame + x + 1);
+        int16x8_t half = vshrq_n_s16(a, 1);
+        sum = vpadalq_s32(sum, vmull_s16(vget_low_s16(half), vget_low_s16(half)));
+        sum = vpadalq_s32(sum, vmull_s16(vget_high_s16(half), vget_high_s16(half)));
+        signs = vsubq_s16(signs, vshrq_n_s16(veorq_s16(a, b), 15));
+    }
+    energy = vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1);
+    int16_t counts[8];
+    vst1q_s16(counts, signs);
+    for (int16_t count : counts)
+        crossings += count;
+#endif
+    for (; x<samples; x++)
+    {
+        int half = frame[x] >> 1;
+        energy += half * half;
+        if (x+1 < samples && (frame[x] ^ frame[x+1]) < 0)
+            crossings++;
+    }
+}
+
+bool VoiceDetector::process(const int16_t* frame, int samples, int sampleRate)
+{
+    if (samples <= 0)
+        return false;
+    qint64 energy;
+    int crossings;
+    measure(frame, samples, energy, crossings);
+    double mean = (double)energy / samples;
+    int duration = samples * 1000 / sampleRate;
+    if (noiseFloor < 0)
+        noiseFloor = std::max(mean, (double)TOXAV_VAD_MIN_ENERGY);
+
+    // A halved full scale sine has a mean square of 16384^2/2
+    double dB = 10 * std::log10(std::max(mean, 1.0) / (16384.0 * 16384.0 / 2));
+    level = std::min(std::max((int)std::lround((dB + 60) * 100 / 60), 0), 100);
+
+    // Fricatives are quiet but cross zero far more often than voiced speech or hum
+    double rate = (double)crossings / samples;
+    bool speech = mean > noiseFloor * TOXAV_VAD_THRESHOLD
+                  || (mean > noiseFloor * TOXAV_VAD_THRESHOLD / 2 && rate > TOXAV_VAD_FRICATIVE_RATE);
+
+    // The floor drops to quieter frames at once and creeps up, so speech doesn't become the floor
+    if (mean < noiseFloor)
+        noiseFloor = std::max(mean, (double)TOXAV_VAD_MIN_ENERGY);
+    else if (!speech)
+        noiseFloor += (mean - noiseFloor) / 16;
+    else
+        noiseFloor += (mean - noiseFloor) / 512; // Still gets out of a floor that started too low
+
+    if (!enabled || speech)
+    {
+        hangover = TOXAV_VAD_HANGOVER;
+        silence = 0;
+        voice = true;
+        return true;
+    }
+    if (hangover > 0)
+    {
+        hangover -= duration;
+        voice = true;
+        return true;
+    }
+
+    voice = false;
+    silence += duration;
+    if (silence < TOXAV_VAD_COMFORT_INTERVAL)
+        return false;
+    silence = 0;
+    return true;
+}
@@ -0,0 +1,49 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VOICEDETECTOR_H
+#define VOICEDETECTOR_H
+
+#include <cstdint>
+#include <QtGlobal>
+
+/// Tells speech from silence in the captured frames, so the audio thread doesn't encode and send
+/// what nobody says. A frame is voice when its energy is well above a noise floor that follows the
+/// quietest frames, or a bit above it with the zero-crossing rate of a fricative. Sending goes on for
+/// TOXAV_VAD_HANGOVER after the last voice frame so word endings aren't cut, and during silence one
+/// frame of background goes out every TOXAV_VAD_COMFORT_INTERVAL: it keeps the far end's decoder
+/// and its idea of the room's noise up to date. Only the audio thread uses it
+class VoiceDetector
+{
+public:
+    VoiceDetector();
+    void reset(bool enabled); ///< Disabled, every frame is sent but the level is still measured
+    bool process(const int16_t* frame, int samples, int sampleRate); ///< True if the frame should be sent
+    int getLevel() const {return level;} ///< Of the last frame, 0 for -60dBFS and below to 100 for full scale
+    bool isVoice() const {return voice;} ///< The last frame was sent as speech, not silence or comfort noise
+
+    static void measure(const int16_t* frame, int samples, qint64& energy, int& crossings); ///< Sum of squares and sign changes
+
+private:
+    bool enabled;
+    double noiseFloor; ///< Mean energy per sample of the background
+    int hangover; ///< ms of sending left since the last voice frame
+    int silence; ///< ms since the last frame we sent during silence
+    int level;
+    bool voice;
+};
+
+#endif // VOICEDETECTOR_H
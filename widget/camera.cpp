@@ -15,107 +15,349 @@
 */
 
 #include "camera.h"
-#include "widget.h"
+#include "videoconvert.h"
+#include "settings.h"
+#include "coredefines.h"
+#include <QDebug>
+#include <QThread>
+#include <algorithm>
 
 using namespace cv;
 
+/// Opens the device, then captures as fast as it delivers and publishes every frame.
+/// With nobody suscribed it only grabs to keep the stream going, until the idle timeout closes it
+class Camera::CaptureThread : public QThread
+{
+public:
+    CaptureThread(Camera* Cam) : cam{Cam}, stopping{0} {}
+    void stop() {stopping.storeRelease(1);}
+
+protected:
+    void run()
+    {
+        if (cam->cam.open(0))
+            cam->configure();
+        else
+            qWarning() << "Camera: Can't open the device";
+
+        bool idle = false;
+        while (!stopping.loadAcquire())
+        {
+            {
+                QMutexLocker locker(&cam->subscriptionMutex);
+                if (cam->refcount <= 0 && cam->idleTimer.hasExpired(cam->idleTimeout))
+                {
+                    cam->capturing = false; // The next suscribe waits for us and starts over
+                    break;
+                }
+                if (idle != (cam->refcount <= 0))
+                {
+                    idle = !idle;
+                    if (idle)
+                        cam->dropFrames(); // Nobody should see a frame from before they suscribed
+                }
+            }
+
+            if (idle)
+            {
+                if (!cam->cam.grab())
+                    msleep(10);
+                continue;
+            }
+
+            // Any slot but the latest one that nobody reads, there are enough for one to be free
+            int current = cam->latest.loadAcquire(), slot = 0;
+            while (slot == current || cam->frameSlots[slot].readers.loadAcquire())
+                slot = (slot + 1) % FRAME_SLOTS;
+
+            // Reading blocks for the exposure time, that's why we do it here and not in the getters
+            Mat& frame = cam->frameSlots[slot].frame;
+            if (!cam->cam.read(frame) || frame.empty())
+            {
+                msleep(10); // Don't spin on a camera that just went away
+                continue;
+            }
+
+            // We asked for raw frames, but only know what to do with YUYV. Anything else is
+            // compressed or exotic, so let OpenCV decode it to BGR from now on
+            if (frame.type() != CV_8UC3 && frame.type() != CV_8UC2)
+            {
+                qWarning() << "Camera: Unsupported raw frame type" << frame.type() << ", falling back to BGR";
+                cam->cam.set(CV_CAP_PROP_CONVERT_RGB, 1);
+                continue;
+            }
+
+            // One conversion for the encoder and the preview, whoever asks first doesn't pay for it
+            VideoFrame video = toVideoFrame(frame);
+            if (video.isNull())
+                continue;
+            cam->frameSlots[slot].video = video;
+            cam->latest.fetchAndStoreOrdered(slot);
+            cam->serial.ref();
+        }
+
+        cam->dropFrames();
+        cam->cam.release();
+    }
+
+private:
+    Camera* cam;
+    QAtomicInt stopping;
+};
+
+Camera* Camera::instance{nullptr};
+
 Camera::Camera()
-    : refcount{0}
+    : refcount{0}, capturing{false}, idleTimeout{0}, captureThread{nullptr}, latest{-1}
+{
+    instance = this;
+}
+
+Camera::~Camera()
 {
+    if (instance == this)
+        instance = nullptr;
+    if (captureThread)
+    {
+        captureThread->stop();
+        captureThread->wait();
+        delete captureThread;
+    }
 }
 
 void Camera::suscribe()
 {
+    QMutexLocker locker(&subscriptionMutex);
     if (refcount <= 0)
-    {
         refcount = 1;
-        cam.open(0);
-    }
     else
         refcount++;
+    startCapture();
 }
 
 void Camera::unsuscribe()
 {
+    QMutexLocker locker(&subscriptionMutex);
     refcount--;
 
     if (refcount <= 0)
     {
-        cam.release();
+        // The capture thread goes idle and closes the device once this runs out
         refcount = 0;
+        idleTimer.start();
+        idleTimeout = Settings::getInstance().getCamReleaseDelay() * 1000;
+    }
+}
+
+void Camera::prewarm(int timeout)
+{
+    QMutexLocker locker(&subscriptionMutex);
+    if (refcount <= 0)
+    {
+        // Don't cut a longer grace period short
+        qint64 left = capturing ? idleTimeout - idleTimer.elapsed() : 0;
+        if (left < timeout)
+        {
+            idleTimer.start();
+            idleTimeout = timeout;
+        }
+    }
+    startCapture();
+}
+
+void Camera::startCapture()
+{
+    if (capturing)
+        return;
+
+    // A thread that timed out is releasing the device, the new one has to open it after that
+    if (captureThread)
+    {
+        captureThread->wait();
+        delete captureThread;
     }
+    capturing = true;
+    captureThread = new CaptureThread(this);
+    captureThread->start();
+}
+
+void Camera::dropFrames()
+{
+    latest.storeRelease(-1);
+    // Give the frames back to the pool once the readers that saw the old latest are done
+    for (FrameSlot& slot : frameSlots)
+    {
+        while (slot.readers.loadAcquire())
+            QThread::yieldCurrentThread();
+        slot.video = VideoFrame();
+    }
+}
+
+void Camera::configure()
+{
+    if (!cam.isOpened())
+        return;
+
+    Settings& settings = Settings::getInstance();
+    QSize resolution = settings.getCamResolution();
+    if (resolution.isValid())
+    {
+        cam.set(CV_CAP_PROP_FRAME_WIDTH, resolution.width());
+        cam.set(CV_CAP_PROP_FRAME_HEIGHT, resolution.height());
+    }
+    if (settings.getCamFps() > 0)
+        cam.set(CV_CAP_PROP_FPS, settings.getCamFps());
+
+    QByteArray fourcc = settings.getCamFormat().toLatin1();
+    if (fourcc.size() == 4)
+        cam.set(CV_CAP_PROP_FOURCC, CV_FOURCC(fourcc[0], fourcc[1], fourcc[2], fourcc[3]));
+
+    // Take YUYV as the device sends it, it goes to I420 without a BGR round trip.
+    // Backends that can't do that just ignore it, MJPEG has to be decoded anyway
+    cam.set(CV_CAP_PROP_CONVERT_RGB, fourcc == "MJPG" ? 1 : 0);
+
+    qDebug() << "Camera: Capturing at" << cam.get(CV_CAP_PROP_FRAME_WIDTH) << "x" << cam.get(CV_CAP_PROP_FRAME_HEIGHT)
+             << cam.get(CV_CAP_PROP_FPS) << "fps";
+}
+
+QList<QSize> Camera::getSupportedResolutions()
+{
+    QMutexLocker locker(&subscriptionMutex);
+    if (!resolutions.isEmpty() || capturing)
+        return resolutions; // We can't change the size under the capture thread's feet
+
+    // A thread that just timed out may still be releasing the device
+    if (captureThread)
+    {
+        captureThread->wait();
+        delete captureThread;
+        captureThread = nullptr;
+    }
+
+    // OpenCV can't list the modes, but the device snaps what we ask for to the closest one it has
+    const QSize candidates[] = {{160, 120}, {320, 240}, {352, 288}, {640, 360}, {640, 480}, {800, 600},
+                                {960, 720}, {1280, 720}, {1280, 960}, {1600, 1200}};
+    if (!cam.open(0))
+        return resolutions;
+    for (QSize candidate : candidates)
+    {
+        cam.set(CV_CAP_PROP_FRAME_WIDTH, candidate.width());
+        cam.set(CV_CAP_PROP_FRAME_HEIGHT, candidate.height());
+        QSize size(cam.get(CV_CAP_PROP_FRAME_WIDTH), cam.get(CV_CAP_PROP_FRAME_HEIGHT));
+        // Bigger frames wouldn't fit in the video frame pool
+        if (size.isValid() && size.width() <= TOXAV_MAX_VIDEO_WIDTH && size.height() <= TOXAV_MAX_VIDEO_HEIGHT
+                && !resolutions.contains(size))
+            resolutions.append(size);
+    }
+    cam.release();
+    return resolutions;
+}
+
+int Camera::acquireFrame()
+{
+    // Pin the slot, then check it's still the latest. If it isn't, the capture thread may
+    // have picked it before it saw our pin, so let go and try the new latest
+    forever
+    {
+        int slot = latest.loadAcquire();
+        if (slot < 0)
+            return -1;
+        frameSlots[slot].readers.ref();
+        if (latest.loadAcquire() == slot)
+            return slot;
+        frameSlots[slot].readers.deref();
+    }
+}
+
+void Camera::releaseFrame(int slot)
+{
+    frameSlots[slot].readers.deref();
 }
 
 Mat Camera::getLastFrame()
 {
     Mat frame;
-    cam >> frame;
+    int slot = acquireFrame();
+    if (slot < 0)
+        return frame;
+    frameSlots[slot].frame.copyTo(frame);
+    releaseFrame(slot);
     return frame;
 }
 
-QImage Camera::getLastImage()
+QImage Camera::getLastImage(QSize fitSize)
 {
-    Mat3b src = getLastFrame();
-    QImage dest(src.cols, src.rows, QImage::Format_ARGB32);
-    for (int y = 0; y < src.rows; ++y)
-    {
-            const cv::Vec3b *srcrow = src[y];
-            QRgb *destrow = (QRgb*)dest.scanLine(y);
-            for (int x = 0; x < src.cols; ++x)
-                    destrow[x] = qRgba(srcrow[x][2], srcrow[x][1], srcrow[x][0], 255);
-    }
+    VideoFrame video = getLastVideoFrame();
+    vpx_image* img = video.image();
+    if (!img)
+        return QImage();
+
+    // Straight to the size it's shown at, in one pass
+    QSize size(img->d_w, img->d_h);
+    if (fitSize.isValid())
+        size = size.scaled(fitSize, Qt::KeepAspectRatio).expandedTo(QSize(1,1));
+    QImage dest(size, QImage::Format_RGB32);
+    // We've always put Cb in the V plane and Cr in the U plane
+    VideoConvert::i420ToRgb32(img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y],
+                              img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V],
+                              img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U],
+                              img->d_w, img->d_h, dest.bits(), dest.bytesPerLine(), size.width(), size.height());
     return dest;
 }
 
-vpx_image Camera::getLastVPXImage()
+VideoFrame Camera::toVideoFrame(const Mat& frame)
 {
-    Mat3b frame = getLastFrame();
-    vpx_image img;
-    int w = frame.size().width, h = frame.size().height;
-    vpx_img_alloc(&img, VPX_IMG_FMT_I420, w, h, 1); // I420 == YUV420P, same as YV12 with U and V switched
-
-    size_t i=0, j=0;
-    for( int line = 0; line < h; ++line )
+    int w = frame.cols, h = frame.rows;
+    VideoFrame video = VideoFrame::create(w, h); // I420 == YUV420P, same as YV12 with U and V switched
+    if (vpx_image* img = video.image())
     {
-        const cv::Vec3b *srcrow = frame[line];
-        if( !(line % 2) )
-        {
-            for( int x = 0; x < w; x += 2 )
-            {
-                uint8_t r = srcrow[x][2];
-                uint8_t g = srcrow[x][1];
-                uint8_t b = srcrow[x][0];
-
-                img.planes[VPX_PLANE_Y][i] = ((66*r + 129*g + 25*b) >> 8) + 16;
-                img.planes[VPX_PLANE_V][j] = ((-38*r + -74*g + 112*b) >> 8) + 128;
-                img.planes[VPX_PLANE_U][j] = ((112*r + -94*g + -18*b) >> 8) + 128;
-                i++;
-                j++;
-
-                r = srcrow[x+1][2];
-                g = srcrow[x+1][1];
-                b = srcrow[x+1][0];
-                img.planes[VPX_PLANE_Y][i] = ((66*r + 129*g + 25*b) >> 8) + 16;
-                i++;
-            }
-        }
+        // We've always put Cb in the V plane and Cr in the U plane, NetCamView expects it that way
+        if (frame.type() == CV_8UC2)
+            VideoConvert::yuyvToI420(frame.data, (int)frame.step, w, h,
+                                     img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y],
+                                     img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V],
+                                     img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U]);
         else
-        {
-            for( int x = 0; x < w; x += 1 )
-            {
-                uint8_t r = srcrow[x][2];
-                uint8_t g = srcrow[x][1];
-                uint8_t b = srcrow[x][0];
+            VideoConvert::bgrToI420(frame.data, (int)frame.step, w, h,
+                                    img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y],
+                                    img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V],
+                                    img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U]);
+    }
+    return video;
+}
 
-                img.planes[VPX_PLANE_Y][i] = ((66*r + 129*g + 25*b) >> 8) + 16;
-                i++;
-            }
-        }
+VideoFrame Camera::getLastVideoFrame(QSize maxSize)
+{
+    int slot = acquireFrame();
+    if (slot < 0)
+        return VideoFrame();
+    VideoFrame video = frameSlots[slot].video;
+    releaseFrame(slot);
+
+    vpx_image* src = video.image();
+    if (!src)
+        return video;
+    int w = src->d_w, h = src->d_h;
+    if (!maxSize.isValid() || (w <= maxSize.width() && h <= maxSize.height()))
+        return video;
+
+    // Even sizes so the chroma planes scale by the same factor
+    QSize size = QSize(w, h).scaled(maxSize, Qt::KeepAspectRatio);
+    size = QSize(std::max(size.width() & ~1, 2), std::max(size.height() & ~1, 2));
+    VideoFrame scaled = VideoFrame::create(size.width(), size.height());
+    if (scaled.isNull())
+        return video;
+    vpx_image* dst = scaled.image();
+    for (int plane = VPX_PLANE_Y; plane <= VPX_PLANE_V; plane++)
+    {
+        int shift = plane == VPX_PLANE_Y ? 0 : 1;
+        VideoConvert::scalePlane(src->planes[plane], src->stride[plane], (w+shift) >> shift, (h+shift) >> shift,
+                                 dst->planes[plane], dst->stride[plane], size.width() >> shift, size.height() >> shift);
     }
-    return img;
+    return scaled;
 }
 
 Camera* Camera::getInstance()
 {
-    return Widget::getInstance()->getCamera();
+    return instance;
 }
@@ -18,29 +18,72 @@
 #define CAMERA_H
 
 #include <QImage>
-#include "vpx/vpx_image.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QList>
+#include <QSize>
+#include <QElapsedTimer>
+#include "videosource.h"
 #include "opencv2/opencv.hpp"
 
 /**
  * This class is a wrapper to share a camera's captured video frames
  * It allows objects to suscribe and unsuscribe to the stream, starting
  * the camera only when needed, and giving access to the last frames
+ * A capture thread owns the device, the getters only take its latest frame and never block
+ * Each frame is converted to I420 once, by the capture thread, and every consumer shares that
+ * The device is opened by the capture thread and kept open for a while after the last user leaves,
+ * opening a webcam takes long enough to be noticed every time a call or a preview starts
  **/
 
-class Camera
+class Camera : public VideoSource
 {
 public:
     Camera();
-    static Camera* getInstance(); ///< Returns the global widget's Camera instance
-    void suscribe(); ///< Call this once before trying to get frames
-    void unsuscribe(); ///< Call this once when you don't need frames anymore
-    cv::Mat getLastFrame(); ///< Get the last captured frame
-    QImage getLastImage(); ///< Convert the last frame to a QImage (can be expensive !)
-    vpx_image getLastVPXImage(); ///< Convert the last frame to a vpx_image (can be expensive !)
+    ~Camera();
+    static Camera* getInstance(); ///< Returns the Camera that was created last, Core's front end owns it
+    virtual void suscribe() override; ///< Call this once before trying to get frames
+    virtual void unsuscribe() override; ///< Call this once when you don't need frames anymore
+    void prewarm(int timeout); ///< Opens the device in the background and keeps it open for at least timeout ms, e.g. while a call rings
+    cv::Mat getLastFrame(); ///< Get a copy of the last captured frame, BGR or raw YUYV, empty if there is none yet
+    QImage getLastImage(QSize fitSize = QSize()); ///< Convert the last frame to a QImage scaled up or down to fit fitSize, null if there is none yet
+    virtual VideoFrame getLastVideoFrame(QSize maxSize = QSize()) override; ///< The last frame as I420, shared unless it has to be scaled down to fit maxSize
+    int getFrameSerial() const {return serial.loadAcquire();} ///< Changes every time a new frame is captured
+    QList<QSize> getSupportedResolutions(); ///< Probes the device the first time, opening it if it is closed. Blocks, call it from a worker
 
 private:
+    class CaptureThread;
+    int acquireFrame(); ///< Pins the latest frame's slot so the capture thread won't reuse it, or -1
+    void releaseFrame(int slot);
+    void configure(); ///< Asks the freshly opened device for the resolution, rate and format in the settings
+    void startCapture(); ///< Starts the capture thread unless it's running, call with subscriptionMutex held
+    void dropFrames(); ///< Unpublishes the frames, only the capture thread calls it
+    static VideoFrame toVideoFrame(const cv::Mat& frame); ///< Converts a BGR or YUYV capture to I420
+
+private:
+    /// The latest frame is published in a slot that nobody writes anymore, the capture thread
+    /// fills one that is neither the latest nor pinned. One slot per reader thread (Core and GUI)
+    /// plus the latest plus the one being filled means there's always a free one
+    enum {FRAME_SLOTS = 4};
+    struct FrameSlot
+    {
+        cv::Mat frame; ///< What the device gave us, reused by the next capture into this slot
+        VideoFrame video; ///< The frame converted once for everyone, readers take their own reference
+        QAtomicInt readers;
+    };
+
+    static Camera* instance;
     int refcount; ///< Number of users suscribed to the camera
-    cv::VideoCapture cam; ///< OpenCV camera capture opbject
+    QMutex subscriptionMutex; ///< Core and the GUI can suscribe from their threads
+    bool capturing; ///< The capture thread is running and will see the next subscription
+    QElapsedTimer idleTimer; ///< Since the device has nobody to capture for
+    int idleTimeout; ///< How long the device stays open with nobody suscribed, in ms
+    cv::VideoCapture cam; ///< OpenCV camera capture opbject, only touched by the capture thread once started
+    CaptureThread* captureThread;
+    FrameSlot frameSlots[FRAME_SLOTS];
+    QAtomicInt latest; ///< The slot of the latest frame, or -1
+    QAtomicInt serial;
+    QList<QSize> resolutions; ///< What the device accepted when we probed it, empty until then
 };
 
 #endif // CAMERA_H
@@ -16,121 +16,879 @@
 
 #include "chatareawidget.h"
 #include "widget/tool/chataction.h"
+#include "smileypack.h"
+#include "settings.h"
+#include "history.h"
+#include "widget/tool/visibility.h"
 #include <QScrollBar>
 #include <QDesktopServices>
-#include <QTextTable>
+#include <QTextDocument>
+#include <QTextDocumentFragment>
+#include <QTextCursor>
 #include <QAbstractTextDocumentLayout>
-#include <QCoreApplication>
+#include <QPainter>
+#include <QMouseEvent>
+#include <QKeyEvent>
+#include <QApplication>
+#include <QClipboard>
+#include <QUrl>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QDataStream>
+#include <QDir>
 #include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
-ChatAreaWidget::ChatAreaWidget(QWidget *parent) :
-    QTextBrowser(parent)
+/// Gets the smileys from the pack, so every row shares the pack's images
+class ChatDocument : public QTextDocument
 {
-    setReadOnly(true);
-    viewport()->setCursor(Qt::ArrowCursor);
-    setContextMenuPolicy(Qt::CustomContextMenu);
-    setUndoRedoEnabled(false);
+protected:
+    QVariant loadResource(int type, const QUrl& name) override
+    {
+        if (type == QTextDocument::ImageResource && name.scheme() == "smiley")
+            return SmileyPack::getInstance().getImage(name);
+        return QTextDocument::loadResource(type, name);
+    }
+};
+
+void ChatAreaWidget::HeightIndex::clear()
+{
+    tree.clear();
+}
+
+void ChatAreaWidget::HeightIndex::append(int height)
+{
+    // Node i covers the rows (i - lowbit(i), i], one-based
+    int i = tree.size() + 1;
+    int low = i & -i;
+    tree.append(height + top(i-1) - top(i-low));
+}
+
+void ChatAreaWidget::HeightIndex::add(int row, int delta)
+{
+    for (int i=row+1; i<=tree.size(); i+=i&-i)
+        tree[i-1] += delta;
+}
+
+int ChatAreaWidget::HeightIndex::top(int row) const
+{
+    int sum = 0;
+    for (int i=row; i>0; i-=i&-i)
+        sum += tree[i-1];
+    return sum;
+}
+
+int ChatAreaWidget::HeightIndex::total() const
+{
+    return top(tree.size());
+}
 
-    setOpenExternalLinks(false);
-    setOpenLinks(false);
-    setAcceptRichText(false);
+int ChatAreaWidget::HeightIndex::rowAt(int y) const
+{
+    int step = 1;
+    while (step*2 <= tree.size())
+        step *= 2;
+    int row = 0;
+    for (; step; step/=2)
+    {
+        if (row+step <= tree.size() && tree[row+step-1] <= y)
+        {
+            row += step;
+            y -= tree[row-1];
+        }
+    }
+    return std::min(row, tree.size()-1);
+}
 
-    chatTextTable = textCursor().insertTable(1,3);
+ChatAreaWidget::RowLayout::RowLayout()
+    : name{nullptr}, message{nullptr}
+{
+}
+
+ChatAreaWidget::RowLayout::~RowLayout()
+{
+    delete name;
+    delete message;
+}
 
-    QTextTableFormat tableFormat;
-    tableFormat.setColumnWidthConstraints({QTextLength(QTextLength::VariableLength,0),
-                                           QTextLength(QTextLength::PercentageLength,100),
-                                           QTextLength(QTextLength::VariableLength,0)});
-    tableFormat.setBorderStyle(QTextFrameFormat::BorderStyle_None);
-    chatTextTable->setFormat(tableFormat);
-    chatTextTable->format().setCellSpacing(2);
-    chatTextTable->format().setWidth(QTextLength(QTextLength::PercentageLength,100));
+ChatAreaWidget::ChatAreaWidget(QWidget *parent)
+    : QAbstractScrollArea(parent), nameWidth{0}, dateWidth{0}, shownNameWidth{0}, messageWidth{0},
+      lockSliderToBottom{true}, selecting{false}, shownRow{-1}, layoutStale{false}, layoutQueued{false}, rowBytes{0},
+      scrollbackLimit{Settings::getInstance().getScrollbackLimit()}, spill{nullptr}
+{
+    viewport()->setCursor(Qt::ArrowCursor);
+    viewport()->setMouseTracking(true);
+    setContextMenuPolicy(Qt::CustomContextMenu);
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setFocusPolicy(Qt::StrongFocus);
+    selectionAnchor = selectionCursor = Position{0, 0};
 
-//    nameFormat.setAlignment(Qt::AlignRight);
-//    nameFormat.setNonBreakableLines(true);
-//    dateFormat.setAlignment(Qt::AlignLeft);
-//    dateFormat.setNonBreakableLines(true);
+    estimatedHeight = fontMetrics().lineSpacing() + 3*CHAT_ROW_SPACING;
+    verticalScrollBar()->setSingleStep(fontMetrics().lineSpacing());
+    connect(verticalScrollBar(), &QScrollBar::actionTriggered, this, &ChatAreaWidget::onScrollAction);
+    connect(&SmileyPack::getInstance(), &SmileyPack::packChanged, this, &ChatAreaWidget::onSmileyPackChanged);
 
-    connect(this, &ChatAreaWidget::anchorClicked, this, &ChatAreaWidget::onAnchorClicked);
-    connect(verticalScrollBar(), SIGNAL(rangeChanged(int,int)), this, SLOT(onSliderRangeChanged()));
+    updateTimer.setSingleShot(true);
+    updateTimer.setInterval(CHAT_FRAME_INTERVAL);
+    connect(&updateTimer, &QTimer::timeout, this, &ChatAreaWidget::relayout);
 }
 
 ChatAreaWidget::~ChatAreaWidget()
 {
+    qDeleteAll(layouts);
     for (ChatAction* action : messages)
         delete action;
     messages.clear();
+    delete spill;
 }
 
-void ChatAreaWidget::mouseReleaseEvent(QMouseEvent * event)
+void ChatAreaWidget::setScrollbackLimit(int rows)
 {
-    QTextEdit::mouseReleaseEvent(event);
-    QPointF documentHitPost(event->pos().x() + horizontalScrollBar()->value(), event->pos().y() + verticalScrollBar()->value());
-    int pos = this->document()->documentLayout()->hitTest(documentHitPost, Qt::ExactHit);
-    if (pos > 0)
+    scrollbackLimit = rows;
+    spillOldRows();
+}
+
+void ChatAreaWidget::showRow(int row)
+{
+    if (row < 0 || row >= messages.size())
+        return;
+    lockSliderToBottom = false;
+    shownRow = row;
+    selectionAnchor = Position{row, 0};
+    selectionCursor = Position{row, std::numeric_limits<int>::max()};
+    scheduleLayout();
+}
+
+void ChatAreaWidget::setDefaultStyleSheet(const QString& css)
+{
+    styleSheet = css;
+    qDeleteAll(layouts);
+    layouts.clear();
+    nameWidths.clear();
+    invalidateHeights();
+}
+
+QTextDocument* ChatAreaWidget::newDocument(const QString& html, int width) const
+{
+    QTextDocument* doc = new ChatDocument;
+    doc->setUndoRedoEnabled(false);
+    doc->setDefaultFont(font());
+    doc->setDocumentMargin(CHAT_ROW_SPACING);
+    doc->setDefaultStyleSheet(styleSheet);
+    doc->setHtml(html);
+    doc->setTextWidth(width);
+    return doc;
+}
+
+void ChatAreaWidget::insertMessage(ChatAction *msgAction)
+{
+    if (msgAction == nullptr)
+        return;
+
+    appendRow(msgAction);
+    spillOldRows();
+    scheduleUpdate();
+}
+
+void ChatAreaWidget::insertMessages(const QList<ChatAction*>& msgActions)
+{
+    int count = messages.size() + msgActions.size();
+    messages.reserve(count);
+    heights.reserve(count);
+    measured.reserve(count);
+    for (ChatAction* action : msgActions)
+        if (action != nullptr)
+            appendRow(action);
+    spillOldRows();
+    scheduleUpdate();
+}
+
+void ChatAreaWidget::scheduleLayout()
+{
+    layoutStale = true;
+    if (layoutQueued)
+        return;
+    layoutQueued = true;
+    QMetaObject::invokeMethod(this, "relayout", Qt::QueuedConnection);
+}
+
+void ChatAreaWidget::relayout()
+{
+    updateTimer.stop();
+    // What the layout itself invalidates is done in this pass, it doesn't need another
+    layoutVisible();
+    layoutStale = layoutQueued = false;
+    viewport()->update();
+}
+
+void ChatAreaWidget::scheduleUpdate()
+{
+    // Off screen nothing gets laid out, the dirty viewport is painted in one pass once we're shown
+    if (!Visibility::isOnScreen(this))
     {
-        QTextCursor cursor(document());
-        cursor.setPosition(pos);
+        updateTimer.stop();
+        layoutStale = true;
+        viewport()->update();
+        return;
+    }
+    if (!updateTimer.isActive())
+        updateTimer.start();
+}
 
-        if(!cursor.atEnd())
+void ChatAreaWidget::appendRow(ChatAction* msgAction)
+{
+    int row = messages.size();
+    messages.append(msgAction);
+    rowOf.insert(msgAction, row);
+    if (msgAction->hasButtons())
+        interactiveRows.insert(row, msgAction);
+    heights.append(estimatedHeight);
+    measured.append(false);
+    index.append(estimatedHeight);
+    watchRow(msgAction);
+}
+
+void ChatAreaWidget::watchRow(ChatAction* msgAction)
+{
+    connect(msgAction, &ChatAction::contentChanged, this, &ChatAreaWidget::onRowChanged);
+    connect(msgAction, &ChatAction::repaintNeeded, this, &ChatAreaWidget::onRowRepaintNeeded);
+    rowBytes += actionBytes(msgAction);
+
+    // Only what changes the columns is measured now, the row waits until it's on screen
+    QString name = msgAction->getName();
+    auto it = nameWidths.find(name);
+    if (it == nameWidths.end())
+    {
+        QTextDocument* doc = newDocument(name, -1);
+        it = nameWidths.insert(name, std::ceil(doc->idealWidth()));
+        delete doc;
+    }
+    nameWidth = std::max(nameWidth, *it);
+    dateWidth = std::max(dateWidth, fontMetrics().width(msgAction->getDate()) + 2*CHAT_ROW_SPACING);
+}
+
+void ChatAreaWidget::spillOldRows()
+{
+    // Rows go in chunks so that this doesn't run for every message, and never while
+    // the user is reading older rows, who may just have paged them back in
+    if (scrollbackLimit <= 0 || !lockSliderToBottom || messages.size() < scrollbackLimit + CHAT_SPILL_CHUNK)
+        return;
+    spillRows(messages.size() - scrollbackLimit);
+}
+
+void ChatAreaWidget::spillRows(int count)
+{
+    // File transfers stay, their rows would come back from the spill as plain text without their buttons
+    if (!interactiveRows.isEmpty())
+        count = std::min(count, interactiveRows.firstKey());
+    if (count <= 0)
+        return;
+    // With encrypted logs the spill is sealed like them, without their key the rows stay in memory
+    bool encrypted = Settings::getInstance().getEncryptLogs();
+    if (encrypted && !History::getInstance().canSeal())
+        return;
+
+    if (!spill)
+    {
+        spill = new QTemporaryFile(QDir::temp().filePath("qtox-chat-XXXXXX"));
+        if (!spill->open())
         {
-            cursor.setPosition(pos+1);
+            qWarning() << "ChatAreaWidget: Can't open a file to spill the scrollback, keeping it in memory";
+            delete spill;
+            spill = nullptr;
+            scrollbackLimit = 0;
+            return;
+        }
+    }
+
+    QByteArray chunk;
+    QDataStream rows(&chunk, QIODevice::WriteOnly);
+    rows << (qint32)count;
+    for (int i=0; i<count; i++)
+    {
+        ChatAction* action = messages[i];
+        rows << action->getAuthor() << action->getPlainMessage() << action->getDate() << action->isMine();
+        rowBytes -= actionBytes(action);
+        rowOf.remove(action);
+        delete action;
+    }
+    spill->seek(spill->size());
+    spilledChunks.append(spill->pos());
+    QDataStream stream(spill);
+    stream << (quint8)encrypted << (encrypted ? History::getInstance().seal(chunk) : chunk);
+
+    messages.remove(0, count);
+    heights.remove(0, count);
+    measured.remove(0, count);
+    renumberRows(-count, count);
+}
 
-            QTextFormat format = cursor.charFormat();
-            if (format.isImageFormat())
+bool ChatAreaWidget::readSpilledChunk(QDataStream& stream, QByteArray& chunk)
+{
+    quint8 encrypted;
+    QByteArray payload;
+    stream >> encrypted >> payload;
+    if (stream.status() != QDataStream::Ok)
+        return false;
+    if (!encrypted)
+    {
+        chunk = payload;
+        return true;
+    }
+    return History::getInstance().unseal(payload, chunk);
+}
+
+int ChatAreaWidget::reloadSpilledRows()
+{
+    if (spilledChunks.isEmpty())
+        return 0;
+
+    qint64 offset = spilledChunks.takeLast();
+    spill->seek(offset);
+    QDataStream stream(spill);
+    QByteArray chunk;
+    bool ok = readSpilledChunk(stream, chunk);
+    QDataStream in(chunk);
+    qint32 count = 0;
+    in >> count;
+    QVector<ChatAction*> rows;
+    for (int i=0; ok && i<count && in.status() == QDataStream::Ok; i++)
+    {
+        QString author, message, date;
+        bool isMe;
+        in >> author >> message >> date >> isMe;
+        rows.append(new MessageAction(author, message, date, isMe));
+    }
+    if (!ok || in.status() != QDataStream::Ok)
+        qWarning() << "ChatAreaWidget: Lost part of the spilled scrollback";
+    spill->resize(offset);
+
+    messages = rows + messages;
+    heights = QVector<int>(rows.size(), estimatedHeight) + heights;
+    measured = QVector<bool>(rows.size(), false) + measured;
+    for (ChatAction* action : rows)
+        watchRow(action);
+    renumberRows(rows.size(), 0);
+    return rows.size() * estimatedHeight;
+}
+
+void ChatAreaWidget::renumberRows(int delta, int count)
+{
+    // Laid out rows keep their documents under their new number, removed ones lose them
+    QHash<int, RowLayout*> moved;
+    for (auto it = layouts.begin(); it != layouts.end(); ++it)
+    {
+        if (it.key() < count)
+            delete it.value();
+        else
+            moved.insert(it.key() + delta, it.value());
+    }
+    layouts.swap(moved);
+
+    rowOf.clear();
+    interactiveRows.clear();
+    index.clear();
+    for (int i=0; i<messages.size(); i++)
+    {
+        rowOf.insert(messages[i], i);
+        if (messages[i]->hasButtons())
+            interactiveRows.insert(i, messages[i]);
+        index.append(heights[i]);
+    }
+
+    if (std::min(selectionAnchor, selectionCursor).row < count)
+    {
+        selectionAnchor = selectionCursor = Position{0, 0};
+    }
+    else
+    {
+        selectionAnchor.row += delta;
+        selectionCursor.row += delta;
+    }
+}
+
+void ChatAreaWidget::invalidateHeights()
+{
+    qDeleteAll(layouts);
+    layouts.clear();
+    index.clear();
+    for (int i=0; i<messages.size(); i++)
+    {
+        if (measured[i])
+            heights[i] = estimatedHeight;
+        measured[i] = false;
+        index.append(heights[i]);
+    }
+    scheduleLayout();
+}
+
+void ChatAreaWidget::updateColumns()
+{
+    int width = viewport()->width();
+    int shownName = std::min(nameWidth, width/4);
+    int message = std::max(width - shownName - dateWidth - CHAT_ROW_SPACING, 50);
+    if (shownName == shownNameWidth && message == messageWidth)
+        return;
+    shownNameWidth = shownName;
+    messageWidth = message;
+    invalidateHeights();
+}
+
+int ChatAreaWidget::messageLeft() const
+{
+    return shownNameWidth + CHAT_ROW_SPACING;
+}
+
+ChatAreaWidget::RowLayout* ChatAreaWidget::layoutRow(int row)
+{
+    RowLayout*& layout = layouts[row];
+    if (layout)
+        return layout;
+
+    layout = new RowLayout;
+    ChatAction* action = messages[row];
+    layout->name = newDocument(action->getName(), shownNameWidth);
+    layout->message = newDocument(QString(), messageWidth);
+    action->writeMessage(layout->message);
+    int height = std::ceil(std::max(std::max(layout->name->size().height(), layout->message->size().height()),
+                                    (qreal)fontMetrics().lineSpacing() + 2*CHAT_ROW_SPACING));
+    height += CHAT_ROW_SPACING;
+    if (height != heights[row])
+    {
+        index.add(row, height - heights[row]);
+        heights[row] = height;
+    }
+    measured[row] = true;
+    return layout;
+}
+
+void ChatAreaWidget::layoutVisible()
+{
+    QScrollBar* scroll = verticalScrollBar();
+    int viewHeight = viewport()->height();
+    scroll->setPageStep(viewHeight);
+    if (messages.isEmpty())
+    {
+        scroll->setRange(0, 0);
+        return;
+    }
+    updateColumns();
+
+    int first, last;
+    if (lockSliderToBottom)
+    {
+        // The last screen and one above it
+        int covered = 0;
+        for (first = messages.size(); first > 0 && covered < 2*viewHeight; covered += heights[first])
+            layoutRow(--first);
+        last = messages.size() - 1;
+        scroll->setRange(0, std::max(index.total() - viewHeight, 0));
+        scroll->setValue(scroll->maximum());
+    }
+    else
+    {
+        // The rows above are laid out too, so the one at the top mustn't move when they get their real height
+        if (shownRow >= 0)
+        {
+            // The rows above get their real height first, so the row lands a third down the view
+            int covered = 0;
+            for (int row = shownRow; row >= 0 && covered < viewHeight; row--)
             {
-                QString imageName = format.toImageFormat().name();
-                if (QRegExp("^data:ftrans.*").exactMatch(imageName))
-                {
-                    QString data = imageName.right(imageName.length() - 12);
-                    int endpos = data.indexOf("/png;base64");
-                    data = data.left(endpos);
-                    int middlepos = data.indexOf(".");
-                    QString widgetID = data.left(middlepos);
-                    QString widgetBtn = data.right(data.length() - middlepos - 1);
-                    qDebug() << "ChatAreaWidget::mouseReleaseEvent:" << widgetID << widgetBtn;
-                    emit onFileTranfertInterract(widgetID, widgetBtn);
-                }
+                layoutRow(row);
+                covered += heights[row];
             }
+            scroll->setRange(0, std::max(index.total() - viewHeight, 0));
+            scroll->setValue(index.top(shownRow) - viewHeight/3);
+            shownRow = -1;
+        }
+        int value = scroll->value();
+        if (value < viewHeight && !spilledChunks.isEmpty())
+        {
+            int added = reloadSpilledRows();
+            scroll->setRange(0, std::max(index.total() - viewHeight, 0));
+            scroll->setValue(value + added);
+            value = scroll->value();
+        }
+        int anchor = index.rowAt(value);
+        int offset = value - index.top(anchor);
+        int covered = -offset;
+        for (last = anchor; last < messages.size() && covered < 2*viewHeight; last++)
+        {
+            layoutRow(last);
+            covered += heights[last];
         }
+        last = std::max(last - 1, anchor);
+        covered = 0;
+        for (first = anchor; first > 0 && covered < viewHeight; covered += heights[first])
+            layoutRow(--first);
+        offset = std::min(offset, heights[anchor] - 1);
+        scroll->setRange(0, std::max(index.total() - viewHeight, 0));
+        scroll->setValue(index.top(anchor) + offset);
     }
+    evictLayouts(first, last);
 }
 
-void ChatAreaWidget::onAnchorClicked(const QUrl &url)
+void ChatAreaWidget::evictLayouts(int first, int last)
 {
-    QDesktopServices::openUrl(url);
+    for (auto it = layouts.begin(); it != layouts.end();)
+    {
+        if (it.key() < first || it.key() > last)
+        {
+            delete it.value();
+            it = layouts.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
 }
 
-void ChatAreaWidget::insertMessage(ChatAction *msgAction)
+void ChatAreaWidget::paintEvent(QPaintEvent*)
 {
-    if (msgAction == nullptr)
+    // The scroll range isn't touched while painting, rows missing their layout get it below
+    // and the range catches up right after
+    if (layoutStale)
+        scheduleLayout();
+    if (messages.isEmpty())
         return;
 
-    checkSlider();
+    QPainter painter(viewport());
+    int viewHeight = viewport()->height();
+    int value = verticalScrollBar()->value();
+    int row = index.rowAt(value);
+    int top = index.top(row) - value;
+    Position start = std::min(selectionAnchor, selectionCursor), end = std::max(selectionAnchor, selectionCursor);
+    for (; row < messages.size() && top < viewHeight; top += heights[row], row++)
+    {
+        RowLayout* layout = layoutRow(row);
 
-    int row = chatTextTable->rows() - 1;
-    QTextCursor cur = chatTextTable->cellAt(row,1).firstCursorPosition();
-    cur.clearSelection();
-    cur.setKeepPositionOnInsert(true);
-    chatTextTable->appendRows(1);
-    chatTextTable->cellAt(row,0).firstCursorPosition().insertHtml(msgAction->getName());
-    chatTextTable->cellAt(row,1).firstCursorPosition().insertHtml(msgAction->getMessage());
-    chatTextTable->cellAt(row,2).firstCursorPosition().insertText(msgAction->getDate());
+        painter.save();
+        painter.translate(0, top);
+        layout->name->drawContents(&painter, QRectF(0, 0, shownNameWidth, heights[row]));
+        painter.restore();
 
-    msgAction->setTextCursor(cur);
+        QAbstractTextDocumentLayout::PaintContext context;
+        context.palette = palette();
+        context.clip = QRectF(0, 0, messageWidth, heights[row]);
+        if (hasSelection() && row >= start.row && row <= end.row)
+        {
+            int length = layout->message->characterCount() - 1;
+            QAbstractTextDocumentLayout::Selection selection;
+            selection.cursor = QTextCursor(layout->message);
+            selection.cursor.setPosition(row == start.row ? std::min(start.pos, length) : 0);
+            selection.cursor.setPosition(row == end.row ? std::min(end.pos, length) : length, QTextCursor::KeepAnchor);
+            selection.format.setBackground(palette().brush(QPalette::Highlight));
+            selection.format.setForeground(palette().brush(QPalette::HighlightedText));
+            context.selections.append(selection);
+        }
+        painter.save();
+        painter.translate(messageLeft(), top);
+        painter.setClipRect(context.clip);
+        layout->message->documentLayout()->draw(&painter, context);
+        painter.restore();
 
-    messages.append(msgAction);
+        painter.drawText(QRect(viewport()->width() - dateWidth + CHAT_ROW_SPACING, top + CHAT_ROW_SPACING,
+                               dateWidth, heights[row]), Qt::AlignLeft | Qt::AlignTop, messages[row]->getDate());
+    }
+}
+
+void ChatAreaWidget::resizeEvent(QResizeEvent* event)
+{
+    QAbstractScrollArea::resizeEvent(event);
+    scheduleLayout();
 }
 
-void ChatAreaWidget::onSliderRangeChanged()
+void ChatAreaWidget::scrollContentsBy(int, int)
+{
+    scheduleLayout();
+}
+
+void ChatAreaWidget::onScrollAction()
 {
     QScrollBar* scroll = verticalScrollBar();
-    if (lockSliderToBottom)
-        scroll->setValue(scroll->maximum());
+    lockSliderToBottom = scroll->sliderPosition() >= scroll->maximum();
 }
 
-void ChatAreaWidget::checkSlider()
+void ChatAreaWidget::onSmileyPackChanged()
 {
+    // The heights stay, what's laid out again gets its real one
+    qDeleteAll(layouts);
+    layouts.clear();
+    scheduleLayout();
+}
+
+void ChatAreaWidget::onRowChanged()
+{
+    int row = rowOf.value(static_cast<ChatAction*>(sender()), -1);
+    if (row < 0)
+        return;
+    delete layouts.take(row);
+    scheduleLayout();
+}
+
+void ChatAreaWidget::onRowRepaintNeeded()
+{
+    int row = rowOf.value(static_cast<ChatAction*>(sender()), -1);
+    if (row < 0 || !layouts.contains(row))
+        return;
+    viewport()->update(0, index.top(row) - verticalScrollBar()->value(), viewport()->width(), heights[row]);
+}
+
+bool ChatAreaWidget::positionAt(const QPoint& point, Position& position)
+{
+    if (messages.isEmpty())
+        return false;
+    int y = point.y() + verticalScrollBar()->value();
+    position.row = index.rowAt(std::max(y, 0));
+    QTextDocument* doc = layoutRow(position.row)->message;
+    QPointF local(point.x() - messageLeft(), y - index.top(position.row));
+    position.pos = std::max(doc->documentLayout()->hitTest(local, Qt::FuzzyHit), 0);
+    return true;
+}
+
+QString ChatAreaWidget::anchorAt(const QPoint& point)
+{
+    if (messages.isEmpty())
+        return QString();
+    int y = point.y() + verticalScrollBar()->value();
+    int row = index.rowAt(std::max(y, 0));
+    QTextDocument* doc = layoutRow(row)->message;
+    QPointF local(point.x() - messageLeft(), y - index.top(row));
+    return doc->documentLayout()->anchorAt(local);
+}
+
+ChatAction* ChatAreaWidget::buttonAt(const QPoint& point, int& button)
+{
+    button = -1;
+    if (messages.isEmpty())
+        return nullptr;
+    int y = point.y() + verticalScrollBar()->value();
+    auto it = interactiveRows.find(index.rowAt(std::max(y, 0)));
+    if (it == interactiveRows.end())
+        return nullptr;
+
+    // The action knows where it drew its buttons, no need to ask the document
+    int row = it.key();
+    if (!layouts.contains(row))
+        return nullptr;
+    button = it.value()->buttonAt(QPointF(point.x() - messageLeft(), y - index.top(row)));
+    return button < 0 ? nullptr : it.value();
+}
+
+void ChatAreaWidget::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QAbstractScrollArea::mousePressEvent(event);
+
+    pressPoint = event->pos();
+    Position position;
+    if (!positionAt(event->pos(), position))
+        return;
+    selectionCursor = position;
+    if (!(event->modifiers() & Qt::ShiftModifier))
+        selectionAnchor = position;
+    selecting = true;
+    viewport()->update();
+}
+
+void ChatAreaWidget::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!selecting)
+    {
+        int button;
+        bool clickable = buttonAt(event->pos(), button) || !anchorAt(event->pos()).isEmpty();
+        viewport()->setCursor(clickable ? Qt::PointingHandCursor : Qt::ArrowCursor);
+        return;
+    }
+
+    // Dragging past the edges scrolls
     QScrollBar* scroll = verticalScrollBar();
-    lockSliderToBottom = scroll && scroll->value() == scroll->maximum();
+    if (event->pos().y() < 0)
+        scroll->setValue(scroll->value() + event->pos().y());
+    else if (event->pos().y() > viewport()->height())
+        scroll->setValue(scroll->value() + event->pos().y() - viewport()->height());
+    lockSliderToBottom = scroll->value() >= scroll->maximum();
+
+    Position position;
+    if (positionAt(event->pos(), position))
+        selectionCursor = position;
+    viewport()->update();
+}
+
+void ChatAreaWidget::mouseReleaseEvent(QMouseEvent * event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QAbstractScrollArea::mouseReleaseEvent(event);
+    selecting = false;
+
+    if (hasSelection())
+    {
+        QClipboard* clipboard = QApplication::clipboard();
+        if (clipboard->supportsSelection())
+            clipboard->setText(selectedText(), QClipboard::Selection);
+        return;
+    }
+    if ((event->pos() - pressPoint).manhattanLength() >= QApplication::startDragDistance())
+        return;
+
+    int button;
+    if (ChatAction* action = buttonAt(event->pos(), button))
+    {
+        action->pressButton(button);
+        return;
+    }
+    QString anchor = anchorAt(event->pos());
+    if (!anchor.isEmpty())
+        QDesktopServices::openUrl(QUrl(anchor));
+}
+
+void ChatAreaWidget::mouseDoubleClickEvent(QMouseEvent* event)
+{
+    Position position;
+    if (event->button() != Qt::LeftButton || !positionAt(event->pos(), position))
+        return QAbstractScrollArea::mouseDoubleClickEvent(event);
+
+    QTextCursor cursor(layoutRow(position.row)->message);
+    cursor.setPosition(position.pos);
+    cursor.select(QTextCursor::WordUnderCursor);
+    selectionAnchor = Position{position.row, cursor.selectionStart()};
+    selectionCursor = Position{position.row, cursor.selectionEnd()};
+    viewport()->update();
+}
+
+void ChatAreaWidget::keyPressEvent(QKeyEvent* event)
+{
+    if (event == QKeySequence::Copy)
+        copy();
+    else if (event == QKeySequence::SelectAll)
+        selectAll();
+    else
+        QAbstractScrollArea::keyPressEvent(event);
+}
+
+bool ChatAreaWidget::hasSelection() const
+{
+    return !(selectionAnchor == selectionCursor);
+}
+
+QString ChatAreaWidget::rowText(int row, int from, int to) const
+{
+    QTextDocument* doc = layouts.contains(row) ? layouts[row]->message : nullptr;
+    QTextDocument* temporary = nullptr;
+    if (messages[row]->isObject())
+    {
+        if (from > 0 || to == 0)
+            return QString();
+        doc = temporary = newDocument(messages[row]->getMessage(), -1);
+        from = 0;
+        to = -1;
+    }
+    else if (!doc)
+    {
+        doc = temporary = newDocument(messages[row]->getMessage(), -1);
+    }
+
+    int length = doc->characterCount() - 1;
+    QTextCursor cursor(doc);
+    cursor.setPosition(std::min(from, length));
+    cursor.setPosition(to < 0 ? length : std::min(to, length), QTextCursor::KeepAnchor);
+    QString text = cursor.selection().toPlainText();
+    delete temporary;
+    return text;
+}
+
+QString ChatAreaWidget::selectedText() const
+{
+    if (!hasSelection())
+        return QString();
+
+    Position start = std::min(selectionAnchor, selectionCursor), end = std::max(selectionAnchor, selectionCursor);
+    QStringList lines;
+    for (int row=start.row; row<=end.row; row++)
+        lines << rowText(row, row == start.row ? start.pos : 0, row == end.row ? end.pos : -1);
+    return lines.join("\n");
+}
+
+void ChatAreaWidget::copy()
+{
+    if (hasSelection())
+        QApplication::clipboard()->setText(selectedText());
+}
+
+void ChatAreaWidget::selectAll()
+{
+    if (messages.isEmpty())
+        return;
+    selectionAnchor = Position{0, 0};
+    selectionCursor = Position{messages.size()-1, std::numeric_limits<int>::max()};
+    viewport()->update();
+}
+
+QString ChatAreaWidget::toPlainText() const
+{
+    QString text;
+    if (spill)
+    {
+        spill->seek(0);
+        QDataStream stream(spill);
+        QByteArray chunk;
+        while (!stream.atEnd() && readSpilledChunk(stream, chunk))
+        {
+            QDataStream in(chunk);
+            qint32 count = 0;
+            in >> count;
+            for (int i=0; i<count && in.status() == QDataStream::Ok; i++)
+            {
+                QString author, message, date;
+                bool isMe;
+                in >> author >> message >> date >> isMe;
+                if (!author.isEmpty())
+                    text += author + "\n";
+                text += message + "\n" + date + "\n";
+            }
+        }
+    }
+    for (ChatAction* action : messages)
+    {
+        QString name = QTextDocumentFragment::fromHtml(action->getName()).toPlainText();
+        if (!name.isEmpty())
+            text += name + "\n";
+        text += QTextDocumentFragment::fromHtml(action->getMessage()).toPlainText() + "\n";
+        text += action->getDate() + "\n";
+    }
+    return text;
+}
+
+qint64 ChatAreaWidget::actionBytes(ChatAction* action)
+{
+    return sizeof(MessageAction) + (action->getAuthor().size() + action->getPlainMessage().size()
+                                    + action->getDate().size()) * sizeof(QChar);
+}
+
+qint64 ChatAreaWidget::getMemoryUsage() const
+{
+    // The rows are counted as they come and go, only the few laid out ones are walked
+    qint64 bytes = messages.capacity() * (sizeof(ChatAction*) + sizeof(int) + sizeof(bool)) + rowBytes;
+    for (const RowLayout* layout : layouts)
+        bytes += 2*CHAT_DOCUMENT_OVERHEAD
+                 + (layout->name->characterCount() + layout->message->characterCount()) * sizeof(QChar);
+    return bytes;
+}
+
+void ChatAreaWidget::trim()
+{
+    qDeleteAll(layouts);
+    layouts.clear();
+    nameWidths.clear();
+
+    int count = messages.size() - CHAT_SPILL_CHUNK;
+    if (lockSliderToBottom && count > 0)
+        spillRows(count);
+    messages.squeeze();
+    heights.squeeze();
+    measured.squeeze();
+    scheduleLayout();
 }
@@ -17,38 +17,148 @@
 #ifndef CHATAREAWIDGET_H
 #define CHATAREAWIDGET_H
 
-#include <QTextBrowser>
-#include <QList>
+#include <QAbstractScrollArea>
+#include <QVector>
+#include <QHash>
+#include <QMap>
+#include <QTimer>
+
+// Pixels between rows and around their text
+#define CHAT_ROW_SPACING 2
+// At most one repaint, and so one layout pass, per this many ms when messages arrive
+#define CHAT_FRAME_INTERVAL 16
+// Rows spilled to disk at once when the scrollback limit is passed, and paged back in at once
+#define CHAT_SPILL_CHUNK 200
+// What a laid out QTextDocument costs on top of its text, roughly, for the memory report
+#define CHAT_DOCUMENT_OVERHEAD 2048
 
 class ChatAction;
-class QTextTable;
+class QTextDocument;
+class QTemporaryFile;
+class QDataStream;
 
-class ChatAreaWidget : public QTextBrowser
+/// Shows the messages of a chat as rows of name, message and date. Only the rows on screen,
+/// plus a screen's height above and below, are laid out and kept as QTextDocuments; the others
+/// are just their ChatAction and a height, estimated until they've been laid out once.
+/// Scrolling keeps the top row in place while estimates above it turn into real heights.
+/// Past the scrollback limit the oldest rows are spilled to a temporary file, sealed with the key
+/// of the logs when they're encrypted, and paged back in chunks when the user scrolls up to them.
+class ChatAreaWidget : public QAbstractScrollArea
 {
     Q_OBJECT
 public:
     explicit ChatAreaWidget(QWidget *parent = 0);
     virtual ~ChatAreaWidget();
-    void insertMessage(ChatAction *msgAction);
+    void insertMessage(ChatAction *msgAction); ///< Takes ownership
+    void insertMessages(const QList<ChatAction*>& msgActions); ///< Takes ownership, for backlogs and bursts
+    void setDefaultStyleSheet(const QString& css); ///< Used for every row's HTML
+    void setScrollbackLimit(int rows); ///< 0 keeps every row in memory
+    void showRow(int row); ///< Scrolls to the row and selects it
+    QString toPlainText() const; ///< The whole conversation, lays out nothing
+    bool hasSelection() const;
+    QString selectedText() const;
+    qint64 getMemoryUsage() const; ///< Rough bytes of the rows kept in memory and of their laid out documents
+    void trim(); ///< Forgets the laid out documents and, unless the user scrolled up, spills all but a chunk of rows
 
-signals:
-    void onFileTranfertInterract(QString widgetName, QString buttonName);
+public slots:
+    void copy();
+    void selectAll();
 
 protected:
-    void mouseReleaseEvent(QMouseEvent * event);
+    void paintEvent(QPaintEvent* event);
+    void resizeEvent(QResizeEvent* event);
+    void scrollContentsBy(int dx, int dy);
+    void mousePressEvent(QMouseEvent* event);
+    void mouseMoveEvent(QMouseEvent* event);
+    void mouseReleaseEvent(QMouseEvent* event);
+    void mouseDoubleClickEvent(QMouseEvent* event);
+    void keyPressEvent(QKeyEvent* event);
 
 private slots:
-    void onAnchorClicked(const QUrl& url);
-    void onSliderRangeChanged();
+    void onRowChanged(); ///< A ChatAction's content changed
+    void onRowRepaintNeeded(); ///< A ChatAction's embedded object changed, but not its size
+    void onScrollAction(); ///< The user scrolled, we stick to the bottom if that's where they went
+    void onSmileyPackChanged(); ///< Formats the rows again
+    void relayout(); ///< Runs the layout scheduleLayout asked for, then repaints
+
+private:
+    /// Laid out documents of a row on screen
+    struct RowLayout
+    {
+        RowLayout();
+        ~RowLayout();
+        QTextDocument *name, *message;
+    };
+    /// Lets us find a row's top and the row at a height in log time, Fenwick tree style
+    class HeightIndex
+    {
+    public:
+        void clear();
+        void append(int height);
+        void add(int row, int delta);
+        int top(int row) const; ///< Sum of the heights before the row
+        int rowAt(int y) const; ///< The row containing y, clamped to the rows we have
+        int total() const;
+        int size() const {return tree.size();}
+    private:
+        QVector<int> tree;
+    };
+    /// A place in the text of a message
+    struct Position
+    {
+        int row, pos;
+        bool operator==(const Position& other) const {return row == other.row && pos == other.pos;}
+        bool operator<(const Position& other) const {return row < other.row || (row == other.row && pos < other.pos);}
+    };
+
+    void appendRow(ChatAction* msgAction);
+    void watchRow(ChatAction* msgAction); ///< Connects it and accounts for its name and date
+    void spillOldRows(); ///< If we're over the limit, and at the bottom
+    void spillRows(int count); ///< The oldest rows up to the first with buttons, they stay in memory if the spill can't be opened or sealed
+    static bool readSpilledChunk(QDataStream& stream, QByteArray& chunk); ///< Unsealed if need be
+    static qint64 actionBytes(ChatAction* action); ///< Rough, from its text
+    int reloadSpilledRows(); ///< The newest spilled chunk, returns the height it added
+    void renumberRows(int delta, int count); ///< After removing or prepending rows at the front
+    void scheduleUpdate(); ///< Lays out and repaints at the next frame, whatever arrives until then, or once we're on screen again
+    void scheduleLayout(); ///< Lays out and fixes the scroll range from the event loop, never from paintEvent
+    void updateColumns(); ///< When a wider name or date shows up, or we're resized
+    void invalidateHeights();
+    RowLayout* layoutRow(int row); ///< Lays the row out if needed and records its real height
+    void layoutVisible(); ///< Lays out the rows around the viewport and fixes the scroll range
+    void evictLayouts(int first, int last); ///< Forgets the documents of rows outside [first, last]
+    QTextDocument* newDocument(const QString& html, int width) const;
+    bool positionAt(const QPoint& point, Position& position); ///< In viewport coordinates
+    QString anchorAt(const QPoint& point);
+    ChatAction* buttonAt(const QPoint& point, int& button); ///< Nothing if the row isn't in the hit map
+    int messageLeft() const;
+    QString rowText(int row, int from, int to) const; ///< Plain text of part of a message, -1 to is the end
 
 private:
-    void checkSlider();
+    QVector<ChatAction*> messages;
+    QVector<int> heights;
+    QVector<bool> measured;
+    HeightIndex index;
+    QHash<int, RowLayout*> layouts;
+    QHash<ChatAction*, int> rowOf; ///< For the updates of file transfers
+    QMap<int, ChatAction*> interactiveRows; ///< Hit map of the rows with buttons, by row
+    QString styleSheet;
+    QHash<QString, int> nameWidths; ///< By the name's HTML
+    int nameWidth, dateWidth; ///< What the widest name and date we've seen need
+    int shownNameWidth, messageWidth; ///< Names get at most a quarter of the width
 
-    QList<ChatAction*> messages;
+    int estimatedHeight;
     bool lockSliderToBottom;
-    int sliderPosition;
-    QTextTable *chatTextTable;
-    QTextBlockFormat nameFormat, dateFormat;
+    bool selecting;
+    Position selectionAnchor, selectionCursor;
+    QPoint pressPoint;
+    int shownRow; ///< What showRow asked for, done at the next layout
+    bool layoutStale; ///< Rows or the view changed since layoutVisible last ran
+    bool layoutQueued; ///< relayout is posted
+    qint64 rowBytes; ///< actionBytes of the rows in memory, kept up to date for getMemoryUsage
+    QTimer updateTimer;
+    int scrollbackLimit;
+    QTemporaryFile* spill; ///< Made when we first need it
+    QVector<qint64> spilledChunks; ///< Offsets in the spill, the newest chunk is last
 };
 
 #endif // CHATAREAWIDGET_H
@@ -0,0 +1,75 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "contactlistdelegate.h"
+#include "contactlistmodel.h"
+#include "style.h"
+#include <QPainter>
+#include <QPixmap>
+
+ContactListDelegate::ContactListDelegate(QObject *parent) :
+    QStyledItemDelegate(parent)
+{
+    smallFont.setPixelSize(10);
+}
+
+QSize ContactListDelegate::sizeHint(const QStyleOptionViewItem &option, const QModelIndex &) const
+{
+    return QSize(option.rect.width(), CONTACT_ROW_HEIGHT);
+}
+
+void ContactListDelegate::paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const
+{
+    bool active = index.data(ContactListModel::ActiveRole).toBool();
+    bool isGroup = index.data(ContactListModel::IsGroupRole).toBool();
+    QRect r = option.rect;
+
+    QColor background(65,65,65,255);
+    if (active)
+        background = Qt::white;
+    else if (option.state & QStyle::State_MouseOver)
+        background = QColor(75,75,75,255);
+    painter->save();
+    painter->fillRect(r, background);
+
+    QString avatarPath = isGroup ? ":img/group" : ":img/contact";
+    if (active)
+        avatarPath += "_dark";
+    QPixmap avatar = Style::getPixmap(avatarPath + ".png");
+    int x = r.left() + 20;
+    painter->drawPixmap(x, r.top() + (r.height() - avatar.height()) / 2, avatar);
+    x += avatar.width() + 5;
+
+    QPixmap light = Style::getPixmap(index.data(ContactListModel::StatusLightRole).toString());
+    int lightX = r.right() - 5 - light.width();
+    painter->drawPixmap(lightX, r.top() + (r.height() - light.height()) / 2, light);
+
+    int textWidth = lightX - 5 - x;
+    QFontMetrics nameMetrics(option.font), smallMetrics(smallFont);
+    int textTop = r.top() + (r.height() - nameMetrics.height() - smallMetrics.height()) / 2;
+
+    painter->setPen(active ? Qt::black : Qt::white);
+    painter->setFont(option.font);
+    QString name = nameMetrics.elidedText(index.data(Qt::DisplayRole).toString(), Qt::ElideRight, textWidth);
+    painter->drawText(QRect(x, textTop, textWidth, nameMetrics.height()), Qt::AlignLeft | Qt::AlignVCenter, name);
+
+    painter->setPen(active ? Qt::darkGray : Qt::gray);
+    painter->setFont(smallFont);
+    QString status = smallMetrics.elidedText(index.data(ContactListModel::StatusMessageRole).toString(), Qt::ElideRight, textWidth);
+    painter->drawText(QRect(x, textTop + nameMetrics.height(), textWidth, smallMetrics.height()), Qt::AlignLeft | Qt::AlignVCenter, status);
+
+    painter->restore();
+}
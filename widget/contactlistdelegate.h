@@ -14,32 +14,25 @@
     See the COPYING file for more details.
 */
 
-#ifndef GROUPWIDGET_H
-#define GROUPWIDGET_H
+#ifndef CONTACTLISTDELEGATE_H
+#define CONTACTLISTDELEGATE_H
 
-#include <QLabel>
-#include "genericchatroomwidget.h"
+#include <QStyledItemDelegate>
 
-class GroupWidget : public GenericChatroomWidget
+#define CONTACT_ROW_HEIGHT 55
+
+/// Paints a contact row the way the old per-friend widgets looked, without any child widgets
+class ContactListDelegate : public QStyledItemDelegate
 {
     Q_OBJECT
 public:
-    GroupWidget(int GroupId, QString Name);
-    void onUserListChanged();
-    void contextMenuEvent(QContextMenuEvent * event);
-    void setAsInactiveChatroom();
-    void setAsActiveChatroom();
-    void updateStatusLight();
-    void setChatForm(Ui::MainWindow &);
-    void resetEventFlags();
-
-signals:
-    void groupWidgetClicked(GroupWidget* widget);
-    void removeGroup(int groupId);
+    explicit ContactListDelegate(QObject *parent = 0);
 
-public:
-    int groupId;
-    QLabel avatar, name, nusers, statusPic;
+    void paint(QPainter *painter, const QStyleOptionViewItem &option, const QModelIndex &index) const;
+    QSize sizeHint(const QStyleOptionViewItem &option, const QModelIndex &index) const;
+
+private:
+    QFont smallFont;
 };
 
-#endif // GROUPWIDGET_H
+#endif // CONTACTLISTDELEGATE_H
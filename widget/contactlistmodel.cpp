@@ -0,0 +1,261 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "contactlistmodel.h"
+#include "friendlist.h"
+#include "friend.h"
+#include "grouplist.h"
+#include "group.h"
+#include "grouppeermodel.h"
+#include "settings.h"
+#include <algorithm>
+
+ContactListModel::ContactListModel(QObject *parent) :
+    QAbstractListModel(parent), activeIsGroup{false}, activeId{-1}
+{
+}
+
+int ContactListModel::rowCount(const QModelIndex &parent) const
+{
+    if (parent.isValid())
+        return 0;
+    return entries.size();
+}
+
+QVariant ContactListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= entries.size())
+        return QVariant();
+
+    const Entry& e = entries[index.row()];
+    if (role == IsGroupRole)
+        return e.isGroup;
+    else if (role == IdRole)
+        return e.id;
+    else if (role == ActiveRole)
+        return e.isGroup == activeIsGroup && e.id == activeId;
+
+    if (e.isGroup)
+    {
+        Group* g = GroupList::findGroup(e.id);
+        if (!g)
+            return QVariant();
+
+        if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+            return g->name;
+        else if (role == StatusMessageRole)
+            return tr("%1 users in chat").arg(g->peers->count());
+        else if (role == StatusLightRole)
+        {
+            if (Settings::getInstance().getUseNativeDecoration())
+                return g->hasNewMessages ? ":img/status/dot_online_notification.png" : ":img/status/dot_online.png";
+            if (!g->hasNewMessages)
+                return ":img/status/dot_groupchat.png";
+            return g->userWasMentioned ? ":img/status/dot_groupchat_notification.png" : ":img/status/dot_groupchat_newmessages.png";
+        }
+    }
+    else
+    {
+        Friend* f = FriendList::findFriend(e.id);
+        if (!f)
+            return QVariant();
+
+        if (role == Qt::DisplayRole || role == Qt::ToolTipRole)
+            return f->getName();
+        else if (role == StatusMessageRole)
+            return f->statusMessage;
+        else if (role == StatusLightRole)
+        {
+            QString light;
+            if (f->friendStatus == Status::Online)
+                light = ":img/status/dot_online";
+            else if (f->friendStatus == Status::Away)
+                light = ":img/status/dot_idle";
+            else if (f->friendStatus == Status::Busy)
+                light = ":img/status/dot_busy";
+            else
+                light = ":img/status/dot_away";
+            if (f->hasNewEvents)
+                light += "_notification";
+            return light + ".png";
+        }
+    }
+    return QVariant();
+}
+
+bool ContactListModel::lessThan(const Entry& a, const Entry& b)
+{
+    if (a.bucket != b.bucket)
+        return a.bucket < b.bucket;
+    int cmp = a.sortName.compare(b.sortName, Qt::CaseInsensitive);
+    if (cmp != 0)
+        return cmp < 0;
+    if (a.isGroup != b.isGroup)
+        return b.isGroup;
+    return a.id < b.id;
+}
+
+ContactListModel::Entry ContactListModel::makeEntry(bool isGroup, int id) const
+{
+    Entry e{isGroup, id, 1, QString()};
+    if (isGroup)
+    {
+        if (Group* g = GroupList::findGroup(id))
+            e.sortName = g->name;
+    }
+    else if (Friend* f = FriendList::findFriend(id))
+    {
+        e.sortName = f->getName();
+        if (f->friendStatus == Status::Online)
+            e.bucket = 0;
+        else if (f->friendStatus == Status::Away)
+            e.bucket = 2;
+        else if (f->friendStatus == Status::Busy)
+            e.bucket = 3;
+        else
+            e.bucket = 4;
+    }
+    return e;
+}
+
+quint64 ContactListModel::keyOf(bool isGroup, int id)
+{
+    return ((quint64)isGroup << 32) | (quint32)id;
+}
+
+int ContactListModel::rowOf(bool isGroup, int id) const
+{
+    return rows.value(keyOf(isGroup, id), -1);
+}
+
+void ContactListModel::reindex(int from, int to)
+{
+    for (int i=from; i<to; i++)
+        rows[keyOf(entries[i].isGroup, entries[i].id)] = i;
+}
+
+void ContactListModel::insertEntry(const Entry& e)
+{
+    int row = std::lower_bound(entries.begin(), entries.end(), e, lessThan) - entries.begin();
+    beginInsertRows(QModelIndex(), row, row);
+    entries.insert(row, e);
+    reindex(row, entries.size());
+    endInsertRows();
+}
+
+void ContactListModel::removeEntry(bool isGroup, int id)
+{
+    int row = rowOf(isGroup, id);
+    if (row == -1)
+        return;
+    beginRemoveRows(QModelIndex(), row, row);
+    entries.remove(row);
+    rows.remove(keyOf(isGroup, id));
+    reindex(row, entries.size());
+    endRemoveRows();
+}
+
+void ContactListModel::updateEntry(bool isGroup, int id)
+{
+    int row = rowOf(isGroup, id);
+    if (row == -1)
+        return;
+
+    Entry e = makeEntry(isGroup, id);
+    bool inPlace = (row == 0 || lessThan(entries[row-1], e))
+            && (row == entries.size()-1 || lessThan(e, entries[row+1]));
+    entries[row] = e;
+    if (!inPlace)
+    {
+        // Place it among the other rows as if it had been taken out first
+        auto begin = entries.begin(), end = entries.end();
+        int to = row;
+        if (lessThan(e, entries[row == 0 ? 0 : row-1]))
+            to = std::lower_bound(begin, begin + row, e, lessThan) - begin;
+        else
+            to = std::lower_bound(begin + row + 1, end, e, lessThan) - begin - 1;
+
+        if (to != row)
+        {
+            beginMoveRows(QModelIndex(), row, row, QModelIndex(), to > row ? to + 1 : to);
+            entries.remove(row);
+            entries.insert(to, e);
+            reindex(std::min(row, to), std::max(row, to) + 1);
+            endMoveRows();
+            row = to;
+        }
+    }
+    QModelIndex idx = index(row);
+    emit dataChanged(idx, idx);
+}
+
+void ContactListModel::addFriend(int friendId)
+{
+    insertEntry(makeEntry(false, friendId));
+}
+
+void ContactListModel::addFriends(const QList<int>& friendIds)
+{
+    if (friendIds.isEmpty())
+        return;
+
+    beginResetModel();
+    entries.reserve(entries.size() + friendIds.size());
+    for (int friendId : friendIds)
+        entries.append(makeEntry(false, friendId));
+    std::sort(entries.begin(), entries.end(), lessThan);
+    rows.reserve(entries.size());
+    reindex(0, entries.size());
+    endResetModel();
+}
+
+void ContactListModel::addGroup(int groupId)
+{
+    insertEntry(makeEntry(true, groupId));
+}
+
+void ContactListModel::removeFriend(int friendId)
+{
+    removeEntry(false, friendId);
+}
+
+void ContactListModel::removeGroup(int groupId)
+{
+    removeEntry(true, groupId);
+}
+
+void ContactListModel::updateFriend(int friendId)
+{
+    updateEntry(false, friendId);
+}
+
+void ContactListModel::updateGroup(int groupId)
+{
+    updateEntry(true, groupId);
+}
+
+void ContactListModel::setActive(bool isGroup, int id)
+{
+    int oldRow = rowOf(activeIsGroup, activeId);
+    activeIsGroup = isGroup;
+    activeId = id;
+    int newRow = rowOf(activeIsGroup, activeId);
+
+    if (oldRow != -1)
+        emit dataChanged(index(oldRow), index(oldRow));
+    if (newRow != -1)
+        emit dataChanged(index(newRow), index(newRow));
+}
@@ -0,0 +1,80 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CONTACTLISTMODEL_H
+#define CONTACTLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QHash>
+#include <QString>
+
+/// Flat list of friends and groups, kept sorted by status then name.
+/// A row only stores its sort key, everything else is read from FriendList/GroupList on demand.
+class ContactListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role
+    {
+        IsGroupRole = Qt::UserRole, ///< bool
+        IdRole, ///< Friend or group number
+        StatusMessageRole,
+        StatusLightRole, ///< Resource path of the status dot
+        ActiveRole ///< The chatroom shown in the main area
+    };
+
+    explicit ContactListModel(QObject *parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    void addFriend(int friendId);
+    void addFriends(const QList<int>& friendIds); ///< Sorts once, for loading the whole list
+    void addGroup(int groupId);
+    void removeFriend(int friendId);
+    void removeGroup(int groupId);
+    /// Re-reads the row and moves it to its new place if its status or name changed
+    void updateFriend(int friendId);
+    void updateGroup(int groupId);
+    void setActive(bool isGroup, int id); ///< id -1 for none
+
+private:
+    struct Entry
+    {
+        bool isGroup;
+        int id;
+        int bucket; ///< Online friends, groups, away, busy, offline
+        QString sortName;
+    };
+
+    static bool lessThan(const Entry& a, const Entry& b);
+    Entry makeEntry(bool isGroup, int id) const;
+    static quint64 keyOf(bool isGroup, int id);
+    int rowOf(bool isGroup, int id) const;
+    void reindex(int from, int to); ///< Rows moved between from and to, to excluded
+    void insertEntry(const Entry& e);
+    void removeEntry(bool isGroup, int id);
+    void updateEntry(bool isGroup, int id);
+
+private:
+    QVector<Entry> entries;
+    QHash<quint64, int> rows; ///< Row of each entry, by keyOf
+    bool activeIsGroup;
+    int activeId;
+};
+
+#endif // CONTACTLISTMODEL_H
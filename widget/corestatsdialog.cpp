@@ -0,0 +1,160 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "corestatsdialog.h"
+#include "core.h"
+#include "settings.h"
+#include "memoryreport.h"
+#include <QBoxLayout>
+#include <QCheckBox>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QPlainTextEdit>
+#include <QPushButton>
+#include <QScrollBar>
+
+#define GUI_TICK_INTERVAL 16
+
+CoreStatsDialog::CoreStatsDialog(Core* core, QWidget* parent) :
+    QDialog(parent), core{core}, guiTicks{0}, guiLateSum{0}, guiLateMax{0}
+{
+    setWindowTitle(tr("qTox – Core statistics"));
+    setMinimumSize(600, 400);
+
+    text = new QPlainTextEdit(this);
+    text->setReadOnly(true);
+    text->setLineWrapMode(QPlainTextEdit::NoWrap);
+    QFont mono("Monospace");
+    mono.setStyleHint(QFont::TypeWriter);
+    text->setFont(mono);
+
+    logStats = new QCheckBox(tr("Log the statistics every minute"), this);
+    logStats->setChecked(Settings::getInstance().getLogCoreStats());
+    QPushButton* reset = new QPushButton(tr("Reset"), this);
+    QPushButton* trim = new QPushButton(tr("Trim memory"), this);
+    trim->setToolTip(tr("Drops the caches and the scrollback that can be read back from the disk"));
+    QPushButton* close = new QPushButton(tr("Close"), this);
+
+    QHBoxLayout* buttons = new QHBoxLayout();
+    buttons->addWidget(logStats);
+    buttons->addStretch(1);
+    buttons->addWidget(trim);
+    buttons->addWidget(reset);
+    buttons->addWidget(close);
+    QVBoxLayout* layout = new QVBoxLayout(this);
+    layout->addWidget(text);
+    layout->addLayout(buttons);
+
+    // loopStats is emitted on the Core thread, the connection queues it to us
+    connect(core, &Core::loopStats, this, &CoreStatsDialog::onLoopStats);
+    connect(reset, SIGNAL(clicked()), this, SLOT(onResetClicked()));
+    connect(trim, SIGNAL(clicked()), this, SLOT(onTrimClicked()));
+    connect(close, SIGNAL(clicked()), this, SLOT(close()));
+    connect(logStats, SIGNAL(toggled(bool)), this, SLOT(onLogToggled(bool)));
+    connect(&pollTimer, SIGNAL(timeout()), this, SLOT(requestStats()));
+    connect(&guiTimer, SIGNAL(timeout()), this, SLOT(onGuiTick()));
+
+    pollTimer.start(1000);
+    guiTimer.setTimerType(Qt::PreciseTimer);
+    guiTimer.start(GUI_TICK_INTERVAL);
+    guiClock.start();
+    requestStats();
+}
+
+void CoreStatsDialog::requestStats()
+{
+    QMetaObject::invokeMethod(core, "requestLoopStats", Qt::QueuedConnection);
+}
+
+void CoreStatsDialog::onResetClicked()
+{
+    QMetaObject::invokeMethod(core, "resetLoopStats", Qt::QueuedConnection);
+    guiTicks = guiLateSum = guiLateMax = 0;
+    requestStats();
+}
+
+void CoreStatsDialog::onTrimClicked()
+{
+    MemoryReport::trim();
+    requestStats();
+}
+
+void CoreStatsDialog::onLogToggled(bool checked)
+{
+    Settings::getInstance().setLogCoreStats(checked);
+}
+
+void CoreStatsDialog::onGuiTick()
+{
+    qint64 late = guiClock.restart() - GUI_TICK_INTERVAL;
+    if (late < 0)
+        late = 0;
+    guiTicks++;
+    guiLateSum += late;
+    guiLateMax = qMax(guiLateMax, late);
+}
+
+void CoreStatsDialog::onLoopStats(const QByteArray& json)
+{
+    QJsonObject stats = QJsonDocument::fromJson(json).object();
+    QStringList lines;
+    lines << QString("%1 %2 %3 %4 %5").arg(tr("Probe"), -20).arg(tr("Samples"), 10)
+                                      .arg("p50", 10).arg("p99", 10).arg("max", 10);
+    for (const QJsonValue& value : stats["probes"].toArray())
+    {
+        QJsonObject probe = value.toObject();
+        QString unit = probe["unit"].toString() == "us" ? QString() : " " + probe["unit"].toString();
+        lines << QString("%1 %2 %3 %4 %5%6").arg(probe["name"].toString(), -20)
+                 .arg(probe["count"].toInt(), 10).arg("<" + QString::number(probe["p50"].toDouble()), 10)
+                 .arg("<" + QString::number(probe["p99"].toDouble()), 10).arg(probe["max"].toInt(), 10).arg(unit);
+    }
+    lines << QString() << tr("Times are in microseconds, p50 and p99 are the upper bounds of their histogram buckets.");
+
+    lines << QString() << tr("GUI thread: %1 ticks of %2 ms in the last poll, %3 ms late on average, %4 ms at worst")
+             .arg(guiTicks).arg(GUI_TICK_INTERVAL)
+             .arg(guiTicks ? (double)guiLateSum / guiTicks : 0, 0, 'f', 1).arg(guiLateMax);
+    guiTicks = guiLateSum = guiLateMax = 0;
+
+    QJsonObject memory = MemoryReport::collect();
+    qint64 accounted = 0;
+    lines << QString() << tr("Memory, estimated:");
+    for (const QJsonValue& value : memory["subsystems"].toArray())
+    {
+        QJsonObject entry = value.toObject();
+        qint64 bytes = entry["bytes"].toDouble();
+        accounted += bytes;
+        lines << QString("  %1 %2 KiB  %3").arg(entry["name"].toString(), -20)
+                 .arg(bytes / 1024, 10).arg(entry["detail"].toString());
+    }
+    qint64 resident = memory["resident"].toDouble();
+    lines << QString("  %1 %2 KiB").arg(tr("Accounted"), -20).arg(accounted / 1024, 10);
+    if (resident)
+        lines << QString("  %1 %2 KiB").arg(tr("Resident"), -20).arg(resident / 1024, 10);
+
+    QJsonObject signalObject = stats["signals"].toObject();
+    if (!signalObject.isEmpty())
+    {
+        lines << QString() << tr("Signals emitted by Core:");
+        for (auto it = signalObject.begin(); it != signalObject.end(); ++it)
+            lines << QString("  %1 %2").arg(it.key(), -40).arg(it.value().toInt(), 10);
+    }
+
+    // Keep the scroll position while the text is replaced each second
+    int scroll = text->verticalScrollBar()->value();
+    text->setPlainText(lines.join('\n'));
+    text->verticalScrollBar()->setValue(scroll);
+}
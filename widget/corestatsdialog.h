@@ -0,0 +1,53 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef CORESTATSDIALOG_H
+#define CORESTATSDIALOG_H
+
+#include <QDialog>
+#include <QElapsedTimer>
+#include <QTimer>
+
+class Core;
+class QCheckBox;
+class QPlainTextEdit;
+
+/// Shows the CoreProfiler histograms, polled from Core every second, next to the lateness of a GUI timer
+/// and the MemoryReport
+class CoreStatsDialog : public QDialog
+{
+    Q_OBJECT
+public:
+    CoreStatsDialog(Core* core, QWidget* parent = 0);
+
+private slots:
+    void onLoopStats(const QByteArray& json);
+    void requestStats();
+    void onResetClicked();
+    void onTrimClicked();
+    void onLogToggled(bool checked);
+    void onGuiTick(); ///< Measures how late the GUI thread serves a 16ms timer
+
+private:
+    Core* core;
+    QPlainTextEdit* text;
+    QCheckBox* logStats;
+    QTimer pollTimer, guiTimer;
+    QElapsedTimer guiClock;
+    qint64 guiTicks, guiLateSum, guiLateMax; ///< In ms, since the last poll
+};
+
+#endif // CORESTATSDIALOG_H
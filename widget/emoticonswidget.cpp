@@ -18,116 +18,215 @@
 #include "smileypack.h"
 #include "style.h"
 
-#include <QPushButton>
-#include <QRadioButton>
-#include <QFile>
-#include <QLayout>
-#include <QGridLayout>
-
-EmoticonsWidget::EmoticonsWidget(QWidget *parent) :
-    QMenu(parent)
+#include <QPainter>
+#include <QMouseEvent>
+#include <QWheelEvent>
+#include <QToolTip>
+#include <QHelpEvent>
+#include <algorithm>
+
+// Size of an emoticon in the atlas, of its cell in the view, and columns of the atlas
+static const int iconSize = 16, cellSize = 24, dotSize = 10, atlasColumns = 32;
+
+/// Paints a page of emoticons straight from the atlas, and the page dots below them
+class EmoticonsWidget::View : public QWidget
 {
-    setStyleSheet(Style::get(":/ui/emoticonWidget/emoticonWidget.css"));
-    setLayout(&layout);
-    layout.addWidget(&stack);
-
-    QWidget* pageButtonsContainer = new QWidget;
-    QHBoxLayout* buttonLayout = new QHBoxLayout;
-    pageButtonsContainer->setLayout(buttonLayout);
+public:
+    explicit View(EmoticonsWidget* Owner)
+        : owner{Owner}, page{0}, hovered{-1},
+          dot(Style::getPixmap(":/ui/emoticonWidget/dot_page.png")),
+          dotHover(Style::getPixmap(":/ui/emoticonWidget/dot_page_hover.png")),
+          dotCurrent(Style::getPixmap(":/ui/emoticonWidget/dot_page_current.png"))
+    {
+        setMouseTracking(true);
+    }
 
-    layout.addWidget(pageButtonsContainer);
+    void reset()
+    {
+        page = 0;
+        hovered = -1;
+        updateGeometry();
+        update();
+    }
 
-    const int maxCols = 5;
-    const int maxRows = 3;
-    const int itemsPerPage = maxRows * maxCols;
+    int pageCount() const
+    {
+        return std::max((owner->emoticons.size() + itemsPerPage - 1) / itemsPerPage, 1);
+    }
 
-    const QList<QStringList>& emoticons = SmileyPack::getInstance().getEmoticons();
-    int itemCount = emoticons.size();
-    int pageCount = (itemCount / itemsPerPage) + 1;
-    int currPage = 0;
-    int currItem = 0;
-    int row = 0;
-    int col = 0;
+    QSize sizeHint() const
+    {
+        return QSize(EMOTICONS_COLUMNS * cellSize, EMOTICONS_ROWS * cellSize + (pageCount() > 1 ? 2*dotSize : 0));
+    }
 
-    // create pages
-    buttonLayout->addStretch();
-    for (int i = 0; i < pageCount; i++)
+protected:
+    void paintEvent(QPaintEvent*)
     {
-        QGridLayout* pageLayout = new QGridLayout;
-        pageLayout->addItem(new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::Expanding), maxRows, 0);
-        pageLayout->addItem(new QSpacerItem(0, 0, QSizePolicy::Expanding, QSizePolicy::Minimum), 0, maxCols);
+        QPainter painter(this);
+        for (int slot = 0; slot < itemsPerPage; slot++)
+        {
+            int index = page * itemsPerPage + slot;
+            if (index >= owner->emoticons.size())
+                break;
+            QRect cell = cellRect(slot);
+            if (index == hovered)
+            {
+                painter.setPen(Qt::NoPen);
+                painter.setBrush(QColor(0, 0, 0, 30));
+                painter.drawRoundedRect(cell, 3, 3);
+            }
+            QRect source((index % atlasColumns) * iconSize, (index / atlasColumns) * iconSize, iconSize, iconSize);
+            painter.drawPixmap(QRect(cell.center() - QPoint(iconSize/2 - 1, iconSize/2 - 1), QSize(iconSize, iconSize)),
+                               owner->atlas, source);
+        }
 
-        QWidget* page = new QWidget;
-        page->setLayout(pageLayout);
-        stack.addWidget(page);
+        if (pageCount() < 2)
+            return;
+        for (int i = 0; i < pageCount(); i++)
+            painter.drawPixmap(dotRect(i), i == page ? dotCurrent : i == hoveredDot ? dotHover : dot);
+    }
 
-        // page buttons are only needed if there is more than 1 page
-        if (pageCount > 1)
+    void mouseMoveEvent(QMouseEvent* event)
+    {
+        int item = itemAt(event->pos()), pageDot = dotAt(event->pos());
+        if (item != hovered || pageDot != hoveredDot)
         {
-            QRadioButton* pageButton = new QRadioButton;
-            pageButton->setProperty("pageIndex", i);
-            pageButton->setChecked(i == 0);
-            buttonLayout->addWidget(pageButton);
-
-            connect(pageButton, &QRadioButton::clicked, this, &EmoticonsWidget::onPageButtonClicked);
+            hovered = item;
+            hoveredDot = pageDot;
+            update();
         }
     }
-    buttonLayout->addStretch();
 
-    for (const QStringList& set : emoticons)
+    void leaveEvent(QEvent*)
     {
-        QPushButton* button = new QPushButton;
-        button->setIcon(SmileyPack::getInstance().getAsIcon(set[0]));
-        button->setToolTip(set.join(" "));
-        button->setProperty("sequence", set[0]);
-        button->setFlat(true);
+        hovered = hoveredDot = -1;
+        update();
+    }
 
-        connect(button, &QPushButton::clicked, this, &EmoticonsWidget::onSmileyClicked);
+    void mouseReleaseEvent(QMouseEvent* event)
+    {
+        int item = itemAt(event->pos());
+        if (item >= 0)
+            return owner->onSmileyClicked(item);
+        int pageDot = dotAt(event->pos());
+        if (pageDot >= 0)
+            setPage(pageDot);
+    }
 
-        qobject_cast<QGridLayout*>(stack.widget(currPage)->layout())->addWidget(button, row, col);
+    void wheelEvent(QWheelEvent* event)
+    {
+        setPage(page + (event->angleDelta().y() < 0 ? 1 : -1));
+    }
 
-        col++;
-        currItem++;
+    bool event(QEvent* event)
+    {
+        if (event->type() != QEvent::ToolTip)
+            return QWidget::event(event);
+        QHelpEvent* help = static_cast<QHelpEvent*>(event);
+        int item = itemAt(help->pos());
+        if (item >= 0)
+            QToolTip::showText(help->globalPos(), owner->emoticons[item].join(" "), this);
+        else
+            QToolTip::hideText();
+        return true;
+    }
 
-        // next row
-        if (col >= maxCols)
-        {
-            col = 0;
-            row++;
-        }
+private:
+    static const int itemsPerPage = EMOTICONS_COLUMNS * EMOTICONS_ROWS;
 
-        // next page
-        if (currItem >= itemsPerPage)
-        {
-            row = 0;
-            currItem = 0;
-            currPage++;
-        }
+    QRect cellRect(int slot) const
+    {
+        return QRect((slot % EMOTICONS_COLUMNS) * cellSize, (slot / EMOTICONS_COLUMNS) * cellSize, cellSize, cellSize);
     }
 
-    // calculates sizeHint
-    layout.activate();
+    QRect dotRect(int i) const
+    {
+        int left = (width() - (2*pageCount() - 1) * dotSize) / 2;
+        return QRect(left + 2*i*dotSize, EMOTICONS_ROWS * cellSize + dotSize/2, dotSize, dotSize);
+    }
+
+    int itemAt(const QPoint& pos) const
+    {
+        if (pos.x() < 0 || pos.y() < 0 || pos.x() >= EMOTICONS_COLUMNS * cellSize || pos.y() >= EMOTICONS_ROWS * cellSize)
+            return -1;
+        int index = page * itemsPerPage + (pos.y() / cellSize) * EMOTICONS_COLUMNS + pos.x() / cellSize;
+        return index < owner->emoticons.size() ? index : -1;
+    }
+
+    int dotAt(const QPoint& pos) const
+    {
+        if (pageCount() < 2)
+            return -1;
+        for (int i = 0; i < pageCount(); i++)
+            if (dotRect(i).adjusted(-dotSize/2, -dotSize/2, dotSize/2, dotSize/2).contains(pos))
+                return i;
+        return -1;
+    }
+
+    void setPage(int Page)
+    {
+        page = std::min(std::max(Page, 0), pageCount() - 1);
+        hovered = -1;
+        update();
+    }
+
+private:
+    EmoticonsWidget* owner;
+    int page, hovered, hoveredDot{-1};
+    QPixmap dot, dotHover, dotCurrent;
+};
+
+EmoticonsWidget* EmoticonsWidget::getInstance()
+{
+    static EmoticonsWidget* instance = new EmoticonsWidget;
+    return instance;
 }
 
-void EmoticonsWidget::onSmileyClicked()
+EmoticonsWidget::EmoticonsWidget(QWidget *parent) :
+    QMenu(parent)
 {
-    // hide the QMenu
-    QMenu::hide();
+    setStyleSheet(Style::get(":/ui/emoticonWidget/emoticonWidget.css"));
+    setLayout(&layout);
+    view = new View(this);
+    layout.addWidget(view);
 
-    // emit insert emoticon
-    QWidget* sender = qobject_cast<QWidget*>(QObject::sender());
-    if (sender)
-        emit insertEmoticon(' ' + sender->property("sequence").toString() + ' ');
+    connect(&SmileyPack::getInstance(), &SmileyPack::packChanged, this, &EmoticonsWidget::onSmileyPackChanged);
+    onSmileyPackChanged();
 }
 
-void EmoticonsWidget::onPageButtonClicked()
+void EmoticonsWidget::onSmileyPackChanged()
 {
-    QWidget* sender = qobject_cast<QRadioButton*>(QObject::sender());
-    if (sender)
+    SmileyPack& pack = SmileyPack::getInstance();
+    emoticons = pack.getEmoticons();
+
+    // One pixmap for the whole pack, the view only blits from it
+    int rows = std::max((emoticons.size() + atlasColumns - 1) / atlasColumns, 1);
+    atlas = QPixmap(atlasColumns * iconSize, rows * iconSize);
+    atlas.fill(Qt::transparent);
+    QPainter painter(&atlas);
+    for (int i = 0; i < emoticons.size(); i++)
     {
-        int page = sender->property("pageIndex").toInt();
-        stack.setCurrentIndex(page);
+        QImage image = pack.getAsImage(emoticons[i][0]);
+        if (image.isNull())
+            continue;
+        QRect cell((i % atlasColumns) * iconSize, (i / atlasColumns) * iconSize, iconSize, iconSize);
+        QRect target(QPoint(), image.size().scaled(cell.size(), Qt::KeepAspectRatio));
+        target.moveCenter(cell.center());
+        painter.drawImage(target, image);
     }
+    painter.end();
+
+    view->reset();
+    layout.invalidate();
+    layout.activate();
+}
+
+void EmoticonsWidget::onSmileyClicked(int index)
+{
+    // hide the QMenu
+    QMenu::hide();
+
+    emit insertEmoticon(' ' + emoticons[index][0] + ' ');
 }
 
 QSize EmoticonsWidget::sizeHint() const
@@ -18,25 +18,38 @@
 #define EMOTICONSWIDGET_H
 
 #include <QMenu>
-#include <QStackedWidget>
 #include <QVBoxLayout>
+#include <QPixmap>
+#include <QStringList>
 
+// Emoticons of a page of the picker
+#define EMOTICONS_COLUMNS 5
+#define EMOTICONS_ROWS 3
+
+/// The emoticon picker, built once for each smiley pack. Every icon is drawn once into an atlas,
+/// and a single view paints the current page from it, along with the page dots.
 class EmoticonsWidget : public QMenu
 {
     Q_OBJECT
 public:
-    explicit EmoticonsWidget(QWidget *parent = 0);
+    static EmoticonsWidget* getInstance(); ///< Shared by every chat form
 
 signals:
     void insertEmoticon(QString str);
 
 private slots:
-    void onSmileyClicked();
-    void onPageButtonClicked();
+    void onSmileyPackChanged();
+
+private:
+    class View;
+    explicit EmoticonsWidget(QWidget *parent = 0);
+    void onSmileyClicked(int index); ///< By the view
 
 private:
-    QStackedWidget stack;
+    View* view;
     QVBoxLayout layout;
+    QList<QStringList> emoticons;
+    QPixmap atlas; ///< The first emoticon of each set, in cells of the icon size
 
 public:
     virtual QSize sizeHint() const;
@@ -19,45 +19,112 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QDirIterator>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QMenu>
+#include <QLabel>
+#include <QProgressBar>
+#include <QTimer>
+#include <QTextStream>
 #include "chatform.h"
 #include "friend.h"
-#include "widget/friendwidget.h"
 #include "filetransferinstance.h"
 #include "widget/tool/chataction.h"
 #include "widget/netcamview.h"
 #include "widget/chatareawidget.h"
 #include "widget/tool/chattextedit.h"
 #include "core.h"
+#include "history.h"
+#include "eventdispatcher.h"
+#include "settings.h"
+#include "style.h"
 #include "widget/widget.h"
 
 ChatForm::ChatForm(Friend* chatFriend)
-    : f(chatFriend)
+    : f(chatFriend), netcam{nullptr}, callId{-1}, callActive{false}, sharingScreen{false}
 {
+    historyChat = History::friendChat(f->userId);
     nameLabel->setText(f->getName());
-    avatarLabel->setPixmap(QPixmap(":/img/contact_dark.png"));
+    avatarLabel->setPixmap(Style::getPixmap(":/img/contact_dark.png"));
 
     statusMessageLabel = new CroppingLabel();
-    netcam = new NetCamView();
+    setStatusMessage(f->statusMessage);
+
+    callStats = new QLabel(chatWidget);
+    callStats->setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white; padding: 4px;");
+    callStats->setAttribute(Qt::WA_TransparentForMouseEvents);
+    callStats->hide();
+    callStatsTimer = new QTimer(this);
+    callStatsTimer->setInterval(TOX_CALL_STATS_INTERVAL);
+    connect(callStatsTimer, &QTimer::timeout, this, &ChatForm::updateCallStats);
+
+    micLevel = new QProgressBar(micButton);
+    micLevel->setRange(0, 100);
+    micLevel->setTextVisible(false);
+    micLevel->setObjectName("voice");
+    micLevel->setStyleSheet("QProgressBar {border: none; background: transparent;}"
+                            "QProgressBar#voice::chunk {background-color: #6bc260;}"
+                            "QProgressBar#silence::chunk {background-color: #a0a0a0;}");
+    micLevel->setAttribute(Qt::WA_TransparentForMouseEvents);
+    micLevel->hide();
+    micLevelTimer = new QTimer(this);
+    micLevelTimer->setInterval(TOX_MIC_LEVEL_INTERVAL);
+    connect(micLevelTimer, &QTimer::timeout, this, &ChatForm::updateMicLevel);
 
     headTextLayout->addWidget(statusMessageLabel);
     headTextLayout->addStretch();
 
-    connect(Core::getInstance(), &Core::fileSendStarted, this, &ChatForm::startFileSend);
-    connect(Core::getInstance(), &Core::videoFrameReceived, netcam, &NetCamView::updateDisplay);
     connect(sendButton, &QPushButton::clicked, this, &ChatForm::onSendTriggered);
     connect(fileButton, &QPushButton::clicked, this, &ChatForm::onAttachClicked);
+    fileButton->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(fileButton, &QPushButton::customContextMenuRequested, this, &ChatForm::onAttachFolderClicked);
     connect(callButton, &QPushButton::clicked, this, &ChatForm::onCallTriggered);
     connect(videoButton, &QPushButton::clicked, this, &ChatForm::onVideoCallTriggered);
+    videoButton->setContextMenuPolicy(Qt::CustomContextMenu);
+    callButton->setContextMenuPolicy(Qt::CustomContextMenu);
     connect(msgEdit, &ChatTextEdit::enterPressed, this, &ChatForm::onSendTriggered);
     connect(micButton, SIGNAL(clicked()), this, SLOT(onMicMuteToggle()));
-    connect(chatWidget, &ChatAreaWidget::onFileTranfertInterract, this, &ChatForm::onFileTansBtnClicked);
+
+    Core* core = Core::getInstance();
+    connect(this, SIGNAL(sendMessage(int,QString)), core, SLOT(sendMessage(int,QString)));
+    connect(this, SIGNAL(sendFile(int32_t, QString, QString, long long)), core, SLOT(sendFile(int32_t, QString, QString, long long)));
+    connect(this, SIGNAL(sendFiles(int32_t, QString, QString, QStringList)), core, SLOT(sendFiles(int32_t, QString, QString, QStringList)));
+    connect(this, SIGNAL(answerCall(int)), core, SLOT(answerCall(int)));
+    connect(this, SIGNAL(hangupCall(int)), core, SLOT(hangupCall(int)));
+    connect(this, SIGNAL(startCall(int)), core, SLOT(startCall(int)));
+    connect(this, SIGNAL(startVideoCall(int,bool)), core, SLOT(startCall(int,bool)));
+    connect(this, SIGNAL(cancelCall(int,int)), core, SLOT(cancelCall(int,int)));
+    connect(this, SIGNAL(micMuteToggle(int)), core, SLOT(micMuteToggle(int)));
+    connect(this, SIGNAL(screenShareToggle(int)), core, SLOT(screenShareToggle(int)));
+    EventDispatcher::getInstance().addChatForm(f->friendId, this); // Core events reach us through it
 }
 
 ChatForm::~ChatForm()
 {
+    EventDispatcher::getInstance().removeChatForm(f->friendId);
     delete netcam;
 }
 
+NetCamView* ChatForm::getNetCam()
+{
+    if (!netcam)
+        netcam = new NetCamView();
+    return netcam;
+}
+
+bool ChatForm::isIdle() const
+{
+    if (callActive || mainWidget->isVisible())
+        return false;
+    for (const QPointer<FileTransferInstance>& transfer : transfers)
+        if (transfer && transfer->isActive())
+            return false;
+
+    // Without a log, whatever is on screen would be gone for good
+    return !getFirstMessageTime().isValid() || Settings::getInstance().getEnableLogging();
+}
+
 void ChatForm::setStatusMessage(QString newMessage)
 {
     statusMessageLabel->setText(newMessage);
@@ -77,9 +144,15 @@ void ChatForm::onSendTriggered()
 
 void ChatForm::onAttachClicked()
 {
-    QString path = QFileDialog::getOpenFileName(0,tr("Send a file"));
-    if (path.isEmpty())
+    QStringList paths = QFileDialog::getOpenFileNames(0,tr("Send a file"));
+    if (paths.isEmpty())
+        return;
+    if (paths.size() > 1)
+    {
+        emit sendFiles(f->friendId, QFileInfo(paths.first()).dir().dirName(), QString(), paths);
         return;
+    }
+    QString path = paths.first();
 
     QFile file(path);
     if (!file.exists() || !file.open(QIODevice::ReadOnly))
@@ -97,20 +170,87 @@ void ChatForm::onAttachClicked()
     emit sendFile(f->friendId, fi.fileName(), path, filesize);
 }
 
+/// Lists a folder's files off the GUI thread, a big tree or a slow disk would freeze us
+/// Made on the GUI thread for a FolderWalk and deleted once it delivered, the walk never touches the form
+class FolderWalkRelay : public QObject
+{
+    Q_OBJECT
+public:
+    explicit FolderWalkRelay(ChatForm* Form) : form{Form} {}
+
+public slots:
+    void deliver(QString dir, QStringList paths)
+    {
+        // On the GUI thread, the form can't go away while we look
+        if (form)
+            QMetaObject::invokeMethod(form, "onFolderWalked", Q_ARG(QString, dir), Q_ARG(QStringList, paths));
+        deleteLater();
+    }
+
+private:
+    QPointer<ChatForm> form;
+};
+
+class ChatForm::FolderWalk : public QRunnable
+{
+public:
+    FolderWalk(ChatForm* Form, const QString& Dir) : relay{new FolderWalkRelay(Form)}, dir{Dir} {}
+
+    void run()
+    {
+        QStringList paths;
+        QDirIterator it(dir, QDir::Files | QDir::Hidden | QDir::NoDotAndDotDot, QDirIterator::Subdirectories);
+        while (it.hasNext())
+            paths << it.next();
+        QMetaObject::invokeMethod(relay, "deliver", Qt::QueuedConnection, Q_ARG(QString, dir), Q_ARG(QStringList, paths));
+    }
+
+private:
+    FolderWalkRelay* relay;
+    QString dir;
+};
+
+void ChatForm::onAttachFolderClicked()
+{
+    QString dir = QFileDialog::getExistingDirectory(0, tr("Send a folder"));
+    if (dir.isEmpty())
+        return;
+    QThreadPool::globalInstance()->start(new FolderWalk(this, dir));
+}
+
+void ChatForm::onFolderWalked(QString dir, QStringList paths)
+{
+    if (paths.isEmpty())
+        return;
+
+    // Names are relative to the parent, so the friend gets the folder itself
+    QFileInfo info(dir);
+    emit sendFiles(f->friendId, info.fileName(), info.absolutePath(), paths);
+}
+
 void ChatForm::startFileSend(ToxFile file)
 {
-    if (file.friendId != f->friendId)
+    if (file.friendId != f->friendId || file.batchId >= 0)
         return;
 
     FileTransferInstance* fileTrans = new FileTransferInstance(file);
-    ftransWidgets.insert(fileTrans->getId(), fileTrans);
+    transfers << fileTrans;
+
+    QString name = Widget::getInstance()->getUsername();
+    if (name == previousName)
+        name = "";
+    previousName = Widget::getInstance()->getUsername();
 
-    connect(Core::getInstance(), &Core::fileTransferInfo, fileTrans, &FileTransferInstance::onFileTransferInfo);
-    connect(Core::getInstance(), &Core::fileTransferCancelled, fileTrans, &FileTransferInstance::onFileTransferCancelled);
-    connect(Core::getInstance(), &Core::fileTransferFinished, fileTrans, &FileTransferInstance::onFileTransferFinished);
-    connect(Core::getInstance(), SIGNAL(fileTransferAccepted(ToxFile)), fileTrans, SLOT(onFileTransferAccepted(ToxFile)));
-    connect(Core::getInstance(), SIGNAL(fileTransferPaused(int,int,ToxFile::FileDirection)), fileTrans, SLOT(onFileTransferPaused(int,int,ToxFile::FileDirection)));
-    connect(Core::getInstance(), SIGNAL(fileTransferRemotePausedUnpaused(ToxFile,bool)), fileTrans, SLOT(onFileTransferRemotePausedUnpaused(ToxFile,bool)));
+    chatWidget->insertMessage(new FileTransferAction(fileTrans, name, QTime::currentTime().toString("hh:mm"), true));
+}
+
+void ChatForm::startFileBatch(int FriendId, int BatchId, QString batchName, int fileCount, long long totalBytes)
+{
+    if (FriendId != f->friendId)
+        return;
+
+    FileTransferInstance* fileTrans = new FileTransferInstance(FriendId, BatchId, batchName, fileCount, totalBytes);
+    transfers << fileTrans;
 
     QString name = Widget::getInstance()->getUsername();
     if (name == previousName)
@@ -126,21 +266,14 @@ void ChatForm::onFileRecvRequest(ToxFile file)
         return;
 
     FileTransferInstance* fileTrans = new FileTransferInstance(file);
-    ftransWidgets.insert(fileTrans->getId(), fileTrans);
-
-    connect(Core::getInstance(), &Core::fileTransferInfo, fileTrans, &FileTransferInstance::onFileTransferInfo);
-    connect(Core::getInstance(), &Core::fileTransferCancelled, fileTrans, &FileTransferInstance::onFileTransferCancelled);
-    connect(Core::getInstance(), &Core::fileTransferFinished, fileTrans, &FileTransferInstance::onFileTransferFinished);
-    connect(Core::getInstance(), SIGNAL(fileTransferAccepted(ToxFile)), fileTrans, SLOT(onFileTransferAccepted(ToxFile)));
-    connect(Core::getInstance(), SIGNAL(fileTransferPaused(int,int,ToxFile::FileDirection)), fileTrans, SLOT(onFileTransferPaused(int,int,ToxFile::FileDirection)));
-    connect(Core::getInstance(), SIGNAL(fileTransferRemotePausedUnpaused(ToxFile,bool)), fileTrans, SLOT(onFileTransferRemotePausedUnpaused(ToxFile,bool)));
+    transfers << fileTrans;
 
     Widget* w = Widget::getInstance();
     if (!w->isFriendWidgetCurActiveWidget(f)|| w->getIsWindowMinimized() || !w->isActiveWindow())
     {
         w->newMessageAlert();
         f->hasNewEvents=true;
-        f->widget->updateStatusLight();
+        w->updateFriendStatusLight(f->friendId);
     }
 
     QString name = f->getName();
@@ -151,11 +284,20 @@ void ChatForm::onFileRecvRequest(ToxFile file)
     chatWidget->insertMessage(new FileTransferAction(fileTrans, name, QTime::currentTime().toString("hh:mm"), false));
 }
 
+void ChatForm::showVideoFrame(int CallId, const VideoFrame& frame)
+{
+    if (CallId != callId || !netcam || !netcam->isVisible())
+        return;
+
+    netcam->updateDisplay(frame);
+}
+
 void ChatForm::onAvInvite(int FriendId, int CallId, bool video)
 {
     if (FriendId != f->friendId)
         return;
 
+    callActive = true;
     callId = CallId;
     callButton->disconnect();
     videoButton->disconnect();
@@ -181,7 +323,7 @@ void ChatForm::onAvInvite(int FriendId, int CallId, bool video)
     {
         w->newMessageAlert();
         f->hasNewEvents=true;
-        f->widget->updateStatusLight();
+        w->updateFriendStatusLight(f->friendId);
     }
 }
 
@@ -190,10 +332,13 @@ void ChatForm::onAvStart(int FriendId, int CallId, bool video)
     if (FriendId != f->friendId)
         return;
 
+    callActive = true;
     audioInputFlag = true;
     callId = CallId;
+    micLevelTimer->start();
     callButton->disconnect();
     videoButton->disconnect();
+    connect(callButton, &QPushButton::customContextMenuRequested, this, &ChatForm::onCallButtonContextMenu);
     if (video)
     {
         callButton->setObjectName("grey");
@@ -201,7 +346,9 @@ void ChatForm::onAvStart(int FriendId, int CallId, bool video)
         videoButton->setObjectName("red");
         videoButton->style()->polish(videoButton);
         connect(videoButton, SIGNAL(clicked()), this, SLOT(onHangupCallTriggered()));
-        netcam->show();
+        connect(videoButton, &QPushButton::customContextMenuRequested, this, &ChatForm::onVideoButtonContextMenu);
+        sharingScreen = false; // Calls always start with the camera
+        getNetCam()->show();
     }
     else
     {
@@ -218,6 +365,7 @@ void ChatForm::onAvCancel(int FriendId, int)
     if (FriendId != f->friendId)
         return;
 
+    callActive = false;
     audioInputFlag = false;
     micButton->setObjectName("green");
     micButton->style()->polish(micButton);
@@ -229,7 +377,8 @@ void ChatForm::onAvCancel(int FriendId, int)
     videoButton->style()->polish(videoButton);
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
 }
 
 void ChatForm::onAvEnd(int FriendId, int)
@@ -237,6 +386,7 @@ void ChatForm::onAvEnd(int FriendId, int)
     if (FriendId != f->friendId)
         return;
 
+    callActive = false;
     audioInputFlag = false;
     micButton->setObjectName("green");
     micButton->style()->polish(micButton);
@@ -248,7 +398,8 @@ void ChatForm::onAvEnd(int FriendId, int)
     videoButton->style()->polish(videoButton);
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
 }
 
 void ChatForm::onAvRinging(int FriendId, int CallId, bool video)
@@ -256,6 +407,7 @@ void ChatForm::onAvRinging(int FriendId, int CallId, bool video)
     if (FriendId != f->friendId)
         return;
 
+    callActive = true;
     callId = CallId;
     callButton->disconnect();
     videoButton->disconnect();
@@ -282,8 +434,10 @@ void ChatForm::onAvStarting(int FriendId, int, bool video)
     if (FriendId != f->friendId)
         return;
 
+    callActive = true;
     callButton->disconnect();
     videoButton->disconnect();
+    connect(callButton, &QPushButton::customContextMenuRequested, this, &ChatForm::onCallButtonContextMenu);
     if (video)
     {
         callButton->setObjectName("grey");
@@ -291,7 +445,9 @@ void ChatForm::onAvStarting(int FriendId, int, bool video)
         videoButton->setObjectName("red");
         videoButton->style()->polish(videoButton);
         connect(videoButton, SIGNAL(clicked()), this, SLOT(onHangupCallTriggered()));
-        netcam->show();
+        connect(videoButton, &QPushButton::customContextMenuRequested, this, &ChatForm::onVideoButtonContextMenu);
+        sharingScreen = false; // Calls always start with the camera
+        getNetCam()->show();
     }
     else
     {
@@ -308,6 +464,7 @@ void ChatForm::onAvEnding(int FriendId, int)
     if (FriendId != f->friendId)
         return;
 
+    callActive = false;
     audioInputFlag = false;
     micButton->setObjectName("green");
     micButton->style()->polish(micButton);
@@ -321,7 +478,8 @@ void ChatForm::onAvEnding(int FriendId, int)
     videoButton->disconnect();
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
 }
 
 void ChatForm::onAvRequestTimeout(int FriendId, int)
@@ -329,6 +487,7 @@ void ChatForm::onAvRequestTimeout(int FriendId, int)
     if (FriendId != f->friendId)
         return;
 
+    callActive = false;
     audioInputFlag = false;
     micButton->setObjectName("green");
     micButton->style()->polish(micButton);
@@ -342,7 +501,8 @@ void ChatForm::onAvRequestTimeout(int FriendId, int)
     videoButton->disconnect();
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
 }
 
 void ChatForm::onAvPeerTimeout(int FriendId, int)
@@ -350,6 +510,7 @@ void ChatForm::onAvPeerTimeout(int FriendId, int)
     if (FriendId != f->friendId)
         return;
 
+    callActive = false;
     audioInputFlag = false;
     micButton->setObjectName("green");
     micButton->style()->polish(micButton);
@@ -363,18 +524,20 @@ void ChatForm::onAvPeerTimeout(int FriendId, int)
     videoButton->disconnect();
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
 }
 
 void ChatForm::onAvMediaChange(int, int, bool video)
 {
     if (video)
     {
-        netcam->show();
+        getNetCam()->show();
     }
     else
     {
-        netcam->hide();
+        if (netcam)
+            netcam->hide();
     }
 }
 
@@ -423,10 +586,24 @@ void ChatForm::onCancelCallTriggered()
     videoButton->disconnect();
     connect(callButton, SIGNAL(clicked()), this, SLOT(onCallTriggered()));
     connect(videoButton, SIGNAL(clicked()), this, SLOT(onVideoCallTriggered()));
-    netcam->hide();
+    if (netcam)
+        netcam->hide();
     emit cancelCall(callId, f->friendId);
 }
 
+void ChatForm::onVideoButtonContextMenu(QPoint pos)
+{
+    QMenu menu;
+    QAction* share = menu.addAction(tr("Share my screen","Context menu of the video call button"));
+    share->setCheckable(true);
+    share->setChecked(sharingScreen);
+    if (menu.exec(videoButton->mapToGlobal(pos)) == share)
+    {
+        sharingScreen = !sharingScreen;
+        emit screenShareToggle(callId);
+    }
+}
+
 void ChatForm::onMicMuteToggle()
 {
     if (audioInputFlag == true)
@@ -445,13 +622,82 @@ void ChatForm::onMicMuteToggle()
     }
 }
 
-void ChatForm::onFileTansBtnClicked(QString widgetName, QString buttonName)
+void ChatForm::onCallButtonContextMenu(QPoint pos)
+{
+    QMenu menu;
+    QAction* show = menu.addAction(tr("Show call statistics","Context menu of the call button"));
+    show->setCheckable(true);
+    show->setChecked(callStats->isVisible());
+    QAction* save = menu.addAction(tr("Save call statistics...","Context menu of the call button"));
+    QAction* chosen = menu.exec(callButton->mapToGlobal(pos));
+    if (chosen == show)
+    {
+        if (callStats->isVisible())
+        {
+            callStatsTimer->stop();
+            callStats->hide();
+        }
+        else
+        {
+            callStatsTimer->start();
+            updateCallStats();
+        }
+    }
+    else if (chosen == save)
+    {
+        QString report = Core::getInstance()->getCallStatsReport(callId);
+        if (report.isEmpty())
+            return;
+        QString path = QFileDialog::getSaveFileName(0, tr("Save call statistics"), QString(), tr("Text files (*.txt)"));
+        if (path.isEmpty())
+            return;
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
+        {
+            QMessageBox::warning(0, tr("Error"), tr("Couldn't write to %1").arg(path));
+            return;
+        }
+        QTextStream(&file) << report << "\n";
+    }
+}
+
+void ChatForm::updateMicLevel()
 {
-    uint id = widgetName.toUInt();
+    if (!callActive)
+    {
+        micLevelTimer->stop();
+        micLevel->hide();
+        return;
+    }
 
-    auto it = ftransWidgets.find(id);
-    if (it != ftransWidgets.end())
-        it.value()->pressFromHtml(buttonName);
-    else
-        qDebug() << "no filetransferwidget: " << id;
+    bool voice;
+    micLevel->setValue(Core::getMicLevel(&voice));
+    // Restyled only when it changes, polishing every tick would cost more than the meter
+    const char* name = voice ? "voice" : "silence";
+    if (micLevel->objectName() != name)
+    {
+        micLevel->setObjectName(name);
+        micLevel->style()->polish(micLevel);
+    }
+    micLevel->setGeometry(0, micButton->height() - 3, micButton->width(), 3);
+    micLevel->show();
 }
+
+void ChatForm::updateCallStats()
+{
+    QString report = Core::getInstance()->getCallStatsReport(callId);
+    if (report.isEmpty())
+    {
+        callStatsTimer->stop();
+        callStats->hide();
+        return;
+    }
+    callStats->setText(report);
+    callStats->adjustSize();
+    callStats->move(chatWidget->width() - callStats->width() - 8, 8);
+    callStats->show();
+    callStats->raise();
+}
+
+// allows Q_OBJECT macro inside cpp
+#include "chatform.moc"
@@ -19,10 +19,16 @@
 
 #include "genericchatform.h"
 #include "corestructs.h"
+#include <QStringList>
+#include <QPointer>
 
 struct Friend;
 class FileTransferInstance;
 class NetCamView;
+class VideoFrame;
+class QLabel;
+class QTimer;
+class QProgressBar;
 
 class ChatForm : public GenericChatForm
 {
@@ -31,18 +37,22 @@ public:
     ChatForm(Friend* chatFriend);
     ~ChatForm();
     void setStatusMessage(QString newMessage);
+    bool isIdle() const; ///< Not shown, no call or transfer, and everything shown can be read back from the history
 
 signals:
     void sendFile(int32_t friendId, QString, QString, long long);
+    void sendFiles(int32_t friendId, QString batchName, QString baseDir, QStringList filePaths);
     void startCall(int friendId);
     void startVideoCall(int friendId, bool video);
     void answerCall(int callId);
     void hangupCall(int callId);
     void cancelCall(int callId, int friendId);
     void micMuteToggle(int callId);
+    void screenShareToggle(int callId);
 
 public slots:
     void startFileSend(ToxFile file);
+    void startFileBatch(int FriendId, int BatchId, QString batchName, int fileCount, long long totalBytes);
     void onFileRecvRequest(ToxFile file);
     void onAvInvite(int FriendId, int CallId, bool video);
     void onAvStart(int FriendId, int CallId, bool video);
@@ -56,24 +66,40 @@ public slots:
     void onAvMediaChange(int FriendId, int CallId, bool video);
     void onMicMuteToggle();
 
+public:
+    void showVideoFrame(int CallId, const VideoFrame& frame); ///< Widget routes our calls' frames here
+
 private slots:
     void onSendTriggered();
     void onAttachClicked();
+    void onAttachFolderClicked();
+    void onFolderWalked(QString dir, QStringList paths); ///< Sends what FolderWalk found as one batch
     void onCallTriggered();
     void onVideoCallTriggered();
     void onAnswerCallTriggered();
     void onHangupCallTriggered();
     void onCancelCallTriggered();
-    void onFileTansBtnClicked(QString widgetName, QString buttonName);
+    void onVideoButtonContextMenu(QPoint pos); ///< Lets us switch between sharing the camera and the screen
+    void onCallButtonContextMenu(QPoint pos); ///< Shows or saves the call's stats
+    void updateCallStats(); ///< Hides the overlay once the call is over
+    void updateMicLevel(); ///< Hides the meter once the call is over
 
 private:
+    class FolderWalk;
+    NetCamView* getNetCam(); ///< Created with the first video call
+
     Friend* f;
     CroppingLabel *statusMessageLabel;
     NetCamView* netcam;
     bool audioInputFlag;
     int callId;
-
-    QHash<uint, FileTransferInstance*> ftransWidgets;
+    bool callActive;
+    QList<QPointer<FileTransferInstance>> transfers;
+    bool sharingScreen;
+    QLabel* callStats; ///< Overlay on the chat area
+    QTimer* callStatsTimer;
+    QProgressBar* micLevel; ///< Along the bottom of the mic button, grey while silence isn't sent
+    QTimer* micLevelTimer;
 };
 
 #endif // CHATFORM_H
@@ -16,7 +16,24 @@
 
 #include "filesform.h"
 #include "ui_mainwindow.h"
+#include "core.h"
+#include "style.h"
+#include "friend.h"
+#include "friendlist.h"
+#include "transferhistory.h"
+#include "widget/transferlistmodel.h"
 #include <QFileInfo>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QLineEdit>
+#include <QListView>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QSaveFile>
+#include <QTableWidget>
 #include <QUrl>
 #include <QDebug>
 #include <QDesktopServices>
@@ -31,15 +48,37 @@ FilesForm::FilesForm()
     headLabel.setFont(bold);
     head->setLayout(&headLayout);
     headLayout.addWidget(&headLabel);
+    search = new QLineEdit;
+    search->setPlaceholderText(tr("Search transfers", "Placeholder of the files search box"));
+    headLayout.addWidget(search);
+
+    TransferHistory::getInstance().load();
+    recvdModel = new TransferListModel(false, this);
+    sentModel = new TransferListModel(true, this);
+
+    main.addTab(makeList(recvdModel), tr("Downloads"));
+    main.addTab(makeList(sentModel), tr("Uploads"));
+
+    statsTable = new QTableWidget(0, 9);
+    statsTable->setHorizontalHeaderLabels({tr("File"), tr("Direction"), tr("Progress"), tr("Speed"),
+                                           tr("Failed sends"), tr("Wakeups"), tr("Disk wait"),
+                                           tr("Core time"), tr("Status")});
+    statsTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    statsTable->verticalHeader()->hide();
+    statsTable->horizontalHeader()->setStretchLastSection(true);
+    QPushButton* saveStats = new QPushButton(tr("Save dump..."));
+    statsPage = new QWidget;
+    QVBoxLayout* statsLayout = new QVBoxLayout(statsPage);
+    statsLayout->addWidget(statsTable);
+    statsLayout->addWidget(saveStats, 0, Qt::AlignRight);
+    main.addTab(statsPage, tr("Statistics", "Debug counters of the active file transfers"));
+
+    statsTimer.setInterval(1000);
     
-    recvd = new QListWidget;
-    sent = new QListWidget;
-    
-    main.addTab(recvd, tr("Downloads"));
-    main.addTab(sent, tr("Uploads"));
-    
-    connect(sent, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(onFileActivated(QListWidgetItem*)));
-    connect(recvd, SIGNAL(itemActivated(QListWidgetItem*)), this, SLOT(onFileActivated(QListWidgetItem*)));
+    connect(search, SIGNAL(textChanged(QString)), this, SLOT(onSearchChanged(QString)));
+    connect(&main, SIGNAL(currentChanged(int)), this, SLOT(onTabChanged(int)));
+    connect(&statsTimer, SIGNAL(timeout()), this, SLOT(requestStats()));
+    connect(saveStats, SIGNAL(clicked()), this, SLOT(onSaveStatsClicked()));
 
 }
 
@@ -63,29 +102,109 @@ void FilesForm::show(Ui::MainWindow& ui)
     head->show();
 }
 
-void FilesForm::onFileDownloadComplete(const QString& path)
+QListView* FilesForm::makeList(TransferListModel* model)
 {
-    ListWidgetItem* tmp = new ListWidgetItem(QIcon(":/ui/acceptFileButton/default.png"), QFileInfo(path).fileName());
-    tmp->path = path;
-    recvd->addItem(tmp);
+    // Every row has the same height, the view doesn't measure the ones that aren't on screen
+    QListView* list = new QListView;
+    list->setUniformItemSizes(true);
+    list->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    list->setModel(model);
+    connect(list, SIGNAL(activated(QModelIndex)), this, SLOT(onFileActivated(QModelIndex)));
+    return list;
 }
 
-void FilesForm::onFileUploadComplete(const QString& path)
+void FilesForm::onFileTransferFinished(ToxFile file)
 {
-    ListWidgetItem* tmp = new ListWidgetItem(QIcon(":/ui/acceptFileButton/default.png"), QFileInfo(path).fileName());
-    tmp->path = path;
-    sent->addItem(tmp);
+    TransferHistory::Entry entry;
+    entry.path = file.filePath;
+    if (Friend* f = FriendList::findFriend(file.friendId))
+    {
+        entry.peerId = f->userId;
+        entry.peerName = f->getName();
+    }
+    entry.size = file.filesize;
+    entry.time = QDateTime::currentDateTime();
+    entry.digest = file.digest;
+    entry.sending = file.direction == ToxFile::SENDING;
+    TransferHistory::getInstance().append(entry);
 }
 
-// sadly, the ToxFile struct in core only has the file name, not the file path...
-// so currently, these don't work as intended (though for now, downloads might work
-// whenever they're not saved anywhere custom, thanks to the hack)
-// I could do some digging around, but for now I'm tired and others already 
-// might know it without me needing to dig, so...
-void FilesForm::onFileActivated(QListWidgetItem* item)
+void FilesForm::onSearchChanged(const QString& text)
 {
-    ListWidgetItem* tmp = dynamic_cast<ListWidgetItem*> (item);
-    QUrl url = QUrl::fromLocalFile(tmp->path);
+    recvdModel->setFilter(text);
+    sentModel->setFilter(text);
+}
+
+void FilesForm::onFileActivated(const QModelIndex& index)
+{
+    QUrl url = QUrl::fromLocalFile(index.data(TransferListModel::PathRole).toString());
     qDebug() << "Opening '" << url << "'";
     QDesktopServices::openUrl(url);
 }
+
+void FilesForm::onTabChanged(int index)
+{
+    if (main.widget(index) != statsPage)
+    {
+        statsTimer.stop();
+        return;
+    }
+    requestStats();
+    statsTimer.start();
+}
+
+void FilesForm::requestStats()
+{
+    if (!main.isVisible())
+    {
+        statsTimer.stop();
+        return;
+    }
+    // Core owns the transfers, it answers on its own thread with fileTransferStats
+    QMetaObject::invokeMethod(Core::getInstance(), "requestFileTransferStats", Qt::QueuedConnection);
+}
+
+void FilesForm::onFileTransferStats(const QByteArray& json)
+{
+    lastStats = json;
+    QJsonArray transfers = QJsonDocument::fromJson(json).object().value("transfers").toArray();
+    statsTable->setRowCount(transfers.size());
+    for (int row=0; row<transfers.size(); row++)
+    {
+        QJsonObject t = transfers[row].toObject();
+        double filesize = t["filesize"].toDouble();
+        QStringList cells;
+        cells << t["fileName"].toString()
+              << (t["direction"].toString() == "sending" ? tr("Upload") : tr("Download"))
+              << QString("%1%").arg(filesize ? 100 * t["bytesSent"].toDouble() / filesize : 0, 0, 'f', 1)
+              << QString("%1 KiB/s").arg(t["bytesPerSec"].toDouble() / 1024, 0, 'f', 1)
+              << QString::number(t["sendFailures"].toInt())
+              << QString::number(t["wakeups"].toInt())
+              << QString("%1 ms").arg(t["diskWaitMs"].toDouble())
+              << QString("%1 ms").arg(t["coreTimeUs"].toDouble() / 1000, 0, 'f', 1)
+              << t["status"].toString();
+        for (int col=0; col<cells.size(); col++)
+        {
+            QTableWidgetItem* item = statsTable->item(row, col);
+            if (!item)
+                statsTable->setItem(row, col, item = new QTableWidgetItem);
+            item->setText(cells[col]);
+        }
+    }
+}
+
+void FilesForm::onSaveStatsClicked()
+{
+    if (lastStats.isEmpty())
+        return;
+    QString path = QFileDialog::getSaveFileName(0, tr("Save transfer statistics"), "qtox-transfers.json",
+                                                tr("JSON files (*.json)"));
+    if (path.isEmpty())
+        return;
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(lastStats) != lastStats.size() || !file.commit())
+    {
+        qWarning() << "FilesForm::onSaveStatsClicked: Can't write" << path;
+        QMessageBox::warning(0, tr("Couldn't save"), tr("The statistics couldn't be written to %1").arg(path));
+    }
+}
@@ -17,15 +17,22 @@
 #ifndef FILESFORM_H
 #define FILESFORM_H
 
-#include <QListWidgetItem>
 #include <QTabWidget>
 #include <QString>
 #include <QLabel>
 #include <QVBoxLayout>
+#include <QTimer>
+#include "corestructs.h"
 
 namespace Ui {class MainWindow;}
-class QListWidget;
+class QLineEdit;
+class QListView;
+class QModelIndex;
+class QTableWidget;
+class TransferListModel;
 
+/// Every transfer of the TransferHistory, which it loads in the background as soon as we're made,
+/// and the live counters of the active ones
 class FilesForm : public QObject
 {
     Q_OBJECT
@@ -37,30 +44,33 @@ public:
     void show(Ui::MainWindow &ui);
 
 public slots:
-    void onFileDownloadComplete(const QString& path);
-    void onFileUploadComplete(const QString& path);
+    void onFileTransferFinished(ToxFile file); ///< Adds it to the history
+    void onFileTransferStats(const QByteArray& json);
     
 private slots:
-    void onFileActivated(QListWidgetItem* item);
+    void onFileActivated(const QModelIndex& index);
+    void onSearchChanged(const QString& text);
+    void onTabChanged(int index); ///< Only polls Core for stats while the tab is shown
+    void requestStats();
+    void onSaveStatsClicked();
+
+private:
+    QListView* makeList(TransferListModel* model);
 
 private:
     QWidget* head;
     QLabel headLabel;
     QVBoxLayout headLayout;
+    QLineEdit* search;
 
-    /* If we really do go whole hog with listing in progress transers,
-    I should really look into the new fangled list thingy, to deactivate
-    specific items in the list */
     QTabWidget main;
-    QListWidget* sent, * recvd;
+    TransferListModel *sentModel, *recvdModel;
 
-};
+    QWidget* statsPage; ///< Live counters of the active transfers, for debugging slow ones
+    QTableWidget* statsTable;
+    QTimer statsTimer;
+    QByteArray lastStats; ///< The JSON of the last snapshot, saved as is by the dump button
 
-class ListWidgetItem : public QListWidgetItem
-{
-    using QListWidgetItem::QListWidgetItem;
-  public:
-    QString path;
 };
 
 #endif // FILESFORM_H
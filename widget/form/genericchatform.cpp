@@ -17,12 +17,20 @@
 #include "genericchatform.h"
 #include "ui_mainwindow.h"
 #include <QFileDialog>
+#include <QLineEdit>
+#include <QDialog>
+#include <QMenu>
+#include <QVBoxLayout>
+#include <QProgressDialog>
+#include <QMessageBox>
 #include "smileypack.h"
 #include "widget/emoticonswidget.h"
 #include "style.h"
 #include "widget/widget.h"
 #include "settings.h"
 #include "widget/tool/chataction.h"
+#include "history.h"
+#include "chatexport.h"
 #include "widget/chatareawidget.h"
 #include "widget/tool/chattextedit.h"
 
@@ -30,6 +38,8 @@ GenericChatForm::GenericChatForm(QObject *parent) :
     QObject(parent)
 {
     curRow = 0;
+    searchPending = false;
+    contextPending = false;
 
     mainWidget = new QWidget(); headWidget = new QWidget();
 
@@ -41,11 +51,14 @@ GenericChatForm::GenericChatForm(QObject *parent) :
     QVBoxLayout *footButtonsSmall = new QVBoxLayout(), *volMicLayout = new QVBoxLayout();
 
     chatWidget = new ChatAreaWidget();
-    chatWidget->document()->setDefaultStyleSheet(Style::get(":ui/chatArea/innerStyle.css"));
-    chatWidget->setStyleSheet(Style::get(":/ui/chatArea/chatArea.css"));
+    chatWidget->setDefaultStyleSheet(Style::get(":ui/chatArea/innerStyle.css"));
 
     msgEdit = new ChatTextEdit();
 
+    searchEdit = new QLineEdit();
+    searchEdit->setPlaceholderText(tr("Search the history"));
+    searchEdit->setMaximumWidth(150);
+
     sendButton = new QPushButton();
     emoteButton = new QPushButton();
 
@@ -61,13 +74,13 @@ GenericChatForm::GenericChatForm(QObject *parent) :
 
     footButtonsSmall->setSpacing(2);
 
-    msgEdit->setStyleSheet(Style::get(":/ui/msgEdit/msgEdit.css"));
+    // The chat area, input and their buttons are styled by Widget's mainContent, see chatFormStyleSheet
     msgEdit->setFixedHeight(50);
     msgEdit->setFrameStyle(QFrame::NoFrame);
 
-    sendButton->setStyleSheet(Style::get(":/ui/sendButton/sendButton.css"));
-    fileButton->setStyleSheet(Style::get(":/ui/fileButton/fileButton.css"));
-    emoteButton->setStyleSheet(Style::get(":/ui/emoteButton/emoteButton.css"));
+    sendButton->setObjectName("sendButton");
+    fileButton->setObjectName("fileButton");
+    emoteButton->setObjectName("emoteButton");
 
     callButton->setObjectName("green");
     callButton->setStyleSheet(Style::get(":/ui/callButton/callButton.css"));
@@ -100,6 +113,7 @@ GenericChatForm::GenericChatForm(QObject *parent) :
     headWidget->setLayout(headLayout);
     headLayout->addWidget(avatarLabel);
     headLayout->addLayout(headTextLayout);
+    headLayout->addWidget(searchEdit);
     headLayout->addLayout(volMicLayout);
     headLayout->addWidget(callButton);
     headLayout->addWidget(videoButton);
@@ -117,6 +131,9 @@ GenericChatForm::GenericChatForm(QObject *parent) :
     emoteButton->setAttribute(Qt::WA_LayoutUsesWidgetRect);
 
     connect(emoteButton,  SIGNAL(clicked()), this, SLOT(onEmoteButtonClicked()));
+    connect(searchEdit, &QLineEdit::returnPressed, this, &GenericChatForm::onSearchRequested);
+    connect(&History::getInstance(), &History::searchFinished, this, &GenericChatForm::onSearchFinished);
+    connect(&History::getInstance(), &History::contextRead, this, &GenericChatForm::onContextRead);
     connect(chatWidget, SIGNAL(customContextMenuRequested(QPoint)), this, SLOT(onChatContextMenuRequested(QPoint)));
 }
 
@@ -139,16 +156,38 @@ void GenericChatForm::onChatContextMenuRequested(QPoint pos)
     QWidget* sender = (QWidget*)QObject::sender();
     pos = sender->mapToGlobal(pos);
     QMenu menu;
+    QAction* copy = menu.addAction(tr("Copy"), chatWidget, SLOT(copy()));
+    copy->setEnabled(chatWidget->hasSelection());
     menu.addAction(tr("Save chat log"), this, SLOT(onSaveLogClicked()));
     menu.exec(pos);
 }
 
 void GenericChatForm::onSaveLogClicked()
 {
-    QString path = QFileDialog::getSaveFileName(0, tr("Save chat log"));
+    QString path = QFileDialog::getSaveFileName(0, tr("Save chat log"), QString(),
+                                                tr("Text (*.txt);;HTML (*.html);;JSON (*.json)"));
     if (path.isEmpty())
         return;
 
+    // The history streams from a worker thread, without it all we have is what's on screen
+    if (!historyChat.isEmpty() && !History::getInstance().getSegmentSizes(historyChat).isEmpty())
+    {
+        ChatExport* exporter = new ChatExport(historyChat, nameLabel->text(), path, ChatExport::formatFor(path));
+        QProgressDialog* progress = new QProgressDialog(tr("Saving the chat log..."), tr("Cancel"), 0, 100, mainWidget);
+        progress->setAttribute(Qt::WA_DeleteOnClose);
+        progress->setMinimumDuration(500);
+        connect(exporter, &ChatExport::progress, progress, &QProgressDialog::setValue);
+        connect(progress, &QProgressDialog::canceled, exporter, &ChatExport::cancel);
+        connect(exporter, &ChatExport::finished, progress, &QProgressDialog::close);
+        connect(exporter, &ChatExport::finished, this, [path](bool ok, QString error)
+        {
+            if (!ok && !error.isEmpty())
+                QMessageBox::warning(0, tr("Save chat log"), tr("Couldn't save the chat log to %1: %2").arg(path, error));
+        });
+        exporter->start();
+        return;
+    }
+
     QFile file(path);
     if (!file.open(QIODevice::WriteOnly | QIODevice::Text))
         return;
@@ -169,6 +208,129 @@ void GenericChatForm::addMessage(QString author, QString message, QDateTime date
         chatWidget->insertMessage(new MessageAction("", message, date, isMe));
     else chatWidget->insertMessage(new MessageAction(author , message, date, isMe));
     previousName = author;
+    if (!firstMessageTime.isValid())
+        firstMessageTime = datetime;
+
+    if (!historyChat.isEmpty())
+        History::getInstance().append(historyChat, author, message, datetime);
+}
+
+QString GenericChatForm::chatFormStyleSheet()
+{
+    return Style::get(":/ui/chatArea/chatArea.css") + Style::get(":/ui/msgEdit/msgEdit.css")
+            + Style::get(":/ui/sendButton/sendButton.css") + Style::get(":/ui/fileButton/fileButton.css")
+            + Style::get(":/ui/emoteButton/emoteButton.css");
+}
+
+QDateTime GenericChatForm::getFirstMessageTime() const
+{
+    return firstMessageTime;
+}
+
+qint64 GenericChatForm::getMemoryUsage() const
+{
+    return chatWidget->getMemoryUsage();
+}
+
+void GenericChatForm::trim()
+{
+    chatWidget->trim();
+}
+
+void GenericChatForm::restoreHistory(const QDateTime& from)
+{
+    if (historyChat.isEmpty())
+        return;
+
+    QString username = Widget::getInstance()->getUsername();
+    QString format = Settings::getInstance().getTimestampFormat();
+    QList<ChatAction*> actions;
+    History::getInstance().sync();
+    History::getInstance().read(historyChat, from, [&](const History::Message& m)
+    {
+        QString author = (m.author == previousName) ? QString() : m.author;
+        actions << new MessageAction(author, m.message, m.time.toString(format), m.author == username);
+        previousName = m.author;
+        return true;
+    });
+    if (actions.isEmpty())
+        return;
+
+    firstMessageTime = from;
+    chatWidget->insertMessages(actions);
+}
+
+void GenericChatForm::onSearchRequested()
+{
+    QString query = searchEdit->text().trimmed();
+    if (query.isEmpty() || historyChat.isEmpty())
+        return;
+    searchPending = true;
+    History::getInstance().search(query, historyChat);
+}
+
+void GenericChatForm::onSearchFinished(QString query, History::Hits hits)
+{
+    if (!searchPending || query != searchEdit->text().trimmed())
+        return;
+    searchPending = false;
+
+    QList<History::Message> found = hits.value(historyChat);
+    QMenu menu;
+    QFontMetrics metrics(menu.font());
+    if (found.isEmpty())
+        menu.addAction(tr("No messages found"))->setEnabled(false);
+    // The newest first
+    for (int i = found.size() - 1; i >= 0 && found.size() - i <= SEARCH_MENU_HITS; i--)
+    {
+        const History::Message& hit = found[i];
+        QString text = hit.time.toString("yyyy-MM-dd " + Settings::getInstance().getTimestampFormat())
+                + "  " + hit.author + ": " + hit.message.simplified();
+        menu.addAction(metrics.elidedText(text, Qt::ElideRight, 400))->setData(i);
+    }
+
+    QAction* chosen = menu.exec(searchEdit->mapToGlobal(QPoint(0, searchEdit->height())));
+    if (chosen && chosen->data().isValid())
+        showSearchContext(found[chosen->data().toInt()]);
+}
+
+void GenericChatForm::showSearchContext(const History::Message& hit)
+{
+    // Read on the history's thread, the segments may have to be opened and unsealed
+    contextPending = true;
+    History::getInstance().readContext(historyChat, hit, SEARCH_CONTEXT_MESSAGES, SEARCH_CONTEXT_MESSAGES);
+}
+
+void GenericChatForm::onContextRead(QString chat, History::Message hit, History::Messages context)
+{
+    if (!contextPending || chat != historyChat)
+        return;
+    contextPending = false;
+
+    QDialog dialog(mainWidget);
+    dialog.setWindowTitle(tr("Search the history"));
+    dialog.resize(500, 400);
+    QVBoxLayout* layout = new QVBoxLayout(&dialog);
+    ChatAreaWidget* area = new ChatAreaWidget();
+    area->setDefaultStyleSheet(Style::get(":ui/chatArea/innerStyle.css"));
+    area->setStyleSheet(Style::get(":/ui/chatArea/chatArea.css"));
+    area->setScrollbackLimit(0);
+    layout->addWidget(area);
+
+    QList<ChatAction*> actions;
+    QString previous, self = Widget::getInstance()->getUsername();
+    int hitRow = -1;
+    for (const History::Message& message : context)
+    {
+        QString date = message.time.toString(Settings::getInstance().getTimestampFormat());
+        actions << new MessageAction(message.author == previous ? "" : message.author, message.message, date, message.author == self);
+        if (message.segment == hit.segment && message.offset == hit.offset)
+            hitRow = actions.size() - 1;
+        previous = message.author;
+    }
+    area->insertMessages(actions);
+    area->showRow(hitRow);
+    dialog.exec();
 }
 
 GenericChatForm::~GenericChatForm()
@@ -183,7 +345,9 @@ void GenericChatForm::onEmoteButtonClicked()
     if (SmileyPack::getInstance().getEmoticons().empty())
         return;
 
-    EmoticonsWidget widget;
+    // the picker is shared by every form, only the one that opened it gets the emoticon
+    EmoticonsWidget& widget = *EmoticonsWidget::getInstance();
+    disconnect(&widget, SIGNAL(insertEmoticon(QString)), 0, 0);
     connect(&widget, SIGNAL(insertEmoticon(QString)), this, SLOT(onEmoteInsertRequested(QString)));
 
     QWidget* sender = qobject_cast<QWidget*>(QObject::sender());
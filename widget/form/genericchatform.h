@@ -20,13 +20,18 @@
 #include <QObject>
 #include <QPoint>
 #include <QDateTime>
+#include "history.h"
 
 // Spacing in px inserted when the author of the last message changes
 #define AUTHOR_CHANGE_SPACING 5
+// Search hits listed at once, and messages shown around the one picked
+#define SEARCH_MENU_HITS 20
+#define SEARCH_CONTEXT_MESSAGES 15
 
 class QLabel;
 class QVBoxLayout;
 class QPushButton;
+class QLineEdit;
 class CroppingLabel;
 class ChatTextEdit;
 class ChatAreaWidget;
@@ -44,7 +49,12 @@ public:
 
     virtual void setName(const QString &newName);
     virtual void show(Ui::MainWindow &ui);
+    static QString chatFormStyleSheet(); ///< Set once on the container the forms are shown in, so each form doesn't parse it again
     void addMessage(QString author, QString message, QDateTime datetime=QDateTime::currentDateTime());
+    QDateTime getFirstMessageTime() const; ///< Invalid if nothing was shown yet
+    void restoreHistory(const QDateTime& from); ///< Shows what was logged since, after the form was recreated
+    qint64 getMemoryUsage() const; ///< Of the chat area's rows and documents
+    void trim(); ///< Evicts the scrollback the chat area can page back in
 
 signals:
     void sendMessage(int, QString);
@@ -57,6 +67,12 @@ protected slots:
     void onSaveLogClicked();
     void onEmoteButtonClicked();
     void onEmoteInsertRequested(QString str);
+    void onSearchRequested();
+    void onSearchFinished(QString query, History::Hits hits);
+    void onContextRead(QString chat, History::Message hit, History::Messages context); ///< Shows it around the hit
+
+protected:
+    void showSearchContext(const History::Message& hit); ///< Asks the history for the messages around it
 
 protected:
     CroppingLabel *nameLabel;
@@ -69,6 +85,11 @@ protected:
     QString previousName;
     ChatAreaWidget *chatWidget;
     int curRow;
+    QString historyChat; ///< Where addMessage logs to, nowhere if empty
+    QLineEdit *searchEdit;
+    bool searchPending;
+    bool contextPending; ///< We asked for the context of a hit, it shows when it comes
+    QDateTime firstMessageTime;
 };
 
 #endif // GENERICCHATFORM_H
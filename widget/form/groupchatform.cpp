@@ -16,16 +16,27 @@
 
 #include "groupchatform.h"
 #include "group.h"
-#include "widget/groupwidget.h"
 #include "widget/tool/chattextedit.h"
 #include "widget/croppinglabel.h"
+#include "history.h"
+#include "grouppeermodel.h"
 #include <QPushButton>
+#include <QListView>
+#include <QMenu>
+#include <QApplication>
+#include <QClipboard>
+#include "core.h"
+#include "settings.h"
+#include "style.h"
+#include "widget/widget.h"
+#include "widget/tool/chataction.h"
+#include "widget/chatareawidget.h"
 
 GroupChatForm::GroupChatForm(Group* chatGroup)
     : group(chatGroup)
 {
     nusersLabel = new QLabel();
-    namesList = new QLabel();
+    namesList = new QListView();
 
     fileButton->setEnabled(false);
     callButton->setVisible(false);
@@ -36,17 +47,30 @@ GroupChatForm::GroupChatForm(Group* chatGroup)
     QFont small;
     small.setPixelSize(10);
 
-    nameLabel->setText(group->widget->name.text());
+    nameLabel->setText(group->name);
+    historyChat = History::groupChat(group->name);
     nusersLabel->setFont(small);
-    nusersLabel->setText(GroupChatForm::tr("%1 users in chat","Number of users in chat").arg(group->peers.size()));
-    avatarLabel->setPixmap(QPixmap(":/img/group_dark.png"));
-
-    QString names;
-    for (QString& s : group->peers)
-        names.append(s+", ");
-    names.chop(2);
-    namesList->setText(names);
+    updateUserCount();
+    avatarLabel->setPixmap(Style::getPixmap(":/img/group_dark.png"));
+
+    // A single line of names that scrolls sideways, like the comma separated label it replaces
+    namesList->setModel(group->peers);
     namesList->setFont(small);
+    namesList->setFlow(QListView::LeftToRight);
+    namesList->setWrapping(false);
+    namesList->setLayoutMode(QListView::Batched);
+    namesList->setSpacing(2);
+    namesList->setFrameShape(QFrame::NoFrame);
+    namesList->setSelectionMode(QAbstractItemView::NoSelection);
+    namesList->setFocusPolicy(Qt::NoFocus);
+    namesList->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    namesList->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    namesList->setFixedHeight(QFontMetrics(small).height() + 6);
+    namesList->setStyleSheet("QListView { background: transparent; }");
+    namesList->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(namesList, &QListView::customContextMenuRequested, this, &GroupChatForm::onPeerContextMenu);
+    connect(group->peers, &GroupPeerModel::rowsInserted, this, &GroupChatForm::updateUserCount);
+    connect(group->peers, &GroupPeerModel::rowsRemoved, this, &GroupChatForm::updateUserCount);
 
     msgEdit->setObjectName("group");
 
@@ -74,23 +98,42 @@ void GroupChatForm::onSendTriggered()
     emit sendMessage(group->groupId, msg);
 }
 
-void GroupChatForm::addGroupMessage(QString message, int peerId)
+void GroupChatForm::addGroupMessages(const QList<GroupMessage>& messages)
 {
-    QString msgAuthor;
-    if (group->peers.contains(peerId))
-        msgAuthor = group->peers[peerId];
-    else
-        msgAuthor = tr("<Unknown>");
+    QDateTime now = QDateTime::currentDateTime();
+    QString date = now.toString(Settings::getInstance().getTimestampFormat());
+    QString username = Widget::getInstance()->getUsername();
+    QList<ChatAction*> actions;
+    for (const GroupMessage& msg : messages)
+    {
+        QString author = msg.author.isEmpty() ? tr("<Unknown>") : msg.author;
+        actions << new MessageAction(author == previousName ? QString() : author, msg.message, date, author == username);
+        previousName = author;
+        if (!historyChat.isEmpty())
+            History::getInstance().append(historyChat, author, msg.message, now);
+    }
+    if (!firstMessageTime.isValid())
+        firstMessageTime = now;
+    chatWidget->insertMessages(actions);
+}
 
-    addMessage(msgAuthor, message);
+void GroupChatForm::updateUserCount()
+{
+    nusersLabel->setText(tr("%1 users in chat","Number of users in chat").arg(group->peers->count()));
 }
 
-void GroupChatForm::onUserListChanged()
+void GroupChatForm::onPeerContextMenu(const QPoint& pos)
 {
-    nusersLabel->setText(tr("%1 users in chat").arg(group->nPeers));
-    QString names;
-    for (QString& s : group->peers)
-        names.append(s+", ");
-    names.chop(2);
-    namesList->setText(names);
+    QModelIndex index = namesList->indexAt(pos);
+    if (!index.isValid())
+        return;
+
+    QMenu menu;
+    QAction* copyKey = menu.addAction(tr("Copy public key", "Menu to copy the public key of a group chat peer"));
+    if (menu.exec(namesList->viewport()->mapToGlobal(pos)) != copyKey)
+        return;
+
+    QByteArray key = Core::getInstance()->getGroupPeers(group->groupId)->publicKey(index.row());
+    if (!key.isEmpty())
+        QApplication::clipboard()->setText(key.toHex().toUpper());
 }
@@ -18,9 +18,11 @@
 #define GROUPCHATFORM_H
 
 #include "genericchatform.h"
+#include "corestructs.h"
 
 namespace Ui {class MainWindow;}
 class Group;
+class QListView;
 
 class GroupChatForm : public GenericChatForm
 {
@@ -28,15 +30,17 @@ class GroupChatForm : public GenericChatForm
 public:
     GroupChatForm(Group* chatGroup);
     ~GroupChatForm();
-    void addGroupMessage(QString message, int peerId);
-    void onUserListChanged();
+    void addGroupMessages(const QList<GroupMessage>& messages); ///< Inserted in the chat in one go
 
 private slots:
     void onSendTriggered();
+    void updateUserCount();
+    void onPeerContextMenu(const QPoint& pos);
 
 private:
     Group* group;
-    QLabel *nusersLabel, *namesList;
+    QLabel *nusersLabel;
+    QListView *namesList; ///< Over the group's GroupPeerModel, only lays out the names in view
 };
 
 #endif // GROUPCHATFORM_H
@@ -14,55 +14,111 @@
     See the COPYING file for more details.
 */
 #include "friendlistwidget.h"
-#include <QDebug>
-#include <QGridLayout>
+#include "contactlistmodel.h"
+#include "contactlistdelegate.h"
+#include "grouplist.h"
+#include "group.h"
+#include "core.h"
+#include <QVBoxLayout>
+#include <QListView>
+#include <QLineEdit>
+#include <QSortFilterProxyModel>
+#include <QMenu>
 
 FriendListWidget::FriendListWidget(QWidget *parent) :
     QWidget(parent)
 {
-    mainLayout = new QGridLayout();
+    QVBoxLayout* mainLayout = new QVBoxLayout();
     setLayout(mainLayout);
-    setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Fixed);
+    setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Ignored);
     layout()->setSpacing(0);
     layout()->setMargin(0);
 
-    groupLayout = new QVBoxLayout();
-    groupLayout->setSpacing(0);
-    groupLayout->setMargin(0);
+    model = new ContactListModel(this);
+    filter = new QSortFilterProxyModel(this);
+    filter->setSourceModel(model);
+    filter->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    filter->setDynamicSortFilter(true);
 
-    for (Status s : {Status::Online, Status::Away, Status::Busy, Status::Offline})
-    {
-        QLayout *l = new QVBoxLayout();
-        l->setSpacing(0);
-        l->setMargin(0);
+    filterEdit = new QLineEdit();
+    filterEdit->setLayoutDirection(Qt::LeftToRight); // parent might have set Qt::RightToLeft
+    filterEdit->setPlaceholderText(tr("Filter contacts", "Placeholder of the contact list's search box"));
+    connect(filterEdit, &QLineEdit::textChanged, this, &FriendListWidget::onFilterChanged);
 
-        layouts[static_cast<int>(s)] = l;
-    }
+    view = new QListView();
+    view->setModel(filter);
+    view->setItemDelegate(new ContactListDelegate(view));
+    view->setUniformItemSizes(true);
+    view->setMouseTracking(true);
+    view->setFrameShape(QFrame::NoFrame);
+    view->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    view->setVerticalScrollMode(QAbstractItemView::ScrollPerPixel);
+    view->setSelectionMode(QAbstractItemView::NoSelection);
+    view->setFocusPolicy(Qt::NoFocus);
+    view->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(view, &QListView::clicked, this, &FriendListWidget::onClicked);
+    connect(view, &QListView::customContextMenuRequested, this, &FriendListWidget::onContextMenuRequested);
 
-    mainLayout->addLayout(layouts[static_cast<int>(Status::Online)], 0, 0);
-    mainLayout->addLayout(groupLayout, 1, 0);
-    mainLayout->addLayout(layouts[static_cast<int>(Status::Away)], 2, 0);
-    mainLayout->addLayout(layouts[static_cast<int>(Status::Busy)], 3, 0);
-    mainLayout->addLayout(layouts[static_cast<int>(Status::Offline)], 4, 0);
+    mainLayout->addWidget(filterEdit);
+    mainLayout->addWidget(view);
 }
 
-QLayout* FriendListWidget::getGroupLayout()
+ContactListModel* FriendListWidget::getModel()
 {
-    return groupLayout;
+    return model;
 }
 
-QLayout* FriendListWidget::getFriendLayout(Status s)
+void FriendListWidget::onClicked(const QModelIndex& index)
 {
-    auto res = layouts.find(static_cast<int>(s));
-    if (res != layouts.end())
-        return res.value();
+    int id = index.data(ContactListModel::IdRole).toInt();
+    if (index.data(ContactListModel::IsGroupRole).toBool())
+        emit groupClicked(id);
+    else
+        emit friendClicked(id);
+}
 
-    qDebug() << "Friend Status: " << static_cast<int>(s) << " not found!";
-    return layouts[static_cast<int>(Status::Online)];
+void FriendListWidget::onFilterChanged(const QString& text)
+{
+    filter->setFilterFixedString(text);
 }
 
-void FriendListWidget::moveWidget(QWidget *w, Status s)
+void FriendListWidget::onContextMenuRequested(const QPoint& pos)
 {
-    mainLayout->removeWidget(w);
-    getFriendLayout(s)->addWidget(w);
+    QModelIndex index = view->indexAt(pos);
+    if (!index.isValid())
+        return;
+
+    int id = index.data(ContactListModel::IdRole).toInt();
+    QMenu menu;
+    if (index.data(ContactListModel::IsGroupRole).toBool())
+    {
+        QAction* quitGroup = menu.addAction(tr("Quit group","Menu to quit a groupchat"));
+        if (menu.exec(view->viewport()->mapToGlobal(pos)) == quitGroup)
+            emit removeGroup(id);
+        return;
+    }
+
+    QAction* copyId = menu.addAction(tr("Copy friend ID","Menu to copy the Tox ID of that friend"));
+    QMenu* inviteMenu = menu.addMenu(tr("Invite in group","Menu to invite a friend in a groupchat"));
+    QMap<QAction*, Group*> groupActions;
+    for (Group* group : GroupList::groupList)
+    {
+        QAction* groupAction = inviteMenu->addAction(group->name);
+        groupActions[groupAction] =  group;
+    }
+    if (groupActions.isEmpty())
+        inviteMenu->setEnabled(false);
+    menu.addSeparator();
+    QAction* removeFriendAction = menu.addAction(tr("Remove friend", "Menu to remove the friend from our friendlist"));
+
+    QAction* selectedItem = menu.exec(view->viewport()->mapToGlobal(pos));
+    if (!selectedItem)
+        return;
+
+    if (selectedItem == copyId)
+        emit copyFriendIdToClipboard(id);
+    else if (selectedItem == removeFriendAction)
+        emit removeFriend(id);
+    else if (groupActions.contains(selectedItem))
+        Core::getInstance()->groupInviteFriend(id, groupActions[selectedItem]->groupId);
 }
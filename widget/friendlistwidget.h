@@ -18,30 +18,39 @@
 #define FRIENDLISTWIDGET_H
 
 #include <QWidget>
-#include <QHash>
-#include "corestructs.h"
 
-class QLayout;
-class QGridLayout;
+class QListView;
+class QLineEdit;
+class QSortFilterProxyModel;
+class QModelIndex;
+class ContactListModel;
 
+/// The contact list, a single view over ContactListModel that only paints the visible rows
 class FriendListWidget : public QWidget
 {
     Q_OBJECT
 public:
     explicit FriendListWidget(QWidget *parent = 0);
 
-    QLayout* getGroupLayout();
-    QLayout* getFriendLayout(Status s);
-    void moveWidget(QWidget *w, Status s);
+    ContactListModel* getModel();
 
 signals:
+    void friendClicked(int friendId);
+    void groupClicked(int groupId);
+    void removeFriend(int friendId);
+    void copyFriendIdToClipboard(int friendId);
+    void removeGroup(int groupId);
 
-public slots:
+private slots:
+    void onClicked(const QModelIndex& index);
+    void onContextMenuRequested(const QPoint& pos);
+    void onFilterChanged(const QString& text);
 
 private:
-    QHash<int, QLayout*> layouts;
-    QLayout *groupLayout;
-    QGridLayout *mainLayout;
+    ContactListModel* model;
+    QSortFilterProxyModel* filter;
+    QListView* view;
+    QLineEdit* filterEdit;
 };
 
 #endif // FRIENDLISTWIDGET_H
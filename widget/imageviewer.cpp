@@ -0,0 +1,394 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "imageviewer.h"
+#include <QApplication>
+#include <QBuffer>
+#include <QDebug>
+#include <QDesktopWidget>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QKeyEvent>
+#include <QMessageBox>
+#include <QPainter>
+#include <QRunnable>
+#include <QScrollBar>
+#include <limits>
+#include <cmath>
+
+/// Decodes one tile straight from the mapping, clipped and scaled by the decoder when it knows how
+class ImageViewer::TileTask : public QRunnable
+{
+public:
+    TileTask(ImageViewer* Viewer, int Level, int X, int Y, int Generation)
+        : viewer{Viewer}, level{Level}, x{X}, y{Y}, tileGeneration{Generation} {}
+
+    void run()
+    {
+        // Scrolled or zoomed away while we were queued, the overview is always wanted
+        if (x >= 0 && !viewer->isWanted(level, x, y, tileGeneration))
+        {
+            QMetaObject::invokeMethod(viewer, "onTileSkipped", Qt::QueuedConnection,
+                                      Q_ARG(int, level), Q_ARG(int, x), Q_ARG(int, y), Q_ARG(int, tileGeneration));
+            return;
+        }
+
+        // Shares the mapping, nothing is copied as long as nobody writes to it
+        QByteArray bytes = viewer->data;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, viewer->format);
+        QRect rect = x < 0 ? QRect(QPoint(), viewer->levelSize(level)) : viewer->tileRect(level, x, y);
+        if (viewer->tiled && x >= 0)
+        {
+            int factor = 1 << level;
+            reader.setClipRect(QRect(rect.topLeft() * factor, rect.size() * factor) & QRect(QPoint(), viewer->imageSize));
+        }
+        reader.setScaledSize(rect.size());
+        QImage tile = reader.read();
+        if (tile.isNull())
+            qWarning() << "ImageViewer: Can't decode a tile," << reader.errorString();
+        else if (tile.format() != QImage::Format_RGB32 && tile.format() != QImage::Format_ARGB32_Premultiplied)
+            tile = tile.convertToFormat(tile.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32);
+
+        QMetaObject::invokeMethod(viewer, "onTileReady", Qt::QueuedConnection, Q_ARG(int, level), Q_ARG(int, x),
+                                  Q_ARG(int, y), Q_ARG(int, tileGeneration), Q_ARG(QImage, tile));
+    }
+
+private:
+    ImageViewer* viewer;
+    int level, x, y, tileGeneration;
+};
+
+QSet<ImageViewer*> ImageViewer::viewers;
+
+ImageViewer::ImageViewer(const QString& path)
+    : file{path}, tiled{false}, scaled{false}, level{0}, minLevel{0}, fitLevel{0}
+{
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(QFileInfo(path).fileName());
+    viewport()->setCursor(Qt::OpenHandCursor);
+    pool.setMaxThreadCount(IMAGE_VIEWER_THREADS);
+
+    QSize screen = QApplication::desktop()->availableGeometry().size();
+    tiles.setMaxCost(screen.width() * screen.height() * 4 * IMAGE_VIEWER_CACHE_SCREENS);
+    viewers.insert(this);
+}
+
+ImageViewer::~ImageViewer()
+{
+    viewers.remove(this);
+    // The queued tasks see they're stale and return right away, the mapping goes with the file
+    generation.ref();
+    pool.waitForDone();
+}
+
+void ImageViewer::view(const QString& path)
+{
+    ImageViewer* viewer = new ImageViewer(path);
+    if (!viewer->open())
+    {
+        qWarning() << "ImageViewer: Can't decode" << path;
+        QMessageBox::warning(0, tr("Can't show the picture","Title of the image viewer's error popup"),
+                             tr("%1 can't be opened as a picture.").arg(QFileInfo(path).fileName()));
+        delete viewer;
+        return;
+    }
+    if (!viewer->scaled && (qint64)viewer->imageSize.width() * viewer->imageSize.height() > IMAGE_VIEWER_MAX_DECODE_PIXELS)
+    {
+        qWarning() << "ImageViewer: Not decoding" << path << viewer->imageSize << "whole";
+        QMessageBox::warning(0, tr("Can't show the picture","Title of the image viewer's error popup"),
+                             tr("%1 is too large to be shown, it has %2 x %3 pixels.").arg(QFileInfo(path).fileName())
+                             .arg(viewer->imageSize.width()).arg(viewer->imageSize.height()));
+        delete viewer;
+        return;
+    }
+
+    // Start with the picture fitting most of the screen. A decoder that can't clip makes a single tile
+    // of the whole level, so we can't zoom in further than what fits in the cache
+    QSize screen = QApplication::desktop()->availableGeometry().size() * 4 / 5;
+    while (viewer->levelSize(viewer->fitLevel).width() > screen.width()
+           || viewer->levelSize(viewer->fitLevel).height() > screen.height())
+        viewer->fitLevel++;
+    if (!viewer->tiled)
+        while ((qint64)viewer->levelSize(viewer->minLevel).width() * viewer->levelSize(viewer->minLevel).height() * 4
+               > viewer->tiles.maxCost())
+            viewer->minLevel++;
+    viewer->fitLevel = std::max(viewer->fitLevel, viewer->minLevel);
+    viewer->level = viewer->fitLevel;
+
+    int frame = 2 * viewer->frameWidth();
+    viewer->resize(viewer->levelSize(viewer->fitLevel).expandedTo(QSize(320, 240)) + QSize(frame, frame));
+    viewer->pool.start(new TileTask(viewer, viewer->fitLevel, -1, -1, 0));
+    viewer->updateScrollBars();
+    viewer->show();
+}
+
+bool ImageViewer::open()
+{
+    // QByteArray can't hold more than that, it would take a 30k x 30k PNG anyway
+    if (!file.open(QIODevice::ReadOnly) || file.size() <= 0 || file.size() > std::numeric_limits<int>::max())
+        return false;
+    uchar* map = file.map(0, file.size());
+    if (!map)
+        return false;
+    data = QByteArray::fromRawData(reinterpret_cast<const char*>(map), file.size());
+
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::ReadOnly);
+    QImageReader reader(&buffer);
+    reader.setDecideFormatFromContent(true);
+    if (!reader.canRead())
+        return false;
+    format = reader.format();
+    imageSize = reader.size();
+    tiled = reader.supportsOption(QImageIOHandler::ClipRect);
+    scaled = reader.supportsOption(QImageIOHandler::ScaledSize);
+    qDebug() << "ImageViewer: Opened" << file.fileName() << imageSize << format << (tiled ? "tiled" : "whole");
+    return imageSize.isValid();
+}
+
+qint64 ImageViewer::getTileMemory()
+{
+    qint64 bytes = 0;
+    for (ImageViewer* viewer : viewers)
+        bytes += viewer->tiles.totalCost() + viewer->overview.byteCount();
+    return bytes;
+}
+
+QSize ImageViewer::levelSize(int level) const
+{
+    int factor = 1 << level;
+    return QSize((imageSize.width() + factor - 1) / factor, (imageSize.height() + factor - 1) / factor);
+}
+
+int ImageViewer::tileExtent(int level) const
+{
+    QSize size = levelSize(level);
+    return tiled ? IMAGE_VIEWER_TILE : std::max(size.width(), size.height());
+}
+
+QRect ImageViewer::tileRect(int level, int x, int y) const
+{
+    int extent = tileExtent(level);
+    return QRect(x * extent, y * extent, extent, extent) & QRect(QPoint(), levelSize(level));
+}
+
+QPoint ImageViewer::origin() const
+{
+    // Smaller than the window, it goes in the middle
+    QSize size = levelSize(level), view = viewport()->size();
+    return QPoint(size.width() < view.width() ? (view.width() - size.width()) / 2 : -horizontalScrollBar()->value(),
+                  size.height() < view.height() ? (view.height() - size.height()) / 2 : -verticalScrollBar()->value());
+}
+
+quint64 ImageViewer::tileKey(int level, int x, int y)
+{
+    return ((quint64)level << 56) | ((quint64)(quint32)x << 28) | (quint32)y;
+}
+
+void ImageViewer::updateScrollBars()
+{
+    QSize size = levelSize(level), view = viewport()->size();
+    horizontalScrollBar()->setRange(0, std::max(0, size.width() - view.width()));
+    horizontalScrollBar()->setPageStep(view.width());
+    horizontalScrollBar()->setSingleStep(IMAGE_VIEWER_TILE / 4);
+    verticalScrollBar()->setRange(0, std::max(0, size.height() - view.height()));
+    verticalScrollBar()->setPageStep(view.height());
+    verticalScrollBar()->setSingleStep(IMAGE_VIEWER_TILE / 4);
+}
+
+void ImageViewer::updateWanted()
+{
+    int extent = tileExtent(level);
+    QRect visible = viewport()->rect().translated(-origin()) & QRect(QPoint(), levelSize(level));
+    QRect rect;
+    if (!visible.isEmpty())
+        rect = QRect(QPoint(visible.left() / extent, visible.top() / extent),
+                     QPoint(visible.right() / extent, visible.bottom() / extent));
+    QMutexLocker locker(&wantedMutex);
+    wanted = rect;
+}
+
+bool ImageViewer::isWanted(int level, int x, int y, int tileGeneration)
+{
+    if (tileGeneration != generation.loadAcquire())
+        return false;
+    Q_UNUSED(level); // Implied by the generation
+    QMutexLocker locker(&wantedMutex);
+    return wanted.contains(x, y);
+}
+
+void ImageViewer::request(int level, int x, int y)
+{
+    quint64 key = tileKey(level, x, y);
+    if (pending.contains(key))
+        return;
+    pending.insert(key);
+    pool.start(new TileTask(this, level, x, y, generation.loadAcquire()));
+}
+
+void ImageViewer::setLevel(int newLevel, QPoint anchor)
+{
+    newLevel = std::max(minLevel, std::min(newLevel, fitLevel));
+    if (newLevel == level)
+        return;
+
+    // Keep the pixel under the anchor where it is
+    QPointF point = QPointF(anchor - origin()) * std::ldexp(1.0, level - newLevel);
+    level = newLevel;
+    generation.ref();
+    pending.clear();
+    updateScrollBars();
+    horizontalScrollBar()->setValue(point.x() - anchor.x());
+    verticalScrollBar()->setValue(point.y() - anchor.y());
+    viewport()->update();
+}
+
+void ImageViewer::onTileReady(int level, int x, int y, int tileGeneration, const QImage& tile)
+{
+    if (x < 0)
+    {
+        overview = tile;
+        viewport()->update();
+        return;
+    }
+    if (tileGeneration != generation.loadAcquire())
+        return;
+
+    // A tile that doesn't decode is kept empty, so we don't try again every paint
+    quint64 key = tileKey(level, x, y);
+    pending.remove(key);
+    tiles.insert(key, new QImage(tile), std::max(1, tile.byteCount()));
+    viewport()->update(tileRect(level, x, y).translated(origin()));
+}
+
+void ImageViewer::onTileSkipped(int level, int x, int y, int tileGeneration)
+{
+    if (tileGeneration == generation.loadAcquire())
+        pending.remove(tileKey(level, x, y));
+}
+
+void ImageViewer::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    painter.fillRect(event->rect(), palette().dark());
+    updateWanted();
+
+    QSize size = levelSize(level);
+    QPoint offset = origin();
+    QRect visible = event->rect().translated(-offset) & QRect(QPoint(), size);
+    if (visible.isEmpty())
+        return;
+
+    // The overview is the fitting level already
+    if (level == fitLevel && !overview.isNull())
+    {
+        painter.drawImage(visible.translated(offset), overview, visible);
+        return;
+    }
+
+    // Missing tiles are drawn from the overview, blurry until the worker gets to them
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    qreal scale = overview.isNull() ? 0 : (qreal)overview.width() / size.width();
+    int extent = tileExtent(level);
+    for (int y = visible.top() / extent; y <= visible.bottom() / extent; y++)
+    {
+        for (int x = visible.left() / extent; x <= visible.right() / extent; x++)
+        {
+            QRect rect = tileRect(level, x, y);
+            QImage* tile = tiles.object(tileKey(level, x, y));
+            if (tile && !tile->isNull())
+            {
+                painter.drawImage(rect.topLeft() + offset, *tile);
+                continue;
+            }
+            if (!tile)
+                request(level, x, y);
+            if (scale > 0)
+                painter.drawImage(QRectF(rect.translated(offset)), overview,
+                                  QRectF(rect.x() * scale, rect.y() * scale, rect.width() * scale, rect.height() * scale));
+        }
+    }
+}
+
+void ImageViewer::resizeEvent(QResizeEvent* event)
+{
+    updateScrollBars();
+    QAbstractScrollArea::resizeEvent(event);
+}
+
+void ImageViewer::scrollContentsBy(int dx, int dy)
+{
+    Q_UNUSED(dx);
+    Q_UNUSED(dy);
+    // Centered pictures don't move with the bars, just paint everything again
+    viewport()->update();
+}
+
+void ImageViewer::wheelEvent(QWheelEvent* event)
+{
+    if (!(event->modifiers() & Qt::ControlModifier))
+        return QAbstractScrollArea::wheelEvent(event);
+    setLevel(level + (event->angleDelta().y() > 0 ? -1 : 1), event->pos());
+}
+
+void ImageViewer::keyPressEvent(QKeyEvent* event)
+{
+    QPoint center = viewport()->rect().center();
+    switch (event->key())
+    {
+    case Qt::Key_Plus:
+    case Qt::Key_Equal:
+        setLevel(level - 1, center);
+        break;
+    case Qt::Key_Minus:
+        setLevel(level + 1, center);
+        break;
+    case Qt::Key_0:
+        setLevel(fitLevel, center);
+        break;
+    case Qt::Key_Escape:
+        close();
+        break;
+    default:
+        QAbstractScrollArea::keyPressEvent(event);
+    }
+}
+
+void ImageViewer::mousePressEvent(QMouseEvent* event)
+{
+    if (event->button() != Qt::LeftButton)
+        return QAbstractScrollArea::mousePressEvent(event);
+    dragStart = event->pos();
+    viewport()->setCursor(Qt::ClosedHandCursor);
+}
+
+void ImageViewer::mouseMoveEvent(QMouseEvent* event)
+{
+    if (!(event->buttons() & Qt::LeftButton))
+        return QAbstractScrollArea::mouseMoveEvent(event);
+    QPoint delta = event->pos() - dragStart;
+    dragStart = event->pos();
+    horizontalScrollBar()->setValue(horizontalScrollBar()->value() - delta.x());
+    verticalScrollBar()->setValue(verticalScrollBar()->value() - delta.y());
+}
+
+void ImageViewer::mouseReleaseEvent(QMouseEvent* event)
+{
+    viewport()->setCursor(Qt::OpenHandCursor);
+    QAbstractScrollArea::mouseReleaseEvent(event);
+}
@@ -0,0 +1,96 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef IMAGEVIEWER_H
+#define IMAGEVIEWER_H
+
+#include <QAbstractScrollArea>
+#include <QAtomicInt>
+#include <QCache>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QSet>
+#include <QThreadPool>
+
+#define IMAGE_VIEWER_TILE 256
+#define IMAGE_VIEWER_THREADS 2
+#define IMAGE_VIEWER_CACHE_SCREENS 2 // The tile cache holds this many screens worth of pixels
+#define IMAGE_VIEWER_MAX_DECODE_PIXELS (32*1024*1024) // Past this, pictures whose decoder can't scale down aren't shown
+
+/// Shows a received picture of any size in its own window. The file is memory-mapped, never read whole,
+/// and only the tiles on screen are decoded, at the zoom level they're shown at, on the viewer's own pool.
+/// Decoded tiles go in a cache bounded to a couple of screens, whatever the picture's size.
+/// Formats whose decoder can't clip are decoded whole, so they can't be zoomed in past that bound.
+/// Those that can't scale down either, like PNG, GIF and BMP, decode every pixel even for the overview,
+/// so past IMAGE_VIEWER_MAX_DECODE_PIXELS we refuse them rather than allocate that much
+class ImageViewer : public QAbstractScrollArea
+{
+    Q_OBJECT
+public:
+    static void view(const QString& path); ///< Opens a viewer window, warns if the file can't or shouldn't be decoded
+    ~ImageViewer();
+    static qint64 getTileMemory(); ///< Of every open viewer, GUI thread only
+
+protected:
+    void paintEvent(QPaintEvent* event) override;
+    void resizeEvent(QResizeEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
+    void wheelEvent(QWheelEvent* event) override;
+    void keyPressEvent(QKeyEvent* event) override;
+    void mousePressEvent(QMouseEvent* event) override;
+    void mouseMoveEvent(QMouseEvent* event) override;
+    void mouseReleaseEvent(QMouseEvent* event) override;
+
+private slots:
+    void onTileReady(int level, int x, int y, int tileGeneration, const QImage& tile); ///< x is -1 for the overview
+    void onTileSkipped(int level, int x, int y, int tileGeneration); ///< The task found it off screen
+
+private:
+    class TileTask;
+    explicit ImageViewer(const QString& path);
+    bool open(); ///< Maps the file and reads the header
+    QSize levelSize(int level) const; ///< The picture halved level times
+    int tileExtent(int level) const; ///< Side of a tile, a single tile covers the picture if we can't clip
+    QRect tileRect(int level, int x, int y) const; ///< In the level's pixels
+    QPoint origin() const; ///< Where the level's top left is drawn in the viewport
+    void setLevel(int newLevel, QPoint anchor); ///< Keeps what's under anchor in place
+    void updateScrollBars();
+    void updateWanted(); ///< Tells the tasks which tiles are still on screen
+    bool isWanted(int level, int x, int y, int tileGeneration); ///< Called by the tasks
+    void request(int level, int x, int y);
+    static quint64 tileKey(int level, int x, int y);
+
+private:
+    static QSet<ImageViewer*> viewers;
+    QFile file;
+    QByteArray data; ///< Over the mapping, never copied
+    QByteArray format;
+    QSize imageSize;
+    bool tiled; ///< The decoder can clip, so a tile costs its own size only
+    bool scaled; ///< The decoder can scale down while decoding, or makes the whole picture first
+    int level, minLevel, fitLevel;
+    QImage overview; ///< The whole picture at fitLevel, drawn where tiles are missing
+    QCache<quint64, QImage> tiles; ///< The cost is in bytes
+    QSet<quint64> pending;
+    QAtomicInt generation; ///< Changes with the level, the tasks of an old one give up
+    QMutex wantedMutex;
+    QRect wanted; ///< The tiles on screen, in tile coordinates of the current level
+    QPoint dragStart;
+    QThreadPool pool; ///< Waited for by the destructor, so the tasks can use the mapping and us
+};
+
+#endif // IMAGEVIEWER_H
@@ -16,101 +16,107 @@
 
 #include "netcamview.h"
 #include "core.h"
+#include "videoconverter.h"
+#include "widget/tool/visibility.h"
+#ifdef QTOX_OPENGL_VIDEO
+#include "videosurface.h"
+#endif
 #include <QLabel>
 #include <QHBoxLayout>
-
-static inline void fromYCbCrToRGB(
-        uint8_t Y, uint8_t Cb, uint8_t Cr,
-        uint8_t& R, uint8_t& G, uint8_t& B)
-{
-    int r = Y + ((1436 * (Cr - 128)) >> 10),
-        g = Y - ((354 * (Cb - 128) + 732 * (Cr - 128)) >> 10),
-        b = Y + ((1814 * (Cb - 128)) >> 10);
-
-    if(r < 0) {
-        r = 0;
-    } else if(r > 255) {
-        r = 255;
-    }
-
-    if(g < 0) {
-        g = 0;
-    } else if(g > 255) {
-        g = 255;
-    }
-
-    if(b < 0) {
-        b = 0;
-    } else if(b > 255) {
-        b = 255;
-    }
-
-    R = static_cast<uint8_t>(r);
-    G = static_cast<uint8_t>(g);
-    B = static_cast<uint8_t>(b);
-}
-
+#include <QEvent>
 
 NetCamView::NetCamView(QWidget* parent)
     : QWidget(parent), displayLabel{new QLabel},
-      mainLayout{new QHBoxLayout()}
+      mainLayout{new QHBoxLayout()}, surface{nullptr}, converter{new VideoConverter(this)}
 {
     setLayout(mainLayout);
     setWindowTitle("Tox video");
     setMinimumSize(320,240);
 
     displayLabel->setAlignment(Qt::AlignCenter);
+    connect(converter, &VideoConverter::imageReady, this, &NetCamView::showImage);
+    Visibility::watch(this, "showPendingFrame");
+
+#ifdef QTOX_OPENGL_VIDEO
+    if (VideoSurface::isAvailable())
+    {
+        surface = new VideoSurface;
+        connect(surface, &VideoSurface::failed, this, &NetCamView::useSoftwareRendering);
+        mainLayout->addWidget(surface);
+        displayLabel->hide();
+        return;
+    }
+#endif
+
+    mainLayout->addWidget(displayLabel);
+}
+
+void NetCamView::useSoftwareRendering()
+{
+    if (!surface)
+        return;
 
+    surface->deleteLater();
+    surface = nullptr;
     mainLayout->addWidget(displayLabel);
+    displayLabel->show();
 }
 
-void NetCamView::updateDisplay(vpx_image* frame)
+void NetCamView::updateDisplay(const VideoFrame& video)
 {
-    if (!frame->w || !frame->h)
+    vpx_image* frame = video.image();
+    if (!frame || !frame->w || !frame->h)
         return;
 
-    Core* core = Core::getInstance();
+    // Nobody would see it, the newest frame is converted once we're back on screen
+    if (!Visibility::isOnScreen(this))
+    {
+        pending = video;
+        return;
+    }
+    pending = VideoFrame();
 
-    core->increaseVideoBusyness();
+#ifdef QTOX_OPENGL_VIDEO
+    if (surface)
+    {
+        surface->setFrame(video);
+        return;
+    }
+#endif
 
-    img = convert(*frame);
+    // Straight to the size we show it at, off the GUI thread so other calls' views don't wait for us
+    QSize size = QSize(frame->d_w, frame->d_h).scaled(displayLabel->size(), Qt::KeepAspectRatio);
+    converter->toImage(video, size);
+}
 
-    vpx_img_free(frame);
-    displayLabel->setPixmap(QPixmap::fromImage(img).scaled(displayLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+void NetCamView::showImage(const QImage& image)
+{
+    if (surface)
+        return;
 
-    core->decreaseVideoBusyness();
+    img = image;
+    displayLabel->setPixmap(QPixmap::fromImage(img));
 }
 
-QImage NetCamView::convert(vpx_image& frame)
+void NetCamView::showPendingFrame()
 {
-    int w = frame.d_w, h = frame.d_h;
-    int bpl = frame.stride[VPX_PLANE_Y], cxbpl = frame.stride[VPX_PLANE_V];
-    QImage img(w, h, QImage::Format_RGB32);
-
-    uint8_t* yData = frame.planes[VPX_PLANE_Y];
-    uint8_t* uData = frame.planes[VPX_PLANE_V];
-    uint8_t* vData = frame.planes[VPX_PLANE_U];
-    for (int i = 0; i< h; i++)
-    {
-        uint32_t* scanline = (uint32_t*)img.scanLine(i);
-        for (int j=0; j < w; j++)
-        {
-            uint8_t Y = yData[i*bpl + j];
-            uint8_t U = uData[i/2*cxbpl + j/2];
-            uint8_t V = vData[i/2*cxbpl + j/2];
-
-            uint8_t R, G, B;
-            fromYCbCrToRGB(Y, U, V, R, G, B);
-
-            scanline[j] = (0xFF<<24) + (R<<16) + (G<<8) + B;
-        }
-    }
+    VideoFrame frame = pending; // updateDisplay lets go of pending
+    if (!frame.isNull())
+        updateDisplay(frame);
+}
 
-    return img;
+void NetCamView::showEvent(QShowEvent* e)
+{
+    QWidget::showEvent(e);
+    // After the window system had a chance to expose us
+    QMetaObject::invokeMethod(this, "showPendingFrame", Qt::QueuedConnection);
 }
 
 void NetCamView::resizeEvent(QResizeEvent *e)
 {
     Q_UNUSED(e)
+    if (surface)
+        return;
+
     displayLabel->setPixmap(QPixmap::fromImage(img).scaled(displayLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
 }
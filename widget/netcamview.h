@@ -18,6 +18,7 @@
 #define NETCAMVIEW_H
 
 #include <QWidget>
+#include "videoframe.h"
 
 class QCloseEvent;
 class QShowEvent;
@@ -25,7 +26,8 @@ class QPainter;
 class QLabel;
 class QHBoxLayout;
 class QImage;
-class vpx_image;
+class VideoSurface;
+class VideoConverter;
 
 class NetCamView : public QWidget
 {
@@ -35,19 +37,25 @@ public:
     NetCamView(QWidget *parent=0);
 
 public slots:
-    void updateDisplay(vpx_image* frame);
+    void updateDisplay(const VideoFrame& frame); ///< Only keeps the frame while we're not on screen
 
-private:
-    static QImage convert(vpx_image& frame);
+private slots:
+    void useSoftwareRendering(); ///< Drops the OpenGL surface for the label
+    void showPendingFrame(); ///< What came while we were hidden or minimized, in one conversion
+    void showImage(const QImage& image); ///< A frame the converter made ready to paint
 
 protected:
     void resizeEvent(QResizeEvent *e);
+    void showEvent(QShowEvent* e);
 
 private:
     QLabel *displayLabel;
     QImage lastFrame;
     QHBoxLayout* mainLayout;
     QImage img;
+    VideoSurface* surface; ///< Null when we draw in software
+    VideoConverter* converter; ///< Converts our frames on the shared pool when we draw in software
+    VideoFrame pending; ///< The newest frame we didn't show, null once it's shown
 };
 
 #endif // NETCAMVIEW_H
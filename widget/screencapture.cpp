@@ -0,0 +1,191 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "screencapture.h"
+#include "videoconvert.h"
+#include "coredefines.h"
+#include <QTimer>
+#include <QScreen>
+#include <QPixmap>
+#include <QGuiApplication>
+#include <QCoreApplication>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+ScreenCapture::ScreenCapture()
+    : captureTimer{new QTimer(this)}, refcount{0}, frameStale{true}
+{
+    // Screens can only be grabbed from the GUI thread, whoever asked for us first
+    moveToThread(QCoreApplication::instance()->thread());
+    captureTimer->setInterval(TOXAV_SCREEN_CAPTURE_INTERVAL);
+    captureTimer->setSingleShot(false);
+    connect(captureTimer, &QTimer::timeout, this, &ScreenCapture::capture);
+}
+
+ScreenCapture* ScreenCapture::getInstance()
+{
+    static ScreenCapture* instance = new ScreenCapture;
+    return instance;
+}
+
+void ScreenCapture::suscribe()
+{
+    QMutexLocker locker(&subscriptionMutex);
+    if (refcount++ == 0)
+        QMetaObject::invokeMethod(this, "start", Qt::QueuedConnection);
+}
+
+void ScreenCapture::unsuscribe()
+{
+    QMutexLocker locker(&subscriptionMutex);
+    if (refcount <= 0)
+    {
+        qWarning() << "ScreenCapture::unsuscribe: Not suscribed";
+        return;
+    }
+    if (--refcount == 0)
+        QMetaObject::invokeMethod(this, "stop", Qt::QueuedConnection);
+}
+
+void ScreenCapture::start()
+{
+    if (captureTimer->isActive())
+        return;
+
+    captureTimer->start();
+    capture();
+}
+
+void ScreenCapture::stop()
+{
+    // We may have been suscribed again before this got to run
+    {
+        QMutexLocker locker(&subscriptionMutex);
+        if (refcount > 0)
+            return;
+    }
+
+    captureTimer->stop();
+    previous = QImage();
+    QMutexLocker canvasLocker(&canvasMutex);
+    canvasSize = QSize();
+    canvasY.clear();
+    canvasU.clear();
+    canvasV.clear();
+    QMutexLocker frameLocker(&frameMutex);
+    frame = VideoFrame();
+    frameStale = true;
+}
+
+bool ScreenCapture::updateTile(const QImage& grab, int x, int y, int w, int h)
+{
+    if (!previous.isNull())
+    {
+        int line = y;
+        while (line < y+h && !memcmp(grab.constScanLine(line) + 4*x, previous.constScanLine(line) + 4*x, 4*w))
+            line++;
+        if (line == y+h)
+            return false;
+    }
+
+    // Tiles start on even pixels, so their chroma doesn't share samples with the neighbours
+    int yStride = canvasSize.width(), cStride = (canvasSize.width()+1)/2;
+    VideoConvert::rgb32ToI420(grab.constScanLine(y) + 4*x, grab.bytesPerLine(), w, h,
+                              canvasY.data() + y*yStride + x, yStride,
+                              canvasV.data() + y/2*cStride + x/2, cStride,
+                              canvasU.data() + y/2*cStride + x/2, cStride);
+    return true;
+}
+
+void ScreenCapture::capture()
+{
+    QScreen* screen = QGuiApplication::primaryScreen();
+    if (!screen)
+        return;
+
+    QImage grab = screen->grabWindow(0).toImage();
+    if (grab.isNull())
+        return;
+    if (grab.format() != QImage::Format_RGB32 && grab.format() != QImage::Format_ARGB32)
+        grab = grab.convertToFormat(QImage::Format_RGB32);
+
+    QMutexLocker canvasLocker(&canvasMutex);
+    if (grab.size() != canvasSize)
+    {
+        canvasSize = grab.size();
+        int chroma = ((canvasSize.width()+1)/2) * ((canvasSize.height()+1)/2);
+        canvasY.resize(canvasSize.width() * canvasSize.height());
+        canvasU.resize(chroma);
+        canvasV.resize(chroma);
+        previous = QImage(); // Everything is new
+    }
+
+    bool changed = false;
+    for (int y=0; y<canvasSize.height(); y+=TOXAV_SCREEN_CAPTURE_TILE)
+        for (int x=0; x<canvasSize.width(); x+=TOXAV_SCREEN_CAPTURE_TILE)
+            changed |= updateTile(grab, x, y, std::min(TOXAV_SCREEN_CAPTURE_TILE, canvasSize.width()-x),
+                                  std::min(TOXAV_SCREEN_CAPTURE_TILE, canvasSize.height()-y));
+    previous = grab;
+
+    if (changed)
+    {
+        QMutexLocker frameLocker(&frameMutex);
+        frameStale = true;
+        serial.ref();
+    }
+}
+
+VideoFrame ScreenCapture::getLastVideoFrame(QSize maxSize)
+{
+    QMutexLocker frameLocker(&frameMutex);
+    if (!frame.isNull() && !frameStale && frameMaxSize == maxSize)
+        return frame;
+
+    // The GUI thread is converting, the last frame will do until next time
+    if (!canvasMutex.tryLock())
+        return frame;
+    if (canvasSize.isEmpty())
+    {
+        canvasMutex.unlock();
+        return frame;
+    }
+
+    // Even sizes so the chroma planes scale by the same factor, and never more than a call can take
+    QSize bound(TOXAV_MAX_VIDEO_WIDTH, TOXAV_MAX_VIDEO_HEIGHT);
+    if (maxSize.isValid())
+        bound = bound.boundedTo(maxSize);
+    QSize size = canvasSize.width() <= bound.width() && canvasSize.height() <= bound.height()
+            ? canvasSize : canvasSize.scaled(bound, Qt::KeepAspectRatio);
+    size = QSize(std::max(size.width() & ~1, 2), std::max(size.height() & ~1, 2));
+
+    VideoFrame built = VideoFrame::create(size.width(), size.height());
+    if (vpx_image* img = built.image())
+    {
+        int w = canvasSize.width(), h = canvasSize.height(), cw = (w+1)/2, ch = (h+1)/2;
+        VideoConvert::scalePlane(canvasY.constData(), w, w, h, img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y],
+                                 size.width(), size.height());
+        VideoConvert::scalePlane(canvasU.constData(), cw, cw, ch, img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U],
+                                 size.width()/2, size.height()/2);
+        VideoConvert::scalePlane(canvasV.constData(), cw, cw, ch, img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V],
+                                 size.width()/2, size.height()/2);
+        frame = built;
+        frameMaxSize = maxSize;
+        frameStale = false;
+    }
+    canvasMutex.unlock();
+    return frame;
+}
@@ -0,0 +1,68 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef SCREENCAPTURE_H
+#define SCREENCAPTURE_H
+
+#include <QObject>
+#include <QImage>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QVector>
+#include "videosource.h"
+
+class QTimer;
+
+/// Shares the primary screen as a video source. The screen is grabbed on the GUI thread,
+/// compared with the previous grab tile by tile, and only the tiles that changed are converted
+/// into a full resolution I420 copy of the screen. The frame handed to calls is only rebuilt from
+/// that copy when something changed, so a static screen costs a grab and a comparison per tick.
+class ScreenCapture : public QObject, public VideoSource
+{
+    Q_OBJECT
+
+public:
+    static ScreenCapture* getInstance();
+    virtual void suscribe() override; ///< Can be called from any thread
+    virtual void unsuscribe() override;
+    virtual VideoFrame getLastVideoFrame(QSize maxSize = QSize()) override; ///< Shared until the screen changes or maxSize does
+    int getFrameSerial() const {return serial.loadAcquire();} ///< Changes every time the screen changed
+
+private slots:
+    void start();
+    void stop();
+    void capture(); ///< Grabs the screen and converts what changed
+
+private:
+    ScreenCapture();
+    bool updateTile(const QImage& grab, int x, int y, int w, int h); ///< Converts the tile if it changed since the last grab
+
+private:
+    QTimer* captureTimer;
+    int refcount; ///< Number of users suscribed, guarded by subscriptionMutex
+    QMutex subscriptionMutex;
+    QImage previous; ///< Last grab, to find what changed. Only touched by the GUI thread
+    QMutex canvasMutex; ///< Held while tiles are converted and while the shared frame is built from them
+    QSize canvasSize;
+    QVector<uint8_t> canvasY, canvasU, canvasV; ///< The whole screen in I420, Cb in canvasV like the camera's frames
+    QMutex frameMutex; ///< Never held while waiting for canvasMutex, so the getter can't block on a conversion
+    VideoFrame frame; ///< Built from the canvas for the last maxSize asked
+    QSize frameMaxSize;
+    bool frameStale; ///< The screen changed since we built frame
+    QAtomicInt serial;
+};
+
+#endif // SCREENCAPTURE_H
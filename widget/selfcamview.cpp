@@ -16,54 +16,147 @@
 
 #include "selfcamview.h"
 #include "camera.h"
+#include "widget/tool/visibility.h"
+#ifdef QTOX_OPENGL_VIDEO
+#include "videosurface.h"
+#endif
 #include <QCloseEvent>
 #include <QShowEvent>
+#include <QHideEvent>
 #include <QTimer>
 #include <QLabel>
 #include <QHBoxLayout>
-#include <opencv2/opencv.hpp>
-
-using namespace cv;
+#include <QScreen>
+#include <QWindow>
+#include <QGuiApplication>
 
 SelfCamView::SelfCamView(Camera* Cam, QWidget* parent)
     : QWidget(parent), displayLabel{new QLabel},
-      mainLayout{new QHBoxLayout()}, cam(Cam), updateDisplayTimer{new QTimer}
+      mainLayout{new QHBoxLayout()}, cam(Cam), updateDisplayTimer{new QTimer}, lastFrameSerial{-1},
+      displaying{false}, surface{nullptr}
 {
     setLayout(mainLayout);
     setWindowTitle(SelfCamView::tr("Tox video test","Title of the window to test the video/webcam"));
     setMinimumSize(320,240);
 
-    updateDisplayTimer->setInterval(5);
+    updateDisplayTimer->setTimerType(Qt::PreciseTimer);
     updateDisplayTimer->setSingleShot(false);
 
     displayLabel->setAlignment(Qt::AlignCenter);
 
+    connect(updateDisplayTimer, SIGNAL(timeout()), this, SLOT(updateDisplay()));
+
+#ifdef QTOX_OPENGL_VIDEO
+    if (VideoSurface::isAvailable())
+    {
+        surface = new VideoSurface;
+        connect(surface, &VideoSurface::failed, this, &SelfCamView::useSoftwareRendering);
+        mainLayout->addWidget(surface);
+        displayLabel->hide();
+        return;
+    }
+#endif
+
     mainLayout->addWidget(displayLabel);
+}
 
-    connect(updateDisplayTimer, SIGNAL(timeout()), this, SLOT(updateDisplay()));
+void SelfCamView::useSoftwareRendering()
+{
+    if (!surface)
+        return;
+
+    surface->deleteLater();
+    surface = nullptr;
+    mainLayout->addWidget(displayLabel);
+    displayLabel->show();
+    lastFrameSerial = -1;
 }
 
 void SelfCamView::closeEvent(QCloseEvent* event)
 {
-    cam->unsuscribe();
-    updateDisplayTimer->stop();
+    stopDisplay();
     event->accept();
 }
 
 void SelfCamView::showEvent(QShowEvent* event)
 {
-    cam->suscribe();
-    updateDisplayTimer->start();
+    if (!isMinimized())
+        startDisplay();
+    event->accept();
+}
+
+void SelfCamView::hideEvent(QHideEvent* event)
+{
+    // Also when minimized on some platforms, changeEvent sees that too
+    stopDisplay();
     event->accept();
 }
 
+void SelfCamView::changeEvent(QEvent* e)
+{
+    QWidget::changeEvent(e);
+    if (e->type() != QEvent::WindowStateChange)
+        return;
+    if (isMinimized())
+        stopDisplay();
+    else if (isVisible())
+        startDisplay();
+}
+
+void SelfCamView::startDisplay()
+{
+    if (displaying)
+        return;
+    displaying = true;
+    cam->suscribe();
+    lastFrameSerial = -1;
+
+    // No point looking for new frames more often than the screen can show them
+    QScreen* screen = windowHandle() ? windowHandle()->screen() : QGuiApplication::primaryScreen();
+    qreal refreshRate = screen && screen->refreshRate() > 0 ? screen->refreshRate() : 60;
+    updateDisplayTimer->start(qMax(1, qRound(1000 / refreshRate)));
+}
+
+void SelfCamView::stopDisplay()
+{
+    if (!displaying)
+        return;
+    displaying = false;
+    cam->unsuscribe();
+    updateDisplayTimer->stop();
+}
+
 void SelfCamView::updateDisplay()
 {
-    displayLabel->setPixmap(QPixmap::fromImage(cam->getLastImage()).scaled(displayLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
+    // Covered, the serial stays so the frame is converted once we're exposed again
+    if (!Visibility::isOnScreen(this))
+        return;
+
+    // The camera doesn't block us until it has a new frame anymore, don't convert the same one again
+    int serial = cam->getFrameSerial();
+    if (serial == lastFrameSerial)
+        return;
+    lastFrameSerial = serial;
+
+#ifdef QTOX_OPENGL_VIDEO
+    // The same I420 frame the encoder gets, the GPU converts and scales it
+    if (surface)
+    {
+        surface->setFrame(cam->getLastVideoFrame());
+        return;
+    }
+#endif
+
+    // Converted from the capture thread's I420 frame straight to the size we show it at
+    displayLabel->setPixmap(QPixmap::fromImage(cam->getLastImage(displayLabel->size())));
 }
 
 void SelfCamView::resizeEvent(QResizeEvent *e)
 {
     Q_UNUSED(e)
+    if (surface)
+        return;
+
+    lastFrameSerial = -1;
     updateDisplay();
 }
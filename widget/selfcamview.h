@@ -21,11 +21,13 @@
 
 class QCloseEvent;
 class QShowEvent;
+class QHideEvent;
 class QPainter;
 class Camera;
 class QLabel;
 class QHBoxLayout;
 class QTimer;
+class VideoSurface;
 
 class SelfCamView : public QWidget
 {
@@ -36,11 +38,16 @@ public:
 
 private slots:
     void updateDisplay();
+    void useSoftwareRendering(); ///< Drops the OpenGL surface for the label
 
 private:
     void closeEvent(QCloseEvent*);
     void showEvent(QShowEvent*);
+    void hideEvent(QHideEvent*);
+    void changeEvent(QEvent* e); ///< Lets go of the camera while we're minimized
     void paint(QPainter *painter);
+    void startDisplay(); ///< Subscribes to the camera and polls it at the refresh rate
+    void stopDisplay();
 
 protected:
     void resizeEvent(QResizeEvent *e);
@@ -50,6 +57,9 @@ private:
     QHBoxLayout* mainLayout;
     Camera* cam;
     QTimer* updateDisplayTimer;
+    int lastFrameSerial; ///< Serial of the camera frame we show, -1 to redraw
+    bool displaying; ///< We're subscribed to the camera
+    VideoSurface* surface; ///< Null when we draw in software
 };
 
 #endif // SELFCAMVIEW_H
@@ -1,10 +1,12 @@
 #include "settingsdialog.h"
 #include "settings.h"
+#include "style.h"
 #include "widget.h"
 #include "camera.h"
 #include "selfcamview.h"
 #include "core.h"
 #include "smileypack.h"
+#include "corestatsdialog.h"
 
 #include <QListWidget>
 #include <QListWidgetItem>
@@ -16,6 +18,11 @@
 #include <QCheckBox>
 #include <QLineEdit>
 #include <QComboBox>
+#include <QSpinBox>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
 
 
 // =======================================
@@ -44,6 +51,24 @@ public:
         vLayout->addWidget(makeToxPortable);
         group->setLayout(vLayout);
 
+        // file transfers
+        QGroupBox* transferGroup = new QGroupBox(tr("File Transfers"));
+        QLabel* uploadLimitLabel = new QLabel(tr("Upload limit","Label of the spinbox limiting the file upload rate"));
+        uploadLimit = new QSpinBox(this);
+        uploadLimit->setRange(0, 1024*1024);
+        uploadLimit->setSingleStep(16);
+        uploadLimit->setSuffix(tr(" KiB/s","Unit of the upload limit"));
+        uploadLimit->setSpecialValueText(tr("Unlimited","Upload limit of 0"));
+
+        hashTransfers = new QCheckBox(this);
+        hashTransfers->setText(tr("Verify transfers with a checksum","Text on a checkbox to hash file transfers"));
+
+        QVBoxLayout* transferLayout = new QVBoxLayout();
+        transferLayout->addWidget(uploadLimitLabel);
+        transferLayout->addWidget(uploadLimit);
+        transferLayout->addWidget(hashTransfers);
+        transferGroup->setLayout(transferLayout);
+
         // theme
         QGroupBox* themeGroup = new QGroupBox(tr("Theme"));
         QLabel* smileyLabel = new QLabel(tr("Smiley Pack"));
@@ -58,9 +83,19 @@ public:
         themeLayout->addWidget(smileyPack);
         themeGroup->setLayout(themeLayout);
 
+        // debug
+        QGroupBox* debugGroup = new QGroupBox(tr("Debug"));
+        showCoreStats = new QPushButton(tr("Show Core statistics"), this);
+        showCoreStats->setToolTip(tr("Timings of the Tox loop, its callbacks and the GUI thread","describes the Core statistics button"));
+        QVBoxLayout* debugLayout = new QVBoxLayout();
+        debugLayout->addWidget(showCoreStats, 0, Qt::AlignLeft);
+        debugGroup->setLayout(debugLayout);
+
         QVBoxLayout *mainLayout = new QVBoxLayout();
         mainLayout->addWidget(group);
+        mainLayout->addWidget(transferGroup);
         mainLayout->addWidget(themeGroup);
+        mainLayout->addWidget(debugGroup);
         mainLayout->addStretch(1);
         setLayout(mainLayout);
     }
@@ -68,7 +103,10 @@ public:
     QCheckBox* enableIPv6;
     QCheckBox* useTranslations;
     QCheckBox* makeToxPortable;
+    QSpinBox* uploadLimit;
+    QCheckBox* hashTransfers;
     QComboBox* smileyPack;
+    QPushButton* showCoreStats;
 };
 
 class IdentityPage : public QWidget
@@ -135,14 +173,86 @@ public:
         camView->hide(); // hide by default
         testVideo = new QPushButton(tr("Show video preview","On a button"));
         connect(testVideo, SIGNAL(clicked()), this, SLOT(onTestVideoPressed()));
+        useOpenGLVideo = new QCheckBox(tr("Use hardware accelerated video rendering"), this);
+        useOpenGLVideo->setToolTip(tr("Lets the graphics card convert and scale video.\nTakes effect for newly opened video windows.","Tooltip of the OpenGL video checkbox"));
 
         QVBoxLayout *vLayout = new QVBoxLayout();
+        vLayout->addWidget(useOpenGLVideo);
         vLayout->addWidget(testVideo);
         vLayout->addWidget(camView);
         group->setLayout(vLayout);
 
+        QGroupBox* audioGroup = new QGroupBox(tr("Audio Settings"), this);
+        voiceDetection = new QCheckBox(tr("Don't send silence during calls"), this);
+        voiceDetection->setToolTip(tr("Saves bandwidth and CPU in long, mostly quiet calls.\nTakes effect for new calls.","Tooltip of the voice detection checkbox"));
+        QVBoxLayout* audioLayout = new QVBoxLayout();
+        audioLayout->addWidget(voiceDetection);
+        audioGroup->setLayout(audioLayout);
+
+        // what the call video may step down to on a bad link
+        QGroupBox* rateGroup = new QGroupBox(tr("Call Video Quality"), this);
+        QLabel* fpsLabel = new QLabel(tr("Frame rate","Label of the spinboxes bounding the call video frame rate"));
+        minVideoFps = new QSpinBox(this);
+        minVideoFps->setRange(1, 30);
+        minVideoFps->setPrefix(tr("min ","Prefix of the minimum video frame rate"));
+        minVideoFps->setSuffix(tr(" fps","Unit of the video frame rate"));
+        maxVideoFps = new QSpinBox(this);
+        maxVideoFps->setRange(1, 30);
+        maxVideoFps->setPrefix(tr("max ","Prefix of the maximum video frame rate"));
+        maxVideoFps->setSuffix(tr(" fps","Unit of the video frame rate"));
+        QLabel* sizeLabel = new QLabel(tr("Lowest resolution","Label of the combobox bounding the call video size"));
+        minVideoSize = new QComboBox(this);
+        for (QSize size : {QSize(160, 120), QSize(320, 240), QSize(640, 480)})
+            minVideoSize->addItem(QString("%1x%2").arg(size.width()).arg(size.height()), size);
+
+        QHBoxLayout* fpsLayout = new QHBoxLayout();
+        fpsLayout->addWidget(minVideoFps);
+        fpsLayout->addWidget(maxVideoFps);
+        QVBoxLayout* rateLayout = new QVBoxLayout();
+        rateLayout->addWidget(fpsLabel);
+        rateLayout->addLayout(fpsLayout);
+        rateLayout->addWidget(sizeLabel);
+        rateLayout->addWidget(minVideoSize);
+        rateGroup->setLayout(rateLayout);
+
+        // what we ask the device for, the list of sizes is probed when the dialog opens
+        QGroupBox* camGroup = new QGroupBox(tr("Camera"), this);
+        QLabel* camResolutionLabel = new QLabel(tr("Capture resolution","Label of the camera resolution combobox"));
+        camResolution = new QComboBox(this);
+        QLabel* camFpsLabel = new QLabel(tr("Capture frame rate","Label of the camera frame rate spinbox"));
+        camFps = new QSpinBox(this);
+        camFps->setRange(0, 60);
+        camFps->setSpecialValueText(tr("Automatic","Camera frame rate chosen by the device"));
+        camFps->setSuffix(tr(" fps","Unit of the video frame rate"));
+        QLabel* camFormatLabel = new QLabel(tr("Pixel format","Label of the camera pixel format combobox"));
+        camFormat = new QComboBox(this);
+        camFormat->addItem(tr("Automatic","Camera pixel format chosen by the device"), QString());
+        camFormat->addItem(tr("YUYV (uncompressed)"), QString("YUYV"));
+        camFormat->addItem(tr("MJPEG (compressed)"), QString("MJPG"));
+        QLabel* camReleaseLabel = new QLabel(tr("Keep the camera open","Label of the spinbox of the delay before closing the camera"));
+        camReleaseDelay = new QSpinBox(this);
+        camReleaseDelay->setRange(0, 300);
+        camReleaseDelay->setSpecialValueText(tr("Close it right away","Camera closed as soon as nobody uses it"));
+        camReleaseDelay->setSuffix(tr(" s after use","Unit of the camera release delay"));
+        camReleaseDelay->setToolTip(tr("Reopening a camera can take a few seconds"));
+        camGroup->setToolTip(tr("Takes effect the next time the camera is started"));
+
+        QVBoxLayout* camLayout = new QVBoxLayout();
+        camLayout->addWidget(camResolutionLabel);
+        camLayout->addWidget(camResolution);
+        camLayout->addWidget(camFpsLabel);
+        camLayout->addWidget(camFps);
+        camLayout->addWidget(camFormatLabel);
+        camLayout->addWidget(camFormat);
+        camLayout->addWidget(camReleaseLabel);
+        camLayout->addWidget(camReleaseDelay);
+        camGroup->setLayout(camLayout);
+
         QVBoxLayout *mainLayout = new QVBoxLayout();
+        mainLayout->addWidget(audioGroup);
         mainLayout->addWidget(group);
+        mainLayout->addWidget(camGroup);
+        mainLayout->addWidget(rateGroup);
         mainLayout->addStretch(1);
         setLayout(mainLayout);
     }
@@ -166,6 +276,11 @@ public:
 
     QPushButton* testVideo;
     SelfCamView* camView;
+    QSpinBox* minVideoFps, *maxVideoFps;
+    QComboBox* minVideoSize;
+    QCheckBox* useOpenGLVideo, *voiceDetection;
+    QComboBox* camResolution, *camFormat;
+    QSpinBox* camFps, *camReleaseDelay;
 
 public slots:
     void onTestVideoPressed()
@@ -183,6 +298,25 @@ public slots:
 
 
 
+/// Asks the camera what it can capture at, off the GUI thread
+class SettingsDialog::ResolutionProbe : public QRunnable
+{
+public:
+    ResolutionProbe(SettingsDialog* Dialog, Camera* Cam) : dialog{Dialog}, cam{Cam} {}
+
+    void run()
+    {
+        QList<QSize> resolutions = cam->getSupportedResolutions();
+        if (dialog)
+            QMetaObject::invokeMethod(dialog, "onResolutionsProbed", Qt::QueuedConnection,
+                                      Q_ARG(QList<QSize>, resolutions));
+    }
+
+private:
+    QPointer<SettingsDialog> dialog;
+    Camera* cam;
+};
+
 // =======================================
 // settings dialog
 //========================================
@@ -190,6 +324,7 @@ SettingsDialog::SettingsDialog(Widget *parent) :
     QDialog(parent),
     widget(parent)
 {
+    qRegisterMetaType<QList<QSize>>("QList<QSize>");
     createPages();
     createButtons();
     createConnections();
@@ -220,25 +355,25 @@ void SettingsDialog::createPages()
     pagesWidget->addWidget(avPage);
 
     QListWidgetItem *generalButton = new QListWidgetItem(contentsWidget);
-    generalButton->setIcon(QIcon(":/img/settings/general.png"));
+    generalButton->setIcon(Style::getIcon(":/img/settings/general.png"));
     generalButton->setText(tr("General"));
     generalButton->setTextAlignment(Qt::AlignHCenter);
     generalButton->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
 
     QListWidgetItem *identity = new QListWidgetItem(contentsWidget);
-    identity->setIcon(QIcon(":/img/settings/identity.png"));
+    identity->setIcon(Style::getIcon(":/img/settings/identity.png"));
     identity->setText(tr("Identity"));
     identity->setTextAlignment(Qt::AlignHCenter);
     identity->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
 
     QListWidgetItem *privacy = new QListWidgetItem(contentsWidget);
-    privacy->setIcon(QIcon(":/img/settings/privacy.png"));
+    privacy->setIcon(Style::getIcon(":/img/settings/privacy.png"));
     privacy->setText(tr("Privacy"));
     privacy->setTextAlignment(Qt::AlignHCenter);
     privacy->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
 
     QListWidgetItem *av = new QListWidgetItem(contentsWidget);
-    av->setIcon(QIcon(":/img/settings/av.png"));
+    av->setIcon(Style::getIcon(":/img/settings/av.png"));
     av->setText(tr("Audio/Video"));
     av->setTextAlignment(Qt::AlignHCenter);
     av->setFlags(Qt::ItemIsSelectable | Qt::ItemIsEnabled);
@@ -264,6 +399,14 @@ void SettingsDialog::createConnections()
         this,
         SLOT(changePage(QListWidgetItem*,QListWidgetItem*))
     );
+    connect(generalPage->showCoreStats, SIGNAL(clicked()), this, SLOT(showCoreStats()));
+}
+
+void SettingsDialog::showCoreStats()
+{
+    CoreStatsDialog* dialog = new CoreStatsDialog(widget->getCore(), this);
+    dialog->setAttribute(Qt::WA_DeleteOnClose);
+    dialog->show();
 }
 
 void SettingsDialog::createLayout()
@@ -318,12 +461,42 @@ void SettingsDialog::readConfig()
     generalPage->enableIPv6->setChecked(settings.getEnableIPv6());
     generalPage->useTranslations->setChecked(settings.getUseTranslations());
     generalPage->makeToxPortable->setChecked(settings.getMakeToxPortable());
+    generalPage->uploadLimit->setValue(settings.getUploadLimit());
+    generalPage->hashTransfers->setChecked(settings.getHashTransfers());
+
+    avPage->minVideoFps->setValue(settings.getMinVideoFps());
+    avPage->maxVideoFps->setValue(settings.getMaxVideoFps());
+    int sizeIndex = avPage->minVideoSize->findData(settings.getMinVideoSize());
+    avPage->minVideoSize->setCurrentIndex(sizeIndex < 0 ? 1 : sizeIndex);
+    avPage->useOpenGLVideo->setChecked(settings.getUseOpenGLVideo());
+    avPage->voiceDetection->setChecked(settings.getVoiceDetection());
+
+    // Only what's saved until the probe, opening the device takes too long for the GUI thread
+    avPage->camResolution->clear();
+    QSize camResolution = settings.getCamResolution();
+    avPage->camResolution->addItem(QString("%1x%2").arg(camResolution.width()).arg(camResolution.height()), camResolution);
+    QThreadPool::globalInstance()->start(new ResolutionProbe(this, widget->getCamera()));
+    avPage->camFps->setValue(settings.getCamFps());
+    int formatIndex = avPage->camFormat->findData(settings.getCamFormat());
+    avPage->camFormat->setCurrentIndex(formatIndex < 0 ? 0 : formatIndex);
+    avPage->camReleaseDelay->setValue(settings.getCamReleaseDelay());
 
     identityPage->userName->setText(core->getUsername());
     identityPage->statusMessage->setText(core->getStatusMessage());
     identityPage->toxID->setText(core->getSelfId().toString());
 }
 
+void SettingsDialog::onResolutionsProbed(const QList<QSize>& resolutions)
+{
+    QSize picked = avPage->camResolution->currentData().toSize();
+    avPage->camResolution->clear();
+    for (QSize size : resolutions)
+        avPage->camResolution->addItem(QString("%1x%2").arg(size.width()).arg(size.height()), size);
+    if (avPage->camResolution->findData(picked) < 0)
+        avPage->camResolution->addItem(QString("%1x%2").arg(picked.width()).arg(picked.height()), picked);
+    avPage->camResolution->setCurrentIndex(avPage->camResolution->findData(picked));
+}
+
 void SettingsDialog::writeConfig()
 {
     Settings& settings = Settings::getInstance();
@@ -347,6 +520,64 @@ void SettingsDialog::writeConfig()
         saveSettings = true;
     }
 
+    if (settings.getUploadLimit() != generalPage->uploadLimit->value()) {
+        settings.setUploadLimit(generalPage->uploadLimit->value());
+        saveSettings = true;
+    }
+
+    if (settings.getHashTransfers() != generalPage->hashTransfers->isChecked()) {
+        settings.setHashTransfers(generalPage->hashTransfers->isChecked());
+        saveSettings = true;
+    }
+
+    // the rate controller reads these when the next call starts
+    int minFps = std::min(avPage->minVideoFps->value(), avPage->maxVideoFps->value());
+    if (settings.getMinVideoFps() != minFps) {
+        settings.setMinVideoFps(minFps);
+        saveSettings = true;
+    }
+
+    if (settings.getMaxVideoFps() != avPage->maxVideoFps->value()) {
+        settings.setMaxVideoFps(avPage->maxVideoFps->value());
+        saveSettings = true;
+    }
+
+    if (settings.getMinVideoSize() != avPage->minVideoSize->currentData().toSize()) {
+        settings.setMinVideoSize(avPage->minVideoSize->currentData().toSize());
+        saveSettings = true;
+    }
+
+    if (settings.getVoiceDetection() != avPage->voiceDetection->isChecked()) {
+        settings.setVoiceDetection(avPage->voiceDetection->isChecked());
+        saveSettings = true;
+    }
+
+    if (settings.getUseOpenGLVideo() != avPage->useOpenGLVideo->isChecked()) {
+        settings.setUseOpenGLVideo(avPage->useOpenGLVideo->isChecked());
+        saveSettings = true;
+    }
+
+    // the camera reads these when it's next opened
+    if (settings.getCamResolution() != avPage->camResolution->currentData().toSize()) {
+        settings.setCamResolution(avPage->camResolution->currentData().toSize());
+        saveSettings = true;
+    }
+
+    if (settings.getCamFps() != avPage->camFps->value()) {
+        settings.setCamFps(avPage->camFps->value());
+        saveSettings = true;
+    }
+
+    if (settings.getCamFormat() != avPage->camFormat->currentData().toString()) {
+        settings.setCamFormat(avPage->camFormat->currentData().toString());
+        saveSettings = true;
+    }
+
+    if (settings.getCamReleaseDelay() != avPage->camReleaseDelay->value()) {
+        settings.setCamReleaseDelay(avPage->camReleaseDelay->value());
+        saveSettings = true;
+    }
+
     if (settings.getSmileyPack() != generalPage->smileyPack->currentData().toString()) {
         settings.setSmileyPack(generalPage->smileyPack->currentData().toString());
         saveSettings = true;
@@ -38,8 +38,13 @@ public slots:
     void okPressed();
     void cancelPressed();
     void applyPressed();
+    void showCoreStats();
+
+private slots:
+    void onResolutionsProbed(const QList<QSize>& resolutions); ///< Fills the combobox, keeping what's picked
 
 private:
+    class ResolutionProbe;
     void createPages();
     void createButtons();
     void createConnections();
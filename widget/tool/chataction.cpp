@@ -15,29 +15,15 @@
 */
 
 #include "chataction.h"
-#include "smileypack.h"
-#include <QStringList>
-#include <QBuffer>
+#include "messageformatter.h"
 #include "filetransferinstance.h"
+#include <QTextDocument>
+#include <QTextCursor>
+#include <QAbstractTextDocumentLayout>
 
 QString ChatAction::toHtmlChars(const QString &str)
 {
-    static QList<QPair<QString, QString>> replaceList = {{"&","&amp;"}, {">","&gt;"}, {"<","&lt;"}};
-    QString res = str;
-
-    for (auto &it : replaceList)
-        res = res.replace(it.first,it.second);
-
-    return res;
-}
-
-QString ChatAction::QImage2base64(const QImage &img)
-{
-    QByteArray ba;
-    QBuffer buffer(&ba);
-    buffer.open(QIODevice::WriteOnly);
-    img.save(&buffer, "PNG"); // writes image into ba in PNG format
-    return ba.toBase64();
+    return MessageFormatter::escape(str);
 }
 
 QString ChatAction::getName()
@@ -54,61 +40,20 @@ QString ChatAction::getDate()
     return res;
 }
 
-MessageAction::MessageAction(const QString &author, const QString &message, const QString &date, const bool &me) :
-    ChatAction(me, author, date),
-    message(message)
+void ChatAction::writeMessage(QTextDocument* doc)
 {
+    doc->setHtml(getMessage());
 }
 
-void MessageAction::setTextCursor(QTextCursor cursor)
+MessageAction::MessageAction(const QString &author, const QString &message, const QString &date, const bool &me) :
+    ChatAction(me, author, date),
+    message(message)
 {
-    // When this function is called, we're supposed to only update ourselve when needed
-    // Nobody should ask us to do anything with our content, we're on our own
-    // Except we never udpate on our own, so we can safely free our resources
-
-    (void) cursor;
-    message.clear();
-    message.squeeze();
-    name.clear();
-    name.squeeze();
-    date.clear();
-    date.squeeze();
 }
 
 QString MessageAction::getMessage()
 {
-    QString message_ = SmileyPack::getInstance().smileyfied(toHtmlChars(message));
-
-    // detect urls
-    QRegExp exp("(www\\.|http[s]?:\\/\\/|ftp:\\/\\/)\\S+");
-    int offset = 0;
-    while ((offset = exp.indexIn(message_, offset)) != -1)
-    {
-        QString url = exp.cap();
-
-        // add scheme if not specified
-        if (exp.cap(1) == "www.")
-            url.prepend("http://");
-
-        QString htmledUrl = QString("<a href=\"%1\">%1</a>").arg(url);
-        message_.replace(offset, exp.cap().length(), htmledUrl);
-
-        offset += htmledUrl.length();
-    }
-
-    // detect text quotes
-    QStringList messageLines = message_.split("\n");
-    message_ = "";
-    for (QString& s : messageLines)
-    {
-        if (QRegExp("^[ ]*&gt;.*").exactMatch(s))
-            message_ += "<span class=quote>>" + s.right(s.length()-4) + "</span><br/>";
-        else
-            message_ += s + "<br/>";
-    }
-    message_ = message_.left(message_.length()-4);
-
-    return QString("<div class=message>" + message_ + "</div>");
+    return MessageFormatter::toHtml(message);
 }
 
 FileTransferAction::FileTransferAction(FileTransferInstance *widget, const QString &author, const QString &date, const bool &me) :
@@ -116,7 +61,8 @@ FileTransferAction::FileTransferAction(FileTransferInstance *widget, const QStri
 {
     w = widget;
 
-    connect(w, &FileTransferInstance::stateUpdated, this, &FileTransferAction::updateHtml);
+    connect(w, &FileTransferInstance::stateUpdated, this, &ChatAction::contentChanged);
+    connect(w, &FileTransferInstance::progressUpdated, this, &ChatAction::repaintNeeded);
 }
 
 FileTransferAction::~FileTransferAction()
@@ -127,43 +73,50 @@ QString FileTransferAction::getMessage()
 {
     QString widgetHtml;
     if (w != nullptr)
-        widgetHtml = w->getHtmlImage();
+        widgetHtml = toHtmlChars(w->getText()).replace("\n", "<br>");
     else
         widgetHtml = "<div class=quote>EMPTY CONTENT</div>";
     return widgetHtml;
 }
 
-void FileTransferAction::setTextCursor(QTextCursor cursor)
+QString FileTransferAction::getPlainMessage()
+{
+    return w != nullptr ? w->getText() : QString();
+}
+
+void FileTransferAction::writeMessage(QTextDocument* doc)
+{
+    if (w == nullptr)
+        return ChatAction::writeMessage(doc);
+
+    doc->documentLayout()->registerHandler(ObjectType, this);
+    QTextCharFormat format;
+    format.setObjectType(ObjectType);
+    QTextCursor(doc).insertText(QString(QChar::ObjectReplacementCharacter), format);
+}
+
+int FileTransferAction::buttonAt(const QPointF& pos)
+{
+    if (w == nullptr)
+        return FileTransferInstance::NoButton;
+    return w->buttonAt(pos, objectRect);
+}
+
+void FileTransferAction::pressButton(int button)
+{
+    if (w != nullptr)
+        w->pressButton(button);
+}
+
+QSizeF FileTransferAction::intrinsicSize(QTextDocument* doc, int, const QTextFormat&)
 {
-    cur = cursor;
-    cur.setKeepPositionOnInsert(true);
-    int end=cur.selectionEnd();
-    cur.setPosition(cur.position());
-    cur.setPosition(end, QTextCursor::KeepAnchor);
+    // As wide as the row, what doesn't fit in the text is elided
+    qreal width = doc->textWidth() > 0 ? doc->textWidth() - 2*doc->documentMargin() : 300;
+    return QSizeF(width, w->getHeight(doc->defaultFont()));
 }
 
-void FileTransferAction::updateHtml()
+void FileTransferAction::drawObject(QPainter* painter, const QRectF& rect, QTextDocument* doc, int, const QTextFormat&)
 {
-    if (cur.isNull())
-        return;
-
-    int pos = cur.selectionStart();
-    cur.removeSelectedText();
-    cur.setKeepPositionOnInsert(false);
-    cur.insertHtml(getMessage());
-    cur.setKeepPositionOnInsert(true);
-    int end = cur.position();
-    cur.setPosition(pos);
-    cur.setPosition(end, QTextCursor::KeepAnchor);
-
-    // Free our ressources if we'll never need to update again
-    if (w->getState() == FileTransferInstance::TransfState::tsCanceled
-            || w->getState() == FileTransferInstance::TransfState::tsFinished)
-    {
-        name.clear();
-        name.squeeze();
-        date.clear();
-        date.squeeze();
-        cur = QTextCursor();
-    }
+    objectRect = rect;
+    w->draw(painter, rect, doc->defaultFont());
 }
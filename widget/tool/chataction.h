@@ -18,24 +18,39 @@
 #define CHATACTION_H
 
 #include <QString>
-#include <QTextCursor>
+#include <QObject>
+#include <QRectF>
+#include <QTextObjectInterface>
 
 class FileTransferInstance;
+class QTextDocument;
 
+/// A row of the chat area. The view asks for the HTML only while the row is on screen
 class ChatAction : public QObject
 {
+    Q_OBJECT
 public:
     ChatAction(const bool &me, const QString &author, const QString &date) : isMe(me), name(author), date(date) {;}
     virtual ~ChatAction(){;}
-    virtual void setTextCursor(QTextCursor cursor){(void)cursor;} ///< Call once, and then you MUST let the object update itself
 
     virtual QString getName();
     virtual QString getMessage() = 0;
     virtual QString getDate();
+    virtual QString getPlainMessage() = 0; ///< What the row is spilled to disk as, it comes back as a MessageAction
+    QString getAuthor() {return name;}
+    bool isMine() {return isMe;}
+    virtual void writeMessage(QTextDocument* doc); ///< Fills the row's document, with the HTML of getMessage by default
+    virtual bool isObject() {return false;} ///< The document is a single embedded object, selected whole or not at all
+    virtual bool hasButtons() {return false;} ///< Only these rows go in the view's hit map
+    virtual int buttonAt(const QPointF& pos) {Q_UNUSED(pos); return -1;} ///< Of an embedded object, in document coordinates
+    virtual void pressButton(int button) {Q_UNUSED(button);}
+
+signals:
+    void contentChanged(); ///< The view lays the row out again
+    void repaintNeeded(); ///< The row looks different but keeps its layout
 
 protected:
     QString toHtmlChars(const QString &str);
-    QString QImage2base64(const QImage &img);
 
 protected:
     bool isMe;
@@ -48,27 +63,37 @@ public:
     MessageAction(const QString &author, const QString &message, const QString &date, const bool &me);
     virtual ~MessageAction(){;}
     virtual QString getMessage();
-    virtual void setTextCursor(QTextCursor cursor) final;
+    virtual QString getPlainMessage() {return message;}
 
 private:
     QString message;
 };
 
-class FileTransferAction : public ChatAction
+/// Painted by its FileTransferInstance as an object of the row's document, so progress updates
+/// are just repaints and nothing gets encoded into HTML
+class FileTransferAction : public ChatAction, public QTextObjectInterface
 {
     Q_OBJECT
+    Q_INTERFACES(QTextObjectInterface)
 public:
+    enum {ObjectType = QTextFormat::UserObject + 1};
+
     FileTransferAction(FileTransferInstance *widget, const QString &author, const QString &date, const bool &me);
     virtual ~FileTransferAction();
-    virtual QString getMessage();
-    virtual void setTextCursor(QTextCursor cursor) final;
+    virtual QString getMessage(); ///< The text of the transfer, the view paints the object instead
+    virtual QString getPlainMessage();
+    virtual void writeMessage(QTextDocument* doc);
+    virtual bool isObject() {return true;}
+    virtual bool hasButtons() {return true;}
+    virtual int buttonAt(const QPointF& pos);
+    virtual void pressButton(int button);
 
-private slots:
-    void updateHtml();
+    virtual QSizeF intrinsicSize(QTextDocument* doc, int posInDocument, const QTextFormat& format);
+    virtual void drawObject(QPainter* painter, const QRectF& rect, QTextDocument* doc, int posInDocument, const QTextFormat& format);
 
 private:
     FileTransferInstance *w;
-    QTextCursor cur;
+    QRectF objectRect; ///< Where we were last drawn
 };
 
 #endif // CHATACTION_H
@@ -0,0 +1,59 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "mentionmatcher.h"
+
+MentionMatcher::MentionMatcher()
+{
+}
+
+void MentionMatcher::setTerms(const QStringList& newTerms)
+{
+    QStringList cleaned;
+    for (const QString& term : newTerms)
+    {
+        QString t = term.trimmed();
+        if (!t.isEmpty() && !cleaned.contains(t, Qt::CaseInsensitive))
+            cleaned << t;
+    }
+    if (cleaned == terms)
+        return;
+    terms = cleaned;
+
+    if (terms.isEmpty())
+    {
+        pattern = QRegularExpression();
+        return;
+    }
+
+    QStringList escaped;
+    for (const QString& term : terms)
+        escaped << QRegularExpression::escape(term);
+    pattern = QRegularExpression(escaped.join('|'), QRegularExpression::CaseInsensitiveOption
+                                 | QRegularExpression::UseUnicodePropertiesOption);
+}
+
+QStringList MentionMatcher::getTerms() const
+{
+    return terms;
+}
+
+bool MentionMatcher::matches(const QString& message) const
+{
+    if (terms.isEmpty())
+        return false;
+    return pattern.match(message).hasMatch();
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef MENTIONMATCHER_H
+#define MENTIONMATCHER_H
+
+#include <QStringList>
+#include <QRegularExpression>
+
+/// Finds the user's name and highlight words in group messages. Every term goes in one
+/// case insensitive alternation compiled when the terms change, so a message is scanned once
+/// whatever the number of terms, instead of once per term with a string search.
+class MentionMatcher
+{
+public:
+    MentionMatcher();
+    void setTerms(const QStringList& terms); ///< Empty terms are ignored, recompiles only if they changed
+    QStringList getTerms() const;
+    bool matches(const QString& message) const;
+
+private:
+    QStringList terms;
+    QRegularExpression pattern;
+};
+
+#endif // MENTIONMATCHER_H
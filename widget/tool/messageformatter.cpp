@@ -0,0 +1,243 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "messageformatter.h"
+#include "smileypack.h"
+#include <QStringList>
+#include <QRegExp>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+static const QLatin1String urlPrefixes[] = {QLatin1String("www."), QLatin1String("http://"),
+                                            QLatin1String("https://"), QLatin1String("ftp://")};
+
+void MessageFormatter::appendEscaped(QString& out, const QChar* begin, const QChar* end)
+{
+    const QChar* run = begin;
+    for (const QChar* c = begin; c != end; c++)
+    {
+        const char* entity;
+        switch (c->unicode())
+        {
+            case '&': entity = "&amp;"; break;
+            case '<': entity = "&lt;"; break;
+            case '>': entity = "&gt;"; break;
+            case '"': entity = "&quot;"; break;
+            default: continue;
+        }
+        out.append(run, c - run);
+        out.append(QLatin1String(entity));
+        run = c + 1;
+    }
+    out.append(run, end - run);
+}
+
+QString MessageFormatter::escape(const QString& text)
+{
+    QString out;
+    out.reserve(text.size());
+    appendEscaped(out, text.constData(), text.constData() + text.size());
+    return out;
+}
+
+const QChar* MessageFormatter::findUrl(const QChar* begin, const QChar* end, bool& needsScheme)
+{
+    for (const QChar* c = begin; c != end; c++)
+    {
+        ushort u = c->unicode();
+        if (u != 'w' && u != 'h' && u != 'f')
+            continue;
+        for (const QLatin1String& prefix : urlPrefixes)
+        {
+            int length = prefix.size();
+            if (end - c <= length)
+                continue;
+            int i = 0;
+            while (i < length && c[i].unicode() == (uchar)prefix.latin1()[i])
+                i++;
+            if (i == length)
+            {
+                needsScheme = prefix.latin1()[0] == 'w';
+                return c;
+            }
+        }
+    }
+    return end;
+}
+
+void MessageFormatter::appendWord(QString& out, const QChar* begin, const QChar* end)
+{
+    // Emoticons can be anywhere in the word, "hi:)" has one
+    const SmileyPack& smileys = SmileyPack::getInstance();
+    const QChar* run = begin;
+    for (const QChar* c = begin; c != end;)
+    {
+        int image;
+        int length = smileys.matchAt(c, begin, end, image);
+        if (!length)
+        {
+            c++;
+            continue;
+        }
+        appendEscaped(out, run, c);
+        out += SmileyPack::getImageRichText(image);
+        c += length;
+        run = c;
+    }
+    appendEscaped(out, run, end);
+}
+
+void MessageFormatter::appendLine(QString& out, const QChar* begin, const QChar* end)
+{
+    const QChar* c = begin;
+    while (c != end)
+    {
+        if (c->isSpace())
+        {
+            out += *c++;
+            continue;
+        }
+        const QChar* wordEnd = c;
+        while (wordEnd != end && !wordEnd->isSpace())
+            wordEnd++;
+
+        bool needsScheme;
+        const QChar* url = findUrl(c, wordEnd, needsScheme);
+        appendWord(out, c, url);
+        if (url != wordEnd)
+        {
+            QString href;
+            if (needsScheme)
+                href = "http://";
+            appendEscaped(href, url, wordEnd);
+            out += "<a href=\"" + href + "\">" + href + "</a>";
+        }
+        c = wordEnd;
+    }
+}
+
+QString MessageFormatter::toHtml(const QString& message)
+{
+    QString out;
+    out.reserve(message.size() + message.size()/8 + 32);
+    out += "<div class=message>";
+
+    const QChar* data = message.constData();
+    const QChar* end = data + message.size();
+    const QChar* line = data;
+    while (true)
+    {
+        const QChar* lineEnd = line;
+        while (lineEnd != end && *lineEnd != '\n')
+            lineEnd++;
+
+        const QChar* first = line;
+        while (first != lineEnd && *first == ' ')
+            first++;
+        bool quote = first != lineEnd && *first == '>';
+        if (quote)
+            out += "<span class=quote>";
+        appendLine(out, line, lineEnd);
+        if (quote)
+            out += "</span>";
+
+        if (lineEnd == end)
+            break;
+        out += "<br/>";
+        line = lineEnd + 1;
+    }
+
+    out += "</div>";
+    return out;
+}
+
+/// What MessageAction::getMessage did before, for the benchmark
+static QString legacyFormat(const QString& message)
+{
+    QString message_ = message;
+    static QList<QPair<QString, QString>> replaceList = {{"&","&amp;"}, {">","&gt;"}, {"<","&lt;"}};
+    for (auto &it : replaceList)
+        message_ = message_.replace(it.first,it.second);
+    message_ = SmileyPack::getInstance().smileyfied(message_);
+
+    QRegExp exp("(www\\.|http[s]?:\\/\\/|ftp:\\/\\/)\\S+");
+    int offset = 0;
+    while ((offset = exp.indexIn(message_, offset)) != -1)
+    {
+        QString url = exp.cap();
+        if (exp.cap(1) == "www.")
+            url.prepend("http://");
+        QString htmledUrl = QString("<a href=\"%1\">%1</a>").arg(url);
+        message_.replace(offset, exp.cap().length(), htmledUrl);
+        offset += htmledUrl.length();
+    }
+
+    QStringList messageLines = message_.split("\n");
+    message_ = "";
+    for (QString& s : messageLines)
+    {
+        if (QRegExp("^[ ]*&gt;.*").exactMatch(s))
+            message_ += "<span class=quote>>" + s.right(s.length()-4) + "</span><br/>";
+        else
+            message_ += s + "<br/>";
+    }
+    message_ = message_.left(message_.length()-4);
+    return QString("<div class=message>" + message_ + "</div>");
+}
+
+int MessageFormatter::benchmark()
+{
+    QTextStream out(stdout);
+
+    // The kinds of messages we see, and a pasted log
+    QStringList chat = {
+        "hi", "hey, how are you? :)", "lol", "ok", "brb 5 min",
+        "did you see https://github.com/tux3/qTox/pull/123 yet?",
+        "> I think the build is broken\nyes, since the merge :(",
+        "check www.example.com/some/long/path?with=query&and=params#fragment",
+        "<script>alert(\"no\")</script> & other things that need escaping",
+        "So I tried compiling it with the new toolchain and it failed at link time, "
+        "something about missing symbols in libsodium. Had to rebuild it from source :/ :D ;)",
+    };
+    QString paste;
+    for (int i=0; i<2000; i++)
+        paste += QString("[%1] DEBUG core.cpp:%2 > bootstrap node 144.76.60.215:33445 http://tox.im %3 :)\n")
+                    .arg(i).arg(100 + i % 300).arg(QString(i % 40, 'x'));
+    struct Corpus {const char* name; QStringList messages; int iterations;};
+    const Corpus corpora[] = {{"chat", chat, 2000}, {"pasted log", QStringList{paste}, 5}};
+
+    for (const Corpus& corpus : corpora)
+    {
+        int chars = 0;
+        for (const QString& message : corpus.messages)
+            chars += message.size();
+
+        double times[2];
+        for (int impl=0; impl<2; impl++)
+        {
+            QElapsedTimer timer;
+            timer.start();
+            for (int i=0; i<corpus.iterations; i++)
+                for (const QString& message : corpus.messages)
+                    impl ? toHtml(message) : legacyFormat(message);
+            times[impl] = timer.nsecsElapsed() / 1e6 / corpus.iterations;
+            out << corpus.name << (impl ? " single pass: " : " regexps: ") << QString::number(times[impl], 'f', 3)
+                << " ms for " << chars << " chars\n";
+        }
+        out << corpus.name << ": " << QString::number(times[0] / times[1], 'f', 2) << "x faster\n";
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef MESSAGEFORMATTER_H
+#define MESSAGEFORMATTER_H
+
+#include <QString>
+
+/// Turns a chat message into the HTML of the chat area in one pass over the text:
+/// escaping, links, quoted lines and smileys are all found by the same scan, without regexps.
+/// Smileys are referenced by smiley: URLs, documents showing them get the images from SmileyPack.
+class MessageFormatter
+{
+public:
+    static QString toHtml(const QString& message); ///< Wrapped in a div of class message
+    static QString escape(const QString& text);
+    static void appendEscaped(QString& out, const QChar* begin, const QChar* end);
+    static int benchmark(); ///< Times us against the old regexp formatter on a corpus of messages
+
+private:
+    static void appendLine(QString& out, const QChar* begin, const QChar* end);
+    static void appendWord(QString& out, const QChar* begin, const QChar* end);
+    static const QChar* findUrl(const QChar* begin, const QChar* end, bool& needsScheme);
+};
+
+#endif // MESSAGEFORMATTER_H
@@ -0,0 +1,76 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "visibility.h"
+#include <QEvent>
+#include <QPointer>
+#include <QWidget>
+#include <QWindow>
+
+namespace
+{
+/// Filters the events of the widget's window, and follows the widget when it's reparented
+class Watcher : public QObject
+{
+public:
+    Watcher(QWidget* Widget, const char* Slot) : QObject(Widget), widget{Widget}, slot{Slot}
+    {
+        widget->installEventFilter(this);
+        watchWindow();
+    }
+
+    bool eventFilter(QObject* object, QEvent* event)
+    {
+        if (object == widget && event->type() == QEvent::ParentChange)
+            watchWindow();
+        if (object == window && ((event->type() == QEvent::WindowStateChange && !window->isMinimized())
+                                 || event->type() == QEvent::Show))
+            QMetaObject::invokeMethod(widget, slot, Qt::QueuedConnection);
+        return false;
+    }
+
+private:
+    void watchWindow()
+    {
+        if (window && window != widget)
+            window->removeEventFilter(this);
+        window = widget->window();
+        if (window != widget)
+            window->installEventFilter(this);
+    }
+
+private:
+    QWidget* widget;
+    const char* slot;
+    QPointer<QWidget> window;
+};
+}
+
+bool Visibility::isOnScreen(const QWidget* widget)
+{
+    if (!widget->isVisible())
+        return false;
+    const QWidget* window = widget->window();
+    if (window->isMinimized())
+        return false;
+    QWindow* handle = window->windowHandle();
+    return !handle || handle->isExposed();
+}
+
+void Visibility::watch(QWidget* widget, const char* slot)
+{
+    new Watcher(widget, slot);
+}
@@ -0,0 +1,34 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VISIBILITY_H
+#define VISIBILITY_H
+
+class QWidget;
+
+/// Whether the user can see a widget, so views don't convert and lay out what nobody looks at
+class Visibility
+{
+public:
+    /// Visible, in a window that isn't minimized and that the window system shows. Whether a
+    /// fully covered window counts as shown is up to the window system and compositor
+    static bool isOnScreen(const QWidget* widget);
+    /// Calls the widget's slot, queued, when its window comes back from being minimized or hidden.
+    /// Only top-level widgets get those events, so this watches the window the widget is in
+    static void watch(QWidget* widget, const char* slot);
+};
+
+#endif // VISIBILITY_H
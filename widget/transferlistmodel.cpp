@@ -0,0 +1,161 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "transferlistmodel.h"
+#include "transferhistory.h"
+#include "filetransferinstance.h"
+#include "style.h"
+#include <QFileInfo>
+#include <QMimeDatabase>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
+
+/// QMimeDatabase may be used from any thread, QIcon may not, so only the theme names are found here
+class TransferListModel::IconTask : public QRunnable
+{
+public:
+    IconTask(TransferListModel* Owner, const QStringList& Suffixes) : owner{Owner}, suffixes{Suffixes} {}
+
+    void run()
+    {
+        QMimeDatabase db;
+        QStringList iconNames, genericNames;
+        for (const QString& suffix : suffixes)
+        {
+            QMimeType type = db.mimeTypeForFile("file." + suffix, QMimeDatabase::MatchExtension);
+            iconNames << type.iconName();
+            genericNames << type.genericIconName();
+        }
+        QMetaObject::invokeMethod(owner, "onIconsResolved", Qt::QueuedConnection, Q_ARG(QStringList, suffixes),
+                                  Q_ARG(QStringList, iconNames), Q_ARG(QStringList, genericNames));
+    }
+
+private:
+    TransferListModel* owner; ///< Lives as long as FilesForm, which lives until we quit
+    QStringList suffixes;
+};
+
+TransferListModel::TransferListModel(bool Sending, QObject* parent)
+    : QAbstractListModel(parent), sending{Sending}
+{
+    TransferHistory& history = TransferHistory::getInstance();
+    connect(&history, &TransferHistory::entriesAdded, this, &TransferListModel::onEntriesAdded);
+    onEntriesAdded(0, history.getEntries().size());
+}
+
+int TransferListModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+QVariant TransferListModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size())
+        return QVariant();
+    const TransferHistory::Entry& entry = TransferHistory::getInstance().getEntries()[rows[rows.size() - 1 - index.row()]];
+
+    switch (role)
+    {
+    case Qt::DisplayRole:
+        return QString("%1\n%2, %3, %4").arg(entry.fileName, entry.peerName,
+                                             FileTransferInstance::getHumanReadableSize(entry.size),
+                                             entry.time.toString(Qt::SystemLocaleShortDate));
+    case Qt::ToolTipRole:
+        return entry.path;
+    case Qt::DecorationRole:
+        return iconFor(entry.fileName);
+    case PathRole:
+        return entry.path;
+    default:
+        return QVariant();
+    }
+}
+
+void TransferListModel::setFilter(const QString& text)
+{
+    QStringList newWords = text.split(' ', QString::SkipEmptyParts);
+    if (newWords == words)
+        return;
+
+    beginResetModel();
+    words = newWords;
+    rows.clear();
+    const TransferHistory::Entries& entries = TransferHistory::getInstance().getEntries();
+    for (int i=0; i<entries.size(); i++)
+        if (entries[i].sending == sending && matches(i))
+            rows.append(i);
+    endResetModel();
+}
+
+bool TransferListModel::matches(int entry) const
+{
+    const TransferHistory::Entry& e = TransferHistory::getInstance().getEntries()[entry];
+    for (const QString& word : words)
+        if (!e.path.contains(word, Qt::CaseInsensitive) && !e.peerName.contains(word, Qt::CaseInsensitive))
+            return false;
+    return true;
+}
+
+void TransferListModel::onEntriesAdded(int first, int count)
+{
+    const TransferHistory::Entries& entries = TransferHistory::getInstance().getEntries();
+    QVector<int> added;
+    for (int i=first; i<first+count; i++)
+        if (entries[i].sending == sending && matches(i))
+            added.append(i);
+    if (added.isEmpty())
+        return;
+
+    // Newest first, what's added goes on top
+    beginInsertRows(QModelIndex(), 0, added.size()-1);
+    rows += added;
+    endInsertRows();
+}
+
+QIcon TransferListModel::iconFor(const QString& fileName) const
+{
+    QString suffix = QFileInfo(fileName).suffix().toLower();
+    auto it = icons.find(suffix);
+    if (it != icons.end())
+        return *it;
+
+    QIcon generic = Style::getIcon(":/ui/acceptFileButton/default.png");
+    icons.insert(suffix, generic);
+    if (suffix.isEmpty())
+        return generic;
+    // Every suffix the view asks for while it paints goes in the same lookup
+    if (unresolved.isEmpty())
+        QTimer::singleShot(0, const_cast<TransferListModel*>(this), SLOT(resolveIcons()));
+    unresolved << suffix;
+    return generic;
+}
+
+void TransferListModel::resolveIcons()
+{
+    QThreadPool::globalInstance()->start(new IconTask(this, unresolved));
+    unresolved.clear();
+}
+
+void TransferListModel::onIconsResolved(const QStringList& suffixes, const QStringList& iconNames, const QStringList& genericNames)
+{
+    QIcon generic = Style::getIcon(":/ui/acceptFileButton/default.png");
+    for (int i=0; i<suffixes.size(); i++)
+        icons[suffixes[i]] = QIcon::fromTheme(iconNames[i], QIcon::fromTheme(genericNames[i], generic));
+    // Only the rows on screen are painted again
+    if (!rows.isEmpty())
+        emit dataChanged(index(0), index(rows.size()-1), QVector<int>() << Qt::DecorationRole);
+}
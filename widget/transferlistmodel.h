@@ -0,0 +1,65 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef TRANSFERLISTMODEL_H
+#define TRANSFERLISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QIcon>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+/// The uploads or the downloads of the TransferHistory, newest first, for a QListView.
+/// A row only stores its index in the history, the text is made when the view asks for it, so thousands
+/// of transfers cost a vector of ints. File type icons are looked up by suffix on a worker, rows show the
+/// generic icon until theirs is known. Call from the GUI thread only.
+class TransferListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    enum Role
+    {
+        PathRole = Qt::UserRole
+    };
+
+    explicit TransferListModel(bool sending, QObject* parent = 0);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    void setFilter(const QString& text); ///< Every word must be in the file's name, path or peer, case insensitive
+
+private slots:
+    void onEntriesAdded(int first, int count);
+    void resolveIcons(); ///< Of the suffixes the view asked for since the last time
+    void onIconsResolved(const QStringList& suffixes, const QStringList& iconNames, const QStringList& genericNames);
+
+private:
+    bool matches(int entry) const;
+    QIcon iconFor(const QString& fileName) const; ///< Queues the lookup the first time a suffix is seen
+
+private:
+    class IconTask;
+    bool sending;
+    QStringList words;
+    QVector<int> rows; ///< Indexes in TransferHistory::getEntries, oldest first
+    mutable QHash<QString, QIcon> icons; ///< By lowercase suffix, the generic icon while it's resolved
+    mutable QStringList unresolved;
+};
+
+#endif // TRANSFERLISTMODEL_H
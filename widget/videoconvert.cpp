@@ -0,0 +1,859 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoconvert.h"
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QVector>
+#include <algorithm>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define VIDEOCONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#elif (defined(__ARM_NEON) || defined(__ARM_NEON__)) && (!defined(__BYTE_ORDER__) || __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#define VIDEOCONVERT_NEON
+#include <arm_neon.h>
+#endif
+
+// GCC and Clang only let us use the intrinsics of an instruction set in functions built for it
+#if defined(VIDEOCONVERT_X86) && defined(__GNUC__)
+#define VIDEOCONVERT_TARGET(isa) __attribute__((target(isa)))
+#else
+#define VIDEOCONVERT_TARGET(isa)
+#endif
+
+namespace
+{
+/// Converts count pixels of a pair of rows to I420, returns how many it did.
+/// The scalar one does them all, the vectorized ones leave a tail of less than a vector.
+typedef int (*BgrToI420Rows)(const uint8_t* row0, const uint8_t* row1, int count,
+                             uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v);
+/// Blends row b into row a, weight is in 1/256 and never 0
+typedef int (*BlendRows)(const uint8_t* a, const uint8_t* b, int weight, uint8_t* out, int count);
+/// Converts a row of full resolution Y, Cb and Cr to RGB32
+typedef int (*YuvToRgb32Row)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst, int count);
+
+inline uint8_t bgrLuma(const uint8_t* p)
+{
+    return ((66*p[2] + 129*p[1] + 25*p[0]) >> 8) + 16;
+}
+
+/// The reference, y1 may be null for the last row of an odd height. The chroma sums of four
+/// pixels have two more bits than a pixel, hence the shift by 10. They can't leave [16,240]
+int bgrToI420RowsScalar(const uint8_t* row0, const uint8_t* row1, int count,
+                        uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    for (int x=0; x<count; x+=2)
+    {
+        int x1 = x+1 < count ? x+1 : x;
+        const uint8_t *a = row0 + 3*x, *b = row0 + 3*x1, *c = row1 + 3*x, *d = row1 + 3*x1;
+        y0[x] = bgrLuma(a);
+        y0[x1] = bgrLuma(b);
+        if (y1)
+        {
+            y1[x] = bgrLuma(c);
+            y1[x1] = bgrLuma(d);
+        }
+        int B = a[0] + b[0] + c[0] + d[0];
+        int G = a[1] + b[1] + c[1] + d[1];
+        int R = a[2] + b[2] + c[2] + d[2];
+        u[x/2] = ((-38*R - 74*G + 112*B) >> 10) + 128;
+        v[x/2] = ((112*R - 94*G - 18*B) >> 10) + 128;
+    }
+    return count;
+}
+
+int blendRowsScalar(const uint8_t* a, const uint8_t* b, int weight, uint8_t* out, int count)
+{
+    for (int x=0; x<count; x++)
+        out[x] = (a[x]*(256-weight) + b[x]*weight + 128) >> 8;
+    return count;
+}
+
+inline uint32_t clampByte(int value)
+{
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+int yuvToRgb32RowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst, int count)
+{
+    for (int x=0; x<count; x++)
+    {
+        int Y = y[x], Cb = u[x] - 128, Cr = v[x] - 128;
+        int r = Y + ((1436 * Cr) >> 10),
+            g = Y - ((354 * Cb + 732 * Cr) >> 10),
+            b = Y + ((1814 * Cb) >> 10);
+        dst[x] = 0xFF000000 | (clampByte(r) << 16) | (clampByte(g) << 8) | clampByte(b);
+    }
+    return count;
+}
+
+#ifdef VIDEOCONVERT_X86
+/// pshufb masks gathering channel c of 16 packed BGR pixels from the register r of the three they span
+alignas(16) const int8_t bgrDeinterleave[3][3][16] = {
+    {{0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13}},
+    {{1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14}},
+    {{2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1},
+     {-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15}}};
+
+VIDEOCONVERT_TARGET("ssse3")
+inline __m128i bgrChannel(__m128i a0, __m128i a1, __m128i a2, int c)
+{
+    const __m128i* m = reinterpret_cast<const __m128i*>(bgrDeinterleave[c]);
+    return _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, _mm_load_si128(m)),
+                                     _mm_shuffle_epi8(a1, _mm_load_si128(m+1))),
+                        _mm_shuffle_epi8(a2, _mm_load_si128(m+2)));
+}
+
+VIDEOCONVERT_TARGET("ssse3")
+inline void ssse3Deinterleave(const uint8_t* p, __m128i& b, __m128i& g, __m128i& r)
+{
+    __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+16));
+    __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+32));
+    b = bgrChannel(a0, a1, a2, 0);
+    g = bgrChannel(a0, a1, a2, 1);
+    r = bgrChannel(a0, a1, a2, 2);
+}
+
+/// 8 lumas from 16 bit channels, the sum can exceed 32767 but never 65535 so unsigned shifts work
+VIDEOCONVERT_TARGET("ssse3")
+inline __m128i ssse3Luma(__m128i b, __m128i g, __m128i r)
+{
+    __m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(r, _mm_set1_epi16(66)),
+                                              _mm_mullo_epi16(g, _mm_set1_epi16(129))),
+                                _mm_mullo_epi16(b, _mm_set1_epi16(25)));
+    return _mm_add_epi16(_mm_srli_epi16(sum, 8), _mm_set1_epi16(16));
+}
+
+VIDEOCONVERT_TARGET("ssse3")
+inline void ssse3StoreLuma(uint8_t* dst, __m128i b, __m128i g, __m128i r)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = ssse3Luma(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(r, zero));
+    __m128i hi = ssse3Luma(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(r, zero));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_packus_epi16(lo, hi));
+}
+
+/// 4 chromas from the 2x2 sums, in 32 bits since the products don't fit 16
+VIDEOCONVERT_TARGET("ssse3")
+inline __m128i ssse3Chroma(__m128i rg, __m128i b0, __m128i crg, __m128i cb0)
+{
+    return _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(rg, crg), _mm_madd_epi16(b0, cb0)), 10);
+}
+
+VIDEOCONVERT_TARGET("ssse3")
+int bgrToI420RowsSsse3(const uint8_t* row0, const uint8_t* row1, int count,
+                       uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    const __m128i zero = _mm_setzero_si128(), ones = _mm_set1_epi8(1), bias = _mm_set1_epi16(128);
+    const __m128i uRG = _mm_setr_epi16(-38, -74, -38, -74, -38, -74, -38, -74), uB = _mm_setr_epi16(112, 0, 112, 0, 112, 0, 112, 0);
+    const __m128i vRG = _mm_setr_epi16(112, -94, 112, -94, 112, -94, 112, -94), vB = _mm_setr_epi16(-18, 0, -18, 0, -18, 0, -18, 0);
+    int x = 0;
+    for (; x+16 <= count; x+=16)
+    {
+        __m128i b0, g0, r0, b1, g1, r1;
+        ssse3Deinterleave(row0 + 3*x, b0, g0, r0);
+        ssse3Deinterleave(row1 + 3*x, b1, g1, r1);
+        ssse3StoreLuma(y0 + x, b0, g0, r0);
+        ssse3StoreLuma(y1 + x, b1, g1, r1);
+
+        // Horizontal pairs with pmaddubsw, then the two rows
+        __m128i B = _mm_add_epi16(_mm_maddubs_epi16(b0, ones), _mm_maddubs_epi16(b1, ones));
+        __m128i G = _mm_add_epi16(_mm_maddubs_epi16(g0, ones), _mm_maddubs_epi16(g1, ones));
+        __m128i R = _mm_add_epi16(_mm_maddubs_epi16(r0, ones), _mm_maddubs_epi16(r1, ones));
+        __m128i rgLo = _mm_unpacklo_epi16(R, G), rgHi = _mm_unpackhi_epi16(R, G);
+        __m128i bLo = _mm_unpacklo_epi16(B, zero), bHi = _mm_unpackhi_epi16(B, zero);
+        __m128i cu = _mm_add_epi16(_mm_packs_epi32(ssse3Chroma(rgLo, bLo, uRG, uB), ssse3Chroma(rgHi, bHi, uRG, uB)), bias);
+        __m128i cv = _mm_add_epi16(_mm_packs_epi32(ssse3Chroma(rgLo, bLo, vRG, vB), ssse3Chroma(rgHi, bHi, vRG, vB)), bias);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(u + x/2), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(v + x/2), _mm_packus_epi16(cv, cv));
+    }
+    return x;
+}
+
+/// The coefficients for pmaddwd, lo multiplies the even words and hi the odd ones
+inline int wordPair(int16_t lo, int16_t hi)
+{
+    return int(uint32_t(uint16_t(lo)) | (uint32_t(uint16_t(hi)) << 16));
+}
+
+// The AVX2 versions work on two independent 128 bit lanes, the low one gets pixels 0-15
+// and the high one 16-31, so the in-lane shuffles and packs keep everything in order
+
+VIDEOCONVERT_TARGET("avx2")
+inline __m256i avx2Load2(const uint8_t* p)
+{
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+                                   _mm_loadu_si128(reinterpret_cast<const __m128i*>(p+48)), 1);
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline __m256i avx2Channel(__m256i a0, __m256i a1, __m256i a2, int c)
+{
+    const __m128i* m = reinterpret_cast<const __m128i*>(bgrDeinterleave[c]);
+    return _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, _mm256_broadcastsi128_si256(_mm_load_si128(m))),
+                                           _mm256_shuffle_epi8(a1, _mm256_broadcastsi128_si256(_mm_load_si128(m+1)))),
+                           _mm256_shuffle_epi8(a2, _mm256_broadcastsi128_si256(_mm_load_si128(m+2))));
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline void avx2Deinterleave(const uint8_t* p, __m256i& b, __m256i& g, __m256i& r)
+{
+    __m256i a0 = avx2Load2(p), a1 = avx2Load2(p+16), a2 = avx2Load2(p+32);
+    b = avx2Channel(a0, a1, a2, 0);
+    g = avx2Channel(a0, a1, a2, 1);
+    r = avx2Channel(a0, a1, a2, 2);
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline __m256i avx2Luma(__m256i b, __m256i g, __m256i r)
+{
+    __m256i sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(r, _mm256_set1_epi16(66)),
+                                                    _mm256_mullo_epi16(g, _mm256_set1_epi16(129))),
+                                   _mm256_mullo_epi16(b, _mm256_set1_epi16(25)));
+    return _mm256_add_epi16(_mm256_srli_epi16(sum, 8), _mm256_set1_epi16(16));
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline void avx2StoreLuma(uint8_t* dst, __m256i b, __m256i g, __m256i r)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = avx2Luma(_mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(g, zero), _mm256_unpacklo_epi8(r, zero));
+    __m256i hi = avx2Luma(_mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(g, zero), _mm256_unpackhi_epi8(r, zero));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), _mm256_packus_epi16(lo, hi));
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline __m256i avx2Chroma(__m256i rg, __m256i b0, __m256i crg, __m256i cb0)
+{
+    return _mm256_srai_epi32(_mm256_add_epi32(_mm256_madd_epi16(rg, crg), _mm256_madd_epi16(b0, cb0)), 10);
+}
+
+/// Packs 16 chromas to bytes, the in-lane pack leaves them in the 1st and 3rd quadword
+VIDEOCONVERT_TARGET("avx2")
+inline void avx2StoreChroma(uint8_t* dst, __m256i c)
+{
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(c, c), 0xD8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm256_castsi256_si128(packed));
+}
+
+VIDEOCONVERT_TARGET("avx2")
+int bgrToI420RowsAvx2(const uint8_t* row0, const uint8_t* row1, int count,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    const __m256i zero = _mm256_setzero_si256(), ones = _mm256_set1_epi8(1), bias = _mm256_set1_epi16(128);
+    const __m256i uRG = _mm256_set1_epi32(wordPair(-38, -74)), uB = _mm256_set1_epi32(wordPair(112, 0));
+    const __m256i vRG = _mm256_set1_epi32(wordPair(112, -94)), vB = _mm256_set1_epi32(wordPair(-18, 0));
+    int x = 0;
+    for (; x+32 <= count; x+=32)
+    {
+        __m256i b0, g0, r0, b1, g1, r1;
+        avx2Deinterleave(row0 + 3*x, b0, g0, r0);
+        avx2Deinterleave(row1 + 3*x, b1, g1, r1);
+        avx2StoreLuma(y0 + x, b0, g0, r0);
+        avx2StoreLuma(y1 + x, b1, g1, r1);
+
+        __m256i B = _mm256_add_epi16(_mm256_maddubs_epi16(b0, ones), _mm256_maddubs_epi16(b1, ones));
+        __m256i G = _mm256_add_epi16(_mm256_maddubs_epi16(g0, ones), _mm256_maddubs_epi16(g1, ones));
+        __m256i R = _mm256_add_epi16(_mm256_maddubs_epi16(r0, ones), _mm256_maddubs_epi16(r1, ones));
+        __m256i rgLo = _mm256_unpacklo_epi16(R, G), rgHi = _mm256_unpackhi_epi16(R, G);
+        __m256i bLo = _mm256_unpacklo_epi16(B, zero), bHi = _mm256_unpackhi_epi16(B, zero);
+        avx2StoreChroma(u + x/2, _mm256_add_epi16(_mm256_packs_epi32(avx2Chroma(rgLo, bLo, uRG, uB),
+                                                                     avx2Chroma(rgHi, bHi, uRG, uB)), bias));
+        avx2StoreChroma(v + x/2, _mm256_add_epi16(_mm256_packs_epi32(avx2Chroma(rgLo, bLo, vRG, vB),
+                                                                     avx2Chroma(rgHi, bHi, vRG, vB)), bias));
+    }
+    return x;
+}
+
+VIDEOCONVERT_TARGET("sse2")
+int blendRowsSse2(const uint8_t* a, const uint8_t* b, int weight, uint8_t* out, int count)
+{
+    const __m128i zero = _mm_setzero_si128(), round = _mm_set1_epi16(128);
+    const __m128i wa = _mm_set1_epi16(256-weight), wb = _mm_set1_epi16(weight);
+    int x = 0;
+    for (; x+16 <= count; x+=16)
+    {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a+x));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b+x));
+        __m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpacklo_epi8(vb, zero), wb)), round);
+        __m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(va, zero), wa),
+                                                 _mm_mullo_epi16(_mm_unpackhi_epi8(vb, zero), wb)), round);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out+x), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+    }
+    return x;
+}
+
+/// RGB of 8 pixels, the products of the chroma terms that don't fit 16 bits are done with
+/// pmulhw on the difference scaled by 64, since (d*64*k) >> 16 == (d*k) >> 10. Green needs the sum
+/// of two products before the shift, so it goes through pmaddwd
+VIDEOCONVERT_TARGET("sse2")
+inline void sse2Rgb(__m128i y, __m128i cb, __m128i cr, __m128i& r, __m128i& g, __m128i& b)
+{
+    const __m128i gCoeffs = _mm_set1_epi32(wordPair(354, 732));
+    r = _mm_add_epi16(y, _mm_mulhi_epi16(_mm_slli_epi16(cr, 6), _mm_set1_epi16(1436)));
+    b = _mm_add_epi16(y, _mm_mulhi_epi16(_mm_slli_epi16(cb, 6), _mm_set1_epi16(1814)));
+    __m128i gLo = _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(cb, cr), gCoeffs), 10);
+    __m128i gHi = _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(cb, cr), gCoeffs), 10);
+    g = _mm_sub_epi16(y, _mm_packs_epi32(gLo, gHi));
+}
+
+VIDEOCONVERT_TARGET("sse2")
+int yuvToRgb32RowSse2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst, int count)
+{
+    const __m128i zero = _mm_setzero_si128(), bias = _mm_set1_epi16(128), alpha = _mm_set1_epi8(-1);
+    int x = 0;
+    for (; x+16 <= count; x+=16)
+    {
+        __m128i vy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y+x));
+        __m128i vu = _mm_loadu_si128(reinterpret_cast<const __m128i*>(u+x));
+        __m128i vv = _mm_loadu_si128(reinterpret_cast<const __m128i*>(v+x));
+        __m128i rLo, gLo, bLo, rHi, gHi, bHi;
+        sse2Rgb(_mm_unpacklo_epi8(vy, zero), _mm_sub_epi16(_mm_unpacklo_epi8(vu, zero), bias),
+                _mm_sub_epi16(_mm_unpacklo_epi8(vv, zero), bias), rLo, gLo, bLo);
+        sse2Rgb(_mm_unpackhi_epi8(vy, zero), _mm_sub_epi16(_mm_unpackhi_epi8(vu, zero), bias),
+                _mm_sub_epi16(_mm_unpackhi_epi8(vv, zero), bias), rHi, gHi, bHi);
+        // packuswb clamps, then interleave to B,G,R,A in memory which is 0xAARRGGBB
+        __m128i r = _mm_packus_epi16(rLo, rHi), g = _mm_packus_epi16(gLo, gHi), b = _mm_packus_epi16(bLo, bHi);
+        __m128i bgLo = _mm_unpacklo_epi8(b, g), bgHi = _mm_unpackhi_epi8(b, g);
+        __m128i raLo = _mm_unpacklo_epi8(r, alpha), raHi = _mm_unpackhi_epi8(r, alpha);
+        __m128i* out = reinterpret_cast<__m128i*>(dst+x);
+        _mm_storeu_si128(out, _mm_unpacklo_epi16(bgLo, raLo));
+        _mm_storeu_si128(out+1, _mm_unpackhi_epi16(bgLo, raLo));
+        _mm_storeu_si128(out+2, _mm_unpacklo_epi16(bgHi, raHi));
+        _mm_storeu_si128(out+3, _mm_unpackhi_epi16(bgHi, raHi));
+    }
+    return x;
+}
+
+VIDEOCONVERT_TARGET("avx2")
+int blendRowsAvx2(const uint8_t* a, const uint8_t* b, int weight, uint8_t* out, int count)
+{
+    const __m256i zero = _mm256_setzero_si256(), round = _mm256_set1_epi16(128);
+    const __m256i wa = _mm256_set1_epi16(256-weight), wb = _mm256_set1_epi16(weight);
+    int x = 0;
+    for (; x+32 <= count; x+=32)
+    {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a+x));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b+x));
+        __m256i lo = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpacklo_epi8(vb, zero), wb)), round);
+        __m256i hi = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(va, zero), wa),
+                                                       _mm256_mullo_epi16(_mm256_unpackhi_epi8(vb, zero), wb)), round);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out+x),
+                            _mm256_packus_epi16(_mm256_srli_epi16(lo, 8), _mm256_srli_epi16(hi, 8)));
+    }
+    return x;
+}
+
+VIDEOCONVERT_TARGET("avx2")
+inline void avx2Rgb(__m256i y, __m256i cb, __m256i cr, __m256i& r, __m256i& g, __m256i& b)
+{
+    const __m256i gCoeffs = _mm256_set1_epi32(wordPair(354, 732));
+    r = _mm256_add_epi16(y, _mm256_mulhi_epi16(_mm256_slli_epi16(cr, 6), _mm256_set1_epi16(1436)));
+    b = _mm256_add_epi16(y, _mm256_mulhi_epi16(_mm256_slli_epi16(cb, 6), _mm256_set1_epi16(1814)));
+    __m256i gLo = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi16(cb, cr), gCoeffs), 10);
+    __m256i gHi = _mm256_srai_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi16(cb, cr), gCoeffs), 10);
+    g = _mm256_sub_epi16(y, _mm256_packs_epi32(gLo, gHi));
+}
+
+VIDEOCONVERT_TARGET("avx2")
+int yuvToRgb32RowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst, int count)
+{
+    const __m256i zero = _mm256_setzero_si256(), bias = _mm256_set1_epi16(128), alpha = _mm256_set1_epi8(-1);
+    int x = 0;
+    for (; x+32 <= count; x+=32)
+    {
+        __m256i vy = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y+x));
+        __m256i vu = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(u+x));
+        __m256i vv = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(v+x));
+        __m256i rLo, gLo, bLo, rHi, gHi, bHi;
+        avx2Rgb(_mm256_unpacklo_epi8(vy, zero), _mm256_sub_epi16(_mm256_unpacklo_epi8(vu, zero), bias),
+                _mm256_sub_epi16(_mm256_unpacklo_epi8(vv, zero), bias), rLo, gLo, bLo);
+        avx2Rgb(_mm256_unpackhi_epi8(vy, zero), _mm256_sub_epi16(_mm256_unpackhi_epi8(vu, zero), bias),
+                _mm256_sub_epi16(_mm256_unpackhi_epi8(vv, zero), bias), rHi, gHi, bHi);
+        __m256i r = _mm256_packus_epi16(rLo, rHi), g = _mm256_packus_epi16(gLo, gHi), b = _mm256_packus_epi16(bLo, bHi);
+        __m256i bgLo = _mm256_unpacklo_epi8(b, g), bgHi = _mm256_unpackhi_epi8(b, g);
+        __m256i raLo = _mm256_unpacklo_epi8(r, alpha), raHi = _mm256_unpackhi_epi8(r, alpha);
+        // Each lane holds pixels n-n+3 in its low half and n+16-n+19 in its high half
+        __m256i p0 = _mm256_unpacklo_epi16(bgLo, raLo), p1 = _mm256_unpackhi_epi16(bgLo, raLo);
+        __m256i p2 = _mm256_unpacklo_epi16(bgHi, raHi), p3 = _mm256_unpackhi_epi16(bgHi, raHi);
+        __m256i* out = reinterpret_cast<__m256i*>(dst+x);
+        _mm256_storeu_si256(out, _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256(out+1, _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256(out+2, _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256(out+3, _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    return x;
+}
+
+bool cpuHasSsse3()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1<<9);
+#else
+    return __builtin_cpu_supports("ssse3");
+#endif
+}
+
+bool cpuHasAvx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1<<27)) && (_xgetbv(0) & 6) == 6;
+    __cpuidex(info, 7, 0);
+    return osSavesYmm && (info[1] & (1<<5));
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif // VIDEOCONVERT_X86
+
+#ifdef VIDEOCONVERT_NEON
+inline uint8x8_t neonLuma(uint8x8_t b, uint8x8_t g, uint8x8_t r)
+{
+    uint16x8_t sum = vmull_u8(r, vdup_n_u8(66));
+    sum = vmlal_u8(sum, g, vdup_n_u8(129));
+    sum = vmlal_u8(sum, b, vdup_n_u8(25));
+    return vadd_u8(vshrn_n_u16(sum, 8), vdup_n_u8(16));
+}
+
+inline void neonStoreLuma(uint8_t* dst, const uint8x16x3_t& p)
+{
+    vst1q_u8(dst, vcombine_u8(neonLuma(vget_low_u8(p.val[0]), vget_low_u8(p.val[1]), vget_low_u8(p.val[2])),
+                              neonLuma(vget_high_u8(p.val[0]), vget_high_u8(p.val[1]), vget_high_u8(p.val[2]))));
+}
+
+inline int32x4_t neonChroma(int16x4_t r, int16x4_t g, int16x4_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+    int32x4_t sum = vmull_n_s16(r, cr);
+    sum = vmlal_n_s16(sum, g, cg);
+    sum = vmlal_n_s16(sum, b, cb);
+    return vshrq_n_s32(sum, 10);
+}
+
+inline uint8x8_t neonChroma(int16x8_t r, int16x8_t g, int16x8_t b, int16_t cr, int16_t cg, int16_t cb)
+{
+    int16x8_t c = vcombine_s16(vmovn_s32(neonChroma(vget_low_s16(r), vget_low_s16(g), vget_low_s16(b), cr, cg, cb)),
+                               vmovn_s32(neonChroma(vget_high_s16(r), vget_high_s16(g), vget_high_s16(b), cr, cg, cb)));
+    return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+int bgrToI420RowsNeon(const uint8_t* row0, const uint8_t* row1, int count,
+                      uint8_t* y0, uint8_t* y1, uint8_t* u, uint8_t* v)
+{
+    int x = 0;
+    for (; x+16 <= count; x+=16)
+    {
+        uint8x16x3_t p0 = vld3q_u8(row0 + 3*x), p1 = vld3q_u8(row1 + 3*x);
+        neonStoreLuma(y0 + x, p0);
+        neonStoreLuma(y1 + x, p1);
+
+        int16x8_t B = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[0]), p1.val[0]));
+        int16x8_t G = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[1]), p1.val[1]));
+        int16x8_t R = vreinterpretq_s16_u16(vpadalq_u8(vpaddlq_u8(p0.val[2]), p1.val[2]));
+        vst1_u8(u + x/2, neonChroma(R, G, B, -38, -74, 112));
+        vst1_u8(v + x/2, neonChroma(R, G, B, 112, -94, -18));
+    }
+    return x;
+}
+int blendRowsNeon(const uint8_t* a, const uint8_t* b, int weight, uint8_t* out, int count)
+{
+    const uint8x8_t wa = vdup_n_u8(256-weight), wb = vdup_n_u8(weight);
+    int x = 0;
+    for (; x+16 <= count; x+=16)
+    {
+        uint8x16_t va = vld1q_u8(a+x), vb = vld1q_u8(b+x);
+        uint16x8_t lo = vmlal_u8(vmull_u8(vget_low_u8(va), wa), vget_low_u8(vb), wb);
+        uint16x8_t hi = vmlal_u8(vmull_u8(vget_high_u8(va), wa), vget_high_u8(vb), wb);
+        vst1q_u8(out+x, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8))); // Rounds with +128
+    }
+    return x;
+}
+
+inline int16x4_t neonProduct(int16x4_t d, int16_t k)
+{
+    return vshrn_n_s32(vmull_n_s16(d, k), 10);
+}
+
+int yuvToRgb32RowNeon(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint32_t* dst, int count)
+{
+    const uint8x8_t bias = vdup_n_u8(128);
+    int x = 0;
+    for (; x+8 <= count; x+=8)
+    {
+        int16x8_t Y = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(y+x)));
+        int16x8_t Cb = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(u+x), bias));
+        int16x8_t Cr = vreinterpretq_s16_u16(vsubl_u8(vld1_u8(v+x), bias));
+        int16x4_t cbLo = vget_low_s16(Cb), cbHi = vget_high_s16(Cb), crLo = vget_low_s16(Cr), crHi = vget_high_s16(Cr);
+        int16x8_t r = vcombine_s16(neonProduct(crLo, 1436), neonProduct(crHi, 1436));
+        int16x8_t b = vcombine_s16(neonProduct(cbLo, 1814), neonProduct(cbHi, 1814));
+        int16x8_t g = vcombine_s16(vshrn_n_s32(vmlal_n_s16(vmull_n_s16(cbLo, 354), crLo, 732), 10),
+                                   vshrn_n_s32(vmlal_n_s16(vmull_n_s16(cbHi, 354), crHi, 732), 10));
+        uint8x8x4_t bgra;
+        bgra.val[0] = vqmovun_s16(vaddq_s16(Y, b));
+        bgra.val[1] = vqmovun_s16(vsubq_s16(Y, g));
+        bgra.val[2] = vqmovun_s16(vaddq_s16(Y, r));
+        bgra.val[3] = vdup_n_u8(255);
+        vst4_u8(reinterpret_cast<uint8_t*>(dst+x), bgra);
+    }
+    return x;
+}
+#endif // VIDEOCONVERT_NEON
+
+struct Implementation
+{
+    const char* name;
+    BgrToI420Rows bgrToI420;
+    BlendRows blendRows;
+    YuvToRgb32Row yuvToRgb32;
+};
+
+/// Every path the CPU can run, the reference first and the fastest last
+QVector<Implementation> supportedImplementations()
+{
+    QVector<Implementation> impls;
+    impls.append({"scalar", bgrToI420RowsScalar, blendRowsScalar, yuvToRgb32RowScalar});
+#ifdef VIDEOCONVERT_X86
+    if (cpuHasSsse3())
+        impls.append({"ssse3", bgrToI420RowsSsse3, blendRowsSse2, yuvToRgb32RowSse2});
+    if (cpuHasAvx2())
+        impls.append({"avx2", bgrToI420RowsAvx2, blendRowsAvx2, yuvToRgb32RowAvx2});
+#endif
+#ifdef VIDEOCONVERT_NEON
+    impls.append({"neon", bgrToI420RowsNeon, blendRowsNeon, yuvToRgb32RowNeon});
+#endif
+    return impls;
+}
+
+const Implementation& bestImplementation()
+{
+    static const Implementation best = supportedImplementations().last();
+    return best;
+}
+
+void bgrToI420With(BgrToI420Rows rows, const uint8_t* bgr, int bgrStride, int width, int height,
+                   uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride)
+{
+    for (int line=0; line<height; line+=2)
+    {
+        const uint8_t* row0 = bgr + line*bgrStride;
+        uint8_t* y0 = y + line*yStride;
+        uint8_t* cu = u + line/2*uStride;
+        uint8_t* cv = v + line/2*vStride;
+        if (line+1 == height)
+        {
+            bgrToI420RowsScalar(row0, row0, width, y0, nullptr, cu, cv);
+            break;
+        }
+
+        const uint8_t* row1 = row0 + bgrStride;
+        uint8_t* y1 = y0 + yStride;
+        int done = rows(row0, row1, width, y0, y1, cu, cv);
+        if (done < width)
+            bgrToI420RowsScalar(row0 + 3*done, row1 + 3*done, width - done, y0 + done, y1 + done, cu + done/2, cv + done/2);
+    }
+}
+
+/// Where a destination pixel samples the source, as two neighbours and the weight of the second in 1/256
+struct Tap
+{
+    int index, next, weight;
+};
+
+/// Pixel centers are aligned, chroma samples sit between their two luma samples
+Tap scaleTap(int src, int dst, int d, bool chroma)
+{
+    int samples = chroma ? (src+1)/2 : src;
+    long long pos = (2LL*d + 1) * src * 65536 / (2LL*dst) - 32768; // 16.16 in luma samples
+    if (chroma)
+        pos = (pos - 32768) / 2;
+    pos = std::max(pos, 0LL);
+
+    Tap tap;
+    tap.index = pos >> 16;
+    tap.weight = (pos >> 8) & 255;
+    if (tap.index >= samples-1)
+    {
+        tap.index = samples-1;
+        tap.weight = 0;
+    }
+    tap.next = tap.weight ? tap.index+1 : tap.index;
+    return tap;
+}
+
+/// Row t of a plane, blended with the next one into scratch if needed
+const uint8_t* sampleRow(const Implementation& impl, const uint8_t* plane, int stride, int count,
+                         const Tap& t, QVector<uint8_t>& scratch)
+{
+    const uint8_t* row = plane + t.index*stride;
+    if (!t.weight)
+        return row;
+    const uint8_t* next = plane + t.next*stride;
+    uint8_t* out = scratch.data();
+    int done = impl.blendRows(row, next, t.weight, out, count);
+    blendRowsScalar(row + done, next + done, t.weight, out + done, count - done);
+    return out;
+}
+
+void resampleRow(const uint8_t* src, const QVector<Tap>& taps, uint8_t* out)
+{
+    for (int x=0; x<taps.size(); x++)
+    {
+        const Tap& t = taps[x];
+        out[x] = (src[t.index]*(256-t.weight) + src[t.next]*t.weight + 128) >> 8;
+    }
+}
+
+void i420ToRgb32With(const Implementation& impl, const uint8_t* y, int yStride, const uint8_t* u, int uStride,
+                     const uint8_t* v, int vStride, int width, int height,
+                     uint8_t* dst, int dstStride, int dstWidth, int dstHeight)
+{
+    if (width <= 0 || height <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return;
+
+    // Rows are scaled vertically with the vectorized blend, then horizontally with precomputed
+    // taps, chroma is upsampled to full width on the way, and the vectorized conversion writes them out
+    int cw = (width+1)/2;
+    QVector<Tap> lumaTaps(dstWidth), chromaTaps(dstWidth);
+    for (int x=0; x<dstWidth; x++)
+    {
+        lumaTaps[x] = scaleTap(width, dstWidth, x, false);
+        chromaTaps[x] = scaleTap(width, dstWidth, x, true);
+    }
+    QVector<uint8_t> rowY(width), rowU(cw), rowV(cw), outY(dstWidth), outU(dstWidth), outV(dstWidth);
+
+    for (int line=0; line<dstHeight; line++)
+    {
+        Tap lumaTap = scaleTap(height, dstHeight, line, false), chromaTap = scaleTap(height, dstHeight, line, true);
+        const uint8_t* srcY = sampleRow(impl, y, yStride, width, lumaTap, rowY);
+        const uint8_t* srcU = sampleRow(impl, u, uStride, cw, chromaTap, rowU);
+        const uint8_t* srcV = sampleRow(impl, v, vStride, cw, chromaTap, rowV);
+        if (width != dstWidth)
+        {
+            resampleRow(srcY, lumaTaps, outY.data());
+            srcY = outY.constData();
+        }
+        resampleRow(srcU, chromaTaps, outU.data());
+        resampleRow(srcV, chromaTaps, outV.data());
+
+        uint32_t* out = reinterpret_cast<uint32_t*>(dst + line*dstStride);
+        int done = impl.yuvToRgb32(srcY, outU.constData(), outV.constData(), out, dstWidth);
+        yuvToRgb32RowScalar(srcY + done, outU.constData() + done, outV.constData() + done, out + done, dstWidth - done);
+    }
+}
+
+void scalePlaneWith(const Implementation& impl, const uint8_t* src, int srcStride, int width, int height,
+                    uint8_t* dst, int dstStride, int dstWidth, int dstHeight)
+{
+    if (width <= 0 || height <= 0 || dstWidth <= 0 || dstHeight <= 0)
+        return;
+
+    QVector<Tap> taps(dstWidth);
+    for (int x=0; x<dstWidth; x++)
+        taps[x] = scaleTap(width, dstWidth, x, false);
+    QVector<uint8_t> row(width);
+    for (int line=0; line<dstHeight; line++)
+    {
+        const uint8_t* in = sampleRow(impl, src, srcStride, width, scaleTap(height, dstHeight, line, false), row);
+        if (width == dstWidth)
+            memcpy(dst + line*dstStride, in, width);
+        else
+            resampleRow(in, taps, dst + line*dstStride);
+    }
+}
+}
+
+void VideoConvert::bgrToI420(const uint8_t* bgr, int bgrStride, int width, int height,
+                             uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride)
+{
+    bgrToI420With(bestImplementation().bgrToI420, bgr, bgrStride, width, height, y, yStride, u, uStride, v, vStride);
+}
+
+void VideoConvert::i420ToRgb32(const uint8_t* y, int yStride, const uint8_t* u, int uStride, const uint8_t* v, int vStride,
+                               int width, int height, uint8_t* dst, int dstStride, int dstWidth, int dstHeight)
+{
+    i420ToRgb32With(bestImplementation(), y, yStride, u, uStride, v, vStride, width, height,
+                    dst, dstStride, dstWidth, dstHeight);
+}
+
+void VideoConvert::rgb32ToI420(const uint8_t* rgb, int rgbStride, int width, int height,
+                               uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride)
+{
+    QVector<uint8_t> bgr(2 * 3 * width);
+    for (int line=0; line<height; line+=2)
+    {
+        int rows = std::min(2, height - line);
+        for (int row=0; row<rows; row++)
+        {
+            // 0xffRRGGBB in native endianness, whatever the byte order
+            const uint32_t* src = reinterpret_cast<const uint32_t*>(rgb + (line+row)*rgbStride);
+            uint8_t* out = bgr.data() + row*3*width;
+            for (int x=0; x<width; x++)
+            {
+                out[3*x] = src[x];
+                out[3*x+1] = src[x] >> 8;
+                out[3*x+2] = src[x] >> 16;
+            }
+        }
+        bgrToI420With(bestImplementation().bgrToI420, bgr.constData(), 3*width, width, rows,
+                      y + line*yStride, yStride, u + line/2*uStride, uStride, v + line/2*vStride, vStride);
+    }
+}
+
+void VideoConvert::yuyvToI420(const uint8_t* yuyv, int yuyvStride, int width, int height,
+                              uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride)
+{
+    int pairs = width / 2;
+    for (int row=0; row<height; row+=2)
+    {
+        const uint8_t* top = yuyv + row*yuyvStride;
+        const uint8_t* bottom = row+1 < height ? top + yuyvStride : top;
+        uint8_t *outTop = y + row*yStride, *outBottom = row+1 < height ? outTop + yStride : outTop;
+        uint8_t *outU = u + (row/2)*uStride, *outV = v + (row/2)*vStride;
+        for (int x=0; x<width; x++)
+        {
+            outTop[x] = top[2*x];
+            outBottom[x] = bottom[2*x];
+        }
+        for (int x=0; x<pairs; x++)
+        {
+            outU[x] = (top[4*x+1] + bottom[4*x+1] + 1) >> 1;
+            outV[x] = (top[4*x+3] + bottom[4*x+3] + 1) >> 1;
+        }
+        // An odd last pixel has its Cb but no Cr of its own, it shares the pair's before it
+        if (width % 2)
+        {
+            outU[pairs] = (top[4*pairs+1] + bottom[4*pairs+1] + 1) >> 1;
+            outV[pairs] = pairs ? outV[pairs-1] : 128;
+        }
+    }
+}
+
+void VideoConvert::scalePlane(const uint8_t* src, int srcStride, int width, int height,
+                              uint8_t* dst, int dstStride, int dstWidth, int dstHeight)
+{
+    scalePlaneWith(bestImplementation(), src, srcStride, width, height, dst, dstStride, dstWidth, dstHeight);
+}
+
+const char* VideoConvert::implementation()
+{
+    return bestImplementation().name;
+}
+
+int VideoConvert::benchmark()
+{
+    QTextStream out(stdout);
+    const int sizes[][2] = {{640, 480}, {1280, 720}, {1920, 1080}, {641, 361}};
+    const int iterations = 200;
+    int mismatches = 0;
+
+    QVector<Implementation> impls = supportedImplementations();
+    for (const auto& size : sizes)
+    {
+        int w = size[0], h = size[1], cw = (w+1)/2, ch = (h+1)/2;
+        QVector<uint8_t> bgr(3*w*h);
+        uint32_t seed = 1;
+        for (uint8_t& byte : bgr)
+            byte = (seed = seed * 1103515245 + 12345) >> 24;
+
+        QVector<uint8_t> reference;
+        double referenceTime = 0;
+        for (const Implementation& impl : impls)
+        {
+            QVector<uint8_t> i420(w*h + 2*cw*ch);
+            uint8_t *py = i420.data(), *pu = py + w*h, *pv = pu + cw*ch;
+
+            QElapsedTimer timer;
+            timer.start();
+            for (int i=0; i<iterations; i++)
+                bgrToI420With(impl.bgrToI420, bgr.constData(), 3*w, w, h, py, w, pu, cw, pv, cw);
+            double time = timer.nsecsElapsed() / 1e6 / iterations;
+
+            bool matches = true;
+            if (reference.isEmpty())
+            {
+                reference = i420;
+                referenceTime = time;
+            }
+            else if (i420 != reference)
+            {
+                matches = false;
+                mismatches++;
+            }
+            out << "bgrToI420 " << impl.name << ' ' << w << 'x' << h << ": "
+                << QString::number(time, 'f', 3) << " ms/frame, " << QString::number(referenceTime / time, 'f', 2)
+                << "x scalar" << (matches ? "" : ", DIFFERS FROM SCALAR") << '\n';
+        }
+    }
+
+    // Decoded frames, scaled down to a typical view, up, and not at all
+    const int scales[][4] = {{1280, 720, 640, 360}, {640, 480, 1024, 768}, {1280, 720, 1280, 720}, {641, 361, 397, 223}};
+    for (const auto& scale : scales)
+    {
+        int w = scale[0], h = scale[1], cw = (w+1)/2, ch = (h+1)/2, dw = scale[2], dh = scale[3];
+        QVector<uint8_t> i420(w*h + 2*cw*ch);
+        uint32_t seed = 1;
+        for (uint8_t& byte : i420)
+            byte = (seed = seed * 1103515245 + 12345) >> 24;
+        const uint8_t *py = i420.constData(), *pu = py + w*h, *pv = pu + cw*ch;
+
+        QVector<uint8_t> reference;
+        double referenceTime = 0;
+        for (const Implementation& impl : impls)
+        {
+            QVector<uint8_t> rgb(4*dw*dh);
+            QElapsedTimer timer;
+            timer.start();
+            for (int i=0; i<iterations; i++)
+                i420ToRgb32With(impl, py, w, pu, cw, pv, cw, w, h, rgb.data(), 4*dw, dw, dh);
+            double time = timer.nsecsElapsed() / 1e6 / iterations;
+
+            bool matches = true;
+            if (reference.isEmpty())
+            {
+                reference = rgb;
+                referenceTime = time;
+            }
+            else if (rgb != reference)
+            {
+                matches = false;
+                mismatches++;
+            }
+            out << "i420ToRgb32 " << impl.name << ' ' << w << 'x' << h << "->" << dw << 'x' << dh << ": "
+                << QString::number(time, 'f', 3) << " ms/frame, " << QString::number(referenceTime / time, 'f', 2)
+                << "x scalar" << (matches ? "" : ", DIFFERS FROM SCALAR") << '\n';
+        }
+    }
+    return mismatches ? 1 : 0;
+}
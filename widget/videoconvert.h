@@ -0,0 +1,48 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOCONVERT_H
+#define VIDEOCONVERT_H
+
+#include <cstdint>
+
+/// Colour conversions of the video paths, vectorized where the CPU allows it.
+/// The vectorized implementation is picked once at runtime, the portable scalar one
+/// is the reference that all the others must match bit for bit.
+class VideoConvert
+{
+public:
+    /// Converts packed 24 bit BGR to I420 with 2x2 box-filtered chroma, odd sizes repeat the last column/row
+    static void bgrToI420(const uint8_t* bgr, int bgrStride, int width, int height,
+                          uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride);
+    /// Same as bgrToI420 for QImage::Format_RGB32 pixels, packs each pair of rows to BGR for the vectorized path
+    static void rgb32ToI420(const uint8_t* rgb, int rgbStride, int width, int height,
+                            uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride);
+    /// Splits packed YUYV (4:2:2) into I420, averaging the chroma of each pair of rows. Cheap enough to stay scalar.
+    /// A row is 2*width bytes, an odd last pixel repeats the Cr of the one before
+    static void yuyvToI420(const uint8_t* yuyv, int yuyvStride, int width, int height,
+                           uint8_t* y, int yStride, uint8_t* u, int uStride, uint8_t* v, int vStride);
+    /// Converts I420 to RGB32 and scales it bilinearly to dstWidth x dstHeight in the same pass
+    static void i420ToRgb32(const uint8_t* y, int yStride, const uint8_t* u, int uStride, const uint8_t* v, int vStride,
+                            int width, int height, uint8_t* dst, int dstStride, int dstWidth, int dstHeight);
+    /// Scales one 8 bit plane bilinearly, for a whole I420 image call it on each plane with its own size
+    static void scalePlane(const uint8_t* src, int srcStride, int width, int height,
+                           uint8_t* dst, int dstStride, int dstWidth, int dstHeight);
+    static const char* implementation(); ///< Name of the vectorized path in use, "scalar" if there is none
+    static int benchmark(); ///< Times every path the CPU supports against the scalar one, non-zero if they disagree
+};
+
+#endif // VIDEOCONVERT_H
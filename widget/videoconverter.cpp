@@ -0,0 +1,154 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videoconverter.h"
+#include "videoconvert.h"
+#include "videosource.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include <algorithm>
+
+namespace
+{
+/// Separate from the global pool, a frame mustn't wait behind a thumbnail or a chat export
+QThreadPool* convertPool()
+{
+    // Initialized once even if the GUI and Core threads get here together
+    static QThreadPool* pool = []
+    {
+        QThreadPool* pool = new QThreadPool;
+        pool->setMaxThreadCount(std::max(QThread::idealThreadCount(), 2));
+        // The threads are kept between frames, starting one for each would cost more than converting
+        pool->setExpiryTimeout(-1);
+        return pool;
+    }();
+    return pool;
+}
+}
+
+struct VideoConverter::Link
+{
+    QMutex mutex;
+    VideoConverter* converter;
+};
+
+/// Converts one frame, then hands the result back on the converter's thread if it's still there
+class VideoConverter::Task : public QRunnable
+{
+public:
+    Task(QSharedPointer<Link> Link, const Job& Job)
+        : link{Link}, job(Job) {}
+
+    void run()
+    {
+        QElapsedTimer cost;
+        cost.start();
+        if (job.source)
+        {
+            VideoFrame frame = job.source->getLastVideoFrame(job.size);
+            QMutexLocker locker(&link->mutex);
+            if (link->converter)
+                QMetaObject::invokeMethod(link->converter, "onFrameDone", Qt::QueuedConnection,
+                                          Q_ARG(VideoFrame, frame), Q_ARG(qint64, cost.elapsed()));
+            return;
+        }
+
+        QImage image;
+        if (vpx_image* frame = job.frame.image())
+        {
+            image = QImage(job.size, QImage::Format_RGB32);
+            // The sender puts Cb in the V plane and Cr in the U plane, see Camera::getLastVideoFrame
+            VideoConvert::i420ToRgb32(frame->planes[VPX_PLANE_Y], frame->stride[VPX_PLANE_Y],
+                                      frame->planes[VPX_PLANE_V], frame->stride[VPX_PLANE_V],
+                                      frame->planes[VPX_PLANE_U], frame->stride[VPX_PLANE_U],
+                                      frame->d_w, frame->d_h, image.bits(), image.bytesPerLine(),
+                                      job.size.width(), job.size.height());
+        }
+        job.frame = VideoFrame(); // Back to the pool before the image is painted
+        QMutexLocker locker(&link->mutex);
+        if (link->converter)
+            QMetaObject::invokeMethod(link->converter, "onImageDone", Qt::QueuedConnection, Q_ARG(QImage, image));
+    }
+
+private:
+    QSharedPointer<Link> link;
+    Job job;
+};
+
+VideoConverter::VideoConverter(QObject* parent)
+    : QObject(parent), link{new Link}, busy{false}, hasWaiting{false}
+{
+    link->converter = this;
+}
+
+VideoConverter::~VideoConverter()
+{
+    // A task that's still running keeps the link, what it posts before this is dropped with us
+    QMutexLocker locker(&link->mutex);
+    link->converter = nullptr;
+}
+
+void VideoConverter::toImage(const VideoFrame& frame, QSize size)
+{
+    submit({frame, nullptr, size.expandedTo(QSize(1,1))});
+}
+
+void VideoConverter::fromSource(VideoSource* source, QSize maxSize)
+{
+    submit({VideoFrame(), source, maxSize});
+}
+
+int VideoConverter::getThreadCount()
+{
+    return convertPool()->maxThreadCount();
+}
+
+void VideoConverter::submit(const Job& job)
+{
+    waiting = job;
+    hasWaiting = true;
+    if (!busy)
+        startNext();
+}
+
+void VideoConverter::startNext()
+{
+    if (!hasWaiting)
+        return;
+    busy = true;
+    hasWaiting = false;
+    convertPool()->start(new Task(link, waiting));
+    waiting = Job();
+}
+
+void VideoConverter::onImageDone(const QImage& image)
+{
+    busy = false;
+    startNext();
+    if (!image.isNull())
+        emit imageReady(image);
+}
+
+void VideoConverter::onFrameDone(const VideoFrame& frame, qint64 cost)
+{
+    busy = false;
+    startNext();
+    emit frameReady(frame, cost);
+}
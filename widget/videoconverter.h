@@ -0,0 +1,72 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOCONVERTER_H
+#define VIDEOCONVERTER_H
+
+#include <QObject>
+#include <QImage>
+#include <QSharedPointer>
+#include <QSize>
+#include "videoframe.h"
+
+class VideoSource;
+
+/// Colour converts and scales the frames of one video stream on a worker pool shared by every stream,
+/// so a second or third call runs on other cores instead of taking from the frame rate of the first.
+/// A stream has at most one frame in flight, its results come back in order on the converter's thread.
+/// A frame that comes while another is being converted waits, and is replaced if a newer one comes.
+class VideoConverter : public QObject
+{
+    Q_OBJECT
+public:
+    explicit VideoConverter(QObject* parent = 0);
+    ~VideoConverter();
+
+    void toImage(const VideoFrame& frame, QSize size); ///< To RGB32 at size, for imageReady
+    void fromSource(VideoSource* source, QSize maxSize); ///< The source's newest frame scaled down to fit maxSize, for frameReady
+    bool isBusy() const {return busy;} ///< A frame is being converted
+
+    static int getThreadCount(); ///< Of the shared pool
+
+signals:
+    void imageReady(const QImage& image); ///< Ready to paint, the size toImage was given
+    void frameReady(const VideoFrame& frame, qint64 cost); ///< Null if the source had none, cost is the conversion's in ms
+
+private slots:
+    void onImageDone(const QImage& image);
+    void onFrameDone(const VideoFrame& frame, qint64 cost);
+
+private:
+    struct Job
+    {
+        VideoFrame frame;
+        VideoSource* source; ///< Null for toImage
+        QSize size;
+    };
+    void submit(const Job& job);
+    void startNext();
+
+private:
+    class Task;
+    struct Link; ///< Shared with our tasks, cut when we're gone
+    QSharedPointer<Link> link;
+    bool busy;
+    bool hasWaiting;
+    Job waiting;
+};
+
+#endif // VIDEOCONVERTER_H
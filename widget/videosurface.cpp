@@ -0,0 +1,208 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#include "videosurface.h"
+#include "settings.h"
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+#include <QOffscreenSurface>
+#include <QDebug>
+#include <cstring>
+
+namespace
+{
+const char* vertexShader =
+    "attribute vec2 position;\n"
+    "attribute vec2 texCoord;\n"
+    "varying vec2 coord;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_Position = vec4(position, 0.0, 1.0);\n"
+    "    coord = texCoord;\n"
+    "}\n";
+
+// Same full range conversion as VideoConvert::i420ToRgb32
+const char* fragmentShader =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D yTex;\n"
+    "uniform sampler2D cbTex;\n"
+    "uniform sampler2D crTex;\n"
+    "varying vec2 coord;\n"
+    "void main()\n"
+    "{\n"
+    "    float y = texture2D(yTex, coord).r;\n"
+    "    float cb = texture2D(cbTex, coord).r - 0.5;\n"
+    "    float cr = texture2D(crTex, coord).r - 0.5;\n"
+    "    gl_FragColor = vec4(y + 1.402*cr, y - 0.344*cb - 0.714*cr, y + 1.772*cb, 1.0);\n"
+    "}\n";
+
+const GLfloat quadTexCoords[] = {0, 1,  1, 1,  0, 0,  1, 0};
+
+enum {TEX_Y, TEX_CB, TEX_CR};
+}
+
+VideoSurface::VideoSurface(QWidget* parent)
+    : QOpenGLWidget(parent), program{nullptr}, broken{false}
+{
+    textures[0] = textures[1] = textures[2] = 0;
+}
+
+VideoSurface::~VideoSurface()
+{
+    if (!program)
+        return;
+
+    makeCurrent();
+    glDeleteTextures(3, textures);
+    delete program;
+    doneCurrent();
+}
+
+bool VideoSurface::isAvailable()
+{
+    if (!Settings::getInstance().getUseOpenGLVideo())
+        return false;
+
+    // Creating a context is slow, the answer won't change while we run
+    static int available = -1;
+    if (available < 0)
+    {
+        QOpenGLContext context;
+        QOffscreenSurface surface;
+        context.setFormat(QSurfaceFormat::defaultFormat());
+        surface.setFormat(context.format());
+        surface.create();
+        available = context.create() && context.makeCurrent(&surface)
+                    && QOpenGLShaderProgram::hasOpenGLShaderPrograms(&context);
+        if (context.isValid())
+            context.doneCurrent();
+        if (!available)
+            qWarning() << "VideoSurface: No usable OpenGL context, drawing video in software";
+    }
+    return available;
+}
+
+void VideoSurface::setFrame(const VideoFrame& newFrame)
+{
+    vpx_image* img = newFrame.image();
+    if (!img || !img->d_w || !img->d_h)
+        return;
+
+    // If we haven't painted the previous one yet it's simply replaced
+    frame = newFrame;
+    update();
+}
+
+void VideoSurface::initializeGL()
+{
+    initializeOpenGLFunctions();
+
+    program = new QOpenGLShaderProgram(this);
+    if (!program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexShader)
+        || !program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentShader)
+        || !program->link())
+    {
+        qWarning() << "VideoSurface: Can't build the video shaders:" << program->log();
+        broken = true;
+        emit failed();
+        return;
+    }
+
+    program->bind();
+    program->setUniformValue("yTex", TEX_Y);
+    program->setUniformValue("cbTex", TEX_CB);
+    program->setUniformValue("crTex", TEX_CR);
+    program->release();
+
+    glGenTextures(3, textures);
+    for (unsigned texture : textures)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VideoSurface::uploadPlane(int texture, const uint8_t* data, int stride, int width, int height, bool reallocate)
+{
+    // GLES2 can't skip padding at the end of the rows, pack them first if there is any
+    if (stride != width)
+    {
+        repack.resize(width*height);
+        for (int line=0; line<height; line++)
+            memcpy(repack.data() + line*width, data + line*stride, width);
+        data = reinterpret_cast<const uint8_t*>(repack.constData());
+    }
+
+    glActiveTexture(GL_TEXTURE0 + texture);
+    glBindTexture(GL_TEXTURE_2D, textures[texture]);
+    if (reallocate)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, width, height, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_LUMINANCE, GL_UNSIGNED_BYTE, data);
+}
+
+void VideoSurface::paintGL()
+{
+    glClearColor(0, 0, 0, 1);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    if (broken)
+        return;
+
+    if (vpx_image* img = frame.image())
+    {
+        int w = img->d_w, h = img->d_h, cw = (w+1)/2, ch = (h+1)/2;
+        bool resized = textureSize != QSize(w, h);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        // The sender puts Cb in the V plane and Cr in the U plane, see Camera::getLastVideoFrame
+        uploadPlane(TEX_Y, img->planes[VPX_PLANE_Y], img->stride[VPX_PLANE_Y], w, h, resized);
+        uploadPlane(TEX_CB, img->planes[VPX_PLANE_V], img->stride[VPX_PLANE_V], cw, ch, resized);
+        uploadPlane(TEX_CR, img->planes[VPX_PLANE_U], img->stride[VPX_PLANE_U], cw, ch, resized);
+        textureSize = QSize(w, h);
+
+        // The textures have it now, give the buffer back to the pool
+        frame = VideoFrame();
+    }
+    if (textureSize.isEmpty())
+        return;
+
+    // Keep the aspect ratio, the clear color gives us the black bars
+    QSize fit = textureSize.scaled(size(), Qt::KeepAspectRatio);
+    GLfloat sx = GLfloat(fit.width()) / width(), sy = GLfloat(fit.height()) / height();
+    const GLfloat quad[] = {-sx, -sy,  sx, -sy,  -sx, sy,  sx, sy};
+
+    program->bind();
+    for (int texture=TEX_Y; texture<=TEX_CR; texture++)
+    {
+        glActiveTexture(GL_TEXTURE0 + texture);
+        glBindTexture(GL_TEXTURE_2D, textures[texture]);
+    }
+    program->enableAttributeArray("position");
+    program->enableAttributeArray("texCoord");
+    program->setAttributeArray("position", quad, 2);
+    program->setAttributeArray("texCoord", quadTexCoords, 2);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    program->disableAttributeArray("position");
+    program->disableAttributeArray("texCoord");
+    program->release();
+    glActiveTexture(GL_TEXTURE0);
+}
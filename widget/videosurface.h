@@ -0,0 +1,62 @@
+/*
+    Copyright (C) 2014 by Project Tox <https://tox.im>
+
+    This file is part of qTox, a Qt-based graphical interface for Tox.
+
+    This program is libre software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+
+    See the COPYING file for more details.
+*/
+
+#ifndef VIDEOSURFACE_H
+#define VIDEOSURFACE_H
+
+#include <QOpenGLWidget>
+#include <QOpenGLFunctions>
+#include <QByteArray>
+#include "videoframe.h"
+
+class QOpenGLShaderProgram;
+
+/// Draws I420 video with OpenGL. The planes are uploaded as three textures,
+/// the colour conversion happens in a fragment shader and the scaling in the texture sampler,
+/// so a frame costs the CPU one copy of its planes and nothing that depends on the widget size.
+class VideoSurface : public QOpenGLWidget, protected QOpenGLFunctions
+{
+    Q_OBJECT
+
+public:
+    VideoSurface(QWidget *parent=0);
+    ~VideoSurface();
+
+    static bool isAvailable(); ///< Whether we're allowed to and can create a context with shaders
+
+public slots:
+    void setFrame(const VideoFrame& frame); ///< Keeps a reference to the frame until the next repaint uploads it
+
+signals:
+    void failed(); ///< The context came up without working shaders, the owner should fall back to software
+
+protected:
+    void initializeGL();
+    void paintGL();
+
+private:
+    void uploadPlane(int texture, const uint8_t* data, int stride, int width, int height, bool reallocate); ///< Texture storage is only reallocated when the size changes
+
+private:
+    QOpenGLShaderProgram* program;
+    unsigned textures[3];
+    QSize textureSize;
+    VideoFrame frame; ///< Waiting to be uploaded, null once it's in the textures
+    bool broken;
+    QByteArray repack;
+};
+
+#endif // VIDEOSURFACE_H
@@ -21,15 +21,19 @@
 #include "friend.h"
 #include "friendlist.h"
 #include "widget/tool/friendrequestdialog.h"
-#include "widget/friendwidget.h"
 #include "grouplist.h"
 #include "group.h"
-#include "widget/groupwidget.h"
 #include "widget/form/groupchatform.h"
 #include "style.h"
 #include "selfcamview.h"
 #include "widget/friendlistwidget.h"
+#include "widget/contactlistmodel.h"
 #include "camera.h"
+#include "soundbank.h"
+#include "history.h"
+#include "transferhistory.h"
+#include "eventdispatcher.h"
+#include "startuptrace.h"
 #include "widget/form/chatform.h"
 #include "widget/settingsdialog.h"
 #include <QMessageBox>
@@ -47,13 +51,56 @@ Widget *Widget::instance{nullptr};
 Widget::Widget(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::MainWindow),
-      activeChatroomWidget{nullptr}
+      activeFriend{nullptr}, activeGroup{nullptr}
 {
     ui->setupUi(this);
 
     ui->statusbar->hide();
     ui->menubar->hide();
 
+    // Core starts first, so loading the profile overlaps with building the rest of the window.
+    // Its signals are queued, they only reach us once the event loop runs
+    camera = new Camera;
+
+    Core::registerMetaTypes();
+
+    coreThread = new QThread(this);
+    core = new Core(camera, coreThread);
+    core->moveToThread(coreThread);
+    connect(coreThread, &QThread::started, core, &Core::start);
+
+    connect(core, &Core::connected, this, &Widget::onConnected);
+    connect(core, &Core::disconnected, this, &Widget::onDisconnected);
+    connect(core, &Core::failedToStart, this, &Widget::onFailedToStartCore);
+    connect(core, &Core::statusSet, this, &Widget::onStatusSet);
+    connect(core, &Core::usernameSet, this, &Widget::setUsername);
+    connect(core, &Core::statusMessageSet, this, &Widget::setStatusMessage);
+    connect(core, &Core::fileTransferFinished, &filesForm, &FilesForm::onFileTransferFinished);
+    connect(core, &Core::fileTransferStats, &filesForm, &FilesForm::onFileTransferStats);
+    connect(core, &Core::friendAdded, this, &Widget::addFriend);
+    connect(core, &Core::friendListLoaded, this, &Widget::onFriendListLoaded);
+    connect(core, &Core::failedToAddFriend, this, &Widget::addFriendFailed);
+    connect(core, &Core::friendPresenceChanged, this, &Widget::onFriendPresenceChanged);
+    connect(core, &Core::friendUsernameLoaded, this, &Widget::onFriendUsernameLoaded);
+    connect(core, &Core::friendStatusMessageLoaded, this, &Widget::onFriendStatusMessageLoaded);
+    connect(core, &Core::friendRequestReceived, this, &Widget::onFriendRequestReceived);
+    EventDispatcher::getInstance().connectCore(core);
+    connect(core, &Core::videoFrameReceived, this, &Widget::onVideoFrameReceived);
+    connect(core, &Core::groupInviteReceived, this, &Widget::onGroupInviteReceived);
+    connect(core, &Core::groupMessagesReceived, this, &Widget::onGroupMessagesReceived);
+    connect(core, &Core::groupNamelistChanged, this, &Widget::onGroupNamelistChanged);
+    connect(core, &Core::emptyGroupCreated, this, &Widget::onEmptyGroupCreated);
+    connect(&Settings::getInstance(), &Settings::highlightWordsChanged, this, &Widget::updateMentionTerms);
+
+    connect(this, &Widget::statusSet, core, &Core::setStatus);
+    connect(this, &Widget::friendRequested, core, &Core::requestFriendship);
+    connect(this, &Widget::friendRequestAccepted, core, &Core::acceptFriendRequest);
+    connect(this, &Widget::windowMinimizedChanged, core, &Core::setWindowMinimized);
+
+    coreThread->setObjectName("Core");
+    instance = this; // Widget::getInstance may be called from the Core thread before we return
+    coreThread->start();
+
     //restore window state
     restoreGeometry(Settings::getInstance().getWindowGeometry());
     restoreState(Settings::getInstance().getWindowState());
@@ -77,7 +124,7 @@ Widget::Widget(QWidget *parent)
         ui->friendList->setObjectName("friendList");
         ui->friendList->setStyleSheet(Style::get(":ui/friendList/friendList.css"));
 
-        ui->tbMenu->setIcon(QIcon(":ui/window/applicationIcon.png"));
+        ui->tbMenu->setIcon(Style::getIcon(":ui/window/applicationIcon.png"));
         ui->pbMin->setObjectName("minimizeButton");
         ui->pbMax->setObjectName("maximizeButton");
         ui->pbClose->setObjectName("closeButton");
@@ -110,12 +157,19 @@ Widget::Widget(QWidget *parent)
     isWindowMinimized = 0;
 
     ui->mainContent->setLayout(new QVBoxLayout());
+    ui->mainContent->setStyleSheet(GenericChatForm::chatFormStyleSheet());
     ui->mainHead->setLayout(new QVBoxLayout());
     ui->mainHead->layout()->setMargin(0);
     ui->mainHead->layout()->setSpacing(0);
 
     contactListWidget = new FriendListWidget();
     ui->friendList->setWidget(contactListWidget);
+    ui->friendList->setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff); // the list view scrolls itself
+    connect(contactListWidget, &FriendListWidget::friendClicked, this, &Widget::onFriendChatroomClicked);
+    connect(contactListWidget, &FriendListWidget::groupClicked, this, &Widget::onGroupChatroomClicked);
+    connect(contactListWidget, &FriendListWidget::removeFriend, this, &Widget::removeFriend);
+    connect(contactListWidget, &FriendListWidget::copyFriendIdToClipboard, this, &Widget::copyFriendIdToClipboard);
+    connect(contactListWidget, &FriendListWidget::removeGroup, this, &Widget::removeGroup);
     ui->friendList->setLayoutDirection(Qt::RightToLeft);
 
     ui->nameLabel->setEditable(true);
@@ -131,11 +185,11 @@ Widget::Widget(QWidget *parent)
 
     QMenu *statusButtonMenu = new QMenu(ui->statusButton);
     QAction* setStatusOnline = statusButtonMenu->addAction(Widget::tr("Online","Button to set your status to 'Online'"));
-    setStatusOnline->setIcon(QIcon(":ui/statusButton/dot_online.png"));
+    setStatusOnline->setIcon(Style::getIcon(":ui/statusButton/dot_online.png"));
     QAction* setStatusAway = statusButtonMenu->addAction(Widget::tr("Away","Button to set your status to 'Away'"));
-    setStatusAway->setIcon(QIcon(":ui/statusButton/dot_idle.png"));
+    setStatusAway->setIcon(Style::getIcon(":ui/statusButton/dot_idle.png"));
     QAction* setStatusBusy = statusButtonMenu->addAction(Widget::tr("Busy","Button to set your status to 'Busy'"));
-    setStatusBusy->setIcon(QIcon(":ui/statusButton/dot_busy.png"));
+    setStatusBusy->setIcon(Style::getIcon(":ui/statusButton/dot_busy.png"));
     ui->statusButton->setMenu(statusButtonMenu);
 
     ui->titleBar->setMouseTracking(true);
@@ -155,52 +209,11 @@ Widget::Widget(QWidget *parent)
     ui->statusButton->setObjectName("offline");
     ui->statusButton->style()->polish(ui->statusButton);
 
-    camera = new Camera;
     settingsDialog = new SettingsDialog(this);
 
     // Disable some widgets until we're connected to the DHT
     ui->statusButton->setEnabled(false);
 
-    qRegisterMetaType<Status>("Status");
-    qRegisterMetaType<vpx_image>("vpx_image");
-    qRegisterMetaType<uint8_t>("uint8_t");
-    qRegisterMetaType<int32_t>("int32_t");
-    qRegisterMetaType<int64_t>("int64_t");
-    qRegisterMetaType<ToxFile>("ToxFile");
-    qRegisterMetaType<ToxFile::FileDirection>("ToxFile::FileDirection");
-
-    coreThread = new QThread(this);
-    core = new Core(camera, coreThread);
-    core->moveToThread(coreThread);
-    connect(coreThread, &QThread::started, core, &Core::start);
-
-    connect(core, &Core::connected, this, &Widget::onConnected);
-    connect(core, &Core::disconnected, this, &Widget::onDisconnected);
-    connect(core, &Core::failedToStart, this, &Widget::onFailedToStartCore);
-    connect(core, &Core::statusSet, this, &Widget::onStatusSet);
-    connect(core, &Core::usernameSet, this, &Widget::setUsername);
-    connect(core, &Core::statusMessageSet, this, &Widget::setStatusMessage);
-    connect(core, SIGNAL(fileDownloadFinished(const QString&)), &filesForm, SLOT(onFileDownloadComplete(const QString&)));
-    connect(core, SIGNAL(fileUploadFinished(const QString&)), &filesForm, SLOT(onFileUploadComplete(const QString&)));
-    connect(core, &Core::friendAdded, this, &Widget::addFriend);
-    connect(core, &Core::failedToAddFriend, this, &Widget::addFriendFailed);
-    connect(core, &Core::friendStatusChanged, this, &Widget::onFriendStatusChanged);
-    connect(core, &Core::friendUsernameChanged, this, &Widget::onFriendUsernameChanged);
-    connect(core, &Core::friendStatusChanged, this, &Widget::onFriendStatusChanged);
-    connect(core, &Core::friendStatusMessageChanged, this, &Widget::onFriendStatusMessageChanged);
-    connect(core, &Core::friendUsernameLoaded, this, &Widget::onFriendUsernameLoaded);
-    connect(core, &Core::friendStatusMessageLoaded, this, &Widget::onFriendStatusMessageLoaded);
-    connect(core, &Core::friendRequestReceived, this, &Widget::onFriendRequestReceived);
-    connect(core, &Core::friendMessageReceived, this, &Widget::onFriendMessageReceived);
-    connect(core, &Core::groupInviteReceived, this, &Widget::onGroupInviteReceived);
-    connect(core, &Core::groupMessageReceived, this, &Widget::onGroupMessageReceived);
-    connect(core, &Core::groupNamelistChanged, this, &Widget::onGroupNamelistChanged);
-    connect(core, &Core::emptyGroupCreated, this, &Widget::onEmptyGroupCreated);
-
-    connect(this, &Widget::statusSet, core, &Core::setStatus);
-    connect(this, &Widget::friendRequested, core, &Core::requestFriendship);
-    connect(this, &Widget::friendRequestAccepted, core, &Core::acceptFriendRequest);
-
     connect(ui->addButton, SIGNAL(clicked()), this, SLOT(onAddClicked()));
     connect(ui->groupButton, SIGNAL(clicked()), this, SLOT(onGroupClicked()));
     connect(ui->transferButton, SIGNAL(clicked()), this, SLOT(onTransferClicked()));
@@ -212,29 +225,29 @@ Widget::Widget(QWidget *parent)
     connect(setStatusBusy, SIGNAL(triggered()), this, SLOT(setStatusBusy()));
     connect(&friendForm, SIGNAL(friendRequested(QString,QString)), this, SIGNAL(friendRequested(QString,QString)));
 
-    coreThread->start();
-
     friendForm.show(*ui);
 }
 
 Widget::~Widget()
 {
-    core->saveConfiguration();
     instance = nullptr;
     coreThread->exit();
     coreThread->wait(500); // In case of deadlock (can happen with QtAudio/PA bugs)
     if (!coreThread->isFinished())
         coreThread->terminate();
-    delete core;
+    delete core; // Saves the profile and waits for it to be written
+    Settings::getInstance().save();
+    TransferHistory::shutdown(); // Its writer seals with the key of the logs
+    History::getInstance().shutdown();
 
     hideMainForms();
 
     for (Friend* f : FriendList::friendList)
         delete f;
-    FriendList::friendList.clear();
+    FriendList::clear();
     for (Group* g : GroupList::groupList)
         delete g;
-    GroupList::groupList.clear();
+    GroupList::clear();
     delete ui;
 }
 
@@ -270,6 +283,7 @@ Camera* Widget::getCamera()
 
 void Widget::onConnected()
 {
+    StartupTrace::finish();
     ui->statusButton->setEnabled(true);
     emit statusSet(Status::Online);
 }
@@ -330,7 +344,8 @@ void Widget::onTransferClicked()
 {
     hideMainForms();
     filesForm.show(*ui);
-    activeChatroomWidget = nullptr;
+    activeFriend = nullptr;
+    activeGroup = nullptr;
 }
 
 void Widget::onSettingsClicked()
@@ -346,10 +361,22 @@ void Widget::hideMainForms()
         item->widget()->hide();
     while ((item = ui->mainContent->layout()->takeAt(0)) != 0)
         item->widget()->hide();
-    
-    if (activeChatroomWidget != nullptr)
+
+    contactListWidget->getModel()->setActive(false, -1);
+}
+
+void Widget::resetActiveEventFlags()
+{
+    if (activeFriend)
+    {
+        activeFriend->hasNewEvents = 0;
+        contactListWidget->getModel()->updateFriend(activeFriend->friendId);
+    }
+    else if (activeGroup)
     {
-        activeChatroomWidget->setAsInactiveChatroom();
+        activeGroup->hasNewMessages = 0;
+        activeGroup->userWasMentioned = 0;
+        contactListWidget->getModel()->updateGroup(activeGroup->groupId);
     }
 }
 
@@ -364,6 +391,12 @@ void Widget::setUsername(const QString& username)
 {
     ui->nameLabel->setText(username);
     ui->nameLabel->setToolTip(username); // for overlength names
+    updateMentionTerms();
+}
+
+void Widget::updateMentionTerms()
+{
+    mentions.setTerms(QStringList(getUsername()) + Settings::getInstance().getHighlightWords());
 }
 
 void Widget::onStatusMessageChanged(const QString& newStatusMessage, const QString& oldStatusMessage)
@@ -383,32 +416,25 @@ void Widget::addFriend(int friendId, const QString &userId)
 {
 
     qDebug() << "Widget: Adding friend with id "+userId;
-    Friend* newfriend = FriendList::addFriend(friendId, userId);
-    QLayout* layout = contactListWidget->getFriendLayout(Status::Offline);
-    layout->addWidget(newfriend->widget);
-    connect(newfriend->widget, SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), this, SLOT(onChatroomWidgetClicked(GenericChatroomWidget*)));
-    connect(newfriend->widget, SIGNAL(removeFriend(int)), this, SLOT(removeFriend(int)));
-    connect(newfriend->widget, SIGNAL(copyFriendIdToClipboard(int)), this, SLOT(copyFriendIdToClipboard(int)));
-    connect(newfriend->widget, SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), newfriend->chatForm, SLOT(focusInput()));
-    connect(newfriend->chatForm, SIGNAL(sendMessage(int,QString)), core, SLOT(sendMessage(int,QString)));
-    connect(newfriend->chatForm, SIGNAL(sendFile(int32_t, QString, QString, long long)), core, SLOT(sendFile(int32_t, QString, QString, long long)));
-    connect(newfriend->chatForm, SIGNAL(answerCall(int)), core, SLOT(answerCall(int)));
-    connect(newfriend->chatForm, SIGNAL(hangupCall(int)), core, SLOT(hangupCall(int)));
-    connect(newfriend->chatForm, SIGNAL(startCall(int)), core, SLOT(startCall(int)));
-    connect(newfriend->chatForm, SIGNAL(startVideoCall(int,bool)), core, SLOT(startCall(int,bool)));
-    connect(newfriend->chatForm, SIGNAL(cancelCall(int,int)), core, SLOT(cancelCall(int,int)));
-    connect(newfriend->chatForm, SIGNAL(micMuteToggle(int)), core, SLOT(micMuteToggle(int)));
-    connect(core, &Core::fileReceiveRequested, newfriend->chatForm, &ChatForm::onFileRecvRequest);
-    connect(core, &Core::avInvite, newfriend->chatForm, &ChatForm::onAvInvite);
-    connect(core, &Core::avStart, newfriend->chatForm, &ChatForm::onAvStart);
-    connect(core, &Core::avCancel, newfriend->chatForm, &ChatForm::onAvCancel);
-    connect(core, &Core::avEnd, newfriend->chatForm, &ChatForm::onAvEnd);
-    connect(core, &Core::avRinging, newfriend->chatForm, &ChatForm::onAvRinging);
-    connect(core, &Core::avStarting, newfriend->chatForm, &ChatForm::onAvStarting);
-    connect(core, &Core::avEnding, newfriend->chatForm, &ChatForm::onAvEnding);
-    connect(core, &Core::avRequestTimeout, newfriend->chatForm, &ChatForm::onAvRequestTimeout);
-    connect(core, &Core::avPeerTimeout, newfriend->chatForm, &ChatForm::onAvPeerTimeout);
-    connect(core, &Core::avMediaChange, newfriend->chatForm, &ChatForm::onAvMediaChange);
+    FriendList::addFriend(friendId, userId); // its chat form is only made once it's needed
+    contactListWidget->getModel()->addFriend(friendId);
+}
+
+void Widget::onFriendListLoaded(const QList<FriendInfo>& friends)
+{
+    qDebug() << "Widget: Loading" << friends.size() << "friends";
+    QList<int> ids;
+    ids.reserve(friends.size());
+    for (const FriendInfo& info : friends)
+    {
+        Friend* f = FriendList::addFriend(info.friendId, info.userId);
+        if (!info.name.isEmpty())
+            f->setName(info.name);
+        f->setStatusMessage(info.statusMessage);
+        f->lastSeen = info.lastSeen;
+        ids << info.friendId;
+    }
+    contactListWidget->getModel()->addFriends(ids);
 }
 
 void Widget::addFriendFailed(const QString&)
@@ -416,70 +442,91 @@ void Widget::addFriendFailed(const QString&)
     QMessageBox::critical(0,"Error","Couldn't request friendship");
 }
 
-void Widget::onFriendStatusChanged(int friendId, Status status)
+void Widget::onFriendPresenceChanged(const QList<FriendPresence>& updates)
 {
-    Friend* f = FriendList::findFriend(friendId);
-    if (!f)
-        return;
-
-    contactListWidget->moveWidget(f->widget, status);
-
-    f->friendStatus = status;
-    f->widget->updateStatusLight();
-
-    // Workaround widget style after returning to list
-    if (f->widget->isActive())
-        f->widget->setAsActiveChatroom();
+    for (const FriendPresence& presence : updates)
+    {
+        Friend* f = FriendList::findFriend(presence.friendId);
+        if (!f)
+            continue;
+
+        if (presence.hasStatus)
+            f->friendStatus = presence.status;
+        if (presence.hasName)
+            f->setName(presence.name);
+        if (presence.hasStatusMessage)
+            f->setStatusMessage(presence.statusMessage);
+        contactListWidget->getModel()->updateFriend(presence.friendId);
+    }
 }
 
-void Widget::onFriendStatusMessageChanged(int friendId, const QString& message)
+void Widget::onFriendStatusMessageLoaded(int friendId, const QString& message)
 {
     Friend* f = FriendList::findFriend(friendId);
     if (!f)
         return;
 
     f->setStatusMessage(message);
+    contactListWidget->getModel()->updateFriend(friendId);
 }
 
-void Widget::onFriendUsernameChanged(int friendId, const QString& username)
+void Widget::onFriendUsernameLoaded(int friendId, const QString& username)
 {
     Friend* f = FriendList::findFriend(friendId);
     if (!f)
         return;
 
     f->setName(username);
+    contactListWidget->getModel()->updateFriend(friendId);
 }
 
-void Widget::onFriendStatusMessageLoaded(int friendId, const QString& message)
+void Widget::onFriendChatroomClicked(int friendId)
 {
     Friend* f = FriendList::findFriend(friendId);
     if (!f)
         return;
 
-    f->setStatusMessage(message);
+    hideMainForms();
+    f->getChatForm()->show(*ui);
+    activeFriend = f;
+    activeGroup = nullptr;
+    contactListWidget->getModel()->setActive(false, friendId);
+    resetActiveEventFlags();
+    f->getChatForm()->focusInput();
 }
 
-void Widget::onFriendUsernameLoaded(int friendId, const QString& username)
+void Widget::onGroupChatroomClicked(int groupId)
 {
-    Friend* f = FriendList::findFriend(friendId);
-    if (!f)
+    Group* g = GroupList::findGroup(groupId);
+    if (!g)
         return;
 
-    f->setName(username);
+    hideMainForms();
+    g->chatForm->show(*ui);
+    activeFriend = nullptr;
+    activeGroup = g;
+    contactListWidget->getModel()->setActive(true, groupId);
+    resetActiveEventFlags();
+    g->chatForm->focusInput();
 }
 
-void Widget::onChatroomWidgetClicked(GenericChatroomWidget *widget)
+void Widget::onGroupUserListChanged(int groupId)
 {
-    hideMainForms();
-    widget->setChatForm(*ui);
-    if (activeChatroomWidget != nullptr)
-    {
-        activeChatroomWidget->setAsInactiveChatroom();
-    }
-    activeChatroomWidget = widget;
-    widget->setAsActiveChatroom();
-    widget->resetEventFlags();
-    widget->updateStatusLight();
+    contactListWidget->getModel()->updateGroup(groupId);
+}
+
+void Widget::updateFriendStatusLight(int friendId)
+{
+    contactListWidget->getModel()->updateFriend(friendId);
+}
+
+void Widget::onVideoFrameReceived(int friendId, int callId, const VideoFrame& frame)
+{
+    // Only the call's own view converts the frame, then Core may queue the next one
+    Friend* f = FriendList::findFriend(friendId);
+    if (f && f->chatForm)
+        f->chatForm->showVideoFrame(callId, frame);
+    core->videoFrameDisplayed(callId);
 }
 
 void Widget::onFriendMessageReceived(int friendId, const QString& message)
@@ -488,43 +535,23 @@ void Widget::onFriendMessageReceived(int friendId, const QString& message)
     if (!f)
         return;
 
-    f->chatForm->addMessage(f->getName(), message);
+    f->getChatForm()->addMessage(f->getName(), message);
 
-    if (activeChatroomWidget != nullptr)
-    {
-        if ((static_cast<GenericChatroomWidget*>(f->widget) != activeChatroomWidget) || isWindowMinimized || !isActiveWindow())
-        {
-            f->hasNewEvents = 1;
-            newMessageAlert();
-        }
-    }
-    else
+    if (f != activeFriend || isWindowMinimized || !isActiveWindow())
     {
         f->hasNewEvents = 1;
         newMessageAlert();
     }
 
-    f->widget->updateStatusLight();
+    contactListWidget->getModel()->updateFriend(friendId);
 }
 
 void Widget::newMessageAlert()
 {
     QApplication::alert(this);
 
-    static QFile sndFile(":audio/notification.pcm");
-    static QByteArray sndData;
-    if (sndData.isEmpty())
-    {
-        sndFile.open(QIODevice::ReadOnly);
-        sndData = sndFile.readAll();
-        sndFile.close();
-    }
-
-    ALuint buffer;
-    alGenBuffers(1, &buffer);
-    alBufferData(buffer, AL_FORMAT_MONO16, sndData.data(), sndData.size(), 44100);
-    alSourcei(core->alMainSource, AL_BUFFER, buffer);
-    alSourcePlay(core->alMainSource);
+    if (Core::soundBank)
+        Core::soundBank->play(SoundBank::NewMessage);
 }
 
 void Widget::onFriendRequestReceived(const QString& userId, const QString& message)
@@ -538,9 +565,14 @@ void Widget::onFriendRequestReceived(const QString& userId, const QString& messa
 void Widget::removeFriend(int friendId)
 {
     Friend* f = FriendList::findFriend(friendId);
-    f->widget->setAsInactiveChatroom();
-    if (static_cast<GenericChatroomWidget*>(f->widget) == activeChatroomWidget)
-        activeChatroomWidget = nullptr;
+    if (!f)
+        return;
+    if (f == activeFriend)
+    {
+        activeFriend = nullptr;
+        contactListWidget->getModel()->setActive(false, -1);
+    }
+    contactListWidget->getModel()->removeFriend(friendId);
     FriendList::removeFriend(friendId);
     core->removeFriend(friendId);
     delete f;
@@ -568,27 +600,30 @@ void Widget::onGroupInviteReceived(int32_t friendId, const uint8_t* publicKey)
     }
 }
 
-void Widget::onGroupMessageReceived(int groupnumber, int friendgroupnumber, const QString& message)
+void Widget::onGroupMessagesReceived(int groupnumber, const QList<GroupMessage>& messages)
 {
     Group* g = GroupList::findGroup(groupnumber);
     if (!g)
         return;
 
-    g->chatForm->addGroupMessage(message, friendgroupnumber);
+    g->chatForm->addGroupMessages(messages);
 
-    if ((static_cast<GenericChatroomWidget*>(g->widget) != activeChatroomWidget) || isWindowMinimized || !isActiveWindow())
+    if (g != activeGroup || isWindowMinimized || !isActiveWindow())
     {
         g->hasNewMessages = 1;
-        if (message.contains(core->getUsername(), Qt::CaseInsensitive))
+        for (const GroupMessage& msg : messages)
         {
+            if (!mentions.matches(msg.message))
+                continue;
             newMessageAlert();
             g->userWasMentioned = 1;
+            break;
         }
-        g->widget->updateStatusLight();
+        contactListWidget->getModel()->updateGroup(groupnumber);
     }
 }
 
-void Widget::onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t Change)
+void Widget::onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t Change, const QString& peerName)
 {
     Group* g = GroupList::findGroup(groupnumber);
     if (!g)
@@ -600,7 +635,7 @@ void Widget::onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t Cha
     TOX_CHAT_CHANGE change = static_cast<TOX_CHAT_CHANGE>(Change);
     if (change == TOX_CHAT_CHANGE_PEER_ADD)
     {
-        QString name = core->getGroupPeerName(groupnumber, peernumber);
+        QString name = peerName;
         if (name.isEmpty())
             name = tr("<Unknown>", "Placeholder when we don't know someone's name in a group chat");
         g->addPeer(peernumber,name);
@@ -608,15 +643,20 @@ void Widget::onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t Cha
     else if (change == TOX_CHAT_CHANGE_PEER_DEL)
         g->removePeer(peernumber);
     else if (change == TOX_CHAT_CHANGE_PEER_NAME)
-        g->updatePeer(peernumber,core->getGroupPeerName(groupnumber, peernumber));
+        g->updatePeer(peernumber, peerName);
 }
 
 void Widget::removeGroup(int groupId)
 {
     Group* g = GroupList::findGroup(groupId);
-    g->widget->setAsInactiveChatroom();
-    if (static_cast<GenericChatroomWidget*>(g->widget) == activeChatroomWidget)
-        activeChatroomWidget = nullptr;
+    if (!g)
+        return;
+    if (g == activeGroup)
+    {
+        activeGroup = nullptr;
+        contactListWidget->getModel()->setActive(true, -1);
+    }
+    contactListWidget->getModel()->removeGroup(groupId);
     GroupList::removeGroup(groupId);
     core->removeGroup(groupId);
     delete g;
@@ -640,13 +680,9 @@ Group *Widget::createGroup(int groupId)
 
     QString groupName = QString("Groupchat #%1").arg(groupId);
     Group* newgroup = GroupList::addGroup(groupId, groupName);
-    QLayout* layout = contactListWidget->getGroupLayout();
-    layout->addWidget(newgroup->widget);
-    newgroup->widget->updateStatusLight();
+    contactListWidget->getModel()->addGroup(groupId);
 
-    connect(newgroup->widget, SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), this, SLOT(onChatroomWidgetClicked(GenericChatroomWidget*)));
-    connect(newgroup->widget, SIGNAL(removeGroup(int)), this, SLOT(removeGroup(int)));
-    connect(newgroup->widget, SIGNAL(chatroomWidgetClicked(GenericChatroomWidget*)), newgroup->chatForm, SLOT(focusInput()));
+    connect(newgroup, &Group::userListChanged, this, &Widget::onGroupUserListChanged);
     connect(newgroup->chatForm, SIGNAL(sendMessage(int,QString)), core, SLOT(sendGroupMessage(int,QString)));
     return newgroup;
 }
@@ -661,7 +697,7 @@ bool Widget::isFriendWidgetCurActiveWidget(Friend* f)
     if (!f)
         return false;
 
-    if (activeChatroomWidget == static_cast<GenericChatroomWidget*>(f->widget))
+    if (f == activeFriend)
         return true;
     else
         return false;
@@ -675,6 +711,7 @@ bool Widget::event(QEvent * e)
         if(windowState().testFlag(Qt::WindowMinimized) == true)
         {
             isWindowMinimized = 1;
+            emit windowMinimizedChanged(true);
         }
     }
     else if (e->type() == QEvent::WindowActivate)
@@ -684,12 +721,10 @@ bool Widget::event(QEvent * e)
             this->setObjectName("activeWindow");
             this->style()->polish(this);
         }
+        if (isWindowMinimized)
+            emit windowMinimizedChanged(false);
         isWindowMinimized = 0;
-        if (activeChatroomWidget != nullptr)
-        {
-            activeChatroomWidget->resetEventFlags();
-            activeChatroomWidget->updateStatusLight();
-        }
+        resetActiveEventFlags();
     }
     else if (e->type() == QEvent::WindowDeactivate && !Settings::getInstance().getUseNativeDecoration())
     {
@@ -1009,12 +1044,12 @@ void Widget::maximizeBtnClicked()
 {
     if (isFullScreen() or isMaximized())
     {
-        ui->pbMax->setIcon(QIcon(":/ui/images/app_max.png"));
+        ui->pbMax->setIcon(Style::getIcon(":/ui/images/app_max.png"));
         setWindowState(windowState() & ~Qt::WindowFullScreen & ~Qt::WindowMaximized);
     }
     else
     {
-        ui->pbMax->setIcon(QIcon(":/ui/images/app_rest.png"));
+        ui->pbMax->setIcon(Style::getIcon(":/ui/images/app_rest.png"));
         setWindowState(windowState() | Qt::WindowFullScreen | Qt::WindowMaximized);
     }
 }
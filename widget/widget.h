@@ -21,6 +21,7 @@
 #include "widget/form/addfriendform.h"
 #include "widget/form/filesform.h"
 #include "corestructs.h"
+#include "widget/tool/mentionmatcher.h"
 
 #define PIXELS_TO_ACT 7
 
@@ -28,7 +29,6 @@ namespace Ui {
 class MainWindow;
 }
 
-class GenericChatroomWidget;
 class Group;
 struct Friend;
 class QSplitter;
@@ -38,6 +38,7 @@ class Core;
 class Camera;
 class FriendListWidget;
 class SettingsDialog;
+class VideoFrame;
 
 class Widget : public QMainWindow
 {
@@ -56,6 +57,7 @@ public:
     static Widget* getInstance();
     void newMessageAlert();
     bool isFriendWidgetCurActiveWidget(Friend* f);
+    void updateFriendStatusLight(int friendId); ///< Repaints the friend's row after its event flags changed
     bool getIsWindowMinimized();
     ~Widget();
 
@@ -68,6 +70,10 @@ signals:
     void statusSelected(Status status);
     void usernameChanged(const QString& username);
     void statusMessageChanged(const QString& statusMessage);
+    void windowMinimizedChanged(bool minimized);
+
+public slots:
+    void onFriendMessageReceived(int friendId, const QString& message); ///< EventDispatcher drains the messages from Core's ring
 
 private slots:
     void maximizeBtnClicked();
@@ -85,31 +91,34 @@ private slots:
     void setUsername(const QString& username);
     void setStatusMessage(const QString &statusMessage);
     void addFriend(int friendId, const QString& userId);
+    void onFriendListLoaded(const QList<FriendInfo>& friends);
     void addFriendFailed(const QString& userId);
-    void onFriendStatusChanged(int friendId, Status status);
-    void onFriendStatusMessageChanged(int friendId, const QString& message);
-    void onFriendUsernameChanged(int friendId, const QString& username);
+    void onFriendPresenceChanged(const QList<FriendPresence>& updates);
     void onFriendStatusMessageLoaded(int friendId, const QString& message);
     void onFriendUsernameLoaded(int friendId, const QString& username);
-    void onChatroomWidgetClicked(GenericChatroomWidget *);
-    void onFriendMessageReceived(int friendId, const QString& message);
+    void onFriendChatroomClicked(int friendId);
+    void onGroupChatroomClicked(int groupId);
+    void onGroupUserListChanged(int groupId);
+    void onVideoFrameReceived(int friendId, int callId, const VideoFrame& frame);
     void onFriendRequestReceived(const QString& userId, const QString& message);
     void onEmptyGroupCreated(int groupId);
     void onGroupInviteReceived(int32_t friendId, const uint8_t *publicKey);
-    void onGroupMessageReceived(int groupnumber, int friendgroupnumber, const QString& message);
-    void onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t change);
+    void onGroupMessagesReceived(int groupnumber, const QList<GroupMessage>& messages);
+    void onGroupNamelistChanged(int groupnumber, int peernumber, uint8_t change, const QString& peerName);
     void removeFriend(int friendId);
     void copyFriendIdToClipboard(int friendId);
     void removeGroup(int groupId);
     void setStatusOnline();
     void setStatusAway();
     void setStatusBusy();
+    void updateMentionTerms(); ///< Our name and the highlight words
 
 protected slots:
     void moveWindow(QMouseEvent *e);
 
 private:
     void hideMainForms();
+    void resetActiveEventFlags();
     Group* createGroup(int groupId);
 
 private:
@@ -137,8 +146,10 @@ private:
     FilesForm filesForm;
     SettingsDialog* settingsDialog;
     static Widget* instance;
-    GenericChatroomWidget* activeChatroomWidget;
+    Friend* activeFriend;
+    Group* activeGroup; ///< At most one of activeFriend and activeGroup is set
     FriendListWidget* contactListWidget;
+    MentionMatcher mentions;
     Camera* camera;
     bool notify(QObject *receiver, QEvent *event);
     bool eventFilter(QObject *, QEvent *event);